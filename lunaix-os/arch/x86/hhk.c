@@ -23,6 +23,9 @@
 // use table #9
 #define PG_TABLE_STACK 8
 
+// 为 multiboot info 预留的空间，见 boot.S 中的 mb_info
+#define MB_INFO_SIZE 4096
+
 // Provided by linker (see linker.ld)
 extern uint8_t __kernel_start;
 extern uint8_t __kernel_end;
@@ -81,14 +84,26 @@ _init_page(ptd_t* ptd)
     // 计算内核.text段的物理地址
     uintptr_t kernel_pm = V2P(&__kernel_start);
 
-    // 重映射内核至高半区地址（>=0xC0000000）
+    // 内核映像的首个4MiB（包括低1MiB与hhk）直接使用一个大页映射，以减少TLB缺失。
+    //  由于 V2P 为线性偏移，该大页的物理基地址恰为0。
+    //  内核映像为所有地址空间共享，故标记为全局页，切换地址空间时无需重新载入。
+    // FIXME: 只是用作用户模式（R3）测试！
+    //        在实际中，内核代码除了极少部分需要暴露给R3（如从信号返回），其余的应为R0。
+    SET_PDE(ptd,
+            kernel_pde_index,
+            NEW_L1_LARGE_ENTRY(PG_PREM_URW | PG_GLOBAL,
+                               V2P(kernel_pde_index << 22)))
+
+    // 重映射超出大页部分的内核至高半区地址（>=0xC0000000）
     for (u32_t i = 0; i < kernel_pg_counts; i++) {
-        // FIXME: 只是用作用户模式（R3）测试！
-        //        在实际中，内核代码除了极少部分需要暴露给R3（如从信号返回），其余的应为R0。
+        if (kernel_pte_index + i < PG_MAX_ENTRIES) {
+            continue;
+        }
         SET_PTE(ptd,
                 PG_TABLE_KERNEL,
                 kernel_pte_index + i,
-                NEW_L2_ENTRY(PG_PREM_URW, kernel_pm + (i << PG_SIZE_BITS)))
+                NEW_L2_ENTRY(PG_PREM_URW | PG_GLOBAL,
+                             kernel_pm + (i << PG_SIZE_BITS)))
     }
 
     // 最后一个entry用于循环映射
@@ -126,6 +141,17 @@ _save_multiboot_info(multiboot_info_t* info, uint8_t* destination)
                                  (uint8_t*)info->drives_addr,
                                  info->drives_length);
     }
+
+    // 内核命令行，超出 mb_info 预留空间（见 boot.S）的部分截去
+    if (present(info->flags, MULTIBOOT_INFO_CMDLINE)) {
+        uint8_t* cmdline = (uint8_t*)info->cmdline;
+        ((multiboot_info_t*)destination)->cmdline =
+          (uintptr_t)destination + current;
+        while (*cmdline && current < MB_INFO_SIZE - 1) {
+            destination[current++] = *cmdline++;
+        }
+        destination[current] = '\0';
+    }
 }
 
 void
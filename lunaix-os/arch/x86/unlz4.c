@@ -0,0 +1,152 @@
+/**
+ * @file unlz4.c
+ * @brief 解压随内核一同载入的 LZ4 映像（见 makefile 中的 KERNEL_LZ4）。
+ *
+ *  运行于开启分页之前，只能访问物理地址，且不可调用高半核中的任何函数
+ *  （包括编译器可能隐式生成的 memcpy 调用），故复制均以 rep movsb 完成。
+ *
+ */
+#include <arch/x86/boot/unlz4.h>
+#include <lunaix/mm/page.h>
+
+#define sym_val(sym) (uintptr_t)(&sym)
+
+// 由 link/linker-lz4.ld 提供，未压缩的内核中不存在，弱引用的地址即为0
+extern uint8_t __kpayload_start __attribute__((weak));
+extern uint8_t __kpayload_end __attribute__((weak));
+
+extern uint8_t __kernel_start;
+extern uint8_t __kernel_end;
+
+static inline void
+__unlz4_copy(uint8_t* dst, const uint8_t* src, u32_t len)
+{
+    // 逐字节向前复制的语义恰好满足重叠的匹配（offset < len）
+    asm volatile("rep movsb"
+                 : "+D"(dst), "+S"(src), "+c"(len)
+                 :
+                 : "memory");
+}
+
+static inline u32_t
+__unlz4_length(const uint8_t** src, const uint8_t* end, u32_t len)
+{
+    u8_t b;
+    if (len != 15) {
+        return len;
+    }
+
+    do {
+        if (*src >= end) {
+            return (u32_t)-1;
+        }
+        b = *(*src)++;
+        len += b;
+    } while (b == 255);
+
+    return len;
+}
+
+/**
+ * @brief 解压一个 LZ4 块
+ *
+ * @return int 解压所得的字节数，数据有误则为-1
+ */
+static int
+__unlz4_block(const uint8_t* src, u32_t len, uint8_t* dst, u32_t cap)
+{
+    const uint8_t* end = src + len;
+    uint8_t* out = dst;
+
+    while (src < end) {
+        u8_t token = *src++;
+
+        u32_t lit = __unlz4_length(&src, end, token >> 4);
+        if (lit > (u32_t)(end - src) || lit > cap - (out - dst)) {
+            return -1;
+        }
+
+        __unlz4_copy(out, src, lit);
+        out += lit;
+        src += lit;
+
+        // 块中的最后一个序列只有字面量
+        if (src >= end) {
+            break;
+        }
+
+        if (end - src < 2) {
+            return -1;
+        }
+
+        u32_t offset = src[0] | (src[1] << 8);
+        src += 2;
+
+        u32_t match = __unlz4_length(&src, end, token & 0xf);
+        if (match == (u32_t)-1) {
+            return -1;
+        }
+        match += LZ4_MIN_MATCH;
+
+        if (!offset || offset > (u32_t)(out - dst) ||
+            match > cap - (out - dst)) {
+            return -1;
+        }
+
+        __unlz4_copy(out, out - offset, match);
+        out += match;
+    }
+
+    return out - dst;
+}
+
+int
+_hhk_unlz4(const uint8_t* src, u32_t len, uint8_t* dst, u32_t cap)
+{
+    const uint8_t* end = src + len;
+    u32_t total = 0;
+
+    while (end - src >= 4) {
+        u32_t word = src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
+        src += 4;
+
+        // 旧式帧以魔数开头，多个帧可首尾相接
+        if (word == LZ4_LEGACY_MAGIC) {
+            continue;
+        }
+
+        if (word > (u32_t)(end - src)) {
+            return -1;
+        }
+
+        int n = __unlz4_block(src, word, dst + total, cap - total);
+        if (n < 0) {
+            return -1;
+        }
+
+        src += word;
+        total += n;
+    }
+
+    return total;
+}
+
+void
+_hhk_unpack_kernel()
+{
+    uintptr_t payload = sym_val(__kpayload_start);
+    if (!payload) {
+        return;
+    }
+
+    // 载荷位于内核映像之后，解压至内核各段的物理地址
+    uint8_t* src = (uint8_t*)V2P(payload);
+    uint8_t* dst = (uint8_t*)V2P(sym_val(__kernel_start));
+    u32_t len = sym_val(__kpayload_end) - payload;
+    u32_t cap = sym_val(__kernel_end) - sym_val(__kernel_start);
+
+    if (_hhk_unlz4(src, len, dst, cap) < 0) {
+        // 映像已损坏，此时尚无任何输出的手段
+        asm("ud2");
+    }
+}
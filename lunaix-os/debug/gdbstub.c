@@ -34,6 +34,8 @@
 
 #include <hal/io.h>
 #include <klibc/string.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/vmm.h>
 #include <lunaix/peripheral/serial.h>
 #include <sdbg/gdbstub.h>
 
@@ -93,6 +95,14 @@ struct gdb_state
 
 #define GDB_EOF (-1)
 
+/*
+ * Largest packet we accept, advertised to GDB through qSupported. A memory
+ * read replies with two hex digits per byte, hence the size of the scratch
+ * buffer used for memory transfers.
+ */
+#define GDB_PKT_SIZE 4096
+#define GDB_MEM_CHUNK (GDB_PKT_SIZE / 2)
+
 #ifndef NULL
 #define NULL ((void*)0)
 #endif
@@ -118,9 +128,17 @@ gdb_sys_getc(struct gdb_state* state);
 int
 gdb_sys_putchar(struct gdb_state* state, int ch);
 int
-gdb_sys_mem_readb(struct gdb_state* state, address addr, char* val);
+gdb_sys_write(struct gdb_state* state, const char* buf, unsigned int len);
+int
+gdb_sys_mem_read(struct gdb_state* state,
+                 address addr,
+                 char* buf,
+                 unsigned int len);
 int
-gdb_sys_mem_writeb(struct gdb_state* state, address addr, char val);
+gdb_sys_mem_write(struct gdb_state* state,
+                  address addr,
+                  const char* buf,
+                  unsigned int len);
 int
 gdb_sys_continue(struct gdb_state* state);
 int
@@ -706,19 +724,16 @@ gdb_mem_read(struct gdb_state* state,
              unsigned int len,
              gdb_enc_func enc)
 {
-    char data[64];
-    unsigned int pos;
+    static char data[GDB_MEM_CHUNK];
 
     if (len > sizeof(data)) {
         return GDB_EOF;
     }
 
     /* Read from system memory */
-    for (pos = 0; pos < len; pos++) {
-        if (gdb_sys_mem_readb(state, addr + pos, &data[pos])) {
-            /* Failed to read */
-            return GDB_EOF;
-        }
+    if (gdb_sys_mem_read(state, addr, data, len)) {
+        /* Failed to read */
+        return GDB_EOF;
     }
 
     /* Encode data */
@@ -736,24 +751,23 @@ gdb_mem_write(struct gdb_state* state,
               unsigned int len,
               gdb_dec_func dec)
 {
-    char data[64];
-    unsigned int pos;
+    static char data[GDB_MEM_CHUNK];
+    int status;
 
     if (len > sizeof(data)) {
         return GDB_EOF;
     }
 
-    /* Decode data */
-    if (dec(buf, buf_len, data, len) == GDB_EOF) {
+    /* Decode data. gdb_dec_bin reports the decoded length, check it too */
+    status = dec(buf, buf_len, data, len);
+    if (status == GDB_EOF || (status && (unsigned int)status != len)) {
         return GDB_EOF;
     }
 
     /* Write to system memory */
-    for (pos = 0; pos < len; pos++) {
-        if (gdb_sys_mem_writeb(state, addr + pos, data[pos])) {
-            /* Failed to write */
-            return GDB_EOF;
-        }
+    if (gdb_sys_mem_write(state, addr, data, len)) {
+        /* Failed to write */
+        return GDB_EOF;
     }
 
     return 0;
@@ -884,13 +898,7 @@ gdb_send_error_packet(struct gdb_state* state,
 static int
 gdb_write(struct gdb_state* state, const char* buf, unsigned int len)
 {
-    while (len--) {
-        if (gdb_sys_putchar(state, *buf++) == GDB_EOF) {
-            return GDB_EOF;
-        }
-    }
-
-    return 0;
+    return gdb_sys_write(state, buf, len);
 }
 
 /*
@@ -933,8 +941,8 @@ gdb_read(struct gdb_state* state,
 int
 gdb_main(struct gdb_state* state)
 {
+    static char pkt_buf[GDB_PKT_SIZE];
     address addr;
-    char pkt_buf[256];
     int status;
     unsigned int length;
     unsigned int pkt_len;
@@ -1150,6 +1158,28 @@ gdb_main(struct gdb_state* state)
                   state, pkt_buf, sizeof(pkt_buf), state->signum);
                 break;
 
+            /*
+             * General Query
+             * Command Format: qSupported[:gdbfeature...]
+             *
+             * Only the packet size is negotiated, which lets GDB move
+             * GDB_MEM_CHUNK bytes per m/M/X packet instead of its default.
+             */
+            case 'q':
+                if (pkt_len < 10 || memcmp(pkt_buf, "qSupported", 10)) {
+                    gdb_send_packet(state, 0, 0);
+                    break;
+                }
+
+                memcpy(pkt_buf, "PacketSize=", 11);
+                pkt_len = 11;
+                for (int shift = 12; shift >= 0; shift -= 4) {
+                    pkt_buf[pkt_len++] =
+                      gdb_get_digit((GDB_PKT_SIZE >> shift) & 0xf);
+                }
+                gdb_send_packet(state, pkt_buf, pkt_len);
+                break;
+
             /*
              * Unsupported Command
              */
@@ -1285,22 +1315,70 @@ gdb_sys_getc(struct gdb_state* state)
 }
 
 /*
- * Read one byte from memory.
+ * Write a sequence of bytes to the debugging stream.
  */
 int
-gdb_sys_mem_readb(struct gdb_state* state, address addr, char* val)
+gdb_sys_write(struct gdb_state* state, const char* buf, unsigned int len)
 {
-    *val = *(volatile char*)addr;
+    serial_tx_buffer(COM_PORT, buf, len);
     return 0;
 }
 
 /*
- * Write one byte to memory.
+ * Check that every page in [addr, addr + len) is present, so that GDB
+ * poking at a bad address gets an error reply rather than a page fault
+ * raised from within the debugger.
+ */
+static int
+gdb_x86_mem_present(address addr, unsigned int len)
+{
+    v_mapping mapping;
+    address end = addr + len;
+
+    if (end < addr) {
+        return 0;
+    }
+
+    for (addr = PG_ALIGN(addr); addr < end; addr += PG_SIZE) {
+        if (!vmm_lookup(addr, &mapping) || !(mapping.flags & PG_PRESENT)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Read a block of memory.
  */
 int
-gdb_sys_mem_writeb(struct gdb_state* state, address addr, char val)
+gdb_sys_mem_read(struct gdb_state* state,
+                 address addr,
+                 char* buf,
+                 unsigned int len)
 {
-    *(volatile char*)addr = val;
+    if (!gdb_x86_mem_present(addr, len)) {
+        return GDB_EOF;
+    }
+
+    memcpy(buf, (void*)addr, len);
+    return 0;
+}
+
+/*
+ * Write a block of memory.
+ */
+int
+gdb_sys_mem_write(struct gdb_state* state,
+                  address addr,
+                  const char* buf,
+                  unsigned int len)
+{
+    if (!gdb_x86_mem_present(addr, len)) {
+        return GDB_EOF;
+    }
+
+    memcpy((void*)addr, buf, len);
     return 0;
 }
 
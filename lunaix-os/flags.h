@@ -15,6 +15,49 @@
 */
 // #define USE_KERNEL_PG
 
+/*
+    Uncomment below to ask the bootloader for a linear framebuffer, on which
+   the console is then rendered instead of the VGA text mode
+*/
+// #define LUNAIX_FBCON
+
+/*
+    Uncomment below to count every syscall and record its latency (in TSC
+   cycles), both system-wide and per process
+*/
+// #define LUNAIX_SYSCALL_STAT
+
+/*
+    Uncomment below to collect per lock class contention and hold time of
+   spinlocks, and to catch recursive locking and unbalanced unlocks. Also
+   collects per class sleepers and blocked time of wait queues
+*/
+// #define LUNAIX_LOCKSTAT
+
+/*
+    Uncomment below to sample the interrupted EIP and kernel backtrace on
+   every timer tick, see lunaix/profiler.h
+*/
+// #define LUNAIX_PROFILER
+
+/*
+    Uncomment below to compile in the static tracepoints, each of which can
+   then be switched on at runtime, see lunaix/trace.h
+*/
+// #define LUNAIX_TRACEPOINTS
+
+/*
+    Uncomment below to count cycles, instructions, LLC and dTLB misses with
+   the performance counters, per task, see hal/pmc.h
+*/
+// #define LUNAIX_PMC
+
+/*
+    Uncomment below to run a micro-benchmark of the open-addressing hash map
+   against the chained one during boot, results go to the kernel log
+*/
+// #define LUNAIX_HMAP_BENCH
+
 /*
     Uncomment below to disable all assertion
 */
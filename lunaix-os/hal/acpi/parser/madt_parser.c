@@ -18,9 +18,16 @@ madt_parse(acpi_madt_t* madt, acpi_context* toc)
     while (ics_start < ics_end) {
         acpi_ics_hdr_t* entry = (acpi_ics_hdr_t*)ics_start;
         switch (entry->type) {
-            case ACPI_MADT_LAPIC:
-                toc->madt.apic = (acpi_apic_t*)entry;
+            case ACPI_MADT_LAPIC: {
+                acpi_apic_t* apic = (acpi_apic_t*)entry;
+                if (!toc->madt.apic) {
+                    toc->madt.apic = apic;
+                }
+                if (toc->madt.apic_count < ACPI_MADT_MAX_APIC) {
+                    toc->madt.apics[toc->madt.apic_count++] = apic;
+                }
                 break;
+            }
             case ACPI_MADT_IOAPIC:
                 toc->madt.ioapic = (acpi_ioapic_t*)entry;
                 break;
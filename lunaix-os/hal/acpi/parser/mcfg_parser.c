@@ -16,8 +16,9 @@ mcfg_parse(acpi_sdthdr_t* mcfg, acpi_context* toc)
     toc->mcfg.allocations = valloc(sizeof(struct mcfg_alloc_info) * alloc_num);
 
     for (size_t i = 0; i < alloc_num; i++) {
+        // 4GiB以上的窗口无法映射，记为0，其上的总线退回至端口访问
         toc->mcfg.allocations[i] = (struct mcfg_alloc_info){
-            .base_addr = allocs[i].base_addr_lo,
+            .base_addr = allocs[i].base_addr_hi ? 0 : allocs[i].base_addr_lo,
             .pci_bus_start = allocs[i].pci_bus_start,
             .pci_bus_end = allocs[i].pci_bus_end,
             .pci_seg_num = allocs[i].pci_seg_num,
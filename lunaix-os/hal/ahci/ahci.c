@@ -29,11 +29,15 @@
 
 #define HBA_MY_IE (HBA_PxINTR_DHR | HBA_PxINTR_TFE | HBA_PxINTR_OF)
 
+// 等待所有端口上的设备就绪的最大轮数
+#define AHCI_READY_SPIN 1000000
+
 // #define DO_HBA_FULL_RESET
 
 LOG_MODULE("AHCI")
 
 struct llist_header ahcis;
+static int nr_hbas = 0;
 
 static char sata_ifs[][20] = { "Not detected",
                                "SATA I (1.5Gbps)",
@@ -77,6 +81,59 @@ __hba_reset_port(hba_reg_t* port_reg)
     port_reg[HBA_RPxSCTL] &= ~0xf;
 }
 
+/**
+ * @brief 找出 ports 中 regs[reg] & mask 不为零的端口
+ *
+ */
+static u32_t
+__ahci_ports_test(struct ahci_hba* hba, u32_t ports, int reg, hba_reg_t mask)
+{
+    u32_t matched = 0;
+    for (; ports; ports &= ports - 1) {
+        u32_t i = __builtin_ctz(ports);
+        if ((hba->ports[i]->regs[reg] & mask)) {
+            matched |= 1 << i;
+        }
+    }
+    return matched;
+}
+
+/**
+ * @brief 同 __hba_reset_port，但对所有端口一并进行：
+ * 先全部停止，再统一等待，对未响应的端口则同时进行COMRESET
+ *
+ */
+static void
+__ahci_reset_ports(struct ahci_hba* hba, u32_t ports)
+{
+    for (u32_t p = ports; p; p &= p - 1) {
+        volatile hba_reg_t* regs = hba->ports[__builtin_ctz(p)]->regs;
+        regs[HBA_RPxCMD] &= ~HBA_PxCMD_ST;
+        regs[HBA_RPxCMD] &= ~HBA_PxCMD_FRE;
+    }
+
+    u32_t stuck;
+    wait_until_expire(
+      !(stuck = __ahci_ports_test(hba, ports, HBA_RPxCMD, HBA_PxCMD_CR)),
+      500000);
+
+    if (!stuck) {
+        return;
+    }
+
+    for (u32_t p = stuck; p; p &= p - 1) {
+        volatile hba_reg_t* regs = hba->ports[__builtin_ctz(p)]->regs;
+        regs[HBA_RPxSCTL] = (regs[HBA_RPxSCTL] & ~0xf) | 1;
+    }
+
+    io_delay(100000); //等待至少一毫秒，差不多就行了
+
+    for (u32_t p = stuck; p; p &= p - 1) {
+        volatile hba_reg_t* regs = hba->ports[__builtin_ctz(p)]->regs;
+        regs[HBA_RPxSCTL] &= ~0xf;
+    }
+}
+
 void
 ahci_init()
 {
@@ -97,12 +154,36 @@ ahci_driver_init(struct pci_device* ahci_dev)
 
     pci_write_cspace(ahci_dev->cspace_base, PCI_REG_STATUS_CMD, cmd);
 
-    int iv = isrm_ivexalloc(__ahci_hba_isr);
-    pci_setup_msi(ahci_dev, iv);
-
     struct ahci_driver* ahci_drv = vzalloc(sizeof(*ahci_drv));
     struct ahci_hba* hba = &ahci_drv->hba;
-    ahci_drv->id = iv;
+
+    // 有多个MSI-X向量时，各端口的中断互不相干，无须再于ISR中逐一排查
+    int nr_ivs = MIN(pci_msix_count(ahci_dev), PCI_MSIX_MAX);
+    if (nr_ivs > 1) {
+        for (int i = 0; i < nr_ivs; i++) {
+            ahci_drv->ivs[i] = isrm_ivexalloc(__ahci_hba_isr);
+        }
+        if (!pci_setup_msix(ahci_dev, ahci_drv->ivs, nr_ivs)) {
+            ahci_drv->nr_ivs = nr_ivs;
+        } else {
+            for (int i = 0; i < nr_ivs; i++) {
+                isrm_ivfree(ahci_drv->ivs[i]);
+            }
+        }
+    }
+
+    if (!ahci_drv->nr_ivs) {
+        ahci_drv->id = isrm_ivexalloc(__ahci_hba_isr);
+        ahci_drv->intrs[0] = (struct ahci_intr){ .hba = hba, .ports = -1 };
+        isrm_set_payload(ahci_drv->id, (ptr_t)&ahci_drv->intrs[0]);
+        pci_setup_msi(ahci_dev, ahci_drv->id);
+    }
+
+    for (int i = 0; i < ahci_drv->nr_ivs; i++) {
+        u32_t ports = i == nr_ivs - 1 ? ~((1U << i) - 1) : (1U << i);
+        ahci_drv->intrs[i] = (struct ahci_intr){ .hba = hba, .ports = ports };
+        isrm_set_payload(ahci_drv->ivs[i], (ptr_t)&ahci_drv->intrs[i]);
+    }
 
     llist_append(&ahcis, &ahci_drv->ahci_drvs);
 
@@ -126,8 +207,24 @@ ahci_driver_init(struct pci_device* ahci_dev)
     hba->cmd_slots = (cap >> 8) & 0x1f; // CAP.NCS
     hba->version = hba->base[HBA_RVER];
     hba->ports_bmp = pmap;
+    hba->cap = cap;
 
     /* ------ HBA端口配置 ------ */
+    // 端口重置与等待设备就绪都颇为耗时（各达数百毫秒），故分阶段对所有端口
+    //  一并进行，使各端口的等待相互重叠，而不是逐个端口串行地等待
+    for (u32_t i = 0; i < 32; i++) {
+        if ((pmap & (1 << i))) {
+            hba->ports[i] = (struct hba_port*)valloc(sizeof(struct hba_port));
+            hba->ports[i]->regs =
+              (hba_reg_t*)(&hba->base[HBA_RPBASE + i * HBA_RPSIZE]);
+        }
+    }
+
+#ifndef DO_HBA_FULL_RESET
+    __ahci_reset_ports(hba, pmap);
+#endif
+
+    u32_t present = 0;
     uintptr_t clb_pg_addr, fis_pg_addr, clb_pa, fis_pa;
     for (size_t i = 0, fisp = 0, clbp = 0; i < 32;
          i++, pmap >>= 1, fisp = (fisp + 1) % 16, clbp = (clbp + 1) % 4) {
@@ -135,24 +232,18 @@ ahci_driver_init(struct pci_device* ahci_dev)
             continue;
         }
 
-        struct hba_port* port =
-          (struct hba_port*)valloc(sizeof(struct hba_port));
-        hba_reg_t* port_regs =
-          (hba_reg_t*)(&hba->base[HBA_RPBASE + i * HBA_RPSIZE]);
-
-#ifndef DO_HBA_FULL_RESET
-        __hba_reset_port(port_regs);
-#endif
+        struct hba_port* port = hba->ports[i];
+        hba_reg_t* port_regs = (hba_reg_t*)port->regs;
 
         if (!clbp) {
             // 每页最多4个命令队列
-            clb_pa = pmm_alloc_page(KERNEL_PID, PP_FGLOCKED);
+            clb_pa = pmm_alloc_page(KERNEL_PID, PP_FGLOCKED | PP_GFP_DMA);
             clb_pg_addr = ioremap(clb_pa, 0x1000);
             memset(clb_pg_addr, 0, 0x1000);
         }
         if (!fisp) {
             // 每页最多16个FIS
-            fis_pa = pmm_alloc_page(KERNEL_PID, PP_FGLOCKED);
+            fis_pa = pmm_alloc_page(KERNEL_PID, PP_FGLOCKED | PP_GFP_DMA);
             fis_pg_addr = ioremap(fis_pa, 0x1000);
             memset(fis_pg_addr, 0, 0x1000);
         }
@@ -172,8 +263,6 @@ ahci_driver_init(struct pci_device* ahci_dev)
 
         hba_clear_reg(port_regs[HBA_RPxSERR]);
 
-        hba->ports[i] = port;
-
         if (!HBA_RPxSSTS_IF(port->ssts)) {
             continue;
         }
@@ -182,21 +271,40 @@ ahci_driver_init(struct pci_device* ahci_dev)
         port_regs[HBA_RPxCMD] |= HBA_PxCMD_FRE;
         port_regs[HBA_RPxCMD] |= HBA_PxCMD_ST;
 
+        present |= 1 << i;
+    }
+
+    // 设备（如刚经COMRESET的硬盘）就绪前不接受命令，一并等待所有端口
+    hba_reg_t busy = HBA_PxTFD_BSY | HBA_PxTFD_DRQ;
+    wait_until_expire(!__ahci_ports_test(hba, present, HBA_RPxTFD, busy),
+                      AHCI_READY_SPIN);
+
+    for (; present; present &= present - 1) {
+        u32_t i = __builtin_ctz(present);
+        struct hba_port* port = hba->ports[i];
+
         if (!ahci_init_device(port)) {
             kprintf(KERROR "init fail: 0x%x@p%d\n", port->regs[HBA_RPxSIG], i);
             continue;
         }
 
         struct hba_device* hbadev = port->device;
-        kprintf(KINFO "sata%d: %s, blk_size=%d, blk=0..%d\n",
+        if (!(cap & HBA_CAP_SNCQ)) {
+            hbadev->flags &= ~HBA_DEV_FNCQ;
+        }
+
+        kprintf(KINFO "sata%d: %s, blk_size=%d, blk=0..%d, ncq=%d\n",
                 i,
                 hbadev->model,
                 hbadev->block_size,
-                (u32_t)hbadev->max_lba);
+                (u32_t)hbadev->max_lba,
+                (hbadev->flags & HBA_DEV_FNCQ) ? hbadev->queue_depth : 0);
 
         ahci_register_device(hbadev);
     }
 
+    ahci_ccc_init(hba, nr_hbas++);
+
     return ahci_drv;
 }
 
@@ -208,6 +316,22 @@ ahci_register_device(struct hba_device* hbadev)
 
     bdev->end_lba = hbadev->max_lba;
     bdev->blk_size = hbadev->block_size;
+    // 相邻的请求可合并为一条命令，其缓冲区段数受PRDT长度所限
+    bdev->blkio->max_segs = HBA_MAX_VBUF_SEGS;
+    // 同步请求可轮询PxCI以获知完成，而不必等待中断，默认不启用
+    bdev->blkio->poll = ahci_blkio_poll;
+
+    // TRIM独占端口（见 blkio_commit），故每个设备一张范围表便足够
+    if ((hbadev->flags & HBA_DEV_FTRIM)) {
+        hbadev->dsm_buf = valloc_dma(SATA_DSM_BLOCK);
+        bdev->blkio->max_discard = SATA_DSM_ENTRIES * SATA_DSM_RANGE_MAX;
+    }
+
+    // 支持NCQ时，允许同时在途的请求数取设备队列深度与HBA命令槽位数中的较小者
+    if ((hbadev->flags & HBA_DEV_FNCQ)) {
+        bdev->blkio->depth =
+          MIN(hbadev->queue_depth, hbadev->hba->cmd_slots + 1);
+    }
 
     block_mount(bdev, ahci_fsexport);
 }
@@ -217,7 +341,9 @@ __get_free_slot(struct hba_port* port)
 {
     hba_reg_t pxsact = port->regs[HBA_RPxSACT];
     hba_reg_t pxci = port->regs[HBA_RPxCI];
-    hba_reg_t free_bmp = pxsact | pxci;
+    // 已完成但尚未经中断处理的槽位同样不可复用
+    hba_reg_t free_bmp =
+      pxsact | pxci | port->cmdctx.tracked_ci | port->cmdctx.deferred;
     u32_t i = 0;
     for (; i <= port->hba->cmd_slots && (free_bmp & 0x1); i++, free_bmp >>= 1)
         ;
@@ -259,19 +385,40 @@ int
 hba_bind_vbuf(struct hba_cmdh* cmdh, struct hba_cmdt* cmdt, struct vecbuf* vbuf)
 {
     size_t i = 0;
-    struct vecbuf* pos = vbuf;
+    uintptr_t prev_end = 0;
+    struct membuf* seg;
 
-    do {
-        assert_msg(i < HBA_MAX_PRDTE, "HBA: Too many PRDTEs");
-        assert_msg(pos->buf.size <= 0x400000, "HBA: Buffer too big");
-
-        cmdt->entries[i++] =
-          (struct hba_prdte){ .data_base = vmm_v2p(pos->buf.buffer),
-                              .byte_count = pos->buf.size - 1 };
-        pos = list_entry(pos->components.next, struct vecbuf, components);
-    } while (pos != vbuf);
+    /*
+        缓冲区在虚拟地址上连续，但在物理上未必如此（如用户空间或vmap所得的缓冲区）。
+        故逐页转换地址，每遇物理上的不连续处便另起一个PRDT项；
+        物理上恰好相接的页则并入前一项，以节省表项。
+    */
+    vbuf_foreach(seg, vbuf)
+    {
+        uintptr_t va = (uintptr_t)seg->buffer;
+        size_t left = seg->size;
+
+        while (left) {
+            uintptr_t pa = vmm_v2p((void*)va);
+            size_t chunk = MIN(left, PG_SIZE - (va & (PG_SIZE - 1)));
+
+            if (i && prev_end == pa &&
+                cmdt->entries[i - 1].byte_count + 1 + chunk <= 0x400000) {
+                cmdt->entries[i - 1].byte_count += chunk;
+            } else {
+                assert_msg(i < HBA_MAX_PRDTE, "HBA: Too many PRDTEs");
+                cmdt->entries[i++] = (struct hba_prdte){
+                    .data_base = pa, .byte_count = chunk - 1
+                };
+            }
+
+            prev_end = pa + chunk;
+            va += chunk;
+            left -= chunk;
+        }
+    }
 
-    cmdh->prdt_len = i + 1;
+    cmdh->prdt_len = i;
 }
 
 int
@@ -284,10 +431,13 @@ hba_prepare_cmd(struct hba_port* port,
 
     // 构建命令头（Command Header）和命令表（Command Table）
     struct hba_cmdh* cmd_header = &port->cmdlst[slot];
-    struct hba_cmdt* cmd_table = vzalloc_dma(sizeof(struct hba_cmdt));
+    struct hba_cmdt* cmd_table = port->cmdctx.states[slot].cmd_table;
 
     memset(cmd_header, 0, sizeof(*cmd_header));
 
+    // 命令表是复用的，PRDT由绑定缓冲区时重写，在此只需清空命令FIS
+    memset(cmd_table->command_fis, 0, sizeof(struct sata_reg_fis));
+
     // 将命令表挂到命令头上
     cmd_header->cmd_table_base = vmm_v2p(cmd_table);
     cmd_header->options =
@@ -299,6 +449,25 @@ hba_prepare_cmd(struct hba_port* port,
     return slot;
 }
 
+static int
+__hba_alloc_cmd_tables(struct hba_port* port)
+{
+    struct hba_cmd_state* states = port->cmdctx.states;
+
+    // 重新识别设备时沿用已有的命令表
+    if (states[0].cmd_table) {
+        return 1;
+    }
+
+    for (u32_t i = 0; i <= port->hba->cmd_slots; i++) {
+        if (!(states[i].cmd_table = vzalloc_dma(sizeof(struct hba_cmdt)))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 int
 ahci_init_device(struct hba_port* port)
 {
@@ -309,6 +478,10 @@ ahci_init_device(struct hba_port* port)
     // mask DHR interrupt
     port->regs[HBA_RPxIE] &= ~HBA_MY_IE;
 
+    if (!__hba_alloc_cmd_tables(port)) {
+        return 0;
+    }
+
     // 预备DMA接收缓存，用于存放HBA传回的数据
     uint16_t* data_in = (uint16_t*)valloc_dma(512);
 
@@ -401,14 +574,12 @@ done:
     achi_register_ops(port);
 
     vfree_dma(data_in);
-    vfree_dma(cmd_table);
 
     return 1;
 
 fail:
     port->regs[HBA_RPxIE] |= HBA_MY_IE;
     vfree_dma(data_in);
-    vfree_dma(cmd_table);
 
     return 0;
 }
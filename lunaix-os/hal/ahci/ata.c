@@ -2,6 +2,7 @@
 #include <hal/ahci/hba.h>
 #include <hal/ahci/sata.h>
 
+#include <klibc/string.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/spike.h>
@@ -15,6 +16,36 @@ sata_read_error(struct hba_port* port)
     port->device->last_result.status = tfd & 0x00ff;
 }
 
+static void
+__sata_setup_trim(struct hba_device* dev,
+                  struct hba_cmdh* header,
+                  struct hba_cmdt* table,
+                  struct blkio_req* io_req)
+{
+    struct sata_reg_fis* fis = (struct sata_reg_fis*)table->command_fis;
+    u64_t* ranges = (u64_t*)dev->dsm_buf;
+    u64_t lba = io_req->blk_addr;
+    u32_t left = io_req->blk_count;
+
+    // 块数为0的项会被设备忽略
+    memset(ranges, 0, SATA_DSM_BLOCK);
+    for (int i = 0; left && i < SATA_DSM_ENTRIES; i++) {
+        u32_t n = MIN(left, SATA_DSM_RANGE_MAX);
+        ranges[i] = (lba & 0xffffffffffffULL) | ((u64_t)n << 48);
+        lba += n;
+        left -= n;
+    }
+
+    hba_bind_sbuf(header,
+                  table,
+                  (struct membuf){ .buffer = ranges, .size = SATA_DSM_BLOCK });
+    header->options |= HBA_CMDH_WRITE;
+
+    // 扇区数寄存器为范围表所占的块数
+    sata_create_fis(fis, ATA_DATA_SET_MANAGEMENT, 0, 1);
+    fis->head.feat_err = ATA_DSM_TRIM;
+}
+
 void
 sata_submit(struct hba_device* dev, struct blkio_req* io_req)
 {
@@ -24,14 +55,43 @@ sata_submit(struct hba_device* dev, struct blkio_req* io_req)
 
     int write = !!(io_req->flags & BLKIO_WRITE);
     int slot = hba_prepare_cmd(port, &table, &header);
-    hba_bind_vbuf(header, table, io_req->vbuf);
+    struct sata_reg_fis* fis = (struct sata_reg_fis*)table->command_fis;
+
+    // 刷新与TRIM均为非排队命令，由blkio保证发出时端口上没有其他命令
+    int ncq = !!(port->device->flags & HBA_DEV_FNCQ) &&
+              !(io_req->flags & BLKIO_EXCL);
+
+    if ((io_req->flags & BLKIO_FLUSH)) {
+        // 无数据传输，PRDT为空
+        sata_create_fis(fis,
+                        (port->device->flags & HBA_DEV_FEXTLBA)
+                          ? ATA_FLUSH_CACHE_EXT
+                          : ATA_FLUSH_CACHE,
+                        0,
+                        0);
+        goto post;
+    }
+
+    if ((io_req->flags & BLKIO_DISCARD)) {
+        __sata_setup_trim(port->device, header, table, io_req);
+        goto post;
+    }
+
+    hba_bind_vbuf(header, table, &io_req->vbuf);
 
     header->options |= HBA_CMDH_WRITE * write;
 
-    uint16_t count = ICEIL(vbuf_size(io_req->vbuf), port->device->block_size);
-    struct sata_reg_fis* fis = (struct sata_reg_fis*)table->command_fis;
+    uint16_t count = ICEIL(vbuf_size(&io_req->vbuf), port->device->block_size);
 
-    if ((port->device->flags & HBA_DEV_FEXTLBA)) {
+    if (ncq) {
+        // 第一方DMA排队命令：扇区数移至特征寄存器，扇区数寄存器则用于标记槽位
+        sata_create_fis(fis,
+                        write ? ATA_WRITE_FPDMA_QUEUED : ATA_READ_FPDMA_QUEUED,
+                        io_req->blk_addr,
+                        SATA_NCQ_TAG(slot));
+        fis->head.feat_err = count & 0xff;
+        fis->feature = count >> 8;
+    } else if ((port->device->flags & HBA_DEV_FEXTLBA)) {
         // 如果该设备支持48位LBA寻址
         sata_create_fis(fis,
                         write ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT,
@@ -41,6 +101,8 @@ sata_submit(struct hba_device* dev, struct blkio_req* io_req)
         sata_create_fis(
           fis, write ? ATA_WRITE_DMA : ATA_READ_DMA, io_req->blk_addr, count);
     }
+
+post:
     /*
           确保我们使用的是LBA寻址模式
           注意：在ACS-3中（甚至在ACS-4），只有在(READ/WRITE)_DMA_EXT指令中明确注明了需要将这一位置位
@@ -53,7 +115,13 @@ sata_submit(struct hba_device* dev, struct blkio_req* io_req)
     fis->dev = (1 << 6);
 
     // The async way...
-    struct hba_cmd_state* cmds = valloc(sizeof(struct hba_cmd_state));
-    *cmds = (struct hba_cmd_state){ .cmd_table = table, .state_ctx = io_req };
+    struct hba_cmd_state* cmds = &port->cmdctx.states[slot];
+    cmds->state_ctx = io_req;
+
+    // NCQ命令须在PxCI之前于PxSACT中登记，其完成以PxSACT中对应位的清零为准
+    if (ncq) {
+        port->regs[HBA_RPxSACT] = 1 << slot;
+    }
+
     ahci_post(port, cmds, slot);
 }
\ No newline at end of file
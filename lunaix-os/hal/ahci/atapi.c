@@ -48,6 +48,20 @@ scsi_parse_capacity(struct hba_device* device, u32_t* parameter)
     }
 }
 
+static void
+__scsi_setup_sync(struct hba_cmdh* header, struct hba_cmdt* table)
+{
+    struct sata_reg_fis* fis = (struct sata_reg_fis*)table->command_fis;
+    uint8_t* cdb = table->atapi_cmd;
+
+    header->options |= HBA_CMDH_ATAPI;
+
+    // LBA与块数均为0，即同步整个介质；无数据传输
+    memset(cdb, 0, sizeof(table->atapi_cmd));
+    cdb[0] = SCSI_SYNC_CACHE_10;
+    sata_create_fis(fis, ATA_PACKET, 0, 0);
+}
+
 void
 scsi_submit(struct hba_device* dev, struct blkio_req* io_req)
 {
@@ -55,18 +69,38 @@ scsi_submit(struct hba_device* dev, struct blkio_req* io_req)
     struct hba_cmdh* header;
     struct hba_cmdt* table;
 
+    // ATAPI设备不支持TRIM（其 max_discard 为0），以ABRT拒绝
+    if ((io_req->flags & BLKIO_DISCARD)) {
+        io_req->errcode = (0x4 << 8) | HBA_PxTFD_ERR;
+        io_req->flags |= BLKIO_ERROR;
+        blkio_complete_async(io_req);
+        return;
+    }
+
+    if ((io_req->flags & BLKIO_FLUSH)) {
+        int slot = hba_prepare_cmd(port, &table, &header);
+        __scsi_setup_sync(header, table);
+
+        struct hba_cmd_state* cmds = &port->cmdctx.states[slot];
+        cmds->state_ctx = io_req;
+        ahci_post(port, cmds, slot);
+        return;
+    }
+
     int write = !!(io_req->flags & BLKIO_WRITE);
     int slot = hba_prepare_cmd(port, &table, &header);
-    hba_bind_vbuf(header, table, io_req->vbuf);
+    hba_bind_vbuf(header, table, &io_req->vbuf);
 
     header->options |= (HBA_CMDH_WRITE * (write == 1)) | HBA_CMDH_ATAPI;
 
-    size_t size = vbuf_size(io_req->vbuf);
+    size_t size = vbuf_size(&io_req->vbuf);
     u32_t count = ICEIL(size, port->device->block_size);
 
     struct sata_reg_fis* fis = (struct sata_reg_fis*)table->command_fis;
     void* cdb = table->atapi_cmd;
-    sata_create_fis(fis, ATA_PACKET, (size << 8), 0);
+    memset(cdb, 0, sizeof(table->atapi_cmd));
+    // 字节数上限仅有16位，多块传输可达64KiB，须截断以免溢出（DMA传输时不使用）
+    sata_create_fis(fis, ATA_PACKET, (MIN(size, 0xfffe) << 8), 0);
     fis->feature = 1 | ((!write) << 2);
 
     if (port->device->cbd_size == SCSI_CDB16) {
@@ -85,7 +119,7 @@ scsi_submit(struct hba_device* dev, struct blkio_req* io_req)
     *((uint8_t*)cdb + 1) = 3 << 5; // RPROTECT=011b 禁用保护检查
 
     // The async way...
-    struct hba_cmd_state* cmds = valloc(sizeof(struct hba_cmd_state));
-    *cmds = (struct hba_cmd_state){ .cmd_table = table, .state_ctx = io_req };
+    struct hba_cmd_state* cmds = &port->cmdctx.states[slot];
+    cmds->state_ctx = io_req;
     ahci_post(port, cmds, slot);
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+/**
+ * @file ccc.c
+ * @brief AHCI命令完成合并（Command Completion Coalescing, AHCI spec 10.11）
+ *
+ * 启用后，参与合并的端口不再为每个完成的命令单独引发中断，而是在累积到
+ * count 个完成，或自首个完成起经过 timeout 毫秒后，由 HBA 统一引发一次，
+ * 并在 HBA_RIS 中以 CCC_CTL.INT 所指的位报告。
+ *
+ * 可经由 /ahci/hba<N>/ccc_enable, ccc_count, ccc_timeout 调整。
+ *
+ */
+#include <hal/ahci/ahci.h>
+#include <hal/ahci/hba.h>
+#include <hal/cpu.h>
+#include <klibc/stdio.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/spike.h>
+
+#define CCC_DEFAULT_COUNT 8
+#define CCC_DEFAULT_TIMEOUT 1
+
+static struct twifs_node* ahci_root;
+
+void
+ahci_ccc_apply(struct ahci_hba* hba)
+{
+    if (!(hba->cap & HBA_CAP_CCCS)) {
+        return;
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // CC与TV仅可在CCC未启用时修改
+    hba_reg_t ctl = hba->base[HBA_RCCC_CTL] & ~HBA_CCC_EN;
+    hba->base[HBA_RCCC_CTL] = ctl;
+
+    ctl = (ctl & 0xff) | HBA_CCC_CC(hba->ccc.count) |
+          HBA_CCC_TV(hba->ccc.timeout);
+    hba->base[HBA_RCCC_CTL] = ctl;
+
+    if (hba->ccc.enabled) {
+        hba->base[HBA_RCCC_PORTS] = hba->ccc.ports;
+        hba->base[HBA_RCCC_CTL] = ctl | HBA_CCC_EN;
+    } else {
+        hba->base[HBA_RCCC_PORTS] = 0;
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+static u32_t
+__parse_u32(const char* str, size_t len)
+{
+    u32_t val = 0;
+    for (size_t i = 0; i < len && '0' <= str[i] && str[i] <= '9'; i++) {
+        val = val * 10 + (str[i] - '0');
+    }
+    return val;
+}
+
+static int
+__ccc_rd_enable(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ahci_hba* hba = twinode_getdata(inode, struct ahci_hba*);
+    return fpos ? 0 : ksnprintf(buffer, len, "%u\n", hba->ccc.enabled);
+}
+
+static int
+__ccc_wr_enable(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ahci_hba* hba = twinode_getdata(inode, struct ahci_hba*);
+    hba->ccc.enabled = !!__parse_u32(buffer, len);
+    ahci_ccc_apply(hba);
+    return len;
+}
+
+static int
+__ccc_rd_count(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ahci_hba* hba = twinode_getdata(inode, struct ahci_hba*);
+    return fpos ? 0 : ksnprintf(buffer, len, "%u\n", hba->ccc.count);
+}
+
+static int
+__ccc_wr_count(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ahci_hba* hba = twinode_getdata(inode, struct ahci_hba*);
+    // 0 会使计数条件失效，仅余超时
+    hba->ccc.count = MIN(MAX(__parse_u32(buffer, len), 1), 255);
+    ahci_ccc_apply(hba);
+    return len;
+}
+
+static int
+__ccc_rd_timeout(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ahci_hba* hba = twinode_getdata(inode, struct ahci_hba*);
+    return fpos ? 0 : ksnprintf(buffer, len, "%u\n", hba->ccc.timeout);
+}
+
+static int
+__ccc_wr_timeout(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ahci_hba* hba = twinode_getdata(inode, struct ahci_hba*);
+    // 超时为0是保留值
+    hba->ccc.timeout = MIN(MAX(__parse_u32(buffer, len), 1), 0xffff);
+    ahci_ccc_apply(hba);
+    return len;
+}
+
+static void
+__ccc_node(struct twifs_node* dir,
+           const char* name,
+           struct ahci_hba* hba,
+           int (*rd)(struct v_inode*, void*, size_t, foff_t),
+           int (*wr)(struct v_inode*, void*, size_t, foff_t))
+{
+    struct twifs_node* node = twifs_file_node(dir, name);
+    node->data = hba;
+    node->ops.read = rd;
+    node->ops.write = wr;
+}
+
+void
+ahci_ccc_init(struct ahci_hba* hba, int index)
+{
+    if (!(hba->cap & HBA_CAP_CCCS)) {
+        return;
+    }
+
+    hba->ccc.enabled = 0;
+    hba->ccc.count = CCC_DEFAULT_COUNT;
+    hba->ccc.timeout = CCC_DEFAULT_TIMEOUT;
+    hba->ccc.intr = HBA_CCC_INT(hba->base[HBA_RCCC_CTL]);
+    hba->ccc.ports = hba->ports_bmp;
+
+    ahci_ccc_apply(hba);
+
+    if (!ahci_root) {
+        ahci_root = twifs_dir_node(NULL, "ahci");
+    }
+
+    struct twifs_node* dir = twifs_dir_node(ahci_root, "hba%d", index);
+    __ccc_node(dir, "ccc_enable", hba, __ccc_rd_enable, __ccc_wr_enable);
+    __ccc_node(dir, "ccc_count", hba, __ccc_rd_count, __ccc_wr_count);
+    __ccc_node(dir, "ccc_timeout", hba, __ccc_rd_timeout, __ccc_wr_timeout);
+}
@@ -47,6 +47,13 @@ __blk_rd_wwid(struct twimap* map)
     }
 }
 
+void
+__blk_rd_post_stalls(struct twimap* map)
+{
+    struct hba_device* hbadev = twimap_data(map, struct hba_device*);
+    twimap_printf(map, "%u", hbadev->port->cmdctx.stalls);
+}
+
 void
 ahci_fsexport(struct block_dev* bdev, void* fs_node)
 {
@@ -67,4 +74,7 @@ ahci_fsexport(struct block_dev* bdev, void* fs_node)
 
     map = twifs_mapping(dev_root, bdev->driver, "alignment_offset");
     map->read = __blk_rd_aoffset;
+
+    map = twifs_mapping(dev_root, bdev->driver, "post_stalls");
+    map->read = __blk_rd_post_stalls;
 }
\ No newline at end of file
@@ -1,75 +1,201 @@
 #include <hal/ahci/ahci.h>
 #include <hal/ahci/sata.h>
+#include <hal/io.h>
 #include <lunaix/isrm.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
 #include <lunaix/syslog.h>
 
 LOG_MODULE("io_evt")
 
-extern struct llist_header ahcis;
+// 错误恢复后，非肇事请求至多被重新提交的次数
+#define AHCI_MAX_RETRIES 3
 
-void
-__ahci_hba_isr(const isr_param* param)
+static void
+__ahci_port_restart(struct hba_port* port)
 {
-    struct ahci_hba* hba;
-    struct ahci_driver *pos, *n;
-    llist_for_each(pos, n, &ahcis, ahci_drvs)
-    {
-        if (pos->id == param->vector) {
-            hba = &pos->hba;
-            goto proceed;
-        }
+    volatile hba_reg_t* regs = port->regs;
+
+    __hba_reset_port((hba_reg_t*)regs);
+
+    // 停止命令引擎后设备仍忙，则须经COMRESET方可恢复
+    if (hba_port_busy(port)) {
+        regs[HBA_RPxSCTL] = (regs[HBA_RPxSCTL] & ~0xf) | 1;
+        io_delay(100000);
+        regs[HBA_RPxSCTL] &= ~0xf;
+        wait_until_expire(HBA_RPxSSTS_PHYSTATE(regs[HBA_RPxSSTS]) == 3,
+                          1000000);
     }
 
-    return;
+    hba_clear_reg(regs[HBA_RPxSERR]);
+    hba_clear_reg(regs[HBA_RPxIS]);
 
-proceed:
-    // ignore spurious interrupt
-    if (!hba->base[HBA_RIS])
-        return;
+    wait_until_expire(!(regs[HBA_RPxCMD] & (HBA_PxCMD_CR | HBA_PxCMD_FR)),
+                      500000);
+    regs[HBA_RPxCMD] |= HBA_PxCMD_FRE;
+    regs[HBA_RPxCMD] |= HBA_PxCMD_ST;
+}
 
-    u32_t port_num = 31 - __builtin_clz(hba->base[HBA_RIS]);
-    struct hba_port* port = hba->ports[port_num];
+/**
+ * @brief 致命错误的恢复，参照 AHCI spec 6.2.2.1：
+ * 停止并重启端口（必要时进行COMRESET），之后处理所有未完成的命令——
+ * 引发设备错误的命令以 BLKIO_ERROR 完成，其余受牵连的命令则重新提交。
+ *
+ * 对于NCQ命令，无法（在不读取NCQ错误日志的前提下）确定肇事者，
+ * 因此全部重新提交，由重试次数加以限制。
+ */
+static void
+__ahci_port_recover(struct hba_port* port, u32_t intr)
+{
     struct hba_cmd_context* cmdctx = &port->cmdctx;
-    u32_t processed = port->regs[HBA_RPxCI] ^ cmdctx->tracked_ci;
+    struct blkio_req* retry[32];
+    int nr_retry = 0;
+
+    u32_t tfd = port->regs[HBA_RPxTFD];
+    u32_t ccs = (port->regs[HBA_RPxCMD] >> 8) & 0x1f;
+    int ncq = !!(port->device->flags & HBA_DEV_FNCQ);
+    u32_t outstanding = cmdctx->tracked_ci | cmdctx->deferred;
+
+    kprintf(KWARN "port error: IS=%x TFD=%x SERR=%x, recovering\n",
+            intr,
+            tfd,
+            port->regs[HBA_RPxSERR]);
+
+    __ahci_port_restart(port);
+
+    cmdctx->tracked_ci = 0;
+    cmdctx->deferred = 0;
+
+    for (; outstanding; outstanding &= outstanding - 1) {
+        u32_t slot = __builtin_ctz(outstanding);
+        struct hba_cmd_state* cmdstate = cmdctx->issued[slot];
+        cmdctx->issued[slot] = NULL;
+
+        if (!cmdstate || !cmdstate->state_ctx) {
+            continue;
+        }
+
+        struct blkio_req* ioreq = (struct blkio_req*)cmdstate->state_ctx;
+        cmdstate->state_ctx = NULL;
+
+        int culprit = (intr & HBA_PxINTR_TFE) && !ncq && slot == ccs;
+        if (!culprit && ioreq->retries < AHCI_MAX_RETRIES) {
+            ioreq->retries++;
+            retry[nr_retry++] = ioreq;
+            continue;
+        }
+
+        ioreq->errcode = tfd & 0xffff;
+        ioreq->flags |= BLKIO_ERROR;
+        blkio_complete_async(ioreq);
+    }
+
+    // 所有槽位均已释放后再重新提交，以免覆盖尚未处理的槽位
+    for (int i = 0; i < nr_retry; i++) {
+        port->device->ops.submit(port->device, retry[i]);
+    }
+}
+
+static void
+__ahci_port_isr(struct hba_port* port)
+{
+    struct hba_cmd_context* cmdctx = &port->cmdctx;
+
+    // 先清除中断状态，再读取命令状态。这样在此之后完成的命令会再次引发中断，不致遗漏
+    u32_t intr = port->regs[HBA_RPxIS];
+    port->regs[HBA_RPxIS] = intr;
+
+    // 对于NCQ命令，PxCI在设备接受命令后即被清零，须同时查看PxSACT
+    u32_t active = port->regs[HBA_RPxCI] | port->regs[HBA_RPxSACT];
+    u32_t processed = cmdctx->tracked_ci & ~active;
 
     sata_read_error(port);
 
-    // FIXME When error occurs, CI will not change. Need error recovery!
-    if (!processed) {
-        if (port->regs[HBA_RPxIS] & HBA_FATAL) {
-            // TODO perform error recovery
-            // This should include:
-            //      1. Discard all issued (but pending) requests (signaled as
-            //      error)
-            //      2. Restart port
-            // Complete steps refer to AHCI spec 6.2.2.1
+    // 多个排队命令可能由同一个中断报告完成
+    while (processed) {
+        u32_t slot = 31 - __builtin_clz(processed);
+        struct hba_cmd_state* cmdstate = cmdctx->issued[slot];
+
+        processed &= ~(1 << slot);
+        cmdctx->tracked_ci &= ~(1 << slot);
+        cmdctx->issued[slot] = NULL;
+
+        if (!cmdstate) {
+            continue;
         }
-        goto done;
+
+        struct blkio_req* ioreq = (struct blkio_req*)cmdstate->state_ctx;
+
+        if ((port->device->last_result.status & HBA_PxTFD_ERR)) {
+            ioreq->errcode = port->regs[HBA_RPxTFD] & 0xffff;
+            ioreq->flags |= BLKIO_ERROR;
+            hba_clear_reg(port->regs[HBA_RPxSERR]);
+        }
+
+        // 完成通知（唤醒等待者、回调）与下一请求的发出均交由工作队列处理
+        blkio_complete_async(ioreq);
+        cmdstate->state_ctx = NULL;
     }
 
-    u32_t slot = 31 - __builtin_clz(processed);
-    struct hba_cmd_state* cmdstate = cmdctx->issued[slot];
+    // 出错时PxCI不再推进，余下的命令不会完成，须经恢复流程处理
+    if ((intr & HBA_FATAL)) {
+        __ahci_port_recover(port, intr);
+    }
+}
+
+void
+__ahci_hba_isr(const isr_param* param)
+{
+    struct ahci_intr* intr = (struct ahci_intr*)isrm_get_payload(param);
+
+    if (!intr)
+        return;
+
+    struct ahci_hba* hba = intr->hba;
+    u32_t ris = hba->base[HBA_RIS] & intr->ports;
+
+    // ignore spurious interrupt
+    if (!ris)
+        return;
+
+    u32_t pending = ris;
+
+    // 合并后的完成中断占用单独的一位，此时所有参与合并的端口均可能有命令完成
+    if (hba->ccc.enabled && (ris & (1 << hba->ccc.intr))) {
+        pending = (pending & ~(1 << hba->ccc.intr)) | hba->ccc.ports;
+    }
 
-    if (!cmdstate) {
-        goto done;
+    // 一次处理所有报告了中断的端口
+    for (; pending; pending &= pending - 1) {
+        struct hba_port* port = hba->ports[__builtin_ctz(pending)];
+        if (port) {
+            __ahci_port_isr(port);
+            ahci_post_deferred(port);
+        }
     }
 
-    struct blkio_req* ioreq = (struct blkio_req*)cmdstate->state_ctx;
+    // HBA_RIS 为写一清零，只清除本次处理过的端口
+    hba->base[HBA_RIS] = ris;
+}
 
-    if ((port->device->last_result.status & HBA_PxTFD_ERR)) {
-        ioreq->errcode = port->regs[HBA_RPxTFD] & 0xffff;
-        ioreq->flags |= BLKIO_ERROR;
-        hba_clear_reg(port->regs[HBA_RPxSERR]);
+int
+ahci_blkio_poll(struct blkio_context* ctx)
+{
+    struct hba_device* hbadev = (struct hba_device*)ctx->driver;
+    struct hba_port* port = hbadev->port;
+    struct hba_cmd_context* cmdctx = &port->cmdctx;
+
+    u32_t active = port->regs[HBA_RPxCI] | port->regs[HBA_RPxSACT];
+    u32_t fatal = port->regs[HBA_RPxIS] & HBA_FATAL;
+    if (!(cmdctx->tracked_ci & ~active) && !fatal) {
+        return 0;
     }
 
-    blkio_schedule(ioreq->io_ctx);
-    blkio_complete(ioreq);
-    vfree(cmdstate->cmd_table);
+    // 中断仍会到来，届时已无事可做：HBA_RIS 由中断处理程序清除
+    __ahci_port_isr(port);
+    ahci_post_deferred(port);
 
-done:
-    hba_clear_reg(port->regs[HBA_RPxIS]);
-    hba->base[HBA_RIS] &= ~(1 << (31 - port_num));
+    return 1;
 }
 
 void
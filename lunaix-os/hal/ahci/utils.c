@@ -16,6 +16,12 @@
 #define IDDEV_OFFALIGN 209
 #define IDDEV_OFFLPP 106
 #define IDDEV_OFFCAPABILITIES 49
+#define IDDEV_OFFQDEPTH 75
+#define IDDEV_OFFSATACAP 76
+#define IDDEV_OFFDSM 169
+
+// 没有在途命令时，发出命令前等待设备就绪的最大轮数
+#define AHCI_POST_SPIN 10000
 
 static u32_t cdb_size[] = { SCSI_CDB12, SCSI_CDB16, 0, 0 };
 
@@ -34,6 +40,18 @@ ahci_parse_dev_info(struct hba_device* dev_info, uint16_t* data)
         dev_info->block_size = 512;
     }
 
+    // SATA Capabilities, bit 8: 支持NCQ。队列深度以减一后的值记于 word 75
+    if (!(dev_info->flags & HBA_DEV_FATAPI) &&
+        (*(data + IDDEV_OFFSATACAP) & (1 << 8))) {
+        dev_info->flags |= HBA_DEV_FNCQ;
+        dev_info->queue_depth = (*(data + IDDEV_OFFQDEPTH) & 0x1f) + 1;
+    }
+
+    // Data Set Management support, bit 0: 支持TRIM
+    if (!(dev_info->flags & HBA_DEV_FATAPI) && (*(data + IDDEV_OFFDSM) & 1)) {
+        dev_info->flags |= HBA_DEV_FTRIM;
+    }
+
     if ((*(data + IDDEV_OFFADDSUPPORT) & 0x8)) {
         dev_info->max_lba = *((uint64_t*)(data + IDDEV_OFFMAXLBA_EXT));
         dev_info->flags |= HBA_DEV_FEXTLBA;
@@ -87,17 +105,78 @@ ahci_try_send(struct hba_port* port, int slot)
     return retries < MAX_RETRY;
 }
 
+static void
+__ahci_issue(struct hba_port* port, u32_t bitmask)
+{
+    // 尚有命令在途时，其完成状态可能尚未被处理，不可清除
+    if (!port->cmdctx.tracked_ci) {
+        hba_clear_reg(port->regs[HBA_RPxIS]);
+    }
+
+    port->cmdctx.tracked_ci |= bitmask;
+    port->regs[HBA_RPxCI] = bitmask;
+
+    for (u32_t slots = bitmask; slots; slots &= slots - 1) {
+        u32_t slot = __builtin_ctz(slots);
+        struct hba_cmd_state* state = port->cmdctx.issued[slot];
+        if (state && state->state_ctx) {
+            blkio_trace((struct blkio_req*)state->state_ctx, BLKIO_TR_ISSUE);
+        }
+    }
+}
+
 void
 ahci_post(struct hba_port* port, struct hba_cmd_state* state, int slot)
 {
-    int bitmask = 1 << slot;
+    struct hba_cmd_context* cmdctx = &port->cmdctx;
+    u32_t bitmask = 1 << slot;
 
-    // 确保端口是空闲的
-    wait_until(!(port->regs[HBA_RPxTFD] & (HBA_PxTFD_BSY | HBA_PxTFD_DRQ)));
+    cmdctx->issued[slot] = state;
 
-    hba_clear_reg(port->regs[HBA_RPxIS]);
+    // NCQ命令何时送达设备由HBA与设备协商，无需等待设备空闲
+    if ((port->device->flags & HBA_DEV_FNCQ)) {
+        __ahci_issue(port, bitmask);
+        return;
+    }
 
-    port->cmdctx.issued[slot] = state;
-    port->cmdctx.tracked_ci |= bitmask;
-    port->regs[HBA_RPxCI] |= bitmask;
+    // 已有被推迟的命令时，新命令须排在其后
+    if (!cmdctx->deferred && !hba_port_busy(port)) {
+        __ahci_issue(port, bitmask);
+        return;
+    }
+
+    cmdctx->stalls++;
+
+    if (cmdctx->tracked_ci) {
+        // 设备正忙于在途的命令，其完成中断到来时再发出
+        cmdctx->deferred |= bitmask;
+        return;
+    }
+
+    // 没有在途的命令，也就不会有中断到来：有限度地等待设备就绪，
+    //  届时仍未就绪也照常发出，HBA会在设备就绪后才传送命令
+    wait_until_expire(!hba_port_busy(port), AHCI_POST_SPIN);
+
+    bitmask |= cmdctx->deferred;
+    cmdctx->deferred = 0;
+    __ahci_issue(port, bitmask);
+}
+
+void
+ahci_post_deferred(struct hba_port* port)
+{
+    struct hba_cmd_context* cmdctx = &port->cmdctx;
+    u32_t deferred = cmdctx->deferred;
+
+    if (!deferred) {
+        return;
+    }
+
+    // 若仍有命令在途，则等待它们的完成中断
+    if (hba_port_busy(port) && cmdctx->tracked_ci) {
+        return;
+    }
+
+    cmdctx->deferred = 0;
+    __ahci_issue(port, deferred);
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+/**
+ * @file alternative.c
+ * @brief 依处理器特性改写代码，见 hal/alternative.h
+ *
+ * 内核代码段以可写的权限映射（见 arch/x86/hhk.c），可直接改写。改写于
+ * 其他处理器启动前进行，且x86会察觉对即将执行的代码的修改，故无需额外的
+ * 同步。
+ *
+ */
+#include <hal/alternative.h>
+#include <hal/cpu.h>
+
+#include <lunaix/syslog.h>
+
+LOG_MODULE("ALT")
+
+extern struct alt_entry __alt_table_start[];
+extern struct alt_entry __alt_table_end[];
+
+// P6起的多字节NOP（0F 1F /0），按长度索引
+static const u8_t alt_nops[][5] = {
+    { 0 },
+    { 0x90 },
+    { 0x66, 0x90 },
+    { 0x0f, 0x1f, 0x00 },
+    { 0x0f, 0x1f, 0x40, 0x00 },
+    { 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+};
+
+#define ALT_NOP_MAX 5
+
+// memcpy 本身即含改写点，故逐字节复制（volatile 以免被编译器换回 memcpy）
+static void
+__alt_copy(volatile u8_t* dst, const u8_t* src, u32_t len)
+{
+    for (u32_t i = 0; i < len; i++) {
+        dst[i] = src[i];
+    }
+}
+
+static void
+__alt_fill_nop(u8_t* dst, u32_t len)
+{
+    while (len) {
+        u32_t n = len > ALT_NOP_MAX ? ALT_NOP_MAX : len;
+        __alt_copy(dst, alt_nops[n], n);
+        dst += n;
+        len -= n;
+    }
+}
+
+static u32_t
+__alt_probe()
+{
+    u32_t features = 0;
+
+    features |= cpu_has_sse2() ? (1 << ALT_FEATURE_SSE2) : 0;
+    features |= cpu_has_ermsb() ? (1 << ALT_FEATURE_ERMSB) : 0;
+    features |= cpu_has_sse42() ? (1 << ALT_FEATURE_SSE42) : 0;
+    features |= cpu_has_pclmul() ? (1 << ALT_FEATURE_PCLMUL) : 0;
+
+    // 须已由 fpu_init 启用（CR4.OSXSAVE）
+    features |= cpu_has_xsave() ? (1 << ALT_FEATURE_XSAVE) : 0;
+    features |= cpu_has_xsaveopt() ? (1 << ALT_FEATURE_XSAVEOPT) : 0;
+
+    return features;
+}
+
+void
+alternatives_apply()
+{
+    u32_t features = __alt_probe();
+    u32_t patched = 0;
+
+    for (struct alt_entry* e = __alt_table_start; e < __alt_table_end; e++) {
+        if (!(features & (1 << e->feature))) {
+            continue;
+        }
+
+        // 替换指令不会长于原指令，由 alt_has 等登记方保证
+        u8_t* site = (u8_t*)e->site;
+        __alt_copy(site, (const u8_t*)e->repl, e->repl_len);
+        __alt_fill_nop(site + e->repl_len, e->site_len - e->repl_len);
+        patched++;
+    }
+
+    kprintf(KINFO "features: 0x%x, %u/%u sites patched\n",
+            features,
+            patched,
+            (u32_t)(__alt_table_end - __alt_table_start));
+}
@@ -41,6 +41,20 @@ apic_init()
 
     _apic_base = ioremap(__APIC_BASE_PADDR, 4096);
 
+    apic_init_ap();
+
+    // Print the basic information of our current local APIC
+    u32_t apic_ver = apic_read_reg(APIC_VER);
+
+    kprintf(KINFO "ID: %x, Version: %x, Max LVT: %u\n",
+            apic_id(),
+            apic_ver & 0xff,
+            (apic_ver >> 16) & 0xff);
+}
+
+void
+apic_init_ap()
+{
     // Hardware enable the APIC
     // By setting bit 11 of IA32_APIC_BASE register
     // Note: After this point, you can't disable then re-enable it until a
@@ -52,15 +66,6 @@ apic_init()
                  "i"(IA32_APIC_ENABLE)
                  : "eax", "ecx", "edx");
 
-    // Print the basic information of our current local APIC
-    u32_t apic_id = apic_read_reg(APIC_IDR) >> 24;
-    u32_t apic_ver = apic_read_reg(APIC_VER);
-
-    kprintf(KINFO "ID: %x, Version: %x, Max LVT: %u\n",
-            apic_id,
-            apic_ver & 0xff,
-            (apic_ver >> 16) & 0xff);
-
     // initialize the local vector table (LVT)
     apic_setup_lvts();
 
@@ -97,6 +102,21 @@ apic_setup_lvts()
     apic_write_reg(APIC_LVT_ERROR, LVT_ENTRY_ERROR(APIC_ERROR_IV));
 }
 
+u32_t
+apic_id()
+{
+    return apic_read_reg(APIC_IDR) >> 24;
+}
+
+void
+apic_send_ipi(u32_t dest, u32_t icr)
+{
+    apic_write_reg(APIC_ICR_HI, dest << 24);
+    apic_write_reg(APIC_ICR_BASE, icr);
+
+    wait_until(!(apic_read_reg(APIC_ICR_BASE) & ICR_DELIVERY_PENDING));
+}
+
 void
 apic_done_servicing()
 {
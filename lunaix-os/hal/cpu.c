@@ -56,6 +56,203 @@ cpu_has_apic()
     return (edx & 0x100);
 }
 
+int
+cpu_has_invariant_tsc()
+{
+    // reference: Intel manual, section 17.17.1
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    if (__get_cpuid_max(0x80000000UL, 0) < 0x80000007UL) {
+        return 0;
+    }
+
+    __get_cpuid(0x80000007UL, &eax, &ebx, &ecx, &edx);
+
+    return (edx & 0x100);
+}
+
+int
+cpu_has_tsc_deadline()
+{
+    // reference: Intel manual, section 10.5.4.1
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (ecx & (1 << 24));
+}
+
+int
+cpu_has_sse2()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (edx & (1 << 26));
+}
+
+int
+cpu_has_sse42()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (ecx & (1 << 20));
+}
+
+int
+cpu_has_pclmul()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (ecx & (1 << 1));
+}
+
+int
+cpu_has_ermsb()
+{
+    // reference: Intel optimization manual, section 3.7.6
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    if (__get_cpuid_max(0, 0) < 7) {
+        return 0;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+    return (ebx & (1 << 9));
+}
+
+int
+cpu_has_mwait()
+{
+    // reference: Intel manual, section 8.10.4
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (ecx & (1 << 3));
+}
+
+u32_t
+cpu_mwait_substates()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    if (!cpu_has_mwait() || __get_cpuid_max(0, 0) < 5) {
+        return 0;
+    }
+
+    __get_cpuid(5, &eax, &ebx, &ecx, &edx);
+
+    // EDX is only meaningful with the extensions enumerated
+    return (ecx & 0x1) ? edx : 0;
+}
+
+int
+cpu_has_xsave()
+{
+    // reference: Intel manual, section 13.2
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (ecx & (1 << 26));
+}
+
+int
+cpu_has_xsaveopt()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    if (!cpu_has_xsave() || __get_cpuid_max(0, 0) < 0xd) {
+        return 0;
+    }
+
+    __cpuid_count(0xd, 1, eax, ebx, ecx, edx);
+
+    return (eax & 0x1);
+}
+
+u64_t
+cpu_xsave_features()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    if (!cpu_has_xsave() || __get_cpuid_max(0, 0) < 0xd) {
+        return 0;
+    }
+
+    __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+
+    return ((u64_t)edx << 32) | eax;
+}
+
+u32_t
+cpu_xsave_size()
+{
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+
+    // EBX reflects the components currently enabled in XCR0
+    return ebx;
+}
+
+#define IA32_MSR_PAT 0x277
+
+#define PAT_UC 0x00
+#define PAT_WC 0x01
+#define PAT_WT 0x04
+#define PAT_WB 0x06
+#define PAT_UC_MINUS 0x07
+
+#define PAT_ENTRIES(e0, e1, e2, e3)                                            \
+    ((e0) | ((e1) << 8) | ((e2) << 16) | ((e3) << 24))
+
+int
+cpu_has_pat()
+{
+    // reference: Intel manual, section 11.12.1
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (edx & (1 << 16));
+}
+
+void
+cpu_init_pat()
+{
+    if (!cpu_has_pat()) {
+        return;
+    }
+
+    // PA0~PA3 与上电默认值相同，故仅用 PCD/PWT 的既有映射不受影响。
+    // reference: Intel manual, section 11.12.4
+    u32_t low = PAT_ENTRIES(PAT_WB, PAT_WT, PAT_UC_MINUS, PAT_UC);
+    u32_t high = PAT_ENTRIES(PAT_WC, PAT_WT, PAT_UC_MINUS, PAT_UC);
+
+    asm volatile("wbinvd" ::: "memory");
+    cpu_wrmsr(IA32_MSR_PAT, high, low);
+    asm volatile("wbinvd" ::: "memory");
+    // 内核映射为全局页，重载CR3不足以使其按新的内存类型重新载入
+    cpu_invtlb_all();
+}
+
+#define IA32_MSR_SYSENTER_CS 0x174
+#define IA32_MSR_SYSENTER_ESP 0x175
+#define IA32_MSR_SYSENTER_EIP 0x176
+
+int
+cpu_has_sysenter()
+{
+    // reference: Intel manual, section 5.8.7
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (edx & (1 << 11));
+}
+
+void
+cpu_setup_sysenter(u32_t cs, void* stack, void* entry)
+{
+    cpu_wrmsr(IA32_MSR_SYSENTER_CS, 0, cs);
+    cpu_wrmsr(IA32_MSR_SYSENTER_ESP, 0, (u32_t)stack);
+    cpu_wrmsr(IA32_MSR_SYSENTER_EIP, 0, (u32_t)entry);
+}
+
 void
 cpu_rdmsr(u32_t msr_idx, u32_t* reg_high, u32_t* reg_low)
 {
@@ -78,4 +275,15 @@ rnd_is_supported()
     reg32 eax, ebx, ecx, edx;
     __get_cpuid(0x01, &eax, &ebx, &ecx, &edx);
     return (ecx & (1 << 30));
-}
\ No newline at end of file
+}
+
+int
+rnd_seed_is_supported()
+{
+    reg32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0, 0) < 7) {
+        return 0;
+    }
+    __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    return (ebx & (1 << 18));
+}
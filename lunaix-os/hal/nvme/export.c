@@ -0,0 +1,63 @@
+#include <hal/nvme/nvme.h>
+#include <lunaix/fs/twifs.h>
+
+static void
+__nvme_rd_serial(struct twimap* map)
+{
+    struct nvme_ns* ns = twimap_data(map, struct nvme_ns*);
+    twimap_printf(map, "%s", ns->ctrl->serial);
+}
+
+static void
+__nvme_rd_nsid(struct twimap* map)
+{
+    struct nvme_ns* ns = twimap_data(map, struct nvme_ns*);
+    twimap_printf(map, "%d", ns->nsid);
+}
+
+static void
+__nvme_rd_capabilities(struct twimap* map)
+{
+    struct nvme_ctrl* ctrl = twimap_data(map, struct nvme_ns*)->ctrl;
+
+    twimap_printf(map,
+                  "max_xfer: %d\nsgl: %d\ndiscard: %d\nwrite_cache: %d\n",
+                  ctrl->max_xfer,
+                  ctrl->sgls,
+                  !!(ctrl->oncs & NVME_ONCS_DSM),
+                  ctrl->vwc);
+}
+
+static void
+__nvme_rd_queues(struct twimap* map)
+{
+    struct nvme_queue* q = &twimap_data(map, struct nvme_ns*)->ctrl->ioq;
+
+    twimap_printf(map, "qid  slots busy  submitted  completed\n");
+    twimap_printf(map,
+                  "%3d %6d %4d %10u %10u\n",
+                  q->qid,
+                  q->nr_slots,
+                  __builtin_popcount(q->busy),
+                  q->submitted,
+                  q->completed);
+}
+
+void
+nvme_fsexport(struct block_dev* bdev, void* fs_node)
+{
+    struct twifs_node* dev_root = (struct twifs_node*)fs_node;
+    struct twimap* map;
+
+    map = twifs_mapping(dev_root, bdev->driver, "serial");
+    map->read = __nvme_rd_serial;
+
+    map = twifs_mapping(dev_root, bdev->driver, "nsid");
+    map->read = __nvme_rd_nsid;
+
+    map = twifs_mapping(dev_root, bdev->driver, "capabilities");
+    map->read = __nvme_rd_capabilities;
+
+    map = twifs_mapping(dev_root, bdev->driver, "queues");
+    map->read = __nvme_rd_queues;
+}
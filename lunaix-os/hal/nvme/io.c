@@ -0,0 +1,296 @@
+/**
+ * @file io.c
+ * @brief NVMe I/O submission and completion
+ *
+ */
+#include <hal/nvme/nvme.h>
+
+#include <lunaix/mm/vmm.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+static inline u32_t
+__nvme_full_mask(struct nvme_queue* q)
+{
+    return q->nr_slots >= 32 ? (u32_t)-1 : (1U << q->nr_slots) - 1;
+}
+
+static inline int
+__nvme_queue_full(struct nvme_queue* q)
+{
+    return q->busy == __nvme_full_mask(q);
+}
+
+/**
+ * @brief 以PRP描述缓冲区。除第一段外，每段须始于页边界；除最后一段外，每段须止于页边界。
+ *  单个缓冲区在虚拟地址上连续，故逐页拆分后总能满足，只有各段的衔接处可能不满足
+ *
+ */
+static int
+__nvme_bind_prp(struct nvme_slot* slot,
+                struct nvme_sqe* sqe,
+                struct vecbuf* vbuf)
+{
+    u64_t* list = (u64_t*)slot->list;
+    u32_t n = 0;
+    int started = 0;
+    uintptr_t prev_end = 0;
+    struct membuf* seg;
+
+    vbuf_foreach(seg, vbuf)
+    {
+        uintptr_t va = (uintptr_t)seg->buffer;
+        size_t left = seg->size;
+
+        while (left) {
+            uintptr_t pa = (uintptr_t)vmm_v2p((void*)va);
+            size_t chunk = MIN(left, PG_SIZE - (va & (PG_SIZE - 1)));
+
+            if (!started) {
+                if ((pa & 0x3)) {
+                    return EINVAL;
+                }
+                sqe->prp1 = pa;
+                started = 1;
+            } else {
+                if ((pa & (PG_SIZE - 1)) || (prev_end & (PG_SIZE - 1)) ||
+                    n == NVME_PRP_PER_LIST) {
+                    return EINVAL;
+                }
+                list[n++] = pa;
+            }
+
+            prev_end = pa + chunk;
+            va += chunk;
+            left -= chunk;
+        }
+    }
+
+    if (n == 1) {
+        sqe->prp2 = list[0];
+    } else if (n > 1) {
+        sqe->prp2 = slot->list_pa;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 以SGL描述缓冲区，各段可始止于任意（或双字对齐的）位置。
+ *  用于不满足PRP约束的缓冲区，需控制器支持
+ *
+ */
+static int
+__nvme_bind_sgl(struct nvme_ctrl* ctrl,
+                struct nvme_slot* slot,
+                struct nvme_sqe* sqe,
+                struct vecbuf* vbuf)
+{
+    struct nvme_sgl_desc* descs = (struct nvme_sgl_desc*)slot->list;
+    u32_t n = 0;
+    uintptr_t prev_end = 0;
+    struct membuf* seg;
+
+    if (!ctrl->sgls) {
+        return ENOTSUP;
+    }
+
+    vbuf_foreach(seg, vbuf)
+    {
+        uintptr_t va = (uintptr_t)seg->buffer;
+        size_t left = seg->size;
+
+        while (left) {
+            uintptr_t pa = (uintptr_t)vmm_v2p((void*)va);
+            size_t chunk = MIN(left, PG_SIZE - (va & (PG_SIZE - 1)));
+
+            // SGLS为2时，要求各段的地址与长度均为双字对齐
+            if (ctrl->sgls == 2 && ((pa | chunk) & 0x3)) {
+                return EINVAL;
+            }
+
+            if (n && prev_end == pa) {
+                descs[n - 1].len += chunk;
+            } else {
+                if (n == NVME_SGL_PER_LIST) {
+                    return EINVAL;
+                }
+                descs[n++] = (struct nvme_sgl_desc){
+                    .addr = pa, .len = chunk, .type = NVME_SGL_DATA
+                };
+            }
+
+            prev_end = pa + chunk;
+            va += chunk;
+            left -= chunk;
+        }
+    }
+
+    // 数据指针（PRP1与PRP2所在的16字节）本身即为一个SGL描述符
+    struct nvme_sgl_desc* dptr = (struct nvme_sgl_desc*)&sqe->prp1;
+    if (n == 1) {
+        *dptr = descs[0];
+    } else {
+        *dptr = (struct nvme_sgl_desc){ .addr = slot->list_pa,
+                                        .len = n * sizeof(*descs),
+                                        .type = NVME_SGL_LAST_SEG };
+    }
+
+    sqe->cdw0 |= NVME_PSDT_SGL;
+    return 0;
+}
+
+static void
+__nvme_fail(struct blkio_req* req, int status)
+{
+    req->errcode = status;
+    req->flags |= BLKIO_ERROR;
+    blkio_complete_async(req);
+}
+
+static void
+__nvme_submit(struct nvme_queue* q, struct blkio_req* req)
+{
+    struct nvme_ns* ns = (struct nvme_ns*)req->io_ctx->driver;
+    struct nvme_ctrl* ctrl = q->ctrl;
+    u32_t s = __builtin_ctz(~q->busy);
+    struct nvme_slot* slot = &q->slots[s];
+    struct nvme_sqe sqe = { .nsid = ns->nsid };
+    u32_t opcode;
+
+    if ((req->flags & BLKIO_FLUSH)) {
+        opcode = NVME_CMD_FLUSH;
+    } else if ((req->flags & BLKIO_DISCARD)) {
+        struct nvme_dsm_range* range = (struct nvme_dsm_range*)slot->list;
+        *range = (struct nvme_dsm_range){ .nlb = req->blk_count,
+                                          .slba = req->blk_addr };
+        opcode = NVME_CMD_DSM;
+        sqe.prp1 = slot->list_pa;
+        sqe.cdw11 = NVME_DSM_DEALLOCATE;
+    } else {
+        size_t size = vbuf_size(&req->vbuf);
+        if (size > ctrl->max_xfer) {
+            __nvme_fail(req, NVME_SC_INVALID_FIELD);
+            return;
+        }
+
+        opcode = (req->flags & BLKIO_WRITE) ? NVME_CMD_WRITE : NVME_CMD_READ;
+        sqe.cdw10 = (u32_t)req->blk_addr;
+        sqe.cdw11 = (u32_t)(req->blk_addr >> 32);
+        sqe.cdw12 = (size >> ns->lba_shift) - 1;
+
+        if (__nvme_bind_prp(slot, &sqe, &req->vbuf)) {
+            sqe.prp1 = sqe.prp2 = 0;
+            if (__nvme_bind_sgl(ctrl, slot, &sqe, &req->vbuf)) {
+                __nvme_fail(req, NVME_SC_INVALID_FIELD);
+                return;
+            }
+        }
+    }
+
+    sqe.cdw0 |= opcode | (s << 16);
+
+    slot->req = req;
+    q->busy |= 1 << s;
+
+    // 在途的命令数少于队列长度，提交队列不会溢出
+    q->sq[q->sq_tail] = sqe;
+    q->sq_tail = (q->sq_tail + 1) % q->size;
+    *q->sq_db = q->sq_tail;
+
+    q->submitted++;
+}
+
+void
+nvme_blkio_handler(struct blkio_req* req)
+{
+    struct nvme_ns* ns = (struct nvme_ns*)req->io_ctx->driver;
+    struct nvme_ctrl* ctrl = ns->ctrl;
+
+    // 没有易失性写缓存的控制器无须刷写
+    if ((req->flags & BLKIO_FLUSH) && !ctrl->vwc) {
+        blkio_complete_async(req);
+        return;
+    }
+
+    // 同一控制器上的各命名空间共用队列，槽位可能已为其他命名空间占满
+    struct nvme_queue* q = &ctrl->ioq;
+    if (__nvme_queue_full(q)) {
+        llist_append(&ctrl->pending, &req->reqs);
+        return;
+    }
+
+    __nvme_submit(q, req);
+}
+
+static int
+__nvme_reap(struct nvme_queue* q)
+{
+    struct nvme_ctrl* ctrl = q->ctrl;
+    volatile struct nvme_cqe* cqe;
+    int reaped = 0, moved = 0;
+
+    while (((cqe = &q->cq[q->cq_head])->status & 1) == q->phase) {
+        u16_t cid = cqe->cid;
+        u16_t status = cqe->status >> 1;
+
+        if (++q->cq_head == q->size) {
+            q->cq_head = 0;
+            q->phase ^= 1;
+        }
+        moved = 1;
+
+        if (cid >= q->nr_slots || !q->slots[cid].req) {
+            continue;
+        }
+
+        struct nvme_slot* slot = &q->slots[cid];
+        struct blkio_req* req = slot->req;
+
+        if (status) {
+            req->errcode = status;
+            req->flags |= BLKIO_ERROR;
+        }
+
+        slot->req = NULL;
+        q->busy &= ~(1 << cid);
+        blkio_complete_async(req);
+        reaped++;
+    }
+
+    // 一次性告知控制器本批已处理的完成项
+    if (moved) {
+        *q->cq_db = q->cq_head;
+    }
+
+    q->completed += reaped;
+
+    while (!llist_empty(&ctrl->pending) && !__nvme_queue_full(q)) {
+        struct blkio_req* req =
+          list_entry(ctrl->pending.next, struct blkio_req, reqs);
+        llist_delete(&req->reqs);
+        __nvme_submit(q, req);
+    }
+
+    return reaped;
+}
+
+void
+nvme_ioq_isr(const isr_param* param)
+{
+    struct nvme_queue* q = (struct nvme_queue*)isrm_get_payload(param);
+
+    if (!q) {
+        return;
+    }
+
+    __nvme_reap(q);
+}
+
+int
+nvme_blkio_poll(struct blkio_context* ctx)
+{
+    struct nvme_ns* ns = (struct nvme_ns*)ctx->driver;
+
+    return __nvme_reap(&ns->ctrl->ioq);
+}
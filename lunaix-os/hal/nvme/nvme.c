@@ -0,0 +1,389 @@
+/**
+ * @file nvme.c
+ * @brief NVM Express controller initialization and admin commands
+ *
+ */
+#include <hal/nvme/nvme.h>
+
+#include <klibc/string.h>
+#include <lunaix/clock.h>
+#include <lunaix/mm/mmio.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("NVME")
+
+#define REG32(ctrl, off) (*(volatile u32_t*)((ctrl)->regs + (off)))
+
+static int nr_ctrls = 0;
+
+void*
+nvme_driver_init(struct pci_device* pci);
+
+void
+nvme_init()
+{
+    pci_add_driver("NVM Express", NVME_CLASS, 0, 0, nvme_driver_init);
+}
+
+void*
+nvme_alloc_page(ptr_t* pa)
+{
+    ptr_t page = (ptr_t)pmm_alloc_page(KERNEL_PID, PP_FGLOCKED | PP_GFP_DMA);
+    if (!page) {
+        return NULL;
+    }
+
+    // 与设备之间的DMA是缓存一致的，故以写回方式映射
+    void* va = ioremap_cached(page, PG_SIZE, PG_CACHE_WB);
+    if (va) {
+        memset(va, 0, PG_SIZE);
+        *pa = page;
+    }
+
+    return va;
+}
+
+static u64_t
+__nvme_read_cap(struct nvme_ctrl* ctrl)
+{
+    return REG32(ctrl, NVME_REG_CAP) |
+           ((u64_t)REG32(ctrl, NVME_REG_CAP + 4) << 32);
+}
+
+static int
+__nvme_wait_ready(struct nvme_ctrl* ctrl, u32_t ready)
+{
+    time_t deadline = clock_systime() + ctrl->timeout;
+
+    wait_until((REG32(ctrl, NVME_REG_CSTS) & NVME_CSTS_RDY) == ready ||
+               clock_systime() >= deadline);
+
+    u32_t csts = REG32(ctrl, NVME_REG_CSTS);
+    if ((csts & NVME_CSTS_CFS) || (csts & NVME_CSTS_RDY) != ready) {
+        return EIO;
+    }
+    return 0;
+}
+
+static int
+__nvme_queue_init(struct nvme_ctrl* ctrl,
+                  struct nvme_queue* q,
+                  int qid,
+                  u16_t size)
+{
+    u32_t stride = 4 << ctrl->db_stride;
+
+    *q = (struct nvme_queue){ .ctrl = ctrl,
+                              .qid = qid,
+                              .size = size,
+                              .phase = 1,
+                              .nr_slots = MIN(NVME_MAX_SLOTS, size - 1) };
+
+    q->sq = nvme_alloc_page(&q->sq_pa);
+    q->cq = nvme_alloc_page(&q->cq_pa);
+    if (!q->sq || !q->cq) {
+        return ENOMEM;
+    }
+
+    q->sq_db =
+      (volatile u32_t*)(ctrl->regs + NVME_REG_DBS + (2 * qid) * stride);
+    q->cq_db =
+      (volatile u32_t*)(ctrl->regs + NVME_REG_DBS + (2 * qid + 1) * stride);
+
+    // 管理队列的命令均同步完成，无须槽位
+    if (!qid) {
+        return 0;
+    }
+
+    u8_t* list_pg = NULL;
+    ptr_t list_pa = 0;
+    for (u32_t i = 0; i < q->nr_slots; i++) {
+        u32_t j = i % NVME_LIST_PER_PAGE;
+        if (!j && !(list_pg = nvme_alloc_page(&list_pa))) {
+            return ENOMEM;
+        }
+        q->slots[i].list = list_pg + j * NVME_LIST_SIZE;
+        q->slots[i].list_pa = list_pa + j * NVME_LIST_SIZE;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 经由管理队列同步地执行一条命令，以轮询的方式等待其完成
+ *
+ */
+static int
+__nvme_admin(struct nvme_ctrl* ctrl, struct nvme_sqe* cmd, u32_t* dw0)
+{
+    struct nvme_queue* q = &ctrl->admin;
+
+    cmd->cdw0 = (cmd->cdw0 & 0xffff) | ((u32_t)q->sq_tail << 16);
+    q->sq[q->sq_tail] = *cmd;
+    q->sq_tail = (q->sq_tail + 1) % q->size;
+    *q->sq_db = q->sq_tail;
+
+    volatile struct nvme_cqe* cqe = &q->cq[q->cq_head];
+    time_t deadline = clock_systime() + ctrl->timeout;
+    wait_until((cqe->status & 1) == q->phase || clock_systime() >= deadline);
+
+    if ((cqe->status & 1) != q->phase) {
+        return EIO;
+    }
+
+    u16_t status = cqe->status >> 1;
+    if (dw0) {
+        *dw0 = cqe->dw0;
+    }
+
+    if (++q->cq_head == q->size) {
+        q->cq_head = 0;
+        q->phase ^= 1;
+    }
+    *q->cq_db = q->cq_head;
+
+    return status ? EIO : 0;
+}
+
+static int
+__nvme_identify(struct nvme_ctrl* ctrl, u32_t nsid, u32_t cns, ptr_t buf_pa)
+{
+    struct nvme_sqe cmd = { .cdw0 = NVME_ADM_IDENTIFY,
+                            .nsid = nsid,
+                            .prp1 = buf_pa,
+                            .cdw10 = cns };
+    return __nvme_admin(ctrl, &cmd, NULL);
+}
+
+static void
+__nvme_copy_str(char* dest, u8_t* src, size_t len)
+{
+    memcpy(dest, src, len);
+    dest[len] = 0;
+
+    // 字符串以空格填充
+    while (len && dest[len - 1] == ' ') {
+        dest[--len] = 0;
+    }
+}
+
+static int
+__nvme_setup_ctrl(struct nvme_ctrl* ctrl)
+{
+    u64_t cap = __nvme_read_cap(ctrl);
+
+    // 仅使用4KiB的内存页
+    if (NVME_CAP_MPSMIN(cap)) {
+        return ENOTSUP;
+    }
+
+    ctrl->db_stride = NVME_CAP_DSTRD(cap);
+    ctrl->timeout = MAX(NVME_CAP_TO(cap) * 500, NVME_ADMIN_TIMEOUT);
+
+    if ((REG32(ctrl, NVME_REG_CC) & NVME_CC_EN)) {
+        REG32(ctrl, NVME_REG_CC) &= ~NVME_CC_EN;
+    }
+    if (__nvme_wait_ready(ctrl, 0)) {
+        return EIO;
+    }
+
+    u16_t asize = MIN(NVME_ADMIN_QSIZE, NVME_CAP_MQES(cap));
+    if (__nvme_queue_init(ctrl, &ctrl->admin, 0, asize)) {
+        return ENOMEM;
+    }
+
+    REG32(ctrl, NVME_REG_AQA) = ((asize - 1) << 16) | (asize - 1);
+    REG32(ctrl, NVME_REG_ASQ) = ctrl->admin.sq_pa;
+    REG32(ctrl, NVME_REG_ASQ + 4) = 0;
+    REG32(ctrl, NVME_REG_ACQ) = ctrl->admin.cq_pa;
+    REG32(ctrl, NVME_REG_ACQ + 4) = 0;
+
+    REG32(ctrl, NVME_REG_CC) = NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES;
+
+    return __nvme_wait_ready(ctrl, 1);
+}
+
+static int
+__nvme_identify_ctrl(struct nvme_ctrl* ctrl, u8_t* id, ptr_t id_pa)
+{
+    if (__nvme_identify(ctrl, 0, NVME_ID_CTRL, id_pa)) {
+        return EIO;
+    }
+
+    __nvme_copy_str(ctrl->serial, id + NVME_IDC_SN, 20);
+    __nvme_copy_str(ctrl->model, id + NVME_IDC_MN, 40);
+
+    // MDTS以最小页大小（4KiB）的2的幂次计，0为不限
+    u32_t mdts = id[NVME_IDC_MDTS];
+    ctrl->max_xfer = (NVME_PRP_PER_LIST + 1) * PG_SIZE;
+    if (mdts && mdts < 16) {
+        ctrl->max_xfer = MIN(ctrl->max_xfer, (u32_t)PG_SIZE << mdts);
+    }
+
+    ctrl->nr_ns = MIN(*(u32_t*)(id + NVME_IDC_NN), NVME_MAX_NS);
+    ctrl->oncs = *(u16_t*)(id + NVME_IDC_ONCS);
+    ctrl->vwc = id[NVME_IDC_VWC] & 0x1;
+    ctrl->sgls = *(u32_t*)(id + NVME_IDC_SGLS) & 0x3;
+
+    return 0;
+}
+
+static int
+__nvme_setup_ioq(struct nvme_ctrl* ctrl)
+{
+    struct nvme_queue* q = &ctrl->ioq;
+    int iv = isrm_ivexalloc(nvme_ioq_isr);
+
+    if (pci_setup_msix(ctrl->pci, &iv, 1)) {
+        goto fail;
+    }
+
+    // 只请求一对I/O队列（数量以0起计）
+    struct nvme_sqe cmd = { .cdw0 = NVME_ADM_SET_FEATURES,
+                            .cdw10 = NVME_FEAT_NR_QUEUES,
+                            .cdw11 = 0 };
+    if (__nvme_admin(ctrl, &cmd, NULL)) {
+        goto fail;
+    }
+
+    u16_t qsize = MIN(NVME_IO_QSIZE, NVME_CAP_MQES(__nvme_read_cap(ctrl)));
+    if (__nvme_queue_init(ctrl, q, 1, qsize)) {
+        goto fail;
+    }
+
+    // 管理队列的完成中断同样经由0号表项，但管理命令均以轮询完成，
+    //  故中断处理程序只需检查I/O队列
+    cmd = (struct nvme_sqe){ .cdw0 = NVME_ADM_CREATE_CQ,
+                             .prp1 = q->cq_pa,
+                             .cdw10 = ((qsize - 1) << 16) | q->qid,
+                             .cdw11 = 0x3 };
+    if (__nvme_admin(ctrl, &cmd, NULL)) {
+        goto fail;
+    }
+
+    cmd = (struct nvme_sqe){ .cdw0 = NVME_ADM_CREATE_SQ,
+                             .prp1 = q->sq_pa,
+                             .cdw10 = ((qsize - 1) << 16) | q->qid,
+                             .cdw11 = (q->qid << 16) | 0x1 };
+    if (__nvme_admin(ctrl, &cmd, NULL)) {
+        goto fail;
+    }
+
+    q->iv = iv;
+    isrm_set_payload(iv, (ptr_t)q);
+
+    return 0;
+
+fail:
+    isrm_ivfree(iv);
+    return EIO;
+}
+
+static void
+__nvme_register_ns(struct nvme_ctrl* ctrl, u32_t nsid, u8_t* id, ptr_t id_pa)
+{
+    if (__nvme_identify(ctrl, nsid, NVME_ID_NS, id_pa)) {
+        return;
+    }
+
+    u64_t nsze = *(u64_t*)(id + NVME_IDN_NSZE);
+    u32_t lbaf = *(u32_t*)(id + NVME_IDN_LBAF + 4 * (id[NVME_IDN_FLBAS] & 0xf));
+    u32_t lba_shift = (lbaf >> 16) & 0xff;
+
+    // 未启用的命名空间大小为0；带有元数据的格式不予支持
+    if (!nsze || (lbaf & 0xffff) || lba_shift < 9 || lba_shift > PG_SIZE_BITS) {
+        return;
+    }
+
+    struct nvme_ns* ns = &ctrl->ns[nsid - 1];
+    *ns = (struct nvme_ns){
+        .ctrl = ctrl, .nsid = nsid, .lba_shift = lba_shift, .nr_blocks = nsze
+    };
+
+    kprintf(KINFO "nvme%dn%d: %s, blk_size=%d, blk=0..%d\n",
+            nr_ctrls,
+            nsid,
+            ctrl->model,
+            1 << lba_shift,
+            (u32_t)(nsze - 1));
+
+    struct block_dev* bdev =
+      block_alloc_dev(ctrl->model, ns, nvme_blkio_handler);
+
+    bdev->end_lba = nsze - 1;
+    bdev->blk_size = 1 << lba_shift;
+    bdev->blkio->depth = ctrl->ioq.nr_slots;
+    // 合并后的请求不得超出单条命令的传输上限
+    bdev->blkio->max_segs =
+      MIN(MAX(ctrl->max_xfer / NVME_SEG_ESTIMATE, 1), NVME_MAX_VBUF_SEGS);
+    bdev->blkio->poll = nvme_blkio_poll;
+
+    if ((ctrl->oncs & NVME_ONCS_DSM)) {
+        bdev->blkio->max_discard = (u32_t)-1;
+    }
+
+    ns->bdev = bdev;
+
+    block_mount(bdev, nvme_fsexport);
+}
+
+void*
+nvme_driver_init(struct pci_device* pci)
+{
+    struct pci_base_addr* bar0 = &pci->bar[0];
+    if (!(bar0->type & BAR_TYPE_MMIO) || !bar0->start) {
+        kprintf(KWARN "BAR#0 is not MMIO\n");
+        return NULL;
+    }
+
+    // 与 virtio-blk 一样，传统的INTx为电平触发，故只使用MSI-X
+    if (!pci_msix_count(pci)) {
+        kprintf(KWARN "no MSI-X, skipped\n");
+        return NULL;
+    }
+
+    pci_reg_t cmd = pci_read_cspace(pci->cspace_base, PCI_REG_STATUS_CMD);
+    cmd |= (PCI_RCMD_MM_ACCESS | PCI_RCMD_DISABLE_INTR | PCI_RCMD_BUS_MASTER);
+    pci_write_cspace(pci->cspace_base, PCI_REG_STATUS_CMD, cmd);
+
+    struct nvme_ctrl* ctrl = vzalloc(sizeof(*ctrl));
+    ctrl->pci = pci;
+    ctrl->regs = ioremap(bar0->start, bar0->size);
+    llist_init_head(&ctrl->pending);
+
+    if (__nvme_setup_ctrl(ctrl)) {
+        kprintf(KERROR "controller not ready\n");
+        return NULL;
+    }
+
+    ptr_t id_pa;
+    u8_t* id = nvme_alloc_page(&id_pa);
+    if (!id || __nvme_identify_ctrl(ctrl, id, id_pa)) {
+        kprintf(KERROR "identify failed\n");
+        return NULL;
+    }
+
+    if (__nvme_setup_ioq(ctrl)) {
+        kprintf(KERROR "I/O queue setup failed\n");
+        return NULL;
+    }
+
+    kprintf(KINFO "nvme%d: %s, max_xfer=%d, sgl=%d\n",
+            nr_ctrls,
+            ctrl->model,
+            ctrl->max_xfer,
+            ctrl->sgls);
+
+    for (u32_t nsid = 1; nsid <= ctrl->nr_ns; nsid++) {
+        __nvme_register_ns(ctrl, nsid, id, id_pa);
+    }
+
+    nr_ctrls++;
+
+    return ctrl;
+}
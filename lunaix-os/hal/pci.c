@@ -13,7 +13,9 @@
 #include <hal/pci.h>
 #include <klibc/string.h>
 #include <lunaix/fs/twifs.h>
+#include <lunaix/mm/mmio.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/sched.h>
 #include <lunaix/spike.h>
 #include <lunaix/syslog.h>
 
@@ -22,9 +24,18 @@ LOG_MODULE("PCI")
 static DEFINE_LLIST(pci_devices);
 static DEFINE_LLIST(pci_drivers);
 
+// 已扫描过的总线，以免经由多个桥重复扫描同一总线
+static u32_t probed_bus[256 / 32];
+
+volatile u8_t* pci_ecam[256];
+static struct acpi_mcfg_toc* ecam_windows = NULL;
+
 void
 pci_probe_msi_info(struct pci_device* device);
 
+static void
+__pci_probe_bus(int bus);
+
 void
 pci_probe_device(int bus, int dev, int funct)
 {
@@ -42,16 +53,26 @@ pci_probe_device(int bus, int dev, int funct)
     // 防止堆栈溢出
     // QEMU的ICH9/Q35实现似乎有点问题，对于多功能设备的每一个功能的header type
     //  都将第七位置位。而virtualbox 就没有这个毛病。
+    //  故第七位只在功能0上用于判断是否为多功能设备，但对每个功能都须清除。
     if ((hdr_type & 0x80) && funct == 0) {
-        hdr_type = hdr_type & ~0x80;
         // 探测多用途设备（multi-function device）
-        for (int i = 1; i < 7; i++) {
+        for (int i = 1; i < 8; i++) {
             pci_probe_device(bus, dev, i);
         }
     }
+    hdr_type = hdr_type & ~0x80;
+
+    if (hdr_type == PCI_TPCIBRIDGE) {
+        // 桥之后的总线号记于其次级总线号寄存器（偏移0x18，位8-15）
+        int secondary = (pci_read_cspace(base, 0x18) >> 8) & 0xff;
+        if (secondary) {
+            __pci_probe_bus(secondary);
+        }
+        return;
+    }
 
     if (hdr_type != PCI_TDEV) {
-        // XXX: 目前忽略所有桥接设备，比如PCI-PCI桥接器，或者是CardBus桥接器
+        // XXX: 目前忽略CardBus桥接器
         return;
     }
 
@@ -87,14 +108,66 @@ pci_probe_device(int bus, int dev, int funct)
     }
 }
 
+/**
+ * @brief 映射总线的ECAM窗口。仅映射实际扫描到的总线，而非MCFG所述的整个区间
+ *  （256条总线共需256MiB的虚拟地址空间）
+ *
+ */
+static void
+__pci_ecam_map(int bus)
+{
+    if (!ecam_windows) {
+        return;
+    }
+
+    for (size_t i = 0; i < ecam_windows->alloc_num; i++) {
+        struct mcfg_alloc_info* win = &ecam_windows->allocations[i];
+        // 传统的配置地址没有段号，故只使用0号段
+        if (win->pci_seg_num || !win->base_addr || bus < win->pci_bus_start ||
+            bus > win->pci_bus_end) {
+            continue;
+        }
+
+        // 基地址对应于0号总线，即便窗口并非由0号总线起始
+        pci_ecam[bus] = ioremap(win->base_addr + (bus << 20), 1 << 20);
+        return;
+    }
+}
+
+static void
+__pci_probe_bus(int bus)
+{
+    if ((probed_bus[bus / 32] & (1 << (bus % 32)))) {
+        return;
+    }
+    probed_bus[bus / 32] |= 1 << (bus % 32);
+
+    __pci_ecam_map(bus);
+
+    for (int dev = 0; dev < 32; dev++) {
+        pci_probe_device(bus, dev, 0);
+    }
+    preempt_point();
+}
+
 void
 pci_probe()
 {
-    // 暴力扫描所有PCI设备
-    // XXX: 尽管最多会有256条PCI总线，但就目前而言，只考虑bus #0就足够了
-    for (int bus = 0; bus < 256; bus++) {
-        for (int dev = 0; dev < 32; dev++) {
-            pci_probe_device(bus, dev, 0);
+    // 由bus #0起，沿PCI-PCI桥递归扫描，而非暴力扫描全部256条总线
+    u32_t host = PCI_ADDRESS(0, 0, 0);
+    pci_reg_t hdr_type = (pci_read_cspace(host, 0xc) >> 16) & 0xff;
+
+    __pci_probe_bus(0);
+
+    if (!(hdr_type & 0x80)) {
+        return;
+    }
+
+    // 多功能的主桥：每个功能对应一个主桥，其功能号即所负责的总线号
+    for (int funct = 1; funct < 8; funct++) {
+        pci_reg_t reg = pci_read_cspace(PCI_ADDRESS(0, 0, funct), 0);
+        if (PCI_DEV_VENDOR(reg) != PCI_VENDOR_INVLD) {
+            __pci_probe_bus(funct);
         }
     }
 }
@@ -126,8 +199,10 @@ pci_probe_msi_info(struct pci_device* device)
     pci_reg_t status =
       pci_read_cspace(device->cspace_base, PCI_REG_STATUS_CMD) >> 16;
 
+    device->msi_loc = 0;
+    device->msix_loc = 0;
+
     if (!(status & 0x10)) {
-        device->msi_loc = 0;
         return;
     }
 
@@ -136,10 +211,10 @@ pci_probe_msi_info(struct pci_device* device)
 
     while (cap_ptr) {
         cap_hdr = pci_read_cspace(device->cspace_base, cap_ptr);
-        if ((cap_hdr & 0xff) == 0x5) {
-            // MSI
+        if ((cap_hdr & 0xff) == PCI_CAP_MSI) {
             device->msi_loc = cap_ptr;
-            return;
+        } else if ((cap_hdr & 0xff) == PCI_CAP_MSIX) {
+            device->msix_loc = cap_ptr;
         }
         cap_ptr = (cap_hdr >> 8) & 0xff;
     }
@@ -291,6 +366,92 @@ pci_setup_msi(struct pci_device* device, int vector)
     pci_write_cspace(device->cspace_base, device->msi_loc, reg1);
 }
 
+int
+pci_msix_count(struct pci_device* device)
+{
+    if (!device->msix_loc) {
+        return 0;
+    }
+
+    pci_reg_t msg_ctl =
+      pci_read_cspace(device->cspace_base, device->msix_loc) >> 16;
+    return MSIX_TABLE_SIZE(msg_ctl);
+}
+
+int
+pci_setup_msix(struct pci_device* device, int* vectors, int nr)
+{
+    int size = pci_msix_count(device);
+    if (!size || nr > size || nr <= 0) {
+        return EINVAL;
+    }
+
+    u32_t cspace = device->cspace_base;
+    pci_reg_t reg1 = pci_read_cspace(cspace, device->msix_loc);
+
+    if (!device->msix_table) {
+        pci_reg_t loc = pci_read_cspace(cspace, PCI_MSIX_TABLE(device->msix_loc));
+        struct pci_base_addr* bar = &device->bar[MSIX_TABLE_BIR(loc)];
+        if (!(bar->type & BAR_TYPE_MMIO)) {
+            return EINVAL;
+        }
+
+        // 表未必按页对齐
+        uintptr_t table_pa = bar->start + MSIX_TABLE_OFFSET(loc);
+        uintptr_t map_pa = PG_ALIGN(table_pa);
+        u32_t map_size = table_pa - map_pa + size * MSIX_ENTRY_SIZE;
+
+        u8_t* mapped = ioremap(map_pa, map_size);
+        if (!mapped) {
+            return ENOMEM;
+        }
+        device->msix_table = (u32_t*)(mapped + (table_pa - map_pa));
+    }
+
+    // 设置表项期间屏蔽整个功能，以免设备以半成品的表项发出中断
+    reg1 |= (MSIX_CAP_ENABLE | MSIX_CAP_FMASK) << 16;
+    pci_write_cspace(cspace, device->msix_loc, reg1);
+
+    // 与 MSI 相同：Dest: APIC#0, Physical Destination; Edge trigger, Fixed
+    for (int i = 0; i < size; i++) {
+        volatile u32_t* ent = &device->msix_table[i * 4];
+        if (i >= nr) {
+            ent[MSIX_ENT_CTRL] |= MSIX_ENT_MASKED;
+            continue;
+        }
+        ent[MSIX_ENT_ADDR_LO] = __APIC_BASE_PADDR;
+        ent[MSIX_ENT_ADDR_HI] = 0;
+        ent[MSIX_ENT_DATA] = vectors[i] & 0xff;
+        ent[MSIX_ENT_CTRL] &= ~MSIX_ENT_MASKED;
+    }
+
+    // MSI 与 MSI-X 不得同时启用
+    if (device->msi_loc) {
+        pci_reg_t msi = pci_read_cspace(cspace, device->msi_loc);
+        pci_write_cspace(cspace, device->msi_loc, msi & ~(MSI_CAP_ENABLE << 16));
+    }
+
+    reg1 &= ~(MSIX_CAP_FMASK << 16);
+    pci_write_cspace(cspace, device->msix_loc, reg1);
+
+    return 0;
+}
+
+void
+pci_msix_mask(struct pci_device* device, int entry, int masked)
+{
+    if (!device->msix_table) {
+        return;
+    }
+
+    volatile u32_t* ent = &device->msix_table[entry * 4];
+    if (masked) {
+        ent[MSIX_ENT_CTRL] |= MSIX_ENT_MASKED;
+    } else {
+        ent[MSIX_ENT_CTRL] &= ~MSIX_ENT_MASKED;
+    }
+}
+
 struct pci_device*
 pci_get_device_by_id(uint16_t vendorId, uint16_t deviceId)
 {
@@ -329,7 +490,8 @@ pci_add_driver(const char* name,
 {
     struct pci_driver* pci_drv = valloc(sizeof(*pci_drv));
     *pci_drv = (struct pci_driver){ .create_driver = init,
-                                    .dev_info = (vendor << 16) | devid,
+                                    // 与 pci_device::device_info 的布局一致
+                                    .dev_info = vendor | (devid << 16),
                                     .dev_class = class };
     if (name) {
         strncpy(pci_drv->name, name, PCI_DRV_NAME_LEN);
@@ -369,9 +531,10 @@ pci_init()
     assert_msg(acpi, "ACPI not initialized.");
     if (acpi->mcfg.alloc_num) {
         // PCIe Enhanced Configuration Mechanism is supported.
-        // TODO: support PCIe addressing mechanism
+        ecam_windows = &acpi->mcfg;
+        kprintf(KINFO "ECAM: %d window(s)\n", acpi->mcfg.alloc_num);
     }
-    // Otherwise, fallback to use legacy PCI 3.0 method.
+    // Buses outside of any window fallback to the legacy PCI 3.0 method.
     pci_probe();
 
     pci_build_fsmapping();
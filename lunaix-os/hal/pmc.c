@@ -0,0 +1,253 @@
+/**
+ * @file pmc.c
+ * @brief 通用性能监测计数器的设置与读取，见 hal/pmc.h
+ *
+ */
+#include <cpuid.h>
+#include <hal/cpu.h>
+#include <hal/pmc.h>
+
+#include <klibc/string.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/percpu.h>
+#include <lunaix/syslog.h>
+
+#ifdef LUNAIX_PMC
+
+LOG_MODULE("PMC")
+
+// reference: Intel manual, section 19.2.1 & 19.2.2
+#define IA32_PERFEVTSEL0 0x186
+#define IA32_PERF_GLOBAL_CTRL 0x38f
+
+// reference: AMD64 manual vol.2, section 13.2.1
+#define AMD_PERFEVTSEL0 0xc0010000
+
+#define EVTSEL_USR (1 << 16)
+#define EVTSEL_OS (1 << 17)
+#define EVTSEL_EN (1 << 22)
+
+// 所用的事件号均不超过 0xff，事件选择寄存器的高32位恒为0
+#define EVTSEL(event, umask)                                                   \
+    ((event) | ((umask) << 8) | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN)
+
+static const char* pmc_names[PMC_NR] = {
+    [PMC_CYCLES] = "cycles",
+    [PMC_INSTRUCTIONS] = "instructions",
+    [PMC_LLC_MISSES] = "llc_misses",
+    [PMC_DTLB_MISSES] = "dtlb_misses",
+};
+
+// 各事件的事件选择值与所用的计数器（rdpmc 的编号），仅 pmc_avail 中的有效
+static u32_t pmc_evtsel[PMC_NR];
+static u32_t pmc_counter[PMC_NR];
+static u32_t pmc_avail;
+static u32_t pmc_evtsel_base;
+static u32_t pmc_global_ctrl;
+static u64_t pmc_mask;
+static int pmc_probed;
+
+static DEFINE_PERCPU(struct pmc_sample, pmc_last);
+
+static inline u64_t
+__pmc_rdpmc(u32_t counter)
+{
+    u32_t hi, lo;
+    asm volatile("rdpmc" : "=d"(hi), "=a"(lo) : "c"(counter));
+    return ((u64_t)hi << 32) | lo;
+}
+
+static void
+__pmc_use(u32_t event, u32_t evtsel, u32_t nr_counters)
+{
+    u32_t counter = 0;
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        counter += !!(pmc_avail & (1 << i));
+    }
+
+    if (counter >= nr_counters) {
+        return;
+    }
+
+    pmc_evtsel[event] = evtsel;
+    pmc_counter[event] = counter;
+    pmc_avail |= 1 << event;
+}
+
+static void
+__pmc_probe_intel()
+{
+    // reference: Intel manual, section 19.2.1.1 & table 19-1
+    reg32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0, 0) < 0xa) {
+        return;
+    }
+    __cpuid(0xa, eax, ebx, ecx, edx);
+
+    u32_t version = eax & 0xff;
+    u32_t nr = (eax >> 8) & 0xff;
+    u32_t width = (eax >> 16) & 0xff;
+    u32_t vec_len = (eax >> 24) & 0xff;
+
+    if (!version || !nr || !width) {
+        return;
+    }
+
+    // EBX 中置位的为不可用的架构事件
+    u32_t missing = ebx | ~((1 << vec_len) - 1);
+
+    if (!(missing & (1 << 0))) {
+        __pmc_use(PMC_CYCLES, EVTSEL(0x3c, 0x00), nr);
+    }
+    if (!(missing & (1 << 1))) {
+        __pmc_use(PMC_INSTRUCTIONS, EVTSEL(0xc0, 0x00), nr);
+    }
+    if (!(missing & (1 << 4))) {
+        __pmc_use(PMC_LLC_MISSES, EVTSEL(0x2e, 0x41), nr);
+    }
+    // DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK（Nehalem 至 Skylake）
+    __pmc_use(PMC_DTLB_MISSES, EVTSEL(0x08, 0x01), nr);
+
+    pmc_evtsel_base = IA32_PERFEVTSEL0;
+    pmc_mask = width >= 64 ? (u64_t)-1 : ((u64_t)1 << width) - 1;
+
+    // 版本2起，通用计数器另须于全局控制寄存器中开启
+    if (version >= 2) {
+        pmc_global_ctrl = (1 << nr) - 1;
+    }
+}
+
+static void
+__pmc_probe_amd()
+{
+    // reference: AMD64 manual vol.2, section 13.2.1; 各代的 BKDG/PPR
+    reg32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    u32_t family = (eax >> 8) & 0xf;
+    if (family == 0xf) {
+        family += (eax >> 20) & 0xff;
+    }
+
+    // 传统的4个计数器自 K7 起即存在
+    if (family < 0x6) {
+        return;
+    }
+
+    __pmc_use(PMC_CYCLES, EVTSEL(0x76, 0x00), 4);
+    __pmc_use(PMC_INSTRUCTIONS, EVTSEL(0xc0, 0x00), 4);
+
+    if (family >= 0x17) {
+        // L2 缺失（来自L1数据与指令缓存的请求）；L1 DTLB 缺失
+        __pmc_use(PMC_LLC_MISSES, EVTSEL(0x64, 0x09), 4);
+        __pmc_use(PMC_DTLB_MISSES, EVTSEL(0x45, 0xff), 4);
+    } else {
+        // L2 缺失；L1 与 L2 DTLB 均缺失
+        __pmc_use(PMC_LLC_MISSES, EVTSEL(0x7e, 0x07), 4);
+        __pmc_use(PMC_DTLB_MISSES, EVTSEL(0x46, 0x07), 4);
+    }
+
+    pmc_evtsel_base = AMD_PERFEVTSEL0;
+    pmc_mask = ((u64_t)1 << 48) - 1;
+}
+
+static void
+__pmc_probe()
+{
+    char vendor[13];
+    cpu_get_model(vendor);
+
+    if (!memcmp(vendor, "GenuineIntel", 12)) {
+        __pmc_probe_intel();
+    } else if (!memcmp(vendor, "AuthenticAMD", 12)) {
+        __pmc_probe_amd();
+    }
+
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        kprintf("%s: %s\n",
+                pmc_names[i],
+                (pmc_avail & (1 << i)) ? "available" : "unavailable");
+    }
+}
+
+void
+pmc_init()
+{
+    // 各处理器视为同构，只于BSP上检测一次
+    if (!pmc_probed) {
+        __pmc_probe();
+        pmc_probed = 1;
+    }
+
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        if (!(pmc_avail & (1 << i))) {
+            continue;
+        }
+
+        cpu_wrmsr(pmc_evtsel_base + pmc_counter[i], 0, pmc_evtsel[i]);
+    }
+
+    if (pmc_global_ctrl) {
+        cpu_wrmsr(IA32_PERF_GLOBAL_CTRL, 0, pmc_global_ctrl);
+    }
+
+    pmc_read(this_cpu_ptr(pmc_last));
+}
+
+u32_t
+pmc_available()
+{
+    return pmc_avail;
+}
+
+const char*
+pmc_name(u32_t event)
+{
+    return event < PMC_NR ? pmc_names[event] : NULL;
+}
+
+void
+pmc_read(struct pmc_sample* sample)
+{
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        sample->v[i] =
+          (pmc_avail & (1 << i)) ? __pmc_rdpmc(pmc_counter[i]) : 0;
+    }
+}
+
+void
+pmc_accumulate(u64_t* acc)
+{
+    if (!pmc_avail) {
+        return;
+    }
+
+    struct pmc_sample now;
+    struct pmc_sample* last = this_cpu_ptr(pmc_last);
+
+    pmc_read(&now);
+
+    // 计数器的宽度不足64位，差值须按其宽度回绕
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        acc[i] += (now.v[i] - last->v[i]) & pmc_mask;
+    }
+
+    *last = now;
+}
+
+static void
+__pmc_rd_events(struct twimap* map)
+{
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        twimap_printf(map, "%s %u\n", pmc_names[i], !!(pmc_avail & (1 << i)));
+    }
+}
+
+void
+pmc_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "pmc");
+    map->read = __pmc_rd_events;
+}
+
+#endif
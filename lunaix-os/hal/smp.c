@@ -0,0 +1,210 @@
+/**
+ * @file smp.c
+ * @brief 多处理器探测：依照MADT唤醒应用处理器（AP），确认其可以响应
+ *
+ * 目前内核的调度器、中断入口（__current）以及各类分配器均未考虑并发，
+ * 因此AP只完成最基本的初始化（GDT、IDT、TSS、PAT、Local APIC）便屏蔽中断并
+ * 停机待命，不执行任何内核代码：它们没有per-CPU数据区、中断栈与FPU状态，
+ * 不接收外部中断，也不参与调度。内核仍是单处理器的，只有BSP执行内核代码，
+ * 停机的AP仅在 /cpus 中列出。
+ *
+ */
+#include <hal/acpi/acpi.h>
+#include <hal/apic.h>
+#include <hal/cpu.h>
+#include <hal/smp.h>
+
+#include <klibc/string.h>
+#include <lunaix/clock.h>
+#include <lunaix/common.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/percpu.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("SMP")
+
+// 等待AP上线的时限（毫秒）
+#define AP_BOOT_TIMEOUT 100
+
+extern u8_t ap_trampoline_start[];
+extern u8_t ap_trampoline_end[];
+extern u8_t ap_tramp_cr3[];
+extern u8_t ap_tramp_stack[];
+extern u8_t ap_tramp_entry[];
+
+extern u64_t _gdt[];
+extern u16_t _gdt_limit;
+extern u64_t _idt[];
+extern u16_t _idt_limit;
+
+static struct cpu_info cpus[SMP_MAX_CPU];
+// 已探测到的处理器数，包括BSP与停机待命的AP
+static u32_t nr_cpus = 1;
+
+// 正在启动的AP的编号。AP逐个启动，因此无需加锁
+static volatile u32_t booting_cpu;
+
+#define TRAMP_VAR(sym)                                                         \
+    (*(u32_t*)(AP_TRAMPOLINE + ((uintptr_t)(sym) -                             \
+                                (uintptr_t)ap_trampoline_start)))
+
+static void
+__delay_ms(u32_t ms)
+{
+    time_t until = clock_systime() + ms;
+    wait_until(clock_systime() >= until);
+}
+
+static void
+__ap_load_tables(u32_t cpu)
+{
+    struct
+    {
+        u16_t limit;
+        u32_t base;
+    } __attribute__((packed)) gdtr = { _gdt_limit, (u32_t)_gdt },
+                              idtr = { _idt_limit, (u32_t)_idt };
+
+    asm volatile("lgdt %0\n"
+                 "movw %w2, %%ax\n"
+                 "movw %%ax, %%ds\n"
+                 "movw %%ax, %%es\n"
+                 "movw %%ax, %%fs\n"
+                 "movw %%ax, %%gs\n"
+                 "movw %%ax, %%ss\n"
+                 "pushl %3\n"
+                 "pushl $1f\n"
+                 "lret\n"
+                 "1:\n"
+                 "lidt %1\n" ::"m"(gdtr),
+                 "m"(idtr),
+                 "i"(KDATA_SEG),
+                 "i"(KCODE_SEG)
+                 : "eax", "memory");
+
+    asm volatile("ltr %w0" ::"r"(TSS_SEG_AP(cpu)));
+}
+
+static void
+__ap_main()
+{
+    u32_t cpu = booting_cpu;
+
+    __ap_load_tables(cpu);
+    // 所有处理器的PAT须一致，否则同一物理页的缓存类型将互相矛盾
+    cpu_init_pat();
+    apic_init_ap();
+
+    cpus[cpu].parked = 1;
+
+    // 停机待命。见文件头部的说明
+    while (1) {
+        asm volatile("cli\n"
+                     "hlt");
+    }
+}
+
+static int
+__boot_ap(u32_t cpu)
+{
+    struct cpu_info* info = &cpus[cpu];
+
+    if (!(info->stack = valloc(AP_STACK_SIZE))) {
+        return 0;
+    }
+
+    TRAMP_VAR(ap_tramp_cr3) = cpu_rcr3();
+    TRAMP_VAR(ap_tramp_stack) = (u32_t)info->stack + AP_STACK_SIZE - 16;
+    TRAMP_VAR(ap_tramp_entry) = (u32_t)__ap_main;
+    booting_cpu = cpu;
+
+    // INIT-SIPI-SIPI, see Intel Multiprocessor Specification, B.4
+    apic_send_ipi(info->apic_id,
+                  ICR_DELIVERY_INIT | ICR_LEVEL_ASSERT | ICR_TRIGGER_LEVEL);
+    apic_send_ipi(info->apic_id, ICR_DELIVERY_INIT | ICR_TRIGGER_LEVEL);
+    __delay_ms(10);
+
+    for (int i = 0; i < 2 && !info->parked; i++) {
+        apic_send_ipi(info->apic_id,
+                      ICR_DELIVERY_STARTUP | (AP_TRAMPOLINE >> PG_SIZE_BITS));
+        __delay_ms(1);
+    }
+
+    time_t deadline = clock_systime() + AP_BOOT_TIMEOUT;
+    wait_until(info->parked || clock_systime() >= deadline);
+
+    if (!info->parked) {
+        vfree(info->stack);
+        info->stack = NULL;
+    }
+
+    return info->parked;
+}
+
+static void
+__smp_rd_cpus(struct twimap* map)
+{
+    for (u32_t i = 0; i < nr_cpus; i++) {
+        twimap_printf(map,
+                      "%u %u %s\n",
+                      i,
+                      cpus[i].apic_id,
+                      cpus[i].parked ? "parked" : "running");
+    }
+}
+
+void
+smp_init()
+{
+    acpi_madt_toc_t* madt = &acpi_get_context()->madt;
+    u32_t bsp_id = apic_id();
+
+    cpus[0] = (struct cpu_info){ .apic_id = bsp_id };
+
+    // 启动代码的执行早于AP开启分页，须对其所在页作恒等映射
+    v_mapping mapping;
+    int mapped = vmm_lookup(AP_TRAMPOLINE, &mapping) &&
+                 PG_ENTRY_ADDR(*mapping.pte) == AP_TRAMPOLINE &&
+                 (*mapping.pte & PG_PRESENT);
+    if (!mapped) {
+        vmm_set_mapping(
+          PD_REFERENCED, AP_TRAMPOLINE, AP_TRAMPOLINE, PG_PREM_RW, VMAP_NULL);
+    }
+
+    memcpy((void*)AP_TRAMPOLINE,
+           ap_trampoline_start,
+           ap_trampoline_end - ap_trampoline_start);
+
+    for (u32_t i = 0; i < madt->apic_count && nr_cpus < SMP_MAX_CPU; i++) {
+        acpi_apic_t* apic = madt->apics[i];
+        if (apic->apic_id == bsp_id || !(apic->flags & ACPI_APIC_ENABLED)) {
+            continue;
+        }
+
+        cpus[nr_cpus].apic_id = apic->apic_id;
+        if (__boot_ap(nr_cpus)) {
+            nr_cpus++;
+        } else {
+            kprintf(KWARN "cpu (apic %u) did not respond\n", apic->apic_id);
+        }
+    }
+
+    if (!mapped) {
+        vmm_del_mapping(PD_REFERENCED, AP_TRAMPOLINE);
+    }
+
+    kprintf(KINFO "%u processor(s) found, APs parked\n", nr_cpus);
+
+    struct twimap* map = twifs_mapping(NULL, NULL, "cpus");
+    map->read = __smp_rd_cpus;
+}
+
+u32_t
+smp_cpu_id()
+{
+    // 单条指令，且无需访问Local APIC
+    return this_cpu_read(percpu_cpu_id);
+}
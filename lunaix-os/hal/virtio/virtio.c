@@ -0,0 +1,314 @@
+/**
+ * @file virtio.c
+ * @brief Virtio 1.0 PCI transport and split virtqueue
+ *
+ */
+#include <hal/virtio/virtio.h>
+
+#include <lunaix/mm/mmio.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+#define CC8(vdev, off) (*(volatile u8_t*)((vdev)->common + (off)))
+#define CC16(vdev, off) (*(volatile u16_t*)((vdev)->common + (off)))
+#define CC32(vdev, off) (*(volatile u32_t*)((vdev)->common + (off)))
+
+// 设备与处理器共享的内存（写回缓存）之间：x86 仅会将写操作延迟至其后的读操作之后
+#define virtio_mb() asm volatile("mfence" ::: "memory")
+#define virtio_wmb() asm volatile("" ::: "memory")
+
+static volatile u8_t*
+__virtio_map(struct pci_device* pci, u32_t bar, u32_t offset, u32_t length)
+{
+    if (bar > 5) {
+        return NULL;
+    }
+
+    struct pci_base_addr* ba = &pci->bar[bar];
+    if (!(ba->type & BAR_TYPE_MMIO) || !ba->start) {
+        return NULL;
+    }
+
+    // 各结构可能共用一个BAR，且未必按页对齐
+    uintptr_t pa = ba->start + offset;
+    uintptr_t map_pa = PG_ALIGN(pa);
+    u8_t* mapped = ioremap(map_pa, pa - map_pa + length);
+
+    return mapped ? mapped + (pa - map_pa) : NULL;
+}
+
+static void
+__virtio_set_status(struct virtio_dev* vdev, u8_t status)
+{
+    CC8(vdev, VIRTIO_CC_STATUS) = CC8(vdev, VIRTIO_CC_STATUS) | status;
+}
+
+int
+virtio_pci_init(struct virtio_dev* vdev, struct pci_device* pci)
+{
+    u32_t base = pci->cspace_base;
+    pci_reg_t status = pci_read_cspace(base, PCI_REG_STATUS_CMD) >> 16;
+
+    if (!(status & 0x10)) {
+        return ENOTSUP;
+    }
+
+    *vdev = (struct virtio_dev){ .pci = pci };
+
+    // 每种配置结构可能出现多次，按规范取第一个
+    pci_reg_t cap_ptr = pci_read_cspace(base, 0x34) & 0xff;
+    while (cap_ptr) {
+        u32_t hdr = pci_read_cspace(base, cap_ptr);
+        if ((hdr & 0xff) != PCI_CAP_VENDOR) {
+            goto next;
+        }
+
+        u32_t bar = pci_read_cspace(base, cap_ptr + VIRTIO_CAP_BAR) & 0xff;
+        u32_t off = pci_read_cspace(base, cap_ptr + VIRTIO_CAP_OFFSET);
+        u32_t len = pci_read_cspace(base, cap_ptr + VIRTIO_CAP_LENGTH);
+
+        switch (VIRTIO_CAP_TYPE(hdr)) {
+            case VIRTIO_PCI_CAP_COMMON:
+                if (!vdev->common) {
+                    vdev->common = __virtio_map(pci, bar, off, len);
+                }
+                break;
+            case VIRTIO_PCI_CAP_NOTIFY:
+                if (!vdev->notify) {
+                    vdev->notify = __virtio_map(pci, bar, off, len);
+                    vdev->notify_mul =
+                      pci_read_cspace(base, cap_ptr + VIRTIO_CAP_NOTIFY_MUL);
+                }
+                break;
+            case VIRTIO_PCI_CAP_ISR:
+                if (!vdev->isr) {
+                    vdev->isr = __virtio_map(pci, bar, off, len);
+                }
+                break;
+            case VIRTIO_PCI_CAP_DEVICE:
+                if (!vdev->devcfg) {
+                    vdev->devcfg = __virtio_map(pci, bar, off, len);
+                }
+                break;
+        }
+
+    next:
+        cap_ptr = (hdr >> 8) & 0xff;
+    }
+
+    // 仅有传统（legacy）I/O端口接口的设备不予支持
+    if (!vdev->common || !vdev->notify) {
+        return ENOTSUP;
+    }
+
+    pci_reg_t cmd = pci_read_cspace(base, PCI_REG_STATUS_CMD);
+    cmd |= (PCI_RCMD_MM_ACCESS | PCI_RCMD_DISABLE_INTR | PCI_RCMD_BUS_MASTER);
+    pci_write_cspace(base, PCI_REG_STATUS_CMD, cmd);
+
+    // 重置设备，写入0后须等待其读回0。参阅：Section 4.1.4.3.2
+    CC8(vdev, VIRTIO_CC_STATUS) = 0;
+    wait_until(!CC8(vdev, VIRTIO_CC_STATUS));
+
+    __virtio_set_status(vdev, VIRTIO_S_ACK);
+    __virtio_set_status(vdev, VIRTIO_S_DRIVER);
+
+    return 0;
+}
+
+int
+virtio_negotiate(struct virtio_dev* vdev, u64_t wanted)
+{
+    CC32(vdev, VIRTIO_CC_DFSELECT) = 0;
+    u64_t offered = CC32(vdev, VIRTIO_CC_DF);
+    CC32(vdev, VIRTIO_CC_DFSELECT) = 1;
+    offered |= (u64_t)CC32(vdev, VIRTIO_CC_DF) << 32;
+
+    u64_t features = offered & (wanted | VIRTIO_FEATURE(VIRTIO_F_VERSION_1));
+    if (!(features & VIRTIO_FEATURE(VIRTIO_F_VERSION_1))) {
+        return ENOTSUP;
+    }
+
+    CC32(vdev, VIRTIO_CC_GFSELECT) = 0;
+    CC32(vdev, VIRTIO_CC_GF) = (u32_t)features;
+    CC32(vdev, VIRTIO_CC_GFSELECT) = 1;
+    CC32(vdev, VIRTIO_CC_GF) = (u32_t)(features >> 32);
+
+    // 设备若不接受所选的特性组合，则不会保留 FEATURES_OK
+    __virtio_set_status(vdev, VIRTIO_S_FEATURES_OK);
+    if (!(CC8(vdev, VIRTIO_CC_STATUS) & VIRTIO_S_FEATURES_OK)) {
+        return ENOTSUP;
+    }
+
+    vdev->features = features;
+    return 0;
+}
+
+int
+virtq_setup(struct virtio_dev* vdev,
+            struct virtq* vq,
+            int index,
+            u16_t size,
+            u16_t msix)
+{
+    CC16(vdev, VIRTIO_CC_Q_SELECT) = index;
+
+    u16_t max = CC16(vdev, VIRTIO_CC_Q_SIZE);
+    if (!max) {
+        return EINVAL;
+    }
+
+    // 分离式队列的长度须为2的幂
+    size = MIN(MIN(size, max), VIRTQ_MAX_SIZE);
+    size = 1 << (31 - __builtin_clz(size));
+
+    *vq = (struct virtq){ .vdev = vdev,
+                          .index = index,
+                          .size = size,
+                          .event_idx = virtio_has(vdev, VIRTIO_F_EVENT_IDX) };
+
+    // 末尾各多出的两字节分别为 used_event 与 avail_event
+    vq->desc = vzalloc_dma(sizeof(struct virtq_desc) * size);
+    vq->avail =
+      vzalloc_dma(sizeof(struct virtq_avail) + sizeof(u16_t) * (size + 1));
+    vq->used = vzalloc_dma(sizeof(struct virtq_used) +
+                           sizeof(struct virtq_used_elem) * size +
+                           sizeof(u16_t));
+
+    if (!vq->desc || !vq->avail || !vq->used) {
+        return ENOMEM;
+    }
+
+    CC16(vdev, VIRTIO_CC_Q_SIZE) = size;
+
+    // 设备无法为队列分配该中断向量时会读回 NO_VECTOR
+    CC16(vdev, VIRTIO_CC_Q_MSIX) = msix;
+    if (CC16(vdev, VIRTIO_CC_Q_MSIX) != msix) {
+        return EINVAL;
+    }
+
+    ptr_t desc_pa = (ptr_t)vmm_v2p(vq->desc);
+    ptr_t avail_pa = (ptr_t)vmm_v2p((void*)vq->avail);
+    ptr_t used_pa = (ptr_t)vmm_v2p((void*)vq->used);
+
+    // 64位的字段可分两次以32位写入
+    CC32(vdev, VIRTIO_CC_Q_DESC) = desc_pa;
+    CC32(vdev, VIRTIO_CC_Q_DESC + 4) = 0;
+    CC32(vdev, VIRTIO_CC_Q_AVAIL) = avail_pa;
+    CC32(vdev, VIRTIO_CC_Q_AVAIL + 4) = 0;
+    CC32(vdev, VIRTIO_CC_Q_USED) = used_pa;
+    CC32(vdev, VIRTIO_CC_Q_USED + 4) = 0;
+
+    u16_t noff = CC16(vdev, VIRTIO_CC_Q_NOFF);
+    vq->notify = (volatile u16_t*)(vdev->notify + noff * vdev->notify_mul);
+
+    CC16(vdev, VIRTIO_CC_Q_ENABLE) = 1;
+
+    return 0;
+}
+
+void
+virtio_ready(struct virtio_dev* vdev)
+{
+    // 配置变更中断不使用
+    CC16(vdev, VIRTIO_CC_MSIX) = VIRTIO_MSI_NO_VECTOR;
+    __virtio_set_status(vdev, VIRTIO_S_DRIVER_OK);
+}
+
+void
+virtio_fail(struct virtio_dev* vdev)
+{
+    __virtio_set_status(vdev, VIRTIO_S_FAILED);
+}
+
+u32_t
+virtio_cfg_read32(struct virtio_dev* vdev, u32_t offset)
+{
+    return *(volatile virtio_u32a_t*)(vdev->devcfg + offset);
+}
+
+u64_t
+virtio_cfg_read64(struct virtio_dev* vdev, u32_t offset)
+{
+    u32_t lo, hi;
+    u8_t gen;
+
+    // 两次读取之间设备可能更新了配置，以配置代数判断读到的是否为同一版本
+    do {
+        gen = CC8(vdev, VIRTIO_CC_CFGGEN);
+        lo = virtio_cfg_read32(vdev, offset);
+        hi = virtio_cfg_read32(vdev, offset + 4);
+    } while (gen != CC8(vdev, VIRTIO_CC_CFGGEN));
+
+    return ((u64_t)hi << 32) | lo;
+}
+
+void
+virtq_publish(struct virtq* vq, u16_t head)
+{
+    vq->avail->ring[vq->avail_idx & (vq->size - 1)] = head;
+
+    // 描述符须先于 idx 对设备可见
+    virtio_wmb();
+    vq->avail->idx = ++vq->avail_idx;
+}
+
+void
+virtq_kick(struct virtq* vq)
+{
+    u16_t new = vq->avail_idx, old = vq->kicked_idx;
+    if (new == old) {
+        return;
+    }
+
+    // 读取 avail_event 之前，idx 的更新须已对设备可见，否则可能错过通知
+    virtio_mb();
+    vq->kicked_idx = new;
+
+    int need;
+    if (vq->event_idx) {
+        u16_t event = *(volatile virtio_u16a_t*)&vq->used->ring[vq->size];
+        // 设备期望在 avail->idx 越过 event 时得到通知。参阅：Section 2.6.7.2
+        need = (u16_t)(new - event - 1) < (u16_t)(new - old);
+    } else {
+        need = !(vq->used->flags & VIRTQ_USED_F_NO_NOTIFY);
+    }
+
+    if (need) {
+        *vq->notify = vq->index;
+        vq->kicks++;
+    } else {
+        vq->kicks_skipped++;
+    }
+}
+
+int
+virtq_pop(struct virtq* vq, u32_t* id, u32_t* len)
+{
+    if (vq->last_used == vq->used->idx) {
+        return 0;
+    }
+
+    volatile struct virtq_used_elem* elem =
+      &vq->used->ring[vq->last_used & (vq->size - 1)];
+    *id = elem->id;
+    *len = elem->len;
+    vq->last_used++;
+
+    return 1;
+}
+
+int
+virtq_rearm(struct virtq* vq)
+{
+    if (vq->event_idx) {
+        // 令设备在完成下一个请求时产生中断，而非每完成一个便中断一次
+        *(volatile u16_t*)&vq->avail->ring[vq->size] = vq->last_used;
+    }
+
+    // 设置 used_event 之后新产生的完成，可能未能触发中断
+    virtio_mb();
+    return vq->last_used != vq->used->idx;
+}
@@ -0,0 +1,465 @@
+/**
+ * @file virtio_blk.c
+ * @brief Virtio block device driver
+ *
+ */
+#include <hal/virtio/virtio_blk.h>
+
+#include <klibc/string.h>
+#include <lunaix/block.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/isrm.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("VBLK")
+
+// 槽位中与设备共享的某一字段的物理地址
+#define vblk_pa(slot, field)                                                   \
+    ((slot)->cmd_pa + ((ptr_t)(field) - (ptr_t)(slot)->cmd))
+
+static int nr_vblks = 0;
+
+static void
+__vblk_isr(const isr_param* param);
+
+static void
+__vblk_blkio_handler(struct blkio_req* req);
+
+static int
+__vblk_poll(struct blkio_context* ctx);
+
+static void
+__vblk_fsexport(struct block_dev* bdev, void* fs_node);
+
+void*
+vblk_driver_init(struct pci_device* pci);
+
+void
+virtio_blk_init()
+{
+    pci_add_driver("Virtio Block",
+                   VIRTIO_BLK_CLASS,
+                   VIRTIO_PCI_VENDOR,
+                   VIRTIO_BLK_DEVID_TRANS,
+                   vblk_driver_init);
+    pci_add_driver("Virtio Block",
+                   VIRTIO_BLK_CLASS,
+                   VIRTIO_PCI_VENDOR,
+                   VIRTIO_BLK_DEVID,
+                   vblk_driver_init);
+}
+
+static int
+__vblk_setup_slots(struct vblk_dev* vblk)
+{
+    struct virtio_dev* vdev = &vblk->vdev;
+    u32_t qsize = vblk->vq.size;
+
+    /*
+        每个请求占用一个槽位，槽位 s 总以第 s 个（间接）或第 s 组（直接）
+        描述符作为链首，故由已用环中的 id 即可直接找到槽位，无须另行分配描述符。
+        支持间接描述符时，请求只占用队列中的一项，描述符链放在槽位自己的表中。
+    */
+    if (virtio_has(vdev, VIRTIO_F_INDIRECT_DESC)) {
+        vblk->desc_per_req = VBLK_INDIRECT_DESC;
+        vblk->nr_slots = MIN(qsize, VBLK_MAX_SLOTS);
+    } else {
+        vblk->desc_per_req = MIN(qsize, VBLK_DIRECT_DESC);
+        vblk->nr_slots = MIN(qsize / vblk->desc_per_req, VBLK_MAX_SLOTS);
+    }
+
+    if (vblk->desc_per_req < 3) {
+        return EINVAL;
+    }
+
+    vblk->max_data_desc = vblk->desc_per_req - 2;
+    if (virtio_has(vdev, VIRTIO_BLK_F_SEG_MAX)) {
+        u32_t seg_max = virtio_cfg_read32(vdev, VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max) {
+            vblk->max_data_desc = MIN(vblk->max_data_desc, seg_max);
+        }
+    }
+
+    vblk->seg_limit = 0x400000;
+    if (virtio_has(vdev, VIRTIO_BLK_F_SIZE_MAX)) {
+        u32_t size_max = virtio_cfg_read32(vdev, VIRTIO_BLK_CFG_SIZE_MAX);
+        if (size_max >= PG_SIZE) {
+            vblk->seg_limit = size_max;
+        }
+    }
+
+    for (u32_t i = 0; i < vblk->nr_slots; i++) {
+        struct vblk_slot* slot = &vblk->slots[i];
+        slot->cmd = valloc_dma(sizeof(struct vblk_cmd));
+        if (!slot->cmd) {
+            return ENOMEM;
+        }
+        slot->cmd_pa = (ptr_t)vmm_v2p(slot->cmd);
+    }
+
+    return 0;
+}
+
+static void
+__vblk_register(struct vblk_dev* vblk)
+{
+    struct virtio_dev* vdev = &vblk->vdev;
+    u32_t blk_size = VIRTIO_BLK_SECTOR;
+
+    if (virtio_has(vdev, VIRTIO_BLK_F_BLK_SIZE)) {
+        blk_size = virtio_cfg_read32(vdev, VIRTIO_BLK_CFG_BLK_SIZE);
+        if (blk_size < VIRTIO_BLK_SECTOR || (blk_size % VIRTIO_BLK_SECTOR)) {
+            blk_size = VIRTIO_BLK_SECTOR;
+        }
+    }
+
+    // 容量总以512字节的扇区计
+    u64_t capacity = virtio_cfg_read64(vdev, VIRTIO_BLK_CFG_CAPACITY);
+    u64_t blocks = capacity / (blk_size / VIRTIO_BLK_SECTOR);
+
+    kprintf(KINFO "vblk%d: blk_size=%d, blk=0..%d, depth=%d, indirect=%d\n",
+            nr_vblks++,
+            blk_size,
+            (u32_t)(blocks - 1),
+            vblk->nr_slots,
+            virtio_has(vdev, VIRTIO_F_INDIRECT_DESC));
+
+    if (!blocks) {
+        return;
+    }
+
+    struct block_dev* bdev =
+      block_alloc_dev("VIRTIO BLOCK", vblk, __vblk_blkio_handler);
+
+    bdev->end_lba = blocks - 1;
+    bdev->blk_size = blk_size;
+    // 缓冲区各段通常不跨越两页以上，据此估计一个请求可合并的段数
+    bdev->blkio->max_segs =
+      MIN(MAX(vblk->max_data_desc / 2, 1), VBLK_MAX_VBUF_SEGS);
+    bdev->blkio->depth = vblk->nr_slots;
+    bdev->blkio->poll = __vblk_poll;
+
+    vblk->bdev = bdev;
+
+    block_mount(bdev, __vblk_fsexport);
+}
+
+void*
+vblk_driver_init(struct pci_device* pci)
+{
+    struct vblk_dev* vblk = vzalloc(sizeof(*vblk));
+    struct virtio_dev* vdev = &vblk->vdev;
+
+    if (virtio_pci_init(vdev, pci)) {
+        kprintf(KWARN "not a virtio 1.0 device, skipped\n");
+        goto fail;
+    }
+
+    if (!vdev->devcfg) {
+        kprintf(KWARN "no device configuration, skipped\n");
+        goto fail_dev;
+    }
+
+    // virtio 设备不提供MSI，而传统的INTx为电平触发，故只使用MSI-X
+    if (!pci_msix_count(pci)) {
+        kprintf(KWARN "no MSI-X, skipped\n");
+        goto fail_dev;
+    }
+
+    u64_t wanted = VIRTIO_FEATURE(VIRTIO_F_INDIRECT_DESC) |
+                   VIRTIO_FEATURE(VIRTIO_F_EVENT_IDX) |
+                   VIRTIO_FEATURE(VIRTIO_BLK_F_SIZE_MAX) |
+                   VIRTIO_FEATURE(VIRTIO_BLK_F_SEG_MAX) |
+                   VIRTIO_FEATURE(VIRTIO_BLK_F_RO) |
+                   VIRTIO_FEATURE(VIRTIO_BLK_F_BLK_SIZE) |
+                   VIRTIO_FEATURE(VIRTIO_BLK_F_FLUSH);
+
+    if (virtio_negotiate(vdev, wanted)) {
+        kprintf(KWARN "feature negotiation failed\n");
+        goto fail_dev;
+    }
+
+    vblk->iv = isrm_ivexalloc(__vblk_isr);
+    isrm_set_payload(vblk->iv, (ptr_t)vblk);
+
+    if (pci_setup_msix(pci, &vblk->iv, 1) ||
+        virtq_setup(vdev, &vblk->vq, 0, VIRTQ_MAX_SIZE, 0) ||
+        __vblk_setup_slots(vblk)) {
+        kprintf(KWARN "queue setup failed\n");
+        goto fail_iv;
+    }
+
+    virtio_ready(vdev);
+    __vblk_register(vblk);
+
+    return vblk;
+
+fail_iv:
+    isrm_set_payload(vblk->iv, 0);
+    isrm_ivfree(vblk->iv);
+fail_dev:
+    virtio_fail(vdev);
+fail:
+    // 已分配给队列的DMA内存可能已为设备所知，不予回收
+    return NULL;
+}
+
+static int
+__vblk_bind_vbuf(struct vblk_dev* vblk,
+                 struct virtq_desc* tbl,
+                 u32_t* n,
+                 struct vecbuf* vbuf,
+                 u16_t flags)
+{
+    u32_t i = *n, first = *n;
+    u32_t limit = first + vblk->max_data_desc;
+    uintptr_t prev_end = 0;
+    struct membuf* seg;
+
+    // 与 hba_bind_vbuf 相同：逐页转换地址，物理上相接的页并入同一描述符
+    vbuf_foreach(seg, vbuf)
+    {
+        uintptr_t va = (uintptr_t)seg->buffer;
+        size_t left = seg->size;
+
+        while (left) {
+            uintptr_t pa = (uintptr_t)vmm_v2p((void*)va);
+            size_t chunk = MIN(left, PG_SIZE - (va & (PG_SIZE - 1)));
+
+            if (i > first && prev_end == pa &&
+                tbl[i - 1].len + chunk <= vblk->seg_limit) {
+                tbl[i - 1].len += chunk;
+            } else {
+                if (i == limit) {
+                    return EINVAL;
+                }
+                tbl[i++] = (struct virtq_desc){ .addr = pa,
+                                                .len = chunk,
+                                                .flags = flags };
+            }
+
+            prev_end = pa + chunk;
+            va += chunk;
+            left -= chunk;
+        }
+    }
+
+    *n = i;
+    return 0;
+}
+
+static int
+__vblk_build(struct vblk_dev* vblk,
+             struct vblk_slot* slot,
+             struct blkio_req* req,
+             struct virtq_desc* tbl)
+{
+    struct vblk_cmd* cmd = slot->cmd;
+    u32_t n = 0;
+    u32_t type = VIRTIO_BLK_T_FLUSH;
+
+    if (!(req->flags & BLKIO_FLUSH)) {
+        type = (req->flags & BLKIO_WRITE) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    }
+
+    cmd->hdr = (struct vblk_req_hdr){
+        .type = type,
+        .sector = req->blk_addr * (vblk->bdev->blk_size / VIRTIO_BLK_SECTOR)
+    };
+    cmd->status = 0xff;
+
+    tbl[n++] = (struct virtq_desc){ .addr = vblk_pa(slot, &cmd->hdr),
+                                    .len = sizeof(cmd->hdr) };
+
+    if (type != VIRTIO_BLK_T_FLUSH) {
+        // 读请求的数据缓冲区由设备写入
+        u16_t flags = type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0;
+        if (__vblk_bind_vbuf(vblk, tbl, &n, &req->vbuf, flags)) {
+            return EINVAL;
+        }
+    }
+
+    tbl[n++] = (struct virtq_desc){ .addr = vblk_pa(slot, &cmd->status),
+                                    .len = 1,
+                                    .flags = VIRTQ_DESC_F_WRITE };
+
+    return n;
+}
+
+static void
+__vblk_fail(struct blkio_req* req, int status)
+{
+    req->errcode = status;
+    req->flags |= BLKIO_ERROR;
+    blkio_complete_async(req);
+}
+
+static void
+__vblk_blkio_handler(struct blkio_req* req)
+{
+    struct vblk_dev* vblk = (struct vblk_dev*)req->io_ctx->driver;
+    struct virtio_dev* vdev = &vblk->vdev;
+    struct virtq* vq = &vblk->vq;
+
+    if ((req->flags & BLKIO_FLUSH)) {
+        // 没有易失性写缓存的设备无须刷写
+        if (!virtio_has(vdev, VIRTIO_BLK_F_FLUSH)) {
+            blkio_complete_async(req);
+            return;
+        }
+    } else if ((req->flags & BLKIO_DISCARD)) {
+        __vblk_fail(req, VIRTIO_BLK_S_UNSUPP);
+        return;
+    } else if ((req->flags & BLKIO_WRITE) &&
+               virtio_has(vdev, VIRTIO_BLK_F_RO)) {
+        __vblk_fail(req, VIRTIO_BLK_S_UNSUPP);
+        return;
+    }
+
+    // blkio 保证在途的请求数不超过 depth，即槽位数
+    u32_t s = __builtin_ctz(~vblk->busy);
+    assert_msg(s < vblk->nr_slots, "VBLK: No free slot");
+
+    struct vblk_slot* slot = &vblk->slots[s];
+    int indirect = virtio_has(vdev, VIRTIO_F_INDIRECT_DESC);
+    u32_t base = indirect ? 0 : s * vblk->desc_per_req;
+    struct virtq_desc* tbl = indirect ? slot->cmd->table : &vq->desc[base];
+
+    int n = __vblk_build(vblk, slot, req, tbl);
+    if (n < 0) {
+        __vblk_fail(req, VIRTIO_BLK_S_IOERR);
+        return;
+    }
+
+    for (int i = 0; i < n - 1; i++) {
+        tbl[i].flags |= VIRTQ_DESC_F_NEXT;
+        tbl[i].next = base + i + 1;
+    }
+
+    if (indirect) {
+        vq->desc[s] =
+          (struct virtq_desc){ .addr = vblk_pa(slot, slot->cmd->table),
+                               .len = n * sizeof(struct virtq_desc),
+                               .flags = VIRTQ_DESC_F_INDIRECT };
+    }
+
+    slot->req = req;
+    vblk->busy |= 1 << s;
+
+    virtq_publish(vq, indirect ? s : base);
+    virtq_kick(vq);
+}
+
+static int
+__vblk_reap(struct vblk_dev* vblk)
+{
+    int indirect = virtio_has(&vblk->vdev, VIRTIO_F_INDIRECT_DESC);
+    int reaped = 0;
+    u32_t id, len;
+
+    do {
+        while (virtq_pop(&vblk->vq, &id, &len)) {
+            u32_t s = indirect ? id : id / vblk->desc_per_req;
+            if (s >= vblk->nr_slots || !vblk->slots[s].req) {
+                continue;
+            }
+
+            struct vblk_slot* slot = &vblk->slots[s];
+            struct blkio_req* req = slot->req;
+
+            u8_t status = slot->cmd->status;
+            if (status != VIRTIO_BLK_S_OK) {
+                req->errcode = status;
+                req->flags |= BLKIO_ERROR;
+            }
+
+            slot->req = NULL;
+            vblk->busy &= ~(1 << s);
+            blkio_complete_async(req);
+            reaped++;
+        }
+    } while (virtq_rearm(&vblk->vq));
+
+    return reaped;
+}
+
+static void
+__vblk_isr(const isr_param* param)
+{
+    struct vblk_dev* vblk = (struct vblk_dev*)isrm_get_payload(param);
+
+    if (!vblk) {
+        return;
+    }
+
+    vblk->intr_reaped += __vblk_reap(vblk);
+}
+
+static int
+__vblk_poll(struct blkio_context* ctx)
+{
+    struct vblk_dev* vblk = (struct vblk_dev*)ctx->driver;
+    int reaped = __vblk_reap(vblk);
+
+    vblk->poll_reaped += reaped;
+    return reaped;
+}
+
+static void
+__vblk_rd_features(struct twimap* map)
+{
+    struct vblk_dev* vblk = twimap_data(map, struct vblk_dev*);
+    u64_t features = vblk->vdev.features;
+
+    twimap_printf(map, "0x%08x%08x", (u32_t)(features >> 32), (u32_t)features);
+}
+
+static void
+__vblk_rd_queue(struct twimap* map)
+{
+    struct vblk_dev* vblk = twimap_data(map, struct vblk_dev*);
+
+    twimap_printf(map,
+                  "size: %d\nslots: %d\ndesc_per_req: %d\nmax_data_desc: "
+                  "%d\nindirect: %d\nevent_idx: %d\n",
+                  vblk->vq.size,
+                  vblk->nr_slots,
+                  vblk->desc_per_req,
+                  vblk->max_data_desc,
+                  virtio_has(&vblk->vdev, VIRTIO_F_INDIRECT_DESC),
+                  vblk->vq.event_idx);
+}
+
+static void
+__vblk_rd_stats(struct twimap* map)
+{
+    struct vblk_dev* vblk = twimap_data(map, struct vblk_dev*);
+
+    twimap_printf(map,
+                  "kicks: %d\nkicks_skipped: %d\nintr_reaped: %d\n"
+                  "poll_reaped: %d\n",
+                  vblk->vq.kicks,
+                  vblk->vq.kicks_skipped,
+                  vblk->intr_reaped,
+                  vblk->poll_reaped);
+}
+
+static void
+__vblk_fsexport(struct block_dev* bdev, void* fs_node)
+{
+    struct twifs_node* dev_root = (struct twifs_node*)fs_node;
+    struct twimap* map;
+
+    map = twifs_mapping(dev_root, bdev->driver, "features");
+    map->read = __vblk_rd_features;
+
+    map = twifs_mapping(dev_root, bdev->driver, "virtqueue");
+    map->read = __vblk_rd_queue;
+
+    map = twifs_mapping(dev_root, bdev->driver, "virtio_stats");
+    map->read = __vblk_rd_stats;
+}
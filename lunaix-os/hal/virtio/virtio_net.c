@@ -0,0 +1,765 @@
+/**
+ * @file virtio_net.c
+ * @brief Virtio network device driver, exported as a raw packet device
+ *
+ * 接收：缓冲区取自一个DMA蛋糕堆，初始化时一次取足，此后在设备、已收报文
+ *  队列与后备之间流转，不再分配。中断中每空出一个描述符，便以后备补上，
+ *  读者取走报文后再将缓冲区交还。报文头之后的帧由读者直接复制至其缓冲区。
+ *
+ * 发送：报文直接以调用者的缓冲区（vecbuf 的各段）进行DMA，不经中转。
+ *  一批报文一并提交、一次通知设备，再一次等待全部完成。
+ *
+ */
+#include <hal/virtio/virtio_net.h>
+
+#include <klibc/string.h>
+#include <lunaix/buffer.h>
+#include <lunaix/foptions.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/ioctl.h>
+#include <lunaix/isrm.h>
+#include <lunaix/mm/cake.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/poll.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("VNET")
+
+// 槽位中与设备共享的某一字段的物理地址
+#define vnet_pa(slot, field)                                                   \
+    ((slot)->cmd_pa + ((ptr_t)(field) - (ptr_t)(slot)->cmd))
+
+#define VNET_HDR_SIZE sizeof(struct vnet_hdr)
+
+static int nr_vnets = 0;
+
+static struct cake_pile* vnet_rxbuf_pile;
+
+static struct twifs_node* net_sysroot;
+
+static void
+__vnet_isr(const isr_param* param);
+
+static void
+__vnet_register(struct vnet_dev* vnet);
+
+void*
+vnet_driver_init(struct pci_device* pci);
+
+void
+virtio_net_init()
+{
+    vnet_rxbuf_pile =
+      cake_new_pile("vnet_rxbuf", VNET_RXBUF_SIZE, 4, PILE_DMA);
+    net_sysroot = twifs_dir_node(NULL, "net");
+
+    pci_add_driver("Virtio Net",
+                   VIRTIO_NET_CLASS,
+                   VIRTIO_PCI_VENDOR,
+                   VIRTIO_NET_DEVID_TRANS,
+                   vnet_driver_init);
+    pci_add_driver("Virtio Net",
+                   VIRTIO_NET_CLASS,
+                   VIRTIO_PCI_VENDOR,
+                   VIRTIO_NET_DEVID,
+                   vnet_driver_init);
+}
+
+/* ---- 接收 ---- */
+
+static void
+__vnet_rx_post(struct vnet_dev* vnet, u16_t id, void* buf)
+{
+    vnet->rxq.desc[id] = (struct virtq_desc){ .addr = (ptr_t)vmm_v2p(buf),
+                                              .len = VNET_RXBUF_SIZE,
+                                              .flags = VIRTQ_DESC_F_WRITE };
+    vnet->rx_posted[id] = buf;
+    virtq_publish(&vnet->rxq, id);
+}
+
+static int
+__vnet_setup_rx(struct vnet_dev* vnet)
+{
+    // 描述符 i 总是承载 rx_posted[i]，由已用环中的 id 即可找到缓冲区
+    vnet->nr_posted = MIN(vnet->rxq.size, VNET_RX_POSTED);
+
+    for (u32_t i = 0; i < VNET_RX_POOL; i++) {
+        void* buf = cake_grab(vnet_rxbuf_pile);
+        if (!buf) {
+            return ENOMEM;
+        }
+
+        if (i < vnet->nr_posted) {
+            __vnet_rx_post(vnet, i, buf);
+        } else {
+            vnet->rx_spare[vnet->nr_spare++] = buf;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 回收已收到的报文，以后备补上空出的描述符。于中断上下文中调用
+ *
+ */
+static int
+__vnet_rx_reap(struct vnet_dev* vnet)
+{
+    struct virtq* vq = &vnet->rxq;
+    int reaped = 0;
+    u32_t id, len;
+
+    do {
+        while (virtq_pop(vq, &id, &len)) {
+            if (id >= vnet->nr_posted || !vnet->rx_posted[id]) {
+                continue;
+            }
+
+            void* buf = vnet->rx_posted[id];
+            vnet->rx_posted[id] = NULL;
+
+            // 缓冲区总数即队列的容量，不会溢出
+            if (len > VNET_HDR_SIZE) {
+                len -= VNET_HDR_SIZE;
+                vnet->rx_ready[vnet->rx_head++ & (VNET_RX_POOL - 1)] =
+                  (struct vnet_rxpkt){ .buf = buf, .len = len };
+                vnet->rx_packets++;
+                vnet->rx_bytes += len;
+            } else {
+                vnet->rx_spare[vnet->nr_spare++] = buf;
+            }
+
+            if (vnet->nr_spare) {
+                __vnet_rx_post(vnet, id, vnet->rx_spare[--vnet->nr_spare]);
+            } else {
+                vnet->rx_empty[vnet->nr_empty++] = id;
+                vnet->rx_starved++;
+            }
+
+            reaped++;
+        }
+    } while (virtq_rearm(vq));
+
+    if (reaped) {
+        virtq_kick(vq);
+        event_signal(&vnet->arrival);
+    }
+
+    return reaped;
+}
+
+/**
+ * @brief 取出一个已收到的报文，没有时等待（nowait 时返回 EAGAIN）。
+ * 报文的缓冲区须经由 __vnet_rx_give 交还
+ *
+ */
+static int
+__vnet_rx_take(struct vnet_dev* vnet, struct vnet_rxpkt* pkt, int nowait)
+{
+    cpu_disable_interrupt();
+    while (vnet->rx_head == vnet->rx_tail) {
+        if (nowait) {
+            cpu_enable_interrupt();
+            return EAGAIN;
+        }
+        event_sleep(&vnet->arrival);
+        cpu_disable_interrupt();
+    }
+
+    *pkt = vnet->rx_ready[vnet->rx_tail++ & (VNET_RX_POOL - 1)];
+    cpu_enable_interrupt();
+
+    return 0;
+}
+
+static void
+__vnet_rx_give(struct vnet_dev* vnet, struct vnet_rxpkt* pkts, u32_t n)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // 优先补充留空的描述符，最后一并通知设备
+    for (u32_t i = 0; i < n; i++) {
+        if (vnet->nr_empty) {
+            u16_t id = vnet->rx_empty[--vnet->nr_empty];
+            __vnet_rx_post(vnet, id, pkts[i].buf);
+        } else {
+            vnet->rx_spare[vnet->nr_spare++] = pkts[i].buf;
+        }
+    }
+    virtq_kick(&vnet->rxq);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+static inline void*
+__vnet_rx_frame(struct vnet_rxpkt* pkt)
+{
+    return pkt->buf + VNET_HDR_SIZE;
+}
+
+/* ---- 发送 ---- */
+
+static int
+__vnet_setup_tx(struct vnet_dev* vnet)
+{
+    u32_t qsize = vnet->txq.size;
+
+    // 与 vblk 相同：槽位 s 总以第 s 个（间接）或第 s 组（直接）描述符作为链首
+    vnet->tx_indirect = virtio_has(&vnet->vdev, VIRTIO_F_INDIRECT_DESC);
+    if (vnet->tx_indirect) {
+        vnet->nr_tx_slots = MIN(qsize, VNET_TX_SLOTS);
+    } else {
+        vnet->nr_tx_slots = MIN(qsize / VNET_TX_DESC, VNET_TX_SLOTS);
+    }
+
+    if (!vnet->nr_tx_slots) {
+        return EINVAL;
+    }
+
+    for (u32_t i = 0; i < vnet->nr_tx_slots; i++) {
+        struct vnet_txslot* slot = &vnet->tx_slots[i];
+        slot->cmd = vzalloc_dma(sizeof(struct vnet_txcmd));
+        if (!slot->cmd) {
+            return ENOMEM;
+        }
+        slot->cmd_pa = (ptr_t)vmm_v2p(slot->cmd);
+    }
+
+    return 0;
+}
+
+static int
+__vnet_bind_vbuf(struct virtq_desc* tbl, u32_t* n, struct vecbuf* vbuf)
+{
+    u32_t i = *n, first = *n;
+    uintptr_t prev_end = 0;
+    struct membuf* seg;
+
+    // 与 __vblk_bind_vbuf 相同：逐页转换地址，物理上相接的页并入同一描述符
+    vbuf_foreach(seg, vbuf)
+    {
+        uintptr_t va = (uintptr_t)seg->buffer;
+        size_t left = seg->size;
+
+        while (left) {
+            uintptr_t pa = (uintptr_t)vmm_v2p((void*)va);
+            size_t chunk = MIN(left, PG_SIZE - (va & (PG_SIZE - 1)));
+
+            if (i > first && prev_end == pa) {
+                tbl[i - 1].len += chunk;
+            } else {
+                if (i == VNET_TX_DESC) {
+                    return EINVAL;
+                }
+                tbl[i++] = (struct virtq_desc){ .addr = pa, .len = chunk };
+            }
+
+            prev_end = pa + chunk;
+            va += chunk;
+            left -= chunk;
+        }
+    }
+
+    *n = i;
+    return 0;
+}
+
+/**
+ * @brief 将以 vbuf 描述的报文放入发送队列，但不通知设备。
+ * 没有空闲槽位时，通知设备并等待。vbuf 各段在完成前须保持驻留
+ *
+ */
+static int
+__vnet_tx_submit(struct vnet_dev* vnet,
+                 struct vecbuf* vbuf,
+                 struct vnet_batch* batch)
+{
+    struct virtq* vq = &vnet->txq;
+    u32_t mask = (u32_t)((1ULL << vnet->nr_tx_slots) - 1);
+
+    if (!vbuf_size(vbuf) || vbuf_size(vbuf) > VNET_FRAME_MAX) {
+        return EINVAL;
+    }
+
+    cpu_disable_interrupt();
+    while (!(~vnet->tx_busy & mask)) {
+        virtq_kick(vq);
+        event_sleep(&vnet->tx_free);
+        cpu_disable_interrupt();
+    }
+
+    u32_t s = __builtin_ctz(~vnet->tx_busy);
+    struct vnet_txslot* slot = &vnet->tx_slots[s];
+    u32_t base = vnet->tx_indirect ? 0 : s * VNET_TX_DESC;
+    struct virtq_desc* tbl =
+      vnet->tx_indirect ? slot->cmd->table : &vq->desc[base];
+    u32_t n = 0;
+
+    tbl[n++] = (struct virtq_desc){ .addr = vnet_pa(slot, &slot->cmd->hdr),
+                                    .len = VNET_HDR_SIZE };
+
+    if (__vnet_bind_vbuf(tbl, &n, vbuf)) {
+        cpu_enable_interrupt();
+        return EINVAL;
+    }
+
+    for (u32_t i = 0; i < n - 1; i++) {
+        tbl[i].flags |= VIRTQ_DESC_F_NEXT;
+        tbl[i].next = base + i + 1;
+    }
+
+    if (vnet->tx_indirect) {
+        vq->desc[s] =
+          (struct virtq_desc){ .addr = vnet_pa(slot, slot->cmd->table),
+                               .len = n * sizeof(struct virtq_desc),
+                               .flags = VIRTQ_DESC_F_INDIRECT };
+    }
+
+    slot->batch = batch;
+    vnet->tx_busy |= 1 << s;
+    batch->pending++;
+    vnet->tx_bytes += vbuf_size(vbuf);
+
+    virtq_publish(vq, vnet->tx_indirect ? s : base);
+    cpu_enable_interrupt();
+
+    return 0;
+}
+
+static void
+__vnet_batch_init(struct vnet_batch* batch)
+{
+    event_init(&batch->done);
+    batch->pending = 1;
+}
+
+/**
+ * @brief 通知设备，并等待批次中的所有发送完成
+ *
+ */
+static void
+__vnet_batch_wait(struct vnet_dev* vnet, struct vnet_batch* batch)
+{
+    cpu_disable_interrupt();
+    virtq_kick(&vnet->txq);
+
+    // 放下提交者持有的一份，此后计数归零时才会通告
+    u32_t pending = --batch->pending;
+    cpu_enable_interrupt();
+
+    if (pending) {
+        event_wait(&batch->done);
+    }
+}
+
+/**
+ * @brief 回收已完成的发送。于中断上下文中调用
+ *
+ */
+static int
+__vnet_tx_reap(struct vnet_dev* vnet)
+{
+    struct virtq* vq = &vnet->txq;
+    int reaped = 0;
+    u32_t id, len;
+
+    do {
+        while (virtq_pop(vq, &id, &len)) {
+            u32_t s = vnet->tx_indirect ? id : id / VNET_TX_DESC;
+            if (s >= vnet->nr_tx_slots || !(vnet->tx_busy & (1 << s))) {
+                continue;
+            }
+
+            struct vnet_batch* batch = vnet->tx_slots[s].batch;
+            vnet->tx_slots[s].batch = NULL;
+            vnet->tx_busy &= ~(1 << s);
+
+            if (!--batch->pending) {
+                event_signal(&batch->done);
+            }
+
+            vnet->tx_packets++;
+            reaped++;
+        }
+    } while (virtq_rearm(vq));
+
+    if (reaped) {
+        event_signal(&vnet->tx_free);
+    }
+
+    return reaped;
+}
+
+static void
+__vnet_isr(const isr_param* param)
+{
+    struct vnet_dev* vnet = (struct vnet_dev*)isrm_get_payload(param);
+
+    if (!vnet) {
+        return;
+    }
+
+    // 仅有一个 MSI-X 表项时两个队列共用之，两边都检查亦无妨
+    __vnet_rx_reap(vnet);
+    __vnet_tx_reap(vnet);
+}
+
+/* ---- 驱动初始化 ---- */
+
+void*
+vnet_driver_init(struct pci_device* pci)
+{
+    struct vnet_dev* vnet = vzalloc(sizeof(*vnet));
+    struct virtio_dev* vdev = &vnet->vdev;
+
+    event_init(&vnet->arrival);
+    event_init(&vnet->tx_free);
+
+    if (virtio_pci_init(vdev, pci)) {
+        kprintf(KWARN "not a virtio 1.0 device, skipped\n");
+        goto fail;
+    }
+
+    // 与 vblk 相同，只使用MSI-X
+    int nr_iv = MIN(pci_msix_count(pci), 2);
+    if (!nr_iv) {
+        kprintf(KWARN "no MSI-X, skipped\n");
+        goto fail_dev;
+    }
+
+    u64_t wanted = VIRTIO_FEATURE(VIRTIO_F_INDIRECT_DESC) |
+                   VIRTIO_FEATURE(VIRTIO_F_EVENT_IDX) |
+                   VIRTIO_FEATURE(VIRTIO_NET_F_MAC) |
+                   VIRTIO_FEATURE(VIRTIO_NET_F_STATUS);
+
+    if (virtio_negotiate(vdev, wanted)) {
+        kprintf(KWARN "feature negotiation failed\n");
+        goto fail_dev;
+    }
+
+    for (int i = 0; i < nr_iv; i++) {
+        vnet->iv[i] = isrm_ivexalloc(__vnet_isr);
+        isrm_set_payload(vnet->iv[i], (ptr_t)vnet);
+    }
+
+    if (pci_setup_msix(pci, vnet->iv, nr_iv) ||
+        virtq_setup(vdev, &vnet->rxq, VIRTIO_NET_Q_RX, VIRTQ_MAX_SIZE, 0) ||
+        virtq_setup(
+          vdev, &vnet->txq, VIRTIO_NET_Q_TX, VIRTQ_MAX_SIZE, nr_iv - 1) ||
+        __vnet_setup_rx(vnet) || __vnet_setup_tx(vnet)) {
+        kprintf(KWARN "queue setup failed\n");
+        goto fail_iv;
+    }
+
+    if (vdev->devcfg && virtio_has(vdev, VIRTIO_NET_F_MAC)) {
+        for (int i = 0; i < 6; i++) {
+            vnet->mac[i] = vdev->devcfg[VIRTIO_NET_CFG_MAC + i];
+        }
+    }
+
+    virtio_ready(vdev);
+
+    // 接收缓冲区已于 DRIVER_OK 之前投递
+    virtq_kick(&vnet->rxq);
+
+    __vnet_register(vnet);
+
+    return vnet;
+
+fail_iv:
+    for (int i = 0; i < nr_iv; i++) {
+        isrm_set_payload(vnet->iv[i], 0);
+        isrm_ivfree(vnet->iv[i]);
+    }
+fail_dev:
+    virtio_fail(vdev);
+fail:
+    // 已分配给队列的DMA内存可能已为设备所知，不予回收
+    return NULL;
+}
+
+/* ---- 原始报文设备 ---- */
+
+/**
+ * @brief 同 __block_pin：钉住用作DMA缓冲区的用户页，内核缓冲区无需处理
+ *
+ */
+static void
+__vnet_unpin(void* buf, size_t len)
+{
+    if ((uintptr_t)buf >= KERNEL_MM_BASE) {
+        return;
+    }
+
+    for (uintptr_t pg = PG_ALIGN(buf); pg < (uintptr_t)buf + len;
+         pg += PG_SIZE) {
+        pmm_free_page(__current->pid, (void*)PG_ALIGN(vmm_v2p((void*)pg)));
+    }
+}
+
+static int
+__vnet_pin(void* buf, size_t len)
+{
+    if ((uintptr_t)buf >= KERNEL_MM_BASE) {
+        return 0;
+    }
+
+    // 设备只读取发送的缓冲区，使其驻留即可
+    uintptr_t start = (uintptr_t)buf, end = start + len;
+    for (uintptr_t pg = PG_ALIGN(start); pg < end; pg += PG_SIZE) {
+        char* p = (char*)MAX(pg, start);
+        char c;
+
+        if (copy_from_user(&c, p, 1)) {
+            __vnet_unpin(buf, pg - start);
+            return EFAULT;
+        }
+
+        pmm_ref_page(__current->pid, (void*)PG_ALIGN(vmm_v2p(p)));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 发送一批报文，返回时均已发出
+ *
+ * @return int 发出的报文数；一个也未能发出时为错误码
+ */
+static int
+__vnet_send(struct vnet_dev* vnet, struct netraw_pkt* pkts, u32_t n)
+{
+    struct vnet_batch batch;
+    u32_t sent = 0;
+    int errno = 0;
+
+    __vnet_batch_init(&batch);
+
+    for (; sent < n; sent++) {
+        struct netraw_pkt* pkt = &pkts[sent];
+        struct vecbuf vbuf = { 0 };
+
+        if (pkt->len > VNET_FRAME_MAX) {
+            errno = EINVAL;
+            break;
+        }
+
+        if ((errno = __vnet_pin(pkt->buf, pkt->len))) {
+            break;
+        }
+
+        vbuf_append(&vbuf, pkt->buf, pkt->len);
+        errno = __vnet_tx_submit(vnet, &vbuf, &batch);
+        vbuf_free(&vbuf);
+
+        if (errno) {
+            __vnet_unpin(pkt->buf, pkt->len);
+            break;
+        }
+    }
+
+    __vnet_batch_wait(vnet, &batch);
+
+    for (u32_t i = 0; i < sent; i++) {
+        __vnet_unpin(pkts[i].buf, pkts[i].len);
+    }
+
+    return sent ? (int)sent : errno;
+}
+
+static int
+__vnet_recv(struct vnet_dev* vnet, struct netraw_pkt* pkts, u32_t n, int flags)
+{
+    struct vnet_rxpkt got[NETRAW_BATCH_MAX];
+    u32_t nr = 0;
+    int errno = 0;
+
+    // 只等待第一个报文，其余的有多少取多少
+    while (nr < n &&
+           !__vnet_rx_take(vnet, &got[nr], nr || (flags & NETRAW_NOWAIT))) {
+        nr++;
+    }
+
+    if (!nr) {
+        return EAGAIN;
+    }
+
+    for (u32_t i = 0; i < nr; i++) {
+        u32_t len = MIN(pkts[i].len, got[i].len);
+        if (copy_to_user(pkts[i].buf, __vnet_rx_frame(&got[i]), len)) {
+            errno = EFAULT;
+        }
+        pkts[i].len = len;
+    }
+
+    __vnet_rx_give(vnet, got, nr);
+
+    return errno ? errno : (int)nr;
+}
+
+static int
+__vnet_read(struct device* dev, struct v_file* file, void* buf, size_t len)
+{
+    struct vnet_dev* vnet = (struct vnet_dev*)dev->underlay;
+    struct vnet_rxpkt pkt;
+    int errno;
+
+    if ((errno = __vnet_rx_take(vnet, &pkt, file->flags & FO_NONBLOCK))) {
+        return errno;
+    }
+
+    // 每次读取一个报文，超出 len 的部分被截去
+    len = MIN(len, pkt.len);
+    memcpy(buf, __vnet_rx_frame(&pkt), len);
+    __vnet_rx_give(vnet, &pkt, 1);
+
+    return len;
+}
+
+static int
+__vnet_write(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    struct vnet_dev* vnet = (struct vnet_dev*)dev->underlay;
+    struct netraw_pkt pkt = { .buf = buf, .len = len };
+
+    int errno = __vnet_send(vnet, &pkt, 1);
+    return errno == 1 ? (int)len : errno;
+}
+
+static int
+__vnet_poll(struct device* dev, struct poll_table* pt)
+{
+    struct vnet_dev* vnet = (struct vnet_dev*)dev->underlay;
+    u32_t mask = (u32_t)((1ULL << vnet->nr_tx_slots) - 1);
+
+    poll_wait(pt, &vnet->arrival.waiters);
+    poll_wait(pt, &vnet->tx_free.waiters);
+
+    int ready = 0;
+    if (vnet->rx_head != vnet->rx_tail) {
+        ready |= POLLIN;
+    }
+    if (~vnet->tx_busy & mask) {
+        ready |= POLLOUT;
+    }
+
+    return ready;
+}
+
+static int
+__vnet_exec_cmd(struct device* dev, u32_t req, va_list args)
+{
+    struct vnet_dev* vnet = (struct vnet_dev*)dev->underlay;
+    struct netraw_pkt pkts[NETRAW_BATCH_MAX];
+    struct netraw_pkt* upkts;
+    u32_t n;
+    int flags = 0, errno;
+
+    switch (req) {
+        case NETRAW_GETMAC: {
+            void* buf = va_arg(args, void*);
+            return copy_to_user(buf, vnet->mac, sizeof(vnet->mac)) ? EFAULT
+                                                                    : 0;
+        }
+        case NETRAW_RECV:
+        case NETRAW_SEND:
+            upkts = va_arg(args, struct netraw_pkt*);
+            n = MIN(va_arg(args, u32_t), NETRAW_BATCH_MAX);
+            if (req == NETRAW_RECV) {
+                flags = va_arg(args, int);
+            }
+            break;
+        default:
+            return EINVAL;
+    }
+
+    if (!n) {
+        return 0;
+    }
+
+    if (copy_from_user(pkts, upkts, n * sizeof(*pkts))) {
+        return EFAULT;
+    }
+
+    if (req == NETRAW_SEND) {
+        for (u32_t i = 0; i < n; i++) {
+            if (!uaccess_ok(pkts[i].buf, pkts[i].len)) {
+                return EFAULT;
+            }
+        }
+        return __vnet_send(vnet, pkts, n);
+    }
+
+    if ((errno = __vnet_recv(vnet, pkts, n, flags)) > 0 &&
+        copy_to_user(upkts, pkts, errno * sizeof(*pkts))) {
+        return EFAULT;
+    }
+
+    return errno;
+}
+
+static void
+__vnet_rd_stats(struct twimap* map)
+{
+    struct vnet_dev* vnet = twimap_data(map, struct vnet_dev*);
+
+    twimap_printf(map,
+                  "rx_packets: %d\nrx_bytes: %d\nrx_starved: %d\n"
+                  "tx_packets: %d\ntx_bytes: %d\nkicks: %d\n"
+                  "kicks_skipped: %d\n",
+                  vnet->rx_packets,
+                  vnet->rx_bytes,
+                  vnet->rx_starved,
+                  vnet->tx_packets,
+                  vnet->tx_bytes,
+                  vnet->rxq.kicks + vnet->txq.kicks,
+                  vnet->rxq.kicks_skipped + vnet->txq.kicks_skipped);
+}
+
+static void
+__vnet_register(struct vnet_dev* vnet)
+{
+    struct virtio_dev* vdev = &vnet->vdev;
+    int link = 1;
+
+    if (vdev->devcfg && virtio_has(vdev, VIRTIO_NET_F_STATUS)) {
+        u16_t status =
+          *(volatile virtio_u16a_t*)(vdev->devcfg + VIRTIO_NET_CFG_STATUS);
+        link = !!(status & VIRTIO_NET_S_LINK_UP);
+    }
+
+    struct device* dev = device_addseq(NULL, vnet, "eth%d", nr_vnets++);
+    dev->read_file = __vnet_read;
+    dev->write = __vnet_write;
+    dev->poll = __vnet_poll;
+    dev->exec_cmd = __vnet_exec_cmd;
+    vnet->dev = dev;
+
+    u8_t* mac = vnet->mac;
+    kprintf(KINFO "%s: mac=%x:%x:%x:%x:%x:%x, link=%d, rx=%d, tx=%d\n",
+            dev->name_val,
+            mac[0],
+            mac[1],
+            mac[2],
+            mac[3],
+            mac[4],
+            mac[5],
+            link,
+            vnet->nr_posted,
+            vnet->nr_tx_slots);
+
+    struct twifs_node* dev_root = twifs_dir_node(net_sysroot, dev->name_val);
+    struct twimap* map = twifs_mapping(dev_root, vnet, "stats");
+    map->read = __vnet_rd_stats;
+}
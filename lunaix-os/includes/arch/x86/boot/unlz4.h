@@ -0,0 +1,33 @@
+#ifndef __LUNAIX_UNLZ4_H
+#define __LUNAIX_UNLZ4_H
+
+#include <lunaix/types.h>
+
+/*
+    LZ4 旧式帧（lz4 -l 的输出）：魔数后接若干个块，每块以32位小端的长度
+    开头，解压后每块至多 8MiB。块内为 token、字面量、偏移与匹配长度组成
+    的序列，匹配最短为4字节。
+
+    reference: https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+*/
+
+#define LZ4_LEGACY_MAGIC 0x184c2102
+#define LZ4_MIN_MATCH 4
+
+/**
+ * @brief 将 src 处长为 len 的旧式帧解压至 dst，至多写入 cap 字节
+ *
+ * @return int 解压所得的字节数，数据有误或空间不足则为-1
+ */
+int
+_hhk_unlz4(const uint8_t* src, u32_t len, uint8_t* dst, u32_t cap);
+
+/**
+ * @brief 若内核以压缩的形式载入（KERNEL_LZ4=1），将其解压至各段的物理
+ * 地址。须于开启分页之前调用
+ *
+ */
+void
+_hhk_unpack_kernel();
+
+#endif /* __LUNAIX_UNLZ4_H */
@@ -0,0 +1,95 @@
+#ifndef __LUNAIX_FPU_H
+#define __LUNAIX_FPU_H
+
+#include <arch/x86/interrupts.h>
+
+#define CR0_TS (1 << 3)
+
+struct proc_info;
+
+/**
+ * @brief 进程FPU状态区（proc->fxstate）的大小。支持XSAVE时由 fpu_init 按
+ *  启用的状态分量确定，否则为FXSAVE的512字节。状态区须64字节对齐
+ *
+ */
+extern size_t fpu_state_size;
+
+/**
+ * @brief 支持XSAVE时置位CR4.OSXSAVE并设置XCR0。每个处理器都须调用，
+ *  且须先于 alternatives_apply
+ *
+ */
+void
+fpu_init();
+
+/**
+ * @brief 以x87的默认配置初始化 fxstate ，并留存一份作为初始状态
+ *
+ * @param fxstate
+ */
+void
+fpu_init_state(void* fxstate);
+
+/**
+ * @brief 修正来自用户空间的状态区中的保留位，以免载入时引发#GP
+ *
+ * @param fxstate
+ */
+void
+fpu_sanitize(void* fxstate);
+
+/**
+ * @brief 将进程的FPU状态还原为初始状态
+ *
+ * @param proc
+ */
+void
+fpu_reset(struct proc_info* proc);
+
+/**
+ * @brief 切换进程前调用。FPU寄存器中若非目标进程的状态，则置位CR0.TS，
+ * 使其首次使用x87/SSE指令时陷入#NM，届时再行交换。
+ *
+ * @param next
+ */
+void
+fpu_switch(struct proc_info* next);
+
+/**
+ * @brief 将仍留在FPU寄存器中的进程状态写回proc->fxstate
+ *
+ * @param proc
+ */
+void
+fpu_save(struct proc_info* proc);
+
+/**
+ * @brief proc->fxstate已被改写或即将释放，丢弃寄存器中的旧状态
+ *
+ * @param proc
+ */
+void
+fpu_discard(struct proc_info* proc);
+
+/**
+ * @brief 内核在屏蔽中断的情况下使用SSE前调用，先行保存寄存器的持有者。
+ *
+ */
+void
+fpu_kernel_begin();
+
+void
+fpu_kernel_end();
+
+/**
+ * @brief 仅当中断屏蔽、且不在另一次内核使用之中（例如于其间发生的异常）时，
+ *  开始使用SSE并返回非零，随后须以 fpu_kernel_end 结束。失败时应退而使用通用寄存器
+ *
+ */
+int
+fpu_kernel_try_begin();
+
+void
+intr_routine_fpu_unavail(const isr_param* param);
+
+#endif /* __LUNAIX_FPU_H */
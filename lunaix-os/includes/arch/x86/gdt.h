@@ -1,6 +1,8 @@
 #ifndef __LUNAIX_GDT_H 
 #define __LUNAIX_GDT_H 1
 
+#include <lunaix/types.h>
+
 #define SD_TYPE(x)              (x << 8)
 #define SD_CODE_DATA(x)         (x << 12)
 #define SD_DPL(x)               (x << 13)
@@ -55,4 +57,7 @@
 void
 _init_gdt();
 
+void
+_set_gdt_entry(u32_t index, u32_t base, u32_t limit, u32_t flags);
+
 #endif
@@ -38,6 +38,20 @@ intr_handler(isr_param* param);
 void
 intr_routine_init();
 
+/**
+ * @brief 为处理器 cpu 设置中断栈。AP的须在其 per-CPU 副本分配后设置
+ *
+ */
+int
+intr_stack_setup(u32_t cpu);
+
+/**
+ * @brief 导出缺页处理的可调参数至 twifs （/pfault_around）
+ *
+ */
+void
+pfault_export();
+
 #endif
 
 #endif /* __LUNAIX_INTERRUPTS_H */
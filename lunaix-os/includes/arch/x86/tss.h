@@ -7,10 +7,42 @@ struct x86_tss
     u32_t link;
     u32_t esp0;
     uint16_t ss0;
-    uint8_t __padding[94];
+    uint16_t __padding0;
+    // 以下仅在任务切换时使用（见 kernel/asm/x86/dfault.c），平时由处理器忽略
+    u32_t esp1;
+    u32_t ss1;
+    u32_t esp2;
+    u32_t ss2;
+    u32_t cr3;
+    u32_t eip;
+    u32_t eflags;
+    u32_t eax;
+    u32_t ecx;
+    u32_t edx;
+    u32_t ebx;
+    u32_t esp;
+    u32_t ebp;
+    u32_t esi;
+    u32_t edi;
+    u32_t es;
+    u32_t cs;
+    u32_t ss;
+    u32_t ds;
+    u32_t fs;
+    u32_t gs;
+    u32_t ldt;
+    uint16_t trap;
+    uint16_t iomap;
 } __attribute__((packed));
 
 void
 tss_update_esp(u32_t esp0);
 
+/**
+ * @brief 设置双重错误所用的任务门及其TSS
+ *
+ */
+void
+dfault_init();
+
 #endif /* __LUNAIX_TSS_H */
@@ -7,6 +7,13 @@
 #define ACPI_MADT_IOAPIC 0x1 // I/O APIC
 #define ACPI_MADT_INTSO 0x2  // Interrupt Source Override
 
+// Processor Local APIC flags
+#define ACPI_APIC_ENABLED 0x1
+#define ACPI_APIC_ONLINE_CAPABLE 0x2
+
+// Maximum number of processor we would keep track of
+#define ACPI_MADT_MAX_APIC 8
+
 /**
  * @brief ACPI Interrupt Controller Structure (ICS) Header
  *
@@ -82,6 +89,9 @@ typedef struct
 {
     void* apic_addr;
     acpi_apic_t* apic;
+    // All the processor local APIC found, in the order of MADT
+    acpi_apic_t* apics[ACPI_MADT_MAX_APIC];
+    u32_t apic_count;
     acpi_ioapic_t* ioapic;
     acpi_intso_t** irq_exception;
 } ACPI_TABLE_PACKED acpi_madt_toc_t;
@@ -2,6 +2,7 @@
 #define __LUNAIX_AHCI_H
 
 #include "hba.h"
+#include <hal/pci.h>
 
 /*
  * Macro naming rule:
@@ -14,11 +15,25 @@
 
 #define AHCI_HBA_CLASS 0x10601
 
+// 中断向量的上下文，经由 isrm_set_payload 附于向量上
+struct ahci_intr
+{
+    struct ahci_hba* hba;
+    // 该向量所服务的端口
+    u32_t ports;
+};
+
 struct ahci_driver
 {
     struct llist_header ahci_drvs;
     struct ahci_hba hba;
+    // 使用MSI时的中断向量
     int id;
+    // 使用MSI-X时，每个端口一个向量：ivs[i] 对应端口 i，
+    //  向量不足时，最后一个向量由其余端口共用
+    int nr_ivs;
+    int ivs[PCI_MSIX_MAX];
+    struct ahci_intr intrs[PCI_MSIX_MAX];
 };
 
 /**
@@ -45,7 +60,9 @@ int
 ahci_try_send(struct hba_port* port, int slot);
 
 /**
- * @brief Issue a HBA command (asynchronized)
+ * @brief Issue a HBA command (asynchronized). Never spins on a busy device
+ * while other commands are in flight, the command is deferred to the
+ * completion interrupt instead.
  *
  * @param port
  * @param state
@@ -54,4 +71,47 @@ ahci_try_send(struct hba_port* port, int slot);
 void
 ahci_post(struct hba_port* port, struct hba_cmd_state* state, int slot);
 
+/**
+ * @brief Port reset as per AHCI spec 10.4.2: stop the command engine, and
+ * perform a COMRESET if the port does not respond.
+ *
+ * @param port_reg
+ */
+void
+__hba_reset_port(hba_reg_t* port_reg);
+
+/**
+ * @brief Set up command completion coalescing (disabled by default) and
+ * export its knobs under /ahci/hba<index>/
+ *
+ */
+void
+ahci_ccc_init(struct ahci_hba* hba, int index);
+
+/**
+ * @brief Program CCC_CTL/CCC_PORTS from hba->ccc
+ *
+ */
+void
+ahci_ccc_apply(struct ahci_hba* hba);
+
+/**
+ * @brief Issue the commands deferred by ahci_post, if the device is ready.
+ * Called from the port interrupt handler.
+ *
+ * @param port
+ */
+void
+ahci_post_deferred(struct hba_port* port);
+
+/**
+ * @brief blkio_context::poll of an AHCI device. Reaps the completed commands
+ * of its port as the interrupt handler would.
+ *
+ * @param ctx
+ * @return int
+ */
+int
+ahci_blkio_poll(struct blkio_context* ctx);
+
 #endif /* __LUNAIX_AHCI_H */
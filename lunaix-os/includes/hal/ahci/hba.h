@@ -10,6 +10,8 @@
 #define HBA_RIS 2
 #define HBA_RPI 3
 #define HBA_RVER 4
+#define HBA_RCCC_CTL 5
+#define HBA_RCCC_PORTS 6
 
 #define HBA_RPBASE (0x40)
 #define HBA_RPSIZE (0x80 >> 2)
@@ -50,6 +52,14 @@
 
 #define HBA_NONFATAL (HBA_PxINTR_NIF | HBA_PxINTR_OF)
 
+#define HBA_CAP_SNCQ (1 << 30)
+#define HBA_CAP_CCCS (1 << 7)
+
+#define HBA_CCC_EN 1
+#define HBA_CCC_INT(ctl) (((ctl) >> 3) & 0x1f)
+#define HBA_CCC_CC(cc) (((cc)&0xff) << 8)
+#define HBA_CCC_TV(tv) (((tv)&0xffff) << 16)
+
 #define HBA_RGHC_ACHI_ENABLE (1 << 31)
 #define HBA_RGHC_INTR_ENABLE (1 << 1)
 #define HBA_RGHC_RESET 1
@@ -75,7 +85,10 @@ typedef unsigned int hba_reg_t;
 #define HBA_CMDH_CLR_BUSY (1 << 10)
 #define HBA_CMDH_PRDT_LEN(entries) (((entries)&0xffff) << 16)
 
-#define HBA_MAX_PRDTE 4
+#define HBA_MAX_PRDTE 32
+// 单个请求所能携带的缓冲区段数。各段在物理页边界处被拆分为多个PRDT项，
+//  故此值须远小于 HBA_MAX_PRDTE
+#define HBA_MAX_VBUF_SEGS 8
 
 struct hba_cmdh
 {
@@ -105,6 +118,8 @@ struct hba_cmdt
 
 #define HBA_DEV_FEXTLBA 1
 #define HBA_DEV_FATAPI (1 << 1)
+#define HBA_DEV_FNCQ (1 << 2)
+#define HBA_DEV_FTRIM (1 << 3)
 
 struct hba_port;
 struct ahci_hba;
@@ -128,6 +143,8 @@ struct hba_device
     u32_t alignment_offset;
     u32_t block_per_sec;
     u32_t capabilities;
+    u32_t queue_depth; // NCQ队列深度，仅在 HBA_DEV_FNCQ 时有效
+    void* dsm_buf;     // TRIM的LBA范围表，仅在 HBA_DEV_FTRIM 时有效
     struct hba_port* port;
     struct ahci_hba* hba;
 
@@ -147,7 +164,13 @@ struct hba_cmd_state
 struct hba_cmd_context
 {
     struct hba_cmd_state* issued[32];
+    // 每个槽位固定使用的命令表与状态，于端口初始化时分配，此后一直复用
+    struct hba_cmd_state states[32];
     u32_t tracked_ci;
+    // 因设备忙而推迟发出的槽位，于下一次完成中断中发出
+    u32_t deferred;
+    // 发出命令时设备仍忙（按原先的做法须自旋等待）的次数
+    u32_t stalls;
 };
 
 struct hba_port
@@ -168,9 +191,29 @@ struct ahci_hba
     unsigned int ports_bmp;
     unsigned int cmd_slots;
     unsigned int version;
+    hba_reg_t cap;
     struct hba_port* ports[32];
+    // 命令完成合并（CCC），仅在 HBA_CAP_CCCS 时可用
+    struct
+    {
+        u32_t enabled;
+        u32_t count;   // 累积多少个命令完成后触发中断
+        u32_t timeout; // 或自首个完成起经过多少毫秒后触发中断
+        u32_t intr;    // 合并后的中断于 HBA_RIS 中所占的位
+        u32_t ports;   // 参与合并的端口
+    } ccc;
 };
 
+/**
+ * @brief 设备是否仍忙（BSY或DRQ置位）
+ *
+ */
+static inline int
+hba_port_busy(struct hba_port* port)
+{
+    return port->regs[HBA_RPxTFD] & (HBA_PxTFD_BSY | HBA_PxTFD_DRQ);
+}
+
 int
 hba_prepare_cmd(struct hba_port* port,
                 struct hba_cmdt** cmdt,
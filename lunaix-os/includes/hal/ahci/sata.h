@@ -15,6 +15,23 @@
 #define ATA_READ_DMA 0xc8
 #define ATA_WRITE_DMA_EXT 0x35
 #define ATA_WRITE_DMA 0xca
+#define ATA_READ_FPDMA_QUEUED 0x60
+#define ATA_WRITE_FPDMA_QUEUED 0x61
+#define ATA_FLUSH_CACHE 0xe7
+#define ATA_FLUSH_CACHE_EXT 0xea
+#define ATA_DATA_SET_MANAGEMENT 0x06
+
+// DATA SET MANAGEMENT 的特征寄存器：TRIM
+#define ATA_DSM_TRIM 0x1
+
+// TRIM的LBA范围表：每项8字节，低48位为起始LBA，高16位为块数。
+//  只使用一个512字节的块，即至多64项
+#define SATA_DSM_BLOCK 512
+#define SATA_DSM_ENTRIES (SATA_DSM_BLOCK / 8)
+#define SATA_DSM_RANGE_MAX 0xffff
+
+// NCQ命令的标签（即命令槽位）位于扇区数寄存器的第3至7位
+#define SATA_NCQ_TAG(slot) (((slot)&0x1f) << 3)
 
 #define MAX_RETRY 2
 
@@ -13,6 +13,7 @@
 #define SCSI_READ_BLOCKS_12 0xa8
 #define SCSI_WRITE_BLOCKS_16 0x8a
 #define SCSI_WRITE_BLOCKS_12 0xaa
+#define SCSI_SYNC_CACHE_10 0x35
 
 #define SCSI_CDB16 16
 #define SCSI_CDB12 12
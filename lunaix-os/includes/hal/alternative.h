@@ -0,0 +1,69 @@
+#ifndef __LUNAIX_ALTERNATIVE_H
+#define __LUNAIX_ALTERNATIVE_H
+
+#include <lunaix/types.h>
+
+/*
+    依处理器特性于启动时改写代码（alternatives）。
+
+    每个改写点在 __alt_table 中登记一个表项：若处理器具备所需的特性，
+    alternatives_apply() 便以替换指令覆盖原指令，不足的长度以NOP补齐。
+    替换指令存放于 __alt_repl，须与位置无关（不含相对跳转或调用）。
+
+    热路径上对特性的判断由此变为一条在启动时即已定下的跳转：无需读取
+    标志变量，也不占用分支预测的表项。改写前执行的总是最保守的实现，
+    故改写点在启动早期亦可安全使用。
+*/
+
+#define ALT_FEATURE_SSE2 0
+#define ALT_FEATURE_ERMSB 1
+#define ALT_FEATURE_SSE42 2
+#define ALT_FEATURE_PCLMUL 3
+#define ALT_FEATURE_XSAVE 4
+#define ALT_FEATURE_XSAVEOPT 5
+
+#define ALT_FEATURE_NR 6
+
+struct alt_entry
+{
+    uintptr_t site;
+    uintptr_t repl;
+    u16_t feature;
+    u8_t site_len;
+    u8_t repl_len;
+};
+
+/**
+ * @brief 处理器是否具备特性 feature（ALT_FEATURE_*），须为常量。
+ *
+ * 原指令为跳过真分支的 jmp，具备特性时被改写为NOP。
+ *
+ */
+static inline __attribute__((always_inline)) int
+alt_has(const u16_t feature)
+{
+    asm goto("1: jmp %l[no]\n"
+             "2:\n"
+             ".pushsection __alt_table, \"a\"\n"
+             "   .long 1b, 2b\n"
+             "   .word %c0\n"
+             "   .byte 2b - 1b, 0\n"
+             ".popsection\n"
+             :
+             : "i"(feature)
+             :
+             : no);
+    return 1;
+no:
+    return 0;
+}
+
+/**
+ * @brief 探测处理器特性并改写所有登记的位置。须于启动早期、在其他处理器
+ * 启动前调用一次
+ *
+ */
+void
+alternatives_apply();
+
+#endif /* __LUNAIX_ALTERNATIVE_H */
@@ -2,13 +2,15 @@
 #define __LUNAIX_APIC_H
 
 #include <lunaix/common.h>
-#include <stdint.h>
+#include <lunaix/types.h>
 
 #define __APIC_BASE_PADDR 0xFEE00000
 
 #define IA32_MSR_APIC_BASE 0x1B
 #define IA32_APIC_ENABLE 0x800
 
+#define IA32_MSR_TSC_DEADLINE 0x6E0
+
 /*
  *  Common APIC memory-mapped registers
  *              Ref: Intel Manual, Vol. 3A, Table 10-1
@@ -32,6 +34,7 @@
     0x200 // Base address for Interrupt-Request bitmap register (256bits)
 #define APIC_ESR 0x280      // Error Status Reg
 #define APIC_ICR_BASE 0x300 // Interrupt Command
+#define APIC_ICR_HI 0x310   // Interrupt Command (destination field)
 #define APIC_LVT_LINT0 0x350
 #define APIC_LVT_LINT1 0x360
 #define APIC_LVT_ERROR 0x370
@@ -53,6 +56,7 @@
 #define LVT_MASKED (1 << 16)
 #define LVT_TIMER_ONESHOT (0 << 17)
 #define LVT_TIMER_PERIODIC (1 << 17)
+#define LVT_TIMER_TSC_DEADLINE (2 << 17)
 
 // Dividers for timer. See Intel Manual Vol3A. 10-17 (pp. 3207), Figure 10-10
 #define APIC_TIMER_DIV1 0b1011
@@ -66,6 +70,13 @@
 
 #define APIC_PRIORITY(cls, subcls) (((cls) << 4) | (subcls))
 
+// Interrupt Command Register. See Intel Manual Vol3A. 10-45, Figure 10-12
+#define ICR_DELIVERY_INIT (0x5 << 8)
+#define ICR_DELIVERY_STARTUP (0x6 << 8)
+#define ICR_DELIVERY_PENDING (1 << 12)
+#define ICR_LEVEL_ASSERT (1 << 14)
+#define ICR_TRIGGER_LEVEL (1 << 15)
+
 unsigned int
 apic_read_reg(unsigned int reg);
 
@@ -75,6 +86,30 @@ apic_write_reg(unsigned int reg, unsigned int val);
 void
 apic_init();
 
+/**
+ * @brief Initialize the local APIC of an application processor. The APIC MMIO
+ * must have been mapped by the BSP through apic_init.
+ *
+ */
+void
+apic_init_ap();
+
+/**
+ * @brief Get the id of the local APIC of current processor
+ *
+ */
+u32_t
+apic_id();
+
+/**
+ * @brief Send an inter-processor interrupt and wait for its delivery.
+ *
+ * @param dest destination local APIC id
+ * @param icr command, the lower 32 bits of ICR
+ */
+void
+apic_send_ipi(u32_t dest, u32_t icr);
+
 /**
  * @brief Tell the APIC that the handler for current interrupt is finished.
  * This will issue a write action to EOI register.
@@ -28,12 +28,113 @@ typedef struct
     reg16 gs;
 } __attribute__((packed)) sg_reg;
 
+/**
+ * @brief 获取厂商标识（如 GenuineIntel），model_out 至少13字节
+ *
+ */
+void
+cpu_get_model(char* model_out);
+
 void
 cpu_get_brand(char* brand_out);
 
 int
 cpu_has_apic();
 
+/**
+ * @brief TSC是否以恒定速率运行，不受频率调节与C-state影响
+ *
+ */
+int
+cpu_has_invariant_tsc();
+
+/**
+ * @brief Local APIC计时器是否支持TSC-deadline模式
+ *
+ */
+int
+cpu_has_tsc_deadline();
+
+int
+cpu_has_sysenter();
+
+int
+cpu_has_pat();
+
+int
+cpu_has_sse2();
+
+int
+cpu_has_sse42();
+
+int
+cpu_has_pclmul();
+
+/**
+ * @brief 是否支持增强的 rep movsb/stosb（ERMSB），此时按字节的串操作不慢于按双字的
+ *
+ */
+int
+cpu_has_ermsb();
+
+/**
+ * @brief 是否支持 MONITOR/MWAIT
+ *
+ */
+int
+cpu_has_mwait();
+
+/**
+ * @brief MWAIT 各C-state的子状态数（CPUID 5号叶的EDX），第 n 个四位对应 Cn。
+ *
+ * @return u32_t 不支持MWAIT或未列举扩展时为0
+ */
+u32_t
+cpu_mwait_substates();
+
+/**
+ * @brief 是否支持 XSAVE/XRSTOR 及 XCR0
+ *
+ */
+int
+cpu_has_xsave();
+
+/**
+ * @brief 是否支持 XSAVEOPT，其跳过自上次 XRSTOR 以来未被修改的状态分量
+ *
+ */
+int
+cpu_has_xsaveopt();
+
+/**
+ * @brief XCR0中可置位的状态分量（CPUID 0xD号叶）
+ *
+ * @return u64_t 不支持XSAVE时为0
+ */
+u64_t
+cpu_xsave_features();
+
+/**
+ * @brief 按当前XCR0所启用的状态分量，XSAVE区域所需的大小。须已支持XSAVE
+ *
+ */
+u32_t
+cpu_xsave_size();
+
+/**
+ * @brief 设置PAT，使 PG_CACHE_WC 表示写合并。每个处理器都须调用，且须一致
+ *
+ */
+void
+cpu_init_pat();
+
+/**
+ * @brief 设置SYSENTER所使用的代码段、栈与入口
+ *
+ */
+void
+cpu_setup_sysenter(u32_t cs, void* stack, void* entry);
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wreturn-type"
 static inline reg32
@@ -44,6 +145,14 @@ cpu_rcr0()
     return val;
 }
 
+static inline reg32
+cpu_rcr4()
+{
+    uintptr_t val;
+    asm volatile("movl %%cr4,%0" : "=r"(val));
+    return val;
+}
+
 static inline reg32
 cpu_rcr2()
 {
@@ -89,6 +198,22 @@ cpu_lcr3(reg32 v)
     asm("mov %0, %%cr3" ::"r"(v));
 }
 
+static inline void
+cpu_lcr4(reg32 v)
+{
+    asm("mov %0, %%cr4" ::"r"(v));
+}
+
+/**
+ * @brief 写入扩展控制寄存器（XCR），须已置位CR4.OSXSAVE
+ *
+ */
+static inline void
+cpu_xsetbv(u32_t xcr, u64_t v)
+{
+    asm volatile("xsetbv" ::"c"(xcr), "a"((u32_t)v), "d"((u32_t)(v >> 32)));
+}
+
 static inline void
 cpu_invplg(void* va)
 {
@@ -107,14 +232,60 @@ cpu_disable_interrupt()
     asm volatile("cli");
 }
 
+/**
+ * @brief 监视 addr 所在的地址范围，其后的 MWAIT 将于该范围被写入时返回
+ *
+ */
+static inline void
+cpu_monitor(volatile void* addr)
+{
+    asm volatile("monitor" ::"a"(addr), "c"(0), "d"(0));
+}
+
+/**
+ * @brief 开中断并以 hint 所指的C-state等待。与 sti; hlt 相同，
+ *  sti 的中断屏蔽窗口保证两者之间不会漏掉中断
+ *
+ */
+static inline void
+cpu_sti_mwait(u32_t hint)
+{
+    asm volatile("sti\n"
+                 "mwait" ::"a"(hint),
+                 "c"(0));
+}
+
+/**
+ * @brief 重载CR3以刷新TLB。标记为全局页（PG_GLOBAL）的内核映射不受影响
+ *
+ */
 static inline void
 cpu_invtlb()
 {
     reg32 interm;
-    asm("movl %%cr3, %0\n"
-        "movl %0, %%cr3"
-        : "=r"(interm)
-        : "r"(interm));
+    asm volatile("movl %%cr3, %0\n"
+                 "movl %0, %%cr3"
+                 : "=r"(interm)
+                 :
+                 : "memory");
+}
+
+/**
+ * @brief 刷新整个TLB，包括全局页。通过翻转CR4.PGE完成
+ *
+ */
+static inline void
+cpu_invtlb_all()
+{
+    reg32 cr4;
+    asm volatile("movl %%cr4, %0\n"
+                 "xorl $0x80, %0\n"
+                 "movl %0, %%cr4\n"
+                 "xorl $0x80, %0\n"
+                 "movl %0, %%cr4"
+                 : "=&r"(cr4)
+                 :
+                 : "memory");
 }
 
 static inline void
@@ -123,6 +294,14 @@ cpu_int(int vect)
     asm("int %0" ::"i"(vect));
 }
 
+static inline u64_t
+cpu_rdtsc()
+{
+    u32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64_t)hi << 32) | lo;
+}
+
 void
 cpu_rdmsr(u32_t msr_idx, u32_t* reg_high, u32_t* reg_low);
 
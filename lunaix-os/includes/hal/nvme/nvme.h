@@ -0,0 +1,232 @@
+#ifndef __LUNAIX_NVME_H
+#define __LUNAIX_NVME_H
+
+#include <hal/pci.h>
+#include <lunaix/blkio.h>
+#include <lunaix/block.h>
+#include <lunaix/ds/llist.h>
+#include <lunaix/isrm.h>
+#include <lunaix/types.h>
+
+/*
+    NVM Express 控制器驱动。
+    使用一对 I/O 提交/完成队列，以一个MSI-X向量通告完成。
+    目前只有BSP执行内核代码（见 hal/smp.c），无需按处理器划分队列。
+    参阅：NVM Express Base Specification, Revision 1.4
+*/
+
+#define NVME_CLASS 0x10802
+
+// 控制器寄存器（字节偏移）
+#define NVME_REG_CAP 0x00
+#define NVME_REG_VS 0x08
+#define NVME_REG_CC 0x14
+#define NVME_REG_CSTS 0x1c
+#define NVME_REG_AQA 0x24
+#define NVME_REG_ASQ 0x28
+#define NVME_REG_ACQ 0x30
+#define NVME_REG_DBS 0x1000
+
+#define NVME_CAP_MQES(cap) (((cap)&0xffff) + 1)
+#define NVME_CAP_TO(cap) (((cap) >> 24) & 0xff)
+#define NVME_CAP_DSTRD(cap) (((cap) >> 32) & 0xf)
+#define NVME_CAP_MPSMIN(cap) (((cap) >> 48) & 0xf)
+
+#define NVME_CC_EN 0x1
+#define NVME_CC_IOSQES (6 << 16)
+#define NVME_CC_IOCQES (4 << 20)
+
+#define NVME_CSTS_RDY 0x1
+#define NVME_CSTS_CFS 0x2
+
+// 管理命令
+#define NVME_ADM_CREATE_SQ 0x01
+#define NVME_ADM_CREATE_CQ 0x05
+#define NVME_ADM_IDENTIFY 0x06
+#define NVME_ADM_SET_FEATURES 0x09
+
+#define NVME_ID_NS 0
+#define NVME_ID_CTRL 1
+
+#define NVME_FEAT_NR_QUEUES 0x07
+
+// NVM 命令
+#define NVME_CMD_FLUSH 0x00
+#define NVME_CMD_WRITE 0x01
+#define NVME_CMD_READ 0x02
+#define NVME_CMD_DSM 0x09
+
+#define NVME_DSM_DEALLOCATE (1 << 2)
+
+// 命令双字0中的数据指针类型（PSDT）：以SGL描述数据
+#define NVME_PSDT_SGL (1 << 14)
+
+#define NVME_SGL_DATA 0x00
+#define NVME_SGL_LAST_SEG 0x30
+
+// Identify Controller 数据结构中的字段偏移
+#define NVME_IDC_SN 4
+#define NVME_IDC_MN 24
+#define NVME_IDC_MDTS 77
+#define NVME_IDC_NN 516
+#define NVME_IDC_ONCS 520
+#define NVME_IDC_VWC 525
+#define NVME_IDC_SGLS 536
+
+#define NVME_ONCS_DSM (1 << 2)
+
+// Identify Namespace 数据结构中的字段偏移
+#define NVME_IDN_NSZE 0
+#define NVME_IDN_FLBAS 26
+#define NVME_IDN_LBAF 128
+
+#define NVME_ADMIN_QSIZE 16
+// I/O 提交队列恰好占满一页
+#define NVME_IO_QSIZE 64
+// 每个队列同时在途的命令数上限，以一个32位的位图记录占用
+#define NVME_MAX_SLOTS 32
+#define NVME_MAX_NS 4U
+
+// 每个槽位的PRP列表（或SGL段）的大小，一页可容纳8个槽位的列表。
+//  PRP列表不得跨页，故单条命令至多传输 1 + 64 页
+#define NVME_LIST_SIZE 512
+#define NVME_LIST_PER_PAGE (PG_SIZE / NVME_LIST_SIZE)
+#define NVME_PRP_PER_LIST (NVME_LIST_SIZE / sizeof(u64_t))
+#define NVME_SGL_PER_LIST (NVME_LIST_SIZE / sizeof(struct nvme_sgl_desc))
+
+// 驱动自身发现的错误所对应的状态码：Invalid Field in Command
+#define NVME_SC_INVALID_FIELD 0x2
+
+// 块层单次读写的上限（见 block.c 中的 BLOCK_MAX_XFER），用于估计可合并的段数
+#define NVME_SEG_ESTIMATE 0x10000
+#define NVME_MAX_VBUF_SEGS 16
+
+// 等待控制器就绪、以及管理命令完成的时限（毫秒）
+#define NVME_ADMIN_TIMEOUT 5000
+
+struct nvme_sqe
+{
+    u32_t cdw0; // opcode | flags | cid << 16
+    u32_t nsid;
+    u32_t rsvd[2];
+    u64_t mptr;
+    u64_t prp1;
+    u64_t prp2;
+    u32_t cdw10;
+    u32_t cdw11;
+    u32_t cdw12;
+    u32_t cdw13;
+    u32_t cdw14;
+    u32_t cdw15;
+} __attribute__((packed));
+
+struct nvme_cqe
+{
+    u32_t dw0;
+    u32_t rsvd;
+    u16_t sq_head;
+    u16_t sq_id;
+    u16_t cid;
+    u16_t status; // 位0为相位标记
+} __attribute__((packed));
+
+struct nvme_sgl_desc
+{
+    u64_t addr;
+    u32_t len;
+    u8_t rsvd[3];
+    u8_t type;
+} __attribute__((packed));
+
+struct nvme_dsm_range
+{
+    u32_t cattr;
+    u32_t nlb;
+    u64_t slba;
+} __attribute__((packed));
+
+struct nvme_slot
+{
+    struct blkio_req* req;
+    // PRP列表、SGL段或DSM范围表
+    void* list;
+    ptr_t list_pa;
+};
+
+struct nvme_ctrl;
+
+struct nvme_queue
+{
+    struct nvme_ctrl* ctrl;
+    u16_t qid;
+    u16_t size;
+    volatile struct nvme_sqe* sq;
+    volatile struct nvme_cqe* cq;
+    ptr_t sq_pa;
+    ptr_t cq_pa;
+    volatile u32_t* sq_db;
+    volatile u32_t* cq_db;
+    u16_t sq_tail;
+    u16_t cq_head;
+    u16_t phase;
+    int iv;
+    u32_t nr_slots;
+    u32_t busy;
+    struct nvme_slot slots[NVME_MAX_SLOTS];
+    u32_t submitted;
+    u32_t completed;
+};
+
+struct nvme_ns
+{
+    struct nvme_ctrl* ctrl;
+    u32_t nsid;
+    u32_t lba_shift;
+    u64_t nr_blocks;
+    struct block_dev* bdev;
+};
+
+struct nvme_ctrl
+{
+    struct pci_device* pci;
+    volatile u8_t* regs;
+    u32_t db_stride;
+    u32_t timeout;
+    // 单条命令的最大数据量（字节）
+    u32_t max_xfer;
+    u32_t sgls;
+    u32_t oncs;
+    u32_t vwc;
+    char model[41];
+    char serial[21];
+    struct nvme_queue admin;
+    struct nvme_queue ioq;
+    // 队列的槽位均被占用时，暂存于此的请求
+    struct llist_header pending;
+    u32_t nr_ns;
+    struct nvme_ns ns[NVME_MAX_NS];
+};
+
+void
+nvme_init();
+
+/**
+ * @brief 取得一页物理连续、且映射至内核空间的DMA内存
+ *
+ */
+void*
+nvme_alloc_page(ptr_t* pa);
+
+void
+nvme_blkio_handler(struct blkio_req* req);
+
+int
+nvme_blkio_poll(struct blkio_context* ctx);
+
+void
+nvme_ioq_isr(const isr_param* param);
+
+void
+nvme_fsexport(struct block_dev* bdev, void* fs_node);
+
+#endif /* __LUNAIX_NVME_H */
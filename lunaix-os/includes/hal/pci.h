@@ -1,6 +1,7 @@
 #ifndef __LUNAIX_PCI_H
 #define __LUNAIX_PCI_H
 
+#include <hal/cpu.h>
 #include <hal/io.h>
 #include <lunaix/ds/llist.h>
 #include <lunaix/types.h>
@@ -42,6 +43,28 @@
 #define MSI_CAP_MASK 0x100
 #define MSI_CAP_ENABLE 0x1
 
+#define PCI_CAP_MSI 0x05
+#define PCI_CAP_MSIX 0x11
+
+// MSI-X: 消息控制寄存器（能力头的高16位），以及表的位置
+//  参阅：PCI LB Spec. (Rev 3) Section 6.8.2
+#define PCI_MSIX_TABLE(msix_base) ((msix_base) + 4)
+#define MSIX_CAP_ENABLE (1 << 15)
+#define MSIX_CAP_FMASK (1 << 14)
+#define MSIX_TABLE_SIZE(msg_ctl) (((msg_ctl)&0x7ff) + 1)
+#define MSIX_TABLE_BIR(x) ((x)&0x7)
+#define MSIX_TABLE_OFFSET(x) ((x) & ~0x7)
+
+// MSI-X 表项，每项四个双字
+#define MSIX_ENTRY_SIZE 16
+#define MSIX_ENT_ADDR_LO 0
+#define MSIX_ENT_ADDR_HI 1
+#define MSIX_ENT_DATA 2
+#define MSIX_ENT_CTRL 3
+#define MSIX_ENT_MASKED 0x1
+
+#define PCI_MSIX_MAX 32
+
 #define PCI_RCMD_DISABLE_INTR (1 << 10)
 #define PCI_RCMD_FAST_B2B (1 << 9)
 #define PCI_RCMD_BUS_MASTER (1 << 2)
@@ -77,6 +100,9 @@ struct pci_device
     u32_t class_info;
     u32_t cspace_base;
     u32_t msi_loc;
+    u32_t msix_loc;
+    // 映射后的 MSI-X 表，由 pci_setup_msix 建立
+    volatile u32_t* msix_table;
     uint16_t intr_info;
     struct
     {
@@ -99,19 +125,67 @@ struct pci_driver
 
 // PCI Configuration Space (C-Space) r/w:
 //      Refer to "PCI Local Bus Specification, Rev.3, Section 3.2.2.3.2"
+//
+// 若ACPI提供了MCFG，则经由内存映射的ECAM访问（PCIe Base Spec. Section 7.2.2），
+//  单次访存即可完成，且可访问4KiB的扩展配置空间；否则退回至CF8/CFC端口。
+
+// 各总线的ECAM窗口（1MiB，已映射），NULL表示该总线经由I/O端口访问
+extern volatile u8_t* pci_ecam[256];
+
+#define PCI_ECAM_OFFSET(base, offset)                                          \
+    (((((base) >> 8) & 0xff) << 12) | ((offset)&0xffc))
+
+#define PCI_CSPACE_SIZE 256
+#define PCIE_CSPACE_SIZE 4096
 
 static inline pci_reg_t
 pci_read_cspace(u32_t base, int offset)
 {
+    volatile u8_t* ecam = pci_ecam[PCI_BUS_NUM(base)];
+    if (ecam) {
+        return *(volatile u32_t*)(ecam + PCI_ECAM_OFFSET(base, offset));
+    }
+
+    // 扩展配置空间只能经由ECAM访问，与不存在的设备一样读得全1
+    if (offset >= PCI_CSPACE_SIZE) {
+        return 0xffffffff;
+    }
+
+    // 地址与数据端口的两次访问须不被打断，中断处理程序（如改投MSI）同样会访问配置空间
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
     io_outl(PCI_CONFIG_ADDR, base | (offset & ~0x3));
-    return io_inl(PCI_CONFIG_DATA);
+    pci_reg_t data = io_inl(PCI_CONFIG_DATA);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+    return data;
 }
 
 static inline void
 pci_write_cspace(u32_t base, int offset, pci_reg_t data)
 {
+    volatile u8_t* ecam = pci_ecam[PCI_BUS_NUM(base)];
+    if (ecam) {
+        *(volatile u32_t*)(ecam + PCI_ECAM_OFFSET(base, offset)) = data;
+        return;
+    }
+
+    if (offset >= PCI_CSPACE_SIZE) {
+        return;
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
     io_outl(PCI_CONFIG_ADDR, base | (offset & ~0x3));
     io_outl(PCI_CONFIG_DATA, data);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
 }
 
 /**
@@ -164,6 +238,33 @@ pci_bar_sizing(struct pci_device* dev, u32_t* bar_out, u32_t bar_num);
 void
 pci_setup_msi(struct pci_device* device, int vector);
 
+/**
+ * @brief 设备所支持的 MSI-X 向量数，不支持时为0
+ *
+ */
+int
+pci_msix_count(struct pci_device* device);
+
+/**
+ * @brief 配置并启用设备的 MSI-X，表项 i 将以中断向量 vectors[i] 投递。
+ *  启用 MSI-X 的同时，MSI 与传统中断均被停用。
+ * 参阅：PCI LB Spec. (Rev 3) Section 6.8.2
+ *
+ * @param device PCI device
+ * @param vectors 每个表项所使用的中断向量
+ * @param nr 表项数，不得超过 pci_msix_count
+ * @return int 0 或错误码
+ */
+int
+pci_setup_msix(struct pci_device* device, int* vectors, int nr);
+
+/**
+ * @brief 屏蔽或解除屏蔽 MSI-X 的某一表项
+ *
+ */
+void
+pci_msix_mask(struct pci_device* device, int entry, int masked);
+
 void
 pci_add_driver(const char* name,
                u32_t class,
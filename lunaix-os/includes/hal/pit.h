@@ -0,0 +1,21 @@
+#ifndef __LUNAIX_PIT_H
+#define __LUNAIX_PIT_H
+
+// Intel 8254 programmable interval timer, only channel 2 is used, as a
+//  reference clock while calibrating the other timers
+
+#define PIT_FREQUENCY 1193182
+
+#define PIT_CH2 0x42
+#define PIT_CMD 0x43
+
+// NMI status and control (port B), gates channel 2 and exposes its output
+#define PIT_PORT_B 0x61
+#define PIT_PORT_B_GATE2 0x01
+#define PIT_PORT_B_SPEAKER 0x02
+#define PIT_PORT_B_OUT2 0x20
+
+// channel 2, lobyte/hibyte access, mode 0 (interrupt on terminal count)
+#define PIT_CMD_CH2_ONESHOT 0xb0
+
+#endif /* __LUNAIX_PIT_H */
@@ -0,0 +1,97 @@
+#ifndef __LUNAIX_PMC_H
+#define __LUNAIX_PMC_H
+
+#include <lunaix/types.h>
+
+/*
+    性能监测计数器（于 flags.h 中定义 LUNAIX_PMC 以启用）。
+
+    每个处理器以其通用计数器计数下列事件，用户态与内核态均计入，计数器
+    从不停止或重新编程。各进程的计数于切换时以前后两次读数之差累加
+    （见 run()），经由 /task/<pid>/pmc 读取；/sys/pmc 列出各事件于本机
+    是否可用。
+
+    周期与指令数为 Intel 与 AMD 共有的架构事件。LLC缺失于 AMD 上以L2
+    缺失近似；dTLB缺失在两家均非架构事件，按处理器的代（family）选用
+    事件编码，未知的型号上可能不准确。运行于未暴露PMU的虚拟机中时
+    全部不可用，读数恒为0。
+*/
+
+#define PMC_CYCLES 0
+#define PMC_INSTRUCTIONS 1
+#define PMC_LLC_MISSES 2
+#define PMC_DTLB_MISSES 3
+
+#define PMC_NR 4
+
+struct pmc_sample
+{
+    u64_t v[PMC_NR];
+};
+
+#ifdef LUNAIX_PMC
+
+/**
+ * @brief 于当前处理器上检测并设置计数器。每个处理器都须调用
+ *
+ */
+void
+pmc_init();
+
+/**
+ * @brief 可用事件的位图，第 i 位对应事件 i
+ *
+ */
+u32_t
+pmc_available();
+
+const char*
+pmc_name(u32_t event);
+
+/**
+ * @brief 读取当前处理器上各事件的计数，不可用的事件为0
+ *
+ */
+void
+pmc_read(struct pmc_sample* sample);
+
+/**
+ * @brief 将当前处理器自上次调用以来的计数累加至 acc。调用者须关中断
+ *
+ */
+void
+pmc_accumulate(u64_t* acc);
+
+/**
+ * @brief 导出 /sys/pmc
+ *
+ */
+void
+pmc_export();
+
+#else
+
+static inline void
+pmc_init()
+{
+}
+
+static inline u32_t
+pmc_available()
+{
+    return 0;
+}
+
+static inline void
+pmc_accumulate(u64_t* acc)
+{
+}
+
+static inline void
+pmc_export()
+{
+}
+
+#endif
+
+#endif /* __LUNAIX_PMC_H */
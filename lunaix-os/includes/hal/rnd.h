@@ -3,20 +3,53 @@
 
 #include <lunaix/types.h>
 
-static inline void
-rnd_fill(void* data, size_t len)
+// RDRAND 偶有暂时无可用随机数的情况，Intel建议至多重试10次
+#define RND_RETRY 10
+
+/**
+ * @brief 以 RDRAND 取一个32位随机数
+ *
+ * @return int 是否成功
+ */
+static inline int
+rnd_rdrand32(u32_t* out)
+{
+    u8_t ok;
+    for (int i = 0; i < RND_RETRY; i++) {
+        asm volatile("rdrand %0\n"
+                     "setc %1"
+                     : "=r"(*out), "=qm"(ok)::"cc");
+        if (ok) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 以 RDSEED 取一个32位随机数，其直接来自熵源，适于作为种子
+ *
+ * @return int 是否成功
+ */
+static inline int
+rnd_rdseed32(u32_t* out)
 {
-    asm volatile("1:\n"
-                 "rdrand %%eax\n"
-                 "movl %%eax, (%0)\n"
-                 "addl $4, %%eax\n"
-                 "subl $4, %1\n"
-                 "jnz 1b" ::"r"((ptr_t)data),
-                 "r"((len & ~0x3))
-                 : "%al");
+    u8_t ok;
+    for (int i = 0; i < RND_RETRY; i++) {
+        asm volatile("rdseed %0\n"
+                     "setc %1"
+                     : "=r"(*out), "=qm"(ok)::"cc");
+        if (ok) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 int
 rnd_is_supported();
 
+int
+rnd_seed_is_supported();
+
 #endif /* __LUNAIX_RND_H */
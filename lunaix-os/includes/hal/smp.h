@@ -0,0 +1,37 @@
+#ifndef __LUNAIX_SMP_H
+#define __LUNAIX_SMP_H
+
+#include <lunaix/types.h>
+
+#define SMP_MAX_CPU 8
+
+#define AP_STACK_SIZE 4096
+
+/**
+ * @brief 处理器描述符，下标即为处理器编号（0号为BSP）
+ *
+ */
+struct cpu_info
+{
+    u32_t apic_id;
+    // 已响应唤醒并停机待命，不执行内核代码（见 hal/smp.c）。BSP不置位
+    volatile int parked;
+    void* stack;
+};
+
+/**
+ * @brief 依照MADT所列出的处理器，逐一以INIT-SIPI-SIPI序列唤醒应用处理器（AP），
+ * 确认其响应后令其停机待命
+ *
+ */
+void
+smp_init();
+
+/**
+ * @brief 获取当前处理器的编号（cpu_info的下标）。只有BSP执行内核代码，目前总为0
+ *
+ */
+u32_t
+smp_cpu_id();
+
+#endif /* __LUNAIX_SMP_H */
@@ -0,0 +1,225 @@
+#ifndef __LUNAIX_VIRTIO_H
+#define __LUNAIX_VIRTIO_H
+
+#include <hal/pci.h>
+#include <lunaix/types.h>
+
+/*
+    Virtio 1.0 的 PCI 传输层（modern）以及分离式虚拟队列（split virtqueue）。
+    参阅：Virtual I/O Device (VIRTIO) Version 1.1, Section 2.6, 4.1
+*/
+
+/*
+    可与其他类型互为别名的整数，用于访问设备配置空间中的字段，
+    以及紧随环之后的事件下标（与环项的类型不同）
+*/
+typedef u16_t __attribute__((may_alias)) virtio_u16a_t;
+typedef u32_t __attribute__((may_alias)) virtio_u32a_t;
+
+#define VIRTIO_PCI_VENDOR 0x1af4
+
+// 厂商自定义的PCI能力，用以指示各配置结构所在的BAR与偏移
+#define PCI_CAP_VENDOR 0x09
+
+#define VIRTIO_PCI_CAP_COMMON 1
+#define VIRTIO_PCI_CAP_NOTIFY 2
+#define VIRTIO_PCI_CAP_ISR 3
+#define VIRTIO_PCI_CAP_DEVICE 4
+
+// 能力结构中的字段偏移
+#define VIRTIO_CAP_TYPE(hdr) (((hdr) >> 24) & 0xff)
+#define VIRTIO_CAP_BAR 4
+#define VIRTIO_CAP_OFFSET 8
+#define VIRTIO_CAP_LENGTH 12
+#define VIRTIO_CAP_NOTIFY_MUL 16
+
+// 通用配置结构（struct virtio_pci_common_cfg）中的寄存器偏移
+#define VIRTIO_CC_DFSELECT 0x00
+#define VIRTIO_CC_DF 0x04
+#define VIRTIO_CC_GFSELECT 0x08
+#define VIRTIO_CC_GF 0x0c
+#define VIRTIO_CC_MSIX 0x10
+#define VIRTIO_CC_NUMQ 0x12
+#define VIRTIO_CC_STATUS 0x14
+#define VIRTIO_CC_CFGGEN 0x15
+#define VIRTIO_CC_Q_SELECT 0x16
+#define VIRTIO_CC_Q_SIZE 0x18
+#define VIRTIO_CC_Q_MSIX 0x1a
+#define VIRTIO_CC_Q_ENABLE 0x1c
+#define VIRTIO_CC_Q_NOFF 0x1e
+#define VIRTIO_CC_Q_DESC 0x20
+#define VIRTIO_CC_Q_AVAIL 0x28
+#define VIRTIO_CC_Q_USED 0x30
+
+#define VIRTIO_MSI_NO_VECTOR 0xffff
+
+// 设备状态
+#define VIRTIO_S_ACK 0x1
+#define VIRTIO_S_DRIVER 0x2
+#define VIRTIO_S_DRIVER_OK 0x4
+#define VIRTIO_S_FEATURES_OK 0x8
+#define VIRTIO_S_NEEDS_RESET 0x40
+#define VIRTIO_S_FAILED 0x80
+
+// 与设备类型无关的特性位
+#define VIRTIO_F_INDIRECT_DESC 28
+#define VIRTIO_F_EVENT_IDX 29
+#define VIRTIO_F_VERSION_1 32
+
+#define VIRTIO_FEATURE(bit) (1ULL << (bit))
+
+#define VIRTQ_DESC_F_NEXT 0x1
+#define VIRTQ_DESC_F_WRITE 0x2
+#define VIRTQ_DESC_F_INDIRECT 0x4
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 0x1
+#define VIRTQ_USED_F_NO_NOTIFY 0x1
+
+// 队列长度的上限，以免描述符表超出一页
+#define VIRTQ_MAX_SIZE 256
+
+struct virtq_desc
+{
+    u64_t addr;
+    u32_t len;
+    u16_t flags;
+    u16_t next;
+} __attribute__((packed));
+
+struct virtq_avail
+{
+    u16_t flags;
+    u16_t idx;
+    // 其后紧随 used_event（启用 VIRTIO_F_EVENT_IDX 时）
+    u16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem
+{
+    u32_t id;
+    u32_t len;
+} __attribute__((packed));
+
+struct virtq_used
+{
+    u16_t flags;
+    u16_t idx;
+    // 其后紧随 avail_event（启用 VIRTIO_F_EVENT_IDX 时）
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+struct virtio_dev
+{
+    struct pci_device* pci;
+    volatile u8_t* common;
+    volatile u8_t* notify;
+    volatile u8_t* isr;
+    volatile u8_t* devcfg;
+    u32_t notify_mul;
+    // 协商后双方共同支持的特性
+    u64_t features;
+};
+
+struct virtq
+{
+    struct virtio_dev* vdev;
+    u16_t index;
+    u16_t size;
+    struct virtq_desc* desc;
+    volatile struct virtq_avail* avail;
+    volatile struct virtq_used* used;
+    volatile u16_t* notify;
+    // 驱动一侧的 avail->idx 副本，以及上一次通知设备时的值
+    u16_t avail_idx;
+    u16_t kicked_idx;
+    // 下一个待回收的 used 项
+    u16_t last_used;
+    int event_idx;
+    // 实际发出的通知，以及因设备仍在处理而省去的通知
+    u32_t kicks;
+    u32_t kicks_skipped;
+};
+
+/**
+ * @brief 找出并映射设备的各个配置结构，重置设备，并告知设备驱动已就位
+ *
+ * @return int 0 成功；设备不是 virtio 1.0 设备，或其配置结构无法访问时返回错误
+ */
+int
+virtio_pci_init(struct virtio_dev* vdev, struct pci_device* pci);
+
+/**
+ * @brief 协商特性。VIRTIO_F_VERSION_1 总会被要求，其余仅启用设备支持的那部分
+ *
+ * @param wanted 驱动能够使用的特性
+ * @return int 0 成功，设备不接受时返回 ENOTSUP
+ */
+int
+virtio_negotiate(struct virtio_dev* vdev, u64_t wanted);
+
+static inline int
+virtio_has(struct virtio_dev* vdev, int feature)
+{
+    return !!(vdev->features & VIRTIO_FEATURE(feature));
+}
+
+/**
+ * @brief 分配并启用第 index 个虚拟队列，其完成中断经由第 msix 个 MSI-X 表项送达
+ *
+ * @param size 期望的队列长度，不超过设备的上限与 VIRTQ_MAX_SIZE
+ */
+int
+virtq_setup(struct virtio_dev* vdev,
+            struct virtq* vq,
+            int index,
+            u16_t size,
+            u16_t msix);
+
+/**
+ * @brief 设置 DRIVER_OK，设备此后开始处理队列
+ *
+ */
+void
+virtio_ready(struct virtio_dev* vdev);
+
+void
+virtio_fail(struct virtio_dev* vdev);
+
+u32_t
+virtio_cfg_read32(struct virtio_dev* vdev, u32_t offset);
+
+u64_t
+virtio_cfg_read64(struct virtio_dev* vdev, u32_t offset);
+
+/**
+ * @brief 将以 head 起始的描述符链放入可用环，但不通知设备
+ *
+ */
+void
+virtq_publish(struct virtq* vq, u16_t head);
+
+/**
+ * @brief 通知设备可用环上自上次通知以来新放入的描述符链。
+ * 启用 VIRTIO_F_EVENT_IDX 时，若设备尚未处理到上次通知的位置，则省去此次通知
+ *
+ */
+void
+virtq_kick(struct virtq* vq);
+
+/**
+ * @brief 从已用环中取出一项
+ *
+ * @return int 0 已用环为空
+ */
+int
+virtq_pop(struct virtq* vq, u32_t* id, u32_t* len);
+
+/**
+ * @brief 取空已用环后调用，要求设备在下一个完成时产生中断。
+ *
+ * @return int 非零表示其间又有新的完成，调用者应继续取出
+ */
+int
+virtq_rearm(struct virtq* vq);
+
+#endif /* __LUNAIX_VIRTIO_H */
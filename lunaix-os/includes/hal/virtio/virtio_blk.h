@@ -0,0 +1,92 @@
+#ifndef __LUNAIX_VIRTIO_BLK_H
+#define __LUNAIX_VIRTIO_BLK_H
+
+#include <hal/virtio/virtio.h>
+#include <lunaix/blkio.h>
+
+// 过渡型（transitional）与纯 virtio 1.0 的块设备
+#define VIRTIO_BLK_DEVID_TRANS 0x1001
+#define VIRTIO_BLK_DEVID 0x1042
+#define VIRTIO_BLK_CLASS 0x10000
+
+#define VIRTIO_BLK_F_SIZE_MAX 1
+#define VIRTIO_BLK_F_SEG_MAX 2
+#define VIRTIO_BLK_F_RO 5
+#define VIRTIO_BLK_F_BLK_SIZE 6
+#define VIRTIO_BLK_F_FLUSH 9
+
+// 设备配置结构（struct virtio_blk_config）中的字段偏移
+#define VIRTIO_BLK_CFG_CAPACITY 0
+#define VIRTIO_BLK_CFG_SIZE_MAX 8
+#define VIRTIO_BLK_CFG_SEG_MAX 12
+#define VIRTIO_BLK_CFG_BLK_SIZE 20
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+
+#define VIRTIO_BLK_S_OK 0
+#define VIRTIO_BLK_S_IOERR 1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+// 设备的扇区大小恒为512字节，与其报告的逻辑块大小无关
+#define VIRTIO_BLK_SECTOR 512
+
+// 同时在途的请求数上限，以一个32位的位图记录占用
+#define VBLK_MAX_SLOTS 32
+// 间接描述符表的长度，其中两项用于请求头与状态字节
+#define VBLK_INDIRECT_DESC 64
+// 不支持间接描述符时，每个请求在队列的描述符表中独占的项数
+#define VBLK_DIRECT_DESC 16
+// 请求可携带的缓冲区段数，每段至少占用一个描述符
+#define VBLK_MAX_VBUF_SEGS 16
+
+struct vblk_req_hdr
+{
+    u32_t type;
+    u32_t reserved;
+    u64_t sector;
+} __attribute__((packed));
+
+/**
+ * @brief 每个槽位中与设备共享的部分，位于物理连续的内存中
+ *
+ */
+struct vblk_cmd
+{
+    struct vblk_req_hdr hdr;
+    u8_t status;
+    u8_t reserved[15];
+    struct virtq_desc table[VBLK_INDIRECT_DESC];
+} __attribute__((packed));
+
+struct vblk_slot
+{
+    struct blkio_req* req;
+    struct vblk_cmd* cmd;
+    ptr_t cmd_pa;
+};
+
+struct vblk_dev
+{
+    struct virtio_dev vdev;
+    struct virtq vq;
+    struct block_dev* bdev;
+    int iv;
+    // 每个请求可用的描述符数，以及其中可用于数据段的数目
+    u32_t desc_per_req;
+    u32_t max_data_desc;
+    // 每个数据描述符可描述的最大字节数
+    u32_t seg_limit;
+    u32_t nr_slots;
+    u32_t busy;
+    struct vblk_slot slots[VBLK_MAX_SLOTS];
+    // 中断与轮询各自回收的请求数
+    u32_t intr_reaped;
+    u32_t poll_reaped;
+};
+
+void
+virtio_blk_init();
+
+#endif /* __LUNAIX_VIRTIO_BLK_H */
@@ -0,0 +1,130 @@
+#ifndef __LUNAIX_VIRTIO_NET_H
+#define __LUNAIX_VIRTIO_NET_H
+
+#include <hal/virtio/virtio.h>
+#include <lunaix/device.h>
+#include <lunaix/event.h>
+
+// 过渡型（transitional）与纯 virtio 1.0 的网络设备
+#define VIRTIO_NET_DEVID_TRANS 0x1000
+#define VIRTIO_NET_DEVID 0x1041
+#define VIRTIO_NET_CLASS 0x20000
+
+#define VIRTIO_NET_F_MAC 5
+#define VIRTIO_NET_F_STATUS 16
+
+// 设备配置结构（struct virtio_net_config）中的字段偏移
+#define VIRTIO_NET_CFG_MAC 0
+#define VIRTIO_NET_CFG_STATUS 6
+
+#define VIRTIO_NET_S_LINK_UP 1
+
+#define VIRTIO_NET_Q_RX 0
+#define VIRTIO_NET_Q_TX 1
+
+// 以太网帧（不含FCS，可带一个VLAN标签）的最大长度
+#define VNET_FRAME_MAX 1518
+
+// 接收缓冲区的大小，可容纳报文头与一个完整的帧
+#define VNET_RXBUF_SIZE 2048
+// 预先投递给设备的接收缓冲区数
+#define VNET_RX_POSTED 64
+// 缓冲池的总量（2的幂）：其余的用作后备，在读者取走报文前替补空出的位置
+#define VNET_RX_POOL 128
+
+// 同时在途的发送数上限，以一个32位的位图记录占用
+#define VNET_TX_SLOTS 32
+// 每个发送的描述符数，其中一项用于报文头
+#define VNET_TX_DESC 8
+
+/**
+ * @brief 每个报文前的头部。未协商校验和卸载与 GSO，故发送时全为零。
+ * virtio 1.0 中总含有 num_buffers 字段
+ *
+ */
+struct vnet_hdr
+{
+    u8_t flags;
+    u8_t gso_type;
+    u16_t hdr_len;
+    u16_t gso_size;
+    u16_t csum_start;
+    u16_t csum_offset;
+    u16_t num_buffers;
+} __attribute__((packed));
+
+/**
+ * @brief 每个发送槽位中与设备共享的部分，位于物理连续的内存中
+ *
+ */
+struct vnet_txcmd
+{
+    struct vnet_hdr hdr;
+    // 使描述符表按16字节对齐
+    u8_t reserved[4];
+    struct virtq_desc table[VNET_TX_DESC];
+} __attribute__((packed));
+
+struct vnet_batch
+{
+    struct lx_event done;
+    // 在途的发送数，另加提交者自己持有的一份
+    u32_t pending;
+};
+
+struct vnet_txslot
+{
+    struct vnet_batch* batch;
+    struct vnet_txcmd* cmd;
+    ptr_t cmd_pa;
+};
+
+struct vnet_rxpkt
+{
+    void* buf;
+    u32_t len;
+};
+
+struct vnet_dev
+{
+    struct virtio_dev vdev;
+    struct virtq rxq;
+    struct virtq txq;
+    struct device* dev;
+    int iv[2];
+    u8_t mac[6];
+
+    // 各接收描述符上投递的缓冲区，NULL表示该位置尚待补充
+    void* rx_posted[VNET_RX_POSTED];
+    u32_t nr_posted;
+    // 空出而未能补充的描述符
+    u16_t rx_empty[VNET_RX_POSTED];
+    u32_t nr_empty;
+    // 后备的缓冲区
+    void* rx_spare[VNET_RX_POOL];
+    u32_t nr_spare;
+    // 已收到而尚未被读取的报文
+    struct vnet_rxpkt rx_ready[VNET_RX_POOL];
+    u32_t rx_head;
+    u32_t rx_tail;
+    struct lx_event arrival;
+
+    int tx_indirect;
+    u32_t nr_tx_slots;
+    u32_t tx_busy;
+    struct vnet_txslot tx_slots[VNET_TX_SLOTS];
+    // 每当有发送槽位空出时通告
+    struct lx_event tx_free;
+
+    u32_t rx_packets;
+    u32_t rx_bytes;
+    // 因没有后备缓冲区，描述符被留空的次数
+    u32_t rx_starved;
+    u32_t tx_packets;
+    u32_t tx_bytes;
+};
+
+void
+virtio_net_init();
+
+#endif /* __LUNAIX_VIRTIO_NET_H */
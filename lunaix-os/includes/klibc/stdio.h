@@ -3,6 +3,28 @@
 #include <stdarg.h>
 #include <stddef.h>
 
+/*
+    格式化输出的目标：线性缓冲区，或是（以 mask 取模定位的）环形缓冲区。
+    pos 自由增长，写至 end 即截断，故可直接写入日志环而无需中间缓冲。
+*/
+struct kfmt_out
+{
+    char* buf;
+    size_t mask; // 环形缓冲区的大小减一；线性缓冲区为 (size_t)-1
+    size_t pos;
+    size_t end;
+};
+
+/**
+ * @brief 按 fmt 一遍完成格式化并写入 out，不附加 '\0'。返回写入的字节数
+ *
+ */
+size_t
+kfmt_vformat(struct kfmt_out* out, const char* fmt, va_list vargs);
+
+void
+kfmt_write(struct kfmt_out* out, const char* str, size_t len);
+
 size_t
 __ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs);
 
@@ -3,4 +3,16 @@
 unsigned int
 crc32b(unsigned char* data, unsigned int size);
 
+unsigned int
+crc32c(unsigned char* data, unsigned int size);
+
+/**
+ * @brief Build the slice-by-8 tables. Before this is called, both checksums
+ * fall back to the slowest implementation. PCLMULQDQ and SSE4.2 are switched
+ * on separately, by alternatives_apply().
+ *
+ */
+void
+crc_select_impl();
+
 #endif /* __LUNAIX_CRC_H */
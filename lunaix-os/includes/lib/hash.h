@@ -8,6 +8,12 @@
 u32_t
 strhash_32(const char* str, u32_t truncate_to);
 
+u32_t
+strhash_32_len(const char* str, u32_t truncate_to, u32_t* len);
+
+u32_t
+strhash_32_n(const char* str, u32_t len, u32_t truncate_to);
+
 /**
  * @brief Simple generic hash function
  *
@@ -23,4 +29,23 @@ hash_32(const u32_t val, u32_t truncate_to)
     return (val * 0x61C88647u) >> (HASH_SIZE_BITS - truncate_to);
 }
 
+/**
+ * @brief Avalanche all 32 bits of the input (murmur3 finalizer)
+ *
+ * ref: https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+ *
+ * @param h
+ * @return u32_t
+ */
+static inline u32_t
+hash_fmix32(u32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
 #endif /* __LUNAIX_HASH_H */
@@ -0,0 +1,16 @@
+#ifndef __LUNAIX_INFLATE_H
+#define __LUNAIX_INFLATE_H
+
+#include <lunaix/types.h>
+
+/**
+ * @brief Decompress a zlib stream (RFC 1950 wrapping RFC 1951 deflate) into
+ * dst. Preset dictionaries are not supported.
+ *
+ * @return int the number of bytes produced, or -1 if the stream is corrupt,
+ * truncated, or would not fit into dst_len bytes
+ */
+int
+inflate_zlib(void* dst, u32_t dst_len, const void* src, u32_t src_len);
+
+#endif /* __LUNAIX_INFLATE_H */
@@ -0,0 +1,39 @@
+#ifndef __LUNAIX_AIO_H
+#define __LUNAIX_AIO_H
+
+#include <lunaix/syscall.h>
+#include <lunaix/types.h>
+
+/*
+    POSIX风格的异步I/O，目前仅支持块设备文件。
+    偏移与长度均需按设备的块大小对齐。
+*/
+struct aiocb
+{
+    int aio_fildes;
+    size_t aio_offset;
+    void* aio_buf;
+    size_t aio_nbytes;
+    int __aio_id; // 由内核填写，标识该请求
+};
+
+__LXSYSCALL1(int, aio_read, struct aiocb*, aiocbp)
+
+__LXSYSCALL1(int, aio_write, struct aiocb*, aiocbp)
+
+/*
+    返回0表示请求已成功完成，EINPROGRESS表示仍在进行，否则为请求的错误码
+*/
+__LXSYSCALL1(int, aio_error, const struct aiocb*, aiocbp)
+
+/*
+    取回已完成请求的结果（传输的字节数），并释放该请求。每个请求仅可调用一次
+*/
+__LXSYSCALL1(int, aio_return, struct aiocb*, aiocbp)
+
+/*
+    简化的 aio_suspend：阻塞直至单个请求完成
+*/
+__LXSYSCALL1(int, aio_suspend, const struct aiocb*, aiocbp)
+
+#endif /* __LUNAIX_AIO_H */
@@ -2,8 +2,9 @@
 #define __LUNAIX_BLKIO_H
 
 #include <lunaix/buffer.h>
+#include <lunaix/clock.h>
 #include <lunaix/ds/llist.h>
-#include <lunaix/ds/waitq.h>
+#include <lunaix/event.h>
 #include <lunaix/types.h>
 
 #define BLKIO_WRITE 0x1
@@ -16,10 +17,80 @@
 
 // Free on complete
 #define BLKIO_FOC 0x10
+// Composite request built by merging adjacent ones, see blkio_commit
+#define BLKIO_MERGED 0x20
+// Write back the volatile write cache of the device, carries no data
+#define BLKIO_FLUSH 0x40
+// Tell the device [blk_addr, blk_addr + blk_count) is no longer in use
+//  (i.e., TRIM), carries no data
+#define BLKIO_DISCARD 0x80
+
+// Requests dispatched alone, as a barrier, see blkio_commit
+#define BLKIO_EXCL (BLKIO_FLUSH | BLKIO_DISCARD)
 
 #define BLKIO_SCHED_IDEL 0x1
+// Context already refilled in the current completion batch
+#define BLKIO_SCHED_KICKED 0x2
+
+// Latency histogram buckets, bucket i counts requests that took
+//  [2^i, 2^(i+1)) microseconds (the first and last bucket are open ended)
+#define BLKIO_LAT_BUCKETS 20
+
+// Number of events kept by a trace ring, must be a power of two
+#define BLKIO_TRACE_NR 512
+
+// Request committed to the context
+#define BLKIO_TR_COMMIT 0
+// Handed over to the driver by the scheduler
+#define BLKIO_TR_DISPATCH 1
+// Issued to the hardware by the driver
+#define BLKIO_TR_ISSUE 2
+// Completed by the hardware
+#define BLKIO_TR_COMPLETE 3
 
 struct blkio_req;
+struct blkio_context;
+
+struct blkio_trace_ent
+{
+    // seq + 1 of the event once fully written, 0 while being written
+    u32_t seq;
+    u8_t event;
+    u8_t flags; // low byte of blkio_req::flags
+    u16_t errcode;
+    u32_t blocks;
+    u64_t lba;
+    u64_t time_ns;
+};
+
+/**
+ * @brief A ring of the most recent request events of a context.
+ *
+ * Writers claim a sequence number with an atomic increment and publish the
+ * entry by storing its seq last, so recording never blocks and readers may
+ * walk the ring while I/O goes on, dropping entries overwritten under them.
+ *
+ */
+struct blkio_trace
+{
+    u32_t head;
+    u32_t enabled;
+    struct blkio_trace_ent ents[BLKIO_TRACE_NR];
+};
+
+struct blkio_stats
+{
+    u32_t rd_ios;
+    u32_t wr_ios;
+    u64_t rd_blocks;
+    u64_t wr_blocks;
+    u32_t errors;
+    u32_t merges;
+    u32_t flushes;
+    u32_t discards;
+    // Measured from blkio_commit to completion
+    u32_t lat_hist[BLKIO_LAT_BUCKETS];
+};
 
 typedef void (*blkio_cb)(struct blkio_req*);
 typedef void (*req_handler)(struct blkio_req*);
@@ -28,18 +99,53 @@ struct blkio_req
 {
     struct llist_header reqs;
     struct blkio_context* io_ctx;
-    struct vecbuf* vbuf;
+    struct vecbuf vbuf;
     u32_t flags;
-    waitq_t wait;
+    // Signaled once the request has completed, successful or not
+    struct lx_event done;
     u64_t blk_addr;
     void* evt_args;
     blkio_cb completed;
     int errcode;
+    // Per-direction FIFO link and expiry (ms), used by the deadline scheduler
+    struct llist_header fifo;
+    time_t deadline;
+    // For a BLKIO_MERGED request: the original requests, in LBA order
+    struct llist_header merged;
+    u64_t commit_ns;
+    // Times the driver has resubmitted this request after an error recovery
+    u32_t retries;
+    // Extra statistics to account this request to (e.g. of a partition)
+    struct blkio_stats* stats;
+    // Number of blocks to discard, for BLKIO_DISCARD
+    u32_t blk_count;
+};
+
+/**
+ * @brief An I/O scheduler policy, deciding the order in which queued requests
+ * are handed to the driver. Called with interrupts disabled.
+ *
+ */
+struct blkio_sched
+{
+    const char* name;
+    void (*add)(struct blkio_context* ctx, struct blkio_req* req);
+    /**
+     * @brief Remove and return the next request to dispatch, NULL if none
+     *
+     */
+    struct blkio_req* (*next)(struct blkio_context* ctx);
 };
 
 struct blkio_context
 {
+    // Queued requests. Kept in LBA order by the elevator based schedulers
     struct llist_header queue;
+    // Read/write FIFOs in arrival order, for the deadline scheduler
+    struct llist_header fifo[2];
+    // Start of the last dispatched request, i.e. the head position for C-LOOK
+    u64_t head_lba;
+    struct blkio_sched* sched;
     struct
     {
         u32_t seektime;
@@ -48,6 +154,37 @@ struct blkio_context
     req_handler handle_one;
     u32_t state;
     u32_t busy;
+    // Max number of requests in flight at once, defaults to 1
+    u32_t depth;
+    // Max number of buffer segments a single request may carry. Adjacent
+    //  requests are merged only if this allows, defaults to 1 (no merging)
+    u32_t max_segs;
+    u32_t blk_size;
+    // Nesting count of blkio_plug, dispatch on commit is held while non-zero
+    u32_t plugged;
+    // Requests waiting in the scheduler, not yet handed to the driver
+    u32_t queued;
+    // A pending BLKIO_EXCL request, dispatched once everything committed
+    //  before it has completed
+    struct blkio_req* barrier;
+    // Requests committed after the barrier, in commit order
+    struct llist_header held;
+    // Max blocks a single BLKIO_DISCARD may cover, 0 if not supported
+    u32_t max_discard;
+    // Event ring, NULL until tracing is first enabled, see blkio_trace_enable
+    struct blkio_trace* trace;
+    // How long (us) a BLKIO_WAIT commit busy-polls for its completion before
+    //  going to sleep, 0 disables polling
+    u32_t poll_us;
+    /**
+     * @brief Reap requests the hardware has completed without waiting for its
+     * interrupt, completing them through blkio_complete_async. Called with
+     * interrupts disabled, NULL if the driver can not poll.
+     *
+     * @return int non-zero if anything has been reaped
+     */
+    int (*poll)(struct blkio_context* ctx);
+    struct blkio_stats stats;
     void* driver;
 };
 
@@ -57,7 +194,8 @@ blkio_init();
 /**
  * @brief Vectorized read request
  *
- * @param vbuf
+ * @param vbuf the segments to transfer, taken over by the request (and freed
+ * along with it), leaving vbuf empty
  * @param start_lba
  * @param completed
  * @param evt_args
@@ -74,7 +212,8 @@ blkio_vrd(struct vecbuf* vbuf,
 /**
  * @brief Vectorized write request
  *
- * @param vbuf
+ * @param vbuf the segments to transfer, taken over by the request (and freed
+ * along with it), leaving vbuf empty
  * @param start_lba
  * @param completed
  * @param evt_args
@@ -88,11 +227,46 @@ blkio_vwr(struct vecbuf* vbuf,
           void* evt_args,
           u32_t options);
 
+/**
+ * @brief Cache flush request, completes once every write completed before it
+ * is on stable storage.
+ *
+ * @param completed
+ * @param evt_args
+ * @param options
+ * @return struct blkio_req*
+ */
+struct blkio_req*
+blkio_flush(blkio_cb completed, void* evt_args, u32_t options);
+
+/**
+ * @brief Discard request, count must not exceed blkio_context::max_discard
+ *
+ * @param start_lba
+ * @param count
+ * @param completed
+ * @param evt_args
+ * @param options
+ * @return struct blkio_req*
+ */
+struct blkio_req*
+blkio_discard(u64_t start_lba,
+              u32_t count,
+              blkio_cb completed,
+              void* evt_args,
+              u32_t options);
+
 void
 blkio_free_req(struct blkio_req* req);
 
 /**
- * @brief Commit an IO request to scheduler.
+ * @brief Commit an IO request to scheduler. If an already queued request of
+ * the same direction is adjacent to it on disk, the two are merged and
+ * dispatched as one, completing both on the merged completion.
+ *
+ * A BLKIO_EXCL request acts as a barrier. It bypasses the scheduler and is
+ * dispatched alone once everything committed before it has completed, while
+ * requests committed after it are held back until it completes.
  *
  * @param ctx
  * @param req
@@ -101,7 +275,40 @@ void
 blkio_commit(struct blkio_context* ctx, struct blkio_req* req, int options);
 
 /**
- * @brief Schedule an IO request to be handled.
+ * @brief Set for how long a BLKIO_WAIT commit on ctx polls for completion
+ * before sleeping. Has no effect if the driver provides no poll hook.
+ *
+ * @param ctx
+ * @param us 0 to always sleep
+ */
+void
+blkio_set_poll(struct blkio_context* ctx, u32_t us);
+
+/**
+ * @brief Hold back dispatching of committed requests, so that a batch can be
+ * queued up first and be sorted and merged by the scheduler before the
+ * hardware sees any of it. Calls may nest.
+ *
+ * A commit with BLKIO_WAIT still dispatches, as waiting on a held request
+ * would never return.
+ *
+ * @param ctx
+ */
+void
+blkio_plug(struct blkio_context* ctx);
+
+/**
+ * @brief Undo one blkio_plug, and dispatch the queued batch once the last
+ * plug is removed.
+ *
+ * @param ctx
+ */
+void
+blkio_unplug(struct blkio_context* ctx);
+
+/**
+ * @brief Dispatch queued requests to the driver, until the context has
+ * `depth` requests in flight.
  *
  * @param ctx
  */
@@ -118,6 +325,79 @@ blkio_schedule(struct blkio_context* ctx);
 void
 blkio_complete(struct blkio_req* req);
 
+/**
+ * @brief Same as blkio_complete, but deferred to the system workqueue, and
+ * kick off the next request of the context from there. Safe to call from
+ * interrupt context.
+ *
+ * @param req
+ */
+void
+blkio_complete_async(struct blkio_req* req);
+
+/**
+ * @brief Look up an I/O scheduler by name ("fifo", "clook" or "deadline")
+ *
+ * @return struct blkio_sched* NULL if no such scheduler
+ */
+struct blkio_sched*
+blkio_sched_find(const char* name, size_t len);
+
+/**
+ * @brief Switch the I/O scheduler of a context, moving requests already
+ * queued over to the new one.
+ *
+ */
+void
+blkio_set_sched(struct blkio_context* ctx, struct blkio_sched* sched);
+
+/**
+ * @brief List all schedulers, the one used by ctx in brackets
+ *
+ */
+int
+blkio_sched_list(struct blkio_context* ctx, char* buf, size_t len);
+
+void
+__blkio_trace_record(struct blkio_trace* trace,
+                     struct blkio_req* req,
+                     u32_t event);
+
+/**
+ * @brief Record an event of req in the trace ring of its context, if tracing
+ * is enabled. Safe to call from interrupt context.
+ *
+ * @param req
+ * @param event one of BLKIO_TR_*
+ */
+static inline void
+blkio_trace(struct blkio_req* req, u32_t event)
+{
+    struct blkio_trace* trace = req->io_ctx->trace;
+    if (trace && trace->enabled) {
+        __blkio_trace_record(trace, req, event);
+    }
+}
+
+/**
+ * @brief Start or stop recording request events of ctx. The ring is kept
+ * once allocated, so events recorded so far remain readable after stopping.
+ *
+ */
+void
+blkio_trace_enable(struct blkio_context* ctx, int enable);
+
+/**
+ * @brief Copy out the event with sequence number seq
+ *
+ * @return int 0 if the event has already been overwritten or is still being
+ * written
+ */
+int
+blkio_trace_get(struct blkio_trace* trace,
+                u32_t seq,
+                struct blkio_trace_ent* ent);
+
 /**
  * @brief Create a new block IO scheduling context
  *
@@ -0,0 +1,39 @@
+/**
+ * @file blkpart_mbr.h
+ * @brief The Master Boot Record (MBR) partition table
+ *
+ */
+#ifndef __LUNAIX_BLKPART_MBR_H
+#define __LUNAIX_BLKPART_MBR_H
+
+#include <lunaix/device.h>
+#include <lunaix/types.h>
+
+#define MBR_SIG 0xaa55
+#define MBR_PTE_OFFSET 446
+#define MBR_PTE_NUM 4
+
+#define MBR_TYPE_EMPTY 0x00
+#define MBR_TYPE_EXT_CHS 0x05
+#define MBR_TYPE_EXT_LBA 0x0f
+#define MBR_TYPE_GPT_PROTECT 0xee
+
+struct mbr_entry
+{
+    u8_t status;
+    u8_t chs_start[3];
+    u8_t type;
+    u8_t chs_end[3];
+    u32_t start_lba;
+    u32_t sectors;
+} PACKED;
+
+/**
+ * @brief 解析MBR分区表，作为没有GPT时的后备
+ *
+ * @return int 1：找到并挂载了分区；0：没有MBR；负值：错误
+ */
+int
+blkpart_probembr(struct device* master);
+
+#endif /* __LUNAIX_BLKPART_MBR_H */
@@ -9,7 +9,17 @@
 #define PARTITION_NAME_SIZE 48
 #define DEV_ID_SIZE 32
 
+// 每个设备预先分配的跳板缓冲块数，用于非对齐访问的首尾两块
+#define BLOCK_BOUNCE_NR 4
+
 struct block_dev;
+struct v_inode;
+
+struct block_bounce
+{
+    u32_t free_map;
+    void* blocks[BLOCK_BOUNCE_NR];
+};
 
 struct block_dev_ops
 {
@@ -30,6 +40,11 @@ struct block_dev
     u64_t start_lba;
     u64_t end_lba;
     u32_t blk_size;
+    struct block_bounce* bounce;
+    // 缓冲缓存：所在物理设备于 devfs 中的 inode，见 bcache.c
+    struct v_inode* bcache;
+    // 仅分区持有，设备本身的统计见 blkio->stats
+    struct blkio_stats* stats;
     struct block_dev_ops ops;
 };
 
@@ -59,9 +74,48 @@ block_mount(struct block_dev* bdev, devfs_exporter export);
 void
 blk_mapping_init();
 
+/**
+ * @brief 按注册的顺序获取块设备（包括分区）
+ *
+ * @return struct block_dev* 超出已注册的数量时为NULL
+ */
+struct block_dev*
+block_dev_at(int index);
+
 void
 blk_set_blkmapping(struct block_dev* bdev, void* fsnode);
 
+/**
+ * @brief 为设备建立缓冲缓存，其分区与之共用。须于设备注册之后调用
+ *
+ */
+void
+bcache_setup(struct block_dev* bdev);
+
+/**
+ * @brief 经由缓冲缓存读取块设备，供文件系统读取元数据（卷描述符、目录等）使用。
+ * 语义同 device::read；非块设备则直接转交 device::read。
+ *
+ */
+int
+bcache_read(struct device* dev, void* buf, foff_t offset, size_t len);
+
+/**
+ * @brief 使 [lba, lba + count) 内的缓存页失效。写入块设备前调用
+ *
+ */
+void
+bcache_invalidate(struct block_dev* bdev, u64_t lba, size_t count);
+
+/**
+ * @brief 同 bcache_invalidate，用于以设备在 devfs 中的页缓存为数据来源的写入
+ * （write_page、submit）：整个设备的页即缓冲缓存本身，只有分区的写入才须
+ * 使之失效
+ *
+ */
+void
+bcache_invalidate_alias(struct block_dev* bdev, u64_t lba, size_t count);
+
 struct block_dev*
 blk_mount_part(struct block_dev* bdev,
                const char* name,
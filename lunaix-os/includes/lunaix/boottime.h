@@ -0,0 +1,35 @@
+#ifndef __LUNAIX_BOOTTIME_H
+#define __LUNAIX_BOOTTIME_H
+
+#include <lunaix/types.h>
+
+/*
+    启动各阶段的耗时。
+
+    初始化的各个阶段结束时以 boot_phase 记下当时的 TSC，阶段的耗时即与
+    前一次记录之差。第一个阶段 entry 记于内核入口，TSC 自处理器复位起
+    计数，故其耗时涵盖固件与引导程序。
+
+    /sys/boot_time 每行一个阶段：
+        名称 耗时（千周期） 耗时（微秒） 结束时刻（微秒，自复位起）
+    TSC 的频率须待计时器校准后方才得知，且不恒定的 TSC 不予换算，此时
+    微秒数为0。推迟至 init 开始运行后的初始化记为 deferred 阶段。
+*/
+
+#define BOOT_NR_PHASES 48
+
+/**
+ * @brief 标记名为 name 的阶段于此刻结束。name 须为静态的字符串
+ *
+ */
+void
+boot_phase(const char* name);
+
+/**
+ * @brief 导出 /sys/boot_time
+ *
+ */
+void
+boot_phase_export();
+
+#endif /* __LUNAIX_BOOTTIME_H */
@@ -1,24 +1,39 @@
 #ifndef __LUNAIX_BUFFER_H
 #define __LUNAIX_BUFFER_H
 
-#include <lunaix/ds/llist.h>
 #include <lunaix/types.h>
 
+// Number of segments stored in the vecbuf itself. Requests of the block layer
+//  take at most three (head, body and tail), only merged ones spill.
+#define VBUF_INLINE_SEGS 4
+
 struct membuf
 {
     void* buffer;
     size_t size;
 };
 
+/**
+ * @brief A vectorized buffer, i.e. a list of segments to be transferred as
+ * one. The segments are kept in the inline array, moving to a heap allocated
+ * one only once they outnumber it.
+ *
+ * An all-zero vecbuf is empty and valid. It can be moved with a plain copy,
+ * as long as the source is not used afterwards.
+ *
+ */
 struct vecbuf
 {
-    struct llist_header components;
-    struct membuf buf;
-    size_t acc_sz;
+    struct membuf* spill; // segments once spilled, NULL while inline
+    u32_t nr_segs;
+    u32_t capacity; // of the spilled array
+    size_t size;
+    struct membuf inl[VBUF_INLINE_SEGS];
 };
 
 /**
- * @brief Free a vectorized buffer
+ * @brief Release the spilled segment array, if any, and empty the vecbuf.
+ * The vecbuf itself and the memory its segments describe are not touched.
  *
  * @param vbuf
  */
@@ -26,27 +41,32 @@ void
 vbuf_free(struct vecbuf* vbuf);
 
 /**
- * @brief Allocate a buffer, or append to `vec` (if not NULL) as a component
- * thus to form a vectorized buffer.
+ * @brief Append a segment to the vecbuf. Only fails when the segments spill
+ * and the larger array cannot be allocated, in which case the vecbuf is left
+ * unchanged. Never sleeps.
  *
- * @param vec the buffer used to construct a vectorized buffer.
+ * @param vbuf
  * @param buf a memeory region that holds data or partial data if vectorized
  * @param len maximum number of bytes should recieved.
- * @return struct vecbuf*
+ * @return int 0 or ENOMEM
  */
-struct vecbuf*
-vbuf_alloc(struct vecbuf** vec, void* buf, size_t len);
+int
+vbuf_append(struct vecbuf* vbuf, void* buf, size_t len);
+
+static inline struct membuf*
+vbuf_segs(struct vecbuf* vbuf)
+{
+    return vbuf->spill ? vbuf->spill : vbuf->inl;
+}
+
+#define vbuf_foreach(seg, vbuf)                                                \
+    for ((seg) = vbuf_segs(vbuf); (seg) < vbuf_segs(vbuf) + (vbuf)->nr_segs;  \
+         (seg)++)
 
 static inline size_t
 vbuf_size(struct vecbuf* vbuf)
 {
-    if (!vbuf) {
-        return 0;
-    }
-
-    struct vecbuf* last =
-      list_entry(vbuf->components.prev, struct vecbuf, components);
-    return last->acc_sz;
+    return vbuf->size;
 }
 
 #endif /* __LUNAIX_BUFFER_H */
@@ -33,6 +33,14 @@ clock_datatime_eq(datetime_t* a, datetime_t* b);
 time_t
 clock_systime();
 
+/**
+ * @brief 返回自开机以来的纳秒数。若TSC可用，则其精度不受时钟周期的限制
+ *
+ * @return u64_t
+ */
+u64_t
+clock_systime_ns();
+
 time_t
 clock_unixtime();
 
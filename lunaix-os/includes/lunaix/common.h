@@ -11,6 +11,13 @@
 #define KSTACK_SIZE MEM_1MB
 #define KSTACK_START ((0x3FFFFFU - KSTACK_SIZE) + 1)
 #define KSTACK_TOP 0x3FFFF0U
+// 以上为每个进程内核栈所预留的地址空间，实际只映射栈顶往下的这些。其下的
+//  一页从不映射，作为保护页，溢出时经由双重错误报告（见 asm/x86/dfault.c）
+#define KSTACK_MAPPED_SIZE (16 * 1024)
+#define KSTACK_MAPPED_START (KSTACK_START + KSTACK_SIZE - KSTACK_MAPPED_SIZE)
+
+// 每个处理器各有的中断栈，外部中断的处理程序在其上运行（见 interrupt.S）
+#define IRQ_STACK_SIZE (8 * 1024)
 
 #define KERNEL_MM_BASE 0xC0000000
 
@@ -25,6 +32,19 @@
 #define UCODE_SEG 0x1B
 #define UDATA_SEG 0x23
 #define TSS_SEG 0x28
+// 应用处理器（AP）各自的TSS紧随BSP的TSS之后
+#define TSS_SEG_AP(cpu) (TSS_SEG + ((cpu) << 3))
+
+// 各处理器的 per-CPU 数据段（见 lunaix/percpu.h），紧随各TSS之后。
+// 与同一处理器的TSS选择子相距固定，中断入口据此由 str 求得
+#define PERCPU_SEG 0x68
+#define PERCPU_SEG_CPU(cpu) (PERCPU_SEG + ((cpu) << 3))
+
+// 双重错误的任务门所用的TSS，紧随各 per-CPU 数据段之后（SMP_MAX_CPU 为8）
+#define DFAULT_TSS_SEG 0xA8
+
+// AP启动代码所在的物理地址（须低于1MiB且按页对齐）
+#define AP_TRAMPOLINE 0x8000
 
 #define USER_START 0x400000
 #define USTACK_SIZE 0x100000
@@ -32,6 +52,10 @@
 #define USTACK_END (0x9fffffff - USTACK_SIZE + 1)
 #define UMMAP_AREA 0x4D000000
 
+// 用户堆（brk）可扩展的区间，紧邻 mmap 区间之下。程序的各段须位于其下方
+#define UHEAP_START 0x40000000
+#define UHEAP_END UMMAP_AREA
+
 #ifndef __ASM__
 #include <stddef.h>
 // From Linux kernel v2.6.0 <kernel.h:194>
@@ -17,22 +17,69 @@
 
 typedef unsigned int dev_t;
 
+struct dev_iocb;
+struct poll_table;
+struct v_file;
+typedef void (*dev_iocb_cb)(struct dev_iocb*);
+
+// device::direct_io 中单个请求的长度上限
+#define DEV_DIRECT_MAX 0x10000
+
+/**
+ * @brief 异步I/O请求，经由 device::submit 提交。
+ * 请求完成时（可能处于中断或工作队列的上下文中）调用 done。
+ *
+ */
+struct dev_iocb
+{
+    void* buf;
+    foff_t offset;
+    size_t len;
+    int write;
+    int result; // 完成后为传输的字节数，或负的错误码
+    dev_iocb_cb done;
+    void* data; // 供提交者使用
+};
+
 struct device
 {
     u32_t magic;
     struct llist_header siblings;
     struct llist_header children;
+    struct hlist_node name_node; // 于注册表中按（父设备，名称）索引
+    struct hlist_node id_node;   // 于注册表中按设备号索引
     struct device* parent;
     struct hstr name;
     dev_t dev_id;
     int dev_type;
     char name_val[DEVICE_NAME_SIZE];
     void* underlay;
-    int (*read)(struct device* dev, void* buf, size_t offset, size_t len);
-    int (*write)(struct device* dev, void* buf, size_t offset, size_t len);
-    int (*read_page)(struct device* dev, void* buf, size_t offset);
-    int (*write_page)(struct device* dev, void* buf, size_t offset);
+    int (*read)(struct device* dev, void* buf, foff_t offset, size_t len);
+    int (*write)(struct device* dev, void* buf, foff_t offset, size_t len);
+    int (*read_page)(struct device* dev, void* buf, foff_t offset);
+    int (*write_page)(struct device* dev, void* buf, foff_t offset);
+    // 提交一个异步I/O请求，成功时返回0，请求的结果通过 iocb->done 告知
+    int (*submit)(struct device* dev, struct dev_iocb* iocb);
+    // 将设备的写缓存落盘，此前完成的写入在返回后即不会丢失
+    int (*sync)(struct device* dev);
+    // 可选，以调用者（可为用户空间）的缓冲区直接传输一批请求：一并提交，
+    // 一次等待全部完成。各请求的 offset 与 len 须按块对齐，结果记于其 result
+    int (*direct_io)(struct device* dev, struct dev_iocb* iocbs, u32_t n);
+    // 可选，成对调用。其间经由 submit 提交的请求暂不调度，以便排序与合并
+    void (*plug)(struct device* dev);
+    void (*unplug)(struct device* dev);
     int (*exec_cmd)(struct device* dev, u32_t req, va_list args);
+    // 可选，返回当前就绪的 POLL* 掩码，并经由 poll_wait 登记其等待队列
+    int (*poll)(struct device* dev, struct poll_table* pt);
+
+    // 可选，成对调用。于每次打开时建立该次打开私有的状态（存于 file->data）
+    int (*open)(struct device* dev, struct v_file* file);
+    void (*release)(struct device* dev, struct v_file* file);
+    // 可选，经由打开的文件读取与轮询，以使用其私有状态。存在时优先于 read 与 poll
+    int (*read_file)(struct device* dev, struct v_file* file, void* buf, size_t len);
+    int (*poll_file)(struct device* dev,
+                     struct v_file* file,
+                     struct poll_table* pt);
 };
 
 struct device*
@@ -66,6 +113,20 @@ device_getbyname(struct device* root_dev, const char* name, size_t len);
 struct device*
 device_getbyoffset(struct device* root_dev, int pos);
 
+/**
+ * @brief 设备 root_dev 的子设备列表，为 NULL 时是顶层设备的列表
+ *
+ */
+struct llist_header*
+device_list(struct device* root_dev);
+
+/**
+ * @brief 任一设备列表的成员有增删时改变，可作为目录游标的 seq
+ *
+ */
+u32_t
+device_list_seq();
+
 void
 device_init_builtin();
 
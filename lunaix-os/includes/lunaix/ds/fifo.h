@@ -6,6 +6,15 @@
 
 #define FIFO_DIRTY 1
 
+/*
+    Single-producer/single-consumer mode. The buffer size must be a power of
+    two; wr_pos and rd_pos then run freely and are masked on access, and
+    neither end takes the lock, so the producer may be an interrupt handler.
+    Only fifo_putone, fifo_readone_async, fifo_write, fifo_read and fifo_len
+    are valid on such a buffer, and free_len is not maintained.
+*/
+#define FIFO_SPSC 2
+
 struct fifo_buf
 {
     void* data;
@@ -17,6 +26,20 @@ struct fifo_buf
     mutex_t lock;
 };
 
+/**
+ * @brief Number of bytes currently held in the buffer
+ *
+ */
+static inline size_t
+fifo_len(struct fifo_buf* fbuf)
+{
+    if ((fbuf->flags & FIFO_SPSC)) {
+        return __atomic_load_n(&fbuf->wr_pos, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&fbuf->rd_pos, __ATOMIC_ACQUIRE);
+    }
+    return fbuf->size - fbuf->free_len;
+}
+
 int
 fifo_backone(struct fifo_buf* fbuf);
 
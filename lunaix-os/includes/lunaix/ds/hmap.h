@@ -0,0 +1,111 @@
+#ifndef __LUNAIX_HMAP_H
+#define __LUNAIX_HMAP_H
+
+#include <lunaix/types.h>
+
+/*
+    开放定址的散列表（Swiss table 式）。
+
+    每个槽位对应一个控制字节：空（HMAP_EMPTY）、已删除（HMAP_DELETED），
+    或是占用者散列值的低7位（h2）。散列值的其余位（h1）决定探测的起点。
+    探测以 HMAP_GROUP 个控制字节为一组进行，以一次32位的读取、按字节
+    并行（SWAR）地找出与 h2 相符或为空的槽位，绝大多数的查找只需读取
+    一组控制字节，并只对 h2 相符者比较键。
+
+    容量总为2的幂，占用（含已删除）超过 7/8 时扩张一倍，或在已删除者
+    居多时按原大小重建。槽位中仅存放元素的指针，元素本身由使用者分配，
+    键的比较亦由使用者在遍历候选者时完成（同 rhtable_hash_foreach）。
+
+    散列值的各位须充分混合（如经 hash_fmix32），否则控制字节无从筛选。
+*/
+
+#define HMAP_GROUP 4
+#define HMAP_MIN_CAP 8
+
+#define HMAP_EMPTY ((u8_t)0x80)
+#define HMAP_DELETED ((u8_t)0xfe)
+
+struct hmap
+{
+    // cap + HMAP_GROUP 个字节，末尾的一组为开头一组的镜像，使得任何位置起
+    // 的一组都无需回绕
+    u8_t* ctrl;
+    void** slots;
+    u32_t cap;
+    u32_t count;
+    // 在需要扩张或重建前，仍可占用的空槽位数
+    u32_t growth_left;
+    u32_t (*hashof)(void* entry);
+};
+
+/**
+ * @brief 遍历散列值为 hash 的候选元素的游标
+ *
+ */
+struct hmap_probe
+{
+    u32_t pos;
+    u32_t stride;
+    u32_t match;
+    u32_t index; // 最近取得的候选者的槽位
+    u8_t h2;
+};
+
+int
+hmap_init(struct hmap* map, u32_t min_cap, u32_t (*hashof)(void* entry));
+
+/**
+ * @brief 释放散列表，元素本身不受影响
+ *
+ */
+void
+hmap_free(struct hmap* map);
+
+/**
+ * @brief 插入一个元素，不检查是否已有相同的键
+ *
+ * @return 0，或在需要扩张而内存不足时为 ENOMEM
+ */
+int
+hmap_insert(struct hmap* map, void* entry);
+
+/**
+ * @brief 移除一个元素（按指针匹配），不在表中的元素将被忽略
+ *
+ */
+void
+hmap_remove(struct hmap* map, void* entry);
+
+void
+hmap_probe_init(struct hmap* map, struct hmap_probe* probe, u32_t hash);
+
+/**
+ * @brief 取得下一个 h2 相符的元素，返回NULL时探测结束
+ *
+ */
+void*
+hmap_probe_next(struct hmap* map, struct hmap_probe* probe);
+
+#define hmap_hash_foreach(map, hash, pos, probe)                               \
+    for (hmap_probe_init(map, &(probe), hash);                                 \
+         (pos = hmap_probe_next(map, &(probe)));)
+
+/**
+ * @brief 遍历全部元素，期间不可插入或移除
+ *
+ */
+#define hmap_for_each(map, i, pos)                                             \
+    for (i = 0; i < (map)->cap; i++)                                           \
+        if (!((map)->ctrl[i] & 0x80) && (pos = (map)->slots[i]))
+
+#ifdef LUNAIX_HMAP_BENCH
+void
+hmap_bench();
+#else
+static inline void
+hmap_bench()
+{
+}
+#endif
+
+#endif /* __LUNAIX_HMAP_H */
@@ -1,6 +1,7 @@
 #ifndef __LUNAIX_HSTR_H
 #define __LUNAIX_HSTR_H
 
+#include <klibc/string.h>
 #include <lib/hash.h>
 
 #define HSTR_FULL_HASH 32
@@ -24,15 +25,72 @@ struct hstr
         .len = (length), .value = (str), .hash = (strhash)                     \
     }
 
-#define HSTR_EQ(str1, str2) ((str1)->hash == (str2)->hash)
+/**
+ * @brief Full-key equality. The hash and length only filter; the bytes are
+ * compared unless both sides share one interned copy.
+ *
+ * @param a
+ * @param b
+ */
+static inline int
+hstr_eq(struct hstr* a, struct hstr* b)
+{
+    return a->hash == b->hash && a->len == b->len &&
+           (a->value == b->value || !memcmp(a->value, b->value, a->len));
+}
+
+#define HSTR_EQ(str1, str2) hstr_eq(str1, str2)
 
+/**
+ * @brief Recompute the hash. A zero len is taken as unknown and is filled in
+ * from the same pass over the string.
+ *
+ * @param hash_str
+ * @param truncate_to
+ */
 inline void
 hstr_rehash(struct hstr* hash_str, u32_t truncate_to)
 {
-    hash_str->hash = strhash_32(hash_str->value, truncate_to);
+    u32_t len;
+    hash_str->hash = strhash_32_len(hash_str->value, truncate_to, &len);
+    if (!hash_str->len) {
+        hash_str->len = len;
+    }
 }
 
 void
 hstrcpy(struct hstr* dest, struct hstr* src);
 
+/**
+ * @brief Point dest to the interned copy of the first src->len bytes of
+ * src->value, creating it if this is the first reference. Equal names share
+ * one NUL-terminated copy, so two interned hstr are equal iff their values
+ * are the same pointer. dest->hash is set to the full strhash_32 of the name.
+ *
+ * src->value need not be NUL-terminated and src->hash is not consulted.
+ *
+ * @param dest
+ * @param src
+ */
+void
+hstr_intern(struct hstr* dest, struct hstr* src);
+
+/**
+ * @brief Take another reference to an interned name.
+ *
+ * @param dest
+ * @param interned
+ */
+void
+hstr_dup(struct hstr* dest, struct hstr* interned);
+
+/**
+ * @brief Drop a reference taken by hstr_intern or hstr_dup. The copy is freed
+ * with its last reference.
+ *
+ * @param interned
+ */
+void
+hstr_release(struct hstr* interned);
+
 #endif /* __LUNAIX_HSTR_H */
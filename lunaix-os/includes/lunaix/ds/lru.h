@@ -7,6 +7,8 @@
 struct lru_node
 {
     struct llist_header lru_nodes;
+    // 入链后再次被访问，驱逐扫描时将其挪回表头并清除，给予第二次机会
+    u32_t referenced;
 };
 
 typedef int (*evict_cb)(struct lru_node* lru_obj);
@@ -22,6 +24,11 @@ struct lru_zone
 struct lru_zone*
 lru_new_zone(evict_cb try_evict_cb);
 
+/**
+ * @brief 记录一次访问。新节点加入表头；已在链表中的节点仅标记为被访问过，
+ * 待驱逐扫描时再挪动，故命中的开销只是一次写入
+ *
+ */
 void
 lru_use_one(struct lru_zone* zone, struct lru_node* node);
 
@@ -34,4 +41,21 @@ lru_remove(struct lru_zone* zone, struct lru_node* node);
 void
 lru_evict_half(struct lru_zone* zone);
 
+/**
+ * @brief 从区域尾部（最久未使用）起驱逐至多 n 个对象，被访问过的对象将被
+ * 挪回表头而免于一次驱逐（CLOCK）
+ *
+ * @return u32_t 实际驱逐的数量
+ */
+u32_t
+lru_evict_n(struct lru_zone* zone, u32_t n);
+
+/**
+ * @brief 遍历所有已注册的LRU区域，按其大小比例共驱逐约 target 个对象
+ *
+ * @return u32_t 实际驱逐的数量
+ */
+u32_t
+lru_reclaim(u32_t target);
+
 #endif /* __LUNAIX_LRU_H */
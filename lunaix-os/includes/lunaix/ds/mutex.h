@@ -1,25 +1,51 @@
 #ifndef __LUNAIX_MUTEX_H
 #define __LUNAIX_MUTEX_H
 
-#include "semaphore.h"
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/waitq.h>
 #include <lunaix/types.h>
+#include <stdatomic.h>
+
+/**
+ * @brief 互斥锁的类别。同一处 mutex_init 所初始化的锁属于同一类别，
+ * 争用统计按类别汇总，导出至 twifs （/mutex_stat）
+ *
+ */
+struct mutex_class
+{
+    struct llist_header classes;
+    const char* name;
+    u32_t acquired;  // 获取次数
+    u32_t contended; // 其中未能立即获取的次数
+    u32_t blocked;   // 其中最终阻塞等待的次数
+};
 
 typedef struct mutex_s
 {
-    struct sem_t sem;
+    atomic_int locked;
     pid_t owner;
+    waitq_t waiters;
+    struct mutex_class* cls;
 } mutex_t;
 
-static inline void
-mutex_init(mutex_t* mutex)
-{
-    sem_init(&mutex->sem, 1);
-}
+#define __MUTEX_STR(x) #x
+#define __MUTEX_LINE(x) __MUTEX_STR(x)
+
+#define mutex_init(mutex)                                                      \
+    ({                                                                         \
+        static struct mutex_class __mutex_class = {                            \
+            .name = __FILE__ ":" __MUTEX_LINE(__LINE__)                        \
+        };                                                                     \
+        __mutex_init((mutex), &__mutex_class);                                 \
+    })
+
+void
+__mutex_init(mutex_t* mutex, struct mutex_class* cls);
 
 static inline int
 mutex_on_hold(mutex_t* mutex)
 {
-    return !atomic_load(&mutex->sem.counter);
+    return atomic_load(&mutex->locked);
 }
 
 void
@@ -31,4 +57,12 @@ mutex_unlock(mutex_t* mutex);
 void
 mutex_unlock_for(mutex_t* mutex, pid_t pid);
 
+/**
+ * @brief 导出各类别互斥锁的争用统计至 twifs
+ * （/mutex_stat: 类别 获取 争用 阻塞）
+ *
+ */
+void
+mutex_export();
+
 #endif /* __LUNAIX_MUTEX_H */
@@ -0,0 +1,85 @@
+#ifndef __LUNAIX_RADIX_H
+#define __LUNAIX_RADIX_H
+
+#include <lunaix/types.h>
+
+#define RADIX_BITS 6
+#define RADIX_FANOUT (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_FANOUT - 1)
+
+#define RADIX_NR_TAGS 2
+
+struct radix_node
+{
+    struct radix_node* parent;
+    u32_t offset; // 在父节点中的槽位
+    u32_t count;  // 非空槽位数
+    // 叶节点：该槽位的元素带有此标记；内部节点：该子树中存在带此标记的元素
+    u64_t tags[RADIX_NR_TAGS];
+    void* slots[RADIX_FANOUT];
+};
+
+/**
+ * @brief 以数组为扇出的基数树。查找只需逐层按下标取值，并可按标记快速找出元素。
+ * 树高随所存的最大下标按需增长。
+ *
+ */
+struct radix_tree
+{
+    struct radix_node* root;
+    u32_t height;
+    int truncated; // 下标的低位被舍去的位数
+};
+
+void
+radix_init(struct radix_tree* tree, u32_t trunc_bits);
+
+void*
+radix_get(struct radix_tree* tree, u32_t index);
+
+/**
+ * @brief 设置下标 index 处的元素（非NULL）
+ *
+ * @return int 0 或 ENOMEM
+ */
+int
+radix_set(struct radix_tree* tree, u32_t index, void* data);
+
+/**
+ * @brief 移除下标 index 处的元素，连同其标记
+ *
+ * @return void* 被移除的元素
+ */
+void*
+radix_remove(struct radix_tree* tree, u32_t index);
+
+void
+radix_tag_set(struct radix_tree* tree, u32_t index, int tag);
+
+void
+radix_tag_clear(struct radix_tree* tree, u32_t index, int tag);
+
+int
+radix_tag_get(struct radix_tree* tree, u32_t index, int tag);
+
+/**
+ * @brief 按下标升序，取出自 start 起至多 max 个元素
+ *
+ * @param tag 仅取带有该标记的元素，-1 则不论标记
+ * @return u32_t 取出的数量
+ */
+u32_t
+radix_gang_lookup(struct radix_tree* tree,
+                  void** results,
+                  u32_t start,
+                  u32_t max,
+                  int tag);
+
+/**
+ * @brief 释放所有节点（不包括元素本身）
+ *
+ */
+void
+radix_release(struct radix_tree* tree);
+
+#endif /* __LUNAIX_RADIX_H */
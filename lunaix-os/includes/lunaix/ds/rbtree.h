@@ -0,0 +1,90 @@
+#ifndef __LUNAIX_RBTREE_H
+#define __LUNAIX_RBTREE_H
+
+#include <lunaix/common.h>
+#include <lunaix/types.h>
+
+/*
+    侵入式的红黑树。节点嵌入于元素之中，树本身不比较键：使用者自根起
+    查找插入的位置，以 rb_link 挂上新节点，随后调用 rb_insert 恢复平衡。
+
+    增强（augmented）的树可于每个节点上维护其子树的聚合值（如区间树中
+    子树的最大端点、地址分配器中子树的最大空隙）。为此在 rb_root 中
+    登记 update 回调，其依据节点自身及其左右子节点重新计算该节点的聚合值。
+    插入与删除时，树会对路径上的以及被旋转的节点调用它，使聚合值总是最新的。
+*/
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+struct rb_node
+{
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    int color;
+};
+
+struct rb_root
+{
+    struct rb_node* node;
+    void (*update)(struct rb_node* node);
+};
+
+#define RB_ROOT(update_fn)                                                     \
+    (struct rb_root)                                                           \
+    {                                                                          \
+        .node = NULL, .update = (update_fn)                                    \
+    }
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define rb_empty(root) (!(root)->node)
+
+/**
+ * @brief 将新节点挂于 parent 之下，link 为 parent 中空着的子节点指针
+ *  （树为空时则为 &root->node）。此后须调用 rb_insert
+ *
+ */
+static inline void
+rb_link(struct rb_node* node, struct rb_node* parent, struct rb_node** link)
+{
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+/**
+ * @brief 恢复挂上 node 后的平衡，并更新路径上的聚合值
+ *
+ */
+void
+rb_insert(struct rb_root* root, struct rb_node* node);
+
+void
+rb_erase(struct rb_root* root, struct rb_node* node);
+
+/**
+ * @brief 自 node 起向上重新计算聚合值，用于节点的键或权重改变之后
+ *
+ */
+void
+rb_propagate(struct rb_root* root, struct rb_node* node);
+
+struct rb_node*
+rb_first(struct rb_root* root);
+
+struct rb_node*
+rb_last(struct rb_root* root);
+
+struct rb_node*
+rb_next(struct rb_node* node);
+
+struct rb_node*
+rb_prev(struct rb_node* node);
+
+#define rb_for_each(root, pos)                                                 \
+    for (pos = rb_first(root); pos; pos = rb_next(pos))
+
+#endif /* __LUNAIX_RBTREE_H */
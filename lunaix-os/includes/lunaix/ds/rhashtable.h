@@ -0,0 +1,76 @@
+#ifndef __LUNAIX_RHASHTABLE_H
+#define __LUNAIX_RHASHTABLE_H
+
+#include <lunaix/ds/hashtable.h>
+
+// 平均每个桶的元素数超出此值时扩张一倍，低于其 1/8 时收缩一半
+#define RHT_LOAD_FACTOR 2U
+#define RHT_MAX_BITS 16
+
+// 每次插入或移除时顺带迁移的旧桶数
+#define RHT_MIGRATE_STEP 8
+
+/**
+ * @brief 可伸缩的散列表。
+ *
+ * 调整大小时并不一次性地将所有元素迁入新表，而是保留旧表，在此后的每次插入与
+ * 移除时迁移若干个桶，直至旧表迁移完毕后将其释放。迁移期间，旧表中编号小于
+ * migrated 的桶已迁入新表，其余的仍留在旧表中，故每个散列值的归属总是唯一的，
+ * 查找时只需检查一个桶。
+ *
+ */
+struct rhtable
+{
+    struct hbucket* buckets;
+    struct hbucket* old;
+    u32_t bits;
+    u32_t old_bits;
+    u32_t migrated;
+    u32_t count;
+    u32_t min_bits;
+    // 取得元素的（完整的）散列值，用于迁移
+    u32_t (*hashof)(struct hlist_node*);
+};
+
+int
+rhtable_init(struct rhtable* table,
+             u32_t min_bits,
+             u32_t (*hashof)(struct hlist_node*));
+
+/**
+ * @brief 摘下所有元素并释放散列表
+ *
+ */
+void
+rhtable_free(struct rhtable* table);
+
+/**
+ * @brief 取得散列值 hash 所归属的桶
+ *
+ */
+static inline struct hbucket*
+rhtable_bucket(struct rhtable* table, u32_t hash)
+{
+    if (table->old) {
+        u32_t i = hash & ((1U << table->old_bits) - 1);
+        if (i >= table->migrated) {
+            return &table->old[i];
+        }
+    }
+    return &table->buckets[hash & ((1U << table->bits) - 1)];
+}
+
+void
+rhtable_add(struct rhtable* table, struct hlist_node* node);
+
+/**
+ * @brief 将元素自散列表中移除，未在表中的元素将被忽略
+ *
+ */
+void
+rhtable_del(struct rhtable* table, struct hlist_node* node);
+
+#define rhtable_hash_foreach(table, hash, pos, n, member)                      \
+    hashtable_bucket_foreach(rhtable_bucket(table, hash), pos, n, member)
+
+#endif /* __LUNAIX_RHASHTABLE_H */
@@ -5,14 +5,28 @@
 #include "waitq.h"
 #include <stdatomic.h>
 
+/*
+    Counter based rwlock with writer preference.
+
+    Readers only bump the counter when there is neither an active nor a
+    queued writer. Once a writer is queued, incoming readers wait behind it;
+    when the writer leaves, every reader waiting at that moment is admitted
+    as one batch before the next writer, so neither side starves.
+*/
 typedef struct rwlock_s
 {
     atomic_uint readers;
-    atomic_flag writer;
+    atomic_int writer;
+    atomic_uint writers_waiting;
+    u32_t readers_waiting;
+    u32_t read_batch;
     waitq_t waiting_readers;
     waitq_t waiting_writers;
 } rwlock_t;
 
+void
+rwlock_init(rwlock_t* rwlock);
+
 void
 rwlock_begin_read(rwlock_t* rwlock);
 
@@ -0,0 +1,170 @@
+#ifndef __LUNAIX_SPINLOCK_H
+#define __LUNAIX_SPINLOCK_H
+
+#include <hal/cpu.h>
+#include <lunaix/ds/llist.h>
+#include <lunaix/types.h>
+#include <stdatomic.h>
+
+/*
+    排号自旋锁（ticket spinlock）。获取者依次领取号码，按号码顺序获得锁，
+    故争用时各处理器公平地轮流进入，不会有处理器一直抢不到。
+
+    持锁期间不可睡眠。与中断处理程序共享的数据须以 spin_lock_irqsave
+    获取锁：它在关中断之前记下中断原先的状态，释放时原样恢复，
+    因此可以嵌套使用，不会在内层释放时过早地开中断。
+
+    于 flags.h 中定义 LUNAIX_LOCKSTAT 后，同一处 spinlock_init 所初始化
+    的锁属于同一类别，按类别统计获取、争用、等待与持有的周期数，
+    导出至 twifs （/lock_stat）；同时检查同一处理器的重复获取以及
+    释放未持有的锁。统计本身不加锁，多处理器下为近似值。
+*/
+
+#ifdef LUNAIX_LOCKSTAT
+struct spinlock_class
+{
+    struct llist_header classes;
+    const char* name;
+    u32_t acquired;  // 获取次数
+    u32_t contended; // 其中未能立即获取的次数
+    u32_t max_hold;  // 最长的一次持有（周期）
+    u64_t wait;      // 累计等待（周期）
+    u64_t hold;      // 累计持有（周期）
+};
+#endif
+
+typedef struct spinlock_s
+{
+    atomic_uint next;    // 下一个待领取的号码
+    atomic_uint serving; // 当前持有锁的号码
+#ifdef LUNAIX_LOCKSTAT
+    struct spinlock_class* cls;
+    int owner; // 持有者所在处理器，-1 表示未被持有
+    u64_t since;
+#endif
+} spinlock_t;
+
+#ifdef LUNAIX_LOCKSTAT
+
+#define __SPINLOCK_STR(x) #x
+#define __SPINLOCK_LINE(x) __SPINLOCK_STR(x)
+
+#define spinlock_init(lock)                                                    \
+    ({                                                                         \
+        static struct spinlock_class __spinlock_class = {                      \
+            .name = __FILE__ ":" __SPINLOCK_LINE(__LINE__)                     \
+        };                                                                     \
+        __spinlock_init((lock), &__spinlock_class);                            \
+    })
+
+// 静态定义的锁，以变量名为类别
+#define SPINLOCK_INIT(var)                                                     \
+    {                                                                          \
+        .cls = &(struct spinlock_class){ .name = __FILE__ ":" #var },          \
+        .owner = -1                                                            \
+    }
+
+void
+__spinlock_init(spinlock_t* lock, struct spinlock_class* cls);
+
+void
+spin_lock(spinlock_t* lock);
+
+int
+spin_trylock(spinlock_t* lock);
+
+void
+spin_unlock(spinlock_t* lock);
+
+/**
+ * @brief 导出各类别自旋锁的统计至 twifs
+ * （/lock_stat: 类别 获取 争用 平均等待 平均持有 最长持有，单位为周期）
+ *
+ */
+void
+spinlock_export();
+
+#else
+
+#define SPINLOCK_INIT(var)                                                     \
+    {                                                                          \
+        0                                                                      \
+    }
+
+static inline void
+spinlock_init(spinlock_t* lock)
+{
+    atomic_init(&lock->next, 0);
+    atomic_init(&lock->serving, 0);
+}
+
+static inline void
+spin_lock(spinlock_t* lock)
+{
+    unsigned int ticket = atomic_fetch_add(&lock->next, 1);
+
+    while (atomic_load_explicit(&lock->serving, memory_order_acquire) !=
+           ticket) {
+        asm volatile("pause");
+    }
+}
+
+/**
+ * @brief 尝试获取锁，成功返回1，锁已被持有时立即返回0
+ *
+ */
+static inline int
+spin_trylock(spinlock_t* lock)
+{
+    unsigned int ticket = atomic_load(&lock->serving);
+    return atomic_compare_exchange_strong(&lock->next, &ticket, ticket + 1);
+}
+
+static inline void
+spin_unlock(spinlock_t* lock)
+{
+    // 只有持有者会修改 serving
+    unsigned int ticket =
+      atomic_load_explicit(&lock->serving, memory_order_relaxed);
+    atomic_store_explicit(&lock->serving, ticket + 1, memory_order_release);
+}
+
+static inline void
+spinlock_export()
+{
+}
+
+#endif
+
+// 仅用于文件作用域
+#define DEFINE_SPINLOCK(var) spinlock_t var = SPINLOCK_INIT(var)
+
+static inline int
+spin_locked(spinlock_t* lock)
+{
+    return atomic_load(&lock->next) != atomic_load(&lock->serving);
+}
+
+/**
+ * @brief 关中断并获取锁，返回中断原先的状态，交由 spin_unlock_irqrestore
+ *
+ */
+static inline int
+spin_lock_irqsave(spinlock_t* lock)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+    spin_lock(lock);
+    return intr;
+}
+
+static inline void
+spin_unlock_irqrestore(spinlock_t* lock, int intr)
+{
+    spin_unlock(lock);
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+#endif /* __LUNAIX_SPINLOCK_H */
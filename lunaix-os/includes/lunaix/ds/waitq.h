@@ -4,17 +4,100 @@
 #include <lunaix/ds/llist.h>
 #include <lunaix/sched.h>
 
+// 互斥等待：每次唤醒只挑选有限个此类等待者
+#define WQ_EXCLUSIVE 0x1
+// 被唤醒者已由唤醒方直接获得所等待的资源
+#define WQ_HANDOFF 0x2
+// 该等待项并非进程，而是一个 waitq_hook
+#define WQ_HOOK 0x4
+
+/*
+    于 flags.h 中定义 LUNAIX_LOCKSTAT 后，同一处 waitq_init 所初始化的等待
+    队列属于同一类别，按类别统计睡眠次数、当前与最多的睡眠者数以及阻塞的
+    周期数（自 pwait 至被 pwake 唤醒），导出至 twifs （/waitq_stat）。
+    与自旋锁的统计一样不加锁，多处理器下为近似值。
+*/
+#ifdef LUNAIX_LOCKSTAT
+struct waitq_class
+{
+    struct llist_header classes;
+    const char* name;
+    u32_t sleeps;       // 睡眠次数
+    u32_t sleepers;     // 当前的睡眠者数
+    u32_t max_sleepers; // 最多的同时睡眠者数
+    u32_t max_blocked;  // 最长的一次阻塞（周期）
+    u64_t blocked;      // 累计阻塞（周期）
+};
+#endif
+
+/*
+    waitq_t 既作为等待队列，也作为进程挂入队列的等待项（proc_info::waitqueue）。
+    flags 与 key 仅对后者有意义。
+*/
 typedef struct waitq
 {
     struct llist_header waiters;
+    u32_t flags;
+    uintptr_t key;
+#ifdef LUNAIX_LOCKSTAT
+    struct waitq_class* cls; // 作为队列：所属的类别
+    u64_t since;             // 作为等待项：开始睡眠的时刻
+#endif
 } waitq_t;
 
+/*
+    挂钩：挂入等待队列而不阻塞任何进程，队列被唤醒时调用 func（可能处于中断
+    上下文中）。挂钩不会因唤醒而被摘下，也不计入互斥等待者，须由挂入者自行摘除。
+    借此，一个进程得以同时关注多个等待队列（如 poll）。
+*/
+struct waitq_hook
+{
+    waitq_t link;
+    void (*func)(struct waitq_hook* hook);
+};
+
+#ifdef LUNAIX_LOCKSTAT
+
+#define __WAITQ_STR(x) #x
+#define __WAITQ_LINE(x) __WAITQ_STR(x)
+
+#define waitq_init(waitq)                                                      \
+    ({                                                                         \
+        static struct waitq_class __waitq_class = {                            \
+            .name = __FILE__ ":" __WAITQ_LINE(__LINE__)                        \
+        };                                                                     \
+        __waitq_init((waitq), &__waitq_class);                                 \
+    })
+
+void
+__waitq_init(waitq_t* waitq, struct waitq_class* cls);
+
+/**
+ * @brief 导出各类别等待队列的统计至 twifs
+ * （/waitq_stat: 类别 睡眠次数 当前睡眠者 最多睡眠者 平均阻塞 最长阻塞，
+ * 单位为周期）
+ *
+ */
+void
+waitq_export();
+
+#else
+
 static inline void
 waitq_init(waitq_t* waitq)
 {
     llist_init_head(&waitq->waiters);
+    waitq->flags = 0;
+    waitq->key = 0;
 }
 
+static inline void
+waitq_export()
+{
+}
+
+#endif
+
 static inline int
 waitq_empty(waitq_t* waitq)
 {
@@ -24,12 +107,57 @@ waitq_empty(waitq_t* waitq)
 void
 pwait(waitq_t* queue);
 
+static inline void
+waitq_hook_add(waitq_t* queue,
+               struct waitq_hook* hook,
+               void (*func)(struct waitq_hook*))
+{
+    hook->link.flags = WQ_HOOK;
+    hook->link.key = 0;
+    hook->func = func;
+    llist_append(&queue->waiters, &hook->link.waiters);
+}
+
+static inline void
+waitq_hook_del(struct waitq_hook* hook)
+{
+    llist_delete(&hook->link.waiters);
+}
+
+/**
+ * @brief 阻塞当前进程于 queue 上
+ *
+ * @param flags WQ_EXCLUSIVE：作为互斥等待者
+ * @param key 非零时，只有以相同的键唤醒才会被选中
+ * @return int 是否经由 pwake_handoff 直接获得了资源
+ */
+int
+pwait_ex(waitq_t* queue, u32_t flags, uintptr_t key);
+
 void
 pwake_one(waitq_t* queue);
 
 void
 pwake_all(waitq_t* queue);
 
+/**
+ * @brief 唤醒与 key 匹配（key为零则全部匹配）的所有非互斥等待者，以及至多
+ * nr_exclusive 个互斥等待者
+ *
+ * @return int 唤醒的进程数
+ */
+int
+pwake_nr(waitq_t* queue, int nr_exclusive, uintptr_t key);
+
+/**
+ * @brief 唤醒首个与 key 匹配的等待者，并告知其资源已直接移交，
+ * 使其无需再次争抢。
+ *
+ * @return struct proc_info* 被唤醒者，队列中无匹配者时为NULL
+ */
+struct proc_info*
+pwake_handoff(waitq_t* queue, uintptr_t key);
+
 #define wait_if(cond)                                                          \
     while ((cond)) {                                                           \
         sched_yieldk();                                                        \
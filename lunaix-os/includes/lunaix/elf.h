@@ -0,0 +1,72 @@
+#ifndef __LUNAIX_ELF_H
+#define __LUNAIX_ELF_H
+
+#include <lunaix/types.h>
+
+/*
+    ELF32 可执行文件的格式（仅包含载入程序所需的部分），见 System V ABI
+    及其 i386 补充文档。
+*/
+
+#define EI_NIDENT 16
+
+#define ELFMAG "\177ELF"
+#define SELFMAG 4
+
+#define EI_CLASS 4
+#define EI_DATA 5
+
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+
+#define ET_EXEC 2
+#define EM_386 3
+
+#define PT_NULL 0
+#define PT_LOAD 1
+#define PT_DYNAMIC 2
+#define PT_INTERP 3
+
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+// 辅助向量（auxv）的类型，随参数一同置于初始的用户栈上
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_ENTRY 9
+
+struct elf32_ehdr
+{
+    u8_t e_ident[EI_NIDENT];
+    u16_t e_type;
+    u16_t e_machine;
+    u32_t e_version;
+    u32_t e_entry;
+    u32_t e_phoff;
+    u32_t e_shoff;
+    u32_t e_flags;
+    u16_t e_ehsize;
+    u16_t e_phentsize;
+    u16_t e_phnum;
+    u16_t e_shentsize;
+    u16_t e_shnum;
+    u16_t e_shstrndx;
+} __attribute__((packed));
+
+struct elf32_phdr
+{
+    u32_t p_type;
+    u32_t p_offset;
+    u32_t p_vaddr;
+    u32_t p_paddr;
+    u32_t p_filesz;
+    u32_t p_memsz;
+    u32_t p_flags;
+    u32_t p_align;
+} __attribute__((packed));
+
+#endif /* __LUNAIX_ELF_H */
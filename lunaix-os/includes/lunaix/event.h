@@ -0,0 +1,141 @@
+#ifndef __LUNAIX_EVENT_H
+#define __LUNAIX_EVENT_H
+
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/types.h>
+#include <lunaix/workqueue.h>
+
+/*
+    事件：驱动与子系统之间通告“某事已发生”的统一方式。
+
+    事件的发生（event_signal）可于中断上下文中通告。每次发生都会：
+        1. 计入 count，由 event_wait 逐次取走，可用作完成量（completion）；
+        2. 调用所有监听者。监听者可直接于通告者的上下文中执行，
+           亦可指定一个工作队列，于其内核线程中执行（此时可以睡眠）；
+        3. 唤醒所有在 waiters 上等待的进程。
+
+    只关心某一条件是否成立的等待者（如多个读者共享的输入），应在屏蔽中断
+    后检查条件，不成立时以 event_sleep 等待下一次发生，而非使用计数。
+    waiters 亦可交由 poll_wait 关注。
+*/
+
+struct lx_event;
+
+typedef void (*event_fn)(struct lx_event* evt, void* arg);
+
+struct event_listener
+{
+    struct llist_header listeners;
+    struct lx_event* evt;
+    event_fn func;
+    void* arg;
+    // 非空时，于该工作队列中执行
+    struct workqueue* wq;
+    struct lx_work work;
+};
+
+struct lx_event
+{
+    waitq_t waiters;
+    struct llist_header listeners;
+    // 已发生而尚未被 event_wait 取走的次数
+    volatile u32_t count;
+};
+
+static inline void
+event_init(struct lx_event* evt)
+{
+    waitq_init(&evt->waiters);
+    llist_init_head(&evt->listeners);
+    evt->count = 0;
+}
+
+/**
+ * @brief 事件是否已发生而未被取走
+ *
+ */
+static inline int
+event_done(struct lx_event* evt)
+{
+    return !!evt->count;
+}
+
+/**
+ * @brief 清除尚未取走的发生次数，以便重新使用
+ *
+ */
+static inline void
+event_reset(struct lx_event* evt)
+{
+    evt->count = 0;
+}
+
+/**
+ * @brief 注册一个监听者
+ *
+ * @param evt
+ * @param listener 由调用者提供，于 event_unlisten 前须保持有效
+ * @param func
+ * @param arg
+ * @param wq 为NULL时，func 于通告者的上下文（可能为中断）中调用；
+ *  否则作为工作项提交至 wq，尚未执行的多次发生只执行一次
+ */
+void
+event_listen(struct lx_event* evt,
+             struct event_listener* listener,
+             event_fn func,
+             void* arg,
+             struct workqueue* wq);
+
+/**
+ * @brief 注销监听者。已提交而尚未执行的工作项仍会执行
+ *
+ */
+void
+event_unlisten(struct event_listener* listener);
+
+/**
+ * @brief 通告事件发生一次。可于中断上下文中调用
+ *
+ */
+void
+event_signal(struct lx_event* evt);
+
+/**
+ * @brief 等待事件发生，并取走一次发生。已发生时立即返回。
+ *  与 pwait 一样，返回时中断已开启
+ *
+ */
+void
+event_wait(struct lx_event* evt);
+
+/**
+ * @brief 阻塞直至事件下一次发生，不涉及计数。须于屏蔽中断后检查条件再调用，
+ *  返回时中断已开启
+ *
+ */
+static inline void
+event_sleep(struct lx_event* evt)
+{
+    pwait(&evt->waiters);
+}
+
+/**
+ * @brief 同 event_sleep，作为互斥等待者：每次发生只唤醒一个此类等待者
+ *
+ */
+static inline void
+event_sleep_exclusive(struct lx_event* evt)
+{
+    pwait_ex(&evt->waiters, WQ_EXCLUSIVE, 0);
+}
+
+/**
+ * @brief 通告事件发生一次，但至多唤醒一个互斥等待者
+ *
+ */
+void
+event_signal_one(struct lx_event* evt);
+
+#endif /* __LUNAIX_EVENT_H */
@@ -12,6 +12,12 @@ __LXSYSCALL2(int, unlinkat, int, fd, const char*, pathname)
 
 __LXSYSCALL2(int, readdir, int, fd, struct dirent*, dent)
 
+/*
+    以 fd 的文件位置为起点，批量读取目录项至 dirp，至多 count 字节。
+    返回写入的字节数，读至末尾时为零
+*/
+__LXSYSCALL3(int, getdents, int, fd, struct dirent*, dirp, unsigned int, count)
+
 __LXSYSCALL4(int,
              readlinkat,
              int,
@@ -82,4 +88,12 @@ __LXSYSCALL4(int,
              size_t,
              len)
 
+/*
+    将全部扩展属性的名称以 '\0' 分隔写入 list，返回写入的字节数。
+    size 为零时仅返回所需的大小
+*/
+__LXSYSCALL3(int, listxattr, const char*, path, char*, list, size_t, size)
+
+__LXSYSCALL3(int, flistxattr, int, fd, char*, list, size_t, size)
+
 #endif /* __LUNAIX_FCTRL_H */
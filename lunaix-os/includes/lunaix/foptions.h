@@ -4,6 +4,7 @@
 #define FO_CREATE 0x1
 #define FO_APPEND 0x2
 #define FO_DIRECT 0x4
+#define FO_NONBLOCK 0x8
 
 #define FSEEK_SET 0x1
 #define FSEEK_CUR 0x2
@@ -11,4 +12,17 @@
 
 #define MNT_RO 0x1
 
+// posix_fadvise
+#define POSIX_FADV_NORMAL 0
+#define POSIX_FADV_RANDOM 1
+#define POSIX_FADV_SEQUENTIAL 2
+#define POSIX_FADV_WILLNEED 3
+#define POSIX_FADV_DONTNEED 4
+#define POSIX_FADV_NOREUSE 5
+
+// sync_file_range
+#define SYNC_FILE_RANGE_WAIT_BEFORE 0x1
+#define SYNC_FILE_RANGE_WRITE 0x2
+#define SYNC_FILE_RANGE_WAIT_AFTER 0x4
+
 #endif /* __LUNAIX_FOPTIONS_H */
@@ -3,8 +3,9 @@
 
 #include <lunaix/clock.h>
 #include <lunaix/device.h>
-#include <lunaix/ds/btrie.h>
+#include <lunaix/ds/radix.h>
 #include <lunaix/ds/hashtable.h>
+#include <lunaix/ds/rhashtable.h>
 #include <lunaix/ds/hstr.h>
 #include <lunaix/ds/llist.h>
 #include <lunaix/ds/lru.h>
@@ -14,7 +15,9 @@
 #include <stdatomic.h>
 
 #define VFS_NAME_MAXLEN 128
-#define VFS_MAX_FD 32
+#define VFS_MAX_FD 1024
+// 初始的文件描述符表大小（须为32的倍数），打开的文件更多时按倍增长
+#define VFS_FD_INIT 32
 
 #define VFS_IFDIR 0x1
 #define VFS_IFFILE 0x2
@@ -27,14 +30,16 @@
 #define VFS_WALK_PARENT 0x4
 #define VFS_WALK_NOFOLLOW 0x8
 
+// 散列表的初始（亦是最小的）大小，此后随元素的数量伸缩
 #define VFS_HASHTABLE_BITS 10
-#define VFS_HASHTABLE_SIZE (1 << VFS_HASHTABLE_BITS)
-#define VFS_HASH_MASK (VFS_HASHTABLE_SIZE - 1)
-#define VFS_HASHBITS (32 - VFS_HASHTABLE_BITS)
 
 #define VFS_PATH_DELIM '/'
 
 #define FSTYPE_ROFS 0x1
+// 内容可在VFS之外（由内核自身）变化，不可缓存查找失败的结果
+#define FSTYPE_PSEUDO 0x2
+// 文件数据只存在于页缓存中（如 tmpfs），缓存页不可驱逐亦无需回写
+#define FSTYPE_NOBACKING 0x4
 
 #define DO_STATUS(errno) SYSCALL_ESTATUS(__current->k_status = errno)
 #define DO_STATUS_OR_RETURN(errno) ({ errno < 0 ? DO_STATUS(errno) : errno; })
@@ -71,6 +76,8 @@ struct v_inode_ops;
 struct v_fd;
 struct pcache;
 struct v_xattr_entry;
+struct poll_table;
+struct iovec;
 
 extern struct v_file_ops default_file_ops;
 extern struct v_inode_ops default_inode_ops;
@@ -95,7 +102,9 @@ struct v_superblock
     struct device* dev;
     struct v_dnode* root;
     struct filesystem* fs;
-    struct hbucket* i_cache;
+    struct rhtable i_cache;
+    u32_t pc_pages; // 该文件系统的文件所占用的页缓存页数
+    u32_t pc_quota; // pc_pages 的上限，为零则不限
     void* data;
     struct
     {
@@ -117,8 +126,8 @@ struct dir_context
 
 struct v_file_ops
 {
-    int (*write)(struct v_inode* inode, void* buffer, size_t len, size_t fpos);
-    int (*read)(struct v_inode* inode, void* buffer, size_t len, size_t fpos);
+    int (*write)(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+    int (*read)(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
 
     // for operatiosn {write|read}_page, following are true:
     //  + `len` always equals to PG_SIZE
@@ -126,13 +135,30 @@ struct v_file_ops
     // These additional operations allow underlying fs to use more specialized
     // and optimized code.
 
-    int (*write_page)(struct v_inode* inode, void* pg, size_t len, size_t fpos);
-    int (*read_page)(struct v_inode* inode, void* pg, size_t len, size_t fpos);
+    int (*write_page)(struct v_inode* inode, void* pg, size_t len, foff_t fpos);
+    int (*read_page)(struct v_inode* inode, void* pg, size_t len, foff_t fpos);
+
+    // optional. read of a sequential device through the open file, for those
+    // keeping per-open state in `v_file::data`. Preferred over read.
+    int (*read_file)(struct v_file* file,
+                     void* buffer,
+                     size_t len,
+                     foff_t fpos);
+
+    // optional. asynchronous write_page of a batch of pages in ascending file
+    // order, which the underlying device may sort and merge. Each iocb is
+    // completed through its `done`, including those failed to submit.
+    void (*submit_pages)(struct v_inode* inode,
+                         struct dev_iocb** iocbs,
+                         u32_t n);
 
     int (*readdir)(struct v_file* file, struct dir_context* dctx);
-    int (*seek)(struct v_inode* inode, size_t offset); // optional
+    int (*seek)(struct v_inode* inode, foff_t offset); // optional
     int (*close)(struct v_file* file);
     int (*sync)(struct v_file* file);
+    // optional. returns the POLL* mask that are ready now, and registers the
+    // waitqueue(s) signalling a change via poll_wait
+    int (*poll)(struct v_file* file, struct poll_table* pt);
 };
 
 struct v_inode_ops
@@ -142,7 +168,7 @@ struct v_inode_ops
     int (*sync)(struct v_inode* this);
     int (*mkdir)(struct v_inode* this, struct v_dnode* dnode);
     int (*rmdir)(struct v_inode* this, struct v_dnode* dir);
-    int (*unlink)(struct v_inode* this);
+    int (*unlink)(struct v_inode* this, struct v_dnode* name);
     int (*link)(struct v_inode* this, struct v_dnode* new_name);
     int (*read_symlink)(struct v_inode* this, const char** path_out);
     int (*set_symlink)(struct v_inode* this, const char* target);
@@ -156,24 +182,55 @@ struct v_inode_ops
                     struct v_xattr_entry* entry); // optional
     int (*delxattr)(struct v_inode* this,
                     struct v_xattr_entry* entry); // optional
+    // optional. loads every xattr of the inode into the cache (skipping those
+    // already found by xattr_getcache), via xattr_new and xattr_addcache
+    int (*listxattr)(struct v_inode* this);
 };
 
 struct v_xattr_entry
 {
     struct llist_header entries;
+    struct hlist_node hash_list;
     struct hstr name;
-    const void* value;
+    void* value; // 由 valloc 分配，随表项一并释放
     size_t len;
 };
 
+/**
+ * @brief 每个打开的文件的预读状态：顺序读取时窗口逐次加倍，随机访问时复位
+ *
+ */
+struct pcache_ra
+{
+    foff_t next;  // 若为顺序读取，下一次读取应始于的位置
+    u32_t window; // 预读窗口（页数）
+    u32_t advice; // 经由 posix_fadvise 声明的访问模式，POSIX_FADV_*
+};
+
+/**
+ * @brief 目录的遍历游标：记住下标 index 处的元素，使顺序的 readdir 无需
+ * 每次都从头数起。seq 改变（目录的成员有增删）时游标作废。
+ *
+ */
+struct dir_cursor
+{
+    int index;
+    u32_t seq;
+    struct llist_header* pos;
+};
+
 struct v_file
 {
     struct v_inode* inode;
     struct v_dnode* dnode;
     struct llist_header* f_list;
-    u32_t f_pos;
+    foff_t f_pos;
     atomic_ulong ref_count;
     struct v_file_ops* ops; // for caching
+    struct pcache_ra ra;
+    struct dir_cursor dcur;
+    void* data; // per-open state of the file system, released by close
+    int flags;  // FO_* options given to open
 };
 
 struct v_fd
@@ -207,10 +264,12 @@ struct v_inode
     u32_t open_count;
     u32_t link_count;
     u32_t lb_usage;
-    u32_t fsize;
+    foff_t fsize;
     void* data; // 允许底层FS绑定他的一些专有数据
     struct llist_header aka_dnodes;
     struct llist_header xattrs;
+    struct rhtable xattr_cache; // 按名称散列，首次缓存扩展属性时才建立
+    int xattr_listed; // 全部扩展属性均已载入缓存，未命中即为不存在
     struct v_superblock* sb;
     struct hlist_node hash_list;
     struct lru_node lru;
@@ -227,10 +286,11 @@ struct v_mount
     struct llist_header list;
     struct llist_header submnts;
     struct llist_header sibmnts;
+    struct hlist_node hash_list; // 以 (parent, mnt_point) 为键的挂载表
     struct v_mount* parent;
     struct v_dnode* mnt_point;
     struct v_superblock* super_block;
-    u32_t busy_counter;
+    atomic_uint busy_counter;
     int flags;
 };
 
@@ -248,35 +308,75 @@ struct v_dnode
     struct v_superblock* super_block;
     struct v_mount* mnt;
     atomic_ulong ref_count;
+    // 子目录项增删时（以及自身被移除时）递增两次，奇数表示正在变更
+    u32_t seq;
+
+    // vfs_get_path 的结果，path_gen 与全局的代数相符时有效
+    char* path;
+    u32_t path_len;
+    u32_t path_gen;
 
     void* data;
 };
 
+static inline u32_t
+vfs_dnode_seq_read(struct v_dnode* dnode)
+{
+    return __atomic_load_n(&dnode->seq, __ATOMIC_ACQUIRE);
+}
+
+static inline int
+vfs_dnode_seq_ok(struct v_dnode* dnode, u32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&dnode->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static inline void
+vfs_dnode_seq_bump(struct v_dnode* dnode)
+{
+    __atomic_fetch_add(&dnode->seq, 1, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * @brief 文件描述符表。bitmap 记录已被占用的描述符，
+ * 较小的表直接使用内嵌的数组，增长后改用另行分配的数组。
+ *
+ */
 struct v_fdtable
 {
-    struct v_fd* fds[VFS_MAX_FD];
+    u32_t size;
+    u32_t lowest; // 小于此的描述符均已被占用
+    u32_t* bitmap;
+    struct v_fd** fds;
+    struct v_fd* fds_inline[VFS_FD_INIT];
+    u32_t bitmap_inline[VFS_FD_INIT / 32];
 };
 
 struct pcache
 {
     struct v_inode* master;
-    struct btrie tree;
+    struct radix_tree tree;
     struct llist_header pages;
-    struct llist_header dirty;
+    struct llist_header dirty_link; // 有脏页时，挂入全局的脏缓存链表
     u32_t n_dirty;
     u32_t n_pages;
+    u32_t n_writeback; // 异步回写中的页数
+    int pinned;        // 页即是文件的全部数据，不可驱逐（见 FSTYPE_NOBACKING）
+    int wb_error;      // 回写遇到的错误，留待下一次 fsync 报告
+    waitq_t wb_wait;   // 异步回写完成时被唤醒
 };
 
 struct pcache_pg
 {
     struct llist_header pg_list;
-    struct llist_header dirty_list;
     struct lru_node lru;
     struct pcache* holder;
     void* pg;
     u32_t flags;
-    u32_t fpos;
+    foff_t fpos;
     u32_t len;
+    time_t dirtied; // 首次变脏的时刻
 };
 
 void
@@ -303,6 +403,22 @@ vfs_export_attributes();
 struct v_dnode*
 vfs_dcache_lookup(struct v_dnode* parent, struct hstr* str);
 
+/**
+ * @brief 将查找失败的 dnode 留在缓存中作为负目录项（inode 为 NULL），
+ * 此后对同名的查找可直接得到 ENOENT。文件系统不支持时，仍由调用者释放它
+ *
+ * @return int 是否已转为负目录项
+ */
+int
+vfs_dcache_negate(struct v_dnode* dnode);
+
+/**
+ * @brief 负目录项即将被赋予 inode（如经由 mkdir），令其重新成为普通的目录项
+ *
+ */
+void
+vfs_dcache_revive(struct v_dnode* dnode);
+
 void
 vfs_dcache_add(struct v_dnode* parent, struct v_dnode* dnode);
 
@@ -361,6 +477,14 @@ vfs_free_fd(struct v_fd* fd);
 int
 vfs_fsync(struct v_file* file);
 
+/**
+ * @brief 检查文件的就绪状态，并向 pt（可为NULL）登记其等待队列
+ *
+ * @return int POLL* 掩码
+ */
+int
+vfs_poll(struct v_file* file, struct poll_table* pt);
+
 void
 vfs_assign_inode(struct v_dnode* assign_to, struct v_inode* inode);
 
@@ -391,9 +515,95 @@ vfs_i_free(struct v_inode* inode);
 int
 vfs_dup_fd(struct v_fd* old, struct v_fd** new);
 
+struct v_fdtable*
+vfs_fdtable_new();
+
+/**
+ * @brief 释放描述符表本身，表中的描述符须已被关闭
+ *
+ */
+void
+vfs_fdtable_free(struct v_fdtable* table);
+
+/**
+ * @brief 扩大描述符表，使之至少可容纳 nr 个描述符
+ *
+ * @return int 0、EMFILE 或 ENOMEM
+ */
+int
+vfs_fdtable_expand(struct v_fdtable* table, u32_t nr);
+
+/**
+ * @brief 将 fd_s 置于 fd 处，fd_s 为 NULL 时则清空该处
+ *
+ */
+void
+vfs_fdtable_set(struct v_fdtable* table, int fd, struct v_fd* fd_s);
+
+/**
+ * @brief 取得不小于 from 的首个已被占用的描述符
+ *
+ * @return int 描述符，-1 表示没有更多
+ */
+int
+vfs_fdtable_next(struct v_fdtable* table, int from);
+
+#define vfs_fdtable_foreach(table, fd)                                         \
+    for (int fd = vfs_fdtable_next(table, 0); fd >= 0;                         \
+         fd = vfs_fdtable_next(table, fd + 1))
+
+/**
+ * @brief 复制 src 中的每一个描述符至 dest 的相同位置
+ *
+ */
+int
+vfs_fdtable_copy(struct v_fdtable* dest, struct v_fdtable* src);
+
+/**
+ * @brief 找出当前进程编号最小的空闲描述符，必要时扩大描述符表
+ *
+ */
+int
+vfs_alloc_fdslot(int* fd);
+
 int
 vfs_getfd(int fd, struct v_fd** fd_s);
 
+/**
+ * @brief 打开 path，并为其分配描述符。返回描述符，或负的错误码
+ *
+ */
+int
+vfs_do_open(const char* path, int options);
+
+/**
+ * @brief 关闭当前进程的描述符 fd，同 close
+ *
+ */
+int
+vfs_do_close(int fd);
+
+/**
+ * @brief 删除 path 所指的文件，同 unlink
+ *
+ */
+int
+vfs_do_unlink(const char* path);
+
+/**
+ * @brief 读写描述符 fd，同 read/write。pos 不为NULL时于该处读写，且不改变文件的位置
+ *
+ */
+int
+vfs_do_rw(int fd, struct iovec* iov, int iovcnt, foff_t* pos, int write);
+
+/**
+ * @brief 将已打开的文件置于当前进程的 fd 处（由 vfs_alloc_fdslot 取得）
+ *
+ */
+void
+vfs_install_fd(int fd, struct v_file* file, int options);
+
 int
 vfs_get_dtype(int itype);
 
@@ -406,6 +616,19 @@ vfs_unref_dnode(struct v_dnode* dnode);
 int
 vfs_get_path(struct v_dnode* dnode, char* buf, size_t size, int depth);
 
+/**
+ * @brief 建立全局的页缓存LRU（活跃与非活跃两条），并按物理内存的大小设定上限
+ *
+ */
+void
+pcache_zone_init();
+
+void
+pcache_export();
+
+void
+pcache_get_stat(u32_t* pages, u32_t* max, u32_t* dirty);
+
 void
 pcache_init(struct pcache* pcache);
 
@@ -420,15 +643,38 @@ pcache_set_dirty(struct pcache* pcache, struct pcache_pg* pg);
 
 int
 pcache_get_page(struct pcache* pcache,
-                u32_t index,
+                foff_t fpos,
                 u32_t* offset,
                 struct pcache_pg** page);
 
 int
-pcache_write(struct v_inode* inode, void* data, u32_t len, u32_t fpos);
+pcache_write(struct v_inode* inode, void* data, u32_t len, foff_t fpos);
+
+/**
+ * @brief 经由页缓存读取文件。缺页时按 ra 的预读窗口一并读入后续的页
+ *
+ * @param ra 预读状态，NULL则不预读
+ */
+int
+pcache_read(struct v_inode* inode,
+            void* data,
+            u32_t len,
+            foff_t fpos,
+            struct pcache_ra* ra);
+
+/**
+ * @brief 获取包含 fpos 的缓存页，必要时从底层文件系统读入。
+ *
+ */
+/**
+ * @brief 查找已缓存的页，不会新建或载入页
+ *
+ */
+struct pcache_pg*
+pcache_lookup(struct pcache* pcache, foff_t fpos);
 
 int
-pcache_read(struct v_inode* inode, void* data, u32_t len, u32_t fpos);
+pcache_get_filled(struct v_inode* inode, foff_t fpos, struct pcache_pg** page);
 
 void
 pcache_release(struct pcache* pcache);
@@ -436,12 +682,69 @@ pcache_release(struct pcache* pcache);
 int
 pcache_commit(struct v_inode* inode, struct pcache_pg* page);
 
-void
+/**
+ * @brief 回写文件全部的脏页，并等待其完成
+ *
+ * @return int 此前（包括此次）回写遇到的错误
+ */
+int
 pcache_commit_all(struct v_inode* inode);
 
+/**
+ * @brief 对文件 [start, end] 范围内的页缓存进行回写，flags 为 SYNC_FILE_RANGE_*
+ * 的组合。WRITE 只提交而不等待，正在回写中的页将被跳过
+ *
+ * @return int 等待（WAIT_AFTER）时，返回此前回写遇到的错误
+ */
+int
+pcache_sync_range(struct v_inode* inode, foff_t start, foff_t end, int flags);
+
+/**
+ * @brief 丢弃 [start, end] 范围内缓存的页（脏页先被回写），
+ * 用于直接I/O写入之后，以免缓存中留有旧的数据
+ *
+ */
+void
+pcache_drop_range(struct v_inode* inode, foff_t start, foff_t end);
+
+/**
+ * @brief 预先载入 [start, end] 范围内尚未缓存的页，至多占用单个文件上限的一半
+ *
+ */
+int
+pcache_prefetch(struct v_inode* inode, foff_t start, foff_t end);
+
 void
 pcache_invalidate(struct pcache* pcache, struct pcache_pg* page);
 
+/**
+ * @brief 全局的脏页总数
+ *
+ */
+u32_t
+pcache_nr_dirty();
+
+/**
+ * @brief 轮流回写各文件中于 before 之前变脏的页，跳过正被读写的文件
+ *
+ * @param before 仅回写此刻（含）之前变脏的页
+ * @param max 至多回写的页数
+ * @return u32_t 提交回写的页数，异步回写的页不等待其完成
+ */
+u32_t
+pcache_writeback(time_t before, u32_t max);
+
+/**
+ * @brief 写入后调用：脏页过多时唤醒回写线程，超出上限则由写入者（须持有 inode
+ * 的锁）同步回写自己的脏页
+ *
+ */
+void
+pcache_balance_dirty(struct v_inode* inode);
+
+void
+pcache_writeback_init();
+
 /**
  * @brief 将挂载点标记为繁忙
  *
@@ -464,21 +767,58 @@ vfs_mount_root(const char* fs_name, struct device* device);
 struct v_mount*
 vfs_create_mount(struct v_mount* parent, struct v_dnode* mnt_point);
 
+/**
+ * @brief 查找挂载于 parent 中的 dnode 之上的挂载
+ *
+ * @return struct v_mount* 不存在时为 NULL
+ */
+struct v_mount*
+vfs_mount_lookup(struct v_mount* parent, struct v_dnode* dnode);
+
+/**
+ * @brief dnode 是否为某一挂载的根
+ *
+ */
+static inline int
+vfs_is_mountpoint(struct v_dnode* dnode)
+{
+    return dnode->mnt && dnode->mnt->mnt_point == dnode;
+}
+
 int
 vfs_check_writable(struct v_dnode* dnode);
 
 int
-default_file_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos);
+default_file_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
 
 int
 default_file_write(struct v_inode* inode,
                    void* buffer,
                    size_t len,
-                   size_t fpos);
+                   foff_t fpos);
 
 int
 default_file_readdir(struct v_file* file, struct dir_context* dctx);
 
+/**
+ * @brief 取得链表 head 中下标为 index 的元素，并记入 file 的游标
+ *
+ * @param seq 链表的版本，游标仅在其未变时有效
+ * @return struct llist_header* 该元素，越界时为NULL
+ */
+struct llist_header*
+vfs_dir_seek(struct v_file* file,
+             struct llist_header* head,
+             int index,
+             u32_t seq);
+
+/**
+ * @brief 同 vfs_dir_seek，在 file 的 dnode 的子目录项中查找
+ *
+ */
+struct v_dnode*
+vfs_dir_child(struct v_file* file, int index);
+
 int
 default_inode_dirlookup(struct v_inode* this, struct v_dnode* dnode);
 
@@ -491,7 +831,7 @@ int
 default_file_close(struct v_file* file);
 
 int
-default_file_seek(struct v_inode* inode, size_t offset);
+default_file_seek(struct v_inode* inode, foff_t offset);
 
 int
 default_inode_open(struct v_inode* this, struct v_file* file);
@@ -509,6 +849,19 @@ struct v_xattr_entry*
 xattr_getcache(struct v_inode* inode, struct hstr* name);
 
 void
+xattr_free(struct v_xattr_entry* entry);
+
+int
 xattr_addcache(struct v_inode* inode, struct v_xattr_entry* xattr);
 
+void
+xattr_delcache(struct v_inode* inode, struct v_xattr_entry* xattr);
+
+/**
+ * @brief 释放 inode 所缓存的全部扩展属性
+ *
+ */
+void
+xattr_release(struct v_inode* inode);
+
 #endif /* __LUNAIX_VFS_H */
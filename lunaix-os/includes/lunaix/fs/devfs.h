@@ -1,7 +1,18 @@
 #ifndef __LUNAIX_DEVFS_H
 #define __LUNAIX_DEVFS_H
 
+struct device;
+struct v_inode;
+
 void
 devfs_init();
 
+/**
+ * @brief 获取块设备于 devfs 中的 inode，必要时建立。该 inode 由所有 devfs
+ * 挂载点共用，且不会被驱逐，其页缓存亦用作设备的缓冲缓存
+ *
+ */
+struct v_inode*
+devfs_vol_inode(struct device* dev);
+
 #endif /* __LUNAIX_DEVFS_H */
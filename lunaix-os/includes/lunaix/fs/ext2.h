@@ -0,0 +1,301 @@
+/**
+ * @file ext2.h
+ * @brief The second extended file system (revision 0 and 1).
+ *
+ * Only the base format is understood: block maps with up to triple indirect
+ * blocks, linear directories. Volumes requiring any other incompatible (or
+ * read-only compatible) feature are refused.
+ *
+ */
+#ifndef __LUNAIX_EXT2_H
+#define __LUNAIX_EXT2_H
+
+#include <lunaix/ds/mutex.h>
+#include <lunaix/fs.h>
+#include <lunaix/spike.h>
+#include <lunaix/types.h>
+
+#define EXT2_MAGIC 0xEF53
+
+#define EXT2_SB_OFFSET 1024
+#define EXT2_SB_SIZE 1024
+
+#define EXT2_ROOT_INO 2
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+#define EXT2_GOOD_OLD_FIRST_INO 11
+
+#define EXT2_VALID_FS 1
+
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+#define EXT2_TIND_BLOCK 14
+#define EXT2_N_BLOCKS 15
+
+// Features we are able to cope with
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x1
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x2
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x2
+
+#define EXT2_RO_COMPAT_SUPP                                                    \
+    (EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+#define EXT2_INCOMPAT_SUPP EXT2_FEATURE_INCOMPAT_FILETYPE
+
+// i_mode
+#define EXT2_S_IFMT 0xF000
+#define EXT2_S_IFLNK 0xA000
+#define EXT2_S_IFREG 0x8000
+#define EXT2_S_IFDIR 0x4000
+
+// file_type in directory entries
+#define EXT2_FT_UNKNOWN 0
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR 2
+#define EXT2_FT_SYMLINK 7
+
+#define EXT2_DIRENT_HDR 8
+#define EXT2_DIRENT_LEN(name_len) ROUNDUP(EXT2_DIRENT_HDR + (name_len), 4)
+
+struct ext2_superblock
+{
+    u32_t s_inodes_count;
+    u32_t s_blocks_count;
+    u32_t s_r_blocks_count;
+    u32_t s_free_blocks_count;
+    u32_t s_free_inodes_count;
+    u32_t s_first_data_block;
+    u32_t s_log_block_size;
+    u32_t s_log_frag_size;
+    u32_t s_blocks_per_group;
+    u32_t s_frags_per_group;
+    u32_t s_inodes_per_group;
+    u32_t s_mtime;
+    u32_t s_wtime;
+    u16_t s_mnt_count;
+    u16_t s_max_mnt_count;
+    u16_t s_magic;
+    u16_t s_state;
+    u16_t s_errors;
+    u16_t s_minor_rev_level;
+    u32_t s_lastcheck;
+    u32_t s_checkinterval;
+    u32_t s_creator_os;
+    u32_t s_rev_level;
+    u16_t s_def_resuid;
+    u16_t s_def_resgid;
+    // EXT2_DYNAMIC_REV
+    u32_t s_first_ino;
+    u16_t s_inode_size;
+    u16_t s_block_group_nr;
+    u32_t s_feature_compat;
+    u32_t s_feature_incompat;
+    u32_t s_feature_ro_compat;
+    u8_t s_uuid[16];
+    char s_volume_name[16];
+    char s_last_mounted[64];
+    u32_t s_algo_bitmap;
+    u8_t s_padding[820];
+} PACKED;
+
+struct ext2_gdesc
+{
+    u32_t bg_block_bitmap;
+    u32_t bg_inode_bitmap;
+    u32_t bg_inode_table;
+    u16_t bg_free_blocks_count;
+    u16_t bg_free_inodes_count;
+    u16_t bg_used_dirs_count;
+    u16_t bg_pad;
+    u8_t bg_reserved[12];
+} PACKED;
+
+// all fields fall on their natural alignment, no packing needed; this also
+// lets callers take the address of i_block
+struct ext2_inode
+{
+    u16_t i_mode;
+    u16_t i_uid;
+    u32_t i_size;
+    u32_t i_atime;
+    u32_t i_ctime;
+    u32_t i_mtime;
+    u32_t i_dtime;
+    u16_t i_gid;
+    u16_t i_links_count;
+    u32_t i_blocks; // in 512-byte sectors
+    u32_t i_flags;
+    u32_t i_osd1;
+    u32_t i_block[EXT2_N_BLOCKS];
+    u32_t i_generation;
+    u32_t i_file_acl;
+    u32_t i_dir_acl;
+    u32_t i_faddr;
+    u8_t i_osd2[12];
+};
+
+struct ext2_dirent
+{
+    u32_t inode;
+    u16_t rec_len;
+    u8_t name_len;
+    u8_t file_type;
+    char name[0];
+} PACKED;
+
+struct ext2_sb_info
+{
+    struct ext2_superblock sb;
+    struct ext2_gdesc* gdt;
+    u32_t block_size;
+    u32_t nr_groups;
+    u32_t inode_size;
+    u32_t first_ino;
+    u32_t gdt_block;
+    u32_t ptrs_per_block;
+    int filetype; // directory entries record the file type
+    // serializes namespace changes (directory contents, link counts)
+    mutex_t ns_lock;
+    // serializes bitmap and counter updates, nests inside ns_lock
+    mutex_t alloc_lock;
+};
+
+struct ext2_inode_info
+{
+    struct ext2_inode raw;
+    u32_t group;
+    u32_t last_alloc; // last data block handed out, the goal of the next one
+    int dirty;        // raw differs from the copy on disk
+    char* symlink;
+};
+
+#define EXT2_SB(vsb) ((struct ext2_sb_info*)(vsb)->data)
+#define EXT2_I(inode) ((struct ext2_inode_info*)(inode)->data)
+
+void
+ext2_init();
+
+/* ---- mount.c ---- */
+
+int
+ext2_write_sb(struct v_superblock* vsb);
+
+int
+ext2_write_gdesc(struct v_superblock* vsb, u32_t group);
+
+/**
+ * @brief Write len bytes at byte offset of the volume, retrying short writes
+ *
+ */
+int
+ext2_write_raw(struct v_superblock* vsb, void* buf, foff_t offset, size_t len);
+
+int
+ext2_read_block(struct v_superblock* vsb, u32_t block, void* buf);
+
+int
+ext2_write_block(struct v_superblock* vsb, u32_t block, void* buf);
+
+/* ---- alloc.c ---- */
+
+/**
+ * @brief Allocate a data block, preferring goal and then the rest of its
+ * group before trying the other groups.
+ *
+ * @return u32_t the block number, or 0 if the volume is full
+ */
+u32_t
+ext2_alloc_block(struct v_superblock* vsb, u32_t goal);
+
+void
+ext2_free_block(struct v_superblock* vsb, u32_t block);
+
+/**
+ * @brief Allocate an inode. Regular files go into their parent's group,
+ * directories are spread into the group with the fewest directories among
+ * those with at least the average number of free inodes.
+ *
+ * @return u32_t the inode number, or 0 if there is none left
+ */
+u32_t
+ext2_alloc_inode(struct v_superblock* vsb, u32_t parent, int is_dir);
+
+void
+ext2_free_inode(struct v_superblock* vsb, u32_t ino, int is_dir);
+
+/* ---- inode.c ---- */
+
+int
+ext2_fill_inode(struct v_inode* inode, u32_t ino);
+
+int
+ext2_write_inode(struct v_inode* inode);
+
+void
+ext2_init_inode(struct v_superblock* vsb, struct v_inode* inode);
+
+struct v_inode*
+ext2_iget(struct v_superblock* vsb, u32_t ino);
+
+/**
+ * @brief Map logical block lblk of the inode. With create set, the block (and
+ * any missing indirect one) is allocated when absent.
+ *
+ * @return int 0 on success, with *pblk being 0 for a hole
+ */
+int
+ext2_bmap(struct v_inode* inode, u32_t lblk, int create, u32_t* pblk);
+
+/**
+ * @brief Release every block of the inode
+ *
+ */
+void
+ext2_truncate(struct v_inode* inode);
+
+int
+ext2_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+
+int
+ext2_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+
+int
+ext2_read_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+
+int
+ext2_write_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+
+int
+ext2_sync(struct v_file* file);
+
+int
+ext2_read_symlink(struct v_inode* this, const char** path_out);
+
+/* ---- directory.c ---- */
+
+int
+ext2_dir_lookup(struct v_inode* this, struct v_dnode* dnode);
+
+int
+ext2_readdir(struct v_file* file, struct dir_context* dctx);
+
+int
+ext2_create(struct v_inode* this, struct v_dnode* dnode);
+
+int
+ext2_mkdir(struct v_inode* this, struct v_dnode* dnode);
+
+int
+ext2_rmdir(struct v_inode* this, struct v_dnode* dir);
+
+int
+ext2_unlink(struct v_inode* this, struct v_dnode* name);
+
+int
+ext2_link(struct v_inode* this, struct v_dnode* new_name);
+
+int
+ext2_rename(struct v_inode* from_inode,
+            struct v_dnode* from_dnode,
+            struct v_dnode* to_dnode);
+
+#endif /* __LUNAIX_EXT2_H */
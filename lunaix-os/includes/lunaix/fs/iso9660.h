@@ -14,6 +14,8 @@
 
 #include <lunaix/clock.h>
 #include <lunaix/device.h>
+#include <lunaix/ds/mutex.h>
+#include <lunaix/ds/rhashtable.h>
 #include <lunaix/fs.h>
 #include <lunaix/types.h>
 
@@ -37,6 +39,9 @@
 #define ISO9660_BLKSZ 2048
 #define ISO9660_IDLEN 256
 
+// 目录记录按名称散列的索引的初始大小，随记录的数量增长
+#define ISO9660_DIRIDX_BITS 4
+
 // NOTES:
 // Each Descriptor sized 1 logical block (2048 bytes in common cases)
 // ISO9660 store number in both-byte order. That is, for a d-bits number, it
@@ -153,7 +158,7 @@ struct iso_drecord
     u8_t xattr_len;
     iso_bbo32_t extent_addr;
     iso_bbo32_t data_size;
-    struct iso_datetime2 PACKED mktime; // Time the record is made, see 9.1.5
+    struct iso_datetime2 mktime; // Time the record is made, see 9.1.5
     u8_t flags;
     u8_t fu_sz;  // size of file unit (FU)
     u8_t gap_sz; // size of gap if FU is interleaved.
@@ -217,6 +222,7 @@ struct isosu_er
 #define ISORR_SL 0x4c53
 #define ISORR_NM 0x4d4e
 #define ISORR_TF 0x4654
+#define ISORR_ZF 0x465a
 
 #define ISORR_NM_CONT 0x1
 
@@ -263,6 +269,44 @@ struct isorr_tf
     char times[0];
 } PACKED;
 
+///
+/// -------- zisofs (透明压缩) --------
+///
+
+// 压缩算法 "pz"，即按块分别进行 zlib 压缩
+#define ISOZF_ALG_PZ 0x7a70
+#define ISOZF_MIN_BSHIFT 15
+#define ISOZF_MAX_BSHIFT 17
+
+struct isorr_zf
+{
+    struct isosu_base header;
+    u16_t algorithm;
+    u8_t hdr_size; // 以 4 字节为单位
+    u8_t bshift;   // log2(块大小)
+    iso_bbo32_t size;
+} PACKED;
+
+// 压缩文件内容的开头。其后（于 hdr_size * 4 处）是各块的起始偏移，
+//  共 块数 + 1 项，块 i 的压缩数据位于 [ptr[i], ptr[i + 1])，长度为零表示全零块
+struct isozf_header
+{
+    u8_t magic[8];
+    u32_t size;
+    u8_t hdr_size;
+    u8_t bshift;
+    u8_t reserved[2];
+} PACKED;
+
+struct iso_zf
+{
+    u32_t bshift;
+    u32_t ptr_table; // 块偏移表在区段内的偏移
+    mutex_t lock;    // 保护 cache
+    u32_t cached;    // cache 中解压的块号，-1 表示无
+    void* cache;
+};
+
 ///
 /// -------- VFS integration ---------
 ///
@@ -273,11 +317,14 @@ struct iso_inode
     u32_t fu_size;
     u32_t gap_size;
     struct llist_header drecaches;
+    struct rhtable drec_index; // 按名称索引 drecaches，供查找使用
+    struct iso_zf* zf;         // 非空则文件内容经 zisofs 压缩
 };
 
 struct iso_drecache
 {
     struct llist_header caches;
+    struct hlist_node hash_list;
     u32_t extent_addr;
     u32_t data_size;
     u32_t xattr_len;
@@ -288,8 +335,9 @@ struct iso_drecache
     time_t ctime;
     time_t atime;
     time_t mtime;
-    struct hstr name;
-    char name_val[ISO9660_IDLEN];
+    u32_t zf_size;   // 解压后的大小
+    u32_t zf_bshift; // 非零则为 zisofs 压缩的文件
+    struct hstr name; // 驻留的名称，见 hstr_intern
 };
 
 struct iso_superblock
@@ -334,13 +382,16 @@ int
 iso9660_close(struct v_file* file);
 
 int
-iso9660_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos);
+iso9660_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+
+int
+iso9660_read_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
 
 int
-iso9660_write(struct v_inode* inode, void* buffer, size_t len, size_t fpos);
+iso9660_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
 
 int
-iso9660_seek(struct v_inode* inode, size_t offset);
+iso9660_seek(struct v_inode* inode, foff_t offset);
 
 int
 isorr_parse_px(struct iso_drecache* cache, void* px_start);
@@ -348,6 +399,22 @@ isorr_parse_px(struct iso_drecache* cache, void* px_start);
 int
 isorr_parse_nm(struct iso_drecache* cache, void* nm_start);
 
+int
+isorr_parse_zf(struct iso_drecache* cache, void* zf_start);
+
+/**
+ * @brief 检查 zisofs 文件头，并将 inode 设为以解压后的内容呈现
+ *
+ */
+int
+iso9660_zf_setup(struct v_inode* inode, struct iso_drecache* dir);
+
+void
+iso9660_zf_release(struct iso_inode* isoino);
+
+int
+iso9660_zf_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos);
+
 int
 isorr_parse_tf(struct iso_drecache* cache, void* tf_start);
 
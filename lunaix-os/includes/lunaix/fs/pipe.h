@@ -0,0 +1,7 @@
+#ifndef __LUNAIX_PIPE_H
+#define __LUNAIX_PIPE_H
+
+void
+pipefs_init();
+
+#endif /* __LUNAIX_PIPE_H */
@@ -0,0 +1,7 @@
+#ifndef __LUNAIX_TMPFS_H
+#define __LUNAIX_TMPFS_H
+
+void
+tmpfs_init();
+
+#endif /* __LUNAIX_TMPFS_H */
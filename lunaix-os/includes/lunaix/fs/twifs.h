@@ -19,11 +19,16 @@ struct twifs_node
         int (*write)(struct v_inode* inode,
                      void* buffer,
                      size_t len,
-                     size_t fpos);
+                     foff_t fpos);
         int (*read)(struct v_inode* inode,
                     void* buffer,
                     size_t len,
-                    size_t fpos);
+                    foff_t fpos);
+        // 可选，需要在打开的文件上保存状态时使用
+        int (*read_file)(struct v_file* file,
+                         void* buffer,
+                         size_t len,
+                         foff_t fpos);
     } ops;
 };
 
@@ -8,6 +8,8 @@
 
 extern struct v_file_ops twimap_file_ops;
 
+struct v_file;
+
 struct twimap
 {
     void* index;
@@ -20,7 +22,22 @@ struct twimap
 };
 
 int
-twimap_read(struct twimap* map, void* buffer, size_t len, size_t fpos);
+twimap_read(struct twimap* map, void* buffer, size_t len, foff_t fpos);
+
+/**
+ * @brief 经由打开的文件读取。内容于偏移为零（或首次读取）时生成一次，
+ *  随后的读取由此继续，直至文件关闭（见 twimap_close_file）
+ *
+ */
+int
+twimap_read_file(struct twimap* map,
+                 struct v_file* file,
+                 void* buffer,
+                 size_t len,
+                 foff_t fpos);
+
+void
+twimap_close_file(struct v_file* file);
 
 void
 twimap_printf(struct twimap* mapping, const char* fmt, ...);
@@ -0,0 +1,13 @@
+#ifndef __LUNAIX_FUTEX_H
+#define __LUNAIX_FUTEX_H
+
+// 若 *uaddr == val ，则阻塞，直至被 FUTEX_WAKE 唤醒
+#define FUTEX_WAIT 0
+
+// 唤醒至多 val 个阻塞于 uaddr 上的进程，返回实际唤醒的数量
+#define FUTEX_WAKE 1
+
+void
+futex_init();
+
+#endif /* __LUNAIX_FUTEX_H */
@@ -0,0 +1,22 @@
+#ifndef __LUNAIX_IDLE_H
+#define __LUNAIX_IDLE_H
+
+#include <lunaix/timer.h>
+
+/**
+ * @brief 选择空闲方式：处理器支持时以 MONITOR/MWAIT 进入C-state，否则使用 HLT
+ *
+ */
+void
+idle_init();
+
+/**
+ * @brief 令当前处理器进入空闲，直至有中断或其就绪队列中有新的进程。
+ *  须在关中断时调用，返回时中断已打开
+ *
+ * @param ticks 预计空闲的时钟周期数（见 timer_idle_enter），用于选择C-state
+ */
+void
+idle_enter(ticks_t ticks);
+
+#endif /* __LUNAIX_IDLE_H */
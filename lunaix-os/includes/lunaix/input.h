@@ -4,7 +4,8 @@
 #include <lunaix/clock.h>
 #include <lunaix/device.h>
 #include <lunaix/ds/llist.h>
-#include <lunaix/ds/waitq.h>
+#include <lunaix/ds/spinlock.h>
+#include <lunaix/event.h>
 #include <lunaix/types.h>
 
 // event should propagate further
@@ -19,6 +20,9 @@
 // vector (e.g. mice wheel scroll, mice maneuver)
 #define PKT_VECTOR 0x3
 
+// events buffered for each reader, must be power of 2
+#define INPUT_QUEUE_LEN 64
+
 struct input_evt_pkt
 {
     u32_t pkt_type;   // packet type
@@ -31,7 +35,24 @@ struct input_device
 {
     struct device* dev_if;            // device interface
     struct input_evt_pkt current_pkt; // recieved event packet
-    waitq_t readers;                  // reader wait queue
+    struct lx_event arrival;          // signaled on every event packet
+    struct llist_header queues;       // input_evt_queue of each open
+    spinlock_t lock;                  // guards queues
+};
+
+/*
+    Every open of an input device gets its own queue, so a slow reader
+    sees every event rather than only the latest one. The event source
+    (usually an irq handler) is the only producer and the reader the only
+    consumer, hence the queue takes no lock.
+*/
+struct input_evt_queue
+{
+    struct llist_header queues;
+    struct input_evt_pkt pkts[INPUT_QUEUE_LEN];
+    volatile u32_t head; // next slot to fill, free running
+    volatile u32_t tail; // next slot to read, free running
+    u32_t dropped;       // events lost to a full queue
 };
 
 typedef int (*input_evt_cb)(struct input_device* dev);
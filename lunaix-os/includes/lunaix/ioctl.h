@@ -2,6 +2,7 @@
 #define __LUNAIX_IOCTL_H
 
 #include <lunaix/syscall.h>
+#include <lunaix/types.h>
 
 #define IOREQ(cmd, arg_num) ((((cmd)&0xffff) << 8) | ((arg_num)&0xff))
 
@@ -14,6 +15,38 @@
 #define TIOCCLSBUF IOREQ(2, 0)
 #define TIOCFLUSH IOREQ(3, 0)
 
+// 块设备：将写缓存落盘
+#define BLKFLUSH IOREQ(4, 0)
+// 块设备：丢弃（TRIM）一段数据，参数为字节偏移与长度，均须按块大小对齐
+#define BLKDISCARD IOREQ(5, 2)
+
+// 串口：设置波特率（至多 115200）
+#define SERIOSBAUD IOREQ(6, 1)
+// 串口：读取当前波特率
+#define SERIOGBAUD IOREQ(7, 0)
+
+// 原始网络设备：批量接收报文，参数为 struct netraw_pkt 数组、其长度与
+//  NETRAW_* 标志，返回收到的报文数。除非指明 NETRAW_NOWAIT，至少等到一个报文
+#define NETRAW_RECV IOREQ(8, 3)
+// 原始网络设备：批量发送报文，参数为 struct netraw_pkt 数组与其长度，
+//  返回发出的报文数。报文直接以调用者的缓冲区进行DMA，返回时均已发出
+#define NETRAW_SEND IOREQ(9, 2)
+// 原始网络设备：读取MAC地址（6字节）
+#define NETRAW_GETMAC IOREQ(10, 1)
+
+#define NETRAW_NOWAIT 0x1
+
+// 单次批量收发的报文数上限
+#define NETRAW_BATCH_MAX 32
+
+struct netraw_pkt
+{
+    void* buf;
+    // 接收时为缓冲区大小，返回后为复制的长度（超出的部分被截去）；
+    //  发送时为报文（以太网帧）的长度
+    u32_t len;
+};
+
 __LXSYSCALL2_VARG(int, ioctl, int, fd, int, req);
 
 #endif /* __LUNAIX_IOCTL_H */
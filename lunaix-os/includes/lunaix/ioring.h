@@ -0,0 +1,72 @@
+#ifndef __LUNAIX_IORING_H
+#define __LUNAIX_IORING_H
+
+#include <lunaix/syscall.h>
+#include <lunaix/types.h>
+
+/*
+    批量提交的I/O环。进程于自身的内存中放置提交队列（SQ）与完成队列（CQ），
+    经由 ioring_setup 登记后，每次 ioring_enter 即可提交多个请求、并取回多个结果。
+
+    进程向 sqes 写入请求后推进 sq_tail；内核取走请求时推进 sq_head。
+    内核向 cqes 写入结果后推进 cq_tail；进程读取结果后推进 cq_head。
+    各下标自由递增，以 (entries - 1) 取模定位，故两个队列的长度均须为2的幂。
+
+    对以 FO_DIRECT 打开、支持异步提交的块设备，带有 IORING_F_POS 的读写
+    异步进行，其余请求均于 ioring_enter 中同步完成。
+    内核保证每个取走的请求都有完成项的位置，CQ 将满时不再取走新的请求。
+*/
+
+#define IORING_OP_NOP 0
+#define IORING_OP_READ 1
+#define IORING_OP_WRITE 2
+#define IORING_OP_FSYNC 3
+#define IORING_OP_OPEN 4 // buf 为路径，len 为打开选项
+
+// 于 offset 处读写，且不改变文件的位置（同 pread/pwrite）
+#define IORING_F_POS 0x1
+
+#define IORING_MAX_ENTRIES 4096
+
+struct io_sqe
+{
+    u8_t opcode;
+    u8_t flags;
+    u16_t __rsvd;
+    int fd;
+    void* buf;
+    size_t len;
+    foff_t offset;
+    u32_t user_data; // 原样复制至对应的完成项
+};
+
+struct io_cqe
+{
+    u32_t user_data;
+    int res; // 同对应的系统调用：传输的字节数、新的描述符或0，失败时为负的错误码
+};
+
+struct io_ring
+{
+    u32_t sq_head;
+    u32_t sq_tail;
+    u32_t cq_head;
+    u32_t cq_tail;
+    u32_t sq_entries;
+    u32_t cq_entries;
+    struct io_sqe* sqes;
+    struct io_cqe* cqes;
+};
+
+/*
+    登记当前进程的I/O环，每个进程至多一个。ring 为NULL时撤销已登记的环
+*/
+__LXSYSCALL1(int, ioring_setup, struct io_ring*, ring)
+
+/*
+    取走至多 to_submit 个请求，随后等待直至至少 min_complete 个完成项可读
+    （在途的请求不足时则不再等待）。返回取走的请求数
+*/
+__LXSYSCALL2(int, ioring_enter, int, to_submit, int, min_complete)
+
+#endif /* __LUNAIX_IORING_H */
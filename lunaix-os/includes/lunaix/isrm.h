@@ -42,4 +42,31 @@ isrm_bindiv(int iv, isr_cb handler);
 isr_cb
 isrm_get(int iv);
 
+/**
+ * @brief 为中断向量附上一个上下文（通常为设备实例），
+ *  处理程序可经由 isrm_get_payload 直接取得，而无须自行查找
+ *
+ */
+void
+isrm_set_payload(int iv, ptr_t payload);
+
+ptr_t
+isrm_get_payload(const isr_param* param);
+
+/**
+ * @brief 记录一次中断的处理：计数、处理耗时（TSC周期）与到达时刻
+ *
+ * @param start 进入分发时的 TSC
+ * @param end 处理程序返回时的 TSC
+ */
+void
+isrm_account(int iv, u64_t start, u64_t end);
+
+/**
+ * @brief 导出各向量的中断统计至 twifs （/interrupts）
+ *
+ */
+void
+isrm_export();
+
 #endif /* __LUNAIX_ISRM_H */
@@ -0,0 +1,46 @@
+#ifndef __LUNAIX_KBENCH_H
+#define __LUNAIX_KBENCH_H
+
+#include <lunaix/types.h>
+
+/*
+    启动时运行的内核原语微基准。
+
+    以内核命令行选项 bench 启用：单独的 bench 运行全部基准，
+    bench=a,b 则只运行名称在列表中的基准。每个基准以 KBENCH_BATCH
+    次操作为一轮，计时（TSC）KBENCH_ROUNDS 轮，报告每次操作的
+    最少、平均与最多周期数。最少值受中断与缓存抖动的影响最小，
+    比较时应以其为准。
+
+    结果经内核日志输出（因而亦见于串口），每个基准一行：
+        KBENCH: name=<名称> n=<操作次数> min=<周期> avg=<周期> max=<周期>
+    跳过的基准为 KBENCH: name=<名称> skipped=<错误码>，前后各有一行
+    KBENCH: begin tsc_khz=<TSC频率> 与 KBENCH: end。
+*/
+
+#define KBENCH_BATCH 256
+#define KBENCH_ROUNDS 16
+
+struct kbench
+{
+    const char* name;
+    /**
+     * @brief 可选。返回非零值则跳过该基准
+     */
+    int (*setup)(struct kbench* bench);
+    /**
+     * @brief 被计时的一次操作，i 为其在本轮中的序号
+     */
+    void (*op)(struct kbench* bench, u32_t i);
+    void (*teardown)(struct kbench* bench);
+    u32_t arg;
+};
+
+/**
+ * @brief 依照命令行运行基准，未启用时什么也不做
+ *
+ */
+void
+kbench_run();
+
+#endif /* __LUNAIX_KBENCH_H */
@@ -0,0 +1,28 @@
+#ifndef __LUNAIX_KCMDLINE_H
+#define __LUNAIX_KCMDLINE_H
+
+/*
+    内核命令行，由引导程序经 multiboot info 传入，形如
+        key1 key2=value2 ...
+    以空白分隔，每项为一个选项，可带有以 '=' 给出的值。
+*/
+
+#define KCMDLINE_MAXLEN 512
+#define KCMDLINE_MAXOPTS 32
+
+/**
+ * @brief 保存并解析命令行。须在引导程序的数据被回收前调用
+ *
+ */
+void
+kcmdline_init(const char* cmdline);
+
+/**
+ * @brief 查询选项 key 的值
+ *
+ * @return const char* 选项的值；未带值的选项为空串，不存在的选项为 NULL
+ */
+const char*
+kcmdline_get(const char* key);
+
+#endif /* __LUNAIX_KCMDLINE_H */
@@ -0,0 +1,86 @@
+#ifndef __LUNAIX_KLOG_H
+#define __LUNAIX_KLOG_H
+
+#include <lunaix/ds/llist.h>
+#include <lunaix/types.h>
+
+/*
+    内核日志环（dmesg）。kprintf 只将格式化后的消息追加至环中，
+    随后由各个输出端（sink）按自身的进度成批取走，
+    故而写日志的一方不会因控制台渲染或串口传输而阻塞。
+
+    追加时不持锁，仅短暂屏蔽中断，因而可在中断上下文中使用。
+    环满时覆盖最旧的内容，落后过多的输出端将跳过被覆盖的部分。
+*/
+
+// 日志环的大小，须为 2 的幂
+#define KLOG_SIZE 16384
+
+// 输出端每次取走的最大字节数
+#define KLOG_BATCH 256
+
+struct klog_sink
+{
+    struct llist_header sinks;
+    void (*write)(struct klog_sink* sink, const char* data, size_t len);
+    // 该输出端下一个要取走的字节（自由增长的位置）
+    size_t pos;
+    // 因落后过多而未能输出的字节数
+    u32_t lost;
+    void* data;
+};
+
+/**
+ * @brief 将一段文本追加至日志环，并通知输出端
+ *
+ */
+void
+klog_append(const char* data, size_t len);
+
+struct kfmt_out;
+
+/**
+ * @brief 开始直接向日志环中写入至多 max_len 字节，期间屏蔽中断。
+ * 返回此前的中断状态，写入完毕后连同 out 交由 klog_commit
+ *
+ */
+int
+klog_begin(struct kfmt_out* out, size_t max_len);
+
+/**
+ * @brief 提交经由 klog_begin 写入的内容，恢复中断并通知输出端
+ *
+ */
+void
+klog_commit(struct kfmt_out* out, int intr);
+
+/**
+ * @brief 登记一个输出端，其将从环中最旧的内容开始输出
+ *
+ */
+void
+klog_add_sink(struct klog_sink* sink);
+
+/**
+ * @brief 此后经由系统工作队列异步地排空日志环。
+ * 在此之前，每次追加都会同步地交由各输出端。
+ *
+ */
+void
+klog_start_async();
+
+/**
+ * @brief 同步地将日志环中未输出的内容全部交由各输出端，用于崩溃前等场合
+ *
+ */
+void
+klog_flush();
+
+/**
+ * @brief 于设备文件系统中创建 klog 节点，读取即得到环中保留的内容
+ *
+ */
+void
+klog_init_dev();
+
+#endif /* __LUNAIX_KLOG_H */
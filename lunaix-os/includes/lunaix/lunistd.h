@@ -7,9 +7,11 @@
 
 __LXSYSCALL(pid_t, fork)
 
-__LXSYSCALL1(int, sbrk, void*, addr)
+__LXSYSCALL(pid_t, vfork)
 
-__LXSYSCALL1(void*, brk, unsigned long, size)
+__LXSYSCALL1(void*, sbrk, size_t, size)
+
+__LXSYSCALL1(int, brk, void*, addr)
 
 __LXSYSCALL(pid_t, getpid)
 
@@ -29,6 +31,14 @@ __LXSYSCALL2(int, kill, pid_t, pid, int, signum)
 
 __LXSYSCALL1(unsigned int, alarm, unsigned int, seconds)
 
+__LXSYSCALL1(int, nice, int, inc)
+
+__LXSYSCALL1(int, getpriority, pid_t, pid)
+
+__LXSYSCALL2(int, setpriority, pid_t, pid, int, nice)
+
+__LXSYSCALL3(int, futex, int*, uaddr, int, op, int, val)
+
 __LXSYSCALL2(int, link, const char*, oldpath, const char*, newpath)
 
 __LXSYSCALL1(int, rmdir, const char*, pathname)
@@ -37,10 +47,46 @@ __LXSYSCALL3(int, read, int, fd, void*, buf, unsigned int, count)
 
 __LXSYSCALL3(int, write, int, fd, void*, buf, unsigned int, count)
 
+/*
+    自 in_fd 向 out_fd 传送至多 count 字节，数据不经由用户空间。给出 offset 时
+    自 *offset 读取并更新之，in_fd 的偏移保持不变
+*/
+__LXSYSCALL4(int,
+             sendfile,
+             int,
+             out_fd,
+             int,
+             in_fd,
+             size_t*,
+             offset,
+             size_t,
+             count)
+
 __LXSYSCALL3(int, readlink, const char*, path, char*, buf, size_t, size)
 
 __LXSYSCALL3(int, lseek, int, fd, int, offset, int, options)
 
+/*
+    以64位的偏移定位，*offset 为相对于 options（FSEEK_*）的偏移，
+    成功后被改写为定位后的位置
+*/
+__LXSYSCALL3(int, lseek64, int, fd, int64_t*, offset, int, options)
+
+__LXSYSCALL3(int,
+             execve,
+             const char*,
+             path,
+             char* const*,
+             argv,
+             char* const*,
+             envp)
+
+__LXSYSCALL3(int, shm_create, int, key, size_t, size, int, flags)
+
+__LXSYSCALL2(void*, shm_attach, int, id, int, flags)
+
+__LXSYSCALL1(int, shm_detach, void*, addr)
+
 __LXSYSCALL1(int, unlink, const char*, pathname)
 
 __LXSYSCALL1(int, close, int, fd)
@@ -49,8 +95,43 @@ __LXSYSCALL2(int, dup2, int, oldfd, int, newfd)
 
 __LXSYSCALL1(int, dup, int, oldfd)
 
+/*
+    创建一个管道，fds[0] 为读端，fds[1] 为写端
+*/
+__LXSYSCALL1(int, pipe, int*, fds)
+
 __LXSYSCALL1(int, fsync, int, fildes)
 
+/*
+    声明对 [offset, offset + len) 范围的访问模式，advice 为 POSIX_FADV_*。
+    WILLNEED 预先载入，DONTNEED 丢弃已缓存的页；其余的则作用于整个打开的文件
+*/
+__LXSYSCALL4(int,
+             posix_fadvise,
+             int,
+             fildes,
+             int,
+             offset,
+             int,
+             len,
+             int,
+             advice)
+
+/*
+    回写 [offset, offset + nbytes) 范围内的页缓存，nbytes 为零时直至文件末尾。
+    flags 为 SYNC_FILE_RANGE_* 的组合，仅有 WRITE 时只发起回写而不等待
+*/
+__LXSYSCALL4(int,
+             sync_file_range,
+             int,
+             fildes,
+             int,
+             offset,
+             int,
+             nbytes,
+             unsigned int,
+             flags)
+
 __LXSYSCALL2(int, symlink, const char*, pathname, const char*, link_target)
 
 __LXSYSCALL1(int, chdir, const char*, path)
@@ -61,4 +142,6 @@ __LXSYSCALL2(char*, getcwd, char*, buf, size_t, size)
 
 __LXSYSCALL2(int, rename, const char*, oldpath, const char*, newpath)
 
+__LXSYSCALL1(int, isatty, int, fd)
+
 #endif /* __LUNAIX_UNISTD_H */
@@ -6,11 +6,58 @@
 #define PILE_NAME_MAXLEN 20
 
 #define PILE_CACHELINE 1
+// 不使用弹匣缓存，蛋糕的拿取与归还总是直接作用于蛋糕本身
+#define PILE_NOMAG 2
+// 蛋糕从DMA区分配
+#define PILE_DMA 4
+// 切块儿对齐至处理器缓存行（64字节），避免热点对象跨行或相互伪共享
+#define PILE_HWALIGN 8
+
+// 收缩时每个蛋糕堆保留的空闲蛋糕数量，以免刚释放便又需重新分配
+#define CAKE_FREE_RESERVE 1
+
+// 每个弹匣可容纳的切块儿数量
+#define CAKE_MAG_ROUNDS 15
 
 struct cake_pile;
 
 typedef void (*pile_cb)(struct cake_pile*, void*);
 
+/**
+ * @brief 弹匣：缓存一定数量已切好的蛋糕块儿（Bonwick, 2001）
+ *
+ */
+struct cake_magazine
+{
+    struct llist_header mags;
+    unsigned int rounds;
+    void* objs[CAKE_MAG_ROUNDS];
+};
+
+/**
+ * @brief 蛋糕堆手头的弹匣。拿取与归还所需的蛋糕块儿通常可直接在此得到满足，
+ * 无需访问蛋糕堆的链表。目前只有BSP执行内核代码（见 hal/smp.c），
+ * 故每个蛋糕堆仅此一份，而非按处理器划分。
+ *
+ */
+struct cake_mag_cache
+{
+    struct cake_magazine* loaded;
+    struct cake_magazine* previous;
+};
+
+/**
+ * @brief 弹匣仓库，存放满载与空载的弹匣
+ *
+ */
+struct cake_depot
+{
+    struct llist_header full;
+    struct llist_header empty;
+    unsigned int full_count;
+    unsigned int empty_count;
+};
+
 struct cake_pile
 {
     struct llist_header piles;
@@ -23,9 +70,19 @@ struct cake_pile
     unsigned int alloced_pieces;
     unsigned int pieces_per_cake;
     unsigned int pg_per_cake;
+    unsigned int cached_pieces;
+    unsigned int peak_pieces; // 在用（不含弹匣缓存）切块儿数量的历史峰值
+    unsigned int color_step;  // 着色的步长
+    unsigned int nr_colors;   // 可用的颜色数，由蛋糕尾部的余量决定
+    unsigned int next_color;
+    int options;
     char pile_name[PILE_NAME_MAXLEN];
 
+    struct cake_mag_cache mag_cache;
+    struct cake_depot depot;
+
     pile_cb ctor;
+    pile_cb dtor;
 };
 
 typedef unsigned int piece_index_t;
@@ -35,6 +92,7 @@ typedef unsigned int piece_index_t;
 struct cake_s
 {
     struct llist_header cakes;
+    struct cake_pile* owner;
     void* first_piece;
     unsigned int used_pieces;
     unsigned int next_free;
@@ -55,9 +113,27 @@ cake_new_pile(char* name,
               unsigned int pg_per_cake,
               int options);
 
+/**
+ * @brief 设置蛋糕堆的构造函数。
+ *  构造函数仅于新蛋糕切分时对其中每一块儿调用一次，而非每次拿取时。
+ *  拿到的蛋糕块儿总处于已构造的状态，故使用者须在归还前将其恢复至该状态
+ *  （如清空链表、等待队列），以便下次拿取时无须重新初始化。
+ *
+ * @param pile
+ * @param ctor
+ */
 void
 cake_set_constructor(struct cake_pile* pile, pile_cb ctor);
 
+/**
+ * @brief 设置蛋糕堆的析构函数，于空闲蛋糕被收缩释放时对其中每一块儿调用
+ *
+ * @param pile
+ * @param dtor
+ */
+void
+cake_set_destructor(struct cake_pile* pile, pile_cb dtor);
+
 /**
  * @brief 拿一块儿蛋糕
  *
@@ -76,6 +152,64 @@ cake_grab(struct cake_pile* pile);
 int
 cake_release(struct cake_pile* pile, void* area);
 
+/**
+ * @brief 查询一块儿蛋糕所属的蛋糕堆
+ *
+ * @param area
+ * @return struct cake_pile* 若不属于任何蛋糕堆，则为 NULL
+ */
+struct cake_pile*
+cake_query_pile(void* area);
+
+/**
+ * @brief 将蛋糕堆中所有弹匣缓存的蛋糕块儿归还至蛋糕，并释放弹匣。
+ * 用于内存紧张时。
+ *
+ * @param pile
+ */
+void
+cake_drain(struct cake_pile* pile);
+
+/**
+ * @brief 清空所有蛋糕堆的弹匣
+ *
+ */
+void
+cake_drain_all();
+
+/**
+ * @brief 蛋糕堆的内存用量（字节）
+ *
+ */
+struct cake_usage
+{
+    unsigned int alloced; // 在用切块儿
+    unsigned int free;    // 空闲切块儿，包括弹匣缓存
+    unsigned int wasted;  // 蛋糕头部、空闲表与尾部无法切分的余量
+    unsigned int peak;    // 在用字节数的历史峰值
+};
+
+void
+cake_usage(struct cake_pile* pile, struct cake_usage* usage);
+
+/**
+ * @brief 收缩蛋糕堆：将超出保留数量的空闲蛋糕归还给物理页分配器
+ *
+ * @param pile
+ * @return unsigned int 释放的页数
+ */
+unsigned int
+cake_shrink(struct cake_pile* pile);
+
+/**
+ * @brief 收缩所有蛋糕堆
+ *
+ * @param drain 是否先清空弹匣，使被缓存的切块儿所在的蛋糕也得以释放
+ * @return unsigned int 释放的页数
+ */
+unsigned int
+cake_shrink_all(int drain);
+
 void
 cake_init();
 
@@ -84,6 +218,10 @@ cake_export();
 
 /********** some handy constructor ***********/
 
+/**
+ * @brief 将新切分的蛋糕块儿清零。归还的块儿不会被再次清零
+ *
+ */
 void
 cake_ctor_zeroing(struct cake_pile* pile, void* piece);
 
@@ -0,0 +1,57 @@
+#ifndef __LUNAIX_MEMPOOL_H
+#define __LUNAIX_MEMPOOL_H
+
+#include <lunaix/ds/waitq.h>
+#include <lunaix/mm/cake.h>
+
+/*
+    内存池：在蛋糕堆之上预留一定数量的对象，保证内存紧张时仍能分配成功。
+
+    分配总是先向蛋糕堆拿取，失败后才动用预留。预留亦耗尽时，分配者将等待，
+    直至有对象归还。归还的对象优先补足预留，其余交还蛋糕堆。
+    如此，只要每个对象在有限时间内归还（如I/O请求终将完成），使用者便总能
+    取得进展，而不会因写回本可释放内存的数据时自身却无法分配而陷入死锁。
+*/
+
+// 预留耗尽时不等待，而是返回NULL。用于不可睡眠的上下文
+#define MEMPOOL_NOWAIT 0x1
+
+struct mempool
+{
+    struct cake_pile* pile;
+    unsigned int min_nr;
+    unsigned int curr_nr;
+    waitq_t wait;
+    void* reserve[0];
+};
+
+/**
+ * @brief 创建内存池，并自 pile 预先拿取 min_nr 个对象作为预留
+ *
+ * @param pile 对象所在的蛋糕堆
+ * @param min_nr 预留数量
+ * @return struct mempool*
+ */
+struct mempool*
+mempool_create(struct cake_pile* pile, unsigned int min_nr);
+
+/**
+ * @brief 自内存池分配一个对象
+ *
+ * @param pool
+ * @param flags MEMPOOL_NOWAIT
+ * @return void* 不带 MEMPOOL_NOWAIT 时总不为NULL
+ */
+void*
+mempool_alloc(struct mempool* pool, int flags);
+
+/**
+ * @brief 归还一个对象，并唤醒等待者
+ *
+ * @param pool
+ * @param obj
+ */
+void
+mempool_free(struct mempool* pool, void* obj);
+
+#endif /* __LUNAIX_MEMPOOL_H */
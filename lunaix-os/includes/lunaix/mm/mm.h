@@ -45,12 +45,31 @@ typedef struct
 #define REGION_TYPE_HEAP (3 << 16);
 #define REGION_TYPE_STACK (4 << 16);
 
+struct v_file;
+struct shm_seg;
+
 struct mm_region
 {
     struct llist_header head;
     unsigned long start;
     unsigned long end;
     unsigned int attr;
+    struct v_file* mfile; // 文件映射所对应的文件，匿名区域为NULL
+    unsigned long offset; // 区域起始处所对应的文件偏移
+    struct shm_seg* shm;  // 共享内存段的映射，其他区域为NULL
+};
+
+/**
+ * @brief 进程的区域集合。区域之间互不重叠，链表与索引均按起始地址排序。
+ *
+ */
+struct mm_regions
+{
+    struct llist_header head;
+    struct mm_region** index; // 供二分查找的有序数组
+    unsigned int nr;
+    unsigned int capacity;
+    struct mm_region* last_hit;
 };
 
 #endif /* __LUNAIX_MM_H */
@@ -0,0 +1,26 @@
+#ifndef __LUNAIX_MMAP_H
+#define __LUNAIX_MMAP_H
+
+#include <lunaix/mm/mm.h>
+#include <lunaix/mm/page.h>
+
+/**
+ * @brief 处理文件映射区域中的缺页：从页缓存中取得对应的页框并直接映射。
+ *
+ * @param region 缺页所在的区域
+ * @param va 缺页地址
+ * @param pte 对应的页表项
+ * @return int 是否成功
+ */
+int
+mmap_fault(struct mm_region* region, uintptr_t va, volatile x86_pte_t* pte);
+
+/**
+ * @brief 在映射区内寻找一段足够大的空闲地址（首次适应）
+ *
+ * @return uintptr_t 起始地址，0表示没有足够的空间
+ */
+uintptr_t
+mmap_find_free(struct mm_regions* regions, size_t size);
+
+#endif /* __LUNAIX_MMAP_H */
@@ -1,11 +1,24 @@
 #ifndef __LUNAIX_MMIO_H
 #define __LUNAIX_MMIO_H
 
+#include <lunaix/mm/page.h>
 #include <lunaix/types.h>
 
+/**
+ * @brief 以不可缓存（UC）的方式映射一段MMIO区间，适用于设备寄存器
+ *
+ */
 void*
 ioremap(uintptr_t paddr, u32_t size);
 
+/**
+ * @brief 以指定的缓存模式（PG_CACHE_*）映射一段MMIO区间。
+ *  帧缓冲等只写的大块区间宜用 PG_CACHE_WC，处理器不支持PAT时退化为UC
+ *
+ */
+void*
+ioremap_cached(uintptr_t paddr, u32_t size, pt_attr cache);
+
 void*
 iounmap(uintptr_t vaddr, u32_t size);
 
@@ -24,6 +24,9 @@
 #define PG_DIRTY(pte) ((pte & (1 << 6)) >> 6)
 #define PG_ACCESSED(pte) ((pte & (1 << 5)) >> 5)
 
+#define PG_ACCESSED_BIT (1 << 5)
+#define PG_DIRTY_BIT (1 << 6)
+
 #define IS_CACHED(entry) ((entry & 0x1))
 
 #define PG_PRESENT (0x1)
@@ -32,6 +35,33 @@
 #define PG_WRITE_THROUGH (1 << 3)
 #define PG_DISABLE_CACHE (1 << 4)
 #define PG_PDE_4MB (1 << 7)
+// 4K页表项中的PAT位。大页目录项中，该位位于第12位（PG_PDE_PAT）
+#define PG_PAT (1 << 7)
+#define PG_PDE_PAT (1 << 12)
+// 全局页（须开启CR4.PGE）：重载CR3时不会被逐出TLB，仅用于各地址空间共享的内核映射
+#define PG_GLOBAL (1 << 8)
+
+/*
+    已换出至交换区的页。页表项不存在，以软件可用位（AVL）标记，地址位存放槽位号，
+    其余属性位保持换出前的原样，换入时据此恢复。槽位0为交换区的首部，故地址位不为0，
+    不会与“已预留，待分配”的页表项混淆。
+*/
+#define PG_SWAPPED (1 << 9)
+#define PG_IS_SWAPPED(pte) (((pte) & (PG_PRESENT | PG_SWAPPED)) == PG_SWAPPED)
+#define PG_SWAP_SLOT(pte) ((u32_t)(pte) >> 12)
+#define NEW_SWAP_ENTRY(flags, slot)                                            \
+    (((slot) << 12) | ((flags) & 0xffe) | PG_SWAPPED)
+
+/*
+    缓存模式，即页表项中 PAT、PCD、PWT 三位的组合，用以索引 PAT 中的表项。
+    表项 0~3 保持上电时的默认值，表项 4 被设为写合并（见 cpu_init_pat）
+*/
+#define PG_CACHE_WB 0
+#define PG_CACHE_WT PG_WRITE_THROUGH
+#define PG_CACHE_UC_MINUS PG_DISABLE_CACHE
+#define PG_CACHE_UC (PG_DISABLE_CACHE | PG_WRITE_THROUGH)
+#define PG_CACHE_WC PG_PAT
+#define PG_CACHE_MASK (PG_PAT | PG_DISABLE_CACHE | PG_WRITE_THROUGH)
 
 #define NEW_L1_ENTRY(flags, pt_addr)                                           \
     (PG_ALIGN(pt_addr) | (((flags) | PG_WRITE_THROUGH) & 0xfff))
@@ -43,6 +73,11 @@
 #define PG_ENTRY_FLAGS(entry) ((entry)&0xFFFU)
 #define PG_ENTRY_ADDR(entry) ((entry) & ~0xFFFU)
 
+// 4MiB大页（PSE）的页目录项
+#define NEW_L1_LARGE_ENTRY(flags, pg_addr)                                     \
+    (((pg_addr)&0xFFC00000UL) | (((flags) | PG_PDE_4MB) & 0xfff))
+#define PG_LARGE_ADDR(entry) ((entry)&0xFFC00000UL)
+
 #define HAS_FLAGS(entry, flags) ((PG_ENTRY_FLAGS(entry) & (flags)) == flags)
 #define CONTAINS_FLAGS(entry, flags) (PG_ENTRY_FLAGS(entry) & (flags))
 
@@ -102,8 +137,20 @@ extern void __pg_mount_point;
 #define PG_MOUNT_3 (PG_MOUNT_BASE + 0x2000)
 #define PG_MOUNT_4 (PG_MOUNT_BASE + 0x3000)
 
+/* 临时映射槽位（kmap），位于页挂载点之后 */
+#define KMAP_BASE (PG_MOUNT_BASE + 0x10000)
+#define KMAP_SLOTS 8
+
 #define PD_REFERENCED L2_BASE_VADDR
 
+/*
+    可标记为全局页的内核地址。内核空间的页表为各地址空间所共享，唯独循环映射
+    （最后一个目录项）与页目录挂载点所见的内容随地址空间而变，须予排除。
+*/
+#define PG_GLOBAL_RANGE(va)                                                    \
+    ((va) >= KERNEL_MM_BASE && L1_INDEX(va) != PG_LAST_TABLE &&                \
+     !((va) >= PD_MOUNT_1 && (va) < PD_MOUNT_1 + MEM_4MB))
+
 #define CURPROC_PTE(vpn)                                                       \
     (&((x86_page_table*)(PD_MOUNT_1 | (((vpn)&0xffc00) << 2)))                 \
         ->entry[(vpn)&0x3ff])
@@ -2,6 +2,7 @@
 #define __LUNAIX_PMM_H
 // Physical memory manager
 
+#include <arch/x86/boot/multiboot.h>
 #include <lunaix/process.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,6 +10,9 @@
 #define PM_PAGE_SIZE 4096
 #define PM_BMP_MAX_SIZE (1024 * 1024)
 
+// 伙伴系统所支持的最大阶数，即最大连续块儿为 2^PM_MAX_ORDER 页（4MiB）
+#define PM_MAX_ORDER 10
+
 /**
  * @brief 长久页：不会被缓存，但允许释放
  *
@@ -21,13 +25,81 @@
  */
 #define PP_FGLOCKED 0x2
 
-typedef u32_t pp_attr_t;
+/**
+ * @brief 分配提示：从DMA区分配（物理地址低于16MiB）。不会被记录于页描述符中
+ *
+ */
+#define PP_GFP_DMA 0x10
+
+/**
+ * @brief 分配提示：该页用于用户空间，优先使用高端内存，且不得侵占内核的余量
+ *
+ */
+#define PP_GFP_USER 0x20
 
+#define PP_GFP_MASK (PP_GFP_DMA | PP_GFP_USER)
+
+#define PM_ZONE_DMA 0
+#define PM_ZONE_NORMAL 1
+#define PM_ZONE_HIGHMEM 2
+#define PM_NR_ZONES 3
+
+// 各区域的起始页号，均对齐至最大阶，以保证伙伴块儿不会跨越区域
+#define PM_ZONE_NORMAL_START ((16 << 20) >> 12)
+#define PM_ZONE_HIGHMEM_START ((896 << 20) >> 12)
+
+// 水位线为区域大小的 1/PM_WMARK_RATIO，且不低于 PM_WMARK_MIN 页。
+//  高水位线为其两倍：余量低于高水位线时唤醒回收线程，直至恢复
+#define PM_WMARK_RATIO 32
+#define PM_WMARK_MIN 64
+
+typedef u8_t pp_attr_t;
+
+/**
+ * @brief 物理页描述符。为了节省空间，其被压缩至8字节。
+ *
+ */
 struct pp_struct
 {
-    pid_t owner;
-    u32_t ref_counts;
-    pp_attr_t attr;
+    u16_t ref_counts;
+    union
+    {
+        struct
+        {
+            u16_t owner;
+            pp_attr_t attr;
+            // 若该页属于某块儿蛋糕，则为该页在蛋糕中的页偏移加一，否则为0
+            u8_t cake_pg;
+        };
+        // 空闲页（ref_counts为0）由伙伴系统使用，记录前后块儿的页号
+        struct
+        {
+            u32_t next : 20;
+            u32_t prev : 20;
+            u32_t order : 8;
+        } __attribute__((packed)) buddy;
+    };
+} __attribute__((packed));
+
+struct free_area
+{
+    u32_t head;
+    size_t nr_free;
+};
+
+/**
+ * @brief 物理内存区域
+ *
+ */
+struct pm_zone
+{
+    const char* name;
+    u32_t start_pg;
+    size_t managed;
+    size_t free_pages;
+    size_t wmark_low;
+    size_t wmark_high;
+    struct free_area free_areas[PM_MAX_ORDER + 1];
 };
 
 /**
@@ -87,12 +159,14 @@ void*
 pmm_alloc_cpage(pid_t owner, size_t num_pages, pp_attr_t attr);
 
 /**
- * @brief 初始化物理内存管理器
+ * @brief 初始化物理内存管理器。物理页描述符表的大小将依据可用内存而定，
+ * 并紧随内核映像之后存放。
  *
- * @param mem_upper_lim 最大可用内存地址
+ * @param map 内存映射表
+ * @param map_size 映射表的条目数
  */
 void
-pmm_init(uintptr_t mem_upper_lim);
+pmm_init(multiboot_memory_map_t* map, size_t map_size);
 
 struct pp_struct*
 pmm_query(void* pa);
@@ -109,4 +183,68 @@ pmm_free_page(pid_t owner, void* page);
 int
 pmm_ref_page(pid_t owner, void* page);
 
+/**
+ * @brief 获取伙伴系统中某一阶的空闲块儿数量
+ *
+ * @param order 阶数
+ * @return size_t
+ */
+size_t
+pmm_free_blocks(int order);
+
+/**
+ * @brief 获取物理内存区域
+ *
+ * @param zone 区域编号（PM_ZONE_*）
+ * @return struct pm_zone*
+ */
+struct pm_zone*
+pmm_zone(int zone);
+
+void
+pmm_export();
+
+void
+pmm_zero_init();
+
+/**
+ * @brief 获取全局共享的只读零页，用于匿名内存的首次读取。
+ *
+ * @return uintptr_t 零页的物理地址
+ */
+uintptr_t
+pmm_zero_page();
+
+/**
+ * @brief 分配一个已清零的用户页。优先取自空闲时预先清零的页框池，池空时才同步清零。
+ *
+ * @param owner
+ * @return uintptr_t
+ */
+uintptr_t
+pmm_alloc_zeroed(pid_t owner);
+
+/**
+ * @brief 补充预清零页框池，由空闲进程调用。
+ *
+ */
+void
+pmm_zero_refill();
+
+/**
+ * @brief 启动内存回收线程。该线程在任一区域的余量低于高水位线时被唤醒，
+ * 并按大小比例驱逐各LRU区域（页缓存、dnode、inode）中的对象。
+ * 缓存无可回收时，换出冷的匿名页（若有交换区，见 lunaix/mm/swap.h）。
+ *
+ */
+void
+pmm_reclaim_init();
+
+/**
+ * @brief 唤醒内存回收线程（若其正在等待）
+ *
+ */
+void
+pmm_reclaim_wakeup();
+
 #endif /* __LUNAIX_PMM_H */
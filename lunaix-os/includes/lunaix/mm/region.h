@@ -4,18 +4,32 @@
 #include <lunaix/mm/mm.h>
 
 void
-region_add(struct mm_region* proc,
+region_init(struct mm_regions* regions);
+
+struct mm_region*
+region_add(struct mm_regions* regions,
            unsigned long start,
            unsigned long end,
            unsigned int attr);
 
+/**
+ * @brief 移除并释放一个区域。若为文件或共享内存段的映射，则同时释放对其的引用。
+ *
+ */
+void
+region_remove(struct mm_regions* regions, struct mm_region* region);
+
 void
-region_release_all(struct mm_region* proc);
+region_release_all(struct mm_regions* regions);
 
+/**
+ * @brief 查找包含 vaddr 的区域。优先检查上一次命中的区域，否则在有序索引上二分查找。
+ *
+ */
 struct mm_region*
-region_get(struct mm_region* proc, unsigned long vaddr);
+region_get(struct mm_regions* regions, unsigned long vaddr);
 
 void
-region_copy(struct mm_region* src, struct mm_region* dest);
+region_copy(struct mm_regions* src, struct mm_regions* dest);
 
 #endif /* __LUNAIX_REGION_H */
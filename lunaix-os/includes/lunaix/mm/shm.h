@@ -0,0 +1,43 @@
+#ifndef __LUNAIX_SHM_H
+#define __LUNAIX_SHM_H
+
+#include <lunaix/types.h>
+
+/*
+    共享内存段。
+
+    段的页框于创建时一次分配，由段本身持有一个引用。映射时，段的每一页以
+    REGION_WSHARED 区域直接映射至进程的 mmap 区间，并为每个页表项增加一次引用，
+    故 fork 后父子进程仍写入同一组页框，且这些页不会被换出（引用数总大于1）。
+
+    段在其最后一个映射解除时（shm_detach、exec 或进程退出）被释放；从未映射过的段
+    则一直保留，可经由键或段号再次找到。
+*/
+
+// 以此为键创建的段总是新段，只能经由返回的段号访问
+#define SHM_PRIVATE 0
+
+// 创建或映射时的选项
+#define SHM_EXCL 0x1   // 若键已存在则失败
+#define SHM_RDONLY 0x2 // 只读映射
+
+#define SHM_MAX_SEGS 64
+#define SHM_MAX_PAGES 1024
+
+struct shm_seg;
+
+/**
+ * @brief 增加段的映射计数。复制区域时调用
+ *
+ */
+void
+shm_get(struct shm_seg* seg);
+
+/**
+ * @brief 减少段的映射计数，若已无映射则释放段及其页框。释放区域时调用
+ *
+ */
+void
+shm_put(struct shm_seg* seg);
+
+#endif /* __LUNAIX_SHM_H */
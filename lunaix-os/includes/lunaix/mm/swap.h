@@ -0,0 +1,70 @@
+#ifndef __LUNAIX_SWAP_H
+#define __LUNAIX_SWAP_H
+
+#include <lunaix/block.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/region.h>
+
+/*
+    匿名页的交换区。
+
+    交换区为 GPT 中类型为 Linux swap 的分区（若有多个，只启用第一个），按页划分
+    为槽位，槽位0保留（mkswap 写入的首部位于此处）。每个槽位有一个引用计数，
+    即指向它的页表项的数目：fork 时随页表项一同复制，页表项被移除或换入时归还。
+
+    槽位以 SWAP_CLUSTER 个为一簇。换出时同一进程中相邻的若干冷页被分配到同一簇内
+    连续的槽位，一次写出；换入时整簇一次读入，缺页地址附近、槽位落在该簇中的页表项
+    一并换入（预读）。
+
+    /sys/swap: 槽位总数 已用 换出页数 换入页数（其中经由预读的页数）
+*/
+
+// 每簇的槽位数，须为2的幂
+#define SWAP_CLUSTER 8
+
+// 槽位号存放于页表项的地址位，不可超出20位
+#define SWAP_MAX_SLOTS (1U << 20)
+
+/**
+ * @brief 若分区的类型为交换区，则启用之。由 GPT 的解析过程调用
+ *
+ * @param type 分区类型的 GUID
+ * @return int 是否已启用
+ */
+int
+swap_probe(struct block_dev* bdev, u8_t* type);
+
+/**
+ * @brief 若为换出的页表项，则增加其槽位的引用。页表项被复制时调用
+ *
+ */
+void
+swap_entry_dup(x86_pte_t pte);
+
+/**
+ * @brief 若为换出的页表项，则归还其槽位的引用。页表项被移除时调用
+ *
+ */
+void
+swap_entry_free(x86_pte_t pte);
+
+/**
+ * @brief 换入 pte 所指向的页，并预读其邻近的页。由缺页处理调用，pte 须属于当前进程
+ *
+ * @return int 是否成功，失败（I/O错误或内存不足）则缺页无法解决
+ */
+int
+swap_fault(struct mm_region* region, uintptr_t va, volatile x86_pte_t* pte);
+
+/**
+ * @brief 以时钟算法挑选冷的匿名页，换出至多 nr 页。由回收线程调用
+ *
+ * @return u32_t 实际释放的页数
+ */
+u32_t
+swap_out(u32_t nr);
+
+void
+swap_export();
+
+#endif /* __LUNAIX_SWAP_H */
@@ -0,0 +1,54 @@
+#ifndef __LUNAIX_UACCESS_H
+#define __LUNAIX_UACCESS_H
+
+#include <lunaix/common.h>
+#include <lunaix/types.h>
+
+/**
+ * @brief 异常修复表的表项。若 insn 处的指令引发了无法解决的页错误，
+ * 则页错误处理程序会将执行流转至 fixup 处，而非向进程发送 SIGSEGV。
+ *
+ */
+struct exception_entry
+{
+    uintptr_t insn;
+    uintptr_t fixup;
+};
+
+/**
+ * @brief 检查 [addr, addr + len) 是否完全位于用户空间
+ *
+ */
+static inline int
+uaccess_ok(const void* addr, size_t len)
+{
+    uintptr_t start = (uintptr_t)addr;
+    return start + len >= start && start + len <= KERNEL_MM_BASE;
+}
+
+/**
+ * @brief 从内核复制数据至用户空间。用户页的缺页会被正常处理；
+ * 若目标地址非法或无法访问，则提前终止，而不会使内核陷入SIGSEGV。
+ *
+ * @return size_t 未能复制的字节数，0表示全部复制成功
+ */
+size_t
+copy_to_user(void* to, const void* from, size_t len);
+
+/**
+ * @brief 从用户空间复制数据至内核。语义同 copy_to_user
+ *
+ * @return size_t 未能复制的字节数，0表示全部复制成功
+ */
+size_t
+copy_from_user(void* to, const void* from, size_t len);
+
+/**
+ * @brief 查找出错指令 eip 对应的修复地址
+ *
+ * @return uintptr_t 修复地址，若 eip 不在异常修复表中则为0
+ */
+uintptr_t
+uaccess_fixup(uintptr_t eip);
+
+#endif /* __LUNAIX_UACCESS_H */
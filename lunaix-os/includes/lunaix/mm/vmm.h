@@ -75,6 +75,37 @@ vmm_del_mapping(uintptr_t mnt, uintptr_t va);
 int
 vmm_lookup(uintptr_t va, v_mapping* mapping);
 
+/**
+ * @brief 检查当前地址空间中 [va, va + len) 是否均已映射且可写，
+ * 即对其写入不会引发缺页（包括写时复制）
+ *
+ */
+int
+vmm_writable(uintptr_t va, size_t len);
+
+void
+vmm_kmap_init();
+
+/**
+ * @brief 将物理页临时映射至当前处理器的一个槽位。
+ * 调用方须保证期间不会被抢占（中断已屏蔽），且以后进先出的次序解除映射。
+ *
+ * @param pa 物理页地址
+ * @return void* 映射所在的虚拟地址
+ */
+void*
+vmm_kmap_atomic(uintptr_t pa);
+
+void
+vmm_kunmap_atomic(void* va);
+
+/**
+ * @brief 复制一整页。若中断已屏蔽，则使用SSE进行拷贝。
+ *
+ */
+void
+vmm_copy_page(void* dst, void* src);
+
 /**
  * @brief (COW) 为虚拟页创建副本。
  *
@@ -84,6 +115,18 @@ vmm_lookup(uintptr_t va, v_mapping* mapping);
 void*
 vmm_dup_page(pid_t pid, void* pa);
 
+/**
+ * @brief 为fork后仍与其他进程共享的用户L2页表建立私有副本。
+ *
+ * 共享的页表在页目录中以只读的形式出现，首次写入（或修改映射）前需调用此函数。
+ *
+ * @param mnt 页目录挂载点
+ * @param l1_inx 页目录项索引
+ * @return int 是否进行了处理（该页表此前为共享的）
+ */
+int
+vmm_unshare_pt(uintptr_t mnt, u32_t l1_inx);
+
 void*
 vmm_dup_vmspace(pid_t pid);
 
@@ -119,6 +162,25 @@ vmm_next_free(uintptr_t start, int options);
 void*
 vmm_vmap(uintptr_t paddr, size_t size, pt_attr attr);
 
+/**
+ * @brief 解除由 vmm_vmap 建立的映射，并归还其所占据的虚拟地址空间
+ *
+ * @param vaddr 虚拟地址空间的基地址
+ * @param size 虚拟地址空间的大小
+ */
+void
+vmm_vunmap(uintptr_t vaddr, size_t size);
+
+void
+vmm_vmap_init();
+
+/**
+ * @brief 禁止此后再以大页建立或拆除 vmap 映射。须在第一次fork前调用
+ *
+ */
+void
+vmm_vmap_seal();
+
 void*
 vmm_v2p(void* va);
 
@@ -0,0 +1,28 @@
+#ifndef __LUNAIX_MMAN_H
+#define __LUNAIX_MMAN_H
+
+#include <lunaix/syscall.h>
+#include <lunaix/types.h>
+#include <stddef.h>
+
+#define PROT_NONE 0x0
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC 0x4
+
+#define MAP_SHARED 0x1
+#define MAP_PRIVATE 0x2
+#define MAP_FIXED 0x10
+#define MAP_ANON 0x20
+
+#define MAP_FAILED ((void*)-1)
+
+/*
+    void* mmap(void* addr, size_t length, int prot, int flags, int fd,
+               size_t offset);
+*/
+__LXSYSCALL2_VARG(void*, mmap, void*, addr, size_t, length);
+
+__LXSYSCALL2(int, munmap, void*, addr, size_t, length);
+
+#endif /* __LUNAIX_MMAN_H */
@@ -0,0 +1,83 @@
+#ifndef __LUNAIX_PERCPU_H
+#define __LUNAIX_PERCPU_H
+
+#include <hal/smp.h>
+#include <lunaix/types.h>
+
+/*
+    每个处理器各有一份的变量。
+
+    以 DEFINE_PERCPU 定义的变量置于 .data.percpu 段中（见 link/linker.ld），
+    该段本身即为0号处理器（BSP）的副本，其余处理器的副本于其启动前分配，
+    初始内容为零。每个处理器的 %fs 指向各自的数据段，其基址为该处理器的
+    副本相对于段本身的偏移，因此以 %fs 为前缀、直接以变量的地址访问，
+    即得到当前处理器的副本。
+
+    this_cpu_* 的读写为单条指令，无需关中断即与本处理器上的中断互斥；
+    仅适用于不超过32位的变量，更大的变量经由 this_cpu_ptr 访问。
+    统计用的计数器各处理器分别累加，读取时以 percpu_sum 求和。
+*/
+
+#define PERCPU_SECTION ".data.percpu"
+
+#define DEFINE_PERCPU(type, name)                                              \
+    __attribute__((section(PERCPU_SECTION))) type name
+
+#define DECLARE_PERCPU(type, name) extern type name
+
+// 各处理器的副本相对于 .data.percpu 的偏移，0号处理器为0
+extern ptr_t percpu_offset[SMP_MAX_CPU];
+
+// 已分配副本的处理器数
+extern u32_t percpu_nr_areas;
+
+DECLARE_PERCPU(ptr_t, percpu_this_offset);
+
+// 处理器编号（cpu_info的下标），即 smp_cpu_id 的返回值
+DECLARE_PERCPU(u32_t, percpu_cpu_id);
+
+#define per_cpu_ptr(var, cpu)                                                  \
+    ((typeof(&(var)))((ptr_t) & (var) + percpu_offset[cpu]))
+
+#define this_cpu_read(var)                                                     \
+    ({                                                                         \
+        typeof(var) __v;                                                       \
+        asm volatile("mov %%fs:%1, %0" : "=q"(__v) : "m"(var));                \
+        __v;                                                                   \
+    })
+
+#define this_cpu_write(var, val)                                               \
+    asm volatile("mov %1, %%fs:%0" : "=m"(var) : "q"((typeof(var))(val)))
+
+#define this_cpu_add(var, val)                                                 \
+    asm volatile("add %1, %%fs:%0" : "+m"(var) : "q"((typeof(var))(val)))
+
+#define this_cpu_inc(var) this_cpu_add(var, 1)
+
+#define this_cpu_ptr(var)                                                      \
+    ((typeof(&(var)))((ptr_t) & (var) + this_cpu_read(percpu_this_offset)))
+
+#define percpu_sum(var)                                                        \
+    ({                                                                         \
+        typeof(var) __sum = 0;                                                 \
+        for (u32_t __i = 0; __i < percpu_nr_areas; __i++) {                    \
+            __sum += *per_cpu_ptr(var, __i);                                   \
+        }                                                                      \
+        __sum;                                                                 \
+    })
+
+/**
+ * @brief 为处理器 cpu 分配副本并设置其数据段。须在其启动前由BSP调用
+ *
+ */
+int
+percpu_setup_cpu(u32_t cpu);
+
+/**
+ * @brief 于当前处理器上载入其数据段
+ *
+ */
+void
+percpu_load(u32_t cpu);
+
+#endif /* __LUNAIX_PERCPU_H */
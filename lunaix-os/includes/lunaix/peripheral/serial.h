@@ -1,6 +1,8 @@
 #ifndef __LUNAIX_SERIAL_H
 #define __LUNAIX_SERIAL_H
 
+#include <lunaix/ds/fifo.h>
+#include <lunaix/ds/waitq.h>
 #include <lunaix/types.h>
 
 #define SERIAL_COM1 0x3f8
@@ -14,6 +16,17 @@
 #define BAUD_38400 3
 #define BAUD_9600 12
 
+// UART clock 1.8432MHz / 16, the baud rate at divisor 1
+#define SERIAL_BAUD_MAX 115200
+#define SERIAL_BAUD_DEFAULT 115200
+
+// Sizes of the rx/tx rings, must be powers of 2
+#define SERIAL_RXBUF_SIZE 1024
+#define SERIAL_TXBUF_SIZE 4096
+
+// Depth of the 16550 tx FIFO, the most we can feed per THRE interrupt
+#define SERIAL_TX_FIFO_DEPTH 16
+
 #define COM_RRXTX(port) (port)
 #define COM_RIE(port) (port + 1)
 #define COM_RCFIFO(port) (port + 2)
@@ -22,9 +35,81 @@
 #define COM_RSLINE(port) (port + 5)
 #define COM_RSMODEM(port) (port + 6)
 
+// Reading COM_RCFIFO gives the interrupt identification register
+#define COM_RIIR(port) (port + 2)
+
+#define UART_IER_RDA 0x1  // rx data available
+#define UART_IER_THRE 0x2 // tx holding register empty
+#define UART_IER_RLS 0x4  // line status
+
+#define UART_IIR_NOPEND 0x1
+#define UART_IIR_ID(iir) (((iir) >> 1) & 0x7)
+#define UART_IIR_MSR 0x0
+#define UART_IIR_THRE 0x1
+#define UART_IIR_RDA 0x2
+#define UART_IIR_RLS 0x3
+#define UART_IIR_TIMEOUT 0x6
+
+#define UART_LSR_DR 0x01
+#define UART_LSR_THRE 0x20
+
+/**
+ * @brief An interrupt driven UART. The irq handler is the producer of rxbuf
+ * and the consumer of txbuf, both SPSC rings; writers to txbuf serialize
+ * among themselves by disabling interrupts.
+ *
+ */
+struct serial_port
+{
+    uintptr_t base;
+    int irq;
+    u32_t baud;
+    struct fifo_buf rxbuf;
+    struct fifo_buf txbuf;
+    waitq_t rx_wait;
+    // THRE interrupt enabled, txbuf is being drained by the irq handler
+    volatile int tx_active;
+    // Bytes dropped on a full rxbuf
+    u32_t rx_dropped;
+    struct device* dev;
+};
+
 void
 serial_init();
 
+/**
+ * @brief Switch the ports not claimed by the debugger to interrupt driven
+ * I/O and expose them as character devices.
+ *
+ */
+void
+serial_init_async();
+
+/**
+ * @brief Set the baud rate of a port
+ *
+ * @return int 0, or EINVAL if the rate cannot be derived from the UART clock
+ */
+int
+serial_set_baud(uintptr_t port, u32_t baud);
+
+/**
+ * @brief Queue data for transmission and return without waiting for the
+ * line. Safe in interrupt context. Whatever does not fit in txbuf is dropped.
+ *
+ * @return size_t Bytes queued
+ */
+size_t
+serial_write_async(struct serial_port* sport, const void* data, size_t len);
+
+/**
+ * @brief The interrupt driven port at given base, or NULL if it is not
+ * running in that mode
+ *
+ */
+struct serial_port*
+serial_get_port(uintptr_t port);
+
 char
 serial_rx_byte(uintptr_t port);
 
@@ -34,8 +119,13 @@ serial_rx_buffer(uintptr_t port, char* data, size_t len);
 void
 serial_tx_byte(uintptr_t port, char data);
 
+/**
+ * @brief Polled transmission that feeds the tx FIFO in bursts. For callers
+ * that run with interrupts off, such as the debugger
+ *
+ */
 void
-serial_tx_buffer(uintptr_t port, char* data, size_t len);
+serial_tx_buffer(uintptr_t port, const char* data, size_t len);
 
 void
 serial_clear_fifo(uintptr_t port);
@@ -0,0 +1,65 @@
+#ifndef __LUNAIX_POLL_H
+#define __LUNAIX_POLL_H
+
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/syscall.h>
+#include <lunaix/types.h>
+
+#define POLLIN 0x1   // 有数据可读
+#define POLLPRI 0x2  // 有紧急数据可读
+#define POLLOUT 0x4  // 可写而不阻塞
+#define POLLERR 0x8  // 出错（总是报告）
+#define POLLHUP 0x10 // 对端已关闭（总是报告）
+#define POLLNVAL 0x20 // fd 无效（总是报告）
+
+// 不支持 poll 的文件（如普通文件）总被视为可读可写
+#define POLL_DEFAULT_MASK (POLLIN | POLLOUT)
+
+struct pollfd
+{
+    int fd;
+    short events;
+    short revents;
+};
+
+struct lx_timer;
+
+struct poll_entry
+{
+    struct waitq_hook hook;
+    struct llist_header entries;
+    struct poll_table* table;
+};
+
+/**
+ * @brief 一次 poll 调用所关注的全部等待队列。
+ *
+ * 首轮检查时，各文件经由 poll_wait 将其等待队列登记于此（挂入一个挂钩），
+ * 其后任意一个队列被唤醒，都将唤醒等待于 wait 上的调用者，令其重新检查。
+ *
+ */
+struct poll_table
+{
+    struct llist_header entries;
+    waitq_t wait;
+    struct lx_timer* timer;
+    int registering;
+    int triggered;
+    int timed_out;
+};
+
+/**
+ * @brief 供文件的 poll 操作使用，登记其就绪状态改变时将被唤醒的等待队列
+ *
+ */
+void
+poll_wait(struct poll_table* pt, waitq_t* queue);
+
+/*
+    等待 fds 中的任意一个就绪，或超过 timeout 毫秒。timeout 为负则不限时，
+    为零则仅检查一次而不阻塞。返回就绪的 fd 数
+*/
+__LXSYSCALL3(int, poll, struct pollfd*, fds, int, nfds, int, timeout)
+
+#endif /* __LUNAIX_POLL_H */
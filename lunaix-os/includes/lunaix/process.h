@@ -2,6 +2,7 @@
 #define __LUNAIX_PROCESS_H
 
 #include <arch/x86/interrupts.h>
+#include <hal/pmc.h>
 #include <lunaix/clock.h>
 #include <lunaix/ds/waitq.h>
 #include <lunaix/fs.h>
@@ -24,26 +25,67 @@
 #define PROC_TERMINATED(state) (state & 0x6)
 
 #define PROC_FINPAUSE 1
+#define PROC_FVFORK 2
+#define PROC_FKTHREAD 4
+#define PROC_FFPU 8 // 进程曾使用过x87/SSE，其FPU状态不再是初始状态
 
 struct proc_mm
 {
     heap_context_t u_heap;
-    struct mm_region regions;
+    struct mm_regions regions;
+    uintptr_t last_fault; // 上一次匿名缺页所映射的页，用于识别顺序访问
 };
 
 struct proc_sigstate
 {
     isr_param proc_regs;
-    char fxstate[512] __attribute__((aligned(16)));
+    char fxstate[0] __attribute__((aligned(16))); // fpu_state_size 字节
 };
 
+// 信号帧中未保存FPU状态（进程未曾使用FPU），fxstate不在帧内
+#define SIGFRAME_NOFPU 0x1
+
 struct proc_sig
 {
     void* signal_handler;
     int sig_num;
+    int sig_flags;
     struct proc_sigstate prev_context;
 } __attribute__((packed));
 
+#define SIGFRAME_LIGHT_SIZE                                                    \
+    __builtin_offsetof(struct proc_sig, prev_context.fxstate)
+
+struct proc_stat
+{
+    ticks_t utime;     // 用户态所耗的时钟周期数
+    ticks_t stime;     // 内核态所耗的时钟周期数
+    u32_t nvcsw;       // 主动让出（阻塞、休眠、yield）的次数
+    u32_t nivcsw;      // 被抢占的次数
+    u64_t wait_ns;     // 于就绪队列中等待的总时长
+    u64_t ready_since; // 最近一次入队的时刻，未入队时为0
+    u64_t pmc[PMC_NR]; // 各性能事件的计数，见 hal/pmc.h
+};
+
+// 每个进程可持有的间隔定时器数量
+#define PROC_TIMER_MAX 4
+
+struct proc_timer
+{
+    struct lx_timer* timer; // 未启动（或已到期的一次性定时器）时为NULL
+    struct proc_info* owner;
+    int signum; // 到期时发送的信号，为0表示该槽位空闲
+    int clockid;
+    ticks_t interval;
+};
+
+// 每个进程可同时持有的异步I/O请求数量
+#define PROC_AIO_MAX 8
+
+struct aio_ctl;
+struct ioring_ctx;
+struct scstat;
+
 struct proc_info
 {
     /*
@@ -64,6 +106,7 @@ struct proc_info
     /* ---- critical section end ---- */
 
     struct llist_header tasks;
+    struct llist_header sched_node;
     struct llist_header siblings;
     struct llist_header children;
     struct llist_header grp_member;
@@ -71,11 +114,16 @@ struct proc_info
 
     struct
     {
-        struct llist_header sleepers;
+        struct lx_timer* wakeup_timer;
+        struct lx_timer* alarm_timer;
         time_t wakeup_time;
         time_t alarm_time;
     } sleep;
 
+    struct proc_timer timers[PROC_TIMER_MAX];
+    struct aio_ctl* aio[PROC_AIO_MAX];
+    struct ioring_ctx* ioring; // 经由 ioring_setup 登记的I/O环
+
     struct proc_mm mm;
     time_t created;
     uint8_t state;
@@ -85,10 +133,15 @@ struct proc_info
     sigset_t sig_mask;
     sigset_t sig_inprogress;
     int flags;
+    int nice;
+    int preempt_count;
+    struct proc_stat stat;
+    struct scstat* scstat; // 各系统调用的统计，见 lunaix/scstat.h
     void* sig_handler[_SIG_NUM];
     struct v_fdtable* fdtable;
     struct v_dnode* cwd;
     pid_t pgid;
+    waitq_t vfork_wait;
 };
 
 extern volatile struct proc_info* __current;
@@ -126,7 +179,7 @@ commit_process(struct proc_info* process);
 pid_t
 destroy_process(pid_t pid);
 
-void
+int
 setup_proc_mem(struct proc_info* proc, uintptr_t kstack_from);
 
 /**
@@ -136,6 +189,32 @@ setup_proc_mem(struct proc_info* proc, uintptr_t kstack_from);
 pid_t
 dup_proc();
 
+/**
+ * @brief 创建一个与当前进程共享用户地址空间的子进程（类 vfork (unix) 实现）。
+ * 父进程将被挂起，直至子进程退出。
+ *
+ */
+pid_t
+vfork_proc();
+
+/**
+ * @brief 创建一个内核线程。其运行于内核态，拥有独立的内核栈与仅含内核空间的页表，
+ * 不接收信号，且永不退出。
+ *
+ * @param entry 线程入口
+ * @param arg 传递给入口的参数
+ * @return struct proc_info*
+ */
+struct proc_info*
+spawn_kthread(void (*entry)(void*), void* arg);
+
+/**
+ * @brief 导出fork耗时统计至 twifs （/forkstat: 次数 最近 最大 平均(千周期)）
+ *
+ */
+void
+fork_export();
+
 /**
  * @brief 创建新进程（LunaixOS的类 CreateProcess (Windows) 实现）
  *
@@ -150,10 +229,38 @@ new_proc();
 void
 terminate_proc(int exit_code);
 
+/**
+ * @brief 撤销并释放进程持有的全部间隔定时器
+ *
+ */
+void
+proc_release_timers(struct proc_info* proc);
+
+/**
+ * @brief 释放进程持有的全部异步I/O请求。尚未完成的请求将于完成时自行释放
+ *
+ */
+void
+proc_release_aio(struct proc_info* proc);
+
+/**
+ * @brief 撤销进程登记的I/O环。尚有在途的请求时，环于最后一个请求完成时释放
+ *
+ */
+void
+proc_release_ioring(struct proc_info* proc);
+
 int
 orphaned_proc(pid_t pid);
 
 struct proc_info*
 get_process(pid_t pid);
 
+/**
+ * @brief 取得 PID 不小于 pid 的进程中 PID 最小的一个，用于按 PID 顺序遍历
+ *
+ */
+struct proc_info*
+get_next_process(pid_t pid);
+
 #endif /* __LUNAIX_PROCESS_H */
@@ -0,0 +1,72 @@
+#ifndef __LUNAIX_PROFILER_H
+#define __LUNAIX_PROFILER_H
+
+#include <arch/x86/interrupts.h>
+#include <lunaix/types.h>
+
+/*
+    采样分析器（于 flags.h 中定义 LUNAIX_PROFILER 以启用）。
+
+    每次定时器中断时记录被中断处的EIP，若中断发生于内核态，另沿帧指针
+    回溯至多 PROF_DEPTH 层调用者的返回地址。样本存于各处理器自己的环形
+    缓冲区中，满后覆盖最早的样本。回溯要求内核以 -fno-omit-frame-pointer
+    编译（见 config/make-cc），否则只有EIP可信。
+
+    运行时经由 /profile/enable 写入1/0开启或关闭（开启时清空缓冲区），
+    或于内核命令行给出 prof 以在启动时即开启。样本经 /profile/cpu<N>
+    读取，每行一个：
+        <pid> <k|u> <eip> [<返回地址> ...]
+    地址均为十六进制。scripts/prof_symbolize.py 以内核ELF将其符号化，
+    输出各函数的样本数及可用于火焰图的折叠调用栈。
+*/
+
+#define PROF_DEPTH 8
+#define PROF_NR_SAMPLES 2048
+
+struct prof_sample
+{
+    u32_t seq;
+    u32_t pid;
+    u32_t eip;
+    u8_t user;
+    u8_t depth;
+    u32_t frames[PROF_DEPTH];
+};
+
+struct prof_ring
+{
+    u32_t head;
+    struct prof_sample samples[PROF_NR_SAMPLES];
+};
+
+#ifdef LUNAIX_PROFILER
+
+/**
+ * @brief 于定时器中断中调用，记录一个样本
+ *
+ */
+void
+profiler_sample(const isr_param* param);
+
+/**
+ * @brief 导出控制与样本至 twifs，并依照命令行决定是否开启
+ *
+ */
+void
+profiler_init();
+
+#else
+
+static inline void
+profiler_sample(const isr_param* param)
+{
+}
+
+static inline void
+profiler_init()
+{
+}
+
+#endif
+
+#endif /* __LUNAIX_PROFILER_H */
@@ -0,0 +1,38 @@
+#ifndef __LUNAIX_RAND_H
+#define __LUNAIX_RAND_H
+
+#include <lunaix/types.h>
+
+/*
+    内核随机数发生器。
+
+    熵池收集 RDSEED/RDRAND（若可用）、TSC 与中断到达的时刻，
+    并定期注入 ChaCha20 的密钥。输出由 ChaCha20 以内存的速度生成，
+    每次取用后即以新生成的密钥覆盖旧密钥（fast key erasure），
+    因而即便状态泄漏也无法反推此前的输出。
+*/
+
+// 熵池中累积多少个样本后，下一次取用前重新注入密钥
+#define RAND_RESEED_SAMPLES 64
+
+// 每批生成的 ChaCha20 块数，期间中断保持开启
+#define RAND_BATCH_BLOCKS 16
+
+void
+rand_init();
+
+/**
+ * @brief 向熵池中混入一个样本。开销很小，可于中断上下文中调用
+ *
+ */
+void
+rand_add_entropy(u32_t sample);
+
+/**
+ * @brief 以密码学安全的随机字节填充缓冲区
+ *
+ */
+void
+rand_bytes(void* buf, size_t len);
+
+#endif /* __LUNAIX_RAND_H */
@@ -1,16 +1,44 @@
 #ifndef __LUNAIX_SCHEDULER_H
 #define __LUNAIX_SCHEDULER_H
 
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/radix.h>
+#include <lunaix/types.h>
+
 #define SCHED_TIME_SLICE 300
 
-#define PROC_TABLE_SIZE 8192
-#define MAX_PROCESS (PROC_TABLE_SIZE / sizeof(uintptr_t))
+// PID 的上限（不含）。进程表按需增长，此值仅受限于物理页的 owner（u16_t），
+//  以及 taskfs 的 inode 编号中 PID 所占的位数
+#define MAX_PROCESS 32768
+
+// 进程的nice值范围，nice值越小，优先级越高
+#define SCHED_NICE_MIN -20
+#define SCHED_NICE_MAX 19
+
+#define SCHED_NR_PRIO (SCHED_NICE_MAX - SCHED_NICE_MIN + 1)
+#define SCHED_PRIO(nice) ((nice)-SCHED_NICE_MIN)
+
+#define SCHED_PRIO_WORDS ((SCHED_NR_PRIO + 31) / 32)
+
+struct proc_info;
 
 struct scheduler
 {
-    struct proc_info** _procs;
-    int procs_index;
+    // 进程表：PID 到进程的映射，以基数树实现，随 PID 的增大按需增长
+    struct radix_tree procs;
+    // 分配过的最大 PID 加一
     unsigned int ptable_len;
+    // 下次分配 PID 时开始查找的位置
+    pid_t next_pid;
+
+    // 就绪队列：每个优先级一个先进先出的链表，位图标记了哪些链表非空
+    u32_t prio_map[SCHED_PRIO_WORDS];
+    struct llist_header runq[SCHED_NR_PRIO];
+    // 就绪的进程数
+    u32_t nr_ready;
+
+    // 有更应运行的进程（更高优先级的进程被唤醒，或时间片用尽）
+    volatile int need_resched;
 };
 
 void
@@ -22,4 +50,60 @@ schedule();
 void
 sched_yieldk();
 
+/**
+ * @brief 将进程置为就绪，并加入其优先级所对应的就绪队列的末尾
+ *
+ * @param proc
+ */
+void
+sched_enqueue(struct proc_info* proc);
+
+/**
+ * @brief 将进程移出就绪队列
+ *
+ * @param proc
+ */
+void
+sched_dequeue(struct proc_info* proc);
+
+/**
+ * @brief 于时钟中断中调用：若需要重新调度，且被中断的上下文允许抢占，则进行调度
+ *
+ */
+void
+sched_preempt();
+
+/**
+ * @brief 于时钟中断中调用：将时钟周期计入当前进程的用户态或内核态时间
+ *
+ * @param user 被中断的是否为用户态
+ */
+void
+sched_account_ticks(int user, u32_t ticks);
+
+/**
+ * @brief 禁止当前进程在内核中被抢占，可嵌套
+ *
+ */
+void
+preempt_disable();
+
+void
+preempt_enable();
+
+/**
+ * @brief 是否有待处理的调度请求，且当前允许抢占
+ *
+ */
+int
+preempt_needed();
+
+/**
+ * @brief 抢占点。在耗时较长的内核路径中调用，以便及时让出处理器给被唤醒的
+ * 高优先级进程。调用前后的中断状态保持不变。
+ *
+ */
+void
+preempt_point();
+
 #endif /* __LUNAIX_SCHEDULER_H */
@@ -0,0 +1,53 @@
+#ifndef __LUNAIX_SCSTAT_H
+#define __LUNAIX_SCSTAT_H
+
+#include <lunaix/types.h>
+
+/*
+    系统调用的统计（于 flags.h 中定义 LUNAIX_SYSCALL_STAT 以启用）。
+
+    以TSC记录每次调用自分派至返回所经过的周期数，阻塞于其中的时间亦计算在内。
+    周期数以4为底分档：第 i 档为 [2^(8+2i), 2^(10+2i))，第0档包括更短的调用。
+    系统整体的统计见 /sys/syscalls，各进程的见 /task/<pid>/syscalls。
+*/
+
+#define SCSTAT_BUCKETS 12
+#define SCSTAT_BUCKET_BASE 8
+
+struct scstat
+{
+    u32_t count;
+    u32_t max_cycles;
+    u64_t cycles;
+    u32_t hist[SCSTAT_BUCKETS];
+};
+
+struct proc_info;
+
+#ifdef LUNAIX_SYSCALL_STAT
+
+/**
+ * @brief 释放进程的统计表
+ *
+ */
+void
+scstat_release(struct proc_info* proc);
+
+void
+scstat_export();
+
+#else
+
+static inline void
+scstat_release(struct proc_info* proc)
+{
+}
+
+static inline void
+scstat_export()
+{
+}
+
+#endif
+
+#endif /* __LUNAIX_SCSTAT_H */
@@ -30,5 +30,14 @@
 #define ENOTDEV -24
 #define EOVERFLOW -25
 #define ENOTBLK -26
+#define EAGAIN -27
+#define EFAULT -28
+#define EINPROGRESS -29
+#define ESPIPE -30
+#define EPIPE -31
+#define ENODATA -32
+#define ENOSPC -33
+#define ENOEXEC -34
+#define E2BIG -35
 
 #endif /* __LUNAIX_CODE_H */
@@ -59,9 +59,65 @@
 #define __SYSCALL_setpgid 50
 
 #define __SYSCALL_syslog 51
+#define __SYSCALL_vfork 52
+#define __SYSCALL_mmap 53
+#define __SYSCALL_munmap 54
+
+#define __SYSCALL_nice 55
+#define __SYSCALL_getpriority 56
+#define __SYSCALL_setpriority 57
+
+#define __SYSCALL_futex 58
+
+#define __SYSCALL_nanosleep 59
+#define __SYSCALL_clock_gettime 60
+#define __SYSCALL_timer_create 61
+#define __SYSCALL_timer_settime 62
+#define __SYSCALL_timer_gettime 63
+#define __SYSCALL_timer_delete 64
+
+#define __SYSCALL_aio_read 65
+#define __SYSCALL_aio_write 66
+#define __SYSCALL_aio_error 67
+#define __SYSCALL_aio_return 68
+#define __SYSCALL_aio_suspend 69
+
+#define __SYSCALL_sendfile 70
+
+#define __SYSCALL_readv 71
+#define __SYSCALL_writev 72
+#define __SYSCALL_pread 73
+#define __SYSCALL_pwrite 74
+
+#define __SYSCALL_poll 75
+
+#define __SYSCALL_pipe 76
+#define __SYSCALL_getdents 77
+#define __SYSCALL_sync_file_range 78
+
+#define __SYSCALL_listxattr 79
+#define __SYSCALL_flistxattr 80
+
+#define __SYSCALL_posix_fadvise 81
+
+#define __SYSCALL_ioring_setup 82
+#define __SYSCALL_ioring_enter 83
+
+#define __SYSCALL_lseek64 84
+
+#define __SYSCALL_execve 85
+
+#define __SYSCALL_shm_create 86
+#define __SYSCALL_shm_attach 87
+#define __SYSCALL_shm_detach 88
+
+#define __SYSCALL_isatty 89
 
 #define __SYSCALL_MAX 0x100
 
+// 经由SYSENTER进入的系统调用，其中断帧的err_code以此标记，以便经SYSEXIT返回
+#define SYSCALL_SYSENTER_MARK 1
+
 #ifndef __ASM__
 
 #define SYSCALL_ESTATUS(errno) -((errno) != 0)
@@ -103,38 +159,55 @@ syscall_install();
     asm volatile("int %1\n" : "=a"(v) : "i"(LUNAIX_SYS_CALL), "a"(callcode));  \
     return (rettype)v;
 
+/*
+    SYSENTER不保存返回地址与用户栈，约定分别由%esi与%ebp传递。
+    SYSEXIT经由%edx与%ecx返回，故二者在调用后不再保留。
+*/
+#define ___DOSYSENTER(callcode, rettype)                                       \
+    int v;                                                                     \
+    asm volatile("pushl %%ebp\n"                                               \
+                 "movl %%esp, %%ebp\n"                                         \
+                 "movl $1f, %%esi\n"                                           \
+                 "sysenter\n"                                                  \
+                 "1:\n"                                                        \
+                 "popl %%ebp\n"                                                \
+                 : "=a"(v)                                                     \
+                 : "a"(callcode)                                               \
+                 : "ecx", "edx", "esi", "memory");                             \
+    return (rettype)v;
+
 #define __LXSYSCALL(rettype, name)                                             \
     static rettype name()                                                      \
     {                                                                          \
-        ___DOINT33(__SYSCALL_##name, rettype)                                  \
+        ___DOSYSENTER(__SYSCALL_##name, rettype)                               \
     }
 
 #define __LXSYSCALL1(rettype, name, t1, p1)                                    \
     static rettype name(__PARAM_MAP1(t1, p1))                                  \
     {                                                                          \
         asm("" ::"b"(p1));                                                     \
-        ___DOINT33(__SYSCALL_##name, rettype)                                  \
+        ___DOSYSENTER(__SYSCALL_##name, rettype)                               \
     }
 
 #define __LXSYSCALL2(rettype, name, t1, p1, t2, p2)                            \
     static rettype name(__PARAM_MAP2(t1, p1, t2, p2))                          \
     {                                                                          \
         asm("\n" ::"b"(p1), "c"(p2));                                          \
-        ___DOINT33(__SYSCALL_##name, rettype)                                  \
+        ___DOSYSENTER(__SYSCALL_##name, rettype)                               \
     }
 
 #define __LXSYSCALL3(rettype, name, t1, p1, t2, p2, t3, p3)                    \
     static rettype name(__PARAM_MAP3(t1, p1, t2, p2, t3, p3))                  \
     {                                                                          \
         asm("\n" ::"b"(p1), "c"(p2), "d"(p3));                                 \
-        ___DOINT33(__SYSCALL_##name, rettype)                                  \
+        ___DOSYSENTER(__SYSCALL_##name, rettype)                               \
     }
 
 #define __LXSYSCALL4(rettype, name, t1, p1, t2, p2, t3, p3, t4, p4)            \
     static rettype name(__PARAM_MAP4(t1, p1, t2, p2, t3, p3, t4, p4))          \
     {                                                                          \
         asm("\n" ::"b"(p1), "c"(p2), "d"(p3), "D"(p4));                        \
-        ___DOINT33(__SYSCALL_##name, rettype)                                  \
+        ___DOSYSENTER(__SYSCALL_##name, rettype)                               \
     }
 
 #define __LXSYSCALL2_VARG(rettype, name, t1, p1, t2, p2)                       \
@@ -144,7 +217,7 @@ syscall_install();
         /* No inlining! This depends on the call frame assumption */           \
         void* _last = (void*)&p2 + sizeof(void*);                              \
         asm("\n" ::"b"(p1), "c"(p2), "d"(_last));                              \
-        ___DOINT33(__SYSCALL_##name, rettype)                                  \
+        ___DOSYSENTER(__SYSCALL_##name, rettype)                               \
     }
 #endif
 
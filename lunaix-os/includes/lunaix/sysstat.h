@@ -0,0 +1,61 @@
+#ifndef __LUNAIX_SYSSTAT_H
+#define __LUNAIX_SYSSTAT_H
+
+#include <lunaix/types.h>
+
+/*
+    /sysstat 的二进制格式，供定时采集的程序一次读取所有常用的计数器，
+    免去逐个打开文本节点并解析的开销。
+
+    内容为一个 struct sysstat，其后紧跟 nr_blk 个 struct sysstat_blk。
+    各计数器在同一次生成中取得（期间不会被中断），彼此一致。
+    新的字段只会追加在末尾，读取方应以 hdr_size 与 blk_size 定位。
+*/
+
+#define SYSSTAT_MAGIC 0x5453584cU // "LXST"
+#define SYSSTAT_VERSION 1
+
+#define SYSSTAT_BLKID_LEN 16
+
+struct sysstat
+{
+    u32_t magic;
+    u16_t version;
+    u16_t hdr_size; // sizeof(struct sysstat)
+    u16_t blk_size; // sizeof(struct sysstat_blk)
+    u16_t nr_blk;
+
+    u32_t systime;  // 毫秒
+    u32_t unixtime; // 秒
+
+    u32_t pm_managed; // 物理页
+    u32_t pm_free;
+
+    u32_t pc_pages; // 页缓存
+    u32_t pc_max;
+    u32_t pc_dirty;
+} PACKED;
+
+struct sysstat_blk
+{
+    char id[SYSSTAT_BLKID_LEN];
+    u32_t rd_ios;
+    u32_t wr_ios;
+    u64_t rd_blocks;
+    u64_t wr_blocks;
+    u32_t errors;
+    u32_t merges;
+    u32_t flushes;
+    u32_t discards;
+    u32_t in_flight; // 在途与排队的请求数属于整个设备，分区与之共享
+    u32_t queued;
+} PACKED;
+
+/**
+ * @brief 于 twifs 的根下建立 sysstat 节点
+ *
+ */
+void
+sysstat_export();
+
+#endif /* __LUNAIX_SYSSTAT_H */
@@ -0,0 +1,68 @@
+#ifndef __LUNAIX_TIME_H
+#define __LUNAIX_TIME_H
+
+#include <lunaix/clock.h>
+#include <lunaix/syscall.h>
+
+// 墙上时间，精度受限于RTC，仅到秒
+#define CLOCK_REALTIME 0
+// 自开机起单调递增的时间
+#define CLOCK_MONOTONIC 1
+
+// timer_settime：it_value 为依所属时钟的绝对时刻，而非相对时长
+#define TIMER_ABSTIME 0x1
+
+#define NSEC_PER_SEC 1000000000L
+
+typedef int clockid_t;
+typedef int timer_t;
+
+struct timespec
+{
+    time_t tv_sec;
+    long tv_nsec;
+};
+
+struct itimerspec
+{
+    struct timespec it_interval;
+    struct timespec it_value;
+};
+
+__LXSYSCALL2(int,
+             nanosleep,
+             const struct timespec*,
+             req,
+             struct timespec*,
+             rem)
+
+__LXSYSCALL2(int, clock_gettime, clockid_t, clockid, struct timespec*, tp)
+
+/*
+    简化的 timer_create：以 signum 代替 sigevent，定时器到期时向进程发送该信号。
+*/
+__LXSYSCALL3(int,
+             timer_create,
+             clockid_t,
+             clockid,
+             int,
+             signum,
+             timer_t*,
+             timerid)
+
+__LXSYSCALL4(int,
+             timer_settime,
+             timer_t,
+             timerid,
+             int,
+             flags,
+             const struct itimerspec*,
+             value,
+             struct itimerspec*,
+             ovalue)
+
+__LXSYSCALL2(int, timer_gettime, timer_t, timerid, struct itimerspec*, value)
+
+__LXSYSCALL1(int, timer_delete, timer_t, timerid)
+
+#endif /* __LUNAIX_TIME_H */
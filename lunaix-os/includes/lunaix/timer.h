@@ -10,9 +10,38 @@
 
 typedef u32_t ticks_t;
 
+struct lx_event;
+
+/*
+    Timers are kept in a hierarchical timing wheel keyed by absolute expiry.
+    The first level resolves single ticks, each further level covers
+    2^TIMER_WHEELN_BITS times the span of the previous one, and its buckets
+    are cascaded down as the tick count rolls over.
+*/
+#define TIMER_WHEEL0_BITS 8
+#define TIMER_WHEELN_BITS 6
+#define TIMER_WHEEL_LEVELS 4
+
+#define TIMER_WHEEL0_SIZE (1 << TIMER_WHEEL0_BITS)
+#define TIMER_WHEELN_SIZE (1 << TIMER_WHEELN_BITS)
+
+// Farthest expiry (in ticks) the wheel can hold without re-cascading
+#define TIMER_WHEEL_SPAN                                                       \
+    (1U << (TIMER_WHEEL0_BITS + (TIMER_WHEEL_LEVELS - 1) * TIMER_WHEELN_BITS))
+
+// Longest delay accepted when converting from nanoseconds, kept to half the
+//  tick range so that expiry comparisons stay unambiguous across wrap-around
+#define TIMER_TICKS_MAX (((ticks_t)-1) >> 1)
+
 struct lx_timer_context
 {
-    struct lx_timer* active_timers;
+    struct llist_header wheel0[TIMER_WHEEL0_SIZE];
+    struct llist_header wheels[TIMER_WHEEL_LEVELS - 1][TIMER_WHEELN_SIZE];
+    /**
+     * @brief Ticks elapsed since the system timer started
+     *
+     */
+    ticks_t ticks;
     /**
      * @brief APIC timer base frequency (ticks per seconds)
      *
@@ -28,13 +57,32 @@ struct lx_timer_context
      *
      */
     ticks_t tphz;
+    /**
+     * @brief TSC frequency in Hz, zero if the TSC is not invariant and thus
+     * unfit as a clocksource
+     *
+     */
+    u64_t tsc_frequency;
+    /**
+     * @brief TSC value when the system timer started ticking
+     *
+     */
+    u64_t tsc_base;
 };
 
 struct lx_timer
 {
     struct llist_header link;
+    /**
+     * @brief Interval in ticks, used to re-arm a periodic timer
+     *
+     */
     ticks_t deadline;
-    ticks_t counter;
+    /**
+     * @brief Absolute tick at which the timer fires
+     *
+     */
+    ticks_t expires;
     void* payload;
     void (*callback)(void*);
     uint8_t flags;
@@ -60,9 +108,60 @@ timer_run_ms(u32_t millisecond,
              void* payload,
              uint8_t flags);
 
+/**
+ * @brief Convert a duration into system ticks, rounding up so that a timer
+ * armed with the result never fires early. Clamped to TIMER_TICKS_MAX.
+ *
+ * @param ns Duration in nanoseconds
+ * @return ticks_t
+ */
+ticks_t
+timer_ns_to_ticks(u64_t ns);
+
+u64_t
+timer_ticks_to_ns(ticks_t ticks);
+
+/**
+ * @brief Signal evt once the given time has elapsed, or every period with
+ * TIMER_MODE_PERIODIC. Work that must not run in interrupt context can be
+ * attached to evt as a listener targeting a workqueue.
+ *
+ * @return struct lx_timer* NULL if out of timers
+ */
+struct lx_timer*
+timer_signal_ms(u32_t millisecond, struct lx_event* evt, uint8_t flags);
+
 struct lx_timer*
 timer_run(ticks_t ticks, void (*callback)(void*), void* payload, uint8_t flags);
 
+/**
+ * @brief Cancel a pending timer and release it. Must not be called on a timer
+ * that has already fired in one-shot mode.
+ *
+ * @param timer
+ */
+void
+timer_cancel(struct lx_timer* timer);
+
+/**
+ * @brief Stop the periodic tick until the next timer falls due. Called by the
+ * idle task, with interrupts disabled, right before halting.
+ *
+ * @return ticks_t Number of ticks until the next timer falls due, which is
+ * how long the idle task expects to sleep. Zero if a tick is already pending
+ * or the timer is not running yet.
+ */
+ticks_t
+timer_idle_enter();
+
+/**
+ * @brief Catch up with the ticks skipped while idling, if woken by an
+ * interrupt other than the timer. Called with interrupts disabled.
+ *
+ */
+void
+timer_idle_exit();
+
 struct lx_timer_context*
 timer_context();
 
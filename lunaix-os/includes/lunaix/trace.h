@@ -0,0 +1,97 @@
+#ifndef __LUNAIX_TRACE_H
+#define __LUNAIX_TRACE_H
+
+/*
+    静态跟踪点（于 flags.h 中定义 LUNAIX_TRACEPOINTS 以启用）。
+
+    跟踪点于编译时以 tracepoint(TP_*, a0, a1, a2) 置于代码中，运行时由
+    掩码 trace_mask 逐个开关：关闭时只有一次内存读取与一条条件跳转，参数
+    亦不会被求值。开启的跟踪点将事件记入当前处理器的环形缓冲区，满后覆盖
+    最早的事件。
+
+    事件经由设备 /dev/trace 读取：每次打开各自从环中最早的事件读起，读取
+    不阻塞，返回若干完整的 struct trace_event，暂无新事件时返回0。
+    seq 为事件在其处理器上的序号，不连续即说明其间的事件已被覆盖；不同
+    处理器的事件按 tsc 排序即得全局的顺序。向 /dev/trace 写入一个 u32_t
+    以设定 trace_mask，第 i 位对应编号为 i 的跟踪点；/sys/tracepoints
+    列出各跟踪点的编号、名称与开关状态。
+*/
+
+// 参数：前一进程, 后一进程, 前一进程的状态
+#define TP_SCHED_SWITCH 0
+// 参数：错误地址, EIP, 错误码
+#define TP_PAGE_FAULT 1
+// 参数：蛋糕堆, 对象
+#define TP_CAKE_GRAB 2
+#define TP_CAKE_RELEASE 3
+// 参数：LBA, 块数, 标志
+#define TP_BLKIO_COMMIT 4
+// 参数：LBA, 块数, 错误码
+#define TP_BLKIO_COMPLETE 5
+// 参数：inode 号, 页于文件中的页号
+#define TP_PCACHE_HIT 6
+#define TP_PCACHE_MISS 7
+// 参数：调用号, 第一个参数 / 调用号, 返回值
+#define TP_SYSCALL_ENTER 8
+#define TP_SYSCALL_EXIT 9
+
+#define TP_NR 10
+
+// 亦用于汇编，故不带后缀 U
+#define TP_MASK(tp) (1 << (tp))
+#define TP_SYSCALL_MASK (TP_MASK(TP_SYSCALL_ENTER) | TP_MASK(TP_SYSCALL_EXIT))
+
+#define TRACE_NR_EVENTS 4096
+
+#ifndef __ASM__
+
+#include <lunaix/types.h>
+
+struct trace_event
+{
+    u32_t seq;
+    u16_t id;
+    u16_t cpu;
+    u32_t pid;
+    u32_t args[3];
+    u64_t tsc;
+};
+
+#ifdef LUNAIX_TRACEPOINTS
+
+extern volatile u32_t trace_mask;
+
+void
+__tracepoint_record(u32_t id, u32_t a0, u32_t a1, u32_t a2);
+
+#define tracepoint(tp, a0, a1, a2)                                             \
+    do {                                                                       \
+        if (__builtin_expect(trace_mask & TP_MASK(tp), 0)) {                   \
+            __tracepoint_record(                                               \
+              (tp), (u32_t)(a0), (u32_t)(a1), (u32_t)(a2));                    \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @brief 注册 /dev/trace 并导出 /sys/tracepoints
+ *
+ */
+void
+trace_init();
+
+#else
+
+#define tracepoint(tp, a0, a1, a2)                                             \
+    do {                                                                       \
+    } while (0)
+
+static inline void
+trace_init()
+{
+}
+
+#endif
+
+#endif /* __ASM__ */
+
+#endif /* __LUNAIX_TRACE_H */
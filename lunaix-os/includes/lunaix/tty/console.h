@@ -2,15 +2,29 @@
 #define __LUNAIX_CONSOLE_H
 
 #include <lunaix/ds/fifo.h>
+#include <lunaix/event.h>
 #include <lunaix/timer.h>
+#include <lunaix/types.h>
+
+// Delay before a deferred flush, bursts of writes within it coalesce
+#define CONSOLE_FLUSH_DELAY_MS 20
+
+// Number of virtual consoles, switched between with Alt+F1..Fn
+#define CONSOLE_NR 4
 
 struct console
 {
-    struct lx_timer* flush_timer;
     struct fifo_buf output;
     struct fifo_buf input;
     size_t wnd_start;
     size_t lines;
+    // Foreground process group, target of ^C and ^Z
+    volatile pid_t fg_pgid;
+    // Signaled on every key typed, waking one reader
+    struct lx_event typed;
+    // Last key typed while this console is visible
+    volatile char ttychr;
+    volatile int ttychr_pending;
 };
 
 #endif /* __LUNAIX_CONSOLE_H */
@@ -0,0 +1,48 @@
+#ifndef __LUNAIX_FBCON_H
+#define __LUNAIX_FBCON_H
+
+#include <arch/x86/boot/multiboot.h>
+#include <lunaix/tty/tty.h>
+
+/*
+    线性帧缓冲上的控制台后端。字符网格仍为 TTY_WIDTH x TTY_HEIGHT，
+    每个字符以内置的 8x8 字形纵向放大一倍绘制，
+    并在帧缓冲足够大时整体按 scale 倍放大。
+*/
+
+#define FBCON_GLYPH_W 8
+#define FBCON_GLYPH_H 16
+#define FBCON_MAX_SCALE 2
+
+// 按颜色缓存的字形行图案的个数
+#define FBCON_GCACHE_NR 4
+
+/**
+ * @brief 若引导程序提供了 32 位 RGB 的线性帧缓冲，则映射并启用之
+ *
+ * @return int 是否可用
+ */
+int
+fbcon_init(multiboot_info_t* mb_info);
+
+void
+fbcon_draw_cell(int x, int y, vga_attribute cell);
+
+void
+fbcon_draw_line(int y, vga_attribute* cells);
+
+/**
+ * @brief 于 (x, y) 处的字符上叠加光标
+ *
+ */
+void
+fbcon_draw_cursor(int x, int y, vga_attribute cell);
+
+/**
+ * @brief 将整个字符网格上移 lines 行，仅一次 memmove。腾出的行由调用者重绘
+ *
+ */
+void
+fbcon_scroll(int lines);
+
+#endif /* __LUNAIX_FBCON_H */
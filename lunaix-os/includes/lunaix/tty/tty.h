@@ -28,6 +28,13 @@ typedef unsigned short vga_attribute;
 void
 tty_init(void* vga_buf);
 
+/**
+ * @brief 此后改由帧缓冲控制台输出（见 fbcon_init），并重绘整屏
+ *
+ */
+void
+tty_enable_fbcon();
+
 void
 tty_set_theme(vga_attribute fg, vga_attribute bg);
 
@@ -37,6 +44,17 @@ tty_get_theme();
 void
 tty_flush_buffer(struct fifo_buf* buf);
 
+/**
+ * @brief 输出缓冲中已渲染的部分被改写（如退格、清空）时调用，
+ *  使下一次刷新整屏重新渲染
+ *
+ */
+void
+tty_invalidate();
+
+void
+tty_set_cursor(uint8_t x, uint8_t y);
+
 void
 tty_clear_line(int line_num);
 
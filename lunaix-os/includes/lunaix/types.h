@@ -36,4 +36,7 @@ typedef signed long ssize_t;
 typedef int32_t pid_t;
 typedef int64_t lba_t;
 
+// 文件或设备内的字节偏移
+typedef u64_t foff_t;
+
 #endif /* __LUNAIX_TYPES_H */
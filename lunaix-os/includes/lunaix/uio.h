@@ -0,0 +1,49 @@
+#ifndef __LUNAIX_UIO_H
+#define __LUNAIX_UIO_H
+
+#include <lunaix/syscall.h>
+#include <lunaix/types.h>
+
+// 单次 readv/writev 至多的缓冲区数
+#define UIO_MAXIOV 16
+
+struct iovec
+{
+    void* iov_base;
+    size_t iov_len;
+};
+
+/*
+    依次读入（写出）iov 中的各个缓冲区，等同于对每个缓冲区连续调用 read（write），
+    但只需一次系统调用，并且期间不会与他人对该文件的读写交错
+*/
+__LXSYSCALL3(int, readv, int, fd, const struct iovec*, iov, int, iovcnt)
+
+__LXSYSCALL3(int, writev, int, fd, const struct iovec*, iov, int, iovcnt)
+
+/*
+    于给定的偏移处读写，不使用也不改变文件自身的偏移。不支持字符设备
+*/
+__LXSYSCALL4(int,
+             pread,
+             int,
+             fd,
+             void*,
+             buf,
+             size_t,
+             count,
+             size_t,
+             offset)
+
+__LXSYSCALL4(int,
+             pwrite,
+             int,
+             fd,
+             void*,
+             buf,
+             size_t,
+             count,
+             size_t,
+             offset)
+
+#endif /* __LUNAIX_UIO_H */
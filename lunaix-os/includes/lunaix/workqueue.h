@@ -0,0 +1,74 @@
+#ifndef __LUNAIX_WORKQUEUE_H
+#define __LUNAIX_WORKQUEUE_H
+
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/types.h>
+
+#define WORK_PENDING 0x1
+
+typedef void (*work_fn)(void* arg);
+
+struct lx_work
+{
+    struct llist_header works;
+    work_fn func;
+    void* arg;
+    u32_t flags;
+};
+
+struct workqueue
+{
+    struct llist_header works;
+    waitq_t worker_wait;
+    struct proc_info* worker;
+};
+
+/**
+ * @brief 创建系统默认的工作队列
+ *
+ */
+void
+workqueue_init();
+
+/**
+ * @brief 系统默认的工作队列，须于 workqueue_init 之后使用
+ *
+ */
+struct workqueue*
+workqueue_system();
+
+/**
+ * @brief 创建一个工作队列，并为其启动一个专属的内核线程
+ *
+ * @return struct workqueue*
+ */
+struct workqueue*
+workqueue_create();
+
+static inline void
+work_init(struct lx_work* work, work_fn func, void* arg)
+{
+    llist_init_head(&work->works);
+    work->func = func;
+    work->arg = arg;
+    work->flags = 0;
+}
+
+/**
+ * @brief 将工作项提交至工作队列。可于中断上下文中调用。
+ * 若该工作项尚未被执行，则不会重复提交。
+ *
+ * @return int 是否新提交了该工作项
+ */
+int
+workqueue_submit(struct workqueue* wq, struct lx_work* work);
+
+/**
+ * @brief 将工作项提交至系统默认的工作队列
+ *
+ */
+int
+work_submit(struct lx_work* work);
+
+#endif /* __LUNAIX_WORKQUEUE_H */
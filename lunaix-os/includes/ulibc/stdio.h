@@ -1,9 +1,61 @@
 #ifndef __LUNAIX_USTDIO_H
 #define __LUNAIX_USTDIO_H
 
+#include <stddef.h>
+
 #define stdout 0
 #define stdin 1
 
+#define BUFSIZ 1024
+#define EOF (-1)
+
+// buffering modes, see setvbuf
+#define _IOFBF 0 // flush when the buffer is full
+#define _IOLBF 1 // also flush after each newline
+#define _IONBF 2 // no buffering
+
+// Output streams over a file descriptor. A stream on a terminal starts line
+// buffered, anything else fully buffered. Open streams are flushed by exit.
+typedef struct ufile FILE;
+
+// the stream on the stdout descriptor, opened on first use
+#define ustdout (__ustdout())
+
+FILE*
+__ustdout();
+
+FILE*
+fdopen(int fd, const char* mode);
+
+int
+fclose(FILE* stream);
+
+/**
+ * @brief Write out the buffered data of stream, or of all open streams if
+ * stream is NULL.
+ */
+int
+fflush(FILE* stream);
+
+/**
+ * @brief Change the buffering of stream. Only allowed before anything is
+ * written to it. With buf being NULL, a buffer of size bytes is allocated.
+ */
+int
+setvbuf(FILE* stream, char* buf, int mode, size_t size);
+
+size_t
+fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream);
+
+int
+fputc(int c, FILE* stream);
+
+int
+fputs(const char* s, FILE* stream);
+
+int
+fprintf(FILE* stream, const char* fmt, ...);
+
 void
 printf(const char* fmt, ...);
 
@@ -0,0 +1,24 @@
+#ifndef __LUNAIX_USTDLIB_H
+#define __LUNAIX_USTDLIB_H
+
+#include <stddef.h>
+
+void*
+malloc(size_t size);
+
+void*
+calloc(size_t nmemb, size_t size);
+
+void*
+realloc(void* ptr, size_t size);
+
+void
+free(void* ptr);
+
+/**
+ * @brief Flush all open stdio streams, then terminate the process.
+ */
+void
+exit(int status);
+
+#endif /* __LUNAIX_USTDLIB_H */
@@ -0,0 +1,87 @@
+/**
+ * @file dfault.c
+ * @brief 双重错误经由任务门处理。
+ *
+ *  内核栈溢出至其下方的保护页时，处理器压入页错误的异常帧本身又会引发页错误，
+ *  继而成为双重错误。此时原有的栈已不可用，中断门无济于事（只会导致三重错误
+ *  而复位），因此改用任务门：处理器切换至 _dfault_tss 所描述的任务，于专用的
+ *  栈上报告错误。
+ *
+ *  IDT为各处理器所共用，它们因此也共用这一个任务。双重错误总是致命的，
+ *  这并无妨碍。
+ *
+ */
+#include <arch/x86/idt.h>
+#include <arch/x86/tss.h>
+#include <arch/x86/vectors.h>
+#include <hal/cpu.h>
+#include <hal/smp.h>
+#include <lunaix/common.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+
+#define DFAULT_STACK_SIZE 4096
+
+extern u64_t _idt[];
+
+extern struct x86_tss _tss;
+extern struct x86_tss _ap_tss[SMP_MAX_CPU];
+
+extern void
+dfault_entry(); /* kernel/asm/x86/interrupt.S */
+
+struct x86_tss _dfault_tss;
+
+static u8_t dfault_stack[DFAULT_STACK_SIZE] __attribute__((aligned(16)));
+
+void
+dfault_init()
+{
+    // 须能访问内核映像的任一页目录皆可。此时仍为引导时的页目录，它从不释放
+    _dfault_tss.cr3 = cpu_rcr3();
+    _dfault_tss.eip = (u32_t)dfault_entry;
+    _dfault_tss.eflags = 0x2;
+    _dfault_tss.esp = (u32_t)dfault_stack + DFAULT_STACK_SIZE - 16;
+    _dfault_tss.cs = KCODE_SEG;
+    _dfault_tss.ss = KDATA_SEG;
+    _dfault_tss.ds = KDATA_SEG;
+    _dfault_tss.es = KDATA_SEG;
+    _dfault_tss.fs = KDATA_SEG;
+    _dfault_tss.gs = KDATA_SEG;
+    _dfault_tss.iomap = sizeof(struct x86_tss);
+
+    // 任务门：仅选择子与属性有效，偏移被忽略
+    _idt[ABORT_DOUBLE_FAULT] =
+      ((u64_t)IDT_ATTR(0, IDT_TASK) << 32) | (DFAULT_TSS_SEG << 16);
+}
+
+/**
+ * @brief 双重错误的报告，由 dfault_entry 调用，从不返回
+ *
+ */
+void
+intr_routine_double_fault()
+{
+    // 被中断的任务即 link 所指的TSS，其寄存器已由处理器存入其中
+    u32_t sel = _dfault_tss.link;
+    struct x86_tss* prev =
+      sel == TSS_SEG ? &_tss : &_ap_tss[(sel - TSS_SEG) >> 3];
+
+    // 任务切换不保存CR3，换回出错进程的页目录，以便访问内核堆中的各类结构
+    cpu_lcr3((u32_t)__current->page_table);
+
+    u32_t esp = prev->esp;
+    const char* why = "Double fault";
+    if (KSTACK_START <= esp && esp < KSTACK_MAPPED_START + PG_SIZE) {
+        why = "Kernel stack overflow";
+    }
+
+    kprint_panic("  INT 8: (pid: %d) [%p: %p] esp=%p %s",
+                 __current->pid,
+                 prev->cs,
+                 prev->eip,
+                 esp,
+                 why);
+    spin();
+}
@@ -0,0 +1,229 @@
+/**
+ * @file fpu.c
+ * @brief 惰性的x87/SSE/AVX上下文切换
+ *
+ * FPU寄存器中保存的始终是 fpu_owner 的状态，切换进程时并不保存或恢复，
+ * 仅置位CR0.TS。只有当进程真正使用x87/SSE/AVX指令而陷入#NM时，才将寄存器
+ * 写回原持有者，并载入当前进程的状态。从不使用FPU的进程因而无需承担
+ * 保存与恢复的开销。
+ *
+ * 支持XSAVE时，以XSAVE/XRSTOR代替FXSAVE/FXRSTOR，并一同启用AVX状态。
+ * 状态区的大小取自CPUID 0xD号叶，见 fpu_state_size。XSAVEOPT可用时，
+ * 自上次XRSTOR以来未被修改的分量不会被写回。
+ *
+ */
+#include <arch/x86/fpu.h>
+#include <hal/alternative.h>
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+
+#define EFLAGS_IF (1 << 9)
+
+#define CR4_OSXSAVE (1 << 18)
+
+// 启用的状态分量：x87、SSE与AVX
+#define FPU_XFEATURES 0x7ULL
+
+// 以上分量所需的最大区域：传统区512字节、XSAVE头64字节、AVX高半部256字节
+#define FPU_STATE_MAX 832
+
+#define FXSAVE_MXCSR 24
+#define FXSAVE_MXCSR_MASK 28
+#define XSAVE_HEADER 512
+
+size_t fpu_state_size = 512;
+
+static struct proc_info* fpu_owner = NULL;
+
+static u64_t fpu_xfeatures = 0;
+
+static char fpu_pristine[FPU_STATE_MAX] __attribute__((aligned(64)));
+
+// 内核正在使用XMM寄存器
+static volatile int fpu_kernel_inuse = 0;
+
+static inline void
+__fpu_clts()
+{
+    asm volatile("clts");
+}
+
+static inline void
+__fpu_stts()
+{
+    cpu_lcr0(cpu_rcr0() | CR0_TS);
+}
+
+// EDX:EAX 为要求的分量，全部置位即为XCR0中启用的全部分量
+static inline void
+__fpu_save_state(void* area)
+{
+    if (alt_has(ALT_FEATURE_XSAVEOPT)) {
+        asm volatile("xsaveopt (%0)" ::"r"(area), "a"(-1), "d"(-1)
+                     : "memory");
+    } else if (alt_has(ALT_FEATURE_XSAVE)) {
+        asm volatile("xsave (%0)" ::"r"(area), "a"(-1), "d"(-1) : "memory");
+    } else {
+        asm volatile("fxsave (%0)" ::"r"(area) : "memory");
+    }
+}
+
+static inline void
+__fpu_restore_state(void* area)
+{
+    if (alt_has(ALT_FEATURE_XSAVE)) {
+        asm volatile("xrstor (%0)" ::"r"(area), "a"(-1), "d"(-1) : "memory");
+    } else {
+        asm volatile("fxrstor (%0)" ::"r"(area) : "memory");
+    }
+}
+
+void
+fpu_init()
+{
+    if (!cpu_has_xsave()) {
+        return;
+    }
+
+    u64_t xfeatures = cpu_xsave_features() & FPU_XFEATURES;
+
+    cpu_lcr4(cpu_rcr4() | CR4_OSXSAVE);
+    cpu_xsetbv(0, xfeatures);
+
+    u32_t size = cpu_xsave_size();
+    assert(size <= FPU_STATE_MAX);
+
+    fpu_xfeatures = xfeatures;
+    fpu_state_size = size;
+}
+
+void
+fpu_init_state(void* fxstate)
+{
+    __fpu_clts();
+    asm volatile("fninit");
+    __fpu_save_state(fpu_pristine);
+
+    memcpy(fxstate, fpu_pristine, fpu_state_size);
+}
+
+void
+fpu_sanitize(void* fxstate)
+{
+    u32_t mxcsr_mask = *(u32_t*)(fpu_pristine + FXSAVE_MXCSR_MASK);
+
+    // 未报告掩码的处理器，其默认值为0xffbf
+    *(u32_t*)((char*)fxstate + FXSAVE_MXCSR) &= mxcsr_mask ?: 0xffbf;
+
+    if (!fpu_xfeatures) {
+        return;
+    }
+
+    // XSTATE_BV 不得含未启用的分量；XCOMP_BV 与其余保留字节须为零
+    u64_t* header = (u64_t*)((char*)fxstate + XSAVE_HEADER);
+    header[0] &= fpu_xfeatures;
+    memset(&header[1], 0, 64 - sizeof(u64_t));
+}
+
+void
+fpu_reset(struct proc_info* proc)
+{
+    fpu_discard(proc);
+    memcpy(proc->fxstate, fpu_pristine, fpu_state_size);
+    proc->flags &= ~PROC_FFPU;
+}
+
+void
+fpu_switch(struct proc_info* next)
+{
+    if (next == fpu_owner) {
+        __fpu_clts();
+    } else {
+        __fpu_stts();
+    }
+}
+
+void
+fpu_save(struct proc_info* proc)
+{
+    if (proc != fpu_owner || !proc->fxstate) {
+        return;
+    }
+
+    // 寄存器仍然有效，持有者保持不变
+    __fpu_clts();
+    __fpu_save_state(proc->fxstate);
+}
+
+void
+fpu_discard(struct proc_info* proc)
+{
+    if (proc != fpu_owner) {
+        return;
+    }
+
+    fpu_owner = NULL;
+    __fpu_stts();
+}
+
+void
+fpu_kernel_begin()
+{
+    __fpu_clts();
+
+    if (fpu_owner) {
+        __fpu_save_state(fpu_owner->fxstate);
+        fpu_owner = NULL;
+    }
+}
+
+void
+fpu_kernel_end()
+{
+    fpu_kernel_inuse = 0;
+    __fpu_stts();
+}
+
+int
+fpu_kernel_try_begin()
+{
+    /*
+        若使用途中被中断并切换至使用FPU的进程，其状态便会覆盖掉我们正在使用的寄存器；
+        嵌套的使用则会覆盖外层的寄存器
+    */
+    if (fpu_kernel_inuse || (cpu_reflags() & EFLAGS_IF)) {
+        return 0;
+    }
+
+    fpu_kernel_inuse = 1;
+    fpu_kernel_begin();
+    return 1;
+}
+
+void
+intr_routine_fpu_unavail(const isr_param* param)
+{
+    struct proc_info* proc = (struct proc_info*)__current;
+
+    // 内核线程与空闲进程没有FPU上下文，只能当作内核自身的使用
+    if (!proc->fxstate) {
+        fpu_kernel_begin();
+        return;
+    }
+
+    __fpu_clts();
+
+    if (fpu_owner == proc) {
+        return;
+    }
+
+    if (fpu_owner) {
+        __fpu_save_state(fpu_owner->fxstate);
+    }
+
+    __fpu_restore_state(proc->fxstate);
+    fpu_owner = proc;
+    proc->flags |= PROC_FFPU;
+}
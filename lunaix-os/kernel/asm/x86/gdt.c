@@ -1,8 +1,12 @@
 #include <arch/x86/gdt.h>
 #include <arch/x86/tss.h>
+#include <hal/smp.h>
+#include <lunaix/common.h>
 #include <lunaix/types.h>
 
-#define GDT_ENTRY 6
+// 除BSP外，每个应用处理器还需要一个TSS描述符；另有每个处理器的 per-CPU 数据段
+//  以及双重错误所用的TSS
+#define GDT_ENTRY (6 + SMP_MAX_CPU - 1 + SMP_MAX_CPU + 1)
 
 uint64_t _gdt[GDT_ENTRY];
 uint16_t _gdt_limit = sizeof(_gdt) - 1;
@@ -17,6 +21,8 @@ _set_gdt_entry(u32_t index, u32_t base, u32_t limit, u32_t flags)
 }
 
 extern struct x86_tss _tss;
+extern struct x86_tss _ap_tss[SMP_MAX_CPU];
+extern struct x86_tss _dfault_tss;
 
 void
 _init_gdt()
@@ -26,5 +32,20 @@ _init_gdt()
     _set_gdt_entry(2, 0, 0xfffff, SEG_R0_DATA);
     _set_gdt_entry(3, 0, 0xfffff, SEG_R3_CODE);
     _set_gdt_entry(4, 0, 0xfffff, SEG_R3_DATA);
-    _set_gdt_entry(5, &_tss, sizeof(struct x86_tss) - 1, SEG_TSS);
+    _set_gdt_entry(5, (u32_t)&_tss, sizeof(struct x86_tss) - 1, SEG_TSS);
+
+    for (u32_t i = 1; i < SMP_MAX_CPU; i++) {
+        _set_gdt_entry(
+          5 + i, (u32_t)&_ap_tss[i], sizeof(struct x86_tss) - 1, SEG_TSS);
+    }
+
+    // per-CPU 数据段，基址于 percpu_setup_cpu 中设置，0号处理器即为0
+    for (u32_t i = 0; i < SMP_MAX_CPU; i++) {
+        _set_gdt_entry(PERCPU_SEG_CPU(i) >> 3, 0, 0xfffff, SEG_R0_DATA);
+    }
+
+    _set_gdt_entry(DFAULT_TSS_SEG >> 3,
+                   (u32_t)&_dfault_tss,
+                   sizeof(struct x86_tss) - 1,
+                   SEG_TSS);
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include <hal/acpi/acpi.h>
+#include <hal/cpu.h>
 #include <hal/ioapic.h>
 
+#include <lunaix/fs/twifs.h>
 #include <lunaix/isrm.h>
+#include <lunaix/percpu.h>
 #include <lunaix/spike.h>
+#include <lunaix/timer.h>
 
 /*
     total: 256 ivs
@@ -13,6 +17,18 @@
 
 static char iv_bmp[(IV_MAX - IV_BASE) / 8];
 static isr_cb handlers[IV_MAX];
+static ptr_t ivhand_payload[IV_MAX];
+
+struct isrm_stat
+{
+    u32_t count;
+    u32_t max_cycles;
+    u64_t cycles;
+    u64_t last_tsc;
+};
+
+// 各处理器分别统计，读取时汇总，见 __isrm_stat_sum
+static DEFINE_PERCPU(struct isrm_stat, ivstats[IV_MAX]);
 
 extern void
 intr_routine_fallback(const isr_param* param);
@@ -41,6 +57,7 @@ __ivalloc_within(size_t a, size_t b, isr_cb handler)
         iv_bmp[i] |= 1 << j;
         int iv = IV_BASE + i * 8 + j;
         handlers[iv] = handler ? handler : intr_routine_fallback;
+        ivhand_payload[iv] = 0;
         return iv;
     }
     return 0;
@@ -66,6 +83,7 @@ isrm_ivfree(int iv)
         iv_bmp[(iv - IV_BASE) / 8] &= ~(1 << ((iv - IV_BASE) % 8));
     }
     handlers[iv] = intr_routine_fallback;
+    ivhand_payload[iv] = 0;
 }
 
 int
@@ -98,4 +116,103 @@ isrm_get(int iv)
 {
     assert(iv < 256);
     return handlers[iv];
+}
+
+void
+isrm_set_payload(int iv, ptr_t payload)
+{
+    assert(iv < 256);
+    ivhand_payload[iv] = payload;
+}
+
+ptr_t
+isrm_get_payload(const isr_param* param)
+{
+    return ivhand_payload[param->vector];
+}
+
+void
+isrm_account(int iv, u64_t start, u64_t end)
+{
+    struct isrm_stat* stat = this_cpu_ptr(ivstats[iv]);
+    u32_t cycles = (u32_t)(end - start);
+
+    stat->count++;
+    stat->cycles += cycles;
+    stat->last_tsc = start;
+    if (cycles > stat->max_cycles) {
+        stat->max_cycles = cycles;
+    }
+}
+
+static void
+__isrm_stat_sum(int iv, struct isrm_stat* sum)
+{
+    *sum = (struct isrm_stat){ 0 };
+
+    for (u32_t cpu = 0; cpu < percpu_nr_areas; cpu++) {
+        struct isrm_stat* stat = per_cpu_ptr(ivstats[iv], cpu);
+        sum->count += stat->count;
+        sum->cycles += stat->cycles;
+        sum->max_cycles = MAX(sum->max_cycles, stat->max_cycles);
+        sum->last_tsc = MAX(sum->last_tsc, stat->last_tsc);
+    }
+}
+
+static void
+__isrm_stat_read(struct twimap* map)
+{
+    int iv = twimap_index(map, int);
+    struct isrm_stat total, *stat = &total;
+
+    __isrm_stat_sum(iv, stat);
+
+    if (!iv) {
+        twimap_printf(map, "IV     COUNT    AVG_CYC    MAX_CYC   LAST_MS\n");
+    }
+    if (!stat->count) {
+        return;
+    }
+
+    // 距上次到达的毫秒数，TSC频率未知时为0
+    struct lx_timer_context* ctx = timer_context();
+    u32_t ago = 0;
+    if (ctx && ctx->tsc_frequency >= 1000) {
+        ago = (u32_t)((cpu_rdtsc() - stat->last_tsc) /
+                      (ctx->tsc_frequency / 1000));
+    }
+
+    twimap_printf(map,
+                  "%3d %9u %10u %10u %9u\n",
+                  iv,
+                  stat->count,
+                  (u32_t)(stat->cycles / stat->count),
+                  stat->max_cycles,
+                  ago);
+}
+
+static int
+__isrm_stat_next(struct twimap* map)
+{
+    int iv = twimap_index(map, int);
+    if (iv >= IV_MAX - 1) {
+        return 0;
+    }
+    map->index = (void*)(iv + 1);
+    return 1;
+}
+
+static void
+__isrm_stat_reset(struct twimap* map)
+{
+    map->index = (void*)0;
+}
+
+void
+isrm_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "interrupts");
+    map->read = __isrm_stat_read;
+    map->go_next = __isrm_stat_next;
+    map->reset = __isrm_stat_reset;
 }
\ No newline at end of file
@@ -4,16 +4,26 @@
 #include <hal/apic.h>
 #include <hal/cpu.h>
 
+#include <lunaix/common.h>
 #include <lunaix/isrm.h>
 #include <lunaix/mm/page.h>
+#include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
+#include <lunaix/percpu.h>
 #include <lunaix/process.h>
+#include <lunaix/rand.h>
 #include <lunaix/sched.h>
+#include <lunaix/status.h>
 #include <lunaix/syslog.h>
 #include <lunaix/tty/tty.h>
 
 LOG_MODULE("INTR")
 
+// 各处理器中断栈的栈顶，由 interrupt.S 读取。为0时中断入口不作切换
+DEFINE_PERCPU(ptr_t, irq_stack_top);
+
+static u8_t bsp_irq_stack[IRQ_STACK_SIZE] __attribute__((aligned(16)));
+
 extern x86_page_table* __kernel_ptd;
 
 void
@@ -22,10 +32,19 @@ intr_handler(isr_param* param)
     __current->intr_ctx = *param;
 
     isr_param* lparam = &__current->intr_ctx;
+    int iv = lparam->vector;
+    u64_t tsc = cpu_rdtsc();
+
+    // 外部中断到达的时刻不可预测，作为熵的来源
+    if (iv >= IV_EX) {
+        rand_add_entropy((u32_t)tsc ^ iv);
+    }
 
-    if (lparam->vector <= 255) {
-        isr_cb subscriber = isrm_get(lparam->vector);
+    if (iv <= 255) {
+        isr_cb subscriber = isrm_get(iv);
         subscriber(param);
+        // 处理程序中可能发生了进程切换，故使用事先保存的向量号
+        isrm_account(iv, tsc, cpu_rdtsc());
         goto done;
     }
 
@@ -43,4 +62,16 @@ done:
     }
 
     return;
-}
\ No newline at end of file
+}
+
+int
+intr_stack_setup(u32_t cpu)
+{
+    u8_t* stack = bsp_irq_stack;
+    if (cpu && !(stack = valloc(IRQ_STACK_SIZE))) {
+        return ENOMEM;
+    }
+
+    *per_cpu_ptr(irq_stack_top, cpu) = (ptr_t)stack + IRQ_STACK_SIZE;
+    return 0;
+}
@@ -1,6 +1,8 @@
+#include <arch/x86/fpu.h>
 #include <arch/x86/interrupts.h>
 
 #include <lunaix/isrm.h>
+#include <lunaix/klog.h>
 #include <lunaix/lxconsole.h>
 #include <lunaix/process.h>
 #include <lunaix/sched.h>
@@ -33,6 +35,7 @@ __print_panic_msg(const char* msg, const isr_param* param)
 void
 intr_routine_divide_zero(const isr_param* param)
 {
+    klog_flush();
     console_flush();
     __print_panic_msg("Divide by zero!", param);
     spin();
@@ -44,6 +47,7 @@ intr_routine_general_protection(const isr_param* param)
     kprintf(KERROR "Pid: %d\n", __current->pid);
     kprintf(KERROR "Addr: %p\n", (&debug_resv)[0]);
     kprintf(KERROR "Expected: %p\n", (&debug_resv)[1]);
+    klog_flush();
     console_flush();
     __print_panic_msg("General Protection", param);
     spin();
@@ -52,6 +56,7 @@ intr_routine_general_protection(const isr_param* param)
 void
 intr_routine_sys_panic(const isr_param* param)
 {
+    klog_flush();
     console_flush();
     __print_panic_msg((char*)(param->registers.edi), param);
     spin();
@@ -60,6 +65,7 @@ intr_routine_sys_panic(const isr_param* param)
 void
 intr_routine_fallback(const isr_param* param)
 {
+    klog_flush();
     console_flush();
     __print_panic_msg("Unknown Interrupt", param);
     spin();
@@ -82,6 +88,7 @@ intr_routine_apic_error(const isr_param* param)
     u32_t error_reg = apic_read_reg(APIC_ESR);
     char buf[32];
     ksprintf(buf, "APIC error, ESR=0x%x", error_reg);
+    klog_flush();
     console_flush();
     __print_panic_msg(buf, param);
     spin();
@@ -100,6 +107,7 @@ intr_routine_init()
     isrm_bindiv(FAULT_GENERAL_PROTECTION, intr_routine_general_protection);
     isrm_bindiv(FAULT_PAGE_FAULT, intr_routine_page_fault);
     isrm_bindiv(FAULT_STACK_SEG_FAULT, intr_routine_page_fault);
+    isrm_bindiv(FAULT_NO_MATH_PROCESSOR, intr_routine_fpu_unavail);
 
     isrm_bindiv(LUNAIX_SYS_PANIC, intr_routine_sys_panic);
     isrm_bindiv(LUNAIX_SCHED, intr_routine_sched);
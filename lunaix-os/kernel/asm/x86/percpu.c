@@ -0,0 +1,44 @@
+#include <arch/x86/gdt.h>
+#include <lunaix/common.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/percpu.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+extern u8_t __percpu_start[];
+extern u8_t __percpu_end[];
+
+ptr_t percpu_offset[SMP_MAX_CPU];
+u32_t percpu_nr_areas = 1;
+
+DEFINE_PERCPU(ptr_t, percpu_this_offset);
+DEFINE_PERCPU(u32_t, percpu_cpu_id);
+
+int
+percpu_setup_cpu(u32_t cpu)
+{
+    assert(cpu < SMP_MAX_CPU);
+
+    if (cpu && !percpu_offset[cpu]) {
+        void* area = vzalloc(__percpu_end - __percpu_start);
+        if (!area) {
+            return ENOMEM;
+        }
+        // 偏移按模 2^32 回绕，段基址加上变量的地址时亦然
+        percpu_offset[cpu] = (ptr_t)area - (ptr_t)__percpu_start;
+    }
+
+    *per_cpu_ptr(percpu_this_offset, cpu) = percpu_offset[cpu];
+    *per_cpu_ptr(percpu_cpu_id, cpu) = cpu;
+    _set_gdt_entry(
+      PERCPU_SEG_CPU(cpu) >> 3, percpu_offset[cpu], 0xfffff, SEG_R0_DATA);
+
+    percpu_nr_areas = MAX(percpu_nr_areas, cpu + 1);
+    return 0;
+}
+
+void
+percpu_load(u32_t cpu)
+{
+    asm volatile("movw %w0, %%fs" ::"r"(PERCPU_SEG_CPU(cpu)));
+}
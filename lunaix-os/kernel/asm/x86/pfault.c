@@ -1,13 +1,19 @@
 #include <arch/x86/interrupts.h>
+#include <klibc/stdio.h>
 #include <lunaix/common.h>
+#include <lunaix/fs/twifs.h>
 #include <lunaix/lxsignal.h>
 #include <lunaix/mm/mm.h>
+#include <lunaix/mm/mmap.h>
 #include <lunaix/mm/pmm.h>
 #include <lunaix/mm/region.h>
+#include <lunaix/mm/swap.h>
+#include <lunaix/mm/uaccess.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/sched.h>
 #include <lunaix/status.h>
 #include <lunaix/syslog.h>
+#include <lunaix/trace.h>
 
 static void
 kprintf(const char* fmt, ...)
@@ -20,13 +26,69 @@ kprintf(const char* fmt, ...)
 
 #define COW_MASK (REGION_RSHARED | REGION_READ | REGION_WRITE)
 
+#define FAULT_AROUND_MAX 16
+
+// 错误码：由写入引起
+#define PFAULT_WRITE (1 << 1)
+
+// 顺序访问时，单次匿名缺页所映射的页数（包括缺页本身）。可通过 /pfault_around 调整
+static u32_t fault_around = 8;
+
 extern void
 __print_panic_msg(const char* msg, const isr_param* param);
 
+/**
+ * @brief 若匿名缺页呈顺序访问（向上或向下，如栈），则一并映射沿该方向的若干相邻页，
+ * 以减少缺页次数。只处理同一张L2页表内、已预留但尚未分配的页表项。
+ *
+ */
+static void
+__fault_around(struct mm_region* region, uintptr_t va)
+{
+    uintptr_t last = __current->mm.last_fault;
+    __current->mm.last_fault = va;
+
+    int dir;
+    if (va == last + PG_SIZE) {
+        dir = 1;
+    } else if (va == last - PG_SIZE) {
+        dir = -1;
+    } else {
+        return;
+    }
+
+    uintptr_t cur = va;
+    for (u32_t i = 1; i < fault_around; i++) {
+        uintptr_t next = cur + dir * PG_SIZE;
+        if (next < region->start || next >= region->end ||
+            L1_INDEX(next) != L1_INDEX(va)) {
+            break;
+        }
+
+        // 未present的页表项不会被TLB缓存，无需刷新
+        x86_pte_t* pte = &PTE_MOUNTED(PD_REFERENCED, next >> 12);
+        if (!(*pte & 0xfff) || (*pte & (PG_PRESENT | ~0xfff))) {
+            break;
+        }
+
+        uintptr_t pa = pmm_alloc_zeroed(__current->pid);
+        if (!pa) {
+            break;
+        }
+
+        *pte = *pte | pa | PG_PRESENT;
+        cur = next;
+    }
+
+    __current->mm.last_fault = cur;
+}
+
 void
 intr_routine_page_fault(const isr_param* param)
 {
     uintptr_t ptr = cpu_rcr2();
+    tracepoint(TP_PAGE_FAULT, ptr, param->eip, param->err_code);
+
     if (!ptr) {
         goto segv_term;
     }
@@ -52,12 +114,21 @@ intr_routine_page_fault(const isr_param* param)
     }
 
     volatile x86_pte_t* pte = &PTE_MOUNTED(PD_REFERENCED, ptr >> 12);
+
+    // 页表仍与父/子进程共享，先为当前进程复制一份。若页本身可写，则错误仅源于页目录项。
+    if (vmm_unshare_pt(PD_REFERENCED, L1_INDEX(ptr)) &&
+        (*pte & (PG_PRESENT | PG_WRITE)) == (PG_PRESENT | PG_WRITE)) {
+        goto resolved;
+    }
+
     if ((*pte & PG_PRESENT)) {
         if ((hit_region->attr & COW_MASK) == COW_MASK) {
             // normal page fault, do COW
             cpu_invplg(pte);
-            uintptr_t pa =
-              (uintptr_t)vmm_dup_page(__current->pid, PG_ENTRY_ADDR(*pte));
+            uintptr_t src = PG_ENTRY_ADDR(*pte);
+            uintptr_t pa = src == pmm_zero_page()
+                             ? pmm_alloc_zeroed(__current->pid)
+                             : (uintptr_t)vmm_dup_page(__current->pid, src);
             pmm_free_page(__current->pid, *pte & ~0xFFF);
             *pte = (*pte & 0xFFF) | pa | PG_WRITE;
             goto resolved;
@@ -73,21 +144,59 @@ intr_routine_page_fault(const isr_param* param)
 
     uintptr_t loc = *pte & ~0xfff;
 
-    // a writable page, not present, not cached, pte attr is not null
+    // 文件映射，从页缓存中取得对应的页
+    if (hit_region->mfile && !loc) {
+        cpu_invplg(pte);
+        if (mmap_fault(hit_region, ptr, pte)) {
+            goto resolved;
+        }
+        goto segv_term;
+    }
+
+    // an accessible page, not present, not cached, pte attr is not null
     //   -> a new page need to be alloc
-    if ((hit_region->attr & REGION_WRITE) && (*pte & 0xfff) && !loc) {
+    if ((hit_region->attr & (REGION_READ | REGION_WRITE)) && (*pte & 0xfff) &&
+        !loc) {
         cpu_invplg(pte);
-        uintptr_t pa = pmm_alloc_page(__current->pid, 0);
+
+        // 首次读取：映射共享的零页，待写入时再经由COW分配。
+        // 这要求该区域要么不可写，要么可写时会应用COW。
+        int attr = hit_region->attr;
+        if (!(param->err_code & PFAULT_WRITE) &&
+            (!(attr & REGION_WRITE) || (attr & COW_MASK) == COW_MASK)) {
+            *pte = (*pte & ~PG_WRITE) | pmm_zero_page() | PG_PRESENT;
+            goto resolved;
+        }
+
+        uintptr_t pa = pmm_alloc_zeroed(__current->pid);
         *pte = *pte | pa | PG_PRESENT;
+        __fault_around(hit_region, PG_ALIGN(ptr));
         goto resolved;
     }
 
+    // 已换出至交换区的页
+    if (PG_IS_SWAPPED(*pte)) {
+        if (swap_fault(hit_region, ptr, pte)) {
+            goto resolved;
+        }
+        goto segv_term;
+    }
+
     // page not present, bring it from disk or somewhere else
     __print_panic_msg("WIP page fault route", param);
     while (1)
         ;
 
 segv_term:
+    if (!SEL_RPL(param->cs)) {
+        // 内核经由 copy_to_user 等访问用户空间时出错，交由修复代码处理
+        uintptr_t fixup = uaccess_fixup(param->eip);
+        if (fixup) {
+            ((isr_param*)param)->eip = fixup;
+            return;
+        }
+    }
+
     kprintf(KERROR "(pid: %d) Segmentation fault on %p (%p:%p)\n",
             __current->pid,
             ptr,
@@ -104,6 +213,36 @@ resolved:
     return;
 }
 
+static int
+__pfault_rd_around(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (fpos) {
+        return 0;
+    }
+    return ksnprintf(buffer, len, "%u\n", fault_around);
+}
+
+static int
+__pfault_wr_around(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    u32_t val = 0;
+    char* str = (char*)buffer;
+    for (size_t i = 0; i < len && '0' <= str[i] && str[i] <= '9'; i++) {
+        val = val * 10 + (str[i] - '0');
+    }
+
+    fault_around = MIN(MAX(val, 1), FAULT_AROUND_MAX);
+    return len;
+}
+
+void
+pfault_export()
+{
+    struct twifs_node* node = twifs_file_node(NULL, "pfault_around");
+    node->ops.read = __pfault_rd_around;
+    node->ops.write = __pfault_wr_around;
+}
+
 int
 do_kernel(v_mapping* mapping)
 {
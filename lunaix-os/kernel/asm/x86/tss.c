@@ -1,10 +1,14 @@
 #include <arch/x86/tss.h>
+#include <hal/smp.h>
 #include <lunaix/common.h>
 
 volatile struct x86_tss _tss = { .link = 0,
                                  .esp0 = KSTACK_TOP,
                                  .ss0 = KDATA_SEG };
 
+// 下标为处理器编号，其中0号（BSP）使用上面的 _tss
+struct x86_tss _ap_tss[SMP_MAX_CPU];
+
 void
 tss_update_esp(u32_t esp0)
 {
@@ -0,0 +1,68 @@
+/**
+ * @file uaccess.c
+ * @brief 可容忍页错误的用户空间访问
+ *
+ * 复制由 rep movsl/movsb 完成。两条指令均登记于异常修复表（__ex_table），
+ * 若其访问的用户页无法被页错误处理程序解决，执行流将转至对应的修复代码，
+ * 此时 ecx 中残余的计数即为未能复制的量。
+ *
+ */
+#include <lunaix/mm/uaccess.h>
+
+extern struct exception_entry __ex_table_start[];
+extern struct exception_entry __ex_table_end[];
+
+static size_t
+__copy_user(void* to, const void* from, size_t len)
+{
+    size_t tail = len & 3;
+    size_t remain = len >> 2;
+
+    asm volatile("1: rep movsl\n"
+                 "   movl %3, %%ecx\n"
+                 "2: rep movsb\n"
+                 "   jmp 4f\n"
+                 // movsl 中途出错：换算成剩余的字节数
+                 "3: leal (%3, %%ecx, 4), %%ecx\n"
+                 "4:\n"
+                 ".pushsection __ex_table, \"a\"\n"
+                 "   .long 1b, 3b\n"
+                 "   .long 2b, 4b\n"
+                 ".popsection\n"
+                 : "+D"(to), "+S"(from), "+c"(remain)
+                 : "r"(tail)
+                 : "memory");
+
+    return remain;
+}
+
+size_t
+copy_to_user(void* to, const void* from, size_t len)
+{
+    if (!uaccess_ok(to, len)) {
+        return len;
+    }
+    return __copy_user(to, from, len);
+}
+
+size_t
+copy_from_user(void* to, const void* from, size_t len)
+{
+    if (!uaccess_ok(from, len)) {
+        return len;
+    }
+    return __copy_user(to, from, len);
+}
+
+uintptr_t
+uaccess_fixup(uintptr_t eip)
+{
+    // 表项很少，线性查找即可
+    for (struct exception_entry* e = __ex_table_start; e < __ex_table_end;
+         e++) {
+        if (e->insn == eip) {
+            return e->fixup;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file bcache.c
+ * @brief 块设备层的缓冲缓存，用于文件系统元数据（卷描述符、目录记录等）
+ *
+ * 缓冲缓存即物理设备在 devfs 中的 inode（如 /dev/sda）的页缓存：元数据以
+ * 设备上的绝对偏移读入其中，由该设备的所有分区共用。经由 devfs 读写整个
+ * 设备与文件系统读取元数据因而共享同一份页帧，并与其他文件的页同处一个
+ * LRU，由页缓存统一回收，不再另设上限。
+ *
+ * 经由块设备的写操作会使所覆盖的缓存页失效，以保持一致。分区在 devfs 中的
+ * inode 仍有各自的页缓存（分区的起始未必按页对齐），与之互为别名。
+ *
+ */
+#include <lunaix/block.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/devfs.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+
+extern struct lru_zone* inode_lru;
+
+void
+bcache_setup(struct block_dev* bdev)
+{
+    // 无法分配时留空，读取将直接转交设备
+    bdev->bcache = devfs_vol_inode(bdev->dev);
+}
+
+int
+bcache_read(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    struct block_dev* bdev = (struct block_dev*)dev->underlay;
+
+    if ((dev->dev_type & DEV_MSKIF) != DEV_IFVOL || !bdev->bcache) {
+        return dev->read(dev, buf, offset, len);
+    }
+
+    struct v_inode* inode = bdev->bcache;
+    size_t bsize = bdev->blk_size;
+    foff_t size = (bdev->end_lba - bdev->start_lba + 1) * bsize;
+
+    if (offset >= size) {
+        return 0;
+    }
+    len = MIN(len, size - offset);
+
+    lock_inode(inode);
+    int errno =
+      pcache_read(inode, buf, len, bdev->start_lba * bsize + offset, NULL);
+    unlock_inode(inode);
+
+    return errno;
+}
+
+static void
+__bcache_drop(struct block_dev* bdev, u64_t lba, size_t count)
+{
+    struct v_inode* inode = bdev->bcache;
+    if (!inode || !count || !inode->pg_cache->n_pages) {
+        return;
+    }
+
+    // 持锁者即我们自己时（如对整个设备的 ioctl），无需也不可再次加锁
+    int held =
+      mutex_on_hold(&inode->lock) && inode->lock.owner == __current->pid;
+
+    if (!held) {
+        lock_inode(inode);
+    }
+
+    size_t bsize = bdev->blk_size;
+    pcache_drop_range(inode, lba * bsize, (lba + count) * bsize - 1);
+
+    if (!held) {
+        unlock_inode(inode);
+    }
+}
+
+void
+bcache_invalidate(struct block_dev* bdev, u64_t lba, size_t count)
+{
+    __bcache_drop(bdev, lba, count);
+}
+
+void
+bcache_invalidate_alias(struct block_dev* bdev, u64_t lba, size_t count)
+{
+    // 写入的正是缓冲缓存自身的页（回写，或已由VFS处理过缓存的直接I/O）。
+    //  丢弃它们会在回写中途释放正被写出的页
+    if (!bdev->bcache || bdev->bcache->data == bdev->dev) {
+        return;
+    }
+
+    __bcache_drop(bdev, lba, count);
+}
@@ -1,5 +1,11 @@
+#include <hal/cpu.h>
+#include <klibc/stdio.h>
 #include <lunaix/block.h>
 #include <lunaix/fs/twifs.h>
+#include <lunaix/status.h>
+
+// 轮询时长的上限（微秒）
+#define BLK_POLL_MAX_US 1000
 
 static struct twifs_node* blk_root;
 
@@ -46,6 +52,47 @@ __blk_rd_size(struct twimap* map)
       map, "%u", (u32_t)(bdev->end_lba - bdev->start_lba) * bdev->blk_size);
 }
 
+static struct blkio_stats*
+__blk_stats(struct block_dev* bdev)
+{
+    return bdev->stats ? bdev->stats : &bdev->blkio->stats;
+}
+
+void
+__blk_rd_stat(struct twimap* map)
+{
+    struct block_dev* bdev = twimap_data(map, struct block_dev*);
+    struct blkio_stats* stats = __blk_stats(bdev);
+
+    // rd_ios rd_blocks wr_ios wr_blocks errors merges in_flight queued
+    //  flushes discards
+    //  在途与排队的请求数属于整个设备，分区与之共享
+    twimap_printf(map,
+                  "%u %u %u %u %u %u %u %u %u %u\n",
+                  stats->rd_ios,
+                  (u32_t)stats->rd_blocks,
+                  stats->wr_ios,
+                  (u32_t)stats->wr_blocks,
+                  stats->errors,
+                  stats->merges,
+                  bdev->blkio->busy,
+                  bdev->blkio->queued,
+                  stats->flushes,
+                  stats->discards);
+}
+
+void
+__blk_rd_latency(struct twimap* map)
+{
+    struct block_dev* bdev = twimap_data(map, struct block_dev*);
+    struct blkio_stats* stats = __blk_stats(bdev);
+
+    // 每行：区间下界（微秒） 请求数
+    for (int i = 0; i < BLKIO_LAT_BUCKETS; i++) {
+        twimap_printf(map, "%u %u\n", i ? 1U << i : 0, stats->lat_hist[i]);
+    }
+}
+
 void
 __map_internal(struct block_dev* bdev, void* fsnode)
 {
@@ -65,6 +112,170 @@ __map_internal(struct block_dev* bdev, void* fsnode)
 
     map = twifs_mapping(dev_root, bdev, "end");
     map->read = __blk_rd_end_lba;
+
+    map = twifs_mapping(dev_root, bdev, "stat");
+    map->read = __blk_rd_stat;
+
+    map = twifs_mapping(dev_root, bdev, "latency");
+    map->read = __blk_rd_latency;
+}
+
+static int
+__blk_rd_sched(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (fpos) {
+        return 0;
+    }
+
+    struct block_dev* bdev = twinode_getdata(inode, struct block_dev*);
+    return blkio_sched_list(bdev->blkio, buffer, len);
+}
+
+static int
+__blk_wr_sched(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct block_dev* bdev = twinode_getdata(inode, struct block_dev*);
+    char* name = (char*)buffer;
+    size_t n = 0;
+
+    while (n < len && name[n] > ' ') {
+        n++;
+    }
+
+    struct blkio_sched* sched = blkio_sched_find(name, n);
+    if (!sched) {
+        return EINVAL;
+    }
+
+    // 调度器的操作与请求的提交、完成之间须互斥
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+    blkio_set_sched(bdev->blkio, sched);
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    return len;
+}
+
+static int
+__blk_rd_poll(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (fpos) {
+        return 0;
+    }
+
+    struct block_dev* bdev = twinode_getdata(inode, struct block_dev*);
+    return ksnprintf(buffer, len, "%u\n", bdev->blkio->poll_us);
+}
+
+static int
+__blk_wr_poll(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct block_dev* bdev = twinode_getdata(inode, struct block_dev*);
+    char* str = (char*)buffer;
+    u32_t us = 0;
+
+    for (size_t i = 0; i < len && '0' <= str[i] && str[i] <= '9'; i++) {
+        us = us * 10 + (str[i] - '0');
+    }
+
+    if (!bdev->blkio->poll) {
+        return ENOTSUP;
+    }
+
+    // 轮询期间中断关闭，时长须加以限制
+    if (us > BLK_POLL_MAX_US) {
+        return EINVAL;
+    }
+
+    blkio_set_poll(bdev->blkio, us);
+    return len;
+}
+
+static int
+__blk_rd_trace_en(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (fpos) {
+        return 0;
+    }
+
+    struct block_dev* bdev = twinode_getdata(inode, struct block_dev*);
+    struct blkio_trace* trace = bdev->blkio->trace;
+    return ksnprintf(buffer, len, "%u\n", trace ? trace->enabled : 0);
+}
+
+static int
+__blk_wr_trace_en(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct block_dev* bdev = twinode_getdata(inode, struct block_dev*);
+
+    if (!len) {
+        return EINVAL;
+    }
+
+    blkio_trace_enable(bdev->blkio, *(char*)buffer != '0');
+    return len;
+}
+
+static void
+__blk_trace_reset(struct twimap* map)
+{
+    struct block_dev* bdev = twimap_data(map, struct block_dev*);
+    struct blkio_trace* trace = bdev->blkio->trace;
+
+    // 从环中最早的事件开始
+    u32_t head = trace ? trace->head : 0;
+    map->index = (void*)(head > BLKIO_TRACE_NR ? head - BLKIO_TRACE_NR : 0);
+}
+
+static int
+__blk_trace_next(struct twimap* map)
+{
+    struct block_dev* bdev = twimap_data(map, struct block_dev*);
+    struct blkio_trace* trace = bdev->blkio->trace;
+    u32_t seq = twimap_index(map, u32_t) + 1;
+
+    if (!trace || seq >= trace->head) {
+        return 0;
+    }
+
+    map->index = (void*)seq;
+    return 1;
+}
+
+static void
+__blk_rd_trace(struct twimap* map)
+{
+    static const char events[] = { 'Q', 'D', 'I', 'C' };
+
+    struct block_dev* bdev = twimap_data(map, struct block_dev*);
+    struct blkio_trace* trace = bdev->blkio->trace;
+    struct blkio_trace_ent ent;
+
+    // 读取期间被新事件覆盖的项则略去
+    if (!trace || !blkio_trace_get(trace, twimap_index(map, u32_t), &ent)) {
+        return;
+    }
+
+    char type = 'R';
+    if ((ent.flags & BLKIO_FLUSH)) {
+        type = 'F';
+    } else if ((ent.flags & BLKIO_DISCARD)) {
+        type = 'T';
+    } else if ((ent.flags & BLKIO_WRITE)) {
+        type = 'W';
+    }
+
+    // 时间（微秒） 事件 类型 LBA 块数 错误码
+    twimap_printf(map,
+                  "%u %c %c %u %u %x\n",
+                  (u32_t)(ent.time_ns / 1000),
+                  events[ent.event & 3],
+                  type,
+                  (u32_t)ent.lba,
+                  ent.blocks,
+                  ent.errcode);
 }
 
 void
@@ -74,6 +285,29 @@ blk_set_blkmapping(struct block_dev* bdev, void* fsnode)
 
     __map_internal(bdev, dev_root);
 
+    // 分区与其所在的设备共用同一个blkio上下文，因此只在设备一级提供
+    struct twifs_node* node = twifs_file_node(dev_root, "scheduler");
+    node->data = bdev;
+    node->ops.read = __blk_rd_sched;
+    node->ops.write = __blk_wr_sched;
+
+    // 同步请求轮询完成的时长（微秒），0为不轮询
+    node = twifs_file_node(dev_root, "poll_us");
+    node->data = bdev;
+    node->ops.read = __blk_rd_poll;
+    node->ops.write = __blk_wr_poll;
+
+    // 请求事件的追踪：写入1/0以开启/关闭，经由trace读取
+    node = twifs_file_node(dev_root, "trace_enable");
+    node->data = bdev;
+    node->ops.read = __blk_rd_trace_en;
+    node->ops.write = __blk_wr_trace_en;
+
+    struct twimap* map = twifs_mapping(dev_root, bdev, "trace");
+    map->reset = __blk_trace_reset;
+    map->go_next = __blk_trace_next;
+    map->read = __blk_rd_trace;
+
     struct block_dev *pos, *n;
     llist_for_each(pos, n, &bdev->parts, parts)
     {
@@ -1,35 +1,81 @@
 #include <lunaix/blkio.h>
 #include <lunaix/mm/cake.h>
+#include <lunaix/mm/mempool.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/trace.h>
+#include <lunaix/workqueue.h>
 
 #include <hal/cpu.h>
 
-static struct cake_pile* blkio_reqpile;
+// Upper bound of a merged request, keeps the sector count of the resulting
+//  command small enough for any transfer mode
+#define BLKIO_MERGE_MAX 0x10000
+
+// Upper bound of poll iterations, in case the system clock does not advance
+//  with interrupts disabled (i.e., no TSC as clock source)
+#define BLKIO_POLL_MAX_SPIN 1000000
+
+// Requests kept in reserve, so that the writeback path, which is what frees
+//  memory under pressure, can always issue its I/O
+#define BLKIO_REQ_RESERVE 16
+
+static struct mempool* blkio_reqpool;
+
+// requests completed by hardware, waiting to be finalized by blkio_done_work
+static DEFINE_LLIST(blkio_done);
+static struct lx_work blkio_done_work;
+
+static void
+__blkio_done(void* arg);
 
 void
 blkio_init()
 {
-    blkio_reqpile = cake_new_pile("blkio_req", sizeof(struct blkio_req), 1, 0);
+    struct cake_pile* pile = cake_new_pile(
+      "blkio_req", sizeof(struct blkio_req), 1, PILE_HWALIGN);
+    blkio_reqpool = mempool_create(pile, BLKIO_REQ_RESERVE);
+
+    work_init(&blkio_done_work, __blkio_done, NULL);
 }
 
 static inline struct blkio_req*
-__blkio_req_create(struct vecbuf* buffer,
-                   u64_t start_lba,
-                   blkio_cb completed,
-                   void* evt_args,
-                   u32_t options)
+__blkio_req_init(struct blkio_req* breq,
+                 struct vecbuf* buffer,
+                 u64_t start_lba,
+                 blkio_cb completed,
+                 void* evt_args,
+                 u32_t options)
 {
     options = options & ~0xf;
-    struct blkio_req* breq = (struct blkio_req*)cake_grab(blkio_reqpile);
     *breq = (struct blkio_req){ .blk_addr = start_lba,
                                 .completed = completed,
                                 .flags = options,
                                 .evt_args = evt_args };
-    breq->vbuf = buffer;
-    waitq_init(&breq->wait);
+    if (buffer) {
+        // the request takes over the segments
+        breq->vbuf = *buffer;
+        *buffer = (struct vecbuf){ 0 };
+    }
+    llist_init_head(&breq->fifo);
+    llist_init_head(&breq->merged);
+    event_init(&breq->done);
     return breq;
 }
 
+static inline struct blkio_req*
+__blkio_req_create(struct vecbuf* buffer,
+                   u64_t start_lba,
+                   blkio_cb completed,
+                   void* evt_args,
+                   u32_t options)
+{
+    // never fails, at worst waits for an in-flight request to be freed
+    struct blkio_req* breq = mempool_alloc(blkio_reqpool, 0);
+    return __blkio_req_init(
+      breq, buffer, start_lba, completed, evt_args, options);
+}
+
 struct blkio_req*
 blkio_vrd(struct vecbuf* buffer,
           u64_t start_lba,
@@ -53,10 +99,34 @@ blkio_vwr(struct vecbuf* buffer,
     return breq;
 }
 
+struct blkio_req*
+blkio_flush(blkio_cb completed, void* evt_args, u32_t options)
+{
+    struct blkio_req* breq =
+      __blkio_req_create(NULL, 0, completed, evt_args, options);
+    breq->flags |= BLKIO_FLUSH;
+    return breq;
+}
+
+struct blkio_req*
+blkio_discard(u64_t start_lba,
+              u32_t count,
+              blkio_cb completed,
+              void* evt_args,
+              u32_t options)
+{
+    struct blkio_req* breq =
+      __blkio_req_create(NULL, start_lba, completed, evt_args, options);
+    breq->flags |= BLKIO_DISCARD;
+    breq->blk_count = count;
+    return breq;
+}
+
 void
 blkio_free_req(struct blkio_req* req)
 {
-    cake_release(blkio_reqpile, (void*)req);
+    vbuf_free(&req->vbuf);
+    mempool_free(blkio_reqpool, (void*)req);
 }
 
 struct blkio_context*
@@ -65,18 +135,218 @@ blkio_newctx(req_handler handler)
     struct blkio_context* ctx =
       (struct blkio_context*)vzalloc(sizeof(struct blkio_context));
     ctx->handle_one = handler;
+    ctx->depth = 1;
+    ctx->max_segs = 1;
 
     llist_init_head(&ctx->queue);
+    llist_init_head(&ctx->held);
+    llist_init_head(&ctx->fifo[0]);
+    llist_init_head(&ctx->fifo[1]);
+    blkio_set_sched(ctx, blkio_sched_find("deadline", 8));
 
     return ctx;
 }
 
+// Merging may happen in the completion work (see __blkio_lift_barrier), where
+//  we must not sleep. Allocations there never wait, merging is simply skipped
+//  when they fail.
+static int
+__blkio_join_vbuf(struct vecbuf* joined,
+                  struct vecbuf* first,
+                  struct vecbuf* second)
+{
+    struct membuf* seg;
+    struct vecbuf* parts[] = { first, second };
+
+    *joined = (struct vecbuf){ 0 };
+    for (int i = 0; i < 2; i++) {
+        vbuf_foreach(seg, parts[i])
+        {
+            if (vbuf_append(joined, seg->buffer, seg->size)) {
+                vbuf_free(joined);
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static struct blkio_req*
+__blkio_make_composite(struct blkio_req* req)
+{
+    struct blkio_req* merged = mempool_alloc(blkio_reqpool, MEMPOOL_NOWAIT);
+    if (!merged) {
+        return NULL;
+    }
+
+    __blkio_req_init(merged, NULL, req->blk_addr, NULL, NULL, BLKIO_FOC);
+    merged->flags |= BLKIO_MERGED | BLKIO_PENDING | (req->flags & BLKIO_WRITE);
+    merged->io_ctx = req->io_ctx;
+    merged->deadline = req->deadline;
+
+    // take over req's place in both the queue and the deadline FIFO
+    llist_prepend(&req->reqs, &merged->reqs);
+    llist_delete(&req->reqs);
+    llist_prepend(&req->fifo, &merged->fifo);
+    llist_delete(&req->fifo);
+
+    llist_append(&merged->merged, &req->reqs);
+    return merged;
+}
+
+static int
+__blkio_try_merge(struct blkio_context* ctx, struct blkio_req* req)
+{
+    // BLKIO_EXCL requests never get here, nor into the queue
+    if (ctx->max_segs <= 1 || !ctx->blk_size) {
+        return 0;
+    }
+
+    size_t size = vbuf_size(&req->vbuf);
+    size_t segs = req->vbuf.nr_segs;
+    u64_t end = req->blk_addr + size / ctx->blk_size;
+
+    if ((size % ctx->blk_size)) {
+        return 0;
+    }
+
+    struct blkio_req *pos, *n;
+    llist_for_each(pos, n, &ctx->queue, reqs)
+    {
+        if ((pos->flags & BLKIO_WRITE) != (req->flags & BLKIO_WRITE)) {
+            continue;
+        }
+
+        size_t pos_sz = vbuf_size(&pos->vbuf);
+        if (pos_sz + size > BLKIO_MERGE_MAX ||
+            pos->vbuf.nr_segs + segs > ctx->max_segs) {
+            continue;
+        }
+
+        int back = pos->blk_addr + pos_sz / ctx->blk_size == req->blk_addr;
+        if (!back && end != pos->blk_addr) {
+            continue;
+        }
+
+        // a composite's buffer is the concatenation of those of its parts
+        struct vecbuf vbuf;
+        int joined = back ? __blkio_join_vbuf(&vbuf, &pos->vbuf, &req->vbuf)
+                          : __blkio_join_vbuf(&vbuf, &req->vbuf, &pos->vbuf);
+        if (!joined) {
+            return 0;
+        }
+
+        if (!(pos->flags & BLKIO_MERGED) &&
+            !(pos = __blkio_make_composite(pos))) {
+            vbuf_free(&vbuf);
+            return 0;
+        }
+
+        if (back) {
+            llist_append(&pos->merged, &req->reqs);
+        } else {
+            llist_prepend(&pos->merged, &req->reqs);
+            pos->blk_addr = req->blk_addr;
+        }
+
+        vbuf_free(&pos->vbuf);
+        pos->vbuf = vbuf;
+        ctx->stats.merges++;
+        if (req->stats) {
+            req->stats->merges++;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+__blkio_enqueue(struct blkio_context* ctx, struct blkio_req* req)
+{
+    if (ctx->barrier) {
+        // held back until the barrier completes, to keep it ordered
+        llist_append(&ctx->held, &req->reqs);
+    } else if ((req->flags & BLKIO_EXCL)) {
+        ctx->barrier = req;
+    } else if (__blkio_try_merge(ctx, req)) {
+        return;
+    } else {
+        ctx->sched->add(ctx, req);
+    }
+
+    ctx->queued++;
+}
+
+static void
+__blkio_lift_barrier(struct blkio_context* ctx)
+{
+    ctx->barrier = NULL;
+
+    // stop at the next barrier, those after it stay held in order
+    while (!ctx->barrier && !llist_empty(&ctx->held)) {
+        struct blkio_req* req =
+          list_entry(ctx->held.next, struct blkio_req, reqs);
+        llist_delete(&req->reqs);
+
+        ctx->queued--;
+        __blkio_enqueue(ctx, req);
+    }
+}
+
+void
+blkio_set_poll(struct blkio_context* ctx, u32_t us)
+{
+    ctx->poll_us = us;
+}
+
+static int
+__blkio_poll(struct blkio_context* ctx, struct blkio_req* req)
+{
+    u64_t until = clock_systime_ns() + (u64_t)ctx->poll_us * 1000;
+
+    for (u32_t i = 0; i < BLKIO_POLL_MAX_SPIN; i++) {
+        // finalize right here, rather than waiting for the workqueue to be
+        //  scheduled, which is the very latency we are trying to avoid
+        if (ctx->poll(ctx)) {
+            __blkio_done(NULL);
+        }
+
+        if (!(req->flags & BLKIO_PENDING)) {
+            return 1;
+        }
+
+        if (clock_systime_ns() >= until) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void
+__blkio_wait(struct blkio_context* ctx, struct blkio_req* req)
+{
+    // a request reaped by polling has signaled its event already, the wait
+    //  below then returns right away
+    if (ctx->poll && ctx->poll_us) {
+        __blkio_poll(ctx, req);
+    }
+
+    event_wait(&req->done);
+}
+
 void
 blkio_commit(struct blkio_context* ctx, struct blkio_req* req, int options)
 {
     req->flags |= BLKIO_PENDING;
     req->io_ctx = ctx;
-    llist_append(&ctx->queue, &req->reqs);
+    req->commit_ns = clock_systime_ns();
+
+    blkio_trace(req, BLKIO_TR_COMMIT);
+    tracepoint(TP_BLKIO_COMMIT, req->blk_addr, req->blk_count, req->flags);
+    __blkio_enqueue(ctx, req);
 
     // if the pipeline is not running (e.g., stalling). Then we should schedule
     // one immediately and kick it started.
@@ -89,51 +359,199 @@ blkio_commit(struct blkio_context* ctx, struct blkio_req* req, int options)
     // As we don't want to overwhelming the interrupt context and also keep the
     // request RTT as small as possible, hence #1 is preferred.
 
-    if (!ctx->busy) {
+    if (ctx->plugged && !(options & BLKIO_WAIT)) {
+        // dispatched in batch on blkio_unplug
+        return;
+    }
+
+    if (ctx->busy < ctx->depth) {
         if ((options & BLKIO_WAIT)) {
             cpu_disable_interrupt();
             blkio_schedule(ctx);
-            pwait(&req->wait);
+            __blkio_wait(ctx, req);
             return;
         }
         blkio_schedule(ctx);
     } else if ((options & BLKIO_WAIT)) {
-        pwait(&req->wait);
+        event_wait(&req->done);
     }
 }
 
 void
-blkio_schedule(struct blkio_context* ctx)
+blkio_plug(struct blkio_context* ctx)
+{
+    ctx->plugged++;
+}
+
+void
+blkio_unplug(struct blkio_context* ctx)
 {
-    if (llist_empty(&ctx->queue)) {
+    assert(ctx->plugged);
+
+    if (--ctx->plugged) {
         return;
     }
 
-    struct blkio_req* head = (struct blkio_req*)ctx->queue.next;
-    llist_delete(&head->reqs);
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+    blkio_schedule(ctx);
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
 
-    head->flags |= BLKIO_BUSY;
-    head->io_ctx->busy++;
+static inline void
+__blkio_dispatch(struct blkio_context* ctx, struct blkio_req* req)
+{
+    ctx->queued--;
+    req->flags |= BLKIO_BUSY;
+    ctx->busy++;
 
-    ctx->handle_one(head);
+    blkio_trace(req, BLKIO_TR_DISPATCH);
+    ctx->handle_one(req);
 }
 
 void
-blkio_complete(struct blkio_req* req)
+blkio_schedule(struct blkio_context* ctx)
+{
+    struct blkio_req* head;
+    while (ctx->busy < ctx->depth && (head = ctx->sched->next(ctx))) {
+        __blkio_dispatch(ctx, head);
+    }
+
+    // the scheduler has run dry and nothing is in flight: everything before
+    //  the barrier has completed
+    head = ctx->barrier;
+    if (head && !ctx->busy && !(head->flags & BLKIO_BUSY)) {
+        __blkio_dispatch(ctx, head);
+    }
+}
+
+static void
+__blkio_account(struct blkio_stats* stats, struct blkio_req* req, u32_t us)
+{
+    u32_t blocks = vbuf_size(&req->vbuf) / req->io_ctx->blk_size;
+
+    if ((req->flags & BLKIO_ERROR)) {
+        stats->errors++;
+    } else if ((req->flags & BLKIO_FLUSH)) {
+        stats->flushes++;
+    } else if ((req->flags & BLKIO_DISCARD)) {
+        stats->discards++;
+    } else if ((req->flags & BLKIO_WRITE)) {
+        stats->wr_ios++;
+        stats->wr_blocks += blocks;
+    } else {
+        stats->rd_ios++;
+        stats->rd_blocks += blocks;
+    }
+
+    u32_t bucket = 0;
+    while (us > 1 && bucket < BLKIO_LAT_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    stats->lat_hist[bucket]++;
+}
+
+static void
+__blkio_finish(struct blkio_req* req)
 {
     req->flags &= ~(BLKIO_BUSY | BLKIO_PENDING);
 
+    if ((req->flags & BLKIO_MERGED)) {
+        // the outcome of the composite is the outcome of every part of it
+        while (!llist_empty(&req->merged)) {
+            struct blkio_req* part =
+              list_entry(req->merged.next, struct blkio_req, reqs);
+            llist_delete(&part->reqs);
+
+            part->errcode = req->errcode;
+            part->flags |= req->flags & BLKIO_ERROR;
+            __blkio_finish(part);
+        }
+    } else if (req->io_ctx->blk_size) {
+        // composites are accounted through their parts
+        u32_t us = (u32_t)((clock_systime_ns() - req->commit_ns) / 1000);
+        __blkio_account(&req->io_ctx->stats, req, us);
+        if (req->stats) {
+            __blkio_account(req->stats, req, us);
+        }
+    }
+
     if (req->completed) {
         req->completed(req);
     }
 
     // Wake all blocked processes on completion,
     //  albeit should be no more than one process in everycase (by design)
-    pwake_all(&req->wait);
+    event_signal(&req->done);
 
     if ((req->flags & BLKIO_FOC)) {
         blkio_free_req(req);
     }
+}
+
+void
+blkio_complete(struct blkio_req* req)
+{
+    struct blkio_context* ctx = req->io_ctx;
+
+    blkio_trace(req, BLKIO_TR_COMPLETE);
+    tracepoint(TP_BLKIO_COMPLETE, req->blk_addr, req->blk_count, req->errcode);
+
+    ctx->busy--;
+    if (req == ctx->barrier) {
+        __blkio_lift_barrier(ctx);
+    }
+    __blkio_finish(req);
+}
+
+void
+blkio_complete_async(struct blkio_req* req)
+{
+    blkio_trace(req, BLKIO_TR_COMPLETE);
+    tracepoint(TP_BLKIO_COMPLETE, req->blk_addr, req->blk_count, req->errcode);
+
+    // the request is no longer on its context queue (see blkio_schedule),
+    //  so we can safely reuse the list node.
+    llist_append(&blkio_done, &req->reqs);
+    work_submit(&blkio_done_work);
+}
+
+static void
+__blkio_done(void* arg)
+{
+    struct blkio_req *pos, *n;
+
+    // works are executed with interrupt disabled, no race with the producer.
+    // Release all slots freed by this batch first, so each context is
+    //  refilled only once, with as many requests as it can take.
+    llist_for_each(pos, n, &blkio_done, reqs)
+    {
+        struct blkio_context* ctx = pos->io_ctx;
+
+        ctx->busy--;
+        if (pos == ctx->barrier) {
+            __blkio_lift_barrier(ctx);
+        }
+    }
+
+    // refill before running the callbacks, keeping the device busy meanwhile
+    llist_for_each(pos, n, &blkio_done, reqs)
+    {
+        struct blkio_context* ctx = pos->io_ctx;
+        if (!(ctx->state & BLKIO_SCHED_KICKED)) {
+            ctx->state |= BLKIO_SCHED_KICKED;
+            blkio_schedule(ctx);
+        }
+    }
 
-    req->io_ctx->busy--;
+    while (!llist_empty(&blkio_done)) {
+        struct blkio_req* req = (struct blkio_req*)blkio_done.next;
+        llist_delete(&req->reqs);
+
+        req->io_ctx->state &= ~BLKIO_SCHED_KICKED;
+        __blkio_finish(req);
+    }
 }
\ No newline at end of file
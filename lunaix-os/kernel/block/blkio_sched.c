@@ -0,0 +1,190 @@
+/**
+ * @file blkio_sched.c
+ * @brief I/O schedulers for blkio_context
+ *
+ * fifo      Dispatch in arrival order.
+ * clook     Circular LOOK elevator. Requests are kept sorted by LBA and
+ *           served in one direction from the current head position, jumping
+ *           back to the lowest LBA once nothing is left ahead.
+ * deadline  C-LOOK plus per-direction FIFOs with an expiry. A request that
+ *           has waited past its deadline is served first, reads being checked
+ *           before writes, so neither starves under a busy elevator.
+ *
+ */
+#include <klibc/stdio.h>
+#include <klibc/string.h>
+#include <lunaix/blkio.h>
+#include <lunaix/spike.h>
+
+#define DEADLINE_READ_MS 500
+#define DEADLINE_WRITE_MS 5000
+
+#define __dir(req) (!!((req)->flags & BLKIO_WRITE))
+
+static void
+__fifo_add(struct blkio_context* ctx, struct blkio_req* req)
+{
+    llist_append(&ctx->queue, &req->reqs);
+}
+
+static struct blkio_req*
+__fifo_next(struct blkio_context* ctx)
+{
+    if (llist_empty(&ctx->queue)) {
+        return NULL;
+    }
+
+    struct blkio_req* req = list_entry(ctx->queue.next, struct blkio_req, reqs);
+    llist_delete(&req->reqs);
+    return req;
+}
+
+static void
+__clook_add(struct blkio_context* ctx, struct blkio_req* req)
+{
+    // Walk from the tail, sequential streams mostly append
+    struct llist_header* pos = ctx->queue.prev;
+    for (; pos != &ctx->queue; pos = pos->prev) {
+        struct blkio_req* r = list_entry(pos, struct blkio_req, reqs);
+        if (r->blk_addr <= req->blk_addr) {
+            break;
+        }
+    }
+
+    // insert right after pos (or at the front if pos is the head)
+    llist_prepend(pos, &req->reqs);
+}
+
+static struct blkio_req*
+__clook_pick(struct blkio_context* ctx)
+{
+    struct blkio_req *pos, *n;
+    llist_for_each(pos, n, &ctx->queue, reqs)
+    {
+        if (pos->blk_addr >= ctx->head_lba) {
+            return pos;
+        }
+    }
+
+    // wrap around to the lowest LBA
+    return list_entry(ctx->queue.next, struct blkio_req, reqs);
+}
+
+static struct blkio_req*
+__clook_next(struct blkio_context* ctx)
+{
+    if (llist_empty(&ctx->queue)) {
+        return NULL;
+    }
+
+    struct blkio_req* req = __clook_pick(ctx);
+    llist_delete(&req->reqs);
+    ctx->head_lba = req->blk_addr;
+    return req;
+}
+
+static void
+__deadline_add(struct blkio_context* ctx, struct blkio_req* req)
+{
+    int dir = __dir(req);
+
+    req->deadline =
+      clock_systime() + (dir ? DEADLINE_WRITE_MS : DEADLINE_READ_MS);
+    llist_append(&ctx->fifo[dir], &req->fifo);
+
+    __clook_add(ctx, req);
+}
+
+static struct blkio_req*
+__deadline_expired(struct blkio_context* ctx, int dir)
+{
+    if (llist_empty(&ctx->fifo[dir])) {
+        return NULL;
+    }
+
+    struct blkio_req* req =
+      list_entry(ctx->fifo[dir].next, struct blkio_req, fifo);
+    return (int)(clock_systime() - req->deadline) >= 0 ? req : NULL;
+}
+
+static struct blkio_req*
+__deadline_next(struct blkio_context* ctx)
+{
+    if (llist_empty(&ctx->queue)) {
+        return NULL;
+    }
+
+    struct blkio_req* req = __deadline_expired(ctx, 0);
+    if (!req && !(req = __deadline_expired(ctx, 1))) {
+        req = __clook_pick(ctx);
+    }
+
+    llist_delete(&req->reqs);
+    llist_delete(&req->fifo);
+    ctx->head_lba = req->blk_addr;
+    return req;
+}
+
+static struct blkio_sched schedulers[] = {
+    { .name = "fifo", .add = __fifo_add, .next = __fifo_next },
+    { .name = "clook", .add = __clook_add, .next = __clook_next },
+    { .name = "deadline", .add = __deadline_add, .next = __deadline_next },
+};
+
+#define NR_SCHEDULERS (sizeof(schedulers) / sizeof(schedulers[0]))
+
+struct blkio_sched*
+blkio_sched_find(const char* name, size_t len)
+{
+    for (size_t i = 0; i < NR_SCHEDULERS; i++) {
+        const char* s = schedulers[i].name;
+        if (strlen(s) == len && !memcmp(s, name, len)) {
+            return &schedulers[i];
+        }
+    }
+    return NULL;
+}
+
+void
+blkio_set_sched(struct blkio_context* ctx, struct blkio_sched* sched)
+{
+    struct blkio_sched* old = ctx->sched;
+    ctx->sched = sched;
+
+    if (!old || old == sched) {
+        return;
+    }
+
+    // Hand over what is still queued. Requests come out of the old scheduler
+    //  with their links detached, so the new one can take them as fresh
+    struct llist_header moved;
+    struct blkio_req* req;
+
+    llist_init_head(&moved);
+    while ((req = old->next(ctx))) {
+        llist_delete(&req->fifo);
+        llist_append(&moved, &req->reqs);
+    }
+
+    while (!llist_empty(&moved)) {
+        req = list_entry(moved.next, struct blkio_req, reqs);
+        llist_delete(&req->reqs);
+        sched->add(ctx, req);
+    }
+}
+
+int
+blkio_sched_list(struct blkio_context* ctx, char* buf, size_t len)
+{
+    size_t off = 0;
+    for (size_t i = 0; i < NR_SCHEDULERS && off < len; i++) {
+        char* fmt = ctx->sched == &schedulers[i] ? "[%s] " : "%s ";
+        off += ksnprintf(buf + off, len - off, fmt, schedulers[i].name);
+    }
+
+    if (off && off <= len) {
+        buf[off - 1] = '\n';
+    }
+
+    return MIN(off, len);
+}
@@ -0,0 +1,66 @@
+/**
+ * @file blkio_trace.c
+ * @brief Per-context ring buffer of block request events, for diagnosing
+ * where the latency of a request goes (queueing, driver, hardware).
+ *
+ */
+#include <lunaix/blkio.h>
+#include <lunaix/mm/valloc.h>
+
+void
+__blkio_trace_record(struct blkio_trace* trace,
+                     struct blkio_req* req,
+                     u32_t event)
+{
+    u32_t seq = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+    struct blkio_trace_ent* ent = &trace->ents[seq & (BLKIO_TRACE_NR - 1)];
+
+    u32_t blocks = req->blk_count;
+    if (req->vbuf.nr_segs && req->io_ctx->blk_size) {
+        blocks = vbuf_size(&req->vbuf) / req->io_ctx->blk_size;
+    }
+
+    // invalidate first, a reader racing with us then sees a mismatch
+    __atomic_store_n(&ent->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    ent->event = event;
+    ent->flags = req->flags & 0xff;
+    ent->errcode = req->errcode & 0xffff;
+    ent->blocks = blocks;
+    ent->lba = req->blk_addr;
+    ent->time_ns = clock_systime_ns();
+
+    __atomic_store_n(&ent->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+void
+blkio_trace_enable(struct blkio_context* ctx, int enable)
+{
+    if (!ctx->trace) {
+        if (!enable) {
+            return;
+        }
+        ctx->trace = vzalloc(sizeof(struct blkio_trace));
+    }
+
+    ctx->trace->enabled = !!enable;
+}
+
+int
+blkio_trace_get(struct blkio_trace* trace,
+                u32_t seq,
+                struct blkio_trace_ent* ent)
+{
+    struct blkio_trace_ent* src = &trace->ents[seq & (BLKIO_TRACE_NR - 1)];
+
+    if (__atomic_load_n(&src->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+        return 0;
+    }
+
+    *ent = *src;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    // overwritten while being copied
+    return __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE) == seq + 1;
+}
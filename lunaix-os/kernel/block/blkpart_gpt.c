@@ -1,7 +1,9 @@
 #include <klibc/string.h>
 #include <lunaix/blkpart_gpt.h>
 #include <lunaix/block.h>
+#include <lunaix/mm/swap.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
 #include <lunaix/status.h>
 #include <lunaix/syslog.h>
 
@@ -9,7 +11,6 @@
 
 #define GPT_BLKSIZE 512
 #define LBA2OFF(lba) ((lba)*GPT_BLKSIZE)
-#define ENT_PER_BLK (GPT_BLKSIZE / sizeof(struct gpt_entry))
 
 #define GPTSIG_LO 0x20494645UL
 #define GPTSIG_HI 0x54524150UL
@@ -18,6 +19,9 @@ static u8_t NULL_GUID[16] = { 0 };
 
 LOG_MODULE("GPT")
 
+// 分区项数组的长度上限（通常为128项 * 128字节 = 16KiB）
+#define GPT_ENTS_MAX 0x10000
+
 int
 blkpart_parse(struct device* master, struct gpt_header* header)
 {
@@ -26,23 +30,43 @@ blkpart_parse(struct device* master, struct gpt_header* header)
         return ENODEV;
 
     int errno;
-    u32_t ent_lba = (u32_t)header->ents_lba;
-    struct gpt_entry* ents_parial = (struct gpt_entry*)valloc(GPT_BLKSIZE);
+    size_t ents_sz = (size_t)header->ents_len * header->ent_size;
 
-    for (size_t i = 0; i < header->ents_len; i++) {
-        if (!(i % ENT_PER_BLK)) {
-            errno = master->read(
-              master, ents_parial, LBA2OFF(ent_lba++), GPT_BLKSIZE);
-            if (errno < 0) {
-                goto done;
-            }
-        }
+    if (header->ent_size < sizeof(struct gpt_entry) || !ents_sz ||
+        ents_sz > GPT_ENTS_MAX) {
+        kprintf(KWARN "bad entry array: %d * %d\n",
+                header->ents_len,
+                header->ent_size);
+        return EINVAL;
+    }
+
+    // 整个分区项数组一次读入，而非逐扇区读取
+    size_t rd_sz = ICEIL(ents_sz, GPT_BLKSIZE) * GPT_BLKSIZE;
+    u8_t* ents = (u8_t*)valloc(rd_sz);
 
-        struct gpt_entry* ent = &ents_parial[i % ENT_PER_BLK];
+    errno = master->read(master, ents, LBA2OFF(header->ents_lba), rd_sz);
+    if (errno < 0) {
+        goto done;
+    }
+
+    if (errno < (int)rd_sz) {
+        errno = EIO;
+        goto done;
+    }
 
-        // assuming the entries are not scattered around
+    if (crc32b(ents, ents_sz) != header->ent_cksum) {
+        kprintf(KWARN "entry array checksum failed\n");
+        errno = EINVAL;
+        goto done;
+    }
+
+    errno = 0;
+    for (size_t i = 0; i < header->ents_len; i++) {
+        struct gpt_entry* ent = (struct gpt_entry*)(ents + i * header->ent_size);
+
+        // 未使用的项可出现在数组的任意位置
         if (!memcmp(ent->pguid, NULL_GUID, 16)) {
-            break;
+            continue;
         }
 
         // Convert UEFI's 512B LB representation into local LBA range.
@@ -55,11 +79,14 @@ blkpart_parse(struct device* master, struct gpt_header* header)
                 (u32_t)slba_local,
                 (u32_t)elba_local);
         // we ignore the partition name, as it rarely used.
-        blk_mount_part(bdev, NULL, i, slba_local, elba_local);
+        struct block_dev* part =
+          blk_mount_part(bdev, NULL, i, slba_local, elba_local);
+
+        swap_probe(part, ent->pguid);
     }
 
 done:
-    vfree(ents_parial);
+    vfree(ents);
     return errno;
 }
 
@@ -75,7 +102,8 @@ blkpart_probegpt(struct device* master)
 
     if (*(u32_t*)&gpt_hdr->signature != GPTSIG_LO ||
         *(u32_t*)&gpt_hdr->signature[4] != GPTSIG_HI) {
-        return 0;
+        errno = 0;
+        goto done;
     }
 
     u32_t crc = gpt_hdr->hdr_cksum;
@@ -83,11 +111,16 @@ blkpart_probegpt(struct device* master)
     if (crc32b((void*)gpt_hdr, sizeof(*gpt_hdr)) != crc) {
         kprintf(KWARN "checksum failed\n");
         // FUTURE check the backup header
-        return EINVAL;
+        errno = EINVAL;
+        goto done;
     }
 
     errno = blkpart_parse(master, gpt_hdr);
+    if (!errno) {
+        errno = 1;
+    }
+
 done:
     vfree(gpt_hdr);
     return errno;
-}
\ No newline at end of file
+}
@@ -0,0 +1,68 @@
+#include <lunaix/blkpart_mbr.h>
+#include <lunaix/block.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/status.h>
+#include <lunaix/syslog.h>
+
+#define MBR_BLKSIZE 512
+
+LOG_MODULE("MBR")
+
+int
+blkpart_probembr(struct device* master)
+{
+    struct block_dev* bdev = (struct block_dev*)master->underlay;
+    if (!bdev)
+        return ENODEV;
+
+    int errno;
+    u8_t* mbr = (u8_t*)valloc(MBR_BLKSIZE);
+
+    if ((errno = master->read(master, mbr, 0, MBR_BLKSIZE)) < 0) {
+        goto done;
+    }
+
+    errno = 0;
+    if (*(u16_t*)(mbr + MBR_BLKSIZE - 2) != MBR_SIG) {
+        goto done;
+    }
+
+    struct mbr_entry* ents = (struct mbr_entry*)(mbr + MBR_PTE_OFFSET);
+    for (int i = 0; i < MBR_PTE_NUM; i++) {
+        struct mbr_entry* ent = &ents[i];
+
+        if (ent->type == MBR_TYPE_EMPTY || !ent->sectors) {
+            continue;
+        }
+
+        // 保护性MBR：真正的分区表是GPT，而其已被判定为无效
+        if (ent->type == MBR_TYPE_GPT_PROTECT) {
+            kprintf(KWARN "%s: protective MBR without valid GPT\n",
+                    bdev->bdev_id);
+            continue;
+        }
+
+        // FUTURE 逻辑分区（扩展分区内的EBR链）
+        if (ent->type == MBR_TYPE_EXT_CHS || ent->type == MBR_TYPE_EXT_LBA) {
+            continue;
+        }
+
+        // 与GPT相同，MBR以512字节为单位
+        u64_t slba = (u64_t)ent->start_lba * MBR_BLKSIZE / bdev->blk_size;
+        u64_t elba = ((u64_t)ent->start_lba + ent->sectors) * MBR_BLKSIZE /
+                     bdev->blk_size;
+
+        kprintf("%s: mbr part#%d: type=%x, %d..%d\n",
+                bdev->bdev_id,
+                i,
+                ent->type,
+                (u32_t)slba,
+                (u32_t)elba - 1);
+        blk_mount_part(bdev, NULL, i, slba, elba - 1);
+        errno = 1;
+    }
+
+done:
+    vfree(mbr);
+    return errno;
+}
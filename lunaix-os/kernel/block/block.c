@@ -1,16 +1,25 @@
 #include <hal/ahci/hba.h>
+#include <hal/cpu.h>
 #include <klibc/stdio.h>
 #include <klibc/string.h>
 #include <lib/crc.h>
 #include <lunaix/block.h>
 #include <lunaix/fs/twifs.h>
+#include <lunaix/ioctl.h>
 #include <lunaix/mm/cake.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/uaccess.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/process.h>
 #include <lunaix/syslog.h>
 
 #include <lunaix/blkpart_gpt.h>
+#include <lunaix/blkpart_mbr.h>
 
 #include <lunaix/spike.h>
+#include <lunaix/status.h>
 
 #define BLOCK_EREAD 1
 #define BLOCK_ESIG 2
@@ -21,6 +30,12 @@ LOG_MODULE("BLOCK")
 
 #define MAX_DEV 32
 
+// 单次读写的上限，超出部分以短读写返回。保证请求所需的PRDT项不超过HBA的限制
+#define BLOCK_MAX_XFER 0x10000
+
+// 直接I/O的缓冲区对齐要求（PRDT项的基址须按双字对齐）
+#define BLOCK_DMA_ALIGN 4
+
 static struct cake_pile* lbd_pile;
 static struct block_dev** dev_registry;
 static struct twifs_node* blk_sysroot;
@@ -33,6 +48,17 @@ __block_mount_partitions(struct hba_device* hd_dev);
 int
 __block_register(struct block_dev* dev);
 
+static void
+__block_bounce_init(struct block_dev* bdev);
+
+static inline void
+__block_commit(struct block_dev* bdev, struct blkio_req* req, int options)
+{
+    // 分区另有一份统计，设备本身的统计由其blkio上下文负责
+    req->stats = bdev->stats;
+    blkio_commit(bdev->blkio, req, options);
+}
+
 void
 block_init()
 {
@@ -43,111 +69,323 @@ block_init()
     blk_sysroot = twifs_dir_node(NULL, "block");
 }
 
+static void*
+__block_bounce_get(struct block_dev* bdev)
+{
+    struct block_bounce* pool = bdev->bounce;
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    void* buf = NULL;
+    for (int i = 0; i < BLOCK_BOUNCE_NR; i++) {
+        if ((pool->free_map & (1 << i))) {
+            pool->free_map &= ~(1 << i);
+            buf = pool->blocks[i];
+            break;
+        }
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    // 池已耗尽（并发的非对齐访问过多），退回到临时分配
+    return buf ? buf : valloc_dma(bdev->blk_size);
+}
+
+static void
+__block_bounce_put(struct block_dev* bdev, void* buf)
+{
+    struct block_bounce* pool = bdev->bounce;
+
+    if (!buf) {
+        return;
+    }
+
+    for (int i = 0; i < BLOCK_BOUNCE_NR; i++) {
+        if (pool->blocks[i] == buf) {
+            int intr = cpu_reflags() & 0x0200;
+            cpu_disable_interrupt();
+            pool->free_map |= (1 << i);
+            if (intr) {
+                cpu_enable_interrupt();
+            }
+            return;
+        }
+    }
+
+    vfree_dma(buf);
+}
+
+static void
+__block_unpin(void* buf, size_t len)
+{
+    if ((uintptr_t)buf >= KERNEL_MM_BASE) {
+        return;
+    }
+
+    for (uintptr_t pg = PG_ALIGN(buf); pg < (uintptr_t)buf + len;
+         pg += PG_SIZE) {
+        pmm_free_page(__current->pid, (void*)PG_ALIGN(vmm_v2p((void*)pg)));
+    }
+}
+
+/**
+ * @brief 钉住用作DMA缓冲区的用户页：使其驻留（必要时经由缺页处理分配，或解除写时复制），
+ * 并持有其物理页的引用，以免在传输过程中被释放。内核缓冲区总是驻留的，无需处理。
+ *
+ * @param dma_wr 设备是否将写入该缓冲区
+ */
+static int
+__block_pin(void* buf, size_t len, int dma_wr)
+{
+    if ((uintptr_t)buf >= KERNEL_MM_BASE) {
+        return 0;
+    }
+
+    uintptr_t start = (uintptr_t)buf, end = start + len;
+    for (uintptr_t pg = PG_ALIGN(start); pg < end; pg += PG_SIZE) {
+        char* p = (char*)MAX(pg, start);
+        char c;
+
+        if (copy_from_user(&c, p, 1) || (dma_wr && copy_to_user(p, &c, 1))) {
+            __block_unpin(buf, pg - start);
+            return EFAULT;
+        }
+
+        pmm_ref_page(__current->pid, (void*)PG_ALIGN(vmm_v2p(p)));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 取得中间整块部分所用的DMA缓冲区。调用者的缓冲区若按 BLOCK_DMA_ALIGN
+ * 对齐，则将其钉住直接使用；否则改经由临时分配的跳板缓冲区中转。
+ *
+ * @param dma_wr 设备是否将写入该缓冲区
+ * @param body 用于DMA的缓冲区
+ */
+static int
+__block_body_get(void* buf, size_t len, int dma_wr, void** body)
+{
+    if (!((uintptr_t)buf % BLOCK_DMA_ALIGN)) {
+        *body = buf;
+        return __block_pin(buf, len, dma_wr);
+    }
+
+    if (!(*body = valloc_dma(len))) {
+        return ENOMEM;
+    }
+
+    if (!dma_wr) {
+        memcpy(*body, buf, len);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 归还 __block_body_get 所取得的缓冲区
+ *
+ * @param copy_back 是否将跳板缓冲区中读得的数据复制给调用者
+ */
+static void
+__block_body_put(void* buf, void* body, size_t len, int copy_back)
+{
+    if (body == buf) {
+        __block_unpin(buf, len);
+        return;
+    }
+
+    if (copy_back) {
+        memcpy(buf, body, len);
+    }
+    vfree_dma(body);
+}
+
+static int
+__block_rd_one(struct block_dev* bdev, void* buf, u64_t lba)
+{
+    struct vecbuf vbuf = { 0 };
+    vbuf_append(&vbuf, buf, bdev->blk_size);
+
+    struct blkio_req* req = blkio_vrd(&vbuf, lba, NULL, NULL, 0);
+    __block_commit(bdev, req, BLKIO_WAIT);
+
+    int errno = req->errcode;
+
+    blkio_free_req(req);
+    return errno;
+}
+
+/*
+    非对齐的访问被拆分为三段：首尾两个不完整的块经由设备的跳板缓冲区中转，
+    中间对齐的部分则直接以调用者的缓冲区进行DMA（缓冲区本身未按 BLOCK_DMA_ALIGN
+    对齐时仍经由跳板缓冲区）。三段合为一个请求提交。
+*/
+
 int
-__block_read(struct device* dev, void* buf, size_t offset, size_t len)
+__block_read(struct device* dev, void* buf, foff_t offset, size_t len)
 {
     int errno;
     struct block_dev* bdev = (struct block_dev*)dev->underlay;
-    size_t bsize = bdev->blk_size, rd_block = offset / bsize + bdev->start_lba,
-           r = offset % bsize, rd_size = 0;
+    size_t bsize = bdev->blk_size, r = offset % bsize;
+    u64_t rd_block = offset / bsize + bdev->start_lba;
+
+    if (rd_block > bdev->end_lba) {
+        return 0;
+    }
 
-    if (!(len = MIN(len, ((size_t)bdev->end_lba - rd_block + 1) * bsize))) {
+    len = MIN(len, BLOCK_MAX_XFER);
+    if (!(len = MIN((u64_t)len, (bdev->end_lba - rd_block + 1) * bsize - r))) {
         return 0;
     }
 
-    struct vecbuf* vbuf = NULL;
+    struct vecbuf vbuf = { 0 };
     struct blkio_req* req;
-    void *head_buf = NULL, *tail_buf = NULL;
+    void *head_buf = NULL, *tail_buf = NULL, *body = NULL;
+    size_t head_sz = 0, body_sz, tail_sz;
 
     // align the boundary
     if (r || len < bsize) {
-        head_buf = valloc(bsize);
-        rd_size = MIN(len, bsize - r);
-        vbuf_alloc(&vbuf, head_buf, bsize);
+        head_buf = __block_bounce_get(bdev);
+        head_sz = MIN(len, bsize - r);
+        vbuf_append(&vbuf, head_buf, bsize);
     }
 
     // align the length
-    if ((len - rd_size)) {
-        size_t llen = len - rd_size;
-        assert_msg(!(llen % bsize), "misalign block read");
-        vbuf_alloc(&vbuf, buf + rd_size, llen);
+    body_sz = (len - head_sz) / bsize * bsize;
+    tail_sz = len - head_sz - body_sz;
+
+    if (body_sz) {
+        if ((errno = __block_body_get(buf + head_sz, body_sz, 1, &body))) {
+            errno = -errno;
+            goto done;
+        }
+        vbuf_append(&vbuf, body, body_sz);
     }
 
-    req = blkio_vrd(vbuf, rd_block, NULL, NULL, 0);
-    blkio_commit(bdev->blkio, req, BLKIO_WAIT);
+    if (tail_sz) {
+        tail_buf = __block_bounce_get(bdev);
+        vbuf_append(&vbuf, tail_buf, bsize);
+    }
+
+    req = blkio_vrd(&vbuf, rd_block, NULL, NULL, 0);
+    __block_commit(bdev, req, BLKIO_WAIT);
 
     if (!(errno = req->errcode)) {
-        memcpy(buf, head_buf + r, rd_size);
+        memcpy(buf, head_buf + r, head_sz);
+        memcpy(buf + head_sz + body_sz, tail_buf, tail_sz);
         errno = len;
     } else {
         errno = -errno;
     }
 
-    if (head_buf) {
-        vfree(head_buf);
+    blkio_free_req(req);
+    if (body_sz) {
+        __block_body_put(buf + head_sz, body, body_sz, errno > 0);
     }
 
-    blkio_free_req(req);
-    vbuf_free(vbuf);
+done:
+    __block_bounce_put(bdev, head_buf);
+    __block_bounce_put(bdev, tail_buf);
+    vbuf_free(&vbuf);
     return errno;
 }
 
 int
-__block_write(struct device* dev, void* buf, size_t offset, size_t len)
+__block_write(struct device* dev, void* buf, foff_t offset, size_t len)
 {
+    int errno;
     struct block_dev* bdev = (struct block_dev*)dev->underlay;
-    size_t bsize = bdev->blk_size, wr_block = offset / bsize + bdev->start_lba,
-           r = offset % bsize, wr_size = 0;
+    size_t bsize = bdev->blk_size, r = offset % bsize;
+    u64_t wr_block = offset / bsize + bdev->start_lba;
 
-    if (!(len = MIN(len, ((size_t)bdev->end_lba - wr_block + 1) * bsize))) {
+    if (wr_block > bdev->end_lba) {
         return 0;
     }
 
-    struct vecbuf* vbuf = NULL;
+    len = MIN(len, BLOCK_MAX_XFER);
+    if (!(len = MIN((u64_t)len, (bdev->end_lba - wr_block + 1) * bsize - r))) {
+        return 0;
+    }
+
+    struct vecbuf vbuf = { 0 };
     struct blkio_req* req;
-    void* tmp_buf = NULL;
+    void *head_buf = NULL, *tail_buf = NULL, *body = NULL;
+    size_t head_sz = 0, body_sz, tail_sz;
+
+    // 不完整的块需先读出，合并新数据后再整块写回
+    if (r || len < bsize) {
+        head_buf = __block_bounce_get(bdev);
+        head_sz = MIN(len, bsize - r);
+        if ((errno = __block_rd_one(bdev, head_buf, wr_block))) {
+            errno = -errno;
+            goto done;
+        }
+        memcpy(head_buf + r, buf, head_sz);
+        vbuf_append(&vbuf, head_buf, bsize);
+    }
 
-    if (r) {
-        size_t wr_size = MIN(len, bsize - r);
-        tmp_buf = vzalloc(bsize);
-        vbuf_alloc(&vbuf, tmp_buf, bsize);
+    body_sz = (len - head_sz) / bsize * bsize;
+    tail_sz = len - head_sz - body_sz;
 
-        memcpy(tmp_buf + r, buf, wr_size);
+    if (body_sz) {
+        if ((errno = __block_body_get(buf + head_sz, body_sz, 0, &body))) {
+            errno = -errno;
+            goto done;
+        }
+        vbuf_append(&vbuf, body, body_sz);
     }
 
-    if ((len - wr_size)) {
-        size_t llen = len - wr_size;
-        assert_msg(!(llen % bsize), "misalign block write");
-        vbuf_alloc(&vbuf, buf + wr_size, llen);
+    if (tail_sz) {
+        u64_t tail_lba = wr_block + !!head_buf + body_sz / bsize;
+
+        tail_buf = __block_bounce_get(bdev);
+        if ((errno = __block_rd_one(bdev, tail_buf, tail_lba))) {
+            errno = -errno;
+            if (body_sz) {
+                __block_body_put(buf + head_sz, body, body_sz, 0);
+            }
+            goto done;
+        }
+        memcpy(tail_buf, buf + head_sz + body_sz, tail_sz);
+        vbuf_append(&vbuf, tail_buf, bsize);
     }
 
-    req = blkio_vwr(vbuf, wr_block, NULL, NULL, 0);
-    blkio_commit(bdev->blkio, req, BLKIO_WAIT);
+    bcache_invalidate(bdev, wr_block, ICEIL(r + len, bsize));
 
-    int errno = req->errcode;
-    if (!errno) {
+    req = blkio_vwr(&vbuf, wr_block, NULL, NULL, 0);
+    __block_commit(bdev, req, BLKIO_WAIT);
+
+    if (!(errno = req->errcode)) {
         errno = len;
     } else {
         errno = -errno;
     }
 
-    if (tmp_buf) {
-        vfree(tmp_buf);
+    blkio_free_req(req);
+    if (body_sz) {
+        __block_body_put(buf + head_sz, body, body_sz, 0);
     }
 
-    blkio_free_req(req);
-    vbuf_free(vbuf);
+done:
+    __block_bounce_put(bdev, head_buf);
+    __block_bounce_put(bdev, tail_buf);
+    vbuf_free(&vbuf);
     return errno;
 }
 
 int
-__block_read_page(struct device* dev, void* buf, size_t offset)
+__block_read_page(struct device* dev, void* buf, foff_t offset)
 {
-    struct vecbuf* vbuf = NULL;
+    struct vecbuf vbuf = { 0 };
     struct block_dev* bdev = (struct block_dev*)dev->underlay;
 
-    u32_t lba = offset / bdev->blk_size + bdev->start_lba;
-    u32_t rd_lba = MIN(lba + PG_SIZE / bdev->blk_size, bdev->end_lba);
+    u64_t lba = offset / bdev->blk_size + bdev->start_lba;
+    u64_t rd_lba = MIN(lba + PG_SIZE / bdev->blk_size, bdev->end_lba);
 
     if (rd_lba <= lba) {
         return 0;
@@ -155,11 +393,11 @@ __block_read_page(struct device* dev, void* buf, size_t offset)
 
     rd_lba -= lba;
 
-    vbuf_alloc(&vbuf, buf, rd_lba * bdev->blk_size);
+    vbuf_append(&vbuf, buf, rd_lba * bdev->blk_size);
 
-    struct blkio_req* req = blkio_vrd(vbuf, lba, NULL, NULL, 0);
+    struct blkio_req* req = blkio_vrd(&vbuf, lba, NULL, NULL, 0);
 
-    blkio_commit(bdev->blkio, req, BLKIO_WAIT);
+    __block_commit(bdev, req, BLKIO_WAIT);
 
     int errno = req->errcode;
     if (!errno) {
@@ -169,18 +407,17 @@ __block_read_page(struct device* dev, void* buf, size_t offset)
     }
 
     blkio_free_req(req);
-    vbuf_free(vbuf);
     return errno;
 }
 
 int
-__block_write_page(struct device* dev, void* buf, size_t offset)
+__block_write_page(struct device* dev, void* buf, foff_t offset)
 {
-    struct vecbuf* vbuf = NULL;
+    struct vecbuf vbuf = { 0 };
     struct block_dev* bdev = (struct block_dev*)dev->underlay;
 
-    u32_t lba = offset / bdev->blk_size + bdev->start_lba;
-    u32_t rd_lba = MIN(lba + PG_SIZE / bdev->blk_size, bdev->end_lba);
+    u64_t lba = offset / bdev->blk_size + bdev->start_lba;
+    u64_t rd_lba = MIN(lba + PG_SIZE / bdev->blk_size, bdev->end_lba);
 
     if (rd_lba <= lba) {
         return 0;
@@ -188,11 +425,13 @@ __block_write_page(struct device* dev, void* buf, size_t offset)
 
     rd_lba -= lba;
 
-    vbuf_alloc(&vbuf, buf, rd_lba * bdev->blk_size);
+    vbuf_append(&vbuf, buf, rd_lba * bdev->blk_size);
 
-    struct blkio_req* req = blkio_vwr(vbuf, lba, NULL, NULL, 0);
+    bcache_invalidate_alias(bdev, lba, rd_lba);
 
-    blkio_commit(bdev->blkio, req, BLKIO_WAIT);
+    struct blkio_req* req = blkio_vwr(&vbuf, lba, NULL, NULL, 0);
+
+    __block_commit(bdev, req, BLKIO_WAIT);
 
     int errno = req->errcode;
     if (!errno) {
@@ -202,18 +441,221 @@ __block_write_page(struct device* dev, void* buf, size_t offset)
     }
 
     blkio_free_req(req);
-    vbuf_free(vbuf);
     return errno;
 }
 
+static void
+__block_iocb_done(struct blkio_req* req)
+{
+    struct dev_iocb* iocb = (struct dev_iocb*)req->evt_args;
+
+    iocb->result = req->errcode ? -req->errcode : (int)vbuf_size(&req->vbuf);
+
+    iocb->done(iocb);
+}
+
+int
+__block_submit(struct device* dev, struct dev_iocb* iocb)
+{
+    struct block_dev* bdev = (struct block_dev*)dev->underlay;
+    size_t bsize = bdev->blk_size;
+    u64_t lba = iocb->offset / bsize + bdev->start_lba;
+
+    // 异步请求直接以调用者的缓冲区进行DMA，因而不做对齐处理
+    if ((iocb->offset % bsize) || (iocb->len % bsize) || !iocb->len ||
+        lba > bdev->end_lba) {
+        return EINVAL;
+    }
+
+    size_t len = MIN(iocb->len, (size_t)(bdev->end_lba - lba + 1) * bsize);
+
+    struct vecbuf vbuf = { 0 };
+    vbuf_append(&vbuf, iocb->buf, len);
+
+    struct blkio_req* req;
+    if (iocb->write) {
+        bcache_invalidate_alias(bdev, lba, len / bsize);
+        req = blkio_vwr(&vbuf, lba, __block_iocb_done, iocb, BLKIO_FOC);
+    } else {
+        req = blkio_vrd(&vbuf, lba, __block_iocb_done, iocb, BLKIO_FOC);
+    }
+
+    // 请求可能在此处的提交返回前便已完成，并由完成回调释放
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+    __block_commit(bdev, req, 0);
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    return 0;
+}
+
+struct block_direct
+{
+    u32_t pending;
+    struct lx_event done;
+};
+
+static void
+__block_direct_done(struct dev_iocb* iocb)
+{
+    struct block_direct* batch = (struct block_direct*)iocb->data;
+
+    if (!--batch->pending) {
+        event_signal(&batch->done);
+    }
+}
+
+/*
+    直接I/O：所有缓冲区预先一次钉住，请求在塞住的队列中一并提交，由调度器排序
+    合并后派发，调用者只等待一次。缓冲区本身即为DMA的目标，没有跳板缓冲区。
+*/
+
+int
+__block_direct_io(struct device* dev, struct dev_iocb* iocbs, u32_t n)
+{
+    struct block_dev* bdev = (struct block_dev*)dev->underlay;
+    size_t bsize = bdev->blk_size;
+    u32_t i, pinned = 0;
+    int errno = 0;
+
+    for (i = 0; i < n; i++) {
+        struct dev_iocb* iocb = &iocbs[i];
+        if ((iocb->offset % bsize) || (iocb->len % bsize) || !iocb->len ||
+            iocb->len > DEV_DIRECT_MAX ||
+            ((uintptr_t)iocb->buf % BLOCK_DMA_ALIGN)) {
+            return EINVAL;
+        }
+    }
+
+    for (; pinned < n; pinned++) {
+        struct dev_iocb* iocb = &iocbs[pinned];
+        if ((errno = __block_pin(iocb->buf, iocb->len, !iocb->write))) {
+            goto done;
+        }
+    }
+
+    struct block_direct batch = { .pending = n };
+    event_init(&batch.done);
+
+    blkio_plug(bdev->blkio);
+
+    for (i = 0; i < n; i++) {
+        struct dev_iocb* iocb = &iocbs[i];
+        iocb->done = __block_direct_done;
+        iocb->data = &batch;
+
+        // 越过设备末尾的请求被拒绝，视为读写了零字节
+        if (__block_submit(dev, iocb)) {
+            iocb->result = 0;
+            batch.pending--;
+        }
+    }
+
+    blkio_unplug(bdev->blkio);
+
+    // 全部被拒绝时不会有完成通告
+    if (batch.pending) {
+        event_wait(&batch.done);
+    }
+
+done:
+    for (i = 0; i < pinned; i++) {
+        __block_unpin(iocbs[i].buf, iocbs[i].len);
+    }
+    return errno;
+}
+
+void
+__block_plug(struct device* dev)
+{
+    blkio_plug(((struct block_dev*)dev->underlay)->blkio);
+}
+
+void
+__block_unplug(struct device* dev)
+{
+    blkio_unplug(((struct block_dev*)dev->underlay)->blkio);
+}
+
+int
+__block_sync(struct device* dev)
+{
+    struct block_dev* bdev = (struct block_dev*)dev->underlay;
+
+    // 刷新作为屏障，在此前提交的写入全部完成后才发出
+    struct blkio_req* req = blkio_flush(NULL, NULL, 0);
+    __block_commit(bdev, req, BLKIO_WAIT);
+
+    int errno = req->errcode ? EIO : 0;
+    blkio_free_req(req);
+    return errno;
+}
+
+static int
+__block_discard(struct block_dev* bdev, size_t offset, size_t len)
+{
+    size_t bsize = bdev->blk_size;
+    u32_t max = bdev->blkio->max_discard;
+    u64_t lba = offset / bsize + bdev->start_lba;
+    u64_t count = len / bsize;
+
+    if (!max) {
+        return ENOTSUP;
+    }
+
+    if ((offset % bsize) || (len % bsize) || lba + count > bdev->end_lba + 1) {
+        return EINVAL;
+    }
+
+    // 被丢弃的块其内容不再确定
+    bcache_invalidate(bdev, lba, count);
+
+    while (count) {
+        u32_t n = MIN(count, max);
+        struct blkio_req* req = blkio_discard(lba, n, NULL, NULL, 0);
+        __block_commit(bdev, req, BLKIO_WAIT);
+
+        int errcode = req->errcode;
+        blkio_free_req(req);
+        if (errcode) {
+            return EIO;
+        }
+
+        lba += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+int
+__block_exec_cmd(struct device* dev, u32_t req, va_list args)
+{
+    struct block_dev* bdev = (struct block_dev*)dev->underlay;
+
+    switch (req) {
+        case BLKFLUSH:
+            return __block_sync(dev);
+        case BLKDISCARD: {
+            size_t offset = va_arg(args, size_t);
+            size_t len = va_arg(args, size_t);
+            return __block_discard(bdev, offset, len);
+        }
+        default:
+            return EINVAL;
+    }
+}
+
 int
 __block_rd_lb(struct block_dev* bdev, void* buf, u64_t start, size_t count)
 {
-    struct vecbuf* vbuf = NULL;
-    vbuf_alloc(&vbuf, buf, bdev->blk_size * count);
+    struct vecbuf vbuf = { 0 };
+    vbuf_append(&vbuf, buf, bdev->blk_size * count);
 
-    struct blkio_req* req = blkio_vrd(vbuf, start, NULL, NULL, 0);
-    blkio_commit(bdev->blkio, req, BLKIO_WAIT);
+    struct blkio_req* req = blkio_vrd(&vbuf, start, NULL, NULL, 0);
+    __block_commit(bdev, req, BLKIO_WAIT);
 
     int errno = req->errcode;
     if (!errno) {
@@ -223,7 +665,6 @@ __block_rd_lb(struct block_dev* bdev, void* buf, u64_t start, size_t count)
     }
 
     blkio_free_req(req);
-    vbuf_free(vbuf);
 
     return errno;
 }
@@ -231,11 +672,13 @@ __block_rd_lb(struct block_dev* bdev, void* buf, u64_t start, size_t count)
 int
 __block_wr_lb(struct block_dev* bdev, void* buf, u64_t start, size_t count)
 {
-    struct vecbuf* vbuf = NULL;
-    vbuf_alloc(&vbuf, buf, bdev->blk_size * count);
+    struct vecbuf vbuf = { 0 };
+    vbuf_append(&vbuf, buf, bdev->blk_size * count);
+
+    bcache_invalidate(bdev, start, count);
 
-    struct blkio_req* req = blkio_vwr(vbuf, start, NULL, NULL, 0);
-    blkio_commit(bdev->blkio, req, BLKIO_WAIT);
+    struct blkio_req* req = blkio_vwr(&vbuf, start, NULL, NULL, 0);
+    __block_commit(bdev, req, BLKIO_WAIT);
 
     int errno = req->errcode;
     if (!errno) {
@@ -245,7 +688,6 @@ __block_wr_lb(struct block_dev* bdev, void* buf, u64_t start, size_t count)
     }
 
     blkio_free_req(req);
-    vbuf_free(vbuf);
 
     return errno;
 }
@@ -284,16 +726,24 @@ block_mount(struct block_dev* bdev, devfs_exporter fs_export)
 {
     int errno = 0;
 
+    bdev->blkio->blk_size = bdev->blk_size;
+    __block_bounce_init(bdev);
+
     if (!__block_register(bdev)) {
         errno = BLOCK_EFULL;
         goto error;
     }
 
+    // 须先于分区的建立：分区复制设备的 block_dev，由此共用缓冲缓存
+    bcache_setup(bdev);
+
     errno = blkpart_probegpt(bdev->dev);
+    if (!errno) {
+        errno = blkpart_probembr(bdev->dev);
+    }
+
     if (errno < 0) {
         kprintf(KERROR "Fail to parse partition table (%d)\n", errno);
-    } else if (!errno) {
-        // TODO try other PT parser...
     }
 
     struct twifs_node* dev_root = twifs_dir_node(blk_sysroot, bdev->bdev_id);
@@ -307,6 +757,15 @@ error:
     return errno;
 }
 
+struct block_dev*
+block_dev_at(int index)
+{
+    if (index < 0 || index >= free_slot) {
+        return NULL;
+    }
+    return dev_registry[index];
+}
+
 int
 __block_register(struct block_dev* bdev)
 {
@@ -319,6 +778,12 @@ __block_register(struct block_dev* bdev)
     dev->write_page = __block_write_page;
     dev->read = __block_read;
     dev->read_page = __block_read_page;
+    dev->submit = __block_submit;
+    dev->direct_io = __block_direct_io;
+    dev->sync = __block_sync;
+    dev->plug = __block_plug;
+    dev->unplug = __block_unplug;
+    dev->exec_cmd = __block_exec_cmd;
 
     bdev->dev = dev;
     strcpy(bdev->bdev_id, dev->name_val);
@@ -326,6 +791,19 @@ __block_register(struct block_dev* bdev)
     return 1;
 }
 
+static void
+__block_bounce_init(struct block_dev* bdev)
+{
+    // 分区复制自其所在设备，共用同一个跳板缓冲池
+    struct block_bounce* pool = valloc(sizeof(struct block_bounce));
+    for (int i = 0; i < BLOCK_BOUNCE_NR; i++) {
+        pool->blocks[i] = valloc_dma(bdev->blk_size);
+    }
+    pool->free_map = (1 << BLOCK_BOUNCE_NR) - 1;
+
+    bdev->bounce = pool;
+}
+
 struct block_dev*
 blk_mount_part(struct block_dev* bdev,
                const char* name,
@@ -342,9 +820,16 @@ blk_mount_part(struct block_dev* bdev,
     dev->write_page = __block_write_page;
     dev->read = __block_read;
     dev->read_page = __block_read_page;
+    dev->submit = __block_submit;
+    dev->direct_io = __block_direct_io;
+    dev->sync = __block_sync;
+    dev->plug = __block_plug;
+    dev->unplug = __block_unplug;
+    dev->exec_cmd = __block_exec_cmd;
 
     pbdev->start_lba = start_lba;
     pbdev->end_lba = end_lba;
+    pbdev->stats = vzalloc(sizeof(struct blkio_stats));
     pbdev->dev = dev;
 
     strcpy(pbdev->bdev_id, dev->name_val);
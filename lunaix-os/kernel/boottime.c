@@ -0,0 +1,70 @@
+/**
+ * @file boottime.c
+ * @brief 启动各阶段的时间戳，见 lunaix/boottime.h
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/boottime.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/spike.h>
+#include <lunaix/timer.h>
+
+struct boot_stamp
+{
+    const char* name;
+    u64_t tsc;
+};
+
+static struct boot_stamp boot_stamps[BOOT_NR_PHASES];
+static u32_t boot_nr_stamps;
+
+void
+boot_phase(const char* name)
+{
+    // 推迟的初始化运行于工作队列中，可能与 proc0 同时记录
+    u32_t i = __atomic_fetch_add(&boot_nr_stamps, 1, __ATOMIC_RELAXED);
+    if (i >= BOOT_NR_PHASES) {
+        return;
+    }
+
+    boot_stamps[i].tsc = cpu_rdtsc();
+    boot_stamps[i].name = name;
+}
+
+static inline u32_t
+__boot_tsc_to_us(u64_t cycles, u64_t freq)
+{
+    return freq >= 1000000 ? (u32_t)(cycles / (freq / 1000000)) : 0;
+}
+
+static void
+__boot_rd_phases(struct twimap* map)
+{
+    struct lx_timer_context* ctx = timer_context();
+    u64_t freq = ctx ? ctx->tsc_frequency : 0;
+    u32_t nr = MIN(boot_nr_stamps, BOOT_NR_PHASES);
+    u64_t prev = 0;
+
+    for (u32_t i = 0; i < nr; i++) {
+        struct boot_stamp* stamp = &boot_stamps[i];
+        if (!stamp->name) {
+            continue;
+        }
+
+        u64_t cycles = stamp->tsc - prev;
+        twimap_printf(map,
+                      "%s %u %u %u\n",
+                      stamp->name,
+                      (u32_t)(cycles / 1000),
+                      __boot_tsc_to_us(cycles, freq),
+                      __boot_tsc_to_us(stamp->tsc, freq));
+        prev = stamp->tsc;
+    }
+}
+
+void
+boot_phase_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "boot_time");
+    map->read = __boot_rd_phases;
+}
@@ -18,22 +18,26 @@ input_test()
         return;
     }
 
-    struct input_evt_pkt event;
+    struct input_evt_pkt events[8];
+    int len;
 
-    while (read(fd, &event, sizeof(event)) > 0) {
-        char* action;
-        if (event.pkt_type == PKT_PRESS) {
-            action = "pressed";
-        } else {
-            action = "release";
-        }
+    while ((len = read(fd, events, sizeof(events))) > 0) {
+        for (size_t i = 0; i < len / sizeof(struct input_evt_pkt); i++) {
+            struct input_evt_pkt event = events[i];
+            char* action;
+            if (event.pkt_type == PKT_PRESS) {
+                action = "pressed";
+            } else {
+                action = "release";
+            }
 
-        printf("%u: %s '%c', class=0x%x, scan=%x\n",
-               event.timestamp,
-               action,
-               event.sys_code & 0xff,
-               (event.sys_code & 0xff00) >> 8,
-               event.scan_code);
+            printf("%u: %s '%c', class=0x%x, scan=%x\n",
+                   event.timestamp,
+                   action,
+                   event.sys_code & 0xff,
+                   (event.sys_code & 0xff00) >> 8,
+                   event.scan_code);
+        }
     }
     return;
 }
\ No newline at end of file
@@ -0,0 +1,380 @@
+#include <lunaix/fctrl.h>
+#include <lunaix/foptions.h>
+#include <lunaix/ioring.h>
+#include <lunaix/lunaix.h>
+#include <lunaix/lunistd.h>
+#include <lunaix/mman.h>
+#include <lunaix/time.h>
+#include <lunaix/uio.h>
+
+#include <klibc/string.h>
+#include <ulibc/stdio.h>
+
+/*
+    类似 fio 的I/O基准：以给定的块大小与队列深度，对设备或普通文件进行
+    顺序或随机的读写，报告 IOPS、吞吐量与延迟的分位数。
+
+    队列深度为1时以 pread/pwrite 同步进行；更深的队列经由 ioring 提交，
+    对以 FO_DIRECT 打开的块设备即为真正的异步并发（见 lunaix/ioring.h），
+    可用于检验 NCQ、请求合并与预读的效果。
+
+    可于 simple shell 中以 iobench 命令运行单项测试，或将 proc0.c 中的
+    演示程序切换为 DEMO_IOBENCH 以运行下方的默认测试集。
+*/
+
+#define IOB_MAX_IOS 65536
+#define IOB_MAX_QD 64
+#define IOB_DEFAULT_SPAN (16 << 20)
+
+struct iob_job
+{
+    const char* path;
+    int write;
+    int random;
+    int direct;
+    u32_t bs;
+    u32_t qd;
+    u32_t nr_ios;
+    u32_t span; // 读写的范围（字节），偏移量均落在 [0, span) 中
+};
+
+static u32_t iob_seed = 2463534242;
+
+static u32_t
+__iob_rand()
+{
+    // xorshift32
+    iob_seed ^= iob_seed << 13;
+    iob_seed ^= iob_seed >> 17;
+    iob_seed ^= iob_seed << 5;
+    return iob_seed;
+}
+
+static u64_t
+__iob_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static size_t
+__iob_offset(struct iob_job* job, u32_t i)
+{
+    u32_t nr_blocks = job->span / job->bs;
+    u32_t block = job->random ? __iob_rand() % nr_blocks : i % nr_blocks;
+    return (size_t)block * job->bs;
+}
+
+static void
+__iob_sort(u32_t* lat, u32_t n)
+{
+    // shell sort, gaps of Ciura
+    static const u32_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (u32_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        u32_t gap = gaps[g];
+        for (u32_t i = gap; i < n; i++) {
+            u32_t v = lat[i], j = i;
+            for (; j >= gap && lat[j - gap] > v; j -= gap) {
+                lat[j] = lat[j - gap];
+            }
+            lat[j] = v;
+        }
+    }
+}
+
+static u32_t
+__iob_percentile(u32_t* sorted, u32_t n, u32_t permille)
+{
+    return sorted[(u64_t)(n - 1) * permille / 1000];
+}
+
+static int
+__iob_run_sync(struct iob_job* job, int fd, char* buf, u32_t* lat)
+{
+    int errors = 0;
+
+    for (u32_t i = 0; i < job->nr_ios; i++) {
+        size_t off = __iob_offset(job, i);
+        u64_t t0 = __iob_now_ns();
+
+        int res = job->write ? pwrite(fd, buf, job->bs, off)
+                             : pread(fd, buf, job->bs, off);
+
+        lat[i] = (u32_t)(__iob_now_ns() - t0);
+        errors += (res != (int)job->bs);
+    }
+
+    return errors;
+}
+
+static int
+__iob_run_ring(struct iob_job* job, int fd, char* buf, u32_t* lat)
+{
+    static struct io_sqe sqes[IOB_MAX_QD];
+    static struct io_cqe cqes[IOB_MAX_QD];
+    u64_t submitted_at[IOB_MAX_QD];
+    u32_t free_slots[IOB_MAX_QD];
+    u32_t nr_free = job->qd;
+    u32_t issued = 0, done = 0;
+    int errors = 0;
+
+    struct io_ring ring = { .sq_entries = IOB_MAX_QD,
+                            .cq_entries = IOB_MAX_QD,
+                            .sqes = sqes,
+                            .cqes = cqes };
+
+    if (ioring_setup(&ring)) {
+        return -1;
+    }
+
+    for (u32_t i = 0; i < job->qd; i++) {
+        free_slots[i] = i;
+    }
+
+    while (done < job->nr_ios) {
+        int to_submit = 0;
+
+        // 补满队列。slot 决定使用的缓冲区，随完成项归还
+        while (nr_free && issued < job->nr_ios) {
+            u32_t slot = free_slots[--nr_free];
+            struct io_sqe* sqe = &sqes[ring.sq_tail & (IOB_MAX_QD - 1)];
+
+            *sqe = (struct io_sqe){
+                .opcode = job->write ? IORING_OP_WRITE : IORING_OP_READ,
+                .flags = IORING_F_POS,
+                .fd = fd,
+                .buf = buf + slot * job->bs,
+                .len = job->bs,
+                .offset = __iob_offset(job, issued),
+                .user_data = slot
+            };
+            submitted_at[slot] = __iob_now_ns();
+
+            __atomic_store_n(
+              &ring.sq_tail, ring.sq_tail + 1, __ATOMIC_RELEASE);
+            issued++;
+            to_submit++;
+        }
+
+        ioring_enter(to_submit, 1);
+
+        u32_t tail = __atomic_load_n(&ring.cq_tail, __ATOMIC_ACQUIRE);
+        u64_t now = __iob_now_ns();
+        for (; ring.cq_head != tail; ring.cq_head++) {
+            struct io_cqe* cqe = &cqes[ring.cq_head & (IOB_MAX_QD - 1)];
+            u32_t slot = cqe->user_data;
+
+            lat[done++] = (u32_t)(now - submitted_at[slot]);
+            errors += (cqe->res != (int)job->bs);
+            free_slots[nr_free++] = slot;
+        }
+    }
+
+    ioring_setup(NULL);
+    return errors;
+}
+
+int
+iobench_run(struct iob_job* job)
+{
+    int options = job->direct ? FO_DIRECT : 0;
+    int errors;
+
+    options |= job->write ? FO_CREATE : 0;
+
+    if (!job->bs || job->span < job->bs || job->qd > IOB_MAX_QD ||
+        job->nr_ios > IOB_MAX_IOS || !job->qd || !job->nr_ios) {
+        printf("iobench: invalid job\n");
+        return -1;
+    }
+
+    int fd = open(job->path, options);
+    if (fd < 0) {
+        printf("iobench: fail to open %s (%d)\n", job->path, geterrno());
+        return fd;
+    }
+
+    size_t buf_len = job->qd * job->bs;
+    size_t lat_len = job->nr_ios * sizeof(u32_t);
+    int prot = PROT_READ | PROT_WRITE, flags = MAP_PRIVATE | MAP_ANON;
+    char* buf = mmap(NULL, buf_len, prot, flags, -1, 0);
+    u32_t* lat = mmap(NULL, lat_len, prot, flags, -1, 0);
+
+    if (buf == MAP_FAILED || lat == MAP_FAILED) {
+        printf("iobench: out of memory\n");
+        errors = -1;
+        goto done;
+    }
+
+    memset(buf, 0xa5, buf_len);
+
+    u64_t t0 = __iob_now_ns();
+    if (job->qd == 1) {
+        errors = __iob_run_sync(job, fd, buf, lat);
+    } else {
+        errors = __iob_run_ring(job, fd, buf, lat);
+    }
+    u64_t elapsed = __iob_now_ns() - t0;
+
+    if (errors < 0) {
+        printf("iobench: ioring unavailable (%d)\n", geterrno());
+        goto done;
+    }
+
+    u64_t lat_sum = 0;
+    for (u32_t i = 0; i < job->nr_ios; i++) {
+        lat_sum += lat[i];
+    }
+    __iob_sort(lat, job->nr_ios);
+
+    elapsed = elapsed ? elapsed : 1;
+    u32_t iops = (u32_t)((u64_t)job->nr_ios * NSEC_PER_SEC / elapsed);
+    u64_t bytes = (u64_t)job->nr_ios * job->bs;
+    u32_t kibps = (u32_t)(bytes * (NSEC_PER_SEC / 1024) / elapsed);
+
+    printf("iobench: %s %s%s bs=%u qd=%u n=%u direct=%d\n",
+           job->path,
+           job->random ? "rand" : "seq",
+           job->write ? "write" : "read",
+           job->bs,
+           job->qd,
+           job->nr_ios,
+           job->direct);
+    printf("  iops=%u kib/s=%u errors=%d\n", iops, kibps, errors);
+    printf("  lat_ns avg=%u p50=%u p90=%u p99=%u p99.9=%u max=%u\n",
+           (u32_t)(lat_sum / job->nr_ios),
+           __iob_percentile(lat, job->nr_ios, 500),
+           __iob_percentile(lat, job->nr_ios, 900),
+           __iob_percentile(lat, job->nr_ios, 990),
+           __iob_percentile(lat, job->nr_ios, 999),
+           lat[job->nr_ios - 1]);
+
+done:
+    if (buf != MAP_FAILED) {
+        munmap(buf, buf_len);
+    }
+    if (lat != MAP_FAILED) {
+        munmap(lat, lat_len);
+    }
+    close(fd);
+    return errors;
+}
+
+/**
+ * @brief 解析十进制数，可带 k 或 m 后缀（×1024 与 ×1048576）
+ *
+ */
+static u32_t
+__iob_atou(const char* str)
+{
+    u32_t v = 0;
+    for (; '0' <= *str && *str <= '9'; str++) {
+        v = v * 10 + (*str - '0');
+    }
+
+    if (*str == 'k' || *str == 'K') {
+        v <<= 10;
+    } else if (*str == 'm' || *str == 'M') {
+        v <<= 20;
+    }
+    return v;
+}
+
+/**
+ * @brief simple shell 的 iobench 命令：
+ *  iobench <路径> <read|write|randread|randwrite> [块大小] [队列深度]
+ *          [次数] [direct]
+ *
+ */
+void
+iobench_cmd(char* args)
+{
+    char* argv[6] = { 0 };
+    int argc = 0;
+
+    while (*args && argc < 6) {
+        argv[argc++] = args;
+        while (*args && *args != ' ') {
+            args++;
+        }
+        while (*args == ' ') {
+            *args++ = '\0';
+        }
+    }
+
+    if (argc < 2) {
+        printf("usage: iobench <path> <read|write|randread|randwrite> "
+               "[bs] [qd] [count] [direct]\n");
+        return;
+    }
+
+    struct iob_job job = { .path = argv[0],
+                           .bs = 4096,
+                           .qd = 1,
+                           .nr_ios = 1024,
+                           .span = IOB_DEFAULT_SPAN };
+
+    const char* mode = argv[1];
+    if (!memcmp(mode, "rand", 4)) {
+        job.random = 1;
+        mode += 4;
+    }
+    job.write = streq(mode, "write");
+    if (!job.write && !streq(mode, "read")) {
+        printf("iobench: unknown mode %s\n", argv[1]);
+        return;
+    }
+
+    if (argc > 2) {
+        job.bs = __iob_atou(argv[2]);
+    }
+    if (argc > 3) {
+        job.qd = __iob_atou(argv[3]);
+    }
+    if (argc > 4) {
+        job.nr_ios = __iob_atou(argv[4]);
+    }
+    job.direct = argc > 5 && streq(argv[5], "direct");
+
+    iobench_run(&job);
+}
+
+#define IOB_FILE "/iobench.dat"
+#define IOB_FILE_SPAN (1024 * 4096)
+#define IOB_DEV "/dev/sda"
+
+// 块大小与队列深度由参数给出，而非以可覆盖的默认值，以免同一字段被初始化两次
+#define __IOB_FILE_JOB(blk, depth, ...)                                        \
+    {                                                                          \
+        .path = IOB_FILE, .span = IOB_FILE_SPAN, .bs = (blk), .qd = (depth),   \
+        __VA_ARGS__                                                            \
+    }
+
+#define __IOB_DEV_JOB(blk, depth, ...)                                         \
+    {                                                                          \
+        .path = IOB_DEV, .span = IOB_DEFAULT_SPAN, .bs = (blk), .qd = (depth), \
+        __VA_ARGS__                                                            \
+    }
+
+void
+_iobench_main()
+{
+    // 普通文件先写后读，读取只覆盖写入的部分；设备上只读，以免破坏其数据
+    struct iob_job jobs[] = {
+        __IOB_FILE_JOB(4096, 1, .write = 1, .nr_ios = 1024),
+        __IOB_FILE_JOB(4096, 1, .nr_ios = 4096),
+        __IOB_FILE_JOB(4096, 1, .random = 1, .nr_ios = 4096),
+        __IOB_DEV_JOB(4096, 1, .nr_ios = 4096),
+        __IOB_DEV_JOB(65536, 1, .direct = 1, .nr_ios = 256),
+        __IOB_DEV_JOB(4096, 1, .random = 1, .direct = 1, .nr_ios = 1024),
+        __IOB_DEV_JOB(4096, 8, .random = 1, .direct = 1, .nr_ios = 1024),
+        __IOB_DEV_JOB(4096, 32, .random = 1, .direct = 1, .nr_ios = 4096),
+    };
+
+    for (u32_t i = 0; i < sizeof(jobs) / sizeof(jobs[0]); i++) {
+        iobench_run(&jobs[i]);
+    }
+
+    unlink(IOB_FILE);
+}
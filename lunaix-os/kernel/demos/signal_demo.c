@@ -4,6 +4,7 @@
 #include <lunaix/spike.h>
 #include <lunaix/types.h>
 #include <ulibc/stdio.h>
+#include <ulibc/stdlib.h>
 
 void __USER__
 sigchild_handler(int signum)
@@ -16,7 +17,7 @@ sigsegv_handler(int signum)
 {
     pid_t pid = getpid();
     printf("SIGSEGV received on process %d\n", pid);
-    _exit(signum);
+    exit(signum);
 }
 
 void __USER__
@@ -41,7 +42,7 @@ _signal_demo_main()
     printf("Child sleep 3s, parent pause.\n");
     if (!fork()) {
         sleep(3);
-        _exit(0);
+        exit(0);
     }
 
     pause();
@@ -57,7 +58,7 @@ _signal_demo_main()
                 i = *(int*)0xdeadc0de; // seg fault!
             }
             printf("%d\n", i);
-            _exit(0);
+            exit(0);
         }
         printf("Forked %d\n", pid);
     }
@@ -8,10 +8,14 @@
 
 #include <klibc/string.h>
 #include <ulibc/stdio.h>
+#include <ulibc/stdlib.h>
 
 char pwd[512];
 char cat_buf[1024];
 
+extern void
+iobench_cmd(char* args); /* iobench.c */
+
 /*
     Simple shell - (actually this is not even a shell)
     It just to make the testing more easy.
@@ -76,7 +80,8 @@ sigint_handle(int signum)
 void
 do_cat(const char* file)
 {
-    int fd = open(file, 0);
+    // 无参数时转录标准输入，以便作为管道的下游
+    int fd = *file ? open(file, 0) : stdin;
     if (fd < 0) {
         sh_printerr();
     } else {
@@ -87,7 +92,9 @@ do_cat(const char* file)
         if (sz < 0) {
             sh_printerr();
         }
-        close(fd);
+        if (fd != stdin) {
+            close(fd);
+        }
         printf("\n");
     }
 }
@@ -99,13 +106,15 @@ do_ls(const char* path)
     if (fd < 0) {
         sh_printerr();
     } else {
-        struct dirent ent = { .d_offset = 0 };
+        struct dirent ents[4];
         int status;
-        while ((status = readdir(fd, &ent)) == 1) {
-            if (ent.d_type == DT_DIR) {
-                printf(" \033[3m%s\033[39;49m\n", ent.d_name);
-            } else {
-                printf(" %s\n", ent.d_name);
+        while ((status = getdents(fd, ents, sizeof(ents))) > 0) {
+            for (int i = 0; i < status / (int)sizeof(struct dirent); i++) {
+                if (ents[i].d_type == DT_DIR) {
+                    printf(" \033[3m%s\033[39;49m\n", ents[i].d_name);
+                } else {
+                    printf(" %s\n", ents[i].d_name);
+                }
             }
         }
 
@@ -116,6 +125,58 @@ do_ls(const char* path)
     }
 }
 
+void
+sh_exec(char* line)
+{
+    char *cmd, *argpart;
+    parse_cmdline(line, &cmd, &argpart);
+
+    if (streq(cmd, "ls")) {
+        do_ls(argpart);
+    } else if (streq(cmd, "cat")) {
+        do_cat(argpart);
+    } else {
+        printf("unknow command\n");
+    }
+}
+
+void
+sh_pipeline(char* left, char* right)
+{
+    int fds[2];
+    pid_t p[2];
+
+    if (pipe(fds) < 0) {
+        sh_printerr();
+        return;
+    }
+
+    if (!(p[0] = fork())) {
+        dup2(fds[1], stdout);
+        close(fds[0]);
+        close(fds[1]);
+        sh_exec(left);
+        exit(0);
+    }
+
+    if (!(p[1] = fork())) {
+        dup2(fds[0], stdin);
+        close(fds[0]);
+        close(fds[1]);
+        sh_exec(right);
+        exit(0);
+    }
+
+    // 须关闭自己手中的写端，下游才能读到文件尾
+    close(fds[0]);
+    close(fds[1]);
+
+    for (int i = 0; i < 2; i++) {
+        setpgid(p[i], getpgid());
+        waitpid(p[i], NULL, 0);
+    }
+}
+
 void
 sh_loop()
 {
@@ -132,12 +193,21 @@ sh_loop()
     while (1) {
         getcwd(pwd, 512);
         printf("[\033[2m%s\033[39;49m]$ ", pwd);
+        fflush(ustdout);
         size_t sz = read(stdin, buf, 511);
         if (sz < 0) {
             printf("fail to read user input (%d)\n", geterrno());
             return;
         }
         buf[sz] = '\0';
+
+        char* bar = strchr(buf, '|');
+        if (bar) {
+            *bar = '\0';
+            sh_pipeline(buf, bar + 1);
+            goto cont;
+        }
+
         parse_cmdline(buf, &cmd, &argpart);
         if (cmd[0] == 0) {
             printf("\n");
@@ -154,12 +224,17 @@ sh_loop()
         } else if (streq(cmd, "ls")) {
             if (!(p = fork())) {
                 do_ls(argpart);
-                _exit(0);
+                exit(0);
             }
         } else if (streq(cmd, "cat")) {
             if (!(p = fork())) {
                 do_cat(argpart);
-                _exit(0);
+                exit(0);
+            }
+        } else if (streq(cmd, "iobench")) {
+            if (!(p = fork())) {
+                iobench_cmd(argpart);
+                exit(0);
             }
         } else {
             printf("unknow command\n");
@@ -178,7 +253,7 @@ sh_main()
     printf("\n Simple shell. Use <PG_UP> or <PG_DOWN> to scroll.\n\n");
     if (!fork()) {
         sh_loop();
-        _exit(0);
+        exit(0);
     }
     wait(NULL);
 }
\ No newline at end of file
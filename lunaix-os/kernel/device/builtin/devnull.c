@@ -1,28 +1,28 @@
 #include <lunaix/device.h>
 
 int
-__null_wr_pg(struct device* dev, void* buf, size_t offset)
+__null_wr_pg(struct device* dev, void* buf, foff_t offset)
 {
     // do nothing
     return PG_SIZE;
 }
 
 int
-__null_wr(struct device* dev, void* buf, size_t offset, size_t len)
+__null_wr(struct device* dev, void* buf, foff_t offset, size_t len)
 {
     // do nothing
     return len;
 }
 
 int
-__null_rd_pg(struct device* dev, void* buf, size_t offset)
+__null_rd_pg(struct device* dev, void* buf, foff_t offset)
 {
     // do nothing
     return 0;
 }
 
 int
-__null_rd(struct device* dev, void* buf, size_t offset, size_t len)
+__null_rd(struct device* dev, void* buf, foff_t offset, size_t len)
 {
     // do nothing
     return 0;
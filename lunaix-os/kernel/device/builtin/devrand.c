@@ -1,31 +1,27 @@
-#include <hal/rnd.h>
 #include <lunaix/device.h>
-#include <lunaix/syslog.h>
-
-LOG_MODULE("rand")
+#include <lunaix/rand.h>
 
 int
-__rand_rd_pg(struct device* dev, void* buf, size_t offset)
+__rand_rd_pg(struct device* dev, void* buf, foff_t offset)
 {
-    rnd_fill(buf, PG_SIZE);
+    rand_bytes(buf, PG_SIZE);
     return PG_SIZE;
 }
 
 int
-__rand_rd(struct device* dev, void* buf, size_t offset, size_t len)
+__rand_rd(struct device* dev, void* buf, foff_t offset, size_t len)
 {
-    rnd_fill(buf, len);
+    rand_bytes(buf, len);
     return len;
 }
 
 void
 devbuiltin_init_rand()
 {
-    if (!rnd_is_supported()) {
-        kprintf(KWARN "not supported.\n");
-        return;
-    }
+    // 无 RDRAND 时仍可用，熵来自 TSC 与中断的时刻
+    rand_init();
+
     struct device* devrand = device_addseq(NULL, NULL, "rand");
     devrand->read = __rand_rd;
     devrand->read_page = __rand_rd_pg;
-}
\ No newline at end of file
+}
@@ -2,13 +2,18 @@
 #include <lunaix/dirent.h>
 #include <lunaix/fs.h>
 #include <lunaix/fs/devfs.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/poll.h>
 #include <lunaix/spike.h>
 
 extern struct v_inode_ops devfs_inode_ops;
 extern struct v_file_ops devfs_file_ops;
 
+// 块设备的 inode 不属于任何一次挂载，由各挂载点与缓冲缓存（bcache）共用
+static struct v_superblock* devfs_vols;
+
 int
-devfs_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+devfs_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     assert(inode->data);
 
@@ -22,7 +27,7 @@ devfs_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
 }
 
 int
-devfs_write(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+devfs_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     assert(inode->data);
 
@@ -36,7 +41,7 @@ devfs_write(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
 }
 
 int
-devfs_read_page(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+devfs_read_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     assert(inode->data);
 
@@ -50,17 +55,82 @@ devfs_read_page(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
 }
 
 int
-devfs_write_page(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+devfs_write_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     assert(inode->data);
 
     struct device* dev = (struct device*)inode->data;
 
-    if (!dev->read_page) {
+    if (!dev->write_page) {
         return ENOTSUP;
     }
 
-    return dev->read_page(dev, buffer, fpos);
+    return dev->write_page(dev, buffer, fpos);
+}
+
+void
+devfs_submit_pages(struct v_inode* inode, struct dev_iocb** iocbs, u32_t n)
+{
+    struct device* dev = (struct device*)inode->data;
+
+    if (dev->plug) {
+        dev->plug(dev);
+    }
+
+    for (u32_t i = 0; i < n; i++) {
+        struct dev_iocb* iocb = iocbs[i];
+        if (dev->submit && !dev->submit(dev, iocb)) {
+            continue;
+        }
+
+        // 设备不支持（或拒绝了）异步请求，退回同步写入
+        iocb->result = devfs_write_page(inode, iocb->buf, iocb->len, iocb->offset);
+        iocb->done(iocb);
+    }
+
+    if (dev->unplug) {
+        dev->unplug(dev);
+    }
+}
+
+int
+devfs_read_file(struct v_file* file, void* buffer, size_t len, foff_t fpos)
+{
+    struct device* dev = (struct device*)file->inode->data;
+
+    if (!dev->read_file) {
+        return devfs_read(file->inode, buffer, len, fpos);
+    }
+
+    return dev->read_file(dev, file, buffer, len);
+}
+
+int
+devfs_sync(struct v_file* file)
+{
+    struct device* dev = (struct device*)file->inode->data;
+
+    if (!dev || !dev->sync) {
+        return ENOTSUP;
+    }
+
+    return dev->sync(dev);
+}
+
+int
+devfs_poll(struct v_file* file, struct poll_table* pt)
+{
+    struct device* dev = (struct device*)file->inode->data;
+
+    if (dev && dev->poll_file) {
+        return dev->poll_file(dev, file, pt);
+    }
+
+    if (!dev || !dev->poll) {
+        return POLL_DEFAULT_MASK;
+    }
+
+    return dev->poll(dev, pt);
 }
 
 int
@@ -90,13 +160,45 @@ devfs_get_dtype(struct device* dev)
     }
 }
 
+struct v_inode*
+devfs_vol_inode(struct device* dev)
+{
+    struct v_inode* inode = vfs_i_find(devfs_vols, dev->dev_id);
+    if (inode) {
+        return inode;
+    }
+
+    if (!(inode = vfs_i_alloc(devfs_vols))) {
+        return NULL;
+    }
+
+    struct pcache* pcache = vzalloc(sizeof(struct pcache));
+    pcache_init(pcache);
+    pcache->master = inode;
+
+    inode->id = dev->dev_id;
+    inode->data = dev;
+    inode->itype = devfs_get_itype(dev);
+    inode->pg_cache = pcache;
+
+    // 缓冲缓存不经由目录项引用它，借此使其免于驱逐
+    inode->link_count++;
+
+    vfs_i_addhash(inode);
+    return inode;
+}
+
 int
 devfs_mknod(struct v_dnode* dnode, struct device* dev)
 {
     assert(dev);
 
-    struct v_inode* devnod = vfs_i_find(dnode->super_block, dev->dev_id);
-    if (!devnod) {
+    struct v_inode* devnod;
+    if ((dev->dev_type & DEV_MSKIF) == DEV_IFVOL) {
+        if (!(devnod = devfs_vol_inode(dev))) {
+            return ENOMEM;
+        }
+    } else if (!(devnod = vfs_i_find(dnode->super_block, dev->dev_id))) {
         if ((devnod = vfs_i_alloc(dnode->super_block))) {
             devnod->id = dev->dev_id;
             devnod->data = dev;
@@ -126,16 +228,44 @@ devfs_dirlookup(struct v_inode* this, struct v_dnode* dnode)
 int
 devfs_readdir(struct v_file* file, struct dir_context* dctx)
 {
-    struct device* dev =
-      device_getbyoffset((struct device*)(file->inode->data), dctx->index);
-    if (!dev) {
+    struct device* parent = (struct device*)(file->inode->data);
+    struct llist_header* it = vfs_dir_seek(
+      file, device_list(parent), dctx->index, device_list_seq());
+    if (!it) {
         return 0;
     }
+
+    struct device* dev = container_of(it, struct device, siblings);
     dctx->read_complete_callback(
       dctx, dev->name.value, dev->name.len, devfs_get_dtype(dev));
     return 1;
 }
 
+int
+devfs_open(struct v_inode* inode, struct v_file* file)
+{
+    struct device* dev = (struct device*)inode->data;
+
+    if (!dev || !dev->open) {
+        return 0;
+    }
+
+    return dev->open(dev, file);
+}
+
+int
+devfs_close(struct v_file* file)
+{
+    struct device* dev = (struct device*)file->inode->data;
+
+    if (dev && dev->release) {
+        dev->release(dev, file);
+        file->data = NULL;
+    }
+
+    return 0;
+}
+
 void
 devfs_init_inode(struct v_superblock* vsb, struct v_inode* inode)
 {
@@ -173,20 +303,29 @@ void
 devfs_init()
 {
     struct filesystem* fs = fsm_new_fs("devfs", 5);
+    fs->types |= FSTYPE_PSEUDO;
     fsm_register(fs);
     fs->mount = devfs_mount;
     fs->unmount = devfs_unmount;
+
+    devfs_vols = vfs_sb_alloc();
+    devfs_vols->fs = fs;
+    devfs_vols->ops.init_inode = devfs_init_inode;
 }
 
 struct v_inode_ops devfs_inode_ops = { .dir_lookup = devfs_dirlookup,
-                                       .open = default_inode_open,
+                                       .open = devfs_open,
                                        .mkdir = default_inode_mkdir,
                                        .rmdir = default_inode_rmdir };
 
-struct v_file_ops devfs_file_ops = { .close = default_file_close,
+struct v_file_ops devfs_file_ops = { .close = devfs_close,
                                      .read = devfs_read,
+                                     .read_file = devfs_read_file,
                                      .read_page = devfs_read_page,
                                      .write = devfs_write,
                                      .write_page = devfs_write_page,
+                                     .submit_pages = devfs_submit_pages,
                                      .seek = default_file_seek,
+                                     .sync = devfs_sync,
+                                     .poll = devfs_poll,
                                      .readdir = devfs_readdir };
\ No newline at end of file
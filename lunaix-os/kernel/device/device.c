@@ -1,5 +1,8 @@
 #include <klibc/stdio.h>
+#include <klibc/string.h>
+#include <lib/hash.h>
 #include <lunaix/device.h>
+#include <lunaix/ds/rhashtable.h>
 #include <lunaix/fs.h>
 #include <lunaix/fs/twifs.h>
 #include <lunaix/ioctl.h>
@@ -11,6 +14,60 @@ static DEFINE_LLIST(root_list);
 
 static volatile dev_t devid = 0;
 
+// 所有设备按（父设备，名称）与按设备号的索引，首次添加设备时建立。
+//  无法建立时退回至逐个比较
+#define DEVICE_HASH_BITS 5
+
+static struct rhtable dev_by_name;
+static struct rhtable dev_by_id;
+
+// 任一设备列表的成员有增删时递增，用于使目录游标作废
+static u32_t dev_seq = 0;
+
+static inline u32_t
+__device_name_key(struct device* parent, u32_t name_hash)
+{
+    return name_hash ^ hash_32((uintptr_t)parent, HASH_SIZE_BITS);
+}
+
+static u32_t
+__device_name_hashof(struct hlist_node* node)
+{
+    struct device* dev = container_of(node, struct device, name_node);
+    return __device_name_key(dev->parent, dev->name.hash);
+}
+
+static u32_t
+__device_id_hashof(struct hlist_node* node)
+{
+    return hash_32(container_of(node, struct device, id_node)->dev_id,
+                   HASH_SIZE_BITS);
+}
+
+static void
+__device_index(struct device* dev)
+{
+    if (!dev_by_name.buckets && rhtable_init(&dev_by_name,
+                                             DEVICE_HASH_BITS,
+                                             __device_name_hashof)) {
+        return;
+    }
+
+    if (!dev_by_id.buckets &&
+        rhtable_init(&dev_by_id, DEVICE_HASH_BITS, __device_id_hashof)) {
+        return;
+    }
+
+    rhtable_add(&dev_by_name, &dev->name_node);
+    rhtable_add(&dev_by_id, &dev->id_node);
+}
+
+static inline int
+__device_name_eq(struct device* dev, struct hstr* name)
+{
+    return HSTR_EQ(&dev->name, name);
+}
+
 struct device*
 device_add(struct device* parent,
            void* underlay,
@@ -40,6 +97,9 @@ device_add(struct device* parent,
     hstr_rehash(&dev->name, HSTR_FULL_HASH);
     llist_init_head(&dev->children);
 
+    __device_index(dev);
+    dev_seq++;
+
     return dev;
 }
 
@@ -86,6 +146,18 @@ device_getbyid(struct llist_header* devlist, dev_t id)
 {
     devlist = devlist ? devlist : &root_list;
     struct device *pos, *n;
+
+    if (dev_by_id.buckets) {
+        rhtable_hash_foreach(
+          &dev_by_id, hash_32(id, HASH_SIZE_BITS), pos, n, id_node)
+        {
+            if (pos->dev_id == id && device_list(pos->parent) == devlist) {
+                return pos;
+            }
+        }
+        return NULL;
+    }
+
     llist_for_each(pos, n, devlist, siblings)
     {
         if (pos->dev_id == id) {
@@ -99,11 +171,23 @@ device_getbyid(struct llist_header* devlist, dev_t id)
 struct device*
 device_getbyhname(struct device* root_dev, struct hstr* name)
 {
-    struct llist_header* devlist = root_dev ? &root_dev->children : &root_list;
+    struct llist_header* devlist = device_list(root_dev);
     struct device *pos, *n;
+
+    if (dev_by_name.buckets) {
+        u32_t key = __device_name_key(root_dev, name->hash);
+        rhtable_hash_foreach(&dev_by_name, key, pos, n, name_node)
+        {
+            if (pos->parent == root_dev && __device_name_eq(pos, name)) {
+                return pos;
+            }
+        }
+        return NULL;
+    }
+
     llist_for_each(pos, n, devlist, siblings)
     {
-        if (HSTR_EQ(&pos->name, name)) {
+        if (__device_name_eq(pos, name)) {
             return pos;
         }
     }
@@ -124,13 +208,32 @@ void
 device_remove(struct device* dev)
 {
     llist_delete(&dev->siblings);
+    if (dev_by_name.buckets) {
+        rhtable_del(&dev_by_name, &dev->name_node);
+    }
+    if (dev_by_id.buckets) {
+        rhtable_del(&dev_by_id, &dev->id_node);
+    }
+    dev_seq++;
     vfree(dev);
 }
 
+struct llist_header*
+device_list(struct device* root_dev)
+{
+    return root_dev ? &root_dev->children : &root_list;
+}
+
+u32_t
+device_list_seq()
+{
+    return dev_seq;
+}
+
 struct device*
 device_getbyoffset(struct device* root_dev, int offset)
 {
-    struct llist_header* devlist = root_dev ? &root_dev->children : &root_list;
+    struct llist_header* devlist = device_list(root_dev);
     struct device *pos, *n;
     int off = 0;
     llist_for_each(pos, n, devlist, siblings)
@@ -165,4 +268,39 @@ __DEFINE_LXSYSCALL3(int, ioctl, int, fd, int, req, va_list, args)
 
 done:
     return DO_STATUS_OR_RETURN(errno);
-}
\ No newline at end of file
+}
+
+static int
+__device_cmd(struct device* dev, u32_t req, ...)
+{
+    va_list args;
+    va_start(args, req);
+    int ret = dev->exec_cmd(dev, req, args);
+    va_end(args);
+    return ret;
+}
+
+/**
+ * @brief 判断文件描述符是否指向终端。
+ *  终端即能应答 TIOCGPGRP 的序列设备；管道、twifs 节点等虽也是序列文件，
+ *  但不是设备，故先检查文件类型再访问 inode->data。
+ *
+ * @return int 是则为1，否则为0
+ */
+__DEFINE_LXSYSCALL1(int, isatty, int, fd)
+{
+    int errno;
+    struct v_fd* fd_s;
+    if ((errno = vfs_getfd(fd, &fd_s))) {
+        return DO_STATUS(errno);
+    }
+
+    struct v_inode* inode = fd_s->file->inode;
+    struct device* dev = (struct device*)inode->data;
+    if (!(inode->itype & VFS_IFSEQDEV) || !dev ||
+        dev->magic != DEV_STRUCT_MAGIC || !dev->exec_cmd) {
+        return 0;
+    }
+
+    return __device_cmd(dev, TIOCGPGRP) != EINVAL;
+}
@@ -1,6 +1,10 @@
+#include <hal/cpu.h>
 #include <lunaix/clock.h>
+#include <lunaix/foptions.h>
+#include <lunaix/fs.h>
 #include <lunaix/input.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/poll.h>
 #include <lunaix/spike.h>
 #include <lunaix/status.h>
 
@@ -16,6 +20,18 @@ input_init()
     input_devcat = device_addcat(NULL, "input");
 }
 
+static void
+__input_enqueue(struct input_evt_queue* q, struct input_evt_pkt* pkt)
+{
+    if (q->head - q->tail == INPUT_QUEUE_LEN) {
+        q->dropped++;
+        return;
+    }
+
+    q->pkts[q->head & (INPUT_QUEUE_LEN - 1)] = *pkt;
+    __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
 void
 input_fire_event(struct input_device* idev, struct input_evt_pkt* pkt)
 {
@@ -30,8 +46,16 @@ input_fire_event(struct input_device* idev, struct input_evt_pkt* pkt)
         }
     }
 
+    struct input_evt_queue *q, *m;
+    int intr = spin_lock_irqsave(&idev->lock);
+    llist_for_each(q, m, &idev->queues, queues)
+    {
+        __input_enqueue(q, pkt);
+    }
+    spin_unlock_irqrestore(&idev->lock, intr);
+
     // wake up all pending readers
-    pwake_all(&idev->readers);
+    event_signal(&idev->arrival);
 }
 
 void
@@ -46,26 +70,88 @@ input_add_listener(input_evt_cb listener)
 }
 
 int
-__input_dev_read(struct device* dev, void* buf, size_t offset, size_t len)
+__input_dev_open(struct device* dev, struct v_file* file)
 {
     struct input_device* idev = dev->underlay;
+    struct input_evt_queue* q = vzalloc(sizeof(*q));
 
-    if (len < sizeof(struct input_evt_pkt)) {
+    if (!q) {
+        return ENOMEM;
+    }
+
+    // the event source walks the queue list from irq context
+    int intr = spin_lock_irqsave(&idev->lock);
+    llist_append(&idev->queues, &q->queues);
+    spin_unlock_irqrestore(&idev->lock, intr);
+
+    file->data = q;
+    return 0;
+}
+
+void
+__input_dev_release(struct device* dev, struct v_file* file)
+{
+    struct input_device* idev = dev->underlay;
+    struct input_evt_queue* q = file->data;
+
+    int intr = spin_lock_irqsave(&idev->lock);
+    llist_delete(&q->queues);
+    spin_unlock_irqrestore(&idev->lock, intr);
+
+    vfree(q);
+}
+
+int
+__input_dev_read(struct device* dev,
+                 struct v_file* file,
+                 void* buf,
+                 size_t len)
+{
+    struct input_device* idev = dev->underlay;
+    struct input_evt_queue* q = file->data;
+    size_t nr = len / sizeof(struct input_evt_pkt);
+
+    if (!nr) {
         return ERANGE;
     }
 
-    // wait for new event
-    pwait(&idev->readers);
+    // wait for events, unless asked not to
+    cpu_disable_interrupt();
+    while (q->head == q->tail) {
+        if ((file->flags & FO_NONBLOCK)) {
+            cpu_enable_interrupt();
+            return EAGAIN;
+        }
+        event_sleep(&idev->arrival);
+        cpu_disable_interrupt();
+    }
+    cpu_enable_interrupt();
 
-    memcpy(buf, &idev->current_pkt, sizeof(struct input_evt_pkt));
+    // hand out as many as are queued and fit in the buffer
+    struct input_evt_pkt* pkts = (struct input_evt_pkt*)buf;
+    u32_t tail = q->tail;
+    u32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    size_t i = 0;
+
+    for (; i < nr && tail != head; i++, tail++) {
+        pkts[i] = q->pkts[tail & (INPUT_QUEUE_LEN - 1)];
+    }
+    __atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
 
-    return sizeof(struct input_evt_pkt);
+    return i * sizeof(struct input_evt_pkt);
 }
 
 int
-__input_dev_read_pg(struct device* dev, void* buf, size_t offset)
+__input_dev_poll(struct device* dev,
+                 struct v_file* file,
+                 struct poll_table* pt)
 {
-    return __input_dev_read(dev, buf, offset, PG_SIZE);
+    struct input_device* idev = dev->underlay;
+    struct input_evt_queue* q = file->data;
+
+    poll_wait(pt, &idev->arrival.waiters);
+
+    return q->head != q->tail ? POLLIN : 0;
 }
 
 struct input_device*
@@ -74,7 +160,9 @@ input_add_device(char* name_fmt, ...)
     assert(input_devcat);
 
     struct input_device* idev = vzalloc(sizeof(*idev));
-    waitq_init(&idev->readers);
+    event_init(&idev->arrival);
+    llist_init_head(&idev->queues);
+    spinlock_init(&idev->lock);
 
     va_list args;
     va_start(args, name_fmt);
@@ -83,8 +171,10 @@ input_add_device(char* name_fmt, ...)
       device_add(input_devcat, idev, name_fmt, DEV_IFSEQ, args);
 
     idev->dev_if = dev;
-    dev->read = __input_dev_read;
-    dev->read_page = __input_dev_read_pg;
+    dev->open = __input_dev_open;
+    dev->release = __input_dev_release;
+    dev->read_file = __input_dev_read;
+    dev->poll_file = __input_dev_poll;
 
     va_end(args);
 
@@ -1,32 +1,50 @@
+#include <klibc/string.h>
 #include <lunaix/buffer.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/status.h>
 
-struct vecbuf*
-vbuf_alloc(struct vecbuf** vec, void* buf, size_t size)
+static int
+__vbuf_grow(struct vecbuf* vbuf)
 {
-    struct vecbuf* vbuf = valloc(sizeof(struct vecbuf));
-    struct vecbuf* _vec = *vec;
+    u32_t cap = vbuf->spill ? vbuf->capacity * 2 : VBUF_INLINE_SEGS * 2;
+    struct membuf* segs = valloc(cap * sizeof(struct membuf));
 
-    *vbuf = (struct vecbuf){ .buf = { .buffer = buf, .size = size },
-                             .acc_sz = vbuf_size(_vec) + size };
+    if (!segs) {
+        return ENOMEM;
+    }
 
-    if (_vec) {
-        llist_append(&_vec->components, &vbuf->components);
-    } else {
-        llist_init_head(&vbuf->components);
-        *vec = vbuf;
+    memcpy(segs, vbuf_segs(vbuf), vbuf->nr_segs * sizeof(struct membuf));
+    if (vbuf->spill) {
+        vfree(vbuf->spill);
     }
 
-    return vbuf;
+    vbuf->spill = segs;
+    vbuf->capacity = cap;
+    return 0;
+}
+
+int
+vbuf_append(struct vecbuf* vbuf, void* buf, size_t size)
+{
+    int errno;
+    u32_t cap = vbuf->spill ? vbuf->capacity : VBUF_INLINE_SEGS;
+
+    if (vbuf->nr_segs == cap && (errno = __vbuf_grow(vbuf))) {
+        return errno;
+    }
+
+    vbuf_segs(vbuf)[vbuf->nr_segs++] =
+      (struct membuf){ .buffer = buf, .size = size };
+    vbuf->size += size;
+
+    return 0;
 }
 
 void
 vbuf_free(struct vecbuf* vbuf)
 {
-    struct vecbuf *pos, *n;
-    llist_for_each(pos, n, &vbuf->components, components)
-    {
-        vfree(pos);
+    if (vbuf->spill) {
+        vfree(vbuf->spill);
     }
-    vfree(pos);
-}
\ No newline at end of file
+    *vbuf = (struct vecbuf){ 0 };
+}
@@ -13,6 +13,59 @@ fifo_init(struct fifo_buf* buf, void* data_buffer, size_t buf_size, int flags)
                               .flags = flags,
                               .free_len = buf_size };
     mutex_init(&buf->lock);
+
+    assert_msg(!(flags & FIFO_SPSC) || !(buf_size & (buf_size - 1)),
+               "spsc fifo: size not power of 2");
+}
+
+/*
+    SPSC ring. Each side only ever stores to its own index, and publishes it
+    with release semantics after the data is in place; the other side reads
+    it with acquire semantics before touching the data.
+*/
+
+static size_t
+__spsc_write(struct fifo_buf* fbuf, const void* data, size_t count)
+{
+    size_t mask = fbuf->size - 1;
+    size_t wr = fbuf->wr_pos;
+    size_t rd = __atomic_load_n(&fbuf->rd_pos, __ATOMIC_ACQUIRE);
+
+    count = MIN(count, fbuf->size - (wr - rd));
+    if (!count) {
+        return 0;
+    }
+
+    size_t off = wr & mask;
+    size_t cplen_tail = MIN(fbuf->size - off, count);
+    memcpy(fbuf->data + off, data, cplen_tail);
+    memcpy(fbuf->data, data + cplen_tail, count - cplen_tail);
+
+    __atomic_store_n(&fbuf->wr_pos, wr + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+static size_t
+__spsc_read(struct fifo_buf* fbuf, void* buf, size_t count)
+{
+    size_t mask = fbuf->size - 1;
+    size_t rd = fbuf->rd_pos;
+    size_t wr = __atomic_load_n(&fbuf->wr_pos, __ATOMIC_ACQUIRE);
+
+    count = MIN(count, wr - rd);
+    if (!count) {
+        return 0;
+    }
+
+    size_t off = rd & mask;
+    size_t cplen_tail = MIN(fbuf->size - off, count);
+    memcpy(buf, fbuf->data + off, cplen_tail);
+    memcpy(buf + cplen_tail, fbuf->data, count - cplen_tail);
+
+    __atomic_store_n(&fbuf->rd_pos, rd + count, __ATOMIC_RELEASE);
+
+    return count;
 }
 
 void
@@ -46,6 +99,17 @@ fifo_backone(struct fifo_buf* fbuf)
 size_t
 fifo_putone(struct fifo_buf* fbuf, uint8_t data)
 {
+    if ((fbuf->flags & FIFO_SPSC)) {
+        size_t wr = fbuf->wr_pos;
+        if (wr - __atomic_load_n(&fbuf->rd_pos, __ATOMIC_ACQUIRE) ==
+            fbuf->size) {
+            return 0;
+        }
+        ((uint8_t*)fbuf->data)[wr & (fbuf->size - 1)] = data;
+        __atomic_store_n(&fbuf->wr_pos, wr + 1, __ATOMIC_RELEASE);
+        return 1;
+    }
+
     mutex_lock(&fbuf->lock);
 
     if (!fbuf->free_len) {
@@ -66,6 +130,10 @@ fifo_putone(struct fifo_buf* fbuf, uint8_t data)
 size_t
 fifo_readone_async(struct fifo_buf* fbuf, uint8_t* data)
 {
+    if ((fbuf->flags & FIFO_SPSC)) {
+        return __spsc_read(fbuf, data, 1);
+    }
+
     if (fbuf->free_len == fbuf->size) {
         return 0;
     }
@@ -103,6 +171,10 @@ fifo_set_wrptr(struct fifo_buf* fbuf, size_t wrptr)
 size_t
 fifo_write(struct fifo_buf* fbuf, void* data, size_t count)
 {
+    if ((fbuf->flags & FIFO_SPSC)) {
+        return __spsc_write(fbuf, data, count);
+    }
+
     size_t wr_count = 0, wr_pos = fbuf->wr_pos;
 
     mutex_lock(&fbuf->lock);
@@ -137,6 +209,10 @@ fifo_write(struct fifo_buf* fbuf, void* data, size_t count)
 size_t
 fifo_read(struct fifo_buf* fbuf, void* buf, size_t count)
 {
+    if ((fbuf->flags & FIFO_SPSC)) {
+        return __spsc_read(fbuf, buf, count);
+    }
+
     size_t rd_count = 0, rd_pos = fbuf->rd_pos;
     mutex_lock(&fbuf->lock);
 
@@ -0,0 +1,82 @@
+#include <hal/cpu.h>
+#include <lunaix/common.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/futex.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_BUCKETS (1 << FUTEX_HASH_BITS)
+
+/*
+    以字所在的物理地址为键，因此共享内存中的同一个字，在不同进程中映射于何处都无关紧要。
+    键相同的等待者必落于同一个桶中，但同一个桶中可能混有不同键的等待者，
+    因此以带键的互斥等待挂入，唤醒时按键筛选。
+*/
+static waitq_t futex_queues[FUTEX_BUCKETS];
+
+void
+futex_init()
+{
+    for (int i = 0; i < FUTEX_BUCKETS; i++) {
+        waitq_init(&futex_queues[i]);
+    }
+}
+
+static inline waitq_t*
+__futex_bucket(uintptr_t key)
+{
+    return &futex_queues[(key * 0x61C88647u) >> (32 - FUTEX_HASH_BITS)];
+}
+
+static uintptr_t
+__futex_key(int* uaddr)
+{
+    if ((uintptr_t)uaddr >= KERNEL_MM_BASE || ((uintptr_t)uaddr & 0x3)) {
+        return 0;
+    }
+
+    // 先行触发缺页（包括写时复制），使得到的物理地址不会在此之后改变。
+    //  系统调用期间中断是屏蔽的，该读-写不会与其他进程交错
+    volatile int* word = uaddr;
+    *word = *word;
+
+    return (uintptr_t)vmm_v2p(uaddr);
+}
+
+static int
+__futex_wait(uintptr_t key, int* uaddr, int val)
+{
+    if (*uaddr != val) {
+        __current->k_status = EAGAIN;
+        return -1;
+    }
+
+    pwait_ex(__futex_bucket(key), WQ_EXCLUSIVE, key);
+    cpu_disable_interrupt();
+
+    return 0;
+}
+
+__DEFINE_LXSYSCALL3(int, futex, int*, uaddr, int, op, int, val)
+{
+    uintptr_t key = __futex_key(uaddr);
+    if (!key) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    switch (op) {
+        case FUTEX_WAIT:
+            return __futex_wait(key, uaddr, val);
+        case FUTEX_WAKE:
+            return pwake_nr(__futex_bucket(key), MAX(val, 0), key);
+        default:
+            __current->k_status = EINVAL;
+            return -1;
+    }
+}
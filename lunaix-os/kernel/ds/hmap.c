@@ -0,0 +1,268 @@
+/**
+ * @file hmap.c
+ * @brief 开放定址的散列表，控制字节按组以SWAR方式匹配
+ *
+ * 组内的匹配只用到32位的整数运算，无需为使用SSE而保存FPU状态。
+ * 与 h2 的匹配可能有假阳性（某字节为零时，借位使其上方的字节亦被误判），
+ * 故在交给使用者前再核对一次控制字节。
+ *
+ */
+#include <klibc/string.h>
+#include <lunaix/ds/hmap.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/status.h>
+
+#define LSBS 0x01010101U
+#define MSBS 0x80808080U
+
+typedef u32_t __attribute__((may_alias)) hmap_group_t;
+
+#define __h1(hash) ((hash) >> 7)
+#define __h2(hash) ((u8_t)((hash)&0x7f))
+
+static inline u32_t
+__group_load(struct hmap* map, u32_t pos)
+{
+    return *(hmap_group_t*)&map->ctrl[pos];
+}
+
+static inline u32_t
+__group_match(u32_t group, u8_t h2)
+{
+    u32_t x = group ^ (LSBS * h2);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+static inline u32_t
+__group_match_empty(u32_t group)
+{
+    // 仅 HMAP_EMPTY 的最高位为1且第1位为0
+    return group & (~group << 6) & MSBS;
+}
+
+static inline u32_t
+__group_match_free(u32_t group)
+{
+    return group & MSBS;
+}
+
+static inline u32_t
+__lowest_byte(u32_t mask)
+{
+    return __builtin_ctz(mask) >> 3;
+}
+
+static inline void
+__set_ctrl(struct hmap* map, u32_t i, u8_t ctrl)
+{
+    map->ctrl[i] = ctrl;
+    // 开头一组的镜像
+    map->ctrl[((i - HMAP_GROUP) & (map->cap - 1)) + HMAP_GROUP] = ctrl;
+}
+
+static inline u32_t
+__max_load(u32_t cap)
+{
+    return cap - cap / 8;
+}
+
+/**
+ * @brief 沿 hash 的探测序列找到第一个空闲（空或已删除）的槽位。
+ *  负载上限保证了总有空槽位，探测必然终止
+ *
+ */
+static u32_t
+__find_free(struct hmap* map, u32_t hash)
+{
+    u32_t mask = map->cap - 1;
+    u32_t pos = __h1(hash) & mask, stride = 0;
+
+    while (1) {
+        u32_t free = __group_match_free(__group_load(map, pos));
+        if (free) {
+            return (pos + __lowest_byte(free)) & mask;
+        }
+        // 三角数步长，容量为2的幂时可遍历所有的组
+        stride += HMAP_GROUP;
+        pos = (pos + stride) & mask;
+    }
+}
+
+static int
+__hmap_alloc(struct hmap* map, u32_t cap)
+{
+    u8_t* ctrl = valloc(cap + HMAP_GROUP);
+    void** slots = valloc(cap * sizeof(void*));
+
+    if (!ctrl || !slots) {
+        if (ctrl) {
+            vfree(ctrl);
+        }
+        if (slots) {
+            vfree(slots);
+        }
+        return ENOMEM;
+    }
+
+    memset(ctrl, HMAP_EMPTY, cap + HMAP_GROUP);
+
+    map->ctrl = ctrl;
+    map->slots = slots;
+    map->cap = cap;
+    map->growth_left = __max_load(cap) - map->count;
+    return 0;
+}
+
+static int
+__hmap_rehash(struct hmap* map, u32_t cap)
+{
+    u8_t* old_ctrl = map->ctrl;
+    void** old_slots = map->slots;
+    u32_t old_cap = map->cap;
+
+    if (__hmap_alloc(map, cap)) {
+        return ENOMEM;
+    }
+
+    for (u32_t i = 0; i < old_cap; i++) {
+        if (old_ctrl[i] & 0x80) {
+            continue;
+        }
+
+        void* entry = old_slots[i];
+        u32_t hash = map->hashof(entry);
+        u32_t j = __find_free(map, hash);
+
+        __set_ctrl(map, j, __h2(hash));
+        map->slots[j] = entry;
+    }
+
+    vfree(old_ctrl);
+    vfree(old_slots);
+    return 0;
+}
+
+int
+hmap_init(struct hmap* map, u32_t min_cap, u32_t (*hashof)(void* entry))
+{
+    u32_t cap = HMAP_MIN_CAP;
+    while (cap < min_cap) {
+        cap <<= 1;
+    }
+
+    *map = (struct hmap){ .hashof = hashof };
+    return __hmap_alloc(map, cap);
+}
+
+void
+hmap_free(struct hmap* map)
+{
+    if (map->ctrl) {
+        vfree(map->ctrl);
+        vfree(map->slots);
+    }
+
+    map->ctrl = NULL;
+    map->slots = NULL;
+    map->cap = 0;
+    map->count = 0;
+    map->growth_left = 0;
+}
+
+int
+hmap_insert(struct hmap* map, void* entry)
+{
+    u32_t hash = map->hashof(entry);
+    u32_t i = __find_free(map, hash);
+
+    if (!map->growth_left && map->ctrl[i] == HMAP_EMPTY) {
+        // 占用者不足 3/4 时，空槽位多是被墓碑耗尽的，按原大小重建即可回收
+        u32_t cap = map->cap;
+        if (map->count >= cap / 2 + cap / 4) {
+            cap <<= 1;
+        }
+        if (__hmap_rehash(map, cap)) {
+            return ENOMEM;
+        }
+        i = __find_free(map, hash);
+    }
+
+    if (map->ctrl[i] == HMAP_EMPTY) {
+        map->growth_left--;
+    }
+
+    __set_ctrl(map, i, __h2(hash));
+    map->slots[i] = entry;
+    map->count++;
+    return 0;
+}
+
+void
+hmap_remove(struct hmap* map, void* entry)
+{
+    struct hmap_probe probe;
+    void* pos;
+
+    hmap_probe_init(map, &probe, map->hashof(entry));
+    while ((pos = hmap_probe_next(map, &probe))) {
+        if (pos != entry) {
+            continue;
+        }
+
+        u32_t mask = map->cap - 1;
+        u32_t i = probe.index;
+
+        // 仅当没有任何连续 HMAP_GROUP 个非空的槽位包含它时，经过此处的探测
+        // 才必然已在近旁的空槽位终止，此时无需留下墓碑
+        u32_t before = (i - HMAP_GROUP) & mask;
+        before = __group_match_empty(__group_load(map, before));
+        u32_t after = __group_match_empty(__group_load(map, i));
+        u8_t ctrl = HMAP_DELETED;
+        if (before && after &&
+            (__builtin_ctz(after) >> 3) + (__builtin_clz(before) >> 3) <
+              HMAP_GROUP) {
+            ctrl = HMAP_EMPTY;
+            map->growth_left++;
+        }
+
+        __set_ctrl(map, i, ctrl);
+        map->count--;
+        return;
+    }
+}
+
+void
+hmap_probe_init(struct hmap* map, struct hmap_probe* probe, u32_t hash)
+{
+    probe->pos = __h1(hash) & (map->cap - 1);
+    probe->stride = 0;
+    probe->h2 = __h2(hash);
+    probe->match = __group_match(__group_load(map, probe->pos), probe->h2);
+}
+
+void*
+hmap_probe_next(struct hmap* map, struct hmap_probe* probe)
+{
+    u32_t mask = map->cap - 1;
+
+    while (1) {
+        if (probe->match) {
+            u32_t i = (probe->pos + __lowest_byte(probe->match)) & mask;
+            probe->match &= probe->match - 1;
+            if (map->ctrl[i] == probe->h2) {
+                probe->index = i;
+                return map->slots[i];
+            }
+            continue;
+        }
+
+        // 组内有空槽位，说明该散列值的探测序列至此为止
+        if (__group_match_empty(__group_load(map, probe->pos))) {
+            return NULL;
+        }
+
+        probe->stride += HMAP_GROUP;
+        probe->pos = (probe->pos + probe->stride) & mask;
+        probe->match = __group_match(__group_load(map, probe->pos), probe->h2);
+    }
+}
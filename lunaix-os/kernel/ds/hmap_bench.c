@@ -0,0 +1,157 @@
+/**
+ * @file hmap_bench.c
+ * @brief hmap 与 rhtable（链式散列表）的微基准，于 flags.h 中定义
+ *  LUNAIX_HMAP_BENCH 后在启动时运行一次，结果输出至内核日志
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/ds/hmap.h>
+#include <lunaix/ds/rhashtable.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/syslog.h>
+
+#ifdef LUNAIX_HMAP_BENCH
+
+LOG_MODULE("HMAP")
+
+#define BENCH_N 4096
+
+struct bench_ent
+{
+    struct hlist_node hash_list;
+    u32_t key;
+};
+
+static u32_t
+__bench_hash(u32_t key)
+{
+    return hash_fmix32(key);
+}
+
+static u32_t
+__hmap_hashof(void* entry)
+{
+    return __bench_hash(((struct bench_ent*)entry)->key);
+}
+
+static u32_t
+__rht_hashof(struct hlist_node* node)
+{
+    return __bench_hash(container_of(node, struct bench_ent, hash_list)->key);
+}
+
+static struct bench_ent*
+__hmap_find(struct hmap* map, u32_t key)
+{
+    struct hmap_probe probe;
+    struct bench_ent* pos;
+    hmap_hash_foreach(map, __bench_hash(key), pos, probe)
+    {
+        if (pos->key == key) {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+static struct bench_ent*
+__rht_find(struct rhtable* table, u32_t key)
+{
+    struct bench_ent *pos, *n;
+    rhtable_hash_foreach(table, __bench_hash(key), pos, n, hash_list)
+    {
+        if (pos->key == key) {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+// 每次操作的平均周期数
+#define __per_op(t0) ((u32_t)((cpu_rdtsc() - (t0)) / BENCH_N))
+
+void
+hmap_bench()
+{
+    struct bench_ent* ents = valloc(BENCH_N * sizeof(struct bench_ent));
+    struct hmap map;
+    struct rhtable table;
+    u32_t hits = 0;
+    u64_t t0;
+
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        ents[i].key = i * 2 + 1;
+    }
+
+    hmap_init(&map, 0, __hmap_hashof);
+    rhtable_init(&table, 4, __rht_hashof);
+
+    // 关中断，以免计入中断处理的时间
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        hmap_insert(&map, &ents[i]);
+    }
+    u32_t hm_ins = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        hits += !!__hmap_find(&map, i * 2 + 1);
+    }
+    u32_t hm_hit = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        hits += !!__hmap_find(&map, i * 2);
+    }
+    u32_t hm_miss = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        hmap_remove(&map, &ents[i]);
+    }
+    u32_t hm_del = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        rhtable_add(&table, &ents[i].hash_list);
+    }
+    u32_t rh_ins = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        hits += !!__rht_find(&table, i * 2 + 1);
+    }
+    u32_t rh_hit = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        hits += !!__rht_find(&table, i * 2);
+    }
+    u32_t rh_miss = __per_op(t0);
+
+    t0 = cpu_rdtsc();
+    for (u32_t i = 0; i < BENCH_N; i++) {
+        rhtable_del(&table, &ents[i].hash_list);
+    }
+    u32_t rh_del = __per_op(t0);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    kprintf("%u entries, cycles/op (insert, hit, miss, remove)\n", BENCH_N);
+    kprintf("  hmap:    %u %u %u %u\n", hm_ins, hm_hit, hm_miss, hm_del);
+    kprintf("  rhtable: %u %u %u %u\n", rh_ins, rh_hit, rh_miss, rh_del);
+    if (hits != 2 * BENCH_N) {
+        kprintf(KERROR "lookup mismatch: %u hits\n", hits);
+    }
+
+    hmap_free(&map);
+    rhtable_free(&table);
+    vfree(ents);
+}
+
+#endif
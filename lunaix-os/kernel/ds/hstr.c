@@ -1,10 +1,111 @@
 #include <klibc/string.h>
 #include <lunaix/ds/hstr.h>
+#include <lunaix/ds/rhashtable.h>
+#include <lunaix/ds/spinlock.h>
+#include <lunaix/mm/valloc.h>
+
+#define HSTR_INTERN_BITS 6
+
+/*
+    Interned names. Directory entries, xattrs and ISO9660 directory records
+    repeat the same few names over and over (think of "." files, or every
+    subdirectory of an ISO tree holding the same set of names); each distinct
+    name is stored once here and shared by reference count.
+*/
+struct hstr_atom
+{
+    struct hlist_node hash_list;
+    u32_t hash;
+    u32_t len;
+    u32_t ref;
+    char value[0];
+};
+
+static struct rhtable intern_table;
+static DEFINE_SPINLOCK(intern_lock);
+
+static u32_t
+__hstr_atom_hashof(struct hlist_node* node)
+{
+    return container_of(node, struct hstr_atom, hash_list)->hash;
+}
+
+static inline struct hstr_atom*
+__hstr_atom(const char* value)
+{
+    return (struct hstr_atom*)(value - offsetof(struct hstr_atom, value));
+}
 
 void
 hstrcpy(struct hstr* dest, struct hstr* src)
 {
-    strcpy(dest->value, src->value);
+    // dest is a caller-owned buffer, never an interned name
+    strcpy((char*)dest->value, src->value);
     dest->hash = src->hash;
     dest->len = src->len;
-}
\ No newline at end of file
+}
+
+void
+hstr_intern(struct hstr* dest, struct hstr* src)
+{
+    u32_t len = src->len;
+    u32_t hash = strhash_32_n(src->value, len, HSTR_FULL_HASH);
+    struct hstr_atom *atom = NULL, *pos, *n;
+
+    // kernel threads may be preempted; keep the table consistent
+    int intr = spin_lock_irqsave(&intern_lock);
+
+    if (!intern_table.buckets) {
+        rhtable_init(&intern_table, HSTR_INTERN_BITS, __hstr_atom_hashof);
+    }
+
+    rhtable_hash_foreach(&intern_table, hash, pos, n, hash_list)
+    {
+        if (pos->hash == hash && pos->len == len &&
+            !memcmp(pos->value, src->value, len)) {
+            atom = pos;
+            break;
+        }
+    }
+
+    if (!atom) {
+        atom = valloc(sizeof(struct hstr_atom) + len + 1);
+        *atom = (struct hstr_atom){ .hash = hash, .len = len };
+        memcpy(atom->value, src->value, len);
+        atom->value[len] = '\0';
+        rhtable_add(&intern_table, &atom->hash_list);
+    }
+
+    atom->ref++;
+
+    spin_unlock_irqrestore(&intern_lock, intr);
+
+    *dest = HHSTR(atom->value, len, hash);
+}
+
+void
+hstr_dup(struct hstr* dest, struct hstr* interned)
+{
+    int intr = spin_lock_irqsave(&intern_lock);
+    __hstr_atom(interned->value)->ref++;
+    spin_unlock_irqrestore(&intern_lock, intr);
+
+    *dest = *interned;
+}
+
+void
+hstr_release(struct hstr* interned)
+{
+    struct hstr_atom* atom = __hstr_atom(interned->value);
+
+    int intr = spin_lock_irqsave(&intern_lock);
+
+    if (!--atom->ref) {
+        rhtable_del(&intern_table, &atom->hash_list);
+        vfree(atom);
+    }
+
+    spin_unlock_irqrestore(&intern_lock, intr);
+
+    interned->value = NULL;
+}
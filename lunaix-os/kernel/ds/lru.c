@@ -1,5 +1,6 @@
 #include <lunaix/ds/lru.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
 
 struct llist_header zone_lead = { .next = &zone_lead, .prev = &zone_lead };
 
@@ -22,53 +23,115 @@ lru_new_zone(evict_cb try_evict_cb)
 void
 lru_use_one(struct lru_zone* zone, struct lru_node* node)
 {
-    if (node->lru_nodes.next && node->lru_nodes.prev) {
-        llist_delete(&node->lru_nodes);
+    struct llist_header* elem = &node->lru_nodes;
+    if (elem->next && elem->next != elem) {
+        node->referenced = 1;
+        return;
     }
 
-    llist_prepend(&zone->lead_node, &node->lru_nodes);
+    node->referenced = 0;
     zone->objects++;
+    llist_prepend(&zone->lead_node, elem);
 }
 
-static void
+// 每需回收一个对象，至多尝试驱逐的节点数。被钉住的对象无法驱逐，限制扫描长度以免空转
+#define LRU_SCAN_RATIO 4
+
+static int
 __do_evict(struct lru_zone* zone, struct llist_header* elem)
 {
     llist_delete(elem);
+    zone->objects--;
+
     if (!zone->try_evict(container_of(elem, struct lru_node, lru_nodes))) {
-        llist_append(&zone->lead_node, elem);
-    } else {
-        zone->objects--;
+        // 回调可能已将其移入别的区域（如降级），此时不再放回
+        if (elem->next == elem) {
+            llist_append(&zone->lead_node, elem);
+            zone->objects++;
+        }
+        return 0;
     }
+
+    return 1;
 }
 
-void
-lru_evict_one(struct lru_zone* zone)
+u32_t
+lru_evict_n(struct lru_zone* zone, u32_t n)
 {
-    struct llist_header* tail = zone->lead_node.prev;
-    if (tail == &zone->lead_node) {
-        return;
+    u32_t evicted = 0;
+    u32_t scan = MIN(zone->objects, n * LRU_SCAN_RATIO);
+    // 每个节点至多获得一次第二次机会，一轮之后所有的访问标记均已被清除
+    u32_t rotate = zone->objects;
+    struct llist_header *tail = zone->lead_node.prev, *prev;
+
+    while (tail != &zone->lead_node && evicted < n && scan) {
+        // 被驱逐的节点随即释放，需事先取得其前驱
+        prev = tail->prev;
+
+        struct lru_node* node = container_of(tail, struct lru_node, lru_nodes);
+        if (node->referenced && rotate) {
+            rotate--;
+            node->referenced = 0;
+            llist_delete(tail);
+            llist_prepend(&zone->lead_node, tail);
+        } else {
+            scan--;
+            evicted += __do_evict(zone, tail);
+        }
+
+        tail = prev;
     }
 
-    __do_evict(zone, tail);
+    return evicted;
+}
+
+void
+lru_evict_one(struct lru_zone* zone)
+{
+    lru_evict_n(zone, 1);
 }
 
 void
 lru_evict_half(struct lru_zone* zone)
 {
-    int target = (int)(zone->objects / 2);
-    struct llist_header* tail = zone->lead_node.prev;
-    while (tail != &zone->lead_node && target > 0) {
-        __do_evict(zone, tail);
-        tail = tail->prev;
-        target--;
+    lru_evict_n(zone, zone->objects / 2);
+}
+
+u32_t
+lru_reclaim(u32_t target)
+{
+    u32_t total = 0, evicted = 0;
+    struct lru_zone *pos, *n;
+
+    llist_for_each(pos, n, &zone_lead, zones)
+    {
+        total += pos->objects;
     }
+
+    if (!total) {
+        return 0;
+    }
+
+    // 按各区域的对象数量分摊回收量（向上取整，以保证小区域也能被回收）
+    llist_for_each(pos, n, &zone_lead, zones)
+    {
+        if (!pos->objects) {
+            continue;
+        }
+        u32_t quota = (target * pos->objects + total - 1) / total;
+        evicted += lru_evict_n(pos, quota);
+    }
+
+    return evicted;
 }
 
 void
 lru_remove(struct lru_zone* zone, struct lru_node* node)
 {
-    if (node->lru_nodes.next && node->lru_nodes.prev) {
-        llist_delete(&node->lru_nodes);
+    // 未在链表中（或已被驱逐流程摘下）的节点不计
+    struct llist_header* elem = &node->lru_nodes;
+    if (elem->next && elem->next != elem) {
+        llist_delete(elem);
+        zone->objects--;
     }
-    zone->objects--;
 }
\ No newline at end of file
@@ -1,11 +1,91 @@
+#include <hal/cpu.h>
 #include <lunaix/ds/mutex.h>
+#include <lunaix/fs/twifs.h>
 #include <lunaix/process.h>
+#include <lunaix/sched.h>
+
+// 持有者正在（另一处理器上）运行时，自旋等待的最大次数
+#define MUTEX_SPIN_MAX 1000
+
+static DEFINE_LLIST(mutex_classes);
+
+void
+__mutex_init(mutex_t* mutex, struct mutex_class* cls)
+{
+    mutex->locked = ATOMIC_VAR_INIT(0);
+    mutex->owner = 0;
+    mutex->cls = cls;
+    waitq_init(&mutex->waiters);
+
+    // 类别为静态变量，首次使用时登记
+    if (!cls->classes.next) {
+        llist_append(&mutex_classes, &cls->classes);
+    }
+}
+
+static inline int
+__mutex_trylock(mutex_t* mutex)
+{
+    int expected = 0;
+    return atomic_compare_exchange_strong(&mutex->locked, &expected, 1);
+}
+
+static int
+__owner_running(mutex_t* mutex)
+{
+    struct proc_info* owner = get_process(mutex->owner);
+    return owner && owner != __current && owner->state == PS_RUNNING;
+}
+
+static void
+__mutex_lock_slow(mutex_t* mutex)
+{
+    mutex->cls->contended++;
+
+    // 持有者仍在运行，则很可能马上就会释放，短暂的自旋比阻塞更划算。
+    //  单处理器下持有者不可能与我们同时运行，故不会自旋
+    for (int i = 0; i < MUTEX_SPIN_MAX && __owner_running(mutex); i++) {
+        asm volatile("pause");
+        if (__mutex_trylock(mutex)) {
+            return;
+        }
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    mutex->cls->blocked++;
+
+    while (1) {
+        // 检查与入队之间不得插入释放，否则将错过唤醒
+        cpu_disable_interrupt();
+
+        if (__mutex_trylock(mutex)) {
+            break;
+        }
+
+        // 空闲进程不可阻塞，只能让出
+        if (__current->pid == KERNEL_PID) {
+            sched_yieldk();
+        } else if (pwait_ex(&mutex->waiters, WQ_EXCLUSIVE, 0)) {
+            // 释放者已将锁直接移交予我们
+            cpu_disable_interrupt();
+            break;
+        }
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
 
 void
 mutex_lock(mutex_t* mutex)
 {
-    sem_wait(&mutex->sem);
+    if (!__mutex_trylock(mutex)) {
+        __mutex_lock_slow(mutex);
+    }
+
     mutex->owner = __current->pid;
+    mutex->cls->acquired++;
 }
 
 void
@@ -20,5 +100,41 @@ mutex_unlock_for(mutex_t* mutex, pid_t pid)
     if (mutex->owner != pid) {
         return;
     }
-    sem_post(&mutex->sem);
-}
\ No newline at end of file
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // 有等待者时直接移交，锁保持占用，免得被唤醒者醒来后又被他人抢先
+    struct proc_info* next = pwake_handoff(&mutex->waiters, 0);
+    if (next) {
+        mutex->owner = next->pid;
+    } else {
+        atomic_store(&mutex->locked, 0);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+static void
+__mutex_rd_stat(struct twimap* map)
+{
+    struct mutex_class *pos, *n;
+    llist_for_each(pos, n, &mutex_classes, classes)
+    {
+        twimap_printf(map,
+                      "%s %u %u %u\n",
+                      pos->name,
+                      pos->acquired,
+                      pos->contended,
+                      pos->blocked);
+    }
+}
+
+void
+mutex_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "mutex_stat");
+    map->read = __mutex_rd_stat;
+}
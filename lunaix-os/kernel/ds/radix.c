@@ -0,0 +1,308 @@
+/**
+ * @file radix.c
+ * @brief 带标记的基数树，每个节点以 RADIX_FANOUT 个槽位的数组索引子节点
+ *
+ * 一个高为 h 的树覆盖 RADIX_BITS * h 位的下标，根节点取最高的 RADIX_BITS 位。
+ * 标记自叶节点向上汇总：内部节点的标记位表示对应的子树中存在带此标记的元素，
+ * 因此按标记查找时可直接跳过无关的子树。
+ *
+ */
+#include <lunaix/ds/radix.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+#define __tagbit(off) (1ULL << (off))
+
+static inline u32_t
+__radix_maxidx(u32_t height)
+{
+    u32_t bits = height * RADIX_BITS;
+    return bits >= 32 ? (u32_t)-1 : (1U << bits) - 1;
+}
+
+static struct radix_node*
+__radix_new_node(struct radix_node* parent, u32_t offset)
+{
+    struct radix_node* node = vzalloc(sizeof(struct radix_node));
+    if (node) {
+        node->parent = parent;
+        node->offset = offset;
+    }
+    return node;
+}
+
+/**
+ * @brief 找到 idx（已舍去低位）所在的叶节点
+ *
+ */
+static struct radix_node*
+__radix_leaf(struct radix_tree* tree, u32_t idx)
+{
+    struct radix_node* node = tree->root;
+    if (!node || idx > __radix_maxidx(tree->height)) {
+        return NULL;
+    }
+
+    for (u32_t shift = (tree->height - 1) * RADIX_BITS; shift && node;
+         shift -= RADIX_BITS) {
+        node = node->slots[(idx >> shift) & RADIX_MASK];
+    }
+
+    return node;
+}
+
+static int
+__radix_grow(struct radix_tree* tree, u32_t idx)
+{
+    if (!tree->root) {
+        if (!(tree->root = __radix_new_node(NULL, 0))) {
+            return ENOMEM;
+        }
+        tree->height = 1;
+    }
+
+    while (idx > __radix_maxidx(tree->height)) {
+        struct radix_node* root = __radix_new_node(NULL, 0);
+        if (!root) {
+            return ENOMEM;
+        }
+
+        struct radix_node* old = tree->root;
+        root->slots[0] = old;
+        root->count = 1;
+        for (int t = 0; t < RADIX_NR_TAGS; t++) {
+            root->tags[t] = old->tags[t] ? __tagbit(0) : 0;
+        }
+
+        old->parent = root;
+        old->offset = 0;
+
+        tree->root = root;
+        tree->height++;
+    }
+
+    return 0;
+}
+
+void
+radix_init(struct radix_tree* tree, u32_t trunc_bits)
+{
+    tree->root = NULL;
+    tree->height = 0;
+    tree->truncated = trunc_bits;
+}
+
+void*
+radix_get(struct radix_tree* tree, u32_t index)
+{
+    u32_t idx = index >> tree->truncated;
+    struct radix_node* leaf = __radix_leaf(tree, idx);
+    return leaf ? leaf->slots[idx & RADIX_MASK] : NULL;
+}
+
+int
+radix_set(struct radix_tree* tree, u32_t index, void* data)
+{
+    u32_t idx = index >> tree->truncated;
+    int errno;
+
+    if ((errno = __radix_grow(tree, idx))) {
+        return errno;
+    }
+
+    struct radix_node* node = tree->root;
+    for (u32_t shift = (tree->height - 1) * RADIX_BITS; shift;
+         shift -= RADIX_BITS) {
+        u32_t off = (idx >> shift) & RADIX_MASK;
+        if (!node->slots[off]) {
+            if (!(node->slots[off] = __radix_new_node(node, off))) {
+                return ENOMEM;
+            }
+            node->count++;
+        }
+        node = node->slots[off];
+    }
+
+    u32_t off = idx & RADIX_MASK;
+    if (!node->slots[off]) {
+        node->count++;
+    }
+    node->slots[off] = data;
+
+    return 0;
+}
+
+static void
+__radix_untag(struct radix_node* node, u32_t off, int tag)
+{
+    // 子树中已无带此标记的元素时，才需清除上层的标记
+    while (node) {
+        node->tags[tag] &= ~__tagbit(off);
+        if (node->tags[tag]) {
+            break;
+        }
+        off = node->offset;
+        node = node->parent;
+    }
+}
+
+void*
+radix_remove(struct radix_tree* tree, u32_t index)
+{
+    u32_t idx = index >> tree->truncated;
+    struct radix_node* node = __radix_leaf(tree, idx);
+    u32_t off = idx & RADIX_MASK;
+
+    if (!node || !node->slots[off]) {
+        return NULL;
+    }
+
+    void* data = node->slots[off];
+    for (int t = 0; t < RADIX_NR_TAGS; t++) {
+        __radix_untag(node, off, t);
+    }
+
+    node->slots[off] = NULL;
+    node->count--;
+
+    // 自下而上回收空的节点
+    while (!node->count) {
+        struct radix_node* parent = node->parent;
+        if (!parent) {
+            tree->root = NULL;
+            tree->height = 0;
+        } else {
+            parent->slots[node->offset] = NULL;
+            parent->count--;
+        }
+
+        vfree(node);
+        if (!(node = parent)) {
+            break;
+        }
+    }
+
+    return data;
+}
+
+void
+radix_tag_set(struct radix_tree* tree, u32_t index, int tag)
+{
+    u32_t idx = index >> tree->truncated;
+    struct radix_node* node = __radix_leaf(tree, idx);
+    u32_t off = idx & RADIX_MASK;
+
+    if (!node || !node->slots[off]) {
+        return;
+    }
+
+    while (node && !(node->tags[tag] & __tagbit(off))) {
+        node->tags[tag] |= __tagbit(off);
+        off = node->offset;
+        node = node->parent;
+    }
+}
+
+void
+radix_tag_clear(struct radix_tree* tree, u32_t index, int tag)
+{
+    u32_t idx = index >> tree->truncated;
+    struct radix_node* node = __radix_leaf(tree, idx);
+
+    if (node) {
+        __radix_untag(node, idx & RADIX_MASK, tag);
+    }
+}
+
+int
+radix_tag_get(struct radix_tree* tree, u32_t index, int tag)
+{
+    u32_t idx = index >> tree->truncated;
+    struct radix_node* node = __radix_leaf(tree, idx);
+
+    return node && (node->tags[tag] & __tagbit(idx & RADIX_MASK));
+}
+
+static u32_t
+__radix_gang(struct radix_node* node,
+             u32_t shift,
+             u32_t base,
+             u32_t start,
+             void** results,
+             u32_t max,
+             int tag)
+{
+    u32_t n = 0;
+    u32_t i = start > base ? (start - base) >> shift : 0;
+
+    for (; i < RADIX_FANOUT && n < max; i++) {
+        if (!node->slots[i]) {
+            continue;
+        }
+
+        if (tag >= 0 && !(node->tags[tag] & __tagbit(i))) {
+            continue;
+        }
+
+        if (!shift) {
+            results[n++] = node->slots[i];
+            continue;
+        }
+
+        n += __radix_gang(node->slots[i],
+                          shift - RADIX_BITS,
+                          base + (i << shift),
+                          start,
+                          results + n,
+                          max - n,
+                          tag);
+    }
+
+    return n;
+}
+
+u32_t
+radix_gang_lookup(struct radix_tree* tree,
+                  void** results,
+                  u32_t start,
+                  u32_t max,
+                  int tag)
+{
+    u32_t idx = start >> tree->truncated;
+    if (!tree->root || !max || idx > __radix_maxidx(tree->height)) {
+        return 0;
+    }
+
+    return __radix_gang(tree->root,
+                        (tree->height - 1) * RADIX_BITS,
+                        0,
+                        idx,
+                        results,
+                        max,
+                        tag);
+}
+
+static void
+__radix_free(struct radix_node* node, u32_t level)
+{
+    if (level > 1) {
+        for (u32_t i = 0; i < RADIX_FANOUT; i++) {
+            if (node->slots[i]) {
+                __radix_free(node->slots[i], level - 1);
+            }
+        }
+    }
+    vfree(node);
+}
+
+void
+radix_release(struct radix_tree* tree)
+{
+    if (tree->root) {
+        __radix_free(tree->root, tree->height);
+    }
+
+    tree->root = NULL;
+    tree->height = 0;
+}
@@ -0,0 +1,331 @@
+/**
+ * @file rbtree.c
+ * @brief 侵入式的红黑树，支持子树聚合值的维护
+ *
+ * 旋转不改变被旋转的一对节点所构成的子树的元素集合，故只需依次（先下后上）
+ * 更新这两个节点；其余受影响的只有自修改处至根的路径，由 rb_propagate 处理。
+ *
+ */
+#include <lunaix/ds/rbtree.h>
+
+static inline void
+__rb_update(struct rb_root* root, struct rb_node* node)
+{
+    if (root->update) {
+        root->update(node);
+    }
+}
+
+static inline int
+__rb_is_black(struct rb_node* node)
+{
+    return !node || node->color == RB_BLACK;
+}
+
+/**
+ * @brief 在 old 的父节点（或根）中以 new 取代 old
+ *
+ */
+static inline void
+__rb_replace_child(struct rb_root* root,
+                   struct rb_node* old,
+                   struct rb_node* new)
+{
+    struct rb_node* parent = old->parent;
+
+    if (!parent) {
+        root->node = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+
+    if (new) {
+        new->parent = parent;
+    }
+}
+
+static void
+__rb_rotate_left(struct rb_root* root, struct rb_node* x)
+{
+    struct rb_node* y = x->right;
+
+    x->right = y->left;
+    if (y->left) {
+        y->left->parent = x;
+    }
+
+    __rb_replace_child(root, x, y);
+    y->left = x;
+    x->parent = y;
+
+    __rb_update(root, x);
+    __rb_update(root, y);
+}
+
+static void
+__rb_rotate_right(struct rb_root* root, struct rb_node* x)
+{
+    struct rb_node* y = x->left;
+
+    x->left = y->right;
+    if (y->right) {
+        y->right->parent = x;
+    }
+
+    __rb_replace_child(root, x, y);
+    y->right = x;
+    x->parent = y;
+
+    __rb_update(root, x);
+    __rb_update(root, y);
+}
+
+void
+rb_propagate(struct rb_root* root, struct rb_node* node)
+{
+    if (!root->update) {
+        return;
+    }
+
+    for (; node; node = node->parent) {
+        root->update(node);
+    }
+}
+
+void
+rb_insert(struct rb_root* root, struct rb_node* node)
+{
+    struct rb_node *parent, *gparent, *uncle;
+
+    rb_propagate(root, node);
+
+    while ((parent = node->parent) && parent->color == RB_RED) {
+        // 父节点为红色，故其不是根，祖父节点必然存在
+        gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (!__rb_is_black(uncle)) {
+                parent->color = uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->right) {
+                __rb_rotate_left(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            __rb_rotate_right(root, gparent);
+        } else {
+            uncle = gparent->left;
+            if (!__rb_is_black(uncle)) {
+                parent->color = uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->left) {
+                __rb_rotate_right(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            __rb_rotate_left(root, gparent);
+        }
+    }
+
+    root->node->color = RB_BLACK;
+}
+
+/**
+ * @brief 删除一个黑色节点后，x 所在的一侧少了一个黑色节点。x 可为空，
+ *  故其父节点另行给出
+ *
+ */
+static void
+__rb_erase_fixup(struct rb_root* root,
+                 struct rb_node* x,
+                 struct rb_node* parent)
+{
+    struct rb_node* w;
+
+    while (x != root->node && __rb_is_black(x)) {
+        // 兄弟节点的一侧多出一个黑色节点，故其必不为空
+        if (x == parent->left) {
+            w = parent->right;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                __rb_rotate_left(root, parent);
+                w = parent->right;
+            }
+
+            if (__rb_is_black(w->left) && __rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+
+            if (__rb_is_black(w->right)) {
+                w->left->color = RB_BLACK;
+                w->color = RB_RED;
+                __rb_rotate_right(root, w);
+                w = parent->right;
+            }
+
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            w->right->color = RB_BLACK;
+            __rb_rotate_left(root, parent);
+        } else {
+            w = parent->left;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                __rb_rotate_right(root, parent);
+                w = parent->left;
+            }
+
+            if (__rb_is_black(w->left) && __rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+
+            if (__rb_is_black(w->left)) {
+                w->right->color = RB_BLACK;
+                w->color = RB_RED;
+                __rb_rotate_left(root, w);
+                w = parent->left;
+            }
+
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            w->left->color = RB_BLACK;
+            __rb_rotate_right(root, parent);
+        }
+
+        x = root->node;
+        break;
+    }
+
+    if (x) {
+        x->color = RB_BLACK;
+    }
+}
+
+void
+rb_erase(struct rb_root* root, struct rb_node* node)
+{
+    struct rb_node *x, *parent;
+    int color = node->color;
+
+    if (!node->left) {
+        x = node->right;
+        parent = node->parent;
+        __rb_replace_child(root, node, x);
+    } else if (!node->right) {
+        x = node->left;
+        parent = node->parent;
+        __rb_replace_child(root, node, x);
+    } else {
+        // 以后继 y 取代 node，实际被摘下的是 y 原本的位置
+        struct rb_node* y = node->right;
+        while (y->left) {
+            y = y->left;
+        }
+
+        color = y->color;
+        x = y->right;
+
+        if (y->parent == node) {
+            parent = y;
+        } else {
+            parent = y->parent;
+            __rb_replace_child(root, y, x);
+            y->right = node->right;
+            y->right->parent = y;
+        }
+
+        __rb_replace_child(root, node, y);
+        y->left = node->left;
+        y->left->parent = y;
+        y->color = node->color;
+    }
+
+    // y（若有）位于 parent 至根的路径上，一并得到更新
+    rb_propagate(root, parent);
+
+    if (color == RB_BLACK) {
+        __rb_erase_fixup(root, x, parent);
+    }
+}
+
+struct rb_node*
+rb_first(struct rb_root* root)
+{
+    struct rb_node* node = root->node;
+
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+struct rb_node*
+rb_last(struct rb_root* root)
+{
+    struct rb_node* node = root->node;
+
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+struct rb_node*
+rb_next(struct rb_node* node)
+{
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    // 向上直至自左子树返回
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+struct rb_node*
+rb_prev(struct rb_node* node)
+{
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+        return node;
+    }
+
+    while (node->parent && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file rhashtable.c
+ * @brief 可伸缩的散列表，以渐进的方式迁移至新的大小
+ *
+ * 一次性的重新散列在元素众多时会造成明显的停顿，因而迁移被分摊至其后的插入与
+ * 移除操作中，每次至多迁移 RHT_MIGRATE_STEP 个桶。查找不参与迁移，只读不写。
+ *
+ */
+#include <lunaix/ds/rhashtable.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/status.h>
+
+#define __nr_buckets(bits) (1U << (bits))
+
+static void
+__rht_migrate(struct rhtable* table)
+{
+    if (!table->old) {
+        return;
+    }
+
+    u32_t len = __nr_buckets(table->old_bits);
+    u32_t mask = __nr_buckets(table->bits) - 1;
+
+    for (int k = 0; k < RHT_MIGRATE_STEP && table->migrated < len; k++) {
+        struct hbucket* bucket = &table->old[table->migrated];
+        struct hlist_node* node;
+
+        while ((node = bucket->head)) {
+            hlist_delete(node);
+            hlist_add(&table->buckets[table->hashof(node) & mask].head, node);
+        }
+
+        table->migrated++;
+    }
+
+    if (table->migrated == len) {
+        vfree(table->old);
+        table->old = NULL;
+    }
+}
+
+static void
+__rht_resize(struct rhtable* table, u32_t bits)
+{
+    struct hbucket* buckets = vzalloc(sizeof(struct hbucket) << bits);
+    if (!buckets) {
+        // 维持原有的大小，仅是链更长了
+        return;
+    }
+
+    table->old = table->buckets;
+    table->old_bits = table->bits;
+    table->migrated = 0;
+
+    table->buckets = buckets;
+    table->bits = bits;
+}
+
+int
+rhtable_init(struct rhtable* table,
+             u32_t min_bits,
+             u32_t (*hashof)(struct hlist_node*))
+{
+    *table = (struct rhtable){ .bits = min_bits,
+                               .min_bits = min_bits,
+                               .hashof = hashof };
+
+    table->buckets = vzalloc(sizeof(struct hbucket) << min_bits);
+    return table->buckets ? 0 : ENOMEM;
+}
+
+static void
+__rht_detach_all(struct hbucket* buckets, u32_t len)
+{
+    for (u32_t i = 0; i < len; i++) {
+        struct hlist_node *node = buckets[i].head, *next;
+        while (node) {
+            next = node->next;
+            node->next = 0;
+            node->pprev = 0;
+            node = next;
+        }
+    }
+}
+
+void
+rhtable_free(struct rhtable* table)
+{
+    if (table->old) {
+        __rht_detach_all(table->old, __nr_buckets(table->old_bits));
+        vfree(table->old);
+    }
+
+    if (table->buckets) {
+        __rht_detach_all(table->buckets, __nr_buckets(table->bits));
+        vfree(table->buckets);
+    }
+
+    table->old = NULL;
+    table->buckets = NULL;
+    table->count = 0;
+}
+
+void
+rhtable_add(struct rhtable* table, struct hlist_node* node)
+{
+    struct hbucket* bucket = rhtable_bucket(table, table->hashof(node));
+    hlist_add(&bucket->head, node);
+    table->count++;
+
+    __rht_migrate(table);
+
+    if (!table->old && table->bits < RHT_MAX_BITS &&
+        table->count > (RHT_LOAD_FACTOR << table->bits)) {
+        __rht_resize(table, table->bits + 1);
+    }
+}
+
+void
+rhtable_del(struct rhtable* table, struct hlist_node* node)
+{
+    if (!node->pprev) {
+        return;
+    }
+
+    hlist_delete(node);
+    table->count--;
+
+    __rht_migrate(table);
+
+    if (!table->old && table->bits > table->min_bits &&
+        table->count < (RHT_LOAD_FACTOR << table->bits) / 8) {
+        __rht_resize(table, table->bits - 1);
+    }
+}
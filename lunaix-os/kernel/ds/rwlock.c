@@ -1,58 +1,129 @@
+#include <hal/cpu.h>
 #include <lunaix/ds/rwlock.h>
 #include <lunaix/spike.h>
 
+/*
+    The slow paths below run with interrupt disabled, so that checking the
+    lock state and queuing onto the wait list is atomic against the release
+    path (which also does its wake up with interrupt disabled).
+*/
+
 void
 rwlock_init(rwlock_t* rwlock)
 {
     waitq_init(&rwlock->waiting_readers);
     waitq_init(&rwlock->waiting_writers);
     atomic_init(&rwlock->readers, 0);
-    atomic_flag_clear(&rwlock->writer);
+    atomic_init(&rwlock->writer, 0);
+    atomic_init(&rwlock->writers_waiting, 0);
+    rwlock->readers_waiting = 0;
+    rwlock->read_batch = 0;
 }
 
-void
-rwlock_begin_read(rwlock_t* rwlock)
+static void
+__rwlock_read_slow(rwlock_t* rwlock)
 {
-    while (atomic_flag_test_and_set(&rwlock->writer)) {
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // undo the optimistic increment. A writer might have seen it and went to
+    //  sleep, wake it if we were the only reason.
+    if (atomic_fetch_sub(&rwlock->readers, 1) == 1 &&
+        !atomic_load(&rwlock->writer)) {
+        pwake_one(&rwlock->waiting_writers);
+    }
+
+    while (atomic_load(&rwlock->writer) ||
+           (atomic_load(&rwlock->writers_waiting) && !rwlock->read_batch)) {
+        rwlock->readers_waiting++;
         pwait(&rwlock->waiting_readers);
+        cpu_disable_interrupt();
+        rwlock->readers_waiting--;
+    }
+
+    if (rwlock->read_batch) {
+        rwlock->read_batch--;
     }
+
     atomic_fetch_add(&rwlock->readers, 1);
-    atomic_flag_clear(&rwlock->writer);
-    pwake_all(&rwlock->waiting_readers);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+void
+rwlock_begin_read(rwlock_t* rwlock)
+{
+    atomic_fetch_add(&rwlock->readers, 1);
+
+    if (!atomic_load(&rwlock->writer) &&
+        !atomic_load(&rwlock->writers_waiting)) {
+        return;
+    }
+
+    __rwlock_read_slow(rwlock);
 }
 
 void
 rwlock_end_read(rwlock_t* rwlock)
 {
     assert(atomic_load(&rwlock->readers) > 0);
-    atomic_fetch_sub(&rwlock->readers, 1);
 
-    if (!atomic_load(&rwlock->readers)) {
-        pwake_one(&rwlock->waiting_writers);
+    if (atomic_fetch_sub(&rwlock->readers, 1) != 1 ||
+        !atomic_load(&rwlock->writers_waiting)) {
+        return;
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    pwake_one(&rwlock->waiting_writers);
+
+    if (intr) {
+        cpu_enable_interrupt();
     }
 }
 
 void
 rwlock_begin_write(rwlock_t* rwlock)
 {
-    // first, acquire writer lock, prevent any incoming readers
-    while (atomic_flag_test_and_set(&rwlock->writer)) {
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // announce ourself first, so no more readers can sneak in.
+    atomic_fetch_add(&rwlock->writers_waiting, 1);
+
+    while (atomic_load(&rwlock->writer) || atomic_load(&rwlock->readers)) {
         pwait(&rwlock->waiting_writers);
+        cpu_disable_interrupt();
     }
 
-    // then, wait for reader finish the read.
-    while (atomic_load(&rwlock->readers)) {
-        pwait(&rwlock->waiting_writers);
+    atomic_fetch_sub(&rwlock->writers_waiting, 1);
+    atomic_store(&rwlock->writer, 1);
+
+    if (intr) {
+        cpu_enable_interrupt();
     }
 }
 
 void
 rwlock_end_write(rwlock_t* rwlock)
 {
-    atomic_flag_clear(&rwlock->writer);
-    if (waitq_empty(&rwlock->waiting_writers)) {
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    atomic_store(&rwlock->writer, 0);
+
+    // readers queued up during our hold go first, as one batch.
+    if (rwlock->readers_waiting) {
+        rwlock->read_batch = rwlock->readers_waiting;
         pwake_all(&rwlock->waiting_readers);
     } else {
         pwake_one(&rwlock->waiting_writers);
     }
-}
\ No newline at end of file
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
@@ -0,0 +1,146 @@
+/**
+ * @file spinlock.c
+ * @brief 带统计与检查的自旋锁实现，仅于定义了 LUNAIX_LOCKSTAT 时使用，
+ *  否则自旋锁全部内联于 lunaix/ds/spinlock.h
+ *
+ */
+#include <hal/smp.h>
+#include <lunaix/ds/spinlock.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/spike.h>
+
+#ifdef LUNAIX_LOCKSTAT
+
+static DEFINE_LLIST(spinlock_classes);
+static atomic_flag classes_lock = ATOMIC_FLAG_INIT;
+
+static void
+__spinlock_register(struct spinlock_class* cls)
+{
+    // 不能用自旋锁保护自旋锁的类别表
+    while (atomic_flag_test_and_set(&classes_lock)) {
+        asm volatile("pause");
+    }
+
+    if (!cls->classes.next) {
+        llist_append(&spinlock_classes, &cls->classes);
+    }
+
+    atomic_flag_clear(&classes_lock);
+}
+
+void
+__spinlock_init(spinlock_t* lock, struct spinlock_class* cls)
+{
+    atomic_init(&lock->next, 0);
+    atomic_init(&lock->serving, 0);
+    lock->cls = cls;
+    lock->owner = -1;
+
+    // 类别为静态变量，首次使用时登记
+    if (!cls->classes.next) {
+        __spinlock_register(cls);
+    }
+}
+
+static inline void
+__spin_acquired(spinlock_t* lock, u64_t start, int contended)
+{
+    struct spinlock_class* cls = lock->cls;
+
+    // 以 DEFINE_SPINLOCK 定义的锁不经过 __spinlock_init
+    if (!cls->classes.next) {
+        __spinlock_register(cls);
+    }
+
+    lock->owner = smp_cpu_id();
+    lock->since = cpu_rdtsc();
+
+    cls->acquired++;
+    if (contended) {
+        cls->contended++;
+        cls->wait += lock->since - start;
+    }
+}
+
+void
+spin_lock(spinlock_t* lock)
+{
+    // 同一处理器重复获取，将永远等待自己释放
+    assert_msg(lock->owner != (int)smp_cpu_id(), "spinlock: recursive lock");
+
+    u64_t start = cpu_rdtsc();
+    unsigned int ticket = atomic_fetch_add(&lock->next, 1);
+    int contended = 0;
+
+    while (atomic_load_explicit(&lock->serving, memory_order_acquire) !=
+           ticket) {
+        contended = 1;
+        asm volatile("pause");
+    }
+
+    __spin_acquired(lock, start, contended);
+}
+
+int
+spin_trylock(spinlock_t* lock)
+{
+    unsigned int ticket = atomic_load(&lock->serving);
+    if (!atomic_compare_exchange_strong(&lock->next, &ticket, ticket + 1)) {
+        return 0;
+    }
+
+    __spin_acquired(lock, 0, 0);
+    return 1;
+}
+
+void
+spin_unlock(spinlock_t* lock)
+{
+    assert_msg(lock->owner == (int)smp_cpu_id(),
+               "spinlock: unlocking a lock not held");
+
+    struct spinlock_class* cls = lock->cls;
+    u32_t held = (u32_t)(cpu_rdtsc() - lock->since);
+
+    cls->hold += held;
+    if (held > cls->max_hold) {
+        cls->max_hold = held;
+    }
+    lock->owner = -1;
+
+    unsigned int ticket =
+      atomic_load_explicit(&lock->serving, memory_order_relaxed);
+    atomic_store_explicit(&lock->serving, ticket + 1, memory_order_release);
+}
+
+static void
+__spinlock_rd_stat(struct twimap* map)
+{
+    struct spinlock_class *pos, *n;
+    llist_for_each(pos, n, &spinlock_classes, classes)
+    {
+        if (!pos->acquired) {
+            continue;
+        }
+
+        u32_t wait = pos->contended ? (u32_t)(pos->wait / pos->contended) : 0;
+        twimap_printf(map,
+                      "%s %u %u %u %u %u\n",
+                      pos->name,
+                      pos->acquired,
+                      pos->contended,
+                      wait,
+                      (u32_t)(pos->hold / pos->acquired),
+                      pos->max_hold);
+    }
+}
+
+void
+spinlock_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "lock_stat");
+    map->read = __spinlock_rd_stat;
+}
+
+#endif
@@ -1,9 +1,120 @@
+#include <lunaix/ds/spinlock.h>
 #include <lunaix/ds/waitq.h>
+#include <lunaix/fs/twifs.h>
 #include <lunaix/process.h>
+#include <lunaix/sched.h>
 #include <lunaix/spike.h>
 
+#ifdef LUNAIX_LOCKSTAT
+
+static DEFINE_LLIST(waitq_classes);
+static DEFINE_SPINLOCK(classes_lock);
+
+void
+__waitq_init(waitq_t* waitq, struct waitq_class* cls)
+{
+    llist_init_head(&waitq->waiters);
+    waitq->flags = 0;
+    waitq->key = 0;
+    waitq->cls = cls;
+    waitq->since = 0;
+
+    // 类别为静态变量，首次使用时登记
+    if (cls->classes.next) {
+        return;
+    }
+
+    spin_lock(&classes_lock);
+    if (!cls->classes.next) {
+        llist_append(&waitq_classes, &cls->classes);
+    }
+    spin_unlock(&classes_lock);
+}
+
+static inline void
+__waitq_stat_sleep(waitq_t* queue, waitq_t* wq)
+{
+    struct waitq_class* cls = queue->cls;
+    if (!cls) {
+        return;
+    }
+
+    wq->since = cpu_rdtsc();
+
+    cls->sleeps++;
+    if (++cls->sleepers > cls->max_sleepers) {
+        cls->max_sleepers = cls->sleepers;
+    }
+}
+
+static inline void
+__waitq_stat_wake(waitq_t* queue, waitq_t* wq)
+{
+    struct waitq_class* cls = queue->cls;
+    if (!cls || !wq->since) {
+        return;
+    }
+
+    u32_t blocked = (u32_t)(cpu_rdtsc() - wq->since);
+
+    wq->since = 0;
+    cls->sleepers--;
+    cls->blocked += blocked;
+    if (blocked > cls->max_blocked) {
+        cls->max_blocked = blocked;
+    }
+}
+
+static void
+__waitq_rd_stat(struct twimap* map)
+{
+    struct waitq_class *pos, *n;
+    llist_for_each(pos, n, &waitq_classes, classes)
+    {
+        if (!pos->sleeps) {
+            continue;
+        }
+
+        twimap_printf(map,
+                      "%s %u %u %u %u %u\n",
+                      pos->name,
+                      pos->sleeps,
+                      pos->sleepers,
+                      pos->max_sleepers,
+                      (u32_t)(pos->blocked / pos->sleeps),
+                      pos->max_blocked);
+    }
+}
+
+void
+waitq_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "waitq_stat");
+    map->read = __waitq_rd_stat;
+}
+
+#else
+
+static inline void
+__waitq_stat_sleep(waitq_t* queue, waitq_t* wq)
+{
+}
+
+static inline void
+__waitq_stat_wake(waitq_t* queue, waitq_t* wq)
+{
+}
+
+#endif
+
 void
 pwait(waitq_t* queue)
+{
+    pwait_ex(queue, 0, 0);
+}
+
+int
+pwait_ex(waitq_t* queue, u32_t flags, uintptr_t key)
 {
     // prevent race condition.
     cpu_disable_interrupt();
@@ -11,44 +122,118 @@ pwait(waitq_t* queue)
     waitq_t* current_wq = &__current->waitqueue;
     assert(llist_empty(&current_wq->waiters));
 
+    current_wq->flags = flags & WQ_EXCLUSIVE;
+    current_wq->key = key;
     llist_append(&queue->waiters, &current_wq->waiters);
+    __waitq_stat_sleep(queue, current_wq);
 
     block_current();
     sched_yieldk();
 
+    int handoff = !!(current_wq->flags & WQ_HANDOFF);
+    current_wq->flags = 0;
+    current_wq->key = 0;
+
     cpu_enable_interrupt();
+
+    return handoff;
 }
 
-void
-pwake_one(waitq_t* queue)
+/**
+ * @brief 若为挂钩则调用之
+ *
+ * @return int 是否为挂钩
+ */
+static inline int
+__pwake_hook(waitq_t* wq)
 {
-    if (llist_empty(&queue->waiters)) {
-        return;
+    if (!(wq->flags & WQ_HOOK)) {
+        return 0;
     }
 
-    waitq_t* wq = list_entry(queue->waiters.next, waitq_t, waiters);
+    struct waitq_hook* hook = container_of(wq, struct waitq_hook, link);
+    hook->func(hook);
+    return 1;
+}
+
+static struct proc_info*
+__pwake_entry(waitq_t* queue, waitq_t* wq)
+{
     struct proc_info* proc = container_of(wq, struct proc_info, waitqueue);
 
     assert(proc->state == PS_BLOCKED);
-    proc->state = PS_READY;
+    sched_enqueue(proc);
     llist_delete(&wq->waiters);
+    __waitq_stat_wake(queue, wq);
+
+    return proc;
+}
+
+void
+pwake_one(waitq_t* queue)
+{
+    waitq_t *pos, *n;
+    llist_for_each(pos, n, &queue->waiters, waiters)
+    {
+        if (!__pwake_hook(pos)) {
+            __pwake_entry(queue, pos);
+            return;
+        }
+    }
 }
 
 void
 pwake_all(waitq_t* queue)
 {
-    if (llist_empty(&queue->waiters)) {
-        return;
+    waitq_t *pos, *n;
+    llist_for_each(pos, n, &queue->waiters, waiters)
+    {
+        if (!__pwake_hook(pos)) {
+            __pwake_entry(queue, pos);
+        }
+    }
+}
+
+int
+pwake_nr(waitq_t* queue, int nr_exclusive, uintptr_t key)
+{
+    int woken = 0;
+    waitq_t *pos, *n;
+    llist_for_each(pos, n, &queue->waiters, waiters)
+    {
+        if (__pwake_hook(pos) || (key && pos->key != key)) {
+            continue;
+        }
+
+        if ((pos->flags & WQ_EXCLUSIVE)) {
+            if (!nr_exclusive) {
+                continue;
+            }
+            nr_exclusive--;
+        }
+
+        __pwake_entry(queue, pos);
+        woken++;
     }
 
-    struct proc_info* proc;
+    return woken;
+}
+
+struct proc_info*
+pwake_handoff(waitq_t* queue, uintptr_t key)
+{
     waitq_t *pos, *n;
     llist_for_each(pos, n, &queue->waiters, waiters)
     {
-        proc = container_of(pos, struct proc_info, waitqueue);
+        if ((pos->flags & WQ_HOOK)) {
+            continue;
+        }
 
-        assert(proc->state == PS_BLOCKED);
-        proc->state = PS_READY;
-        llist_delete(&pos->waiters);
+        if (!key || pos->key == key) {
+            pos->flags |= WQ_HANDOFF;
+            return __pwake_entry(queue, pos);
+        }
     }
+
+    return NULL;
 }
\ No newline at end of file
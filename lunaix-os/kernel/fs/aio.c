@@ -0,0 +1,259 @@
+/**
+ * @file aio.c
+ * @brief 面向用户空间的异步I/O，构建于设备层的 device::submit 之上
+ *
+ * 每个请求使用一块内核DMA缓冲区：写请求在提交时复制用户数据，读请求则在
+ * aio_return 时（即处于发起进程的上下文中）将数据复制回用户空间。
+ * 如此，完成回调无需访问用户空间，可在中断或工作队列的上下文中安全执行。
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/aio.h>
+#include <lunaix/device.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/fs.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+// 单个请求的最大长度
+#define AIO_MAX_LEN 0x10000
+
+struct aio_ctl
+{
+    struct dev_iocb iocb;
+    struct proc_info* owner; // 所属进程退出后为NULL，由完成回调释放
+    void* ubuf;
+    int done;
+    waitq_t wait;
+};
+
+static void
+__aio_free(struct aio_ctl* ctl)
+{
+    vfree_dma(ctl->iocb.buf);
+    vfree(ctl);
+}
+
+static void
+__aio_completed(struct dev_iocb* iocb)
+{
+    struct aio_ctl* ctl = (struct aio_ctl*)iocb->data;
+
+    ctl->done = 1;
+
+    if (!ctl->owner) {
+        __aio_free(ctl);
+        return;
+    }
+
+    pwake_all(&ctl->wait);
+}
+
+static int
+__aio_submit(struct aiocb* aiocbp, int write)
+{
+    struct aiocb cb;
+    struct v_fd* fd_s;
+    int errno, id;
+
+    if (copy_from_user(&cb, aiocbp, sizeof(cb))) {
+        return EFAULT;
+    }
+
+    if ((errno = vfs_getfd(cb.aio_fildes, &fd_s))) {
+        return errno;
+    }
+
+    struct v_inode* inode = fd_s->file->inode;
+    if (!(inode->itype & VFS_IFVOLDEV)) {
+        return ENOTBLK;
+    }
+
+    struct device* dev = (struct device*)inode->data;
+    if (!dev->submit) {
+        return ENOTSUP;
+    }
+
+    if (!cb.aio_nbytes || cb.aio_nbytes > AIO_MAX_LEN) {
+        return EINVAL;
+    }
+
+    for (id = 0; id < PROC_AIO_MAX && __current->aio[id]; id++)
+        ;
+
+    if (id == PROC_AIO_MAX) {
+        return EAGAIN;
+    }
+
+    if (copy_to_user(&aiocbp->__aio_id, &id, sizeof(int))) {
+        return EFAULT;
+    }
+
+    struct aio_ctl* ctl = valloc(sizeof(struct aio_ctl));
+    void* kbuf = valloc_dma(cb.aio_nbytes);
+
+    if (!ctl || !kbuf) {
+        if (ctl) {
+            vfree(ctl);
+        }
+        if (kbuf) {
+            vfree_dma(kbuf);
+        }
+        return ENOMEM;
+    }
+
+    *ctl = (struct aio_ctl){ .iocb = { .buf = kbuf,
+                                       .offset = cb.aio_offset,
+                                       .len = cb.aio_nbytes,
+                                       .write = write,
+                                       .done = __aio_completed,
+                                       .data = ctl },
+                             .owner = (struct proc_info*)__current,
+                             .ubuf = cb.aio_buf };
+    waitq_init(&ctl->wait);
+
+    if (write && copy_from_user(kbuf, cb.aio_buf, cb.aio_nbytes)) {
+        errno = EFAULT;
+        goto fail;
+    }
+
+    if ((errno = dev->submit(dev, &ctl->iocb))) {
+        goto fail;
+    }
+
+    __current->aio[id] = ctl;
+    return 0;
+
+fail:
+    __aio_free(ctl);
+    return errno;
+}
+
+static struct aio_ctl*
+__aio_get(const struct aiocb* aiocbp, int* id)
+{
+    if (copy_from_user(id, &aiocbp->__aio_id, sizeof(int))) {
+        return NULL;
+    }
+
+    if (*id < 0 || *id >= PROC_AIO_MAX) {
+        return NULL;
+    }
+
+    return __current->aio[*id];
+}
+
+void
+proc_release_aio(struct proc_info* proc)
+{
+    // 与完成回调互斥
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    for (int i = 0; i < PROC_AIO_MAX; i++) {
+        struct aio_ctl* ctl = proc->aio[i];
+        if (!ctl) {
+            continue;
+        }
+
+        if (ctl->done) {
+            __aio_free(ctl);
+        } else {
+            ctl->owner = NULL;
+        }
+        proc->aio[i] = NULL;
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+__DEFINE_LXSYSCALL1(int, aio_read, struct aiocb*, aiocbp)
+{
+    int errno = __aio_submit(aiocbp, 0);
+    if (errno) {
+        __current->k_status = errno;
+        return -1;
+    }
+    return 0;
+}
+
+__DEFINE_LXSYSCALL1(int, aio_write, struct aiocb*, aiocbp)
+{
+    int errno = __aio_submit(aiocbp, 1);
+    if (errno) {
+        __current->k_status = errno;
+        return -1;
+    }
+    return 0;
+}
+
+__DEFINE_LXSYSCALL1(int, aio_error, const struct aiocb*, aiocbp)
+{
+    int id;
+    struct aio_ctl* ctl = __aio_get(aiocbp, &id);
+    if (!ctl) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    if (!ctl->done) {
+        return EINPROGRESS;
+    }
+
+    return ctl->iocb.result < 0 ? ctl->iocb.result : 0;
+}
+
+__DEFINE_LXSYSCALL1(int, aio_return, struct aiocb*, aiocbp)
+{
+    int id;
+    struct aio_ctl* ctl = __aio_get(aiocbp, &id);
+    if (!ctl) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    if (!ctl->done) {
+        __current->k_status = EINPROGRESS;
+        return -1;
+    }
+
+    int result = ctl->iocb.result;
+    if (result >= 0 && !ctl->iocb.write &&
+        copy_to_user(ctl->ubuf, ctl->iocb.buf, result)) {
+        result = EFAULT;
+    }
+
+    __current->aio[id] = NULL;
+    __aio_free(ctl);
+
+    if (result < 0) {
+        __current->k_status = result;
+        return -1;
+    }
+
+    return result;
+}
+
+__DEFINE_LXSYSCALL1(int, aio_suspend, const struct aiocb*, aiocbp)
+{
+    int id;
+    struct aio_ctl* ctl = __aio_get(aiocbp, &id);
+    if (!ctl) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    while (!ctl->done) {
+        pwait(&ctl->wait);
+        // pwait 返回时已开启中断，系统调用的剩余部分仍需在关中断下进行
+        cpu_disable_interrupt();
+    }
+
+    return 0;
+}
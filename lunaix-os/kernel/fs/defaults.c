@@ -7,7 +7,7 @@ default_file_close(struct v_file* file)
 }
 
 int
-default_file_seek(struct v_inode* inode, size_t offset)
+default_file_seek(struct v_inode* inode, foff_t offset)
 {
     return 0;
 }
@@ -19,13 +19,13 @@ default_inode_open(struct v_inode* this, struct v_file* file)
 }
 
 int
-default_file_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+default_file_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     return ENOTSUP;
 }
 
 int
-default_file_write(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+default_file_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     return ENOTSUP;
 }
@@ -33,17 +33,13 @@ default_file_write(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
 int
 default_file_readdir(struct v_file* file, struct dir_context* dctx)
 {
-    int i = 0;
-    struct v_dnode *pos, *n;
-    llist_for_each(pos, n, &file->dnode->children, siblings)
-    {
-        if (i < dctx->index) {
-            i++;
-            continue;
-        }
-        dctx->read_complete_callback(dctx, pos->name.value, pos->name.len, 0);
-        break;
+    struct v_dnode* pos = vfs_dir_child(file, dctx->index);
+    if (!pos) {
+        return 0;
     }
+
+    dctx->read_complete_callback(dctx, pos->name.value, pos->name.len, 0);
+    return 1;
 }
 
 int
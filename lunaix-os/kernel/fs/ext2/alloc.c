@@ -0,0 +1,282 @@
+/**
+ * @file alloc.c
+ * @brief ext2 block and inode allocation
+ *
+ * Allocation is block group aware. A file's data blocks are taken right after
+ * the previous block handed to it, or from the start of its inode's group, so
+ * that a file (and the files next to it in a directory) stay close together
+ * on disk. New regular files are placed in their parent directory's group,
+ * while new directories are spread out to leave room for their contents.
+ *
+ * Bitmaps, group descriptors and the superblock counters are written back as
+ * soon as they change.
+ *
+ */
+#include <lunaix/fs/ext2.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+static int
+__ext2_find_zero(u8_t* bitmap, u32_t start, u32_t end)
+{
+    u32_t i = start;
+
+    while (i < end) {
+        // skip over fully used bytes
+        if (!(i % 8) && bitmap[i / 8] == 0xff) {
+            i += 8;
+            continue;
+        }
+
+        if (!(bitmap[i / 8] & (1 << (i % 8)))) {
+            return i;
+        }
+        i++;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Take the first free bit at or after start, optionally wrapping
+ * around to the beginning of the bitmap
+ *
+ * @return int the bit taken, or -1 if there is none
+ */
+static int
+__ext2_bitmap_take(struct v_superblock* vsb,
+                   u32_t bitmap,
+                   u32_t start,
+                   u32_t nbits,
+                   int wrap,
+                   u8_t* buf)
+{
+    if (ext2_read_block(vsb, bitmap, buf)) {
+        return -1;
+    }
+
+    int bit = __ext2_find_zero(buf, start, nbits);
+    if (bit < 0 && start && wrap) {
+        bit = __ext2_find_zero(buf, 0, start);
+    }
+
+    if (bit < 0) {
+        return -1;
+    }
+
+    buf[bit / 8] |= 1 << (bit % 8);
+    return ext2_write_block(vsb, bitmap, buf) ? -1 : bit;
+}
+
+static void
+__ext2_bitmap_put(struct v_superblock* vsb, u32_t bitmap, u32_t bit, u8_t* buf)
+{
+    if (!ext2_read_block(vsb, bitmap, buf)) {
+        buf[bit / 8] &= ~(1 << (bit % 8));
+        ext2_write_block(vsb, bitmap, buf);
+    }
+}
+
+static void
+__ext2_account(struct v_superblock* vsb,
+               u32_t group,
+               int blocks,
+               int inodes,
+               int dirs)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    struct ext2_gdesc* gd = &sbi->gdt[group];
+
+    gd->bg_free_blocks_count += blocks;
+    gd->bg_free_inodes_count += inodes;
+    gd->bg_used_dirs_count += dirs;
+    sbi->sb.s_free_blocks_count += blocks;
+    sbi->sb.s_free_inodes_count += inodes;
+
+    ext2_write_gdesc(vsb, group);
+    ext2_write_sb(vsb);
+}
+
+static inline u32_t
+__ext2_group_blocks(struct ext2_sb_info* sbi, u32_t group)
+{
+    u32_t first = sbi->sb.s_first_data_block + group * sbi->sb.s_blocks_per_group;
+    return MIN(sbi->sb.s_blocks_per_group, sbi->sb.s_blocks_count - first);
+}
+
+u32_t
+ext2_alloc_block(struct v_superblock* vsb, u32_t goal)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    u32_t bpg = sbi->sb.s_blocks_per_group, block = 0;
+
+    if (goal < sbi->sb.s_first_data_block || goal >= sbi->sb.s_blocks_count) {
+        goal = sbi->sb.s_first_data_block;
+    }
+
+    u8_t* buf = valloc(sbi->block_size);
+    if (!buf) {
+        return 0;
+    }
+
+    mutex_lock(&sbi->alloc_lock);
+
+    u32_t g0 = (goal - sbi->sb.s_first_data_block) / bpg;
+    u32_t start = (goal - sbi->sb.s_first_data_block) % bpg;
+
+    for (u32_t i = 0; i < sbi->nr_groups; i++, start = 0) {
+        u32_t g = (g0 + i) % sbi->nr_groups;
+        if (!sbi->gdt[g].bg_free_blocks_count) {
+            continue;
+        }
+
+        int bit = __ext2_bitmap_take(vsb,
+                                     sbi->gdt[g].bg_block_bitmap,
+                                     start,
+                                     __ext2_group_blocks(sbi, g),
+                                     1,
+                                     buf);
+        if (bit < 0) {
+            continue;
+        }
+
+        __ext2_account(vsb, g, -1, 0, 0);
+        block = sbi->sb.s_first_data_block + g * bpg + bit;
+        break;
+    }
+
+    mutex_unlock(&sbi->alloc_lock);
+
+    vfree(buf);
+    return block;
+}
+
+void
+ext2_free_block(struct v_superblock* vsb, u32_t block)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    u32_t bpg = sbi->sb.s_blocks_per_group;
+
+    if (block < sbi->sb.s_first_data_block || block >= sbi->sb.s_blocks_count) {
+        return;
+    }
+
+    u8_t* buf = valloc(sbi->block_size);
+    if (!buf) {
+        return;
+    }
+
+    u32_t g = (block - sbi->sb.s_first_data_block) / bpg;
+
+    mutex_lock(&sbi->alloc_lock);
+
+    __ext2_bitmap_put(vsb,
+                      sbi->gdt[g].bg_block_bitmap,
+                      (block - sbi->sb.s_first_data_block) % bpg,
+                      buf);
+    __ext2_account(vsb, g, 1, 0, 0);
+
+    mutex_unlock(&sbi->alloc_lock);
+
+    vfree(buf);
+}
+
+static int
+__ext2_dir_group(struct ext2_sb_info* sbi, u32_t parent_group)
+{
+    u32_t avg = sbi->sb.s_free_inodes_count / sbi->nr_groups;
+    int best = -1;
+
+    for (u32_t i = 0; i < sbi->nr_groups; i++) {
+        u32_t g = (parent_group + i) % sbi->nr_groups;
+        struct ext2_gdesc* gd = &sbi->gdt[g];
+
+        if (!gd->bg_free_inodes_count || gd->bg_free_inodes_count < avg ||
+            !gd->bg_free_blocks_count) {
+            continue;
+        }
+
+        if (best < 0 || gd->bg_used_dirs_count < sbi->gdt[best].bg_used_dirs_count) {
+            best = g;
+        }
+    }
+
+    return best;
+}
+
+u32_t
+ext2_alloc_inode(struct v_superblock* vsb, u32_t parent, int is_dir)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    u32_t ipg = sbi->sb.s_inodes_per_group, ino = 0;
+    u32_t pg = (parent - 1) / ipg;
+
+    u8_t* buf = valloc(sbi->block_size);
+    if (!buf) {
+        return 0;
+    }
+
+    mutex_lock(&sbi->alloc_lock);
+
+    int g0 = is_dir ? __ext2_dir_group(sbi, pg) : -1;
+    if (g0 < 0) {
+        g0 = pg;
+    }
+
+    // prefer groups that still have room for the data as well
+    for (int pass = 0; pass < 2 && !ino; pass++) {
+        for (u32_t i = 0; i < sbi->nr_groups; i++) {
+            u32_t g = (g0 + i) % sbi->nr_groups;
+            struct ext2_gdesc* gd = &sbi->gdt[g];
+
+            if (!gd->bg_free_inodes_count ||
+                (!pass && !gd->bg_free_blocks_count)) {
+                continue;
+            }
+
+            // the reserved inodes all live in the first group
+            u32_t start = g ? 0 : sbi->first_ino - 1;
+            int bit =
+              __ext2_bitmap_take(vsb, gd->bg_inode_bitmap, start, ipg, 0, buf);
+            if (bit < 0) {
+                continue;
+            }
+
+            __ext2_account(vsb, g, 0, -1, !!is_dir);
+            ino = g * ipg + bit + 1;
+            break;
+        }
+    }
+
+    mutex_unlock(&sbi->alloc_lock);
+
+    vfree(buf);
+    return ino;
+}
+
+void
+ext2_free_inode(struct v_superblock* vsb, u32_t ino, int is_dir)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    u32_t ipg = sbi->sb.s_inodes_per_group;
+    u32_t g = (ino - 1) / ipg;
+
+    if (!ino || g >= sbi->nr_groups) {
+        return;
+    }
+
+    u8_t* buf = valloc(sbi->block_size);
+    if (!buf) {
+        return;
+    }
+
+    mutex_lock(&sbi->alloc_lock);
+
+    __ext2_bitmap_put(vsb, sbi->gdt[g].bg_inode_bitmap, (ino - 1) % ipg, buf);
+    __ext2_account(vsb, g, 0, 1, -!!is_dir);
+
+    mutex_unlock(&sbi->alloc_lock);
+
+    vfree(buf);
+}
@@ -0,0 +1,757 @@
+/**
+ * @file directory.c
+ * @brief ext2 directories and namespace operations
+ *
+ * Directories are plain lists of variable length records, each no larger
+ * than a block. New entries go into the first record with enough slack (an
+ * unused record, or the unused tail of a live one), and a removed entry is
+ * merged into the record before it.
+ *
+ * All changes to the namespace of a volume are serialized by ns_lock.
+ *
+ */
+#include <klibc/string.h>
+#include <lunaix/clock.h>
+#include <lunaix/dirent.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/ext2.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+#define EXT2_DIR_MODE (EXT2_S_IFDIR | 0755)
+#define EXT2_FILE_MODE (EXT2_S_IFREG | 0644)
+
+// a located entry: the block holding it (kept in buf) and where it sits
+struct ext2_slot
+{
+    void* buf;
+    u32_t pblk;
+    u32_t offset;
+    u32_t prev; // offset of the record before it, or -1 if it comes first
+};
+
+static inline struct ext2_dirent*
+__ext2_slot_entry(struct ext2_slot* slot)
+{
+    return (struct ext2_dirent*)(slot->buf + slot->offset);
+}
+
+static inline int
+__ext2_dirent_ok(struct ext2_dirent* de, u32_t offset, u32_t bsize)
+{
+    return de->rec_len >= EXT2_DIRENT_HDR && !(de->rec_len % 4) &&
+           offset + de->rec_len <= bsize &&
+           EXT2_DIRENT_HDR + de->name_len <= de->rec_len;
+}
+
+static inline int
+__ext2_is_dots(struct ext2_dirent* de)
+{
+    return (de->name_len == 1 && de->name[0] == '.') ||
+           (de->name_len == 2 && de->name[0] == '.' && de->name[1] == '.');
+}
+
+static u8_t
+__ext2_ftype(struct v_inode* inode)
+{
+    if (!EXT2_SB(inode->sb)->filetype) {
+        return EXT2_FT_UNKNOWN;
+    }
+
+    if (inode->itype == VFS_IFSYMLINK) {
+        return EXT2_FT_SYMLINK;
+    }
+    return (inode->itype & VFS_IFDIR) ? EXT2_FT_DIR : EXT2_FT_REG_FILE;
+}
+
+/**
+ * @brief Find the entry named name in directory dir. slot->buf must hold a
+ * block worth of space, and is left with the block of the entry.
+ *
+ */
+static int
+__ext2_find_entry(struct v_inode* dir,
+                  const char* name,
+                  u32_t len,
+                  struct ext2_slot* slot)
+{
+    u32_t bsize = EXT2_SB(dir->sb)->block_size;
+    u32_t nblocks = ICEIL(dir->fsize, bsize);
+    int errno;
+
+    for (u32_t lblk = 0; lblk < nblocks; lblk++) {
+        if ((errno = ext2_bmap(dir, lblk, 0, &slot->pblk))) {
+            return errno;
+        }
+
+        if (!slot->pblk) {
+            continue;
+        }
+
+        if ((errno = ext2_read_block(dir->sb, slot->pblk, slot->buf))) {
+            return errno;
+        }
+
+        u32_t off = 0, prev = -1;
+        while (off < bsize) {
+            struct ext2_dirent* de = (struct ext2_dirent*)(slot->buf + off);
+            if (!__ext2_dirent_ok(de, off, bsize)) {
+                return EIO;
+            }
+
+            if (de->inode && de->name_len == len &&
+                !memcmp(de->name, name, len)) {
+                slot->offset = off;
+                slot->prev = prev;
+                return 0;
+            }
+
+            prev = off;
+            off += de->rec_len;
+        }
+    }
+
+    return ENOENT;
+}
+
+static void
+__ext2_fill_entry(struct ext2_dirent* de,
+                  const char* name,
+                  u32_t len,
+                  u32_t ino,
+                  u8_t ftype)
+{
+    de->inode = ino;
+    de->name_len = len;
+    de->file_type = ftype;
+    memcpy(de->name, name, len);
+}
+
+static int
+__ext2_add_entry(struct v_inode* dir,
+                 const char* name,
+                 u32_t len,
+                 u32_t ino,
+                 u8_t ftype)
+{
+    u32_t bsize = EXT2_SB(dir->sb)->block_size;
+    u32_t nblocks = ICEIL(dir->fsize, bsize), need = EXT2_DIRENT_LEN(len);
+    u32_t pblk;
+    int errno = 0;
+
+    void* buf = valloc(bsize);
+    if (!buf) {
+        return ENOMEM;
+    }
+
+    for (u32_t lblk = 0; lblk < nblocks; lblk++) {
+        if ((errno = ext2_bmap(dir, lblk, 0, &pblk))) {
+            goto done;
+        }
+
+        if (!pblk) {
+            continue;
+        }
+
+        if ((errno = ext2_read_block(dir->sb, pblk, buf))) {
+            goto done;
+        }
+
+        for (u32_t off = 0; off < bsize;) {
+            struct ext2_dirent* de = (struct ext2_dirent*)(buf + off);
+            if (!__ext2_dirent_ok(de, off, bsize)) {
+                errno = EIO;
+                goto done;
+            }
+
+            u32_t used = de->inode ? EXT2_DIRENT_LEN(de->name_len) : 0;
+            if (de->rec_len - used >= need) {
+                if (used) {
+                    struct ext2_dirent* tail = (void*)de + used;
+                    tail->rec_len = de->rec_len - used;
+                    de->rec_len = used;
+                    de = tail;
+                }
+
+                __ext2_fill_entry(de, name, len, ino, ftype);
+                errno = ext2_write_block(dir->sb, pblk, buf);
+                goto done;
+            }
+
+            off += de->rec_len;
+        }
+    }
+
+    // no room left, append a block holding just this entry
+    if ((errno = ext2_bmap(dir, nblocks, 1, &pblk))) {
+        goto done;
+    }
+
+    memset(buf, 0, bsize);
+    struct ext2_dirent* de = (struct ext2_dirent*)buf;
+    de->rec_len = bsize;
+    __ext2_fill_entry(de, name, len, ino, ftype);
+
+    if (!(errno = ext2_write_block(dir->sb, pblk, buf))) {
+        dir->fsize = (nblocks + 1) * bsize;
+        errno = ext2_write_inode(dir);
+    }
+
+done:
+    vfree(buf);
+    return errno;
+}
+
+static int
+__ext2_del_entry(struct v_inode* dir, const char* name, u32_t len)
+{
+    struct ext2_slot slot;
+    int errno;
+
+    if (!(slot.buf = valloc(EXT2_SB(dir->sb)->block_size))) {
+        return ENOMEM;
+    }
+
+    if (!(errno = __ext2_find_entry(dir, name, len, &slot))) {
+        struct ext2_dirent* de = __ext2_slot_entry(&slot);
+        if (slot.prev != (u32_t)-1) {
+            struct ext2_dirent* prev = slot.buf + slot.prev;
+            prev->rec_len += de->rec_len;
+        }
+
+        // also cleared when merged, for readers resuming at this offset
+        de->inode = 0;
+        errno = ext2_write_block(dir->sb, slot.pblk, slot.buf);
+    }
+
+    vfree(slot.buf);
+    return errno;
+}
+
+/**
+ * @brief Point the existing entry name of dir at another inode
+ *
+ */
+static int
+__ext2_set_entry(struct v_inode* dir,
+                 const char* name,
+                 u32_t len,
+                 u32_t ino,
+                 u8_t ftype)
+{
+    struct ext2_slot slot;
+    int errno;
+
+    if (!(slot.buf = valloc(EXT2_SB(dir->sb)->block_size))) {
+        return ENOMEM;
+    }
+
+    if (!(errno = __ext2_find_entry(dir, name, len, &slot))) {
+        struct ext2_dirent* de = __ext2_slot_entry(&slot);
+        de->inode = ino;
+        de->file_type = ftype;
+        errno = ext2_write_block(dir->sb, slot.pblk, slot.buf);
+    }
+
+    vfree(slot.buf);
+    return errno;
+}
+
+static int
+__ext2_dir_empty(struct v_inode* dir)
+{
+    u32_t bsize = EXT2_SB(dir->sb)->block_size;
+    u32_t nblocks = ICEIL(dir->fsize, bsize), pblk;
+    int empty = 1;
+
+    void* buf = valloc(bsize);
+    if (!buf) {
+        return 0;
+    }
+
+    for (u32_t lblk = 0; lblk < nblocks && empty; lblk++) {
+        if (ext2_bmap(dir, lblk, 0, &pblk) ||
+            (pblk && ext2_read_block(dir->sb, pblk, buf))) {
+            empty = 0;
+            break;
+        }
+
+        for (u32_t off = 0; pblk && off < bsize;) {
+            struct ext2_dirent* de = (struct ext2_dirent*)(buf + off);
+            if (!__ext2_dirent_ok(de, off, bsize) ||
+                (de->inode && !__ext2_is_dots(de))) {
+                empty = 0;
+                break;
+            }
+            off += de->rec_len;
+        }
+    }
+
+    vfree(buf);
+    return empty;
+}
+
+int
+ext2_dir_lookup(struct v_inode* this, struct v_dnode* dnode)
+{
+    struct ext2_slot slot;
+    int errno;
+
+    if (!(slot.buf = valloc(EXT2_SB(this->sb)->block_size))) {
+        return ENOMEM;
+    }
+
+    errno =
+      __ext2_find_entry(this, dnode->name.value, dnode->name.len, &slot);
+    if (!errno) {
+        struct v_inode* inode =
+          ext2_iget(this->sb, __ext2_slot_entry(&slot)->inode);
+        if (inode) {
+            vfs_assign_inode(dnode, inode);
+        } else {
+            errno = EIO;
+        }
+    }
+
+    vfree(slot.buf);
+    return errno;
+}
+
+static int
+__ext2_dtype(struct v_superblock* vsb, struct ext2_dirent* de)
+{
+    if (!EXT2_SB(vsb)->filetype) {
+        struct v_inode* inode = ext2_iget(vsb, de->inode);
+        return inode ? vfs_get_dtype(inode->itype) : DT_FILE;
+    }
+
+    switch (de->file_type) {
+        case EXT2_FT_DIR:
+            return DT_DIR;
+        case EXT2_FT_SYMLINK:
+            return DT_SYMLINK;
+        default:
+            return DT_FILE;
+    }
+}
+
+/**
+ * @brief Check that a record starts right at off, as the directory may have
+ * changed since a reader stopped there
+ *
+ */
+static int
+__ext2_dirent_at(void* buf, u32_t off, u32_t bsize)
+{
+    u32_t pos = 0;
+    while (pos < off) {
+        struct ext2_dirent* de = (struct ext2_dirent*)(buf + pos);
+        if (!__ext2_dirent_ok(de, pos, bsize)) {
+            return 0;
+        }
+        pos += de->rec_len;
+    }
+    return pos == off;
+}
+
+int
+ext2_readdir(struct v_file* file, struct dir_context* dctx)
+{
+    struct v_inode* dir = file->inode;
+    struct dir_cursor* cur = &file->dcur;
+    u32_t bsize = EXT2_SB(dir->sb)->block_size;
+    u32_t pos = 0, loaded = -1, pblk = 0;
+    int i = 0, found = 0;
+
+    // the cursor keeps the byte offset of the next record in seq
+    if (cur->index && cur->index <= dctx->index) {
+        pos = cur->seq;
+        i = cur->index;
+    }
+
+    void* buf = valloc(bsize);
+    if (!buf) {
+        return ENOMEM;
+    }
+
+    while (pos < dir->fsize) {
+        u32_t lblk = pos / bsize, off = pos % bsize;
+
+        if (lblk != loaded) {
+            if (ext2_bmap(dir, lblk, 0, &pblk) ||
+                (pblk && ext2_read_block(dir->sb, pblk, buf))) {
+                break;
+            }
+            loaded = lblk;
+
+            if (pblk && off && !__ext2_dirent_at(buf, off, bsize)) {
+                // lost our place, count again from the start
+                pos = i = 0;
+                loaded = -1;
+                continue;
+            }
+        }
+
+        if (!pblk) {
+            pos = (lblk + 1) * bsize;
+            continue;
+        }
+
+        struct ext2_dirent* de = (struct ext2_dirent*)(buf + off);
+        if (!__ext2_dirent_ok(de, off, bsize)) {
+            break;
+        }
+
+        pos += de->rec_len;
+
+        if (!de->inode || __ext2_is_dots(de) || i++ < dctx->index) {
+            continue;
+        }
+
+        cur->seq = pos;
+        cur->index = i;
+
+        char name[256];
+        memcpy(name, de->name, de->name_len);
+        name[de->name_len] = '\0';
+
+        dctx->read_complete_callback(
+          dctx, name, de->name_len, __ext2_dtype(dir->sb, de));
+        found = 1;
+        break;
+    }
+
+    vfree(buf);
+    return found;
+}
+
+/**
+ * @brief Bring to life a new inode of the given mode, named dnode within dir
+ *
+ */
+static int
+__ext2_new_inode(struct v_inode* dir,
+                 struct v_dnode* dnode,
+                 u32_t mode,
+                 struct v_inode** out)
+{
+    struct v_superblock* vsb = dir->sb;
+    int is_dir = (mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+
+    u32_t ino = ext2_alloc_inode(vsb, dir->id, is_dir);
+    if (!ino) {
+        return ENOSPC;
+    }
+
+    struct v_inode* inode = vfs_i_alloc(vsb);
+    if (!inode || !inode->data) {
+        if (inode) {
+            vfs_i_free(inode);
+        }
+        ext2_free_inode(vsb, ino, is_dir);
+        return ENOMEM;
+    }
+
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    ei->raw = (struct ext2_inode){ .i_mode = mode,
+                                   .i_links_count = is_dir ? 2 : 1 };
+    ei->group = (ino - 1) / EXT2_SB(vsb)->sb.s_inodes_per_group;
+
+    inode->id = ino;
+    inode->itype = is_dir ? VFS_IFDIR : VFS_IFFILE;
+
+    *out = inode;
+    return 0;
+}
+
+static void
+__ext2_drop_inode(struct v_inode* inode)
+{
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    int is_dir = !!(inode->itype & VFS_IFDIR);
+
+    // nothing can reach the data any more, dirty pages included
+    if (inode->pg_cache) {
+        pcache_release(inode->pg_cache);
+        vfree(inode->pg_cache);
+        inode->pg_cache = NULL;
+    }
+
+    ext2_truncate(inode);
+    ei->raw.i_links_count = 0;
+    ei->raw.i_dtime = clock_unixtime();
+    ext2_write_inode(inode);
+
+    ext2_free_inode(inode->sb, inode->id, is_dir);
+}
+
+/**
+ * @brief Take a link away from the inode, releasing it with the last one
+ *
+ */
+static void
+__ext2_unlink_inode(struct v_inode* inode)
+{
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    int is_dir = !!(inode->itype & VFS_IFDIR);
+
+    // an empty directory holds its own "." besides the name in its parent
+    if (ei->raw.i_links_count <= 1 + is_dir) {
+        __ext2_drop_inode(inode);
+        return;
+    }
+
+    ei->raw.i_links_count--;
+    inode->ctime = clock_unixtime();
+    ext2_write_inode(inode);
+}
+
+static inline void
+__ext2_adjust_links(struct v_inode* inode, int delta)
+{
+    EXT2_I(inode)->raw.i_links_count += delta;
+    inode->mtime = inode->ctime = clock_unixtime();
+    ext2_write_inode(inode);
+}
+
+int
+ext2_create(struct v_inode* this, struct v_dnode* dnode)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(this->sb);
+    struct v_inode* inode;
+    int errno;
+
+    mutex_lock(&sbi->ns_lock);
+
+    if ((errno = __ext2_new_inode(this, dnode, EXT2_FILE_MODE, &inode))) {
+        goto done;
+    }
+
+    if ((errno = ext2_write_inode(inode)) ||
+        (errno = __ext2_add_entry(this,
+                                  dnode->name.value,
+                                  dnode->name.len,
+                                  inode->id,
+                                  __ext2_ftype(inode)))) {
+        __ext2_drop_inode(inode);
+        vfs_i_free(inode);
+        goto done;
+    }
+
+    this->mtime = clock_unixtime();
+
+    vfs_i_addhash(inode);
+    vfs_assign_inode(dnode, inode);
+
+done:
+    mutex_unlock(&sbi->ns_lock);
+    return errno;
+}
+
+int
+ext2_mkdir(struct v_inode* this, struct v_dnode* dnode)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(this->sb);
+    struct v_inode* inode;
+    void* buf = NULL;
+    u32_t pblk;
+    int errno;
+
+    mutex_lock(&sbi->ns_lock);
+
+    if ((errno = __ext2_new_inode(this, dnode, EXT2_DIR_MODE, &inode))) {
+        goto done;
+    }
+
+    if (!(buf = vzalloc(sbi->block_size))) {
+        errno = ENOMEM;
+        goto fail;
+    }
+
+    if ((errno = ext2_bmap(inode, 0, 1, &pblk))) {
+        goto fail;
+    }
+
+    struct ext2_dirent* dot = (struct ext2_dirent*)buf;
+    dot->rec_len = EXT2_DIRENT_LEN(1);
+    __ext2_fill_entry(dot, ".", 1, inode->id, __ext2_ftype(inode));
+
+    struct ext2_dirent* dotdot = buf + dot->rec_len;
+    dotdot->rec_len = sbi->block_size - dot->rec_len;
+    __ext2_fill_entry(dotdot, "..", 2, this->id, __ext2_ftype(this));
+
+    inode->fsize = sbi->block_size;
+
+    if ((errno = ext2_write_block(this->sb, pblk, buf)) ||
+        (errno = ext2_write_inode(inode)) ||
+        (errno = __ext2_add_entry(this,
+                                  dnode->name.value,
+                                  dnode->name.len,
+                                  inode->id,
+                                  __ext2_ftype(inode)))) {
+        goto fail;
+    }
+
+    // the ".." of the new directory
+    __ext2_adjust_links(this, 1);
+
+    vfs_i_addhash(inode);
+    vfs_assign_inode(dnode, inode);
+    goto done;
+
+fail:
+    __ext2_drop_inode(inode);
+    vfs_i_free(inode);
+
+done:
+    if (buf) {
+        vfree(buf);
+    }
+    mutex_unlock(&sbi->ns_lock);
+    return errno;
+}
+
+int
+ext2_rmdir(struct v_inode* this, struct v_dnode* dir)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(this->sb);
+    struct v_inode* inode = dir->inode;
+    int errno;
+
+    mutex_lock(&sbi->ns_lock);
+
+    if (!__ext2_dir_empty(inode)) {
+        errno = ENOTEMPTY;
+        goto done;
+    }
+
+    if ((errno = __ext2_del_entry(this, dir->name.value, dir->name.len))) {
+        goto done;
+    }
+
+    __ext2_drop_inode(inode);
+    __ext2_adjust_links(this, -1);
+
+done:
+    mutex_unlock(&sbi->ns_lock);
+    return errno;
+}
+
+int
+ext2_unlink(struct v_inode* this, struct v_dnode* name)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(this->sb);
+    struct v_inode* dir = name->parent->inode;
+    int errno;
+
+    mutex_lock(&sbi->ns_lock);
+
+    if (!(errno = __ext2_del_entry(dir, name->name.value, name->name.len))) {
+        __ext2_unlink_inode(this);
+        dir->mtime = clock_unixtime();
+    }
+
+    mutex_unlock(&sbi->ns_lock);
+    return errno;
+}
+
+int
+ext2_link(struct v_inode* this, struct v_dnode* new_name)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(this->sb);
+    struct v_inode* dir = new_name->parent->inode;
+    int errno;
+
+    if ((this->itype & VFS_IFDIR)) {
+        return EISDIR;
+    }
+
+    mutex_lock(&sbi->ns_lock);
+
+    if (!(errno = __ext2_add_entry(dir,
+                                   new_name->name.value,
+                                   new_name->name.len,
+                                   this->id,
+                                   __ext2_ftype(this)))) {
+        __ext2_adjust_links(this, 1);
+    }
+
+    mutex_unlock(&sbi->ns_lock);
+    return errno;
+}
+
+int
+ext2_rename(struct v_inode* from_inode,
+            struct v_dnode* from_dnode,
+            struct v_dnode* to_dnode)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(from_inode->sb);
+    struct v_inode* old_dir = from_dnode->parent->inode;
+    struct v_inode* new_dir = to_dnode->parent->inode;
+    struct v_inode* target = to_dnode->inode;
+    struct hstr* name = &to_dnode->name;
+    int is_dir = !!(from_inode->itype & VFS_IFDIR);
+    int errno = 0;
+
+    if (target == from_inode) {
+        return 0;
+    }
+
+    mutex_lock(&sbi->ns_lock);
+
+    if (target) {
+        if (!!(target->itype & VFS_IFDIR) != is_dir) {
+            errno = is_dir ? ENOTDIR : EISDIR;
+            goto done;
+        }
+
+        if (is_dir && !__ext2_dir_empty(target)) {
+            errno = ENOTEMPTY;
+            goto done;
+        }
+
+        errno = __ext2_set_entry(new_dir,
+                                 name->value,
+                                 name->len,
+                                 from_inode->id,
+                                 __ext2_ftype(from_inode));
+    } else {
+        errno = __ext2_add_entry(new_dir,
+                                 name->value,
+                                 name->len,
+                                 from_inode->id,
+                                 __ext2_ftype(from_inode));
+    }
+
+    if (errno) {
+        goto done;
+    }
+
+    if ((errno = __ext2_del_entry(
+           old_dir, from_dnode->name.value, from_dnode->name.len))) {
+        goto done;
+    }
+
+    if (target) {
+        __ext2_unlink_inode(target);
+        if (is_dir) {
+            // the ".." of the replaced directory
+            __ext2_adjust_links(new_dir, -1);
+        }
+    }
+
+    if (is_dir && old_dir != new_dir) {
+        __ext2_set_entry(
+          from_inode, "..", 2, new_dir->id, __ext2_ftype(new_dir));
+        __ext2_adjust_links(old_dir, -1);
+        __ext2_adjust_links(new_dir, 1);
+    }
+
+    from_inode->ctime = clock_unixtime();
+    ext2_write_inode(from_inode);
+
+done:
+    mutex_unlock(&sbi->ns_lock);
+    return errno;
+}
@@ -0,0 +1,522 @@
+#include <klibc/string.h>
+#include <lunaix/block.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/ext2.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+static struct v_inode_ops ext2_inode_ops = { .dir_lookup = ext2_dir_lookup,
+                                             .open = default_inode_open,
+                                             .create = ext2_create,
+                                             .mkdir = ext2_mkdir,
+                                             .rmdir = ext2_rmdir,
+                                             .unlink = ext2_unlink,
+                                             .link = ext2_link,
+                                             .rename = ext2_rename,
+                                             .read_symlink =
+                                               ext2_read_symlink };
+
+static struct v_file_ops ext2_file_ops = { .close = default_file_close,
+                                           .read = ext2_read,
+                                           .read_page = ext2_read_page,
+                                           .write = ext2_write,
+                                           .write_page = ext2_write_page,
+                                           .seek = default_file_seek,
+                                           .readdir = ext2_readdir,
+                                           .sync = ext2_sync };
+
+static void
+ext2_inode_destruct(struct v_inode* inode)
+{
+    struct ext2_inode_info* ei = EXT2_I(inode);
+
+    if (ei->symlink) {
+        vfree(ei->symlink);
+    }
+    vfree(ei);
+}
+
+void
+ext2_init_inode(struct v_superblock* vsb, struct v_inode* inode)
+{
+    inode->data = vzalloc(sizeof(struct ext2_inode_info));
+    inode->ops = &ext2_inode_ops;
+    inode->default_fops = &ext2_file_ops;
+    inode->destruct = ext2_inode_destruct;
+}
+
+static inline size_t
+__ext2_inode_offset(struct v_superblock* vsb, u32_t ino)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    u32_t ipg = sbi->sb.s_inodes_per_group;
+    struct ext2_gdesc* gd = &sbi->gdt[(ino - 1) / ipg];
+
+    return (size_t)gd->bg_inode_table * sbi->block_size +
+           (size_t)((ino - 1) % ipg) * sbi->inode_size;
+}
+
+static u32_t
+__ext2_itype(u32_t mode)
+{
+    switch (mode & EXT2_S_IFMT) {
+        case EXT2_S_IFDIR:
+            return VFS_IFDIR;
+        case EXT2_S_IFLNK:
+            return VFS_IFSYMLINK;
+        default:
+            return VFS_IFFILE;
+    }
+}
+
+int
+ext2_fill_inode(struct v_inode* inode, u32_t ino)
+{
+    struct v_superblock* vsb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    struct ext2_inode_info* ei = EXT2_I(inode);
+
+    if (!ei) {
+        return ENOMEM;
+    }
+
+    if (!ino || ino > sbi->sb.s_inodes_count) {
+        return EINVAL;
+    }
+
+    int errno = bcache_read(
+      vsb->dev, &ei->raw, __ext2_inode_offset(vsb, ino), sizeof(ei->raw));
+    if (errno != sizeof(ei->raw)) {
+        return EIO;
+    }
+
+    ei->group = (ino - 1) / sbi->sb.s_inodes_per_group;
+
+    inode->id = ino;
+    inode->itype = __ext2_itype(ei->raw.i_mode);
+    inode->fsize = ei->raw.i_size;
+    // with large_file, regular files keep the upper half of the size here
+    if ((ei->raw.i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+        inode->fsize |= (foff_t)ei->raw.i_dir_acl << 32;
+    }
+    inode->ctime = ei->raw.i_ctime;
+    inode->mtime = ei->raw.i_mtime;
+    inode->atime = ei->raw.i_atime;
+
+    return 0;
+}
+
+int
+ext2_write_inode(struct v_inode* inode)
+{
+    struct ext2_inode_info* ei = EXT2_I(inode);
+
+    ei->raw.i_size = (u32_t)inode->fsize;
+    if ((ei->raw.i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+        ei->raw.i_dir_acl = (u32_t)(inode->fsize >> 32);
+    }
+    ei->raw.i_ctime = inode->ctime;
+    ei->raw.i_mtime = inode->mtime;
+    ei->raw.i_atime = inode->atime;
+
+    // anything past the base record (extra fields of larger inodes) is kept
+    int errno = ext2_write_raw(inode->sb,
+                               &ei->raw,
+                               __ext2_inode_offset(inode->sb, inode->id),
+                               sizeof(ei->raw));
+    if (!errno) {
+        ei->dirty = 0;
+    }
+
+    return errno;
+}
+
+struct v_inode*
+ext2_iget(struct v_superblock* vsb, u32_t ino)
+{
+    struct v_inode* inode = vfs_i_find(vsb, ino);
+    if (inode) {
+        return inode;
+    }
+
+    if (!(inode = vfs_i_alloc(vsb))) {
+        return NULL;
+    }
+
+    if (ext2_fill_inode(inode, ino)) {
+        vfs_i_free(inode);
+        return NULL;
+    }
+
+    vfs_i_addhash(inode);
+    return inode;
+}
+
+/**
+ * @brief Hand a new block to the inode, right after the last one it got, or
+ * at the start of its group for the first one
+ *
+ */
+static u32_t
+__ext2_new_block(struct v_inode* inode, int zero)
+{
+    struct v_superblock* vsb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    struct ext2_inode_info* ei = EXT2_I(inode);
+
+    u32_t goal = ei->last_alloc ? ei->last_alloc + 1
+                                : sbi->sb.s_first_data_block +
+                                    ei->group * sbi->sb.s_blocks_per_group;
+
+    u32_t block = ext2_alloc_block(vsb, goal);
+    if (!block) {
+        return 0;
+    }
+
+    if (zero) {
+        void* buf = vzalloc(sbi->block_size);
+        if (!buf || ext2_write_block(vsb, block, buf)) {
+            if (buf) {
+                vfree(buf);
+            }
+            ext2_free_block(vsb, block);
+            return 0;
+        }
+        vfree(buf);
+    }
+
+    ei->last_alloc = block;
+    ei->raw.i_blocks += sbi->block_size / 512;
+    ei->dirty = 1;
+
+    return block;
+}
+
+/**
+ * @brief Split a logical block number into the path of slots leading to it:
+ * the slot in i_block first, then one slot in each level of indirection.
+ *
+ * @return int the length of the path, or 0 if out of range
+ */
+static int
+__ext2_block_path(struct ext2_sb_info* sbi, u32_t lblk, u32_t* path)
+{
+    u32_t ppb = sbi->ptrs_per_block;
+
+    if (lblk < EXT2_NDIR_BLOCKS) {
+        path[0] = lblk;
+        return 1;
+    }
+
+    lblk -= EXT2_NDIR_BLOCKS;
+    if (lblk < ppb) {
+        path[0] = EXT2_IND_BLOCK;
+        path[1] = lblk;
+        return 2;
+    }
+
+    lblk -= ppb;
+    if (lblk < ppb * ppb) {
+        path[0] = EXT2_DIND_BLOCK;
+        path[1] = lblk / ppb;
+        path[2] = lblk % ppb;
+        return 3;
+    }
+
+    lblk -= ppb * ppb;
+    if (lblk / (ppb * ppb) < ppb) {
+        path[0] = EXT2_TIND_BLOCK;
+        path[1] = lblk / (ppb * ppb);
+        path[2] = (lblk / ppb) % ppb;
+        path[3] = lblk % ppb;
+        return 4;
+    }
+
+    return 0;
+}
+
+int
+ext2_bmap(struct v_inode* inode, u32_t lblk, int create, u32_t* pblk)
+{
+    struct v_superblock* vsb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    u32_t path[4];
+    int errno = 0;
+
+    int depth = __ext2_block_path(sbi, lblk, path);
+    if (!depth) {
+        return EINVAL;
+    }
+
+    u32_t block = ei->raw.i_block[path[0]];
+    if (!block && create) {
+        if (!(block = __ext2_new_block(inode, depth > 1))) {
+            return ENOSPC;
+        }
+        ei->raw.i_block[path[0]] = block;
+    }
+
+    u32_t* ptrs = NULL;
+    if (depth > 1 && block && !(ptrs = valloc(sbi->block_size))) {
+        return ENOMEM;
+    }
+
+    for (int i = 1; i < depth && block; i++) {
+        if ((errno = ext2_read_block(vsb, block, ptrs))) {
+            goto done;
+        }
+
+        u32_t next = ptrs[path[i]];
+        if (!next && create) {
+            if (!(next = __ext2_new_block(inode, i < depth - 1))) {
+                errno = ENOSPC;
+                goto done;
+            }
+
+            size_t slot = (size_t)block * sbi->block_size + path[i] * 4;
+            if ((errno = ext2_write_raw(vsb, &next, slot, sizeof(next)))) {
+                goto done;
+            }
+        }
+
+        block = next;
+    }
+
+    *pblk = block;
+
+done:
+    if (ptrs) {
+        vfree(ptrs);
+    }
+    return errno;
+}
+
+static void
+__ext2_free_tree(struct v_superblock* vsb, u32_t block, int depth)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+
+    if (!block) {
+        return;
+    }
+
+    u32_t* ptrs;
+    if (depth && (ptrs = valloc(sbi->block_size))) {
+        if (!ext2_read_block(vsb, block, ptrs)) {
+            for (u32_t i = 0; i < sbi->ptrs_per_block; i++) {
+                __ext2_free_tree(vsb, ptrs[i], depth - 1);
+            }
+        }
+        vfree(ptrs);
+    }
+
+    ext2_free_block(vsb, block);
+}
+
+void
+ext2_truncate(struct v_inode* inode)
+{
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    u32_t* blocks = ei->raw.i_block;
+
+    // fast symlinks keep their target in i_block rather than block numbers
+    if (inode->itype == VFS_IFSYMLINK && !ei->raw.i_blocks) {
+        goto done;
+    }
+
+    for (int i = 0; i < EXT2_NDIR_BLOCKS; i++) {
+        __ext2_free_tree(inode->sb, blocks[i], 0);
+    }
+    __ext2_free_tree(inode->sb, blocks[EXT2_IND_BLOCK], 1);
+    __ext2_free_tree(inode->sb, blocks[EXT2_DIND_BLOCK], 2);
+    __ext2_free_tree(inode->sb, blocks[EXT2_TIND_BLOCK], 3);
+
+done:
+    memset(blocks, 0, sizeof(ei->raw.i_block));
+    ei->raw.i_blocks = 0;
+    ei->last_alloc = 0;
+    ei->dirty = 1;
+    inode->fsize = 0;
+}
+
+/**
+ * @brief Transfer between buf and [fpos, fpos + len) of the file, coalescing
+ * blocks that are contiguous on disk into a single device request. Holes read
+ * as zeros, and are filled on writes.
+ *
+ */
+static int
+__ext2_rw(struct v_inode* inode, void* buf, size_t len, foff_t fpos, int write)
+{
+    struct v_superblock* vsb = inode->sb;
+    struct device* dev = vsb->dev;
+    u32_t bsize = EXT2_SB(vsb)->block_size;
+    size_t done = 0;
+    int errno = 0;
+
+    while (done < len) {
+        foff_t pos = fpos + done;
+        u32_t lblk = pos / bsize, off = pos % bsize, pblk;
+        size_t n = MIN(bsize - off, len - done);
+
+        if ((errno = ext2_bmap(inode, lblk, 0, &pblk))) {
+            break;
+        }
+
+        if (!pblk && !write) {
+            memset(buf + done, 0, n);
+            done += n;
+            continue;
+        }
+
+        if (!pblk) {
+            if ((errno = ext2_bmap(inode, lblk, 1, &pblk))) {
+                break;
+            }
+
+            // the rest of a fresh block must not expose what was there before
+            if (n < bsize) {
+                void* blk = vzalloc(bsize);
+                if (!blk) {
+                    errno = ENOMEM;
+                    break;
+                }
+                memcpy(blk + off, buf + done, n);
+                errno = ext2_write_block(vsb, pblk, blk);
+                vfree(blk);
+                if (errno) {
+                    break;
+                }
+                done += n;
+                continue;
+            }
+        }
+
+        // grow the run over the following blocks while they are adjacent on
+        // disk. Fresh blocks are only taken when written in whole.
+        while (!off && done + n < len) {
+            size_t more = MIN(bsize, len - done - n);
+            u32_t next;
+
+            if (ext2_bmap(inode, lblk + n / bsize, write && more == bsize, &next) ||
+                next != pblk + n / bsize) {
+                break;
+            }
+            n += more;
+        }
+
+        foff_t at = (foff_t)pblk * bsize + off;
+        errno = write ? dev->write(dev, buf + done, at, n)
+                      : dev->read(dev, buf + done, at, n);
+        if (errno <= 0) {
+            errno = errno ? EIO : 0;
+            break;
+        }
+
+        // the device may cut long transfers short, carry on from there
+        done += errno;
+        errno = 0;
+    }
+
+    return done ? (int)done : errno;
+}
+
+int
+ext2_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (fpos >= inode->fsize) {
+        return 0;
+    }
+
+    return __ext2_rw(inode, buffer, MIN(len, inode->fsize - fpos), fpos, 0);
+}
+
+int
+ext2_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    int errno = __ext2_rw(inode, buffer, len, fpos, 1);
+
+    if (errno > 0 && fpos + errno > inode->fsize) {
+        inode->fsize = fpos + errno;
+        EXT2_I(inode)->dirty = 1;
+    }
+
+    if (EXT2_I(inode)->dirty) {
+        ext2_write_inode(inode);
+    }
+
+    return errno;
+}
+
+int
+ext2_read_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    return ext2_read(inode, buffer, len, fpos);
+}
+
+int
+ext2_write_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    u32_t bsize = EXT2_SB(inode->sb)->block_size;
+
+    if (fpos >= inode->fsize) {
+        return len;
+    }
+
+    // the page is zeroed past the end of file, write out whole blocks so
+    // that growing the file later does not bring back stale bytes
+    size_t n = MIN(len, ROUNDUP(inode->fsize - fpos, bsize));
+    int errno = __ext2_rw(inode, buffer, n, fpos, 1);
+
+    if (errno >= 0 && ei->raw.i_size != (u32_t)inode->fsize) {
+        ei->dirty = 1;
+    }
+
+    if (ei->dirty) {
+        ext2_write_inode(inode);
+    }
+
+    return errno < 0 ? errno : (int)len;
+}
+
+int
+ext2_sync(struct v_file* file)
+{
+    return ext2_write_inode(file->inode);
+}
+
+int
+ext2_read_symlink(struct v_inode* this, const char** path_out)
+{
+    struct ext2_inode_info* ei = EXT2_I(this);
+    u32_t size = ei->raw.i_size;
+    int errno = 0;
+
+    if (ei->symlink) {
+        goto done;
+    }
+
+    if (!(ei->symlink = valloc(MAX(size + 1, EXT2_SB(this->sb)->block_size)))) {
+        return ENOMEM;
+    }
+
+    // short targets are kept right in i_block
+    if (!ei->raw.i_blocks) {
+        size = MIN(size, sizeof(ei->raw.i_block));
+        memcpy(ei->symlink, ei->raw.i_block, size);
+    } else if ((errno = __ext2_rw(this, ei->symlink, size, 0, 0)) < 0) {
+        vfree(ei->symlink);
+        ei->symlink = NULL;
+        return errno;
+    }
+
+    ei->symlink[size] = '\0';
+
+done:
+    *path_out = ei->symlink;
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file mount.c
+ * @brief ext2 superblock, group descriptors and block I/O helpers
+ *
+ * Metadata blocks (bitmaps, inode tables, directories, indirect blocks) are
+ * read through the block buffer cache. Every update is written straight back
+ * to the device, which in turn invalidates the cached copy, so the cache never
+ * holds stale metadata. File contents bypass the buffer cache and live in the
+ * page cache instead.
+ *
+ */
+#include <klibc/string.h>
+#include <lunaix/block.h>
+#include <lunaix/clock.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/ext2.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("ext2")
+
+int
+ext2_write_raw(struct v_superblock* vsb, void* buf, foff_t offset, size_t len)
+{
+    struct device* dev = vsb->dev;
+    size_t done = 0;
+
+    // the device may cap the length of a single transfer
+    while (done < len) {
+        int errno = dev->write(dev, buf + done, offset + done, len - done);
+        if (errno <= 0) {
+            return EIO;
+        }
+        done += errno;
+    }
+
+    return 0;
+}
+
+int
+ext2_read_block(struct v_superblock* vsb, u32_t block, void* buf)
+{
+    u32_t bsize = EXT2_SB(vsb)->block_size;
+    int errno = bcache_read(vsb->dev, buf, (size_t)block * bsize, bsize);
+    return (u32_t)errno == bsize ? 0 : EIO;
+}
+
+int
+ext2_write_block(struct v_superblock* vsb, u32_t block, void* buf)
+{
+    u32_t bsize = EXT2_SB(vsb)->block_size;
+    return ext2_write_raw(vsb, buf, (size_t)block * bsize, bsize);
+}
+
+int
+ext2_write_sb(struct v_superblock* vsb)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+
+    // backup copies in other groups are left to fsck
+    sbi->sb.s_wtime = clock_unixtime();
+    return ext2_write_raw(vsb, &sbi->sb, EXT2_SB_OFFSET, EXT2_SB_SIZE);
+}
+
+int
+ext2_write_gdesc(struct v_superblock* vsb, u32_t group)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    foff_t offset = (foff_t)sbi->gdt_block * sbi->block_size +
+                    group * sizeof(struct ext2_gdesc);
+
+    return ext2_write_raw(
+      vsb, &sbi->gdt[group], offset, sizeof(struct ext2_gdesc));
+}
+
+static u32_t
+__ext2_rd_capacity(struct v_superblock* vsb)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    return sbi->sb.s_blocks_count * sbi->block_size;
+}
+
+static u32_t
+__ext2_rd_usage(struct v_superblock* vsb)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+    return (sbi->sb.s_blocks_count - sbi->sb.s_free_blocks_count) *
+           sbi->block_size;
+}
+
+static int
+__ext2_check_sb(struct ext2_sb_info* sbi)
+{
+    struct ext2_superblock* sb = &sbi->sb;
+
+    if (sb->s_magic != EXT2_MAGIC) {
+        return EINVAL;
+    }
+
+    if (sb->s_log_block_size > 6 || !sb->s_blocks_per_group ||
+        !sb->s_inodes_per_group) {
+        return EINVAL;
+    }
+
+    sbi->inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+    sbi->first_ino = EXT2_GOOD_OLD_FIRST_INO;
+
+    if (sb->s_rev_level) {
+        if ((sb->s_feature_incompat & ~EXT2_INCOMPAT_SUPP) ||
+            (sb->s_feature_ro_compat & ~EXT2_RO_COMPAT_SUPP)) {
+            kprintf(KWARN "unsupported features: incompat=%x, ro_compat=%x\n",
+                    sb->s_feature_incompat,
+                    sb->s_feature_ro_compat);
+            return ENOTSUP;
+        }
+
+        sbi->inode_size = sb->s_inode_size;
+        sbi->first_ino = sb->s_first_ino;
+    }
+
+    if (sbi->inode_size < EXT2_GOOD_OLD_INODE_SIZE) {
+        return EINVAL;
+    }
+
+    sbi->filetype = !!(sb->s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE);
+    sbi->block_size = 1024 << sb->s_log_block_size;
+    sbi->ptrs_per_block = sbi->block_size / sizeof(u32_t);
+    sbi->gdt_block = sb->s_first_data_block + 1;
+    sbi->nr_groups = ICEIL(sb->s_blocks_count - sb->s_first_data_block,
+                           sb->s_blocks_per_group);
+
+    return 0;
+}
+
+int
+ext2_mount(struct v_superblock* vsb, struct v_dnode* mount_point)
+{
+    struct device* dev = vsb->dev;
+    if (!dev) {
+        return ENODEV;
+    }
+
+    struct ext2_sb_info* sbi = vzalloc(sizeof(*sbi));
+    if (!sbi) {
+        return ENOMEM;
+    }
+
+    int errno =
+      bcache_read(dev, &sbi->sb, EXT2_SB_OFFSET, EXT2_SB_SIZE) == EXT2_SB_SIZE
+        ? 0
+        : EIO;
+    if (errno || (errno = __ext2_check_sb(sbi))) {
+        goto fail;
+    }
+
+    size_t gdt_len = sbi->nr_groups * sizeof(struct ext2_gdesc);
+    if (!(sbi->gdt = valloc(gdt_len))) {
+        errno = ENOMEM;
+        goto fail;
+    }
+
+    if ((size_t)bcache_read(dev,
+                            sbi->gdt,
+                            (size_t)sbi->gdt_block * sbi->block_size,
+                            gdt_len) != gdt_len) {
+        errno = EIO;
+        goto fail;
+    }
+
+    mutex_init(&sbi->ns_lock);
+    mutex_init(&sbi->alloc_lock);
+
+    vsb->data = sbi;
+    vsb->ops.init_inode = ext2_init_inode;
+    vsb->ops.read_capacity = __ext2_rd_capacity;
+    vsb->ops.read_usage = __ext2_rd_usage;
+
+    struct v_inode* root = ext2_iget(vsb, EXT2_ROOT_INO);
+    if (!root) {
+        errno = EIO;
+        goto fail;
+    }
+
+    if (!(root->itype & VFS_IFDIR)) {
+        vfs_i_free(root);
+        errno = EINVAL;
+        goto fail;
+    }
+
+    vfs_assign_inode(mount_point, root);
+
+    // cleared until a clean unmount, so that fsck knows to check it
+    sbi->sb.s_state &= ~EXT2_VALID_FS;
+    sbi->sb.s_mnt_count++;
+    sbi->sb.s_mtime = clock_unixtime();
+    ext2_write_sb(vsb);
+
+    return 0;
+
+fail:
+    if (sbi->gdt) {
+        vfree(sbi->gdt);
+    }
+    vfree(sbi);
+    vsb->data = NULL;
+    return errno;
+}
+
+int
+ext2_unmount(struct v_superblock* vsb)
+{
+    struct ext2_sb_info* sbi = EXT2_SB(vsb);
+
+    sbi->sb.s_state |= EXT2_VALID_FS;
+    ext2_write_sb(vsb);
+
+    // cached inodes only keep their own copies, they never refer back here
+    vfree(sbi->gdt);
+    vfree(sbi);
+
+    return 0;
+}
+
+void
+ext2_init()
+{
+    struct filesystem* fs = fsm_new_fs("ext2", -1);
+    fs->mount = ext2_mount;
+    fs->unmount = ext2_unmount;
+
+    fsm_register(fs);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file fdtable.c
+ * @brief 可增长的文件描述符表
+ *
+ * 描述符的占用情况记录于位图中，分配时逐字查找首个为零的位，而无需逐项检查；
+ * 复制与清理时同样只需访问被占用的描述符。lowest 以下的描述符均已被占用，
+ * 查找由此开始，故连续打开文件时几乎不必扫描。
+ *
+ */
+#include <klibc/string.h>
+#include <lunaix/fs.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+
+#define __bm_word(fd) ((fd) / 32)
+#define __bm_bit(fd) (1U << ((fd) % 32))
+
+struct v_fdtable*
+vfs_fdtable_new()
+{
+    struct v_fdtable* table = vzalloc(sizeof(struct v_fdtable));
+    if (!table) {
+        return NULL;
+    }
+
+    table->size = VFS_FD_INIT;
+    table->fds = table->fds_inline;
+    table->bitmap = table->bitmap_inline;
+
+    return table;
+}
+
+void
+vfs_fdtable_free(struct v_fdtable* table)
+{
+    if (table->fds != table->fds_inline) {
+        vfree(table->fds);
+        vfree(table->bitmap);
+    }
+    vfree(table);
+}
+
+int
+vfs_fdtable_expand(struct v_fdtable* table, u32_t nr)
+{
+    if (nr <= table->size) {
+        return 0;
+    }
+
+    if (nr > VFS_MAX_FD) {
+        return EMFILE;
+    }
+
+    u32_t size = table->size;
+    while (size < nr) {
+        size *= 2;
+    }
+    size = MIN(size, VFS_MAX_FD);
+
+    struct v_fd** fds = vzalloc(size * sizeof(struct v_fd*));
+    u32_t* bitmap = vzalloc(size / 8);
+    if (!fds || !bitmap) {
+        if (fds) {
+            vfree(fds);
+        }
+        if (bitmap) {
+            vfree(bitmap);
+        }
+        return ENOMEM;
+    }
+
+    memcpy(fds, table->fds, table->size * sizeof(struct v_fd*));
+    memcpy(bitmap, table->bitmap, table->size / 8);
+
+    if (table->fds != table->fds_inline) {
+        vfree(table->fds);
+        vfree(table->bitmap);
+    }
+
+    table->fds = fds;
+    table->bitmap = bitmap;
+    table->size = size;
+
+    return 0;
+}
+
+void
+vfs_fdtable_set(struct v_fdtable* table, int fd, struct v_fd* fd_s)
+{
+    assert(fd >= 0 && (u32_t)fd < table->size);
+
+    table->fds[fd] = fd_s;
+
+    if (fd_s) {
+        table->bitmap[__bm_word(fd)] |= __bm_bit(fd);
+        if ((u32_t)fd == table->lowest) {
+            table->lowest++;
+        }
+    } else {
+        table->bitmap[__bm_word(fd)] &= ~__bm_bit(fd);
+        table->lowest = MIN(table->lowest, (u32_t)fd);
+    }
+}
+
+int
+vfs_fdtable_next(struct v_fdtable* table, int from)
+{
+    if (from < 0 || (u32_t)from >= table->size) {
+        return -1;
+    }
+
+    u32_t w = __bm_word(from);
+    u32_t word = table->bitmap[w] & ~(__bm_bit(from) - 1);
+
+    while (!word) {
+        if (++w >= __bm_word(table->size)) {
+            return -1;
+        }
+        word = table->bitmap[w];
+    }
+
+    return w * 32 + __builtin_ctz(word);
+}
+
+int
+vfs_fdtable_copy(struct v_fdtable* dest, struct v_fdtable* src)
+{
+    int errno;
+    if ((errno = vfs_fdtable_expand(dest, src->size))) {
+        return errno;
+    }
+
+    vfs_fdtable_foreach(src, fd)
+    {
+        struct v_fd* copied;
+        if ((errno = vfs_dup_fd(src->fds[fd], &copied))) {
+            return errno;
+        }
+        vfs_fdtable_set(dest, fd, copied);
+    }
+
+    return 0;
+}
+
+int
+vfs_alloc_fdslot(int* fd)
+{
+    struct v_fdtable* table = __current->fdtable;
+
+    for (u32_t w = __bm_word(table->lowest); w < __bm_word(table->size); w++) {
+        u32_t word = ~table->bitmap[w];
+        if (word) {
+            *fd = w * 32 + __builtin_ctz(word);
+            return 0;
+        }
+    }
+
+    // 已满，扩大后首个新增的描述符便是空闲的
+    u32_t size = table->size;
+    if (vfs_fdtable_expand(table, size + 1)) {
+        return EMFILE;
+    }
+
+    *fd = size;
+    return 0;
+}
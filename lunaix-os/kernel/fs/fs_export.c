@@ -37,6 +37,20 @@ __mount_reset(struct twimap* map)
     map->index = container_of(all_mnts.next, struct v_mount, list);
 }
 
+void
+__pcache_rd_usage(struct twimap* map)
+{
+    char path[512];
+    struct v_mount* mnt = twimap_index(map, struct v_mount*);
+    size_t len = vfs_get_path(mnt->mnt_point, path, 511, 0);
+    path[len] = '\0';
+    twimap_printf(map,
+                  "%s %s %u\n",
+                  path,
+                  mnt->super_block->fs->fs_name.value,
+                  mnt->super_block->pc_pages);
+}
+
 void
 __version_rd(struct twimap* map)
 {
@@ -57,6 +71,15 @@ vfs_export_attributes()
     map->go_next = __mount_next;
     map->reset = __mount_reset;
 
+    // 各挂载点（超级块）的页缓存占用：路径 文件系统 页数
+    map = twifs_mapping(NULL, NULL, "pcache");
+    map->read = __pcache_rd_usage;
+    map->go_next = __mount_next;
+    map->reset = __mount_reset;
+
+    // 全局的页缓存：总页数 上限 活跃 非活跃 脏页
+    pcache_export();
+
     map = twifs_mapping(NULL, NULL, "version");
     map->read = __version_rd;
 }
\ No newline at end of file
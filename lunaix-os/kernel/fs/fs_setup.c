@@ -1,8 +1,11 @@
 #include <lunaix/fs.h>
 #include <lunaix/fs/devfs.h>
+#include <lunaix/fs/ext2.h>
 #include <lunaix/fs/iso9660.h>
+#include <lunaix/fs/pipe.h>
 #include <lunaix/fs/ramfs.h>
 #include <lunaix/fs/taskfs.h>
+#include <lunaix/fs/tmpfs.h>
 #include <lunaix/fs/twifs.h>
 
 void
@@ -13,6 +16,9 @@ fsm_register_all()
     devfs_init();
     taskfs_init();
     iso9660_init();
+    pipefs_init();
+    tmpfs_init();
+    ext2_init();
 
     // ... more fs implementation
 }
\ No newline at end of file
@@ -54,8 +54,9 @@ struct filesystem*
 fsm_new_fs(char* name, size_t name_len)
 {
     struct filesystem* fs = vzalloc(sizeof(*fs));
+    // unknown length, hstr_rehash in fsm_register computes it while hashing
     if (name_len == (size_t)-1) {
-        name_len = strlen(name);
+        name_len = 0;
     }
     fs->fs_name = HHSTR(name, name_len, 0);
     return fs;
@@ -0,0 +1,437 @@
+/**
+ * @file ioring.c
+ * @brief 批量提交的I/O环，一次系统调用即可提交并取回多个请求
+ *
+ * 块设备上的异步读写与 aio 相同，经由 device::submit 提交并使用内核的DMA缓冲区。
+ * 完成回调仅将请求挂入环的完成列表，由发起进程在 ioring_enter 中（即处于其上下文
+ * 中）复制读得的数据并写入完成项，因此回调无需访问用户空间。
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/device.h>
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/foptions.h>
+#include <lunaix/fs.h>
+#include <lunaix/ioring.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+#include <lunaix/uio.h>
+
+// 同时在途的异步请求数，超出时其余的请求同步完成
+#define IORING_MAX_INFLIGHT 16
+// 单个异步请求的最大长度
+#define IORING_MAX_ASYNC_LEN 0x10000
+
+struct ioring_ctx
+{
+    struct io_ring* uring;
+    struct io_ring geo; // 登记时取得的队列长度与位置
+    u32_t sq_head;
+    u32_t cq_tail;
+    struct proc_info* owner; // 所属进程退出后为NULL，由最后一个完成回调释放
+    u32_t inflight;
+    u32_t nr_completed;
+    struct llist_header completed;
+    waitq_t wait;
+};
+
+struct ioring_req
+{
+    struct dev_iocb iocb;
+    struct ioring_ctx* ctx;
+    struct llist_header link;
+    void* ubuf;
+    u32_t user_data;
+};
+
+static void
+__ioring_free_req(struct ioring_req* req)
+{
+    vfree_dma(req->iocb.buf);
+    vfree(req);
+}
+
+static void
+__ioring_completed(struct dev_iocb* iocb)
+{
+    struct ioring_req* req = (struct ioring_req*)iocb->data;
+    struct ioring_ctx* ctx = req->ctx;
+
+    ctx->inflight--;
+
+    if (!ctx->owner) {
+        __ioring_free_req(req);
+        if (!ctx->inflight) {
+            vfree(ctx);
+        }
+        return;
+    }
+
+    llist_append(&ctx->completed, &req->link);
+    ctx->nr_completed++;
+    pwake_all(&ctx->wait);
+}
+
+static int
+__ioring_cq_post(struct ioring_ctx* ctx, u32_t user_data, int res)
+{
+    struct io_cqe cqe = { .user_data = user_data, .res = res };
+    u32_t idx = ctx->cq_tail & (ctx->geo.cq_entries - 1);
+
+    if (copy_to_user(&ctx->geo.cqes[idx], &cqe, sizeof(cqe))) {
+        return EFAULT;
+    }
+
+    ctx->cq_tail++;
+    return 0;
+}
+
+/**
+ * @brief 为已完成的异步请求写入完成项
+ *
+ */
+static int
+__ioring_reap(struct ioring_ctx* ctx)
+{
+    int errno = 0;
+
+    while (!llist_empty(&ctx->completed)) {
+        struct ioring_req* req =
+          list_entry(ctx->completed.next, struct ioring_req, link);
+        int res = req->iocb.result;
+
+        if (res > 0 && !req->iocb.write &&
+            copy_to_user(req->ubuf, req->iocb.buf, res)) {
+            res = EFAULT;
+        }
+
+        if ((errno = __ioring_cq_post(ctx, req->user_data, res))) {
+            break;
+        }
+
+        llist_delete(&req->link);
+        ctx->nr_completed--;
+        __ioring_free_req(req);
+    }
+
+    return errno;
+}
+
+/**
+ * @brief 取得可异步读写的块设备。仅限以 FO_DIRECT 打开者：异步请求绕过了页缓存，
+ *  对于经由缓存访问的文件，这将破坏其一致性
+ *
+ */
+static struct device*
+__ioring_async_dev(struct ioring_ctx* ctx, struct io_sqe* sqe)
+{
+    struct v_fd* fd_s;
+
+    if (!(sqe->flags & IORING_F_POS) || !sqe->len ||
+        sqe->len > IORING_MAX_ASYNC_LEN ||
+        ctx->inflight >= IORING_MAX_INFLIGHT) {
+        return NULL;
+    }
+
+    if (vfs_getfd(sqe->fd, &fd_s) || !(fd_s->flags & FO_DIRECT)) {
+        return NULL;
+    }
+
+    struct v_inode* inode = fd_s->file->inode;
+    struct device* dev = (struct device*)inode->data;
+    if (!(inode->itype & VFS_IFVOLDEV) || !dev || !dev->submit) {
+        return NULL;
+    }
+
+    return dev;
+}
+
+static int
+__ioring_submit_async(struct ioring_ctx* ctx,
+                      struct device* dev,
+                      struct io_sqe* sqe)
+{
+    int write = sqe->opcode == IORING_OP_WRITE;
+    struct ioring_req* req = valloc(sizeof(struct ioring_req));
+    void* kbuf = valloc_dma(sqe->len);
+    int errno;
+
+    if (!req || !kbuf) {
+        if (req) {
+            vfree(req);
+        }
+        if (kbuf) {
+            vfree_dma(kbuf);
+        }
+        return ENOMEM;
+    }
+
+    *req = (struct ioring_req){ .iocb = { .buf = kbuf,
+                                          .offset = sqe->offset,
+                                          .len = sqe->len,
+                                          .write = write,
+                                          .done = __ioring_completed,
+                                          .data = req },
+                                .ctx = ctx,
+                                .ubuf = sqe->buf,
+                                .user_data = sqe->user_data };
+
+    if (write && copy_from_user(kbuf, sqe->buf, sqe->len)) {
+        errno = EFAULT;
+        goto fail;
+    }
+
+    // 完成回调可能立即发生，须在提交前计入
+    ctx->inflight++;
+    if ((errno = dev->submit(dev, &req->iocb))) {
+        ctx->inflight--;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    __ioring_free_req(req);
+    return errno;
+}
+
+static int
+__ioring_exec(struct io_sqe* sqe)
+{
+    struct iovec iov = { .iov_base = sqe->buf, .iov_len = sqe->len };
+    foff_t pos = sqe->offset;
+    foff_t* ppos = (sqe->flags & IORING_F_POS) ? &pos : NULL;
+    struct v_fd* fd_s;
+    int errno;
+
+    switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            return 0;
+        case IORING_OP_READ:
+            return vfs_do_rw(sqe->fd, &iov, 1, ppos, 0);
+        case IORING_OP_WRITE:
+            return vfs_do_rw(sqe->fd, &iov, 1, ppos, 1);
+        case IORING_OP_FSYNC:
+            if (!(errno = vfs_getfd(sqe->fd, &fd_s))) {
+                errno = vfs_fsync(fd_s->file);
+            }
+            return errno;
+        case IORING_OP_OPEN:
+            return vfs_do_open((const char*)sqe->buf, (int)sqe->len);
+        default:
+            return EINVAL;
+    }
+}
+
+static int
+__ioring_submit(struct ioring_ctx* ctx, int to_submit, int* submitted)
+{
+    struct device* plugged = NULL;
+    struct io_sqe sqe;
+    u32_t sq_tail, cq_head;
+    int nr = 0, errno = 0;
+
+    if (copy_from_user(&sq_tail, &ctx->uring->sq_tail, sizeof(u32_t)) ||
+        copy_from_user(&cq_head, &ctx->uring->cq_head, sizeof(u32_t))) {
+        return EFAULT;
+    }
+
+    while (nr < to_submit && ctx->sq_head != sq_tail) {
+        // 为每个取走的请求预留完成项，包括尚未写入的
+        u32_t reserved = ctx->cq_tail - cq_head + ctx->inflight +
+                         ctx->nr_completed;
+        if (reserved >= ctx->geo.cq_entries) {
+            break;
+        }
+
+        u32_t idx = ctx->sq_head & (ctx->geo.sq_entries - 1);
+        if (copy_from_user(&sqe, &ctx->geo.sqes[idx], sizeof(sqe))) {
+            errno = EFAULT;
+            break;
+        }
+
+        ctx->sq_head++;
+        nr++;
+
+        struct device* dev = NULL;
+        if (sqe.opcode == IORING_OP_READ || sqe.opcode == IORING_OP_WRITE) {
+            dev = __ioring_async_dev(ctx, &sqe);
+        }
+
+        if (dev) {
+            // 同一批次中发往同一设备的请求暂不调度，以便排序与合并
+            if (dev != plugged) {
+                if (plugged && plugged->unplug) {
+                    plugged->unplug(plugged);
+                }
+                if ((plugged = dev)->plug) {
+                    dev->plug(dev);
+                }
+            }
+
+            if (!__ioring_submit_async(ctx, dev, &sqe)) {
+                continue;
+            }
+        }
+
+        // 同步的请求可能等待同一设备，须先解除阻塞
+        if (plugged) {
+            if (plugged->unplug) {
+                plugged->unplug(plugged);
+            }
+            plugged = NULL;
+        }
+
+        int res = __ioring_exec(&sqe);
+        if ((errno = __ioring_cq_post(ctx, sqe.user_data, res))) {
+            break;
+        }
+    }
+
+    if (plugged && plugged->unplug) {
+        plugged->unplug(plugged);
+    }
+
+    *submitted = nr;
+    return errno;
+}
+
+static int
+__ioring_wait(struct ioring_ctx* ctx, u32_t min_complete)
+{
+    u32_t cq_head;
+    int errno;
+
+    if (copy_from_user(&cq_head, &ctx->uring->cq_head, sizeof(u32_t))) {
+        return EFAULT;
+    }
+
+    while (1) {
+        if ((errno = __ioring_reap(ctx))) {
+            return errno;
+        }
+
+        if (ctx->cq_tail - cq_head >= min_complete || !ctx->inflight) {
+            return 0;
+        }
+
+        pwait(&ctx->wait);
+        // pwait 返回时已开启中断，系统调用的剩余部分仍需在关中断下进行
+        cpu_disable_interrupt();
+    }
+}
+
+void
+proc_release_ioring(struct proc_info* proc)
+{
+    struct ioring_ctx* ctx = proc->ioring;
+
+    if (!ctx) {
+        return;
+    }
+
+    // 与完成回调互斥
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    struct ioring_req *pos, *n;
+    llist_for_each(pos, n, &ctx->completed, link)
+    {
+        __ioring_free_req(pos);
+    }
+
+    if (ctx->inflight) {
+        ctx->owner = NULL;
+    } else {
+        vfree(ctx);
+    }
+    proc->ioring = NULL;
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+__DEFINE_LXSYSCALL1(int, ioring_setup, struct io_ring*, ring)
+{
+    struct proc_info* proc = (struct proc_info*)__current;
+    struct io_ring geo;
+    int errno = 0;
+
+    if (!ring) {
+        proc_release_ioring(proc);
+        return 0;
+    }
+
+    if (proc->ioring) {
+        errno = EBUSY;
+        goto done;
+    }
+
+    if (copy_from_user(&geo, ring, sizeof(geo))) {
+        errno = EFAULT;
+        goto done;
+    }
+
+    u32_t sqn = geo.sq_entries, cqn = geo.cq_entries;
+    if (!sqn || (sqn & (sqn - 1)) || sqn > IORING_MAX_ENTRIES || !cqn ||
+        (cqn & (cqn - 1)) || cqn > IORING_MAX_ENTRIES) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    struct ioring_ctx* ctx = valloc(sizeof(struct ioring_ctx));
+    if (!ctx) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    *ctx = (struct ioring_ctx){ .uring = ring,
+                                .geo = geo,
+                                .sq_head = geo.sq_head,
+                                .cq_tail = geo.cq_tail,
+                                .owner = proc };
+    llist_init_head(&ctx->completed);
+    waitq_init(&ctx->wait);
+
+    proc->ioring = ctx;
+
+done:
+    return DO_STATUS(errno);
+}
+
+__DEFINE_LXSYSCALL2(int, ioring_enter, int, to_submit, int, min_complete)
+{
+    struct ioring_ctx* ctx = __current->ioring;
+    int nr = 0, errno = 0;
+
+    if (!ctx) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    if (to_submit > 0) {
+        errno = __ioring_submit(ctx, to_submit, &nr);
+    }
+
+    if (!errno && min_complete >= 0) {
+        errno = __ioring_wait(ctx, min_complete);
+    }
+
+    // 已取走的请求即便失败也已消耗，两个下标总是写回
+    if (copy_to_user(&ctx->uring->sq_head, &ctx->sq_head, sizeof(u32_t)) ||
+        copy_to_user(&ctx->uring->cq_tail, &ctx->cq_tail, sizeof(u32_t))) {
+        errno = EFAULT;
+    }
+
+done:
+    if (errno && !nr) {
+        return DO_STATUS(errno);
+    }
+    return nr;
+}
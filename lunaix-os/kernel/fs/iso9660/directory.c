@@ -1,14 +1,22 @@
+#include <lunaix/block.h>
 #include <lunaix/dirent.h>
 #include <lunaix/fs.h>
 #include <lunaix/fs/iso9660.h>
 #include <lunaix/mm/cake.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/sched.h>
 #include <lunaix/spike.h>
 
 #include <klibc/string.h>
 
 extern struct cake_pile* drec_cache_pile;
 
+static u32_t
+__iso9660_drec_hashof(struct hlist_node* node)
+{
+    return container_of(node, struct iso_drecache, hash_list)->name.hash;
+}
+
 void
 iso9660_fill_drecache(struct iso_drecache* cache,
                       struct iso_drecord* drec,
@@ -37,6 +45,9 @@ iso9660_fill_drecache(struct iso_drecache* cache,
             case ISORR_TF:
                 i += isorr_parse_tf(cache, (void*)su_entry);
                 break;
+            case ISORR_ZF:
+                i += isorr_parse_zf(cache, (void*)su_entry);
+                break;
             case ISOSU_ST:
                 goto done;
             default:
@@ -54,9 +65,8 @@ done:
         l = (l + 1) ? l : drec->name.len;
         l = MIN(l, ISO9660_IDLEN - 1);
 
-        strncpy(cache->name_val, drec->name.content, l);
-        cache->name = HSTR(cache->name_val, l);
-        hstr_rehash(&cache->name, HSTR_FULL_HASH);
+        struct hstr hname = HSTR((const char*)drec->name.content, l);
+        hstr_intern(&cache->name, &hname);
     }
 }
 
@@ -78,6 +88,12 @@ iso9660_setup_dnode(struct v_dnode* dnode, struct v_inode* inode)
     int errno = 0;
     struct device* dev = dnode->super_block->dev;
     void* records = valloc(ISO9660_BLKSZ);
+
+    // 无法建立索引时，查找退回至逐个比较
+    int indexed = isoino->drec_index.buckets ||
+                  !rhtable_init(&isoino->drec_index,
+                                ISO9660_DIRIDX_BITS,
+                                __iso9660_drec_hashof);
     u32_t current_pos = -ISO9660_BLKSZ, max_pos = inode->fsize,
           blk = inode->lb_addr * ISO9660_BLKSZ, blk_offset = (u32_t)-1;
 
@@ -85,7 +101,8 @@ iso9660_setup_dnode(struct v_dnode* dnode, struct v_inode* inode)
     do {
         if (blk_offset >= ISO9660_BLKSZ - sizeof(struct iso_drecord)) {
             current_pos += ISO9660_BLKSZ;
-            errno = dev->read(dev, records, blk + current_pos, ISO9660_BLKSZ);
+            errno =
+              bcache_read(dev, records, blk + current_pos, ISO9660_BLKSZ);
             if (errno < 0) {
                 errno = EIO;
                 goto done;
@@ -109,8 +126,12 @@ iso9660_setup_dnode(struct v_dnode* dnode, struct v_inode* inode)
 
         iso9660_fill_drecache(cache, drec, mdu->len);
         llist_append(&isoino->drecaches, &cache->caches);
+        if (indexed) {
+            rhtable_add(&isoino->drec_index, &cache->hash_list);
+        }
     cont:
         blk_offset += mdu->len;
+        preempt_point();
     } while (current_pos + blk_offset < max_pos);
 
     dnode->data = &isoino->drecaches;
@@ -130,6 +151,17 @@ iso9660_dir_lookup(struct v_inode* this, struct v_dnode* dnode)
     struct iso_inode* isoino = this->data;
     struct iso_drecache *pos, *n;
 
+    if (isoino->drec_index.buckets) {
+        rhtable_hash_foreach(
+          &isoino->drec_index, dnode->name.hash, pos, n, hash_list)
+        {
+            if (HSTR_EQ(&dnode->name, &pos->name)) {
+                goto found;
+            }
+        }
+        return ENOENT;
+    }
+
     llist_for_each(pos, n, &isoino->drecaches, caches)
     {
         if (HSTR_EQ(&dnode->name, &pos->name)) {
@@ -163,18 +195,31 @@ __get_dtype(struct iso_drecache* pos)
 int
 iso9660_readdir(struct v_file* file, struct dir_context* dctx)
 {
-    struct llist_header* lead = file->dnode->data;
-    struct iso_drecache *pos, *n;
-    u32_t counter = dctx->index - 1;
+    struct llist_header *lead = file->dnode->data, *it = lead->next;
+    struct dir_cursor* cur = &file->dcur;
+    int i = 0;
+
+    // 目录记录在目录被打开期间保持不变，游标总是有效的。
+    // 下标只计可见的记录，因此不经由 vfs_dir_seek
+    if (cur->pos && cur->index <= dctx->index) {
+        it = cur->pos;
+        i = cur->index;
+    }
 
-    llist_for_each(pos, n, lead, caches)
-    {
-        if (counter == (u32_t)-1 && !(pos->flags & ISO_FHIDDEN)) {
-            dctx->read_complete_callback(
-              dctx, pos->name_val, pos->name.len, __get_dtype(pos));
-            return 1;
+    for (; it != lead; it = it->next) {
+        struct iso_drecache* pos = container_of(it, struct iso_drecache, caches);
+        if ((pos->flags & ISO_FHIDDEN) || i++ < dctx->index) {
+            continue;
         }
-        counter--;
+
+        cur->pos = it->next;
+        cur->index = i;
+
+        dctx->read_complete_callback(
+          dctx, pos->name.value, pos->name.len, __get_dtype(pos));
+        return 1;
     }
+
+    cur->pos = NULL;
     return 0;
 }
\ No newline at end of file
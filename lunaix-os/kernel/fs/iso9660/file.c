@@ -1,6 +1,5 @@
 #include <lunaix/fs.h>
 #include <lunaix/fs/iso9660.h>
-#include <lunaix/mm/valloc.h>
 #include <lunaix/spike.h>
 
 #include <klibc/string.h>
@@ -20,7 +19,7 @@ iso9660_close(struct v_file* file)
 }
 
 int
-iso9660_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+iso9660_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     // This read implementation handle both interleaved and non-interleaved
     // structuring
@@ -28,66 +27,99 @@ iso9660_read(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
     struct iso_inode* isoino = inode->data;
     struct device* bdev = inode->sb->dev;
 
-    len = MIN(fpos + len, inode->fsize);
-    if (len <= fpos) {
+    if (isoino->zf) {
+        return iso9660_zf_read(inode, buffer, len, fpos);
+    }
+
+    if (fpos >= inode->fsize) {
         return 0;
     }
 
-    len -= fpos;
+    len = MIN(len, inode->fsize - fpos);
 
     size_t fu_len = isoino->fu_size * ISO9660_BLKSZ;
-    // if fpos is not FU aligned, then we must do an extra read.
-    size_t fu_to_read =
-      ICEIL(len, fu_len) + (fpos > fu_len && (fpos % fu_len) != 0);
-    size_t sec = (fpos % fu_len) / ISO9660_BLKSZ;
-    size_t wd_start = fpos % ISO9660_BLKSZ,
-           wd_len = MIN(len, ISO9660_BLKSZ - wd_start), i = 0;
-
-    // how many blocks (file unit + gaps) before of our current read position
-    size_t true_offset = (fpos / fu_len);
-    true_offset = true_offset * (isoino->fu_size + isoino->gap_size);
-
-    void* rd_buffer = valloc(ISO9660_BLKSZ);
-
-    true_offset += sec + inode->lb_addr;
-
-    int errno = 0;
-    while (fu_to_read) {
-        for (; sec < isoino->fu_size && i < len; sec++) {
-            errno = bdev->read(
-              bdev, rd_buffer, true_offset * ISO9660_BLKSZ, ISO9660_BLKSZ);
-
-            if (errno < 0) {
-                errno = EIO;
-                goto done;
-            }
-
-            memcpy(buffer + i, rd_buffer + wd_start, wd_len);
-
-            i += wd_len;
-            true_offset++;
-            wd_start = 0;
-            wd_len = MIN(len - i, ISO9660_BLKSZ);
+    size_t stride = isoino->fu_size + isoino->gap_size;
+    foff_t base = (foff_t)inode->lb_addr * ISO9660_BLKSZ;
+    size_t i = 0;
+
+    // 每个文件单元（非交错时即整个文件）在介质上是连续的，
+    //  故以单元为单位直接读入目标缓冲区，由设备层合为一条多块的命令
+    while (i < len) {
+        foff_t pos = fpos + i, offset;
+        size_t rd_len;
+
+        if (!isoino->gap_size) {
+            // 非交错：整个文件即为一个连续的区段，无须按单元换算
+            offset = base + pos;
+            rd_len = len - i;
+        } else {
+            size_t in_fu = pos % fu_len;
+            offset = base + pos / fu_len * stride * ISO9660_BLKSZ + in_fu;
+            rd_len = MIN(len - i, fu_len - in_fu);
+        }
+
+        // 设备层对单次读取有长度上限，超出部分以短读返回
+        int errno = bdev->read(bdev, buffer + i, offset, rd_len);
+        if (errno < 0) {
+            return i ? (int)i : EIO;
         }
-        sec = 0;
-        fu_to_read--;
+
+        if (!errno) {
+            break;
+        }
+
+        i += errno;
+    }
+
+    return i;
+}
+
+int
+iso9660_read_page(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct iso_inode* isoino = inode->data;
+    struct device* bdev = inode->sb->dev;
+
+    if (isoino->zf || isoino->gap_size) {
+        return iso9660_read(inode, buffer, len, fpos);
+    }
+
+    if (fpos >= inode->fsize) {
+        return 0;
+    }
+
+    // 页对齐于扇区，故一页对应连续的两个扇区。末页读满整个扇区，
+    //  免去设备层对不足一个扇区的读取再做拆分；多出的部分由页缓存清零
+    size_t valid = MIN(len, inode->fsize - fpos);
+    size_t rd_len = MIN(ROUNDUP(valid, ISO9660_BLKSZ), len);
+    foff_t offset = (foff_t)inode->lb_addr * ISO9660_BLKSZ + fpos;
+    size_t i = 0;
+
+    while (i < rd_len) {
+        int errno = bdev->read(bdev, buffer + i, offset + i, rd_len - i);
+        if (errno < 0) {
+            return i ? (int)MIN(i, valid) : EIO;
+        }
+
+        if (!errno) {
+            break;
+        }
+
+        i += errno;
     }
-    errno = i;
 
-done:
-    vfree(rd_buffer);
-    return errno;
+    return MIN(i, valid);
 }
 
 int
-iso9660_write(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+iso9660_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     // TODO
     return ENOTSUP;
 }
 
 int
-iso9660_seek(struct v_inode* inode, size_t offset)
+iso9660_seek(struct v_inode* inode, foff_t offset)
 {
     // TODO
     return 0;
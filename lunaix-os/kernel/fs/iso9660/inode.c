@@ -1,4 +1,5 @@
 #include <klibc/string.h>
+#include <lunaix/block.h>
 #include <lunaix/fs.h>
 #include <lunaix/fs/iso9660.h>
 #include <lunaix/mm/cake.h>
@@ -14,7 +15,7 @@ static struct v_inode_ops iso_inode_ops = {
 
 static struct v_file_ops iso_file_ops = { .close = iso9660_close,
                                           .read = iso9660_read,
-                                          .read_page = iso9660_read,
+                                          .read_page = iso9660_read_page,
                                           .write = iso9660_write,
                                           .write_page = iso9660_write,
                                           .seek = iso9660_seek,
@@ -28,9 +29,16 @@ iso9660_inode_destruct(struct v_inode* inode)
     struct iso_drecache *pos, *n;
     llist_for_each(pos, n, &isoino->drecaches, caches)
     {
+        hstr_release(&pos->name);
         cake_release(drec_cache_pile, pos);
     }
 
+    if (isoino->drec_index.buckets) {
+        rhtable_free(&isoino->drec_index);
+    }
+
+    iso9660_zf_release(isoino);
+
     vfree(isoino);
 }
 
@@ -77,7 +85,7 @@ iso9660_fill_inode(struct v_inode* inode, struct iso_drecache* dir, int ino)
         struct iso_xattr* xattr = (struct iso_xattr*)valloc(ISO9660_BLKSZ);
         // Only bring in single FU, as we only care about the attributes.
         errno =
-          dev->read(dev, xattr, ISO9660_BLKSZ * inode->lb_addr, ISO9660_BLKSZ);
+          bcache_read(dev, xattr, ISO9660_BLKSZ * inode->lb_addr, ISO9660_BLKSZ);
         if (errno < 0) {
             return EIO;
         }
@@ -91,6 +99,13 @@ iso9660_fill_inode(struct v_inode* inode, struct iso_drecache* dir, int ino)
         vfree(xattr);
     }
 
+    // zisofs 仅用于非交错的普通文件
+    if (dir->zf_bshift && !dir->gap_size && !(dir->flags & ISO_FDIR)) {
+        if ((errno = iso9660_zf_setup(inode, dir))) {
+            return errno;
+        }
+    }
+
     inode->ctime = dir->ctime ? dir->ctime : inode->ctime;
     inode->mtime = dir->mtime ? dir->mtime : inode->mtime;
     inode->atime = dir->atime ? dir->atime : inode->atime;
@@ -27,7 +27,7 @@ iso9660_mount(struct v_superblock* vsb, struct v_dnode* mount_point)
     u32_t lba = 16;
     int errno = 0;
     do {
-        errno = dev->read(dev, vdesc, ISO9660_BLKSZ * lba, ISO9660_BLKSZ);
+        errno = bcache_read(dev, vdesc, ISO9660_BLKSZ * lba, ISO9660_BLKSZ);
         if (errno < 0) {
             errno = EIO;
             goto done;
@@ -69,7 +69,10 @@ iso9660_mount(struct v_superblock* vsb, struct v_dnode* mount_point)
     struct iso_drecache drecache;
     iso9660_fill_drecache(&drecache, dir, mdu->len);
 
-    if ((errno = iso9660_fill_inode(rootino, &drecache, 0)) < 0) {
+    errno = iso9660_fill_inode(rootino, &drecache, 0);
+    hstr_release(&drecache.name);
+
+    if (errno < 0) {
         vfree(isovsb);
         errno = EINVAL;
         goto done;
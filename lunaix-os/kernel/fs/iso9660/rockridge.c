@@ -1,4 +1,5 @@
 #include <lunaix/fs/iso9660.h>
+#include <lunaix/spike.h>
 
 int
 isorr_parse_px(struct iso_drecache* cache, void* px_start)
@@ -43,18 +44,34 @@ isorr_parse_nm(struct iso_drecache* cache, void* nm_start)
 {
     u32_t i = 0, adv = 0;
     struct isorr_nm* nm;
+    char name[ISO9660_IDLEN];
 
     do {
         nm = (struct isorr_nm*)(nm_start + adv);
         u32_t len_name = nm->header.length - sizeof(*nm);
-        memcpy(cache->name_val + i, nm->name, len_name);
+        len_name = MIN(len_name, ISO9660_IDLEN - 1 - i);
+        memcpy(name + i, nm->name, len_name);
         i += len_name;
         adv += nm->header.length;
     } while ((nm->flags & ISORR_NM_CONT) && i < ISO9660_IDLEN - 1);
 
-    cache->name_val[i] = 0;
-    cache->name = HSTR(cache->name_val, i);
-    hstr_rehash(&cache->name, HSTR_FULL_HASH);
+    // 同一映像中大量重复的名称只保留一份
+    struct hstr hname = HSTR(name, i);
+    hstr_intern(&cache->name, &hname);
 
     return adv;
-}
\ No newline at end of file
+}
+int
+isorr_parse_zf(struct iso_drecache* cache, void* zf_start)
+{
+    struct isorr_zf* zf = (struct isorr_zf*)zf_start;
+
+    // 未知的算法或块大小则保持原样，按未压缩的文件呈现
+    if (zf->algorithm == ISOZF_ALG_PZ && zf->bshift >= ISOZF_MIN_BSHIFT &&
+        zf->bshift <= ISOZF_MAX_BSHIFT) {
+        cache->zf_size = zf->size.le;
+        cache->zf_bshift = zf->bshift;
+    }
+
+    return zf->header.length;
+}
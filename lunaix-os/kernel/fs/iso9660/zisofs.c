@@ -0,0 +1,191 @@
+/**
+ * @file zisofs.c
+ * @brief zisofs 透明压缩文件的读取
+ *
+ * 文件内容按块（32K 至 128K）分别压缩。读取时按需解压所涉及的块：
+ *  请求恰好覆盖整块时直接解压至目标缓冲区（如页缓存的预读），
+ *  否则解压至每个文件独有的单块缓存，以供随后落在同一块内的页读取。
+ *
+ */
+#include <lib/inflate.h>
+#include <lunaix/block.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/iso9660.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+
+#include <klibc/string.h>
+
+LOG_MODULE("zisofs")
+
+static const u8_t zf_magic[8] = { 0x37, 0xe4, 0x53, 0x96,
+                                  0xc9, 0xdb, 0xd6, 0x07 };
+
+int
+iso9660_zf_setup(struct v_inode* inode, struct iso_drecache* dir)
+{
+    struct iso_inode* isoino = inode->data;
+    struct isozf_header hdr;
+
+    int errno = bcache_read(
+      inode->sb->dev, &hdr, inode->lb_addr * ISO9660_BLKSZ, sizeof(hdr));
+    if (errno < 0) {
+        return EIO;
+    }
+
+    if (memcmp(hdr.magic, zf_magic, sizeof(zf_magic)) ||
+        hdr.size != dir->zf_size || hdr.bshift != dir->zf_bshift ||
+        hdr.hdr_size * 4 < sizeof(hdr)) {
+        kprintf(KWARN "%s: bad header, treated as uncompressed\n",
+                dir->name.value);
+        return 0;
+    }
+
+    struct iso_zf* zf = vzalloc(sizeof(*zf));
+    if (!zf) {
+        return ENOMEM;
+    }
+
+    zf->bshift = hdr.bshift;
+    zf->ptr_table = hdr.hdr_size * 4;
+    zf->cached = (u32_t)-1;
+    mutex_init(&zf->lock);
+
+    isoino->zf = zf;
+    inode->fsize = hdr.size;
+
+    return 0;
+}
+
+void
+iso9660_zf_release(struct iso_inode* isoino)
+{
+    struct iso_zf* zf = isoino->zf;
+    if (!zf) {
+        return;
+    }
+
+    if (zf->cache) {
+        vfree(zf->cache);
+    }
+    vfree(zf);
+    isoino->zf = NULL;
+}
+
+static int
+__zf_read_raw(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        int errno = dev->read(dev, buf + i, offset + i, len - i);
+        if (errno <= 0) {
+            return EIO;
+        }
+        i += errno;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 解压第 blk 块至 dst，其长度为 dlen
+ *
+ */
+static int
+__zf_inflate(struct v_inode* inode, u32_t blk, void* dst, u32_t dlen)
+{
+    struct iso_zf* zf = ((struct iso_inode*)inode->data)->zf;
+    struct device* dev = inode->sb->dev;
+    foff_t base = (foff_t)inode->lb_addr * ISO9660_BLKSZ;
+    u32_t ptrs[2];
+
+    // 偏移表与文件头相邻，通常已在块缓存之中
+    int errno =
+      bcache_read(dev, ptrs, base + zf->ptr_table + blk * 4, sizeof(ptrs));
+    if (errno < 0) {
+        return EIO;
+    }
+
+    if (ptrs[1] < ptrs[0]) {
+        return EIO;
+    }
+
+    u32_t clen = ptrs[1] - ptrs[0];
+    if (!clen) {
+        memset(dst, 0, dlen);
+        return 0;
+    }
+
+    // 即使不可压缩，zlib 的膨胀也远小于一倍
+    if (clen > (2U << zf->bshift)) {
+        return EIO;
+    }
+
+    void* cbuf = valloc(clen);
+    if (!cbuf) {
+        return ENOMEM;
+    }
+
+    errno = __zf_read_raw(dev, cbuf, base + ptrs[0], clen);
+    if (!errno && inflate_zlib(dst, dlen, cbuf, clen) != (int)dlen) {
+        errno = EIO;
+    }
+
+    vfree(cbuf);
+    return errno;
+}
+
+int
+iso9660_zf_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct iso_zf* zf = ((struct iso_inode*)inode->data)->zf;
+    u32_t bsize = 1U << zf->bshift;
+    int errno = 0;
+    size_t i = 0;
+
+    if (fpos >= inode->fsize) {
+        return 0;
+    }
+
+    len = MIN(len, inode->fsize - fpos);
+
+    mutex_lock(&zf->lock);
+
+    while (i < len) {
+        foff_t pos = fpos + i;
+        u32_t blk = pos >> zf->bshift;
+        u32_t in_blk = pos & (bsize - 1);
+        u32_t blk_len = MIN(bsize, inode->fsize - blk * bsize);
+        u32_t n = MIN(len - i, blk_len - in_blk);
+
+        if (blk != zf->cached && !in_blk && n == blk_len) {
+            if ((errno = __zf_inflate(inode, blk, buffer + i, blk_len))) {
+                break;
+            }
+            i += n;
+            continue;
+        }
+
+        if (blk != zf->cached) {
+            if (!zf->cache && !(zf->cache = valloc(bsize))) {
+                errno = ENOMEM;
+                break;
+            }
+
+            zf->cached = (u32_t)-1;
+            if ((errno = __zf_inflate(inode, blk, zf->cache, blk_len))) {
+                break;
+            }
+            zf->cached = blk;
+        }
+
+        memcpy(buffer + i, zf->cache + in_blk, n);
+        i += n;
+    }
+
+    mutex_unlock(&zf->lock);
+
+    return i ? (int)i : errno;
+}
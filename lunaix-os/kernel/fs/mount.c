@@ -8,8 +8,35 @@
 
 LOG_MODULE("fs")
 
+#define MNT_HASH_BITS 6
+
 struct llist_header all_mnts = { .next = &all_mnts, .prev = &all_mnts };
 
+// 挂载表，免去在 submnts 中逐个比对
+static DECLARE_HASHTABLE(mnt_cache, 1 << MNT_HASH_BITS);
+
+static inline u32_t
+__mnt_hash(struct v_mount* parent, struct v_dnode* dnode)
+{
+    return hash_fmix32((u32_t)parent ^ hash_fmix32((u32_t)dnode));
+}
+
+struct v_mount*
+vfs_mount_lookup(struct v_mount* parent, struct v_dnode* dnode)
+{
+    struct v_mount *pos, *n;
+    u32_t hash = __mnt_hash(parent, dnode);
+
+    hashtable_hash_foreach(mnt_cache, hash, pos, n, hash_list)
+    {
+        if (pos->parent == parent && pos->mnt_point == dnode) {
+            return pos;
+        }
+    }
+
+    return NULL;
+}
+
 struct v_mount*
 vfs_create_mount(struct v_mount* parent, struct v_dnode* mnt_point)
 {
@@ -33,6 +60,9 @@ vfs_create_mount(struct v_mount* parent, struct v_dnode* mnt_point)
         mutex_unlock(&mnt->parent->lock);
     }
 
+    hashtable_hash_in(
+      mnt_cache, &mnt->hash_list, __mnt_hash(parent, mnt_point));
+
     atomic_fetch_add(&mnt_point->ref_count, 1);
 
     return mnt;
@@ -49,19 +79,18 @@ __vfs_do_unmount(struct v_mount* mnt)
     }
 
     llist_delete(&mnt->list);
-    llist_delete(&mnt->sibmnts);
+    hlist_delete(&mnt->hash_list);
 
-    // detached the inodes from cache, and let lru policy to recycle them
-    for (size_t i = 0; i < VFS_HASHTABLE_SIZE; i++) {
-        struct hbucket* bucket = &sb->i_cache[i];
-        if (!bucket) {
-            continue;
-        }
-        bucket->head->pprev = 0;
-    }
+    if (mnt->parent) {
+        mutex_lock(&mnt->parent->lock);
+        llist_delete(&mnt->sibmnts);
+        mutex_unlock(&mnt->parent->lock);
 
-    mnt_chillax(mnt->parent);
+        mnt_chillax(mnt->parent);
+    }
 
+    // detached the inodes from cache (done by vfs_sb_free), and let lru policy
+    // to recycle them
     vfs_sb_free(sb);
     vfs_d_free(mnt->mnt_point);
     vfree(mnt);
@@ -72,17 +101,13 @@ __vfs_do_unmount(struct v_mount* mnt)
 void
 mnt_mkbusy(struct v_mount* mnt)
 {
-    mutex_lock(&mnt->lock);
-    mnt->busy_counter++;
-    mutex_unlock(&mnt->lock);
+    atomic_fetch_add(&mnt->busy_counter, 1);
 }
 
 void
 mnt_chillax(struct v_mount* mnt)
 {
-    mutex_lock(&mnt->lock);
-    mnt->busy_counter--;
-    mutex_unlock(&mnt->lock);
+    atomic_fetch_sub(&mnt->busy_counter, 1);
 }
 
 int
@@ -145,7 +170,7 @@ vfs_mount_at(const char* fs_name,
         return ENODEV;
     }
 
-    if (fs->types == FSTYPE_ROFS) {
+    if ((fs->types & FSTYPE_ROFS)) {
         options |= MNT_RO;
     }
 
@@ -198,15 +223,17 @@ vfs_unmount_at(struct v_dnode* mnt_point)
         return EINVAL;
     }
 
-    if (sb->root != mnt_point) {
+    struct v_mount* mnt = mnt_point->mnt;
+    if (sb->root != mnt_point || !mnt ||
+        vfs_mount_lookup(mnt->parent, mnt_point) != mnt) {
         return EINVAL;
     }
 
-    if (mnt_point->mnt->busy_counter) {
+    if (atomic_load(&mnt->busy_counter)) {
         return EBUSY;
     }
 
-    if (!(errno = __vfs_do_unmount(mnt_point->mnt))) {
+    if (!(errno = __vfs_do_unmount(mnt))) {
         atomic_fetch_sub(&mnt_point->ref_count, 1);
     }
 
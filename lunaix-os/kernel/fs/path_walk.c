@@ -6,6 +6,13 @@
 
 #define VFS_SYMLINK_DEPTH 16
 
+/*
+    无锁的快速查找：只在目录项缓存中查找，不持有任何 dnode 的锁。每一步都以
+    父目录的 seq 验证查找期间无人增删其子项；遇到缓存未命中、符号链接或并发的
+    变更时放弃（EAGAIN），由 vfs_walk 退回至加锁的查找。仅供内部使用。
+*/
+#define VFS_WALK_FAST 0x100
+
 extern struct lru_zone *dnode_lru, *inode_lru;
 
 int
@@ -85,6 +92,11 @@ __vfs_walk(struct v_dnode* start,
             !(walk_options & VFS_WALK_NOFOLLOW)) {
             const char* link;
 
+            if ((walk_options & VFS_WALK_FAST)) {
+                errno = EAGAIN;
+                goto error;
+            }
+
             lock_inode(current_inode);
             if ((errno =
                    current_inode->ops->read_symlink(current_inode, &link))) {
@@ -111,11 +123,45 @@ __vfs_walk(struct v_dnode* start,
             current_inode = dnode->inode;
         }
 
+        if ((walk_options & VFS_WALK_FAST)) {
+            u32_t seq = vfs_dnode_seq_read(current_level);
+
+            dnode = (seq & 1) ? NULL : vfs_dcache_lookup(current_level, &name);
+            if (!dnode || !vfs_dnode_seq_ok(current_level, seq)) {
+                errno = EAGAIN;
+                goto error;
+            }
+
+            if (!dnode->inode) {
+                errno = ENOENT;
+                goto error;
+            }
+            goto next;
+        }
+
         lock_dnode(current_level);
 
         dnode = vfs_dcache_lookup(current_level, &name);
 
-        if (!dnode) {
+        if (dnode && !dnode->inode) {
+            // 负目录项：已知不存在，无需再询问文件系统
+            errno = ENOENT;
+
+            if ((walk_options & VFS_WALK_MKPARENT)) {
+                lock_inode(current_inode);
+                errno = ENOTSUP;
+                if (current_inode->ops->mkdir &&
+                    !(errno = current_inode->ops->mkdir(current_inode, dnode))) {
+                    vfs_dcache_revive(dnode);
+                }
+                unlock_inode(current_inode);
+            }
+
+            if (errno) {
+                unlock_dnode(current_level);
+                goto error;
+            }
+        } else if (!dnode) {
             dnode = vfs_d_alloc(current_level, &name);
 
             if (!dnode) {
@@ -138,6 +184,11 @@ __vfs_walk(struct v_dnode* start,
             vfs_dcache_add(current_level, dnode);
             unlock_inode(current_inode);
 
+            if (errno == ENOENT && vfs_dcache_negate(dnode)) {
+                unlock_dnode(current_level);
+                goto error;
+            }
+
             if (errno) {
                 unlock_dnode(current_level);
                 goto cleanup;
@@ -146,6 +197,7 @@ __vfs_walk(struct v_dnode* start,
 
         unlock_dnode(current_level);
 
+    next:
         j = 0;
         current_level = dnode;
     cont:
@@ -173,8 +225,23 @@ vfs_walk(struct v_dnode* start,
     // symlink
     char* name_buffer = valloc(2048);
 
-    int errno =
-      __vfs_walk(start, path, dentry, component, options, 0, name_buffer);
+    int errno = EAGAIN;
+
+    // 绝大多数查找只读且命中缓存，先试无锁的查找
+    if (!(options & VFS_WALK_MKPARENT)) {
+        errno = __vfs_walk(start,
+                           path,
+                           dentry,
+                           component,
+                           options | VFS_WALK_FAST,
+                           0,
+                           name_buffer);
+    }
+
+    if (errno == EAGAIN) {
+        errno =
+          __vfs_walk(start, path, dentry, component, options, 0, name_buffer);
+    }
 
     vfree(name_buffer);
     return errno;
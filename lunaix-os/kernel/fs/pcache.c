@@ -1,67 +1,322 @@
+#include <hal/cpu.h>
 #include <klibc/string.h>
-#include <lunaix/ds/btrie.h>
+#include <lunaix/ds/radix.h>
+#include <lunaix/foptions.h>
 #include <lunaix/fs.h>
+#include <lunaix/fs/twifs.h>
 #include <lunaix/mm/page.h>
 #include <lunaix/mm/pmm.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/spike.h>
+#include <lunaix/trace.h>
 
 #define PCACHE_DIRTY 0x1
+#define PCACHE_REFERENCED 0x2
+#define PCACHE_ACTIVE 0x4
 
-static struct lru_zone* pcache_zone;
+// 页缓存至多占用可管理内存的百分比，单个文件至多占用其中的百分比
+#define PCACHE_MAX_RATIO 50
+#define PCACHE_INODE_RATIO 50
+
+// 页索引树上的标记：脏页，以及正在回写的页
+#define PCACHE_TAG_DIRTY 0
+#define PCACHE_TAG_WRITEBACK 1
+
+// 按标记批量查找时每批的页数
+#define PCACHE_GANG 16
+
+// 预读窗口的上限（页），一次预读即为一次底层读取，受块设备单次传输的上限所限
+#define PCACHE_RA_MAX 16
+
+// 页索引树以页号为键，u32_t 的页号可覆盖至 16TiB 的文件偏移
+#define PCACHE_INDEX(fpos) ((u32_t)((fpos) >> PG_SIZE_BITS))
+#define PCACHE_ALIGN(fpos) ((fpos) & ~(foff_t)(PG_SIZE - 1))
+
+extern struct lru_zone* inode_lru;
+
+/*
+    所有文件的缓存页共用两条LRU链表。新页归入非活跃链表，在其上再次被访问
+    才提升至活跃链表；活跃链表长于非活跃链表时，其尾部的页降回非活跃链表。
+    如此，一次性的大量顺序读取只会冲刷非活跃链表，而不会挤走常用的页。
+*/
+static struct lru_zone *pcache_inactive, *pcache_active;
+static u32_t nr_pages, max_pages, max_inode_pages;
+
+// 所有含脏页的缓存，按首次变脏的先后排列，供回写线程轮流处理
+static DEFINE_LLIST(dirty_caches);
+static u32_t nr_dirty;
+
+static int
+__pcache_evictable(struct pcache_pg* page)
+{
+    if (page->holder->pinned) {
+        return 0;
+    }
+
+    if (radix_tag_get(&page->holder->tree,
+                      PCACHE_INDEX(page->fpos),
+                      PCACHE_TAG_WRITEBACK)) {
+        return 0;
+    }
+
+    // 仍被映射至用户空间（mmap）的页不可驱逐
+    struct pp_struct* pp = pmm_query(vmm_v2p(page->pg));
+    return !pp || pp->ref_counts <= 1;
+}
 
 static int
 __pcache_try_evict(struct lru_node* obj)
 {
     struct pcache_pg* page = container_of(obj, struct pcache_pg, lru);
+
+    // 所属文件正被读写时不可驱逐（回收线程可能在其他进程持锁挂起期间运行）
+    struct v_inode* master = page->holder->master;
+    if (master && mutex_on_hold(&master->lock)) {
+        return 0;
+    }
+
+    if (!__pcache_evictable(page)) {
+        return 0;
+    }
+
     pcache_invalidate(page->holder, page);
     return 1;
 }
 
+/**
+ * @brief 活跃链表的“驱逐”即降级：移入非活跃链表，须再经两次访问才能回来
+ *
+ */
+static int
+__pcache_try_demote(struct lru_node* obj)
+{
+    struct pcache_pg* page = container_of(obj, struct pcache_pg, lru);
+
+    page->flags &= ~(PCACHE_ACTIVE | PCACHE_REFERENCED);
+    lru_use_one(pcache_inactive, &page->lru);
+    return 1;
+}
+
+static inline struct lru_zone*
+__pcache_lru_of(struct pcache_pg* page)
+{
+    return (page->flags & PCACHE_ACTIVE) ? pcache_active : pcache_inactive;
+}
+
+static void
+__pcache_touch(struct pcache_pg* page)
+{
+    if ((page->flags & PCACHE_ACTIVE)) {
+        lru_use_one(pcache_active, &page->lru);
+        return;
+    }
+
+    if (!(page->flags & PCACHE_REFERENCED)) {
+        page->flags |= PCACHE_REFERENCED;
+        lru_use_one(pcache_inactive, &page->lru);
+        return;
+    }
+
+    lru_remove(pcache_inactive, &page->lru);
+    page->flags = (page->flags & ~PCACHE_REFERENCED) | PCACHE_ACTIVE;
+    lru_use_one(pcache_active, &page->lru);
+
+    if (pcache_active->objects > pcache_inactive->objects) {
+        lru_evict_n(pcache_active, 1);
+    }
+}
+
+/**
+ * @brief 自非活跃链表驱逐一页，其上无可驱逐者时先自活跃链表降级一批
+ *
+ */
+static void
+__pcache_shrink()
+{
+    if (lru_evict_n(pcache_inactive, 1)) {
+        return;
+    }
+
+    lru_evict_n(pcache_active, PCACHE_RA_MAX);
+    lru_evict_n(pcache_inactive, 1);
+}
+
+/**
+ * @brief 文件的缓存页过多时，驱逐它自己最早载入的一页。调用者须持有该文件的锁
+ *
+ */
+static void
+__pcache_evict_own(struct pcache* pcache)
+{
+    // 最近载入的若干页可能正被预读所使用，不予考虑
+    u32_t scan = pcache->n_pages - PCACHE_RA_MAX;
+    struct pcache_pg *pos, *n;
+
+    llist_for_each(pos, n, &pcache->pages, pg_list)
+    {
+        if (!scan--) {
+            break;
+        }
+
+        if (__pcache_evictable(pos)) {
+            lru_remove(__pcache_lru_of(pos), &pos->lru);
+            pcache_invalidate(pcache, pos);
+            return;
+        }
+    }
+}
+
+void
+pcache_zone_init()
+{
+    size_t managed = 0;
+    for (int i = 0; i < PM_NR_ZONES; i++) {
+        managed += pmm_zone(i)->managed;
+    }
+
+    max_pages = managed * PCACHE_MAX_RATIO / 100;
+    max_inode_pages = max_pages * PCACHE_INODE_RATIO / 100;
+    max_inode_pages = MAX(max_inode_pages, PCACHE_RA_MAX * 2);
+
+    pcache_inactive = lru_new_zone(__pcache_try_evict);
+    pcache_active = lru_new_zone(__pcache_try_demote);
+}
+
+static void
+__pcache_rd_stat(struct twimap* map)
+{
+    twimap_printf(map,
+                  "%u %u %u %u %u\n",
+                  nr_pages,
+                  max_pages,
+                  pcache_active->objects,
+                  pcache_inactive->objects,
+                  nr_dirty);
+}
+
+void
+pcache_get_stat(u32_t* pages, u32_t* max, u32_t* dirty)
+{
+    *pages = nr_pages;
+    *max = max_pages;
+    *dirty = nr_dirty;
+}
+
+void
+pcache_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "pcache_stat");
+    map->read = __pcache_rd_stat;
+}
+
+/**
+ * @brief 缓存页需要按页对齐，以便可以直接映射至用户空间（mmap）。
+ *
+ */
+static void*
+__pcache_alloc_frame()
+{
+    uintptr_t pa = pmm_alloc_page(KERNEL_PID, 0);
+    if (!pa) {
+        return NULL;
+    }
+
+    void* pg = vmm_vmap(pa, PG_SIZE, PG_PREM_RW);
+
+    // 此后该页的引用由内核映射持有
+    pmm_free_page(KERNEL_PID, pa);
+    return pg;
+}
+
+static void
+__pcache_free_frame(void* pg)
+{
+    vmm_vunmap((uintptr_t)pg, PG_SIZE);
+}
+
 void
 pcache_init(struct pcache* pcache)
 {
-    btrie_init(&pcache->tree, PG_SIZE_BITS);
-    llist_init_head(&pcache->dirty);
+    radix_init(&pcache->tree, 0);
     llist_init_head(&pcache->pages);
-    pcache_zone = lru_new_zone(__pcache_try_evict);
+    llist_init_head(&pcache->dirty_link);
+    waitq_init(&pcache->wb_wait);
+}
+
+static void
+__pcache_clear_dirty(struct pcache* pcache, struct pcache_pg* page)
+{
+    page->flags &= ~PCACHE_DIRTY;
+    radix_tag_clear(&pcache->tree, PCACHE_INDEX(page->fpos), PCACHE_TAG_DIRTY);
+
+    nr_dirty--;
+    if (!--pcache->n_dirty) {
+        llist_delete(&pcache->dirty_link);
+    }
 }
 
 void
 pcache_release_page(struct pcache* pcache, struct pcache_pg* page)
 {
-    vfree(page->pg);
+    // 回写失败的脏页也只得丢弃
+    if (page->flags & PCACHE_DIRTY) {
+        __pcache_clear_dirty(pcache, page);
+    }
+
+    radix_remove(&pcache->tree, PCACHE_INDEX(page->fpos));
+    __pcache_free_frame(page->pg);
 
     llist_delete(&page->pg_list);
 
     vfree(page);
 
+    nr_pages--;
     pcache->n_pages--;
+    if (pcache->master) {
+        pcache->master->sb->pc_pages--;
+    }
 }
 
 struct pcache_pg*
 pcache_new_page(struct pcache* pcache, u32_t index)
 {
+    if (pcache->pinned) {
+        // 无处可写回，只能驱逐别的文件的页
+        if (nr_pages >= max_pages) {
+            __pcache_shrink();
+        }
+    } else if (pcache->n_pages >= max_inode_pages) {
+        __pcache_evict_own(pcache);
+    } else if (nr_pages >= max_pages) {
+        __pcache_shrink();
+    }
+
     struct pcache_pg* ppg = vzalloc(sizeof(struct pcache_pg));
-    void* pg = valloc(PG_SIZE);
+    void* pg = __pcache_alloc_frame();
 
     if (!ppg || !pg) {
-        lru_evict_one(pcache_zone);
+        __pcache_shrink();
         if (!ppg && !(ppg = vzalloc(sizeof(struct pcache_pg)))) {
             return NULL;
         }
 
-        if (!pg && !(pg = valloc(PG_SIZE))) {
+        if (!pg && !(pg = __pcache_alloc_frame())) {
+            vfree(ppg);
             return NULL;
         }
     }
 
+    if (radix_set(&pcache->tree, index, ppg)) {
+        __pcache_free_frame(pg);
+        vfree(ppg);
+        return NULL;
+    }
+
     ppg->pg = pg;
     ppg->holder = pcache;
 
     llist_append(&pcache->pages, &ppg->pg_list);
-    btrie_set(&pcache->tree, index, ppg);
 
     return ppg;
 }
@@ -69,85 +324,295 @@ pcache_new_page(struct pcache* pcache, u32_t index)
 void
 pcache_set_dirty(struct pcache* pcache, struct pcache_pg* pg)
 {
+    if (pcache->pinned) {
+        return;
+    }
+
     if (!(pg->flags & PCACHE_DIRTY)) {
+        if (!pcache->n_dirty) {
+            llist_append(&dirty_caches, &pcache->dirty_link);
+        }
+
         pg->flags |= PCACHE_DIRTY;
+        pg->dirtied = clock_systime();
         pcache->n_dirty++;
-        llist_append(&pcache->dirty, &pg->dirty_list);
+        nr_dirty++;
+        radix_tag_set(&pcache->tree, PCACHE_INDEX(pg->fpos), PCACHE_TAG_DIRTY);
     }
 }
 
-int
-pcache_get_page(struct pcache* pcache,
-                u32_t index,
-                u32_t* offset,
-                struct pcache_pg** page)
+static inline int
+__pcache_over_quota(struct pcache* pcache)
+{
+    struct v_superblock* sb = pcache->master ? pcache->master->sb : NULL;
+    return sb && sb->pc_quota && sb->pc_pages >= sb->pc_quota;
+}
+
+static int
+__pcache_get_page(struct pcache* pcache,
+                  foff_t fpos,
+                  u32_t* offset,
+                  struct pcache_pg** page,
+                  int touch)
 {
-    struct pcache_pg* pg = btrie_get(&pcache->tree, index);
+    u32_t index = PCACHE_INDEX(fpos);
+    struct pcache_pg* pg = radix_get(&pcache->tree, index);
     int is_new = 0;
-    u32_t mask = ((1 << pcache->tree.truncated) - 1);
-    *offset = index & mask;
-    if (!pg && (pg = pcache_new_page(pcache, index))) {
-        pg->fpos = index & ~mask;
+    *offset = fpos & (PG_SIZE - 1);
+
+    tracepoint(pg ? TP_PCACHE_HIT : TP_PCACHE_MISS,
+               pcache->master ? pcache->master->id : 0,
+               index,
+               0);
+    if (!pg && __pcache_over_quota(pcache)) {
+        // 留给调用者区分于内存不足
+    } else if (!pg && (pg = pcache_new_page(pcache, index))) {
+        pg->fpos = PCACHE_ALIGN(fpos);
+        nr_pages++;
         pcache->n_pages++;
+        if (pcache->master) {
+            pcache->master->sb->pc_pages++;
+        }
+        if (!pcache->pinned) {
+            lru_use_one(pcache_inactive, &pg->lru);
+        }
         is_new = 1;
+    } else if (pg && touch && !pcache->pinned) {
+        __pcache_touch(pg);
     }
-    if (pg)
-        lru_use_one(pcache_zone, &pg->lru);
     *page = pg;
     return is_new;
 }
 
 int
-pcache_write(struct v_inode* inode, void* data, u32_t len, u32_t fpos)
+pcache_get_page(struct pcache* pcache,
+                foff_t fpos,
+                u32_t* offset,
+                struct pcache_pg** page)
+{
+    return __pcache_get_page(pcache, fpos, offset, page, 1);
+}
+
+static int
+__pcache_fill(struct v_inode* inode, struct pcache_pg* pg);
+
+/**
+ * @brief 文件增长后，原末尾所在的页中 len 之后的部分（已被清零）亦成为文件的
+ * 内容
+ *
+ */
+static void
+__pcache_extend(struct v_inode* inode, foff_t old_size)
+{
+    struct pcache_pg* pg =
+      radix_get(&inode->pg_cache->tree, PCACHE_INDEX(old_size));
+    if (pg && pg->fpos + pg->len == old_size) {
+        pg->len = MIN(PG_SIZE, inode->fsize - pg->fpos);
+    }
+}
+
+int
+pcache_write(struct v_inode* inode, void* data, u32_t len, foff_t fpos)
 {
     u32_t pg_off, buf_off = 0;
+    foff_t old_size = inode->fsize;
     struct pcache* pcache = inode->pg_cache;
     struct pcache_pg* pg;
+    int errno = 0;
 
     while (buf_off < len) {
-        pcache_get_page(pcache, fpos, &pg_off, &pg);
+        int is_new = pcache_get_page(pcache, fpos, &pg_off, &pg);
         if (!pg) {
-            return ENOMEM;
+            errno = __pcache_over_quota(pcache) ? ENOSPC : ENOMEM;
+            break;
         }
 
         u32_t wr_bytes = MIN(PG_SIZE - pg_off, len - buf_off);
+
+        // 只写入一部分的新页，其余部分须先自文件读入
+        if (is_new && wr_bytes < PG_SIZE &&
+            (errno = __pcache_fill(inode, pg)) < 0) {
+            pg->len = 0;
+            break;
+        }
+
         memcpy(pg->pg + pg_off, (data + buf_off), wr_bytes);
 
         pcache_set_dirty(pcache, pg);
 
-        pg->len = pg_off + wr_bytes;
+        pg->len = MAX(pg->len, pg_off + wr_bytes);
         buf_off += wr_bytes;
         fpos += wr_bytes;
     }
 
-    return buf_off;
+    if (fpos > inode->fsize && buf_off) {
+        inode->fsize = fpos;
+        if (old_size % PG_SIZE) {
+            __pcache_extend(inode, old_size);
+        }
+    }
+
+    pcache_balance_dirty(inode);
+
+    return buf_off ? (int)buf_off : (errno < 0 ? errno : 0);
+}
+
+static int
+__pcache_fill(struct v_inode* inode, struct pcache_pg* pg)
+{
+    int errno =
+      inode->default_fops->read_page(inode, pg->pg, PG_SIZE, pg->fpos);
+    if (errno >= 0) {
+        // 文件末尾之后的部分可能会被映射至用户空间，需清零
+        memset(pg->pg + errno, 0, PG_SIZE - errno);
+        pg->len = errno;
+    }
+    return errno;
+}
+
+struct pcache_pg*
+pcache_lookup(struct pcache* pcache, foff_t fpos)
+{
+    return radix_get(&pcache->tree, PCACHE_INDEX(fpos));
 }
 
 int
-pcache_read(struct v_inode* inode, void* data, u32_t len, u32_t fpos)
+pcache_get_filled(struct v_inode* inode, foff_t fpos, struct pcache_pg** page)
+{
+    u32_t pg_off;
+    struct pcache_pg* pg;
+    int errno = 0;
+
+    if (pcache_get_page(inode->pg_cache, fpos, &pg_off, &pg)) {
+        if (!pg) {
+            return ENOMEM;
+        }
+        if ((errno = __pcache_fill(inode, pg)) < 0) {
+            pg->len = 0;
+            return errno;
+        }
+    }
+
+    *page = pg;
+    return pg ? 0 : ENOMEM;
+}
+
+static void
+__pcache_load(struct pcache_pg* pg, void* src, u32_t len)
+{
+    memcpy(pg->pg, src, len);
+    memset(pg->pg + len, 0, PG_SIZE - len);
+    pg->len = len;
+}
+
+/**
+ * @brief 填充缺失的页 pg，并以同一次读取填充其后至多 window - 1 个缺失的页
+ *
+ * @return int 读入 pg 的字节数，或错误码
+ */
+static int
+__pcache_fill_ahead(struct v_inode* inode, struct pcache_pg* pg, u32_t window)
+{
+    struct pcache* pcache = inode->pg_cache;
+    u32_t n = 1;
+
+    // 只有由设备支撑的文件系统才值得预读，且预读止于第一个已缓存的页
+    if (inode->sb->dev && !pcache->pinned) {
+        while (n < window && pg->fpos + n * PG_SIZE < inode->fsize &&
+               !radix_get(&pcache->tree, PCACHE_INDEX(pg->fpos) + n)) {
+            n++;
+        }
+    }
+
+    void* buf;
+    if (n == 1 || !(buf = valloc(n * PG_SIZE))) {
+        return __pcache_fill(inode, pg);
+    }
+
+    int errno = inode->default_fops->read(inode, buf, n * PG_SIZE, pg->fpos);
+    if (errno < 0) {
+        goto done;
+    }
+
+    u32_t got = errno;
+    __pcache_load(pg, buf, MIN(got, PG_SIZE));
+
+    for (u32_t i = 1; i * PG_SIZE < got; i++) {
+        struct pcache_pg* ahead;
+        u32_t off;
+
+        foff_t fpos = pg->fpos + i * PG_SIZE;
+        if (!__pcache_get_page(pcache, fpos, &off, &ahead, 0)) {
+            // 已被缓存（或无法分配），不予覆盖
+            if (!ahead) {
+                break;
+            }
+            continue;
+        }
+
+        u32_t off_buf = i * PG_SIZE;
+        __pcache_load(ahead, buf + off_buf, MIN(got - off_buf, PG_SIZE));
+    }
+
+    errno = MIN(got, PG_SIZE);
+
+done:
+    vfree(buf);
+    return errno;
+}
+
+int
+pcache_read(struct v_inode* inode,
+            void* data,
+            u32_t len,
+            foff_t fpos,
+            struct pcache_ra* ra)
 {
     u32_t pg_off, buf_off = 0, new_pg = 0;
     int errno = 0;
     struct pcache* pcache = inode->pg_cache;
     struct pcache_pg* pg;
 
+    // 顺序读取时，每次缺页都使窗口加倍；否则视为随机访问，不预读。
+    // 声明了访问模式的文件则分别总是以最大的窗口预读，或从不预读
+    u32_t advice = ra ? ra->advice : POSIX_FADV_NORMAL;
+    int sequential = ra && advice != POSIX_FADV_RANDOM &&
+                     (ra->next == fpos || advice == POSIX_FADV_SEQUENTIAL);
+    if (ra && !sequential) {
+        ra->window = 0;
+    }
+
+    // 只用一次的数据（如批量复制）：读完的页随即丢弃，不挤占常用的页
+    int noreuse = advice == POSIX_FADV_NOREUSE;
+
+    // 顺序地分多次读取同一页只算作一次访问，以免其被误认作常用的页
+    u32_t last_pg = sequential && fpos ? PCACHE_INDEX(fpos - 1) : (u32_t)-1;
+
     while (buf_off < len) {
-        if (pcache_get_page(pcache, fpos, &pg_off, &pg)) {
+        int touch = PCACHE_INDEX(fpos) != last_pg && !noreuse;
+        int is_new = __pcache_get_page(pcache, fpos, &pg_off, &pg, touch);
 
-            if (!pg) {
-                return ENOMEM;
-            }
+        if (!pg) {
+            return ENOMEM;
+        }
 
+        if (is_new) {
             // Filling up the page
-            errno =
-              inode->default_fops->read_page(inode, pg->pg, PG_SIZE, pg->fpos);
+            if (sequential && advice == POSIX_FADV_SEQUENTIAL) {
+                ra->window = PCACHE_RA_MAX;
+                errno = __pcache_fill_ahead(inode, pg, ra->window);
+            } else if (sequential) {
+                ra->window = MIN(MAX(ra->window * 2, 2), PCACHE_RA_MAX);
+                errno = __pcache_fill_ahead(inode, pg, ra->window);
+            } else {
+                errno = __pcache_fill(inode, pg);
+            }
             if (errno >= 0 && errno < PG_SIZE) {
                 // EOF
                 len = MIN(len, buf_off + errno);
             } else if (errno < 0) {
                 break;
             }
-            pg->len = errno;
         }
         u32_t rd_bytes = MIN(pg->len - pg_off, len - buf_off);
 
@@ -158,59 +623,395 @@ pcache_read(struct v_inode* inode, void* data, u32_t len, u32_t fpos)
 
         buf_off += rd_bytes;
         fpos += rd_bytes;
+
+        if (noreuse && pg_off + rd_bytes == pg->len &&
+            !(pg->flags & PCACHE_DIRTY) && __pcache_evictable(pg)) {
+            lru_remove(__pcache_lru_of(pg), &pg->lru);
+            pcache_release_page(pcache, pg);
+        }
+    }
+
+    if (ra) {
+        ra->next = fpos;
     }
 
     return errno < 0 ? errno : buf_off;
 }
 
+static void
+__pcache_wait_writeback(struct pcache* pcache, foff_t start, foff_t end);
+
 void
 pcache_release(struct pcache* pcache)
 {
+    // 异步回写的完成回调仍会访问这些页
+    __pcache_wait_writeback(pcache, 0, (foff_t)-1);
+
+    if (pcache->n_dirty) {
+        nr_dirty -= pcache->n_dirty;
+        llist_delete(&pcache->dirty_link);
+    }
+
     struct pcache_pg *pos, *n;
     llist_for_each(pos, n, &pcache->pages, pg_list)
     {
-        lru_remove(pcache_zone, &pos->lru);
+        lru_remove(__pcache_lru_of(pos), &pos->lru);
+        __pcache_free_frame(pos->pg);
         vfree(pos);
+        nr_pages--;
+    }
+
+    if (pcache->master) {
+        pcache->master->sb->pc_pages -= pcache->n_pages;
     }
+    pcache->n_pages = 0;
 
-    btrie_release(&pcache->tree);
+    radix_release(&pcache->tree);
+}
+
+/**
+ * @brief 等待 [start, end] 范围内正在回写的页全部完成
+ *
+ */
+static void
+__pcache_wait_writeback(struct pcache* pcache, foff_t start, foff_t end)
+{
+    struct pcache_pg* page;
+
+    while (1) {
+        // 完成回调可能在中断中执行，检查与等待之间不得错过唤醒
+        cpu_disable_interrupt();
+
+        if (!radix_gang_lookup(&pcache->tree,
+                               (void**)&page,
+                               PCACHE_INDEX(start),
+                               1,
+                               PCACHE_TAG_WRITEBACK) ||
+            page->fpos > end) {
+            break;
+        }
+
+        pwait(&pcache->wb_wait);
+    }
 }
 
 int
 pcache_commit(struct v_inode* inode, struct pcache_pg* page)
 {
     if (!(page->flags & PCACHE_DIRTY)) {
-        return;
+        return 0;
     }
 
+    struct pcache* pcache = inode->pg_cache;
+
+    // 同一页的两次写入不可同时在途，否则无法保证落盘的先后
+    __pcache_wait_writeback(pcache, page->fpos, page->fpos);
+
+    radix_tag_set(
+      &pcache->tree, PCACHE_INDEX(page->fpos), PCACHE_TAG_WRITEBACK);
+
     int errno =
       inode->default_fops->write_page(inode, page->pg, PG_SIZE, page->fpos);
 
-    if (!errno) {
-        page->flags &= ~PCACHE_DIRTY;
-        llist_delete(&page->dirty_list);
-        inode->pg_cache->n_dirty--;
+    radix_tag_clear(
+      &pcache->tree, PCACHE_INDEX(page->fpos), PCACHE_TAG_WRITEBACK);
+    pwake_all(&pcache->wb_wait);
+
+    // write_page 返回写入的字节数
+    if (errno >= 0) {
+        __pcache_clear_dirty(pcache, page);
+        errno = 0;
+    } else {
+        pcache->wb_error = errno;
+    }
+
+    return errno;
+}
+
+struct pcache_wb
+{
+    struct dev_iocb iocb;
+    struct pcache_pg* page;
+};
+
+static void
+__pcache_wb_done(struct dev_iocb* iocb)
+{
+    struct pcache_wb* wb = (struct pcache_wb*)iocb->data;
+    struct pcache_pg* page = wb->page;
+    struct pcache* pcache = page->holder;
+
+    radix_tag_clear(
+      &pcache->tree, PCACHE_INDEX(page->fpos), PCACHE_TAG_WRITEBACK);
+
+    // 写入失败的页重新变脏，等待下一次回写
+    if (iocb->result < 0) {
+        pcache->wb_error = iocb->result;
+        pcache_set_dirty(pcache, page);
+    }
+
+    pcache->n_writeback--;
+    pwake_all(&pcache->wb_wait);
+
+    vfree(wb);
+}
+
+/**
+ * @brief 将一批按偏移排列的脏页作为一个批次提交。文件系统不支持异步回写时
+ * （或无法分配请求时），逐页同步回写
+ *
+ * @return u32_t 成功提交（或写入）的页数
+ */
+static u32_t
+__pcache_submit(struct v_inode* inode, struct pcache_pg** pages, u32_t n)
+{
+    struct pcache* pcache = inode->pg_cache;
+    struct dev_iocb* iocbs[PCACHE_GANG];
+    u32_t nr_iocbs = 0, done = 0;
+
+    for (u32_t i = 0; i < n; i++) {
+        struct pcache_pg* page = pages[i];
+        struct pcache_wb* wb = NULL;
+
+        if (!inode->default_fops->submit_pages ||
+            !(wb = valloc(sizeof(struct pcache_wb)))) {
+            if (!pcache_commit(inode, page)) {
+                done++;
+            }
+            continue;
+        }
+
+        *wb = (struct pcache_wb){ .iocb = { .buf = page->pg,
+                                            .offset = page->fpos,
+                                            .len = PG_SIZE,
+                                            .write = 1,
+                                            .done = __pcache_wb_done,
+                                            .data = wb },
+                                  .page = page };
+
+        // 提交前即清除脏标记，在途期间的写入将使其重新变脏
+        radix_tag_set(
+          &pcache->tree, PCACHE_INDEX(page->fpos), PCACHE_TAG_WRITEBACK);
+        __pcache_clear_dirty(pcache, page);
+        pcache->n_writeback++;
+
+        iocbs[nr_iocbs++] = &wb->iocb;
+    }
+
+    if (nr_iocbs) {
+        inode->default_fops->submit_pages(inode, iocbs, nr_iocbs);
+    }
+
+    return done + nr_iocbs;
+}
+
+/**
+ * @brief 按文件偏移的顺序，经由脏标记找出 [start, end] 中 before（含）之前
+ * 变脏的页，分批提交回写
+ *
+ * @param sync 为真时，等待仍在回写中的页完成后再次提交它；否则跳过
+ */
+static u32_t
+__pcache_writeback_range(struct v_inode* inode,
+                         foff_t start,
+                         foff_t end,
+                         time_t before,
+                         u32_t max,
+                         int sync)
+{
+    struct pcache* pcache = inode->pg_cache;
+    struct pcache_pg *batch[PCACHE_GANG], *picked[PCACHE_GANG];
+    u32_t done = 0, next = PCACHE_INDEX(start), n, nr_picked;
+
+    while (done < max) {
+        n = radix_gang_lookup(
+          &pcache->tree, (void**)batch, next, PCACHE_GANG, PCACHE_TAG_DIRTY);
+        nr_picked = 0;
+
+        for (u32_t i = 0; i < n && done + nr_picked < max; i++) {
+            struct pcache_pg* page = batch[i];
+            if (page->fpos > end) {
+                n = i;
+                break;
+            }
+
+            if ((int)(page->dirtied - before) > 0) {
+                continue;
+            }
+
+            if (radix_tag_get(&pcache->tree,
+                              PCACHE_INDEX(page->fpos),
+                              PCACHE_TAG_WRITEBACK)) {
+                if (!sync) {
+                    continue;
+                }
+                __pcache_wait_writeback(pcache, page->fpos, page->fpos);
+            }
+
+            picked[nr_picked++] = page;
+        }
+
+        if (!n) {
+            break;
+        }
+
+        done += __pcache_submit(inode, picked, nr_picked);
+
+        // 回写失败或被跳过的页仍带有脏标记，越过它们继续
+        if (!(next = PCACHE_INDEX(batch[n - 1]->fpos) + 1)) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+int
+pcache_sync_range(struct v_inode* inode, foff_t start, foff_t end, int flags)
+{
+    struct pcache* pcache = inode->pg_cache;
+    if (!pcache) {
+        return 0;
+    }
+
+    start = PCACHE_ALIGN(start);
+
+    if ((flags & SYNC_FILE_RANGE_WAIT_BEFORE)) {
+        __pcache_wait_writeback(pcache, start, end);
+    }
+
+    if ((flags & SYNC_FILE_RANGE_WRITE)) {
+        __pcache_writeback_range(inode,
+                                 start,
+                                 end,
+                                 clock_systime(),
+                                 (u32_t)-1,
+                                 (flags & SYNC_FILE_RANGE_WAIT_AFTER));
+    }
+
+    int errno = 0;
+    if ((flags & SYNC_FILE_RANGE_WAIT_AFTER)) {
+        __pcache_wait_writeback(pcache, start, end);
+        errno = pcache->wb_error;
+        pcache->wb_error = 0;
     }
 
     return errno;
 }
 
 void
-pcache_commit_all(struct v_inode* inode)
+pcache_drop_range(struct v_inode* inode, foff_t start, foff_t end)
 {
-    if (!inode->pg_cache) {
+    struct pcache* pcache = inode->pg_cache;
+    if (!pcache || !pcache->n_pages) {
         return;
     }
 
-    struct pcache* cache = inode->pg_cache;
-    struct pcache_pg *pos, *n;
+    u32_t index = PCACHE_INDEX(start);
+    u32_t nr = PCACHE_INDEX(end) - index + 1;
 
-    llist_for_each(pos, n, &cache->dirty, dirty_list)
-    {
-        pcache_commit(inode, pos);
+    for (; nr--; index++) {
+        struct pcache_pg* page = radix_get(&pcache->tree, index);
+
+        // 仍被映射至用户空间的页无法丢弃，只得留待其后的访问
+        if (page && __pcache_evictable(page)) {
+            lru_remove(__pcache_lru_of(page), &page->lru);
+            pcache_invalidate(pcache, page);
+        }
     }
 }
 
+int
+pcache_prefetch(struct v_inode* inode, foff_t start, foff_t end)
+{
+    struct pcache* pcache = inode->pg_cache;
+    if (!pcache) {
+        return 0;
+    }
+
+    foff_t fpos = PCACHE_ALIGN(start);
+    u32_t off, nr = PCACHE_INDEX(end) - PCACHE_INDEX(start) + 1;
+    nr = MIN(nr, max_inode_pages / 2);
+
+    for (; nr--; fpos += PG_SIZE) {
+        struct pcache_pg* pg;
+        if (!__pcache_get_page(pcache, fpos, &off, &pg, 0)) {
+            if (!pg) {
+                return ENOMEM;
+            }
+            continue;
+        }
+
+        // 一次读取填充其后连续缺失的若干页
+        int errno = __pcache_fill_ahead(inode, pg, PCACHE_RA_MAX);
+        if (errno < 0) {
+            pg->len = 0;
+            return errno;
+        }
+
+        if (errno < PG_SIZE) {
+            // EOF
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int
+pcache_commit_all(struct v_inode* inode)
+{
+    return pcache_sync_range(inode,
+                             0,
+                             (foff_t)-1,
+                             SYNC_FILE_RANGE_WAIT_BEFORE |
+                               SYNC_FILE_RANGE_WRITE |
+                               SYNC_FILE_RANGE_WAIT_AFTER);
+}
+
+u32_t
+pcache_nr_dirty()
+{
+    return nr_dirty;
+}
+
+
+u32_t
+pcache_writeback(time_t before, u32_t max)
+{
+    u32_t done = 0, nr_caches = 0;
+    struct llist_header* pos;
+
+    for (pos = dirty_caches.next; pos != &dirty_caches; pos = pos->next) {
+        nr_caches++;
+    }
+
+    while (nr_caches-- && done < max && !llist_empty(&dirty_caches)) {
+        struct pcache* pcache =
+          list_entry(dirty_caches.next, struct pcache, dirty_link);
+
+        // 轮转至队尾，使各文件轮流得到回写
+        llist_delete(&pcache->dirty_link);
+        llist_append(&dirty_caches, &pcache->dirty_link);
+
+        // 正被读写的文件留待下一轮，以免回写线程在其锁上挂起
+        struct v_inode* inode = pcache->master;
+        if (mutex_on_hold(&inode->lock)) {
+            continue;
+        }
+
+        lock_inode(inode);
+        done +=
+          __pcache_writeback_range(inode, 0, (u32_t)-1, before, max - done, 0);
+        unlock_inode(inode);
+
+        // 回写期间等待I/O完成时已开启中断
+        cpu_disable_interrupt();
+    }
+
+    return done;
+}
+
 void
 pcache_invalidate(struct pcache* pcache, struct pcache_pg* page)
 {
@@ -0,0 +1,400 @@
+/**
+ * @file pipe.c
+ * @brief 管道：以单页大小的环形缓冲连接的一对文件
+ *
+ * 数据在写入者与读取者的缓冲区与环之间直接整块复制，不经由页缓存。读写两端
+ * 各为一个 inode（挂在一个不可见的 pipefs 中），各自的 inode 锁只串行化同一端
+ * 的读者（写者），因此一端阻塞时不会妨碍另一端的进展。
+ *
+ * 一端被关闭时（v_file 的关闭回调中），vfs_pclose 仍要访问其 dnode 与 inode，
+ * 故其释放推迟至下一次关闭端口或创建管道时进行。
+ *
+ */
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/pipe.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/poll.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+#define PIPE_BUF_SIZE PG_SIZE
+
+struct pipe
+{
+    char* buf;
+    // 自由增长的读写位置，取模后得到在环中的下标
+    u32_t rd_pos;
+    u32_t wr_pos;
+    waitq_t readers;
+    waitq_t writers;
+    int nr_readers;
+    int nr_writers;
+    int nr_ends; // 尚存的 inode 数
+};
+
+static struct v_dnode* pipe_root;
+static u32_t pipe_ino = 0;
+
+// 已关闭、待释放的端口，经由 v_dnode::siblings 串起
+static DEFINE_LLIST(retired_ends);
+
+extern struct v_inode_ops pipe_inode_ops;
+extern struct v_file_ops pipe_rd_fops;
+extern struct v_file_ops pipe_wr_fops;
+
+static inline u32_t
+__pipe_used(struct pipe* pipe)
+{
+    return pipe->wr_pos - pipe->rd_pos;
+}
+
+static void
+__pipe_reap_ends()
+{
+    struct v_dnode *pos, *n;
+    llist_for_each(pos, n, &retired_ends, siblings)
+    {
+        struct v_inode* inode = pos->inode;
+
+        llist_delete(&pos->siblings);
+        vfs_d_free(pos);
+
+        if (!inode->link_count && !inode->open_count) {
+            vfs_i_free(inode);
+        }
+    }
+}
+
+static void
+__pipe_retire(struct v_file* file)
+{
+    struct pipe* pipe = (struct pipe*)file->inode->data;
+
+    if (!pipe->nr_readers && !pipe->nr_writers && pipe->buf) {
+        vfree(pipe->buf);
+        pipe->buf = NULL;
+    }
+
+    __pipe_reap_ends();
+    llist_append(&retired_ends, &file->dnode->siblings);
+}
+
+static void
+__pipe_destruct(struct v_inode* inode)
+{
+    struct pipe* pipe = (struct pipe*)inode->data;
+
+    if (!--pipe->nr_ends) {
+        if (pipe->buf) {
+            vfree(pipe->buf);
+        }
+        vfree(pipe);
+    }
+}
+
+static void
+__pipe_init_inode(struct v_superblock* vsb, struct v_inode* inode)
+{
+    inode->ops = &pipe_inode_ops;
+    inode->default_fops = &pipe_rd_fops;
+}
+
+static int
+__pipe_mount(struct v_superblock* vsb, struct v_dnode* mount_point)
+{
+    vsb->ops.init_inode = __pipe_init_inode;
+
+    struct v_inode* inode = vfs_i_alloc(vsb);
+    if (!inode) {
+        return ENOMEM;
+    }
+
+    inode->id = pipe_ino++;
+    inode->itype = VFS_IFDIR;
+
+    vfs_assign_inode(mount_point, inode);
+    return 0;
+}
+
+static int
+__pipe_unmount(struct v_superblock* vsb)
+{
+    return EBUSY;
+}
+
+void
+pipefs_init()
+{
+    struct filesystem* fs = fsm_new_fs("pipefs", 6);
+    fs->types |= FSTYPE_PSEUDO;
+    fs->mount = __pipe_mount;
+    fs->unmount = __pipe_unmount;
+    fsm_register(fs);
+}
+
+static int
+__pipe_setup_root()
+{
+    if (pipe_root) {
+        return 0;
+    }
+
+    // 不挂入目录树，仅作为所有管道端口的父目录，为其提供超级块与挂载点
+    struct hstr name = HSTR("pipe:", 5);
+    struct v_dnode* root = vfs_d_alloc(NULL, &name);
+    if (!root) {
+        return ENOMEM;
+    }
+
+    int errno;
+    if ((errno = vfs_mount_at("pipefs", NULL, root, 0))) {
+        atomic_fetch_add(&root->ref_count, 1);
+        vfs_d_free(root);
+        return errno;
+    }
+
+    pipe_root = root;
+    return 0;
+}
+
+static int
+__pipe_new_end(struct pipe* pipe, struct v_file_ops* fops, struct v_file** file)
+{
+    struct v_inode* inode = vfs_i_alloc(pipe_root->super_block);
+    if (!inode) {
+        return ENOMEM;
+    }
+
+    inode->id = pipe_ino++;
+    inode->itype = VFS_IFSEQDEV;
+    inode->data = pipe;
+    inode->default_fops = fops;
+
+    struct v_dnode* dnode = vfs_d_alloc(pipe_root, &pipe_root->name);
+    if (!dnode) {
+        vfs_i_free(inode);
+        return ENOMEM;
+    }
+
+    vfs_assign_inode(dnode, inode);
+
+    // 代替目录缓存持有一个引用，直至被回收
+    atomic_fetch_add(&dnode->ref_count, 1);
+
+    int errno = vfs_open(dnode, file);
+    if (errno) {
+        vfs_d_free(dnode);
+        vfs_i_free(inode);
+        return errno;
+    }
+
+    inode->destruct = __pipe_destruct;
+    pipe->nr_ends++;
+
+    return 0;
+}
+
+int
+pipe_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct pipe* pipe = (struct pipe*)inode->data;
+
+    while (!__pipe_used(pipe)) {
+        if (!pipe->nr_writers) {
+            return 0;
+        }
+        pwait(&pipe->readers);
+        cpu_disable_interrupt();
+    }
+
+    size_t n = MIN(len, __pipe_used(pipe));
+    size_t off = pipe->rd_pos % PIPE_BUF_SIZE;
+    size_t first = MIN(n, PIPE_BUF_SIZE - off);
+
+    memcpy(buffer, pipe->buf + off, first);
+    memcpy(buffer + first, pipe->buf, n - first);
+
+    pipe->rd_pos += n;
+    pwake_all(&pipe->writers);
+
+    return n;
+}
+
+int
+pipe_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    struct pipe* pipe = (struct pipe*)inode->data;
+    size_t done = 0;
+
+    while (done < len) {
+        if (!pipe->nr_readers) {
+            return done ? (int)done : EPIPE;
+        }
+
+        size_t space = PIPE_BUF_SIZE - __pipe_used(pipe);
+        if (!space) {
+            pwait(&pipe->writers);
+            cpu_disable_interrupt();
+            continue;
+        }
+
+        size_t n = MIN(space, len - done);
+        size_t off = pipe->wr_pos % PIPE_BUF_SIZE;
+        size_t first = MIN(n, PIPE_BUF_SIZE - off);
+
+        memcpy(pipe->buf + off, buffer + done, first);
+        memcpy(pipe->buf, buffer + done + first, n - first);
+
+        pipe->wr_pos += n;
+        done += n;
+        pwake_all(&pipe->readers);
+    }
+
+    return done;
+}
+
+static int
+__pipe_bad_rw(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    return EBADF;
+}
+
+static int
+__pipe_rd_close(struct v_file* file)
+{
+    struct pipe* pipe = (struct pipe*)file->inode->data;
+
+    pipe->nr_readers--;
+    pwake_all(&pipe->writers);
+
+    __pipe_retire(file);
+    return 0;
+}
+
+static int
+__pipe_wr_close(struct v_file* file)
+{
+    struct pipe* pipe = (struct pipe*)file->inode->data;
+
+    pipe->nr_writers--;
+    pwake_all(&pipe->readers);
+
+    __pipe_retire(file);
+    return 0;
+}
+
+static int
+__pipe_rd_poll(struct v_file* file, struct poll_table* pt)
+{
+    struct pipe* pipe = (struct pipe*)file->inode->data;
+
+    poll_wait(pt, &pipe->readers);
+
+    int mask = __pipe_used(pipe) ? POLLIN : 0;
+    if (!pipe->nr_writers) {
+        mask |= POLLIN | POLLHUP;
+    }
+    return mask;
+}
+
+static int
+__pipe_wr_poll(struct v_file* file, struct poll_table* pt)
+{
+    struct pipe* pipe = (struct pipe*)file->inode->data;
+
+    poll_wait(pt, &pipe->writers);
+
+    if (!pipe->nr_readers) {
+        return POLLERR;
+    }
+    return __pipe_used(pipe) < PIPE_BUF_SIZE ? POLLOUT : 0;
+}
+
+__DEFINE_LXSYSCALL1(int, pipe, int*, fds)
+{
+    int errno, fd[2];
+    struct v_file *rd_end = NULL, *wr_end = NULL;
+
+    if ((errno = __pipe_setup_root())) {
+        goto done;
+    }
+
+    __pipe_reap_ends();
+
+    struct pipe* pipe = vzalloc(sizeof(struct pipe));
+    if (!pipe) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    if (!(pipe->buf = valloc(PIPE_BUF_SIZE))) {
+        vfree(pipe);
+        errno = ENOMEM;
+        goto done;
+    }
+
+    waitq_init(&pipe->readers);
+    waitq_init(&pipe->writers);
+    pipe->nr_readers = 1;
+    pipe->nr_writers = 1;
+
+    if ((errno = __pipe_new_end(pipe, &pipe_rd_fops, &rd_end))) {
+        if (!pipe->nr_ends) {
+            vfree(pipe->buf);
+            vfree(pipe);
+        }
+        goto done;
+    }
+
+    if ((errno = __pipe_new_end(pipe, &pipe_wr_fops, &wr_end))) {
+        goto fail;
+    }
+
+    if ((errno = vfs_alloc_fdslot(&fd[0]))) {
+        goto fail;
+    }
+    vfs_install_fd(fd[0], rd_end, 0);
+
+    if ((errno = vfs_alloc_fdslot(&fd[1]))) {
+        struct v_fd* fd_s = __current->fdtable->fds[fd[0]];
+        vfs_fdtable_set(__current->fdtable, fd[0], NULL);
+        vfs_free_fd(fd_s);
+        goto fail;
+    }
+    vfs_install_fd(fd[1], wr_end, 0);
+
+    if (copy_to_user(fds, fd, sizeof(fd))) {
+        errno = EFAULT;
+    }
+
+done:
+    return DO_STATUS(errno);
+
+fail:
+    // 关闭回调将一并回收这些端口
+    if (wr_end) {
+        vfs_close(wr_end);
+    } else {
+        pipe->nr_writers = 0;
+    }
+    vfs_close(rd_end);
+    return DO_STATUS(errno);
+}
+
+struct v_inode_ops pipe_inode_ops = { .open = default_inode_open };
+
+struct v_file_ops pipe_rd_fops = { .read = pipe_read,
+                                   .write = __pipe_bad_rw,
+                                   .close = __pipe_rd_close,
+                                   .poll = __pipe_rd_poll };
+
+struct v_file_ops pipe_wr_fops = { .read = __pipe_bad_rw,
+                                   .write = pipe_write,
+                                   .close = __pipe_wr_close,
+                                   .poll = __pipe_wr_poll };
@@ -0,0 +1,177 @@
+/**
+ * @file poll.c
+ * @brief 同时等待多个文件描述符
+ *
+ * 首轮检查时，每个文件的 poll 操作将其等待队列登记于 poll_table，即向其中挂入
+ * 一个挂钩。调用者随后阻塞于 poll_table 自身的等待队列上，任一被登记的队列
+ * 被唤醒（或是超时），都将唤醒调用者重新检查，此时不再重复登记。
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/fs.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/poll.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+#include <lunaix/timer.h>
+
+static void
+__poll_notify(struct waitq_hook* hook)
+{
+    struct poll_table* pt = container_of(hook, struct poll_entry, hook)->table;
+
+    pt->triggered = 1;
+    pwake_all(&pt->wait);
+}
+
+static void
+__poll_timeout(void* payload)
+{
+    struct poll_table* pt = (struct poll_table*)payload;
+
+    // 一次性定时器，回调返回后即被释放
+    pt->timer = NULL;
+    pt->timed_out = 1;
+    pwake_all(&pt->wait);
+}
+
+void
+poll_wait(struct poll_table* pt, waitq_t* queue)
+{
+    if (!pt || !pt->registering) {
+        return;
+    }
+
+    struct poll_entry* entry = valloc(sizeof(*entry));
+    if (!entry) {
+        // 无法登记，调用者仍可经由超时或其他文件被唤醒
+        return;
+    }
+
+    entry->table = pt;
+    llist_append(&pt->entries, &entry->entries);
+    waitq_hook_add(queue, &entry->hook, __poll_notify);
+}
+
+static void
+__poll_table_release(struct poll_table* pt)
+{
+    if (pt->timer) {
+        timer_cancel(pt->timer);
+        pt->timer = NULL;
+    }
+
+    struct poll_entry *pos, *n;
+    llist_for_each(pos, n, &pt->entries, entries)
+    {
+        waitq_hook_del(&pos->hook);
+        vfree(pos);
+    }
+}
+
+int
+vfs_poll(struct v_file* file, struct poll_table* pt)
+{
+    if (!file->ops->poll) {
+        return POLL_DEFAULT_MASK;
+    }
+
+    return file->ops->poll(file, pt);
+}
+
+static int
+__do_poll(struct pollfd* fds, int nfds, int timeout)
+{
+    struct poll_table pt = { .registering = 1 };
+    llist_init_head(&pt.entries);
+    waitq_init(&pt.wait);
+
+    int nr_ready;
+    while (1) {
+        nr_ready = 0;
+
+        for (int i = 0; i < nfds; i++) {
+            struct v_fd* fd_s;
+            struct pollfd* pfd = &fds[i];
+
+            pfd->revents = 0;
+            if (pfd->fd < 0) {
+                continue;
+            }
+
+            if (vfs_getfd(pfd->fd, &fd_s)) {
+                pfd->revents = POLLNVAL;
+            } else {
+                int mask = vfs_poll(fd_s->file, &pt);
+                pfd->revents = mask & (pfd->events | POLLERR | POLLHUP);
+            }
+
+            if (pfd->revents) {
+                nr_ready++;
+            }
+        }
+
+        pt.registering = 0;
+
+        if (nr_ready || !timeout || pt.timed_out) {
+            break;
+        }
+
+        if (timeout > 0 && !pt.timer) {
+            pt.timer = timer_run_ms(timeout, __poll_timeout, &pt, 0);
+            if (!pt.timer) {
+                break;
+            }
+            timeout = -1;
+        }
+
+        // 系统调用在关中断下进行，检查与等待之间不会错过唤醒
+        if (!pt.triggered) {
+            pwait(&pt.wait);
+            cpu_disable_interrupt();
+        }
+
+        pt.triggered = 0;
+    }
+
+    __poll_table_release(&pt);
+
+    return nr_ready;
+}
+
+__DEFINE_LXSYSCALL3(int, poll, struct pollfd*, fds, int, nfds, int, timeout)
+{
+    int errno;
+    struct pollfd* kfds = NULL;
+
+    if (nfds < 0 || nfds > VFS_MAX_FD) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    size_t len = nfds * sizeof(struct pollfd);
+    if (nfds && !(kfds = valloc(len))) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    if (copy_from_user(kfds, fds, len)) {
+        errno = EFAULT;
+        goto done;
+    }
+
+    errno = __do_poll(kfds, nfds, timeout);
+
+    if (copy_to_user(fds, kfds, len)) {
+        errno = EFAULT;
+    }
+
+done:
+    if (kfds) {
+        vfree(kfds);
+    }
+    return DO_STATUS_OR_RETURN(errno);
+}
@@ -47,19 +47,14 @@ extern const struct v_file_ops ramfs_file_ops;
 int
 ramfs_readdir(struct v_file* file, struct dir_context* dctx)
 {
-    int i = 0;
-    struct v_dnode *pos, *n;
-    llist_for_each(pos, n, &file->dnode->children, siblings)
-    {
-        if (i++ >= dctx->index) {
-            dctx->read_complete_callback(dctx,
-                                         pos->name.value,
-                                         pos->name.len,
-                                         vfs_get_dtype(pos->inode->itype));
-            return 1;
-        }
+    struct v_dnode* pos = vfs_dir_child(file, dctx->index);
+    if (!pos) {
+        return 0;
     }
-    return 0;
+
+    dctx->read_complete_callback(
+      dctx, pos->name.value, pos->name.len, vfs_get_dtype(pos->inode->itype));
+    return 1;
 }
 
 int
@@ -0,0 +1,159 @@
+/**
+ * @file sendfile.c
+ * @brief 在文件之间直接传送数据，而无需经由用户空间
+ *
+ * 源文件的数据取自其页缓存：每次取得一页后钉住其页框（与mmap相同，被引用的页
+ * 不会被驱逐），随即释放源文件的锁，再将该页交给目标文件。如此，两个文件的锁
+ * 从不同时持有，不会因互相传送而死锁。
+ *
+ * 目标为块设备且写入按页对齐时，页缓存中的页直接交由设备的 write_page 写出，
+ * 全程零复制；其余情况下写入目标的页缓存或其 write 接口，仅有一次内核内的复制。
+ *
+ */
+#include <lunaix/foptions.h>
+#include <lunaix/fs.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+extern struct lru_zone* inode_lru;
+
+static int
+__sendfile_put(struct v_fd* out, void* data, size_t len)
+{
+    struct v_file* file = out->file;
+    struct v_inode* inode = file->inode;
+    int errno;
+
+    lock_inode(inode);
+
+    inode->mtime = clock_unixtime();
+
+    if ((inode->itype & VFS_IFSEQDEV) || (out->flags & FO_DIRECT)) {
+        errno = file->ops->write(inode, data, len, file->f_pos);
+    } else if ((inode->itype & VFS_IFVOLDEV) && len == PG_SIZE &&
+               !(file->f_pos % PG_SIZE) &&
+               !pcache_lookup(inode->pg_cache, file->f_pos)) {
+        // 目标处未被缓存，不必顾及缓存的一致性，可直接写出
+        errno = inode->default_fops->write_page(inode, data, len, file->f_pos);
+        errno = errno < 0 ? errno : (int)MIN((size_t)errno, len);
+    } else {
+        errno = pcache_write(inode, data, len, file->f_pos);
+    }
+
+    if (errno > 0) {
+        file->f_pos += errno;
+    }
+
+    unlock_inode(inode);
+    return errno;
+}
+
+static int
+__sendfile(struct v_fd* out, struct v_fd* in, foff_t* pos, size_t count)
+{
+    struct v_inode* src = in->file->inode;
+    size_t done = 0;
+    int errno = 0;
+
+    while (done < count) {
+        struct pcache_pg* pg;
+
+        lock_inode(src);
+
+        if (*pos >= src->fsize) {
+            unlock_inode(src);
+            break;
+        }
+
+        if ((errno = pcache_get_filled(src, *pos, &pg))) {
+            unlock_inode(src);
+            break;
+        }
+
+        u32_t off = *pos % PG_SIZE;
+        size_t len = MIN(pg->len - off, count - done);
+        len = MIN(len, src->fsize - *pos);
+
+        uintptr_t pa = vmm_v2p(pg->pg);
+        pmm_ref_page(KERNEL_PID, (void*)pa);
+        src->atime = clock_unixtime();
+
+        unlock_inode(src);
+
+        errno = len ? __sendfile_put(out, pg->pg + off, len) : 0;
+
+        pmm_free_page(KERNEL_PID, (void*)pa);
+
+        if (errno <= 0) {
+            break;
+        }
+
+        done += errno;
+        *pos += errno;
+        errno = 0;
+    }
+
+    return done ? (int)done : errno;
+}
+
+__DEFINE_LXSYSCALL4(int,
+                    sendfile,
+                    int,
+                    out_fd,
+                    int,
+                    in_fd,
+                    size_t*,
+                    offset,
+                    size_t,
+                    count)
+{
+    int errno;
+    struct v_fd *in, *out;
+
+    if ((errno = vfs_getfd(in_fd, &in)) || (errno = vfs_getfd(out_fd, &out))) {
+        goto done;
+    }
+
+    struct v_inode* src = in->file->inode;
+    struct v_inode* dst = out->file->inode;
+
+    // 源文件须经由页缓存读取
+    if ((src->itype & (VFS_IFDIR | VFS_IFSEQDEV)) || !src->pg_cache ||
+        (dst->itype & VFS_IFDIR) || src == dst) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    if ((errno = vfs_check_writable(out->file->dnode))) {
+        goto done;
+    }
+
+    // 用户给出的 offset 仍为32位
+    size_t upos;
+    foff_t pos = in->file->f_pos;
+    if (offset && copy_from_user(&upos, offset, sizeof(upos))) {
+        errno = EFAULT;
+        goto done;
+    }
+
+    if (offset) {
+        pos = upos;
+    }
+
+    errno = __sendfile(out, in, &pos, count);
+
+    // 给出 offset 时，源文件自身的偏移保持不变
+    upos = pos;
+    if (!offset) {
+        in->file->f_pos = pos;
+    } else if (copy_to_user(offset, &upos, sizeof(upos))) {
+        errno = EFAULT;
+    }
+
+done:
+    return DO_STATUS_OR_RETURN(errno);
+}
@@ -0,0 +1,211 @@
+/**
+ * @file tmpfs.c
+ * @brief tmpfs：文件数据只存在于页缓存中的内存文件系统
+ *
+ * 与 ramfs 不同，tmpfs 的文件可以读写。文件的数据即是其页缓存，这些页被钉住
+ * （FSTYPE_NOBACKING），既不会被驱逐，亦不会被回写；尚未写入的部分（空洞）
+ * 读出为零。整个文件系统占用的页数受 pc_quota 所限，超出时写入返回 ENOSPC。
+ *
+ * 目录树完全由目录缓存承载，查找失败即是不存在。
+ *
+ */
+#include <klibc/string.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/tmpfs.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+
+// 默认至多占用可管理内存的百分比
+#define TMPFS_SIZE_RATIO 25
+
+static inode_t tmpfs_ino = 0;
+
+extern struct v_inode_ops tmpfs_inode_ops;
+extern struct v_file_ops tmpfs_file_ops;
+
+static int
+__tmpfs_new_inode(struct v_dnode* dnode, u32_t itype)
+{
+    struct v_inode* inode = vfs_i_alloc(dnode->super_block);
+    if (!inode) {
+        return ENOMEM;
+    }
+
+    inode->itype = itype;
+
+    vfs_i_addhash(inode);
+    vfs_assign_inode(dnode, inode);
+
+    return 0;
+}
+
+int
+tmpfs_create(struct v_inode* this, struct v_dnode* dnode)
+{
+    return __tmpfs_new_inode(dnode, VFS_IFFILE);
+}
+
+int
+tmpfs_mkdir(struct v_inode* this, struct v_dnode* dnode)
+{
+    return __tmpfs_new_inode(dnode, VFS_IFDIR);
+}
+
+int
+tmpfs_rmdir(struct v_inode* this, struct v_dnode* dir)
+{
+    // 目录为空已由VFS检查
+    return 0;
+}
+
+int
+tmpfs_link(struct v_inode* this, struct v_dnode* new_name)
+{
+    return 0;
+}
+
+int
+tmpfs_unlink(struct v_inode* this, struct v_dnode* name)
+{
+    // 最后一个名字被移除后，数据便无从访问，立即归还其占用的配额
+    if (this->link_count == 1 && this->pg_cache) {
+        pcache_release(this->pg_cache);
+        vfree(this->pg_cache);
+        this->pg_cache = NULL;
+        this->fsize = 0;
+    }
+
+    return 0;
+}
+
+int
+tmpfs_readdir(struct v_file* file, struct dir_context* dctx)
+{
+    struct v_dnode* pos = vfs_dir_child(file, dctx->index);
+    if (!pos) {
+        return 0;
+    }
+
+    dctx->read_complete_callback(
+      dctx, pos->name.value, pos->name.len, vfs_get_dtype(pos->inode->itype));
+    return 1;
+}
+
+/**
+ * @brief 载入一页，即是填入零：被钉住的页只会在首次访问某个空洞时被载入
+ *
+ */
+int
+tmpfs_read_page(struct v_inode* inode, void* pg, size_t len, foff_t fpos)
+{
+    memset(pg, 0, len);
+
+    if (fpos >= inode->fsize) {
+        return 0;
+    }
+    return MIN(len, inode->fsize - fpos);
+}
+
+int
+tmpfs_write_page(struct v_inode* inode, void* pg, size_t len, foff_t fpos)
+{
+    // 页缓存即是存储，无处可写
+    return len;
+}
+
+/**
+ * @brief 供直接I/O（FO_DIRECT）使用：页缓存即是存储，仍须经由它读写
+ *
+ */
+int
+tmpfs_read(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    return pcache_read(inode, buffer, len, fpos, NULL);
+}
+
+int
+tmpfs_write(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    return pcache_write(inode, buffer, len, fpos);
+}
+
+int
+tmpfs_sync(struct v_file* file)
+{
+    return 0;
+}
+
+void
+tmpfs_inode_init(struct v_superblock* vsb, struct v_inode* inode)
+{
+    inode->id = tmpfs_ino++;
+    inode->ops = &tmpfs_inode_ops;
+    inode->default_fops = &tmpfs_file_ops;
+}
+
+static u32_t
+__tmpfs_rd_capacity(struct v_superblock* vsb)
+{
+    return vsb->pc_quota * PG_SIZE;
+}
+
+static u32_t
+__tmpfs_rd_usage(struct v_superblock* vsb)
+{
+    return vsb->pc_pages * PG_SIZE;
+}
+
+int
+tmpfs_mount(struct v_superblock* vsb, struct v_dnode* mount_point)
+{
+    size_t managed = 0;
+    for (int i = 0; i < PM_NR_ZONES; i++) {
+        managed += pmm_zone(i)->managed;
+    }
+
+    vsb->pc_quota = MAX(managed * TMPFS_SIZE_RATIO / 100, 1);
+    vsb->ops.init_inode = tmpfs_inode_init;
+    vsb->ops.read_capacity = __tmpfs_rd_capacity;
+    vsb->ops.read_usage = __tmpfs_rd_usage;
+
+    return __tmpfs_new_inode(mount_point, VFS_IFDIR);
+}
+
+int
+tmpfs_unmount(struct v_superblock* vsb)
+{
+    // 文件的数据仅存于此，卸载即是丢弃；仍有数据时拒绝卸载
+    return vsb->pc_pages ? EBUSY : 0;
+}
+
+void
+tmpfs_init()
+{
+    struct filesystem* fs = fsm_new_fs("tmpfs", -1);
+    fs->types |= FSTYPE_NOBACKING;
+    fs->mount = tmpfs_mount;
+    fs->unmount = tmpfs_unmount;
+
+    fsm_register(fs);
+}
+
+struct v_inode_ops tmpfs_inode_ops = { .mkdir = tmpfs_mkdir,
+                                       .rmdir = tmpfs_rmdir,
+                                       .dir_lookup = default_inode_dirlookup,
+                                       .create = tmpfs_create,
+                                       .open = default_inode_open,
+                                       .link = tmpfs_link,
+                                       .unlink = tmpfs_unlink,
+                                       .rename = default_inode_rename };
+
+struct v_file_ops tmpfs_file_ops = { .readdir = tmpfs_readdir,
+                                     .close = default_file_close,
+                                     .read = tmpfs_read,
+                                     .read_page = tmpfs_read_page,
+                                     .write = tmpfs_write,
+                                     .write_page = tmpfs_write_page,
+                                     .seek = default_file_seek,
+                                     .sync = tmpfs_sync };
@@ -78,7 +78,7 @@ __twifs_mount(struct v_superblock* vsb, struct v_dnode* mount_point)
 }
 
 int
-__twifs_fwrite(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+__twifs_fwrite(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     struct twifs_node* twi_node = (struct twifs_node*)inode->data;
     if (!twi_node || !twi_node->ops.write) {
@@ -88,7 +88,7 @@ __twifs_fwrite(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
 }
 
 int
-__twifs_fread(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
+__twifs_fread(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
 {
     struct twifs_node* twi_node = (struct twifs_node*)inode->data;
     if (!twi_node || !twi_node->ops.read) {
@@ -97,6 +97,24 @@ __twifs_fread(struct v_inode* inode, void* buffer, size_t len, size_t fpos)
     return twi_node->ops.read(inode, buffer, len, fpos);
 }
 
+int
+__twifs_fread_file(struct v_file* file, void* buffer, size_t len, foff_t fpos)
+{
+    struct twifs_node* twi_node = (struct twifs_node*)file->inode->data;
+    if (twi_node && twi_node->ops.read_file) {
+        return twi_node->ops.read_file(file, buffer, len, fpos);
+    }
+    return __twifs_fread(file->inode, buffer, len, fpos);
+}
+
+int
+__twifs_fclose(struct v_file* file)
+{
+    // 只有映射会在打开的文件上保存状态
+    twimap_close_file(file);
+    return 0;
+}
+
 struct twifs_node*
 __twifs_get_node(struct twifs_node* parent, struct hstr* name)
 {
@@ -151,20 +169,19 @@ int
 __twifs_iterate_dir(struct v_file* file, struct dir_context* dctx)
 {
     struct twifs_node* twi_node = (struct twifs_node*)(file->inode->data);
-    int counter = 0;
-    struct twifs_node *pos, *n;
 
-    llist_for_each(pos, n, &twi_node->children, siblings)
-    {
-        if (counter++ >= dctx->index) {
-            dctx->index = counter;
-            dctx->read_complete_callback(
-              dctx, pos->name.value, pos->name.len, vfs_get_dtype(pos->itype));
-            return 1;
-        }
+    // 节点只会被追加，游标总是有效的
+    struct llist_header* it =
+      vfs_dir_seek(file, &twi_node->children, dctx->index, 0);
+    if (!it) {
+        return 0;
     }
 
-    return 0;
+    struct twifs_node* pos = container_of(it, struct twifs_node, siblings);
+    dctx->index++;
+    dctx->read_complete_callback(
+      dctx, pos->name.value, pos->name.len, vfs_get_dtype(pos->itype));
+    return 1;
 }
 
 int
@@ -234,7 +251,7 @@ twifs_init()
     struct filesystem* twifs = vzalloc(sizeof(struct filesystem));
     twifs->fs_name = HSTR("twifs", 5);
     twifs->mount = __twifs_mount;
-    twifs->types = FSTYPE_ROFS;
+    twifs->types = FSTYPE_ROFS | FSTYPE_PSEUDO;
     twifs->fs_id = 0;
 
     fsm_register(twifs);
@@ -246,12 +263,22 @@ int
 __twifs_twimap_file_read(struct v_inode* inode,
                          void* buf,
                          size_t len,
-                         size_t fpos)
+                         foff_t fpos)
 {
     struct twimap* map = twinode_getdata(inode, struct twimap*);
     return twimap_read(map, buf, len, fpos);
 }
 
+int
+__twifs_twimap_read_file(struct v_file* file,
+                         void* buf,
+                         size_t len,
+                         foff_t fpos)
+{
+    struct twimap* map = twinode_getdata(file->inode, struct twimap*);
+    return twimap_read_file(map, file, buf, len, fpos);
+}
+
 struct twimap*
 twifs_mapping(struct twifs_node* parent, void* data, const char* fmt, ...)
 {
@@ -261,13 +288,15 @@ twifs_mapping(struct twifs_node* parent, void* data, const char* fmt, ...)
     struct twimap* map = twimap_create(data);
     struct twifs_node* node = twifs_file_node_vargs(parent, fmt, args);
     node->ops.read = __twifs_twimap_file_read;
+    node->ops.read_file = __twifs_twimap_read_file;
     node->data = map;
 
     return map;
 }
 
-const struct v_file_ops twifs_file_ops = { .close = default_file_close,
+const struct v_file_ops twifs_file_ops = { .close = __twifs_fclose,
                                            .read = __twifs_fread,
+                                           .read_file = __twifs_fread_file,
                                            .read_page = __twifs_fread,
                                            .write = __twifs_fwrite,
                                            .write_page = __twifs_fwrite,
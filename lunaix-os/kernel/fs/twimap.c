@@ -2,12 +2,26 @@
 #include <lunaix/fs/twimap.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/spike.h>
+#include <lunaix/status.h>
 
 #include <klibc/stdio.h>
 #include <klibc/string.h>
 
+// 单条记录的上限
 #define TWIMAP_BUFFER_SIZE 1024
 
+/**
+ * @brief 一次完整生成的内容。每个打开的文件各自持有一份，
+ *  于偏移为零时重新生成，其余的读取均由此继续，无须从头再生成一遍
+ *
+ */
+struct twimap_snapshot
+{
+    char* data;
+    size_t len;
+    size_t cap;
+};
+
 void
 __twimap_default_reset(struct twimap* map)
 {
@@ -20,62 +34,170 @@ __twimap_default_gonext(struct twimap* map)
     return 0;
 }
 
-int
-__twimap_file_read(struct v_inode* inode, void* buf, size_t len, size_t fpos)
+static int
+__twimap_append(struct twimap_snapshot* snap, void* src, size_t len)
 {
-    struct twimap* map = (struct twimap*)(inode->data);
-    return twimap_read(map, buf, len, fpos);
+    if (snap->len + len > snap->cap) {
+        size_t cap = MAX(snap->cap * 2,
+                         ROUNDUP(snap->len + len, TWIMAP_BUFFER_SIZE));
+        char* data = valloc(cap);
+        if (!data) {
+            return ENOMEM;
+        }
+
+        if (snap->data) {
+            memcpy(data, snap->data, snap->len);
+            vfree(snap->data);
+        }
+
+        snap->data = data;
+        snap->cap = cap;
+    }
+
+    memcpy(snap->data + snap->len, src, len);
+    snap->len += len;
+
+    return 0;
 }
 
-int
-twimap_read(struct twimap* map, void* buffer, size_t len, size_t fpos)
+static int
+__twimap_generate(struct twimap* map, struct twimap_snapshot* snap)
 {
-    map->buffer = valloc(TWIMAP_BUFFER_SIZE);
-    map->reset(map);
+    int errno = 0;
 
-    // FIXME what if TWIMAP_BUFFER_SIZE is not big enough?
+    if (!(map->buffer = valloc(TWIMAP_BUFFER_SIZE))) {
+        return ENOMEM;
+    }
+
+    snap->len = 0;
+    map->reset(map);
 
-    size_t pos = 0;
     do {
         map->size_acc = 0;
         map->read(map);
-        pos += map->size_acc;
-    } while (pos <= fpos && map->go_next(map));
+        errno = __twimap_append(snap, map->buffer, map->size_acc);
+    } while (!errno && map->go_next(map));
+
+    vfree(map->buffer);
+    map->buffer = NULL;
+
+    return errno;
+}
 
-    if (pos <= fpos) {
-        vfree(map->buffer);
+static int
+__twimap_copy(struct twimap_snapshot* snap,
+              void* buffer,
+              size_t len,
+              foff_t fpos)
+{
+    if (fpos >= snap->len) {
         return 0;
     }
 
-    if (!fpos) {
-        pos = 0;
+    len = MIN(len, snap->len - fpos);
+    memcpy(buffer, snap->data + fpos, len);
+
+    return len;
+}
+
+int
+__twimap_file_read(struct v_inode* inode, void* buf, size_t len, foff_t fpos)
+{
+    struct twimap* map = (struct twimap*)(inode->data);
+    return twimap_read(map, buf, len, fpos);
+}
+
+int
+__twimap_file_read_file(struct v_file* file,
+                        void* buf,
+                        size_t len,
+                        foff_t fpos)
+{
+    struct twimap* map = (struct twimap*)(file->inode->data);
+    return twimap_read_file(map, file, buf, len, fpos);
+}
+
+int
+__twimap_file_close(struct v_file* file)
+{
+    twimap_close_file(file);
+    return 0;
+}
+
+int
+twimap_read(struct twimap* map, void* buffer, size_t len, foff_t fpos)
+{
+    struct twimap_snapshot snap = { 0 };
+
+    int errno = __twimap_generate(map, &snap);
+    if (!errno) {
+        errno = __twimap_copy(&snap, buffer, len, fpos);
     }
 
-    size_t acc_size = MIN(len, map->size_acc - (pos - fpos)), rdlen = acc_size;
-    memcpy(buffer, map->buffer + (pos - fpos), acc_size);
+    if (snap.data) {
+        vfree(snap.data);
+    }
 
-    while (acc_size < len && map->go_next(map)) {
-        map->size_acc = 0;
-        map->read(map);
-        rdlen = MIN(len - acc_size, map->size_acc);
-        memcpy(buffer + acc_size, map->buffer, rdlen);
-        acc_size += rdlen;
+    return errno;
+}
+
+int
+twimap_read_file(struct twimap* map,
+                 struct v_file* file,
+                 void* buffer,
+                 size_t len,
+                 foff_t fpos)
+{
+    struct twimap_snapshot* snap = file->data;
+    int fresh = !snap;
+
+    if (fresh) {
+        if (!(snap = vzalloc(sizeof(*snap)))) {
+            return ENOMEM;
+        }
+        file->data = snap;
     }
 
-    vfree(map->buffer);
-    return acc_size;
+    // 从头读起意味着想要最新的内容
+    if (fresh || !fpos) {
+        int errno = __twimap_generate(map, snap);
+        if (errno) {
+            return errno;
+        }
+    }
+
+    return __twimap_copy(snap, buffer, len, fpos);
+}
+
+void
+twimap_close_file(struct v_file* file)
+{
+    struct twimap_snapshot* snap = file->data;
+    if (!snap) {
+        return;
+    }
+
+    if (snap->data) {
+        vfree(snap->data);
+    }
+    vfree(snap);
+    file->data = NULL;
 }
 
 void
 twimap_printf(struct twimap* mapping, const char* fmt, ...)
 {
+    if (mapping->size_acc >= TWIMAP_BUFFER_SIZE - 1) {
+        return;
+    }
+
     va_list args;
     va_start(args, fmt);
 
     char* buf = mapping->buffer + mapping->size_acc;
 
-    mapping->size_acc +=
-      __ksprintf_internal(buf, fmt, TWIMAP_BUFFER_SIZE, args);
+    mapping->size_acc += __ksprintf_internal(
+      buf, fmt, TWIMAP_BUFFER_SIZE - mapping->size_acc, args);
 
     va_end(args);
 }
@@ -110,8 +232,9 @@ twimap_create(void* data)
     return map;
 }
 
-struct v_file_ops twimap_file_ops = { .close = default_file_close,
+struct v_file_ops twimap_file_ops = { .close = __twimap_file_close,
                                       .read = __twimap_file_read,
+                                      .read_file = __twimap_file_read_file,
                                       .readdir = default_file_readdir,
                                       .seek = default_file_seek,
-                                      .write = default_file_write };
\ No newline at end of file
+                                      .write = default_file_write };
@@ -49,10 +49,12 @@
 #include <lunaix/fs.h>
 #include <lunaix/mm/cake.h>
 #include <lunaix/mm/page.h>
+#include <lunaix/mm/uaccess.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/process.h>
 #include <lunaix/spike.h>
 #include <lunaix/syscall.h>
+#include <lunaix/uio.h>
 
 #include <lunaix/fs/twifs.h>
 
@@ -63,10 +65,23 @@ static struct cake_pile* superblock_pile;
 static struct cake_pile* fd_pile;
 
 struct v_dnode* vfs_sysroot;
-static struct hbucket* dnode_cache;
+static struct rhtable dnode_cache;
 
 struct lru_zone *dnode_lru, *inode_lru;
 
+/*
+    负目录项：查找失败的 dnode 仍留在散列表中（但不在其父目录的 children 中，
+    以免被 readdir 列出），借用 aka_list 按创建的先后串起，数量超出上限时
+    最早的一项被丢弃。
+*/
+#define VFS_NEG_DNODE_MAX 256
+
+static DEFINE_LLIST(neg_dnodes);
+static u32_t nr_neg_dnodes;
+
+// 路径缓存的代数。目录被移动或移除时递增，使其下所有缓存的路径一并作废
+static u32_t vfs_path_gen = 1;
+
 struct hstr vfs_ddot = HSTR("..", 2);
 struct hstr vfs_dot = HSTR(".", 1);
 struct hstr vfs_empty = HSTR("", 0);
@@ -83,21 +98,43 @@ __vfs_try_evict_dnode(struct lru_node* obj);
 static int
 __vfs_try_evict_inode(struct lru_node* obj);
 
+static u32_t
+__vfs_dnode_hashof(struct hlist_node* node)
+{
+    return container_of(node, struct v_dnode, hash_list)->name.hash;
+}
+
+static inline u32_t
+__vfs_inode_hash(u32_t i_id)
+{
+    // 不少文件系统以磁盘上的位置作为 inode 编号，低位并不随机
+    return hash_fmix32(i_id);
+}
+
+static u32_t
+__vfs_inode_hashof(struct hlist_node* node)
+{
+    return __vfs_inode_hash(container_of(node, struct v_inode, hash_list)->id);
+}
+
 void
 vfs_init()
 {
     // 为他们专门创建一个蛋糕堆，而不使用valloc，这样我们可以最小化内碎片的产生
-    dnode_pile = cake_new_pile("dnode_cache", sizeof(struct v_dnode), 1, 0);
-    inode_pile = cake_new_pile("inode_cache", sizeof(struct v_inode), 1, 0);
+    dnode_pile =
+      cake_new_pile("dnode_cache", sizeof(struct v_dnode), 1, PILE_HWALIGN);
+    inode_pile =
+      cake_new_pile("inode_cache", sizeof(struct v_inode), 1, PILE_HWALIGN);
     file_pile = cake_new_pile("file_cache", sizeof(struct v_file), 1, 0);
     fd_pile = cake_new_pile("fd_cache", sizeof(struct v_fd), 1, 0);
     superblock_pile =
       cake_new_pile("sb_cache", sizeof(struct v_superblock), 1, 0);
 
-    dnode_cache = vzalloc(VFS_HASHTABLE_SIZE * sizeof(struct hbucket));
+    rhtable_init(&dnode_cache, VFS_HASHTABLE_BITS, __vfs_dnode_hashof);
 
     dnode_lru = lru_new_zone(__vfs_try_evict_dnode);
     inode_lru = lru_new_zone(__vfs_try_evict_inode);
+    pcache_zone_init();
 
     hstr_rehash(&vfs_ddot, HSTR_FULL_HASH);
     hstr_rehash(&vfs_dot, HSTR_FULL_HASH);
@@ -108,16 +145,14 @@ vfs_init()
     atomic_fetch_add(&vfs_sysroot->ref_count, 1);
 }
 
-inline struct hbucket*
+static inline struct hbucket*
 __dcache_hash(struct v_dnode* parent, u32_t* hash)
 {
-    u32_t _hash = *hash;
-    // 确保低位更加随机
-    _hash = _hash ^ (_hash >> VFS_HASHBITS);
-    // 与parent的指针值做加法，来减小碰撞的可能性。
-    _hash += (u32_t)parent;
+    // 混入parent的指针值，使不同目录下的同名项分散开来；
+    // 再经一次雪崩，确保桶号所取的低位足够随机。
+    u32_t _hash = hash_fmix32(*hash ^ (u32_t)parent);
     *hash = _hash;
-    return &dnode_cache[_hash & VFS_HASH_MASK];
+    return rhtable_bucket(&dnode_cache, _hash);
 }
 
 struct v_dnode*
@@ -136,24 +171,95 @@ vfs_dcache_lookup(struct v_dnode* parent, struct hstr* str)
     struct v_dnode *pos, *n;
     hashtable_bucket_foreach(slot, pos, n, hash_list)
     {
-        if (pos->name.hash == hash) {
+        // 散列值仅用于筛选，仍须比较名称本身
+        if (pos->name.hash == hash && pos->parent == parent &&
+            pos->name.len == str->len &&
+            !memcmp(pos->name.value, str->value, str->len)) {
             return pos;
         }
     }
     return NULL;
 }
 
+static void
+__vfs_neg_drop(struct v_dnode* neg)
+{
+    nr_neg_dnodes--;
+    vfs_d_free(neg);
+}
+
+int
+vfs_dcache_negate(struct v_dnode* dnode)
+{
+    if ((dnode->super_block->fs->types & FSTYPE_PSEUDO)) {
+        return 0;
+    }
+
+    // 使遍历其父目录的游标作废
+    vfs_dnode_seq_bump(dnode->parent);
+    llist_delete(&dnode->siblings);
+    llist_append(&neg_dnodes, &dnode->aka_list);
+    vfs_dnode_seq_bump(dnode->parent);
+
+    if (++nr_neg_dnodes > VFS_NEG_DNODE_MAX) {
+        __vfs_neg_drop(list_entry(neg_dnodes.next, struct v_dnode, aka_list));
+    }
+
+    return 1;
+}
+
+void
+vfs_dcache_revive(struct v_dnode* dnode)
+{
+    nr_neg_dnodes--;
+    llist_delete(&dnode->aka_list);
+    vfs_dnode_seq_bump(dnode->parent);
+    llist_append(&dnode->parent->children, &dnode->siblings);
+    vfs_dnode_seq_bump(dnode->parent);
+}
+
+/**
+ * @brief 丢弃 parent 之下的负目录项：名为 name 者，或 name 为 NULL 时全部
+ *
+ */
+static void
+__vfs_neg_purge(struct v_dnode* parent, struct hstr* name)
+{
+    u32_t hash = 0;
+    if (name) {
+        hash = name->hash;
+        __dcache_hash(parent, &hash);
+    }
+
+    struct v_dnode *pos, *n;
+    llist_for_each(pos, n, &neg_dnodes, aka_list)
+    {
+        if (pos->parent == parent && (!name || pos->name.hash == hash)) {
+            __vfs_neg_drop(pos);
+        }
+    }
+}
+
 void
 vfs_dcache_add(struct v_dnode* parent, struct v_dnode* dnode)
 {
     assert(parent);
 
+    // 已被创建出来，同名的负目录项随即失效
+    if (nr_neg_dnodes) {
+        __vfs_neg_purge(parent, &dnode->name);
+    }
+
+    vfs_dnode_seq_bump(parent);
+
     atomic_fetch_add(&dnode->ref_count, 1);
     dnode->parent = parent;
     llist_append(&parent->children, &dnode->siblings);
 
-    struct hbucket* bucket = __dcache_hash(parent, &dnode->name.hash);
-    hlist_add(&bucket->head, &dnode->hash_list);
+    __dcache_hash(parent, &dnode->name.hash);
+    rhtable_add(&dnode_cache, &dnode->hash_list);
+
+    vfs_dnode_seq_bump(parent);
 }
 
 void
@@ -162,12 +268,30 @@ vfs_dcache_remove(struct v_dnode* dnode)
     assert(dnode);
     assert(dnode->ref_count == 1);
 
+    // 使正经过其父目录或其自身的无锁路径查找重试
+    struct v_dnode* parent = dnode->parent;
+    if (parent) {
+        vfs_dnode_seq_bump(parent);
+    }
+    vfs_dnode_seq_bump(dnode);
+
     llist_delete(&dnode->siblings);
     llist_delete(&dnode->aka_list);
-    hlist_delete(&dnode->hash_list);
+    rhtable_del(&dnode_cache, &dnode->hash_list);
+
+    // 其路径随之改变；若有子目录项，则整棵子树中缓存的路径一并作废
+    dnode->path_gen = 0;
+    if (!llist_empty(&dnode->children)) {
+        vfs_path_gen++;
+    }
 
     dnode->parent = NULL;
     atomic_fetch_sub(&dnode->ref_count, 1);
+
+    vfs_dnode_seq_bump(dnode);
+    if (parent) {
+        vfs_dnode_seq_bump(parent);
+    }
 }
 
 void
@@ -203,6 +327,7 @@ vfs_open(struct v_dnode* dnode, struct v_file** file)
         struct pcache* pcache = vzalloc(sizeof(struct pcache));
         pcache_init(pcache);
         pcache->master = inode;
+        pcache->pinned = !!(inode->sb->fs->types & FSTYPE_NOBACKING);
         inode->pg_cache = pcache;
     }
 
@@ -316,29 +441,28 @@ vfs_fsync(struct v_file* file)
 
     lock_inode(file->inode);
 
-    pcache_commit_all(file->inode);
+    // 脏页作为批次提交，由设备排序与合并，并只等待一次
+    if ((errno = pcache_commit_all(file->inode))) {
+        goto done;
+    }
 
     errno = ENOTSUP;
     if (file->ops->sync) {
         errno = file->ops->sync(file);
     }
 
+    // 数据已写入设备，还须令设备将其写缓存落盘
+    struct device* dev = file->inode->sb->dev;
+    if (!errno && dev && dev->sync) {
+        errno = dev->sync(dev);
+    }
+
+done:
     unlock_inode(file->inode);
 
     return errno;
 }
 
-int
-vfs_alloc_fdslot(int* fd)
-{
-    for (size_t i = 0; i < VFS_MAX_FD; i++) {
-        if (!__current->fdtable->fds[i]) {
-            *fd = i;
-            return 0;
-        }
-    }
-    return EMFILE;
-}
 
 struct v_superblock*
 vfs_sb_alloc()
@@ -346,14 +470,14 @@ vfs_sb_alloc()
     struct v_superblock* sb = cake_grab(superblock_pile);
     memset(sb, 0, sizeof(*sb));
     llist_init_head(&sb->sb_list);
-    sb->i_cache = vzalloc(VFS_HASHTABLE_SIZE * sizeof(struct hbucket));
+    rhtable_init(&sb->i_cache, VFS_HASHTABLE_BITS, __vfs_inode_hashof);
     return sb;
 }
 
 void
 vfs_sb_free(struct v_superblock* sb)
 {
-    vfree(sb->i_cache);
+    rhtable_free(&sb->i_cache);
     cake_release(superblock_pile, sb);
 }
 
@@ -374,7 +498,10 @@ __vfs_try_evict_inode(struct lru_node* obj)
 {
     struct v_inode* inode = container_of(obj, struct v_inode, lru);
 
-    if (!inode->link_count && !inode->open_count) {
+    // 持锁者（如回写线程）仍在使用它，或其页缓存仍有异步回写在途
+    if (!inode->link_count && !inode->open_count &&
+        !mutex_on_hold(&inode->lock) &&
+        !(inode->pg_cache && inode->pg_cache->n_writeback)) {
         vfs_i_free(inode);
         return 1;
     }
@@ -400,9 +527,8 @@ vfs_d_alloc(struct v_dnode* parent, struct hstr* name)
     mutex_init(&dnode->lock);
 
     dnode->ref_count = ATOMIC_VAR_INIT(0);
-    dnode->name = HHSTR(vzalloc(VFS_NAME_MAXLEN), 0, 0);
-
-    hstrcpy(&dnode->name, name);
+    // 同名的目录项共享同一份名称
+    hstr_intern(&dnode->name, name);
 
     if (parent) {
         dnode->super_block = parent->super_block;
@@ -425,6 +551,12 @@ vfs_d_free(struct v_dnode* dnode)
     }
 
     vfs_dcache_remove(dnode);
+
+    // 负目录项以父目录的地址为散列的键，不可比父目录存活得更久
+    if (nr_neg_dnodes) {
+        __vfs_neg_purge(dnode, NULL);
+    }
+
     // Make sure the children de-referencing their parent.
     // With lru presented, the eviction will be propagated over the entire
     // detached subtree eventually
@@ -434,16 +566,21 @@ vfs_d_free(struct v_dnode* dnode)
         vfs_dcache_remove(pos);
     }
 
-    vfree(dnode->name.value);
+    // 经由LRU驱逐时已被摘下，否则须自行摘下，以免LRU链表中留下已释放的节点
+    lru_remove(dnode_lru, &dnode->lru);
+
+    if (dnode->path) {
+        vfree(dnode->path);
+    }
+    hstr_release(&dnode->name);
     cake_release(dnode_pile, dnode);
 }
 
 struct v_inode*
 vfs_i_find(struct v_superblock* sb, u32_t i_id)
 {
-    struct hbucket* slot = &sb->i_cache[i_id & VFS_HASH_MASK];
     struct v_inode *pos, *n;
-    hashtable_bucket_foreach(slot, pos, n, hash_list)
+    rhtable_hash_foreach(&sb->i_cache, __vfs_inode_hash(i_id), pos, n, hash_list)
     {
         if (pos->id == i_id) {
             lru_use_one(inode_lru, &pos->lru);
@@ -457,10 +594,8 @@ vfs_i_find(struct v_superblock* sb, u32_t i_id)
 void
 vfs_i_addhash(struct v_inode* inode)
 {
-    struct hbucket* slot = &inode->sb->i_cache[inode->id & VFS_HASH_MASK];
-
-    hlist_delete(&inode->hash_list);
-    hlist_add(&slot->head, &inode->hash_list);
+    rhtable_del(&inode->sb->i_cache, &inode->hash_list);
+    rhtable_add(&inode->sb->i_cache, &inode->hash_list);
 }
 
 struct v_inode*
@@ -506,7 +641,11 @@ vfs_i_free(struct v_inode* inode)
     if (inode->destruct) {
         inode->destruct(inode);
     }
-    hlist_delete(&inode->hash_list);
+    xattr_release(inode);
+    // 所属的文件系统被卸载后，inode 已被摘离散列表，此时不会触及其超级块
+    rhtable_del(&inode->sb->i_cache, &inode->hash_list);
+    // 同 vfs_d_free，未经LRU驱逐而被直接释放时须自行摘下
+    lru_remove(inode_lru, &inode->lru);
     cake_release(inode_pile, inode);
 }
 
@@ -517,7 +656,8 @@ vfs_i_free(struct v_inode* inode)
 int
 vfs_getfd(int fd, struct v_fd** fd_s)
 {
-    if (TEST_FD(fd) && (*fd_s = __current->fdtable->fds[fd])) {
+    struct v_fdtable* table = __current->fdtable;
+    if (TEST_FD(fd) && (u32_t)fd < table->size && (*fd_s = table->fds[fd])) {
         return 0;
     }
     return EBADF;
@@ -580,42 +720,95 @@ vfs_do_open(const char* path, int options)
             return errno;
         }
 
-        struct v_fd* fd_s = cake_grab(fd_pile);
-        memset(fd_s, 0, sizeof(*fd_s));
-
         ofile->f_pos = ofile->inode->fsize & -((options & FO_APPEND) != 0);
-        fd_s->file = ofile;
-        fd_s->flags = options;
-        __current->fdtable->fds[fd] = fd_s;
+        ofile->flags = options;
+        vfs_install_fd(fd, ofile, options);
         return fd;
     }
 
     return errno;
 }
 
+void
+vfs_install_fd(int fd, struct v_file* file, int options)
+{
+    struct v_fd* fd_s = cake_grab(fd_pile);
+    memset(fd_s, 0, sizeof(*fd_s));
+
+    fd_s->file = file;
+    fd_s->flags = options;
+    vfs_fdtable_set(__current->fdtable, fd, fd_s);
+}
+
 __DEFINE_LXSYSCALL2(int, open, const char*, path, int, options)
 {
     int errno = vfs_do_open(path, options);
     return DO_STATUS_OR_RETURN(errno);
 }
 
-__DEFINE_LXSYSCALL1(int, close, int, fd)
+int
+vfs_do_close(int fd)
 {
     struct v_fd* fd_s;
     int errno = 0;
     if ((errno = vfs_getfd(fd, &fd_s))) {
-        goto done_err;
+        return errno;
     }
 
     if ((errno = vfs_close(fd_s->file))) {
-        goto done_err;
+        return errno;
     }
 
     cake_release(fd_pile, fd_s);
-    __current->fdtable->fds[fd] = 0;
+    vfs_fdtable_set(__current->fdtable, fd, NULL);
 
-done_err:
-    return DO_STATUS(errno);
+    return 0;
+}
+
+__DEFINE_LXSYSCALL1(int, close, int, fd)
+{
+    return DO_STATUS(vfs_do_close(fd));
+}
+
+struct llist_header*
+vfs_dir_seek(struct v_file* file,
+             struct llist_header* head,
+             int index,
+             u32_t seq)
+{
+    struct dir_cursor* cur = &file->dcur;
+    struct llist_header* it = head->next;
+    int i = 0;
+
+    if (cur->pos && cur->seq == seq && cur->index <= index) {
+        it = cur->pos;
+        i = cur->index;
+    }
+
+    for (; it != head && i < index; i++) {
+        it = it->next;
+    }
+
+    if (it == head) {
+        cur->pos = NULL;
+        return NULL;
+    }
+
+    cur->pos = it->next;
+    cur->index = index + 1;
+    cur->seq = seq;
+
+    return it;
+}
+
+struct v_dnode*
+vfs_dir_child(struct v_file* file, int index)
+{
+    struct v_dnode* dir = file->dnode;
+    struct llist_header* it =
+      vfs_dir_seek(file, &dir->children, index, vfs_dnode_seq_read(dir));
+
+    return it ? container_of(it, struct v_dnode, siblings) : NULL;
 }
 
 void
@@ -630,6 +823,35 @@ __vfs_readdir_callback(struct dir_context* dctx,
     dent->d_type = dtype;
 }
 
+/**
+ * @brief 读取目录中下标为 dent->d_offset 的项，其中 0 与 1 为 "." 与 ".."。
+ * 成功时 d_offset 前进一项并返回 1，读至末尾返回 0。调用者需持有 inode 锁
+ *
+ */
+static int
+__vfs_readdir_one(struct v_file* file, struct dirent* dent)
+{
+    struct dir_context dctx =
+      (struct dir_context){ .cb_data = dent,
+                            .index = dent->d_offset,
+                            .read_complete_callback = __vfs_readdir_callback };
+    int errno = 1;
+
+    if (dent->d_offset == 0) {
+        __vfs_readdir_callback(&dctx, vfs_dot.value, vfs_dot.len, DT_DIR);
+    } else if (dent->d_offset == 1) {
+        __vfs_readdir_callback(&dctx, vfs_ddot.value, vfs_ddot.len, DT_DIR);
+    } else {
+        dctx.index -= 2;
+        if ((errno = file->ops->readdir(file, &dctx)) != 1) {
+            return errno;
+        }
+    }
+
+    dent->d_offset++;
+    return 1;
+}
+
 __DEFINE_LXSYSCALL2(int, readdir, int, fd, struct dirent*, dent)
 {
     struct v_fd* fd_s;
@@ -646,24 +868,7 @@ __DEFINE_LXSYSCALL2(int, readdir, int, fd, struct dirent*, dent)
     if (!(inode->itype & VFS_IFDIR)) {
         errno = ENOTDIR;
     } else {
-        struct dir_context dctx =
-          (struct dir_context){ .cb_data = dent,
-                                .index = dent->d_offset,
-                                .read_complete_callback =
-                                  __vfs_readdir_callback };
-        errno = 1;
-        if (dent->d_offset == 0) {
-            __vfs_readdir_callback(&dctx, vfs_dot.value, vfs_dot.len, DT_DIR);
-        } else if (dent->d_offset == 1) {
-            __vfs_readdir_callback(&dctx, vfs_ddot.value, vfs_ddot.len, DT_DIR);
-        } else {
-            dctx.index -= 2;
-            if ((errno = fd_s->file->ops->readdir(fd_s->file, &dctx)) != 1) {
-                unlock_inode(inode);
-                goto done;
-            }
-        }
-        dent->d_offset++;
+        errno = __vfs_readdir_one(fd_s->file, dent);
     }
 
     unlock_inode(inode);
@@ -672,109 +877,365 @@ done:
     return DO_STATUS_OR_RETURN(errno);
 }
 
-__DEFINE_LXSYSCALL3(int, read, int, fd, void*, buf, size_t, count)
+__DEFINE_LXSYSCALL3(int,
+                    getdents,
+                    int,
+                    fd,
+                    struct dirent*,
+                    dirp,
+                    unsigned int,
+                    count)
 {
-    int errno = 0;
     struct v_fd* fd_s;
+    int errno;
+
     if ((errno = vfs_getfd(fd, &fd_s))) {
         goto done;
     }
 
     struct v_file* file = fd_s->file;
-    if ((file->inode->itype & VFS_IFDIR)) {
-        errno = EISDIR;
+    struct v_inode* inode = file->inode;
+    unsigned int nr = count / sizeof(struct dirent), i = 0;
+
+    if (!nr) {
+        errno = EINVAL;
         goto done;
     }
 
-    lock_inode(file->inode);
+    struct dirent* dent = valloc(sizeof(struct dirent));
+    if (!dent) {
+        errno = ENOMEM;
+        goto done;
+    }
 
-    file->inode->atime = clock_unixtime();
+    lock_inode(inode);
 
-    if ((file->inode->itype & VFS_IFSEQDEV) || (fd_s->flags & FO_DIRECT)) {
-        errno = file->ops->read(file->inode, buf, count, file->f_pos);
-    } else {
-        errno = pcache_read(file->inode, buf, count, file->f_pos);
+    if (!(inode->itype & VFS_IFDIR)) {
+        errno = ENOTDIR;
+        goto unlock;
     }
 
-    if (errno > 0) {
-        file->f_pos += errno;
-        unlock_inode(file->inode);
-        return errno;
+    // 文件位置即为下一项的下标，配合目录游标，每一项的读取都无需从头查找
+    dent->d_offset = file->f_pos;
+    for (; i < nr; i++) {
+        if ((errno = __vfs_readdir_one(file, dent)) != 1) {
+            break;
+        }
+
+        if (copy_to_user(&dirp[i], dent, sizeof(struct dirent))) {
+            errno = EFAULT;
+            break;
+        }
+
+        file->f_pos = dent->d_offset;
     }
 
-    unlock_inode(file->inode);
+    // 已读取的项优先于其后的错误被报告
+    if (i || errno >= 0) {
+        errno = i * sizeof(struct dirent);
+    }
+
+unlock:
+    unlock_inode(inode);
+    vfree(dent);
 
 done:
-    return DO_STATUS(errno);
+    return DO_STATUS_OR_RETURN(errno);
 }
 
-__DEFINE_LXSYSCALL3(int, write, int, fd, void*, buf, size_t, count)
+/**
+ * @brief 读写的公共路径：依次处理各个缓冲区，遇到错误或不足量的传输即止
+ *
+ * @param pos 给出时为定位读写（pread/pwrite），文件自身的偏移保持不变
+ */
+// 直接I/O每次交由设备的请求数
+#define VFS_DIRECT_BATCH 16
+
+/**
+ * @brief 块设备的直接I/O：各 iovec 被切分为若干请求，成批地交由设备一并提交，
+ * 每批只等待一次。数据直接在用户缓冲区与设备之间传输，不经由页缓存。
+ *
+ * @return int 传输的字节数，或首批即遇到的错误
+ */
+static int
+__vfs_rw_direct(struct v_inode* inode,
+                struct iovec* iov,
+                int iovcnt,
+                foff_t fpos,
+                int write)
+{
+    struct device* dev = (struct device*)inode->data;
+    struct dev_iocb iocbs[VFS_DIRECT_BATCH];
+    size_t done = 0, total = 0;
+    int errno = 0, i = 0, nr;
+    size_t iov_off = 0;
+
+    // 缓冲区将直接作为DMA的目标，须完全位于用户空间
+    for (int k = 0; k < iovcnt; k++) {
+        if (!uaccess_ok(iov[k].iov_base, iov[k].iov_len)) {
+            return EFAULT;
+        }
+        total += iov[k].iov_len;
+    }
+
+    if (!total) {
+        return 0;
+    }
+
+    // 页缓存中较新的数据须先落盘；写入后缓存中的旧页亦须丢弃
+    if ((errno = pcache_sync_range(inode,
+                                   fpos,
+                                   fpos + total - 1,
+                                   SYNC_FILE_RANGE_WAIT_BEFORE |
+                                     SYNC_FILE_RANGE_WRITE |
+                                     SYNC_FILE_RANGE_WAIT_AFTER))) {
+        return errno;
+    }
+
+    while (i < iovcnt) {
+        foff_t off = fpos + done;
+
+        for (nr = 0; nr < VFS_DIRECT_BATCH && i < iovcnt; nr++) {
+            if (!iov[i].iov_len) {
+                i++;
+                nr--;
+                continue;
+            }
+
+            size_t len = MIN(iov[i].iov_len - iov_off, DEV_DIRECT_MAX);
+
+            iocbs[nr] = (struct dev_iocb){ .buf = iov[i].iov_base + iov_off,
+                                           .offset = off,
+                                           .len = len,
+                                           .write = write };
+            off += len;
+
+            if ((iov_off += len) == iov[i].iov_len) {
+                iov_off = 0;
+                i++;
+            }
+        }
+
+        if ((errno = dev->direct_io(dev, iocbs, nr))) {
+            break;
+        }
+
+        // 止于首个出错或未能完整传输的请求
+        for (int k = 0; k < nr; k++) {
+            if (iocbs[k].result < 0) {
+                errno = iocbs[k].result;
+                goto out;
+            }
+
+            done += iocbs[k].result;
+            if ((size_t)iocbs[k].result < iocbs[k].len) {
+                goto out;
+            }
+        }
+    }
+
+out:
+    if (write && done) {
+        pcache_drop_range(inode, fpos, fpos + done - 1);
+    }
+
+    return done ? (int)done : errno;
+}
+
+static int
+__vfs_rw(int fd, struct iovec* iov, int iovcnt, foff_t* pos, int write)
 {
     int errno = 0;
     struct v_fd* fd_s;
     if ((errno = vfs_getfd(fd, &fd_s))) {
-        goto done;
+        return errno;
     }
 
     struct v_file* file = fd_s->file;
+    struct v_inode* inode = file->inode;
 
-    if ((errno = vfs_check_writable(file->dnode))) {
-        goto done;
+    if (write && (errno = vfs_check_writable(file->dnode))) {
+        return errno;
     }
 
-    if ((file->inode->itype & VFS_IFDIR)) {
-        errno = EISDIR;
-        goto done;
+    if ((inode->itype & VFS_IFDIR)) {
+        return EISDIR;
     }
 
-    lock_inode(file->inode);
+    if (pos && (inode->itype & VFS_IFSEQDEV)) {
+        return ESPIPE;
+    }
 
-    file->inode->mtime = clock_unixtime();
+    int direct = (inode->itype & VFS_IFSEQDEV) || (fd_s->flags & FO_DIRECT);
+    foff_t fpos = pos ? *pos : file->f_pos, done = 0;
 
-    if ((file->inode->itype & VFS_IFSEQDEV) || (fd_s->flags & FO_DIRECT)) {
-        errno = file->ops->write(file->inode, buf, count, file->f_pos);
+    lock_inode(inode);
+
+    if (write) {
+        inode->mtime = clock_unixtime();
     } else {
-        errno = pcache_write(file->inode, buf, count, file->f_pos);
+        inode->atime = clock_unixtime();
     }
 
-    if (errno > 0) {
-        file->f_pos += errno;
-        unlock_inode(file->inode);
-        return errno;
+    // 支持直接I/O的块设备（依照惯例，其inode的data即为设备）
+    if ((fd_s->flags & FO_DIRECT) && (inode->itype & VFS_IFVOLDEV) &&
+        inode->data && ((struct device*)inode->data)->direct_io) {
+        errno = __vfs_rw_direct(inode, iov, iovcnt, fpos, write);
+        if (errno > 0) {
+            done = errno;
+            fpos += errno;
+        }
+        iovcnt = 0;
     }
 
-    unlock_inode(file->inode);
+    for (int i = 0; i < iovcnt; i++) {
+        void* buf = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
 
-done:
-    return DO_STATUS(errno);
+        if (!len) {
+            continue;
+        }
+
+        if (direct && !write && file->ops->read_file) {
+            errno = file->ops->read_file(file, buf, len, fpos);
+        } else if (direct) {
+            errno = write ? file->ops->write(inode, buf, len, fpos)
+                          : file->ops->read(inode, buf, len, fpos);
+        } else if (write) {
+            errno = pcache_write(inode, buf, len, fpos);
+        } else {
+            errno = pcache_read(inode, buf, len, fpos, &file->ra);
+        }
+
+        if (errno < 0) {
+            break;
+        }
+
+        done += errno;
+        fpos += errno;
+
+        if ((size_t)errno < len) {
+            break;
+        }
+    }
+
+    if (!pos) {
+        file->f_pos = fpos;
+    }
+
+    unlock_inode(inode);
+
+    return done ? (int)done : errno;
 }
 
-__DEFINE_LXSYSCALL3(int, lseek, int, fd, int, offset, int, options)
+int
+vfs_do_rw(int fd, struct iovec* iov, int iovcnt, foff_t* pos, int write)
+{
+    return __vfs_rw(fd, iov, iovcnt, pos, write);
+}
+
+static int
+__vfs_rwv(int fd, const struct iovec* uiov, int iovcnt, int write)
+{
+    struct iovec iov[UIO_MAXIOV];
+
+    if (iovcnt <= 0 || iovcnt > UIO_MAXIOV) {
+        return EINVAL;
+    }
+
+    if (copy_from_user(iov, uiov, iovcnt * sizeof(struct iovec))) {
+        return EFAULT;
+    }
+
+    return __vfs_rw(fd, iov, iovcnt, NULL, write);
+}
+
+__DEFINE_LXSYSCALL3(int, read, int, fd, void*, buf, size_t, count)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    int errno = __vfs_rw(fd, &iov, 1, NULL, 0);
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+__DEFINE_LXSYSCALL3(int, write, int, fd, void*, buf, size_t, count)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    int errno = __vfs_rw(fd, &iov, 1, NULL, 1);
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+__DEFINE_LXSYSCALL3(int, readv, int, fd, const struct iovec*, iov, int, iovcnt)
+{
+    int errno = __vfs_rwv(fd, iov, iovcnt, 0);
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+__DEFINE_LXSYSCALL3(int, writev, int, fd, const struct iovec*, iov, int, iovcnt)
+{
+    int errno = __vfs_rwv(fd, iov, iovcnt, 1);
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+__DEFINE_LXSYSCALL4(int,
+                    pread,
+                    int,
+                    fd,
+                    void*,
+                    buf,
+                    size_t,
+                    count,
+                    size_t,
+                    offset)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    foff_t pos = offset;
+    int errno = __vfs_rw(fd, &iov, 1, &pos, 0);
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+__DEFINE_LXSYSCALL4(int,
+                    pwrite,
+                    int,
+                    fd,
+                    void*,
+                    buf,
+                    size_t,
+                    count,
+                    size_t,
+                    offset)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    foff_t pos = offset;
+    int errno = __vfs_rw(fd, &iov, 1, &pos, 1);
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+static int
+__vfs_lseek(int fd, int64_t offset, int options, foff_t* result)
 {
     int errno = 0;
     struct v_fd* fd_s;
     if ((errno = vfs_getfd(fd, &fd_s))) {
-        goto done;
+        return errno;
     }
 
     struct v_file* file = fd_s->file;
 
     if (!file->ops->seek) {
-        errno = ENOTSUP;
-        goto done;
+        return ENOTSUP;
     }
 
     lock_inode(file->inode);
 
     int overflow = 0;
-    int fpos = file->f_pos;
+    int64_t fpos = file->f_pos;
     switch (options) {
         case FSEEK_CUR:
-            overflow = __builtin_sadd_overflow((int)file->f_pos, offset, &fpos);
+            overflow = __builtin_add_overflow(fpos, offset, &fpos);
             break;
         case FSEEK_END:
-            overflow =
-              __builtin_sadd_overflow((int)file->inode->fsize, offset, &fpos);
+            fpos = file->inode->fsize;
+            overflow = __builtin_add_overflow(fpos, offset, &fpos);
             break;
         case FSEEK_SET:
             fpos = offset;
@@ -782,16 +1243,74 @@ __DEFINE_LXSYSCALL3(int, lseek, int, fd, int, offset, int, options)
     }
     if (overflow) {
         errno = EOVERFLOW;
+    } else if (fpos < 0) {
+        errno = EINVAL;
     } else if (!(errno = file->ops->seek(file->inode, fpos))) {
         file->f_pos = fpos;
+        *result = fpos;
     }
 
     unlock_inode(file->inode);
 
-done:
+    return errno;
+}
+
+__DEFINE_LXSYSCALL3(int, lseek, int, fd, int, offset, int, options)
+{
+    foff_t fpos;
+    return DO_STATUS(__vfs_lseek(fd, offset, options, &fpos));
+}
+
+__DEFINE_LXSYSCALL3(int, lseek64, int, fd, int64_t*, offset, int, options)
+{
+    int64_t off;
+    foff_t fpos;
+    int errno = 0;
+
+    if (copy_from_user(&off, offset, sizeof(off))) {
+        errno = EFAULT;
+    } else if (!(errno = __vfs_lseek(fd, off, options, &fpos))) {
+        off = fpos;
+        errno = copy_to_user(offset, &off, sizeof(off)) ? EFAULT : 0;
+    }
+
     return DO_STATUS(errno);
 }
 
+/**
+ * @brief 若 dnode 缓存的路径仍然有效，将其写入 buf（至多 size 字节）
+ *
+ * @return int 写入的字节数，无效时为 -1
+ */
+static int
+__vfs_path_cached(struct v_dnode* dnode, char* buf, size_t size)
+{
+    if (!dnode->path || dnode->path_gen != vfs_path_gen) {
+        return -1;
+    }
+
+    size_t len = MIN(dnode->path_len, size);
+    memcpy(buf, dnode->path, len);
+    return len;
+}
+
+static void
+__vfs_path_save(struct v_dnode* dnode, const char* path, size_t len)
+{
+    if (dnode->path && dnode->path_len < len) {
+        vfree(dnode->path);
+        dnode->path = NULL;
+    }
+
+    if (!dnode->path && !(dnode->path = valloc(len))) {
+        return;
+    }
+
+    memcpy(dnode->path, path, len);
+    dnode->path_len = len;
+    dnode->path_gen = vfs_path_gen;
+}
+
 int
 vfs_get_path(struct v_dnode* dnode, char* buf, size_t size, int depth)
 {
@@ -803,6 +1322,12 @@ vfs_get_path(struct v_dnode* dnode, char* buf, size_t size, int depth)
         return ENAMETOOLONG;
     }
 
+    // 祖先的路径亦即其后代路径的前缀
+    int cached = __vfs_path_cached(dnode, buf, size);
+    if (cached >= 0) {
+        return cached;
+    }
+
     size_t len = 0;
 
     if (dnode->parent != dnode) {
@@ -821,6 +1346,11 @@ vfs_get_path(struct v_dnode* dnode, char* buf, size_t size, int depth)
     strncpy(buf + len, dnode->name.value, cpy_size);
     len += cpy_size;
 
+    // 只缓存被直接询问的、完整的路径
+    if (!depth && len < size) {
+        __vfs_path_save(dnode, buf, len);
+    }
+
     return len;
 }
 
@@ -1047,7 +1577,7 @@ __vfs_do_unlink(struct v_dnode* dnode)
     } else if (!(inode->itype & VFS_IFDIR)) {
         // The underlying unlink implementation should handle
         //  symlink case
-        errno = inode->ops->unlink(inode);
+        errno = inode->ops->unlink(inode, dnode);
         if (!errno) {
             vfs_d_free(dnode);
         }
@@ -1060,18 +1590,21 @@ __vfs_do_unlink(struct v_dnode* dnode)
     return errno;
 }
 
-__DEFINE_LXSYSCALL1(int, unlink, const char*, pathname)
+int
+vfs_do_unlink(const char* path)
 {
     int errno;
     struct v_dnode* dnode;
-    if ((errno = vfs_walk_proc(pathname, &dnode, NULL, 0))) {
-        goto done;
+    if ((errno = vfs_walk_proc(path, &dnode, NULL, 0))) {
+        return errno;
     }
 
-    errno = __vfs_do_unlink(dnode);
+    return __vfs_do_unlink(dnode);
+}
 
-done:
-    return DO_STATUS(errno);
+__DEFINE_LXSYSCALL1(int, unlink, const char*, pathname)
+{
+    return DO_STATUS(vfs_do_unlink(pathname));
 }
 
 __DEFINE_LXSYSCALL2(int, unlinkat, int, fd, const char*, pathname)
@@ -1121,6 +1654,117 @@ __DEFINE_LXSYSCALL1(int, fsync, int, fildes)
     return DO_STATUS(errno);
 }
 
+__DEFINE_LXSYSCALL4(int,
+                    posix_fadvise,
+                    int,
+                    fildes,
+                    int,
+                    offset,
+                    int,
+                    len,
+                    int,
+                    advice)
+{
+    int errno;
+    struct v_fd* fd_s;
+
+    if ((errno = vfs_getfd(fildes, &fd_s))) {
+        goto done;
+    }
+
+    if (offset < 0 || len < 0) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    struct v_file* file = fd_s->file;
+    struct v_inode* inode = file->inode;
+    if ((inode->itype & VFS_IFSEQDEV)) {
+        errno = ESPIPE;
+        goto done;
+    }
+
+    // len 为零表示直至文件末尾
+    u32_t end = (u32_t)-1;
+    if (len && (u32_t)(offset + len) > (u32_t)offset) {
+        end = offset + len - 1;
+    }
+
+    switch (advice) {
+        case POSIX_FADV_NORMAL:
+        case POSIX_FADV_RANDOM:
+        case POSIX_FADV_SEQUENTIAL:
+        case POSIX_FADV_NOREUSE:
+            // 访问模式针对整个打开的文件，而非某一范围
+            file->ra.advice = advice;
+            file->ra.window = 0;
+            break;
+        case POSIX_FADV_WILLNEED:
+            lock_inode(inode);
+            errno = pcache_prefetch(inode, offset, end);
+            unlock_inode(inode);
+            break;
+        case POSIX_FADV_DONTNEED:
+            // 脏页只发起回写而不等待，仍在回写中的页无法丢弃
+            lock_inode(inode);
+            pcache_sync_range(inode, offset, end, SYNC_FILE_RANGE_WRITE);
+            pcache_drop_range(inode, offset, end);
+            unlock_inode(inode);
+            break;
+        default:
+            errno = EINVAL;
+            break;
+    }
+
+done:
+    return DO_STATUS(errno);
+}
+
+__DEFINE_LXSYSCALL4(int,
+                    sync_file_range,
+                    int,
+                    fildes,
+                    int,
+                    offset,
+                    int,
+                    nbytes,
+                    unsigned int,
+                    flags)
+{
+    int errno;
+    struct v_fd* fd_s;
+
+    if ((errno = vfs_getfd(fildes, &fd_s))) {
+        goto done;
+    }
+
+    if (offset < 0 || nbytes < 0 ||
+        (flags & ~(SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                   SYNC_FILE_RANGE_WAIT_AFTER))) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    struct v_inode* inode = fd_s->file->inode;
+    if ((inode->itype & VFS_IFDIR)) {
+        errno = EISDIR;
+        goto done;
+    }
+
+    // nbytes 为零表示直至文件末尾
+    u32_t end = (u32_t)-1;
+    if (nbytes && (u32_t)(offset + nbytes) > (u32_t)offset) {
+        end = offset + nbytes - 1;
+    }
+
+    lock_inode(inode);
+    errno = pcache_sync_range(inode, offset, end, flags);
+    unlock_inode(inode);
+
+done:
+    return DO_STATUS(errno);
+}
+
 int
 vfs_dup_fd(struct v_fd* old, struct v_fd** new)
 {
@@ -1154,13 +1798,17 @@ vfs_dup2(int oldfd, int newfd)
         goto done;
     }
 
+    if ((errno = vfs_fdtable_expand(__current->fdtable, newfd + 1))) {
+        goto done;
+    }
+
     newfd_s = __current->fdtable->fds[newfd];
     if (newfd_s && (errno = vfs_close(newfd_s->file))) {
         goto done;
     }
 
     if (!(errno = vfs_dup_fd(oldfd_s, &newfd_s))) {
-        __current->fdtable->fds[newfd] = newfd_s;
+        vfs_fdtable_set(__current->fdtable, newfd, newfd_s);
         return newfd;
     }
 
@@ -1183,7 +1831,7 @@ __DEFINE_LXSYSCALL1(int, dup, int, oldfd)
 
     if (!(errno = vfs_alloc_fdslot(&newfd)) &&
         !(errno = vfs_dup_fd(oldfd_s, &newfd_s))) {
-        __current->fdtable->fds[newfd] = newfd_s;
+        vfs_fdtable_set(__current->fdtable, newfd, newfd_s);
         return newfd;
     }
 
@@ -1340,6 +1988,10 @@ vfs_do_rename(struct v_dnode* current, struct v_dnode* target)
         return EBUSY;
     }
 
+    if (vfs_is_mountpoint(current) || vfs_is_mountpoint(target)) {
+        return EBUSY;
+    }
+
     if (current->super_block != target->super_block) {
         return EXDEV;
     }
@@ -1367,7 +2019,9 @@ vfs_do_rename(struct v_dnode* current, struct v_dnode* target)
     }
 
     // re-position current
-    hstrcpy(&current->name, &target->name);
+    struct hstr old_name = current->name;
+    hstr_dup(&current->name, &target->name);
+    hstr_release(&old_name);
     vfs_dcache_rehash(newparent, current);
 
     // detach target
@@ -1388,7 +2042,8 @@ cleanup:
 __DEFINE_LXSYSCALL2(int, rename, const char*, oldpath, const char*, newpath)
 {
     struct v_dnode *cur, *target_parent, *target;
-    struct hstr name = HSTR(valloc(VFS_NAME_MAXLEN), 0);
+    char* name_buf = valloc(VFS_NAME_MAXLEN);
+    struct hstr name = HSTR(name_buf, 0);
     int errno = 0;
 
     if ((errno = vfs_walk_proc(oldpath, &cur, NULL, 0))) {
@@ -1416,6 +2071,6 @@ __DEFINE_LXSYSCALL2(int, rename, const char*, oldpath, const char*, newpath)
     errno = vfs_do_rename(cur, target);
 
 done:
-    vfree(name.value);
+    vfree(name_buf);
     return DO_STATUS(errno);
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+/**
+ * @file writeback.c
+ * @brief 页缓存脏页的后台回写
+ *
+ * 回写线程每 WB_INTERVAL 毫秒醒来一次，回写存活超过 WB_EXPIRE 毫秒的脏页；
+ * 脏页占内存的比例超过 WB_BG_RATIO 时则不论新旧一并回写。写入者仅在比例超过
+ * WB_RATIO 时才需同步回写自己的脏页。如此，写操作得以平滑地落盘，而驱逐页缓存
+ * 时也就鲜有需要先行回写的脏页。
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/clock.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+#include <lunaix/timer.h>
+
+#define WB_INTERVAL 500
+#define WB_EXPIRE 3000
+
+// 脏页占可管理内存的百分比
+#define WB_BG_RATIO 10
+#define WB_RATIO 20
+
+// 每轮至多回写的页数，回写一轮后让出处理器
+#define WB_BATCH 32
+
+LOG_MODULE("WRITEBACK")
+
+static waitq_t wb_wq;
+static struct proc_info* kwritebackd;
+static u32_t wb_bg_thresh, wb_thresh;
+
+static struct
+{
+    u32_t rounds;
+    u32_t written;
+    u32_t throttled;
+} wb_stat;
+
+static void
+__wb_tick(void* arg)
+{
+    if (!waitq_empty(&wb_wq)) {
+        pwake_one(&wb_wq);
+    }
+}
+
+static void
+__kwritebackd(void* arg)
+{
+    while (1) {
+        cpu_disable_interrupt();
+
+        if (!pcache_nr_dirty()) {
+            pwait(&wb_wq);
+            continue;
+        }
+
+        time_t before = clock_systime();
+        if (pcache_nr_dirty() <= wb_bg_thresh) {
+            before -= WB_EXPIRE;
+        }
+
+        u32_t n = pcache_writeback(before, WB_BATCH);
+
+        wb_stat.rounds++;
+        wb_stat.written += n;
+
+        // 本轮写满了批量，说明仍有积压，稍作让步后继续；否则等待下一周期
+        if (n == WB_BATCH) {
+            sched_yieldk();
+            continue;
+        }
+
+        pwait(&wb_wq);
+    }
+}
+
+void
+pcache_balance_dirty(struct v_inode* inode)
+{
+    u32_t dirty = pcache_nr_dirty();
+
+    if (dirty > wb_bg_thresh && kwritebackd) {
+        __wb_tick(NULL);
+    }
+
+    if (dirty > wb_thresh) {
+        wb_stat.throttled++;
+        pcache_commit_all(inode);
+    }
+}
+
+static void
+__wb_rd_stat(struct twimap* map)
+{
+    twimap_printf(map,
+                  "%u %u %u %u\n",
+                  pcache_nr_dirty(),
+                  wb_stat.rounds,
+                  wb_stat.written,
+                  wb_stat.throttled);
+}
+
+void
+pcache_writeback_init()
+{
+    size_t managed = 0;
+    for (int i = 0; i < PM_NR_ZONES; i++) {
+        managed += pmm_zone(i)->managed;
+    }
+
+    wb_bg_thresh = managed * WB_BG_RATIO / 100;
+    wb_thresh = managed * WB_RATIO / 100;
+
+    waitq_init(&wb_wq);
+
+    kwritebackd = spawn_kthread(__kwritebackd, NULL);
+    if (!kwritebackd) {
+        kprintf(KWARN "fail to start writeback thread\n");
+        return;
+    }
+
+    if (!timer_run_ms(WB_INTERVAL, __wb_tick, NULL, TIMER_MODE_PERIODIC)) {
+        kprintf(KWARN "fail to arm writeback timer\n");
+    }
+
+    struct twimap* map = twifs_mapping(NULL, NULL, "writeback");
+    map->read = __wb_rd_stat;
+}
@@ -1,8 +1,30 @@
+/**
+ * @file xattr.c
+ * @brief 扩展属性及其缓存
+ *
+ * 每个 inode 的扩展属性按名称散列缓存，命中时无需调用文件系统。另有一条链表
+ * 串起全部表项，供 listxattr 与释放时遍历。经由 listxattr 载入全部属性之后，
+ * 缓存即为全集，未命中的查找直接视为不存在。
+ *
+ */
 #include <klibc/string.h>
 #include <lunaix/fs.h>
+#include <lunaix/mm/uaccess.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/syscall.h>
 
+// 散列表的初始大小，属性增多时自行扩张
+#define XATTR_HASH_BITS 3
+
+// 单个属性值的大小上限
+#define XATTR_VALUE_MAX 0x10000
+
+static u32_t
+__xattr_hashof(struct hlist_node* node)
+{
+    return container_of(node, struct v_xattr_entry, hash_list)->name.hash;
+}
+
 struct v_xattr_entry*
 xattr_new(struct hstr* name)
 {
@@ -10,25 +32,32 @@ xattr_new(struct hstr* name)
     if (!entry) {
         return NULL;
     }
-    *entry =
-      (struct v_xattr_entry){ .name = HHSTR(valloc(VFS_NAME_MAXLEN), 0, 0) };
+    *entry = (struct v_xattr_entry){};
 
-    hstrcpy(&entry->name, name);
+    // 各个 inode 上的同名属性（如 user.mime_type）共享同一份名称
+    hstr_intern(&entry->name, name);
     return entry;
 }
 
 void
 xattr_free(struct v_xattr_entry* entry)
 {
-    vfree(entry->name.value);
+    if (entry->value) {
+        vfree(entry->value);
+    }
+    hstr_release(&entry->name);
     vfree(entry);
 }
 
 struct v_xattr_entry*
 xattr_getcache(struct v_inode* inode, struct hstr* name)
 {
+    if (!inode->xattr_cache.buckets) {
+        return NULL;
+    }
+
     struct v_xattr_entry *pos, *n;
-    llist_for_each(pos, n, &inode->xattrs, entries)
+    rhtable_hash_foreach(&inode->xattr_cache, name->hash, pos, n, hash_list)
     {
         if (HSTR_EQ(&pos->name, name)) {
             return pos;
@@ -38,18 +67,44 @@ xattr_getcache(struct v_inode* inode, struct hstr* name)
     return NULL;
 }
 
-void
+int
 xattr_addcache(struct v_inode* inode, struct v_xattr_entry* xattr)
 {
+    struct rhtable* cache = &inode->xattr_cache;
+
+    if (!cache->buckets &&
+        rhtable_init(cache, XATTR_HASH_BITS, __xattr_hashof)) {
+        return ENOMEM;
+    }
+
+    rhtable_add(cache, &xattr->hash_list);
     llist_append(&inode->xattrs, &xattr->entries);
+    return 0;
 }
 
 void
 xattr_delcache(struct v_inode* inode, struct v_xattr_entry* xattr)
 {
+    rhtable_del(&inode->xattr_cache, &xattr->hash_list);
     llist_delete(&xattr->entries);
 }
 
+void
+xattr_release(struct v_inode* inode)
+{
+    struct v_xattr_entry *pos, *n;
+    llist_for_each(pos, n, &inode->xattrs, entries)
+    {
+        llist_delete(&pos->entries);
+        xattr_free(pos);
+    }
+
+    if (inode->xattr_cache.buckets) {
+        rhtable_free(&inode->xattr_cache);
+    }
+    inode->xattr_listed = 0;
+}
+
 int
 __vfs_getxattr(struct v_inode* inode,
                struct v_xattr_entry** xentry,
@@ -70,22 +125,34 @@ __vfs_getxattr(struct v_inode* inode,
 
     hstr_rehash(&hname, HSTR_FULL_HASH);
 
+    // 一切修改都经由缓存，命中的表项总是最新的
     struct v_xattr_entry* entry = xattr_getcache(inode, &hname);
-    if (!entry) {
-        if (!(entry = xattr_new(&hname))) {
-            return ENOMEM;
-        }
+    if (entry) {
+        *xentry = entry;
+        return 0;
+    }
+
+    if (inode->xattr_listed) {
+        return ENODATA;
     }
 
-    if (!(errno = inode->ops->getxattr(inode, entry))) {
+    if (!(entry = xattr_new(&hname))) {
+        return ENOMEM;
+    }
+
+    if (!(errno = inode->ops->getxattr(inode, entry)) &&
+        !(errno = xattr_addcache(inode, entry))) {
         *xentry = entry;
-        xattr_addcache(inode, entry);
     } else {
         xattr_free(entry);
     }
     return errno;
 }
 
+/**
+ * @brief 设置扩展属性，data 位于用户空间
+ *
+ */
 int
 __vfs_setxattr(struct v_inode* inode,
                const char* name,
@@ -99,10 +166,20 @@ __vfs_setxattr(struct v_inode* inode,
     int errno = 0;
     size_t slen = strlen(name);
 
-    if (slen > VFS_NAME_MAXLEN) {
+    if (slen > VFS_NAME_MAXLEN || len > XATTR_VALUE_MAX) {
         return ERANGE;
     }
 
+    void* value = valloc(len ? len : 1);
+    if (!value) {
+        return ENOMEM;
+    }
+
+    if (copy_from_user(value, data, len)) {
+        vfree(value);
+        return EFAULT;
+    }
+
     struct hstr hname = HSTR(name, slen);
 
     hstr_rehash(&hname, HSTR_FULL_HASH);
@@ -110,30 +187,89 @@ __vfs_setxattr(struct v_inode* inode,
     struct v_xattr_entry* entry = xattr_getcache(inode, &hname);
     if (!entry) {
         if (!(entry = xattr_new(&hname))) {
+            vfree(value);
             return ENOMEM;
         }
     } else {
         xattr_delcache(inode, entry);
     }
 
+    if (entry->value) {
+        vfree(entry->value);
+    }
+    entry->value = value;
+    entry->len = len;
+
     if ((errno = inode->ops->delxattr(inode, entry))) {
         xattr_free(entry);
         goto done;
     }
 
-    entry->value = data;
-    entry->len = len;
-
     if ((errno = inode->ops->setxattr(inode, entry))) {
         xattr_free(entry);
         goto done;
     }
 
-    xattr_addcache(inode, entry);
+    if ((errno = xattr_addcache(inode, entry))) {
+        xattr_free(entry);
+    }
 done:
     return errno;
 }
 
+/**
+ * @brief 将全部扩展属性的名称以 '\0' 分隔依次写入用户空间的 list。
+ * size 为零时仅返回所需的大小
+ *
+ */
+static int
+__vfs_listxattr(struct v_inode* inode, char* list, size_t size)
+{
+    int errno;
+
+    if (!inode->xattr_listed) {
+        if (!inode->ops->listxattr) {
+            return ENOTSUP;
+        }
+        if ((errno = inode->ops->listxattr(inode))) {
+            return errno;
+        }
+        inode->xattr_listed = 1;
+    }
+
+    size_t total = 0;
+    struct v_xattr_entry *pos, *n;
+    llist_for_each(pos, n, &inode->xattrs, entries)
+    {
+        total += pos->name.len + 1;
+    }
+
+    if (!size || !total) {
+        return total;
+    }
+
+    if (size < total) {
+        return ERANGE;
+    }
+
+    char* kbuf = valloc(total);
+    if (!kbuf) {
+        return ENOMEM;
+    }
+
+    size_t off = 0;
+    llist_for_each(pos, n, &inode->xattrs, entries)
+    {
+        memcpy(kbuf + off, pos->name.value, pos->name.len);
+        off += pos->name.len;
+        kbuf[off++] = '\0';
+    }
+
+    errno = copy_to_user(list, kbuf, total) ? EFAULT : (int)total;
+    vfree(kbuf);
+    return errno;
+}
+
 __DEFINE_LXSYSCALL4(int,
                     getxattr,
                     const char*,
@@ -162,7 +298,9 @@ __DEFINE_LXSYSCALL4(int,
         goto done;
     }
 
-    memcpy(value, xattr->value, len);
+    if (copy_to_user(value, xattr->value, xattr->len)) {
+        errno = EFAULT;
+    }
 
 done:
     return DO_STATUS(errno);
@@ -223,7 +361,9 @@ __DEFINE_LXSYSCALL4(int,
         goto done;
     }
 
-    memcpy(value, xattr->value, len);
+    if (copy_to_user(value, xattr->value, xattr->len)) {
+        errno = EFAULT;
+    }
 
 done:
     return DO_STATUS(errno);
@@ -254,4 +394,41 @@ __DEFINE_LXSYSCALL4(int,
 
 done:
     return DO_STATUS(errno);
-}
\ No newline at end of file
+}
+
+__DEFINE_LXSYSCALL3(int,
+                    listxattr,
+                    const char*,
+                    path,
+                    char*,
+                    list,
+                    size_t,
+                    size)
+{
+    struct v_dnode* dnode;
+    int errno = 0;
+
+    if ((errno = vfs_walk_proc(path, &dnode, NULL, 0))) {
+        goto done;
+    }
+
+    errno = __vfs_listxattr(dnode->inode, list, size);
+
+done:
+    return DO_STATUS_OR_RETURN(errno);
+}
+
+__DEFINE_LXSYSCALL3(int, flistxattr, int, fd, char*, list, size_t, size)
+{
+    struct v_fd* fd_s;
+    int errno = 0;
+
+    if ((errno = vfs_getfd(fd, &fd_s))) {
+        goto done;
+    }
+
+    errno = __vfs_listxattr(fd_s->file->inode, list, size);
+
+done:
+    return DO_STATUS_OR_RETURN(errno);
+}
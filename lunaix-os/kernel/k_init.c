@@ -1,10 +1,15 @@
+#include <lunaix/boottime.h>
 #include <lunaix/common.h>
+#include <lunaix/tty/fbcon.h>
 #include <lunaix/tty/tty.h>
 
 #include <lunaix/device.h>
 #include <lunaix/foptions.h>
+#include <lunaix/futex.h>
 #include <lunaix/input.h>
 #include <lunaix/isrm.h>
+#include <lunaix/kcmdline.h>
+#include <lunaix/klog.h>
 #include <lunaix/lxconsole.h>
 #include <lunaix/mm/mmio.h>
 #include <lunaix/mm/page.h>
@@ -16,8 +21,14 @@
 #include <lunaix/types.h>
 
 #include <arch/x86/boot/multiboot.h>
+#include <arch/x86/fpu.h>
 #include <arch/x86/idt.h>
 #include <arch/x86/interrupts.h>
+#include <arch/x86/tss.h>
+#include <hal/alternative.h>
+#include <hal/cpu.h>
+#include <hal/pmc.h>
+#include <lib/crc.h>
 
 #include <klibc/stdio.h>
 #include <klibc/string.h>
@@ -45,19 +56,35 @@ setup_memory(multiboot_memory_map_t* map, size_t map_size);
 void
 _kernel_pre_init()
 {
+    boot_phase("entry");
+
     // interrupts
     _init_idt();
+    dfault_init();
+    intr_stack_setup(0);
     isrm_init();
     intr_routine_init();
+    boot_phase("interrupts");
 
-    // memory
-    pmm_init(MEM_1MB + (_k_init_mb_info->mem_upper << 10));
-    vmm_init();
+    // 须先于任何使用 PG_CACHE_WC 的映射
+    cpu_init_pat();
+    pmc_init();
+
+    fpu_init();
+    alternatives_apply();
+    crc_select_impl();
+    boot_phase("cpu");
 
+    // memory
     unsigned int map_size =
       _k_init_mb_info->mmap_length / sizeof(multiboot_memory_map_t);
 
+    pmm_init((multiboot_memory_map_t*)_k_init_mb_info->mmap_addr, map_size);
+    boot_phase("pmm");
+    vmm_init();
+
     setup_memory((multiboot_memory_map_t*)_k_init_mb_info->mmap_addr, map_size);
+    boot_phase("memory");
 }
 
 void
@@ -65,15 +92,26 @@ _kernel_init()
 {
     int errno = 0;
 
+    // 命令行与 multiboot info 一同，将于 init_platform 的末尾被回收
+    if (present(_k_init_mb_info->flags, MULTIBOOT_INFO_CMDLINE)) {
+        kcmdline_init((const char*)_k_init_mb_info->cmdline);
+    }
+
     // allocators
     cake_init();
     valloc_init();
 
     sched_init();
+    futex_init();
+    boot_phase("allocators");
 
     // crt
-    tty_init(ioremap(VGA_FRAMEBUFFER, PG_SIZE));
+    tty_init(ioremap_cached(VGA_FRAMEBUFFER, PG_SIZE, PG_CACHE_WC));
     tty_set_theme(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    if (fbcon_init(_k_init_mb_info)) {
+        tty_enable_fbcon();
+    }
+    boot_phase("tty");
 
     // file system & device subsys
     vfs_init();
@@ -91,11 +129,14 @@ _kernel_init()
     vfs_mount("/dev", "devfs", NULL, 0);
     vfs_mount("/sys", "twifs", NULL, MNT_RO);
     vfs_mount("/task", "taskfs", NULL, MNT_RO);
+    boot_phase("vfs");
 
     lxconsole_spawn_ttydev();
     device_init_builtin();
+    klog_init_dev();
 
     syscall_install();
+    boot_phase("devices");
 
     spawn_proc0();
 }
@@ -145,11 +186,11 @@ spawn_proc0()
     // 直接切换到新的拷贝，进行配置。
     cpu_lcr3(proc0->page_table);
 
-    // 为内核创建一个专属栈空间。
-    for (size_t i = 0; i < (KSTACK_SIZE >> PG_SIZE_BITS); i++) {
+    // 为内核创建一个专属栈空间。只映射栈顶的一部分，其下留作保护页
+    for (size_t i = 0; i < (KSTACK_MAPPED_SIZE >> PG_SIZE_BITS); i++) {
         uintptr_t pa = pmm_alloc_page(KERNEL_PID, 0);
         vmm_set_mapping(PD_REFERENCED,
-                        KSTACK_START + (i << PG_SIZE_BITS),
+                        KSTACK_MAPPED_START + (i << PG_SIZE_BITS),
                         pa,
                         PG_PREM_RW,
                         VMAP_NULL);
@@ -170,15 +211,14 @@ spawn_proc0()
                  : "%ebx", "memory");
 
     // 加载x87默认配置
-    asm volatile("fninit\n"
-                 "fxsave (%%eax)" ::"a"(proc0->fxstate)
-                 : "memory");
+    fpu_init_state(proc0->fxstate);
 
     // 向调度器注册进程。
     commit_process(proc0);
 
     // 由于时钟中断与APIC未就绪，我们需要手动进行第一次调度。这里也会同时隐式地恢复我们的eflags.IF位
     proc0->state = PS_RUNNING;
+    fpu_switch(proc0);
     asm volatile("pushl %0\n"
                  "jmp switch_to\n" ::"r"(proc0));
 
@@ -193,22 +233,7 @@ extern void __usrtext_end;
 void
 setup_memory(multiboot_memory_map_t* map, size_t map_size)
 {
-
-    // First pass, to mark the physical pages
-    for (unsigned int i = 0; i < map_size; i++) {
-        multiboot_memory_map_t mmap = map[i];
-        if (mmap.type == MULTIBOOT_MEMORY_AVAILABLE) {
-            // 整数向上取整除法
-            uintptr_t pg = map[i].addr_low + 0x0fffU;
-            pmm_mark_chunk_free(pg >> PG_SIZE_BITS,
-                                map[i].len_low >> PG_SIZE_BITS);
-        }
-    }
-
-    // 将内核占据的页，包括前1MB，hhk_init 设为已占用
-    size_t pg_count = V2P(&__kernel_end) >> PG_SIZE_BITS;
-    pmm_mark_chunk_occupied(KERNEL_PID, 0, pg_count, PP_FGLOCKED);
-
+    // 物理页的标注已由 pmm_init 完成
     for (uintptr_t i = &__usrtext_start; i < &__usrtext_end; i += PG_SIZE) {
         vmm_set_mapping(PD_REFERENCED, i, V2P(i), PG_PREM_UR, VMAP_NULL);
     }
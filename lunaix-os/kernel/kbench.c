@@ -0,0 +1,364 @@
+/**
+ * @file kbench.c
+ * @brief 内核原语的微基准，见 lunaix/kbench.h
+ *
+ * 成对的操作（如分配与释放）作为一次操作计时，以免释放的代价被遗漏，
+ * 也使得每一轮结束后的状态与开始时相同。
+ *
+ */
+#include <arch/x86/vectors.h>
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/ds/btrie.h>
+#include <lunaix/foptions.h>
+#include <lunaix/fs.h>
+#include <lunaix/kbench.h>
+#include <lunaix/kcmdline.h>
+#include <lunaix/mm/cake.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+#include <lunaix/syscall.h>
+#include <lunaix/syslog.h>
+#include <lunaix/timer.h>
+
+LOG_MODULE("KBENCH")
+
+#define KBENCH_FILE "/kbench.tmp"
+#define KBENCH_FILE_PAGES 4
+#define KBENCH_WALK_PATH "/dev/tty"
+
+/* ---- 内存分配 ---- */
+
+static struct cake_pile* bench_pile;
+
+static int
+__cake_setup(struct kbench* bench)
+{
+    // 蛋糕堆无法销毁，只创建一次
+    if (!bench_pile) {
+        bench_pile = cake_new_pile("kbench", bench->arg, 1, 0);
+    }
+    return !bench_pile;
+}
+
+static void
+__cake_op(struct kbench* bench, u32_t i)
+{
+    cake_release(bench_pile, cake_grab(bench_pile));
+}
+
+static void
+__valloc_op(struct kbench* bench, u32_t i)
+{
+    vfree(valloc(bench->arg));
+}
+
+static void
+__pmm_op(struct kbench* bench, u32_t i)
+{
+    void* pg = pmm_alloc_page(KERNEL_PID, 0);
+    if (pg) {
+        pmm_free_page(KERNEL_PID, pg);
+    }
+}
+
+/* ---- btrie ---- */
+
+static struct btrie bench_btrie;
+
+static int
+__btrie_setup(struct kbench* bench)
+{
+    btrie_init(&bench_btrie, PG_SIZE_BITS);
+    for (u32_t i = 0; i < KBENCH_BATCH; i++) {
+        btrie_set(&bench_btrie, i << PG_SIZE_BITS, (void*)(i + 1));
+    }
+    return 0;
+}
+
+static void
+__btrie_get_op(struct kbench* bench, u32_t i)
+{
+    btrie_get(&bench_btrie, i << PG_SIZE_BITS);
+}
+
+static void
+__btrie_set_op(struct kbench* bench, u32_t i)
+{
+    btrie_set(&bench_btrie, i << PG_SIZE_BITS, (void*)(i + 1));
+}
+
+static void
+__btrie_teardown(struct kbench* bench)
+{
+    btrie_release(&bench_btrie);
+}
+
+/* ---- 文件系统 ---- */
+
+extern struct lru_zone* inode_lru; /* vfs.c */
+
+static int bench_fd;
+static struct v_inode* bench_inode;
+static char bench_buf[64];
+
+static int
+__pcache_setup(struct kbench* bench)
+{
+    struct v_fd* fd_s;
+    int errno;
+
+    if ((bench_fd = vfs_do_open(KBENCH_FILE, FO_CREATE)) < 0) {
+        return bench_fd;
+    }
+
+    vfs_getfd(bench_fd, &fd_s);
+    bench_inode = fd_s->file->inode;
+
+    // 文件由本基准独占，整个过程中持有其锁，读取时便无需逐次加锁
+    lock_inode(bench_inode);
+
+    // 写入的页留在页缓存中，此后的读取全部命中
+    memset(bench_buf, 0x5a, sizeof(bench_buf));
+    for (u32_t pos = 0; pos < KBENCH_FILE_PAGES * PG_SIZE;
+         pos += sizeof(bench_buf)) {
+        errno = pcache_write(bench_inode, bench_buf, sizeof(bench_buf), pos);
+        if (errno < 0) {
+            unlock_inode(bench_inode);
+            vfs_do_close(bench_fd);
+            vfs_do_unlink(KBENCH_FILE);
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
+static void
+__pcache_op(struct kbench* bench, u32_t i)
+{
+    u32_t pos = (i * sizeof(bench_buf)) % (KBENCH_FILE_PAGES * PG_SIZE);
+    pcache_read(bench_inode, bench_buf, sizeof(bench_buf), pos, NULL);
+}
+
+static void
+__pcache_teardown(struct kbench* bench)
+{
+    unlock_inode(bench_inode);
+    vfs_do_close(bench_fd);
+    vfs_do_unlink(KBENCH_FILE);
+}
+
+static int
+__walk_setup(struct kbench* bench)
+{
+    struct v_dnode* dnode;
+    return vfs_walk(NULL, KBENCH_WALK_PATH, &dnode, NULL, 0);
+}
+
+static void
+__walk_op(struct kbench* bench, u32_t i)
+{
+    struct v_dnode* dnode;
+    vfs_walk(NULL, KBENCH_WALK_PATH, &dnode, NULL, 0);
+}
+
+/* ---- 调度与系统调用 ---- */
+
+static struct proc_info* partner;
+static waitq_t partner_wait;
+static volatile int pingpong;
+
+static void
+__partner_main(void* arg)
+{
+    while (1) {
+        // 检查与入队之间不得插入唤醒，否则将错过之
+        cpu_disable_interrupt();
+        if (!pingpong) {
+            pwait(&partner_wait);
+            continue;
+        }
+        sched_yieldk();
+    }
+}
+
+static int
+__ctxsw_setup(struct kbench* bench)
+{
+    // 内核线程不会退出，只创建一次，空闲时阻塞于 partner_wait
+    if (!partner) {
+        waitq_init(&partner_wait);
+        if (!(partner = spawn_kthread(__partner_main, NULL))) {
+            return ENOMEM;
+        }
+    }
+
+    pingpong = 1;
+    pwake_all(&partner_wait);
+    return 0;
+}
+
+static void
+__ctxsw_op(struct kbench* bench, u32_t i)
+{
+    // 让出至 partner，其随即让出回来：一次操作包含两次切换
+    sched_yieldk();
+}
+
+static void
+__ctxsw_teardown(struct kbench* bench)
+{
+    pingpong = 0;
+}
+
+static void
+__syscall_op(struct kbench* bench, u32_t i)
+{
+    // 内核态无法经由 SYSENTER 进入，故测量的是中断门的往返
+    int v;
+    asm volatile("int %1"
+                 : "=a"(v)
+                 : "i"(LUNAIX_SYS_CALL), "a"(__SYSCALL_getpid)
+                 : "memory");
+}
+
+/* ---- 基准列表 ---- */
+
+#define __VALLOC_BENCH(size)                                                   \
+    {                                                                          \
+        .name = "valloc_" #size, .op = __valloc_op, .arg = size                \
+    }
+
+static struct kbench benches[] = {
+    { .name = "cake_grab_release",
+      .setup = __cake_setup,
+      .op = __cake_op,
+      .arg = 64 },
+    __VALLOC_BENCH(8),
+    __VALLOC_BENCH(16),
+    __VALLOC_BENCH(32),
+    __VALLOC_BENCH(64),
+    __VALLOC_BENCH(128),
+    __VALLOC_BENCH(256),
+    __VALLOC_BENCH(512),
+    __VALLOC_BENCH(1024),
+    __VALLOC_BENCH(2048),
+    __VALLOC_BENCH(4096),
+    __VALLOC_BENCH(8192),
+    { .name = "pmm_alloc_free", .op = __pmm_op },
+    { .name = "btrie_get",
+      .setup = __btrie_setup,
+      .op = __btrie_get_op,
+      .teardown = __btrie_teardown },
+    { .name = "btrie_set",
+      .setup = __btrie_setup,
+      .op = __btrie_set_op,
+      .teardown = __btrie_teardown },
+    { .name = "pcache_read_hit",
+      .setup = __pcache_setup,
+      .op = __pcache_op,
+      .teardown = __pcache_teardown },
+    { .name = "path_walk", .setup = __walk_setup, .op = __walk_op },
+    { .name = "sched_yield_pingpong",
+      .setup = __ctxsw_setup,
+      .op = __ctxsw_op,
+      .teardown = __ctxsw_teardown },
+    { .name = "syscall_getpid", .op = __syscall_op },
+};
+
+#define NR_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+/**
+ * @brief name 是否在以逗号分隔的列表 list 中。空列表包含一切
+ *
+ */
+static int
+__kbench_selected(const char* list, const char* name)
+{
+    if (!*list) {
+        return 1;
+    }
+
+    size_t len = strlen(name);
+    while (*list) {
+        const char* end = strchr(list, ',');
+        size_t n = end ? (size_t)(end - list) : strlen(list);
+
+        if (n == len && !memcmp(list, name, len)) {
+            return 1;
+        }
+        if (!end) {
+            break;
+        }
+        list = end + 1;
+    }
+    return 0;
+}
+
+static void
+__kbench_one(struct kbench* bench)
+{
+    u32_t min = (u32_t)-1, max = 0;
+    u64_t total = 0;
+    int errno;
+
+    if (bench->setup && (errno = bench->setup(bench))) {
+        kprintf("name=%s skipped=%d\n", bench->name, errno);
+        return;
+    }
+
+    // 首轮用于预热缓存与分配器，不计入
+    for (u32_t i = 0; i < KBENCH_BATCH; i++) {
+        bench->op(bench, i);
+    }
+
+    for (u32_t r = 0; r < KBENCH_ROUNDS; r++) {
+        u64_t t0 = cpu_rdtsc();
+        for (u32_t i = 0; i < KBENCH_BATCH; i++) {
+            bench->op(bench, i);
+        }
+        u32_t cycles = (u32_t)((cpu_rdtsc() - t0) / KBENCH_BATCH);
+
+        total += cycles;
+        min = MIN(min, cycles);
+        max = MAX(max, cycles);
+    }
+
+    if (bench->teardown) {
+        bench->teardown(bench);
+    }
+
+    kprintf("name=%s n=%u min=%u avg=%u max=%u\n",
+            bench->name,
+            KBENCH_BATCH * KBENCH_ROUNDS,
+            min,
+            (u32_t)(total / KBENCH_ROUNDS),
+            max);
+}
+
+void
+kbench_run()
+{
+    const char* list = kcmdline_get("bench");
+    if (!list) {
+        return;
+    }
+
+    struct lx_timer_context* ctx = timer_context();
+    u32_t tsc_khz = ctx ? (u32_t)(ctx->tsc_frequency / 1000) : 0;
+
+    kprintf("begin tsc_khz=%u\n", tsc_khz);
+
+    for (u32_t i = 0; i < NR_BENCHES; i++) {
+        if (__kbench_selected(list, benches[i].name)) {
+            __kbench_one(&benches[i]);
+        }
+    }
+
+    kprintf("end\n");
+}
@@ -0,0 +1,77 @@
+#include <klibc/string.h>
+#include <lunaix/kcmdline.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("CMDLINE")
+
+struct kcmdline_opt
+{
+    const char* key;
+    const char* value;
+};
+
+static char kcmdline[KCMDLINE_MAXLEN];
+static struct kcmdline_opt opts[KCMDLINE_MAXOPTS];
+static int nr_opts = 0;
+
+static inline int
+__is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+void
+kcmdline_init(const char* cmdline)
+{
+    if (!cmdline) {
+        return;
+    }
+
+    strncpy(kcmdline, cmdline, KCMDLINE_MAXLEN - 1);
+
+    // 就地切分：空白与每项中的第一个 '=' 替换为 '\0'
+    char* p = kcmdline;
+    while (*p) {
+        while (__is_space(*p)) {
+            *p++ = '\0';
+        }
+        if (!*p) {
+            break;
+        }
+
+        if (nr_opts == KCMDLINE_MAXOPTS) {
+            kprintf(KWARN "too many options, ignoring: %s\n", p);
+            break;
+        }
+
+        struct kcmdline_opt* opt = &opts[nr_opts++];
+        char* eq = NULL;
+        opt->key = p;
+
+        while (*p && !__is_space(*p)) {
+            if (*p == '=' && !eq) {
+                eq = p;
+            }
+            p++;
+        }
+
+        if (eq) {
+            *eq = '\0';
+            opt->value = eq + 1;
+        } else {
+            opt->value = "";
+        }
+    }
+}
+
+const char*
+kcmdline_get(const char* key)
+{
+    // 重复的选项以最后一次出现的为准
+    for (int i = nr_opts - 1; i >= 0; i--) {
+        if (streq(opts[i].key, key)) {
+            return opts[i].value;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,226 @@
+#include <hal/cpu.h>
+#include <lunaix/device.h>
+#include <lunaix/klog.h>
+#include <lunaix/spike.h>
+#include <lunaix/workqueue.h>
+
+#include <klibc/stdio.h>
+#include <klibc/string.h>
+
+#define KLOG_MASK (KLOG_SIZE - 1)
+
+static char klog_buf[KLOG_SIZE];
+// 已写入的字节总数（自由增长），环中保留的是其之前的 KLOG_SIZE 个字节
+static volatile size_t klog_head = 0;
+
+static DEFINE_LLIST(klog_sinks);
+
+static struct lx_work klog_work;
+static volatile int klog_async = 0;
+static volatile int klog_draining = 0;
+
+static void
+__klog_copyout(void* dest, size_t pos, size_t len)
+{
+    size_t off = pos & KLOG_MASK;
+    size_t cplen_tail = MIN(KLOG_SIZE - off, len);
+    memcpy(dest, &klog_buf[off], cplen_tail);
+    memcpy(dest + cplen_tail, klog_buf, len - cplen_tail);
+}
+
+static size_t
+__klog_tail()
+{
+    return klog_head > KLOG_SIZE ? klog_head - KLOG_SIZE : 0;
+}
+
+static void
+__klog_drain_sink(struct klog_sink* sink)
+{
+    char batch[KLOG_BATCH];
+    size_t len;
+
+    do {
+        // 取出一批时屏蔽中断，以免其间被新的日志覆盖
+        int intr = cpu_reflags() & 0x0200;
+        cpu_disable_interrupt();
+
+        size_t tail = __klog_tail();
+        if (sink->pos < tail) {
+            sink->lost += tail - sink->pos;
+            sink->pos = tail;
+        }
+
+        len = MIN(klog_head - sink->pos, KLOG_BATCH);
+        __klog_copyout(batch, sink->pos, len);
+        sink->pos += len;
+
+        if (intr) {
+            cpu_enable_interrupt();
+        }
+
+        if (len) {
+            sink->write(sink, batch, len);
+        }
+    } while (len);
+}
+
+static void
+__klog_drain(int force)
+{
+    // 同步模式下，输出期间（于中断中）新追加的日志由外层一并取走
+    if (klog_draining && !force) {
+        return;
+    }
+    klog_draining = 1;
+
+    size_t seen;
+    do {
+        seen = klog_head;
+
+        struct klog_sink *pos, *n;
+        llist_for_each(pos, n, &klog_sinks, sinks)
+        {
+            __klog_drain_sink(pos);
+        }
+    } while (seen != klog_head);
+
+    klog_draining = 0;
+}
+
+static void
+__klog_drain_work(void* arg)
+{
+    __klog_drain(0);
+}
+
+static void
+__klog_notify()
+{
+    if (klog_async) {
+        work_submit(&klog_work);
+    } else {
+        __klog_drain(0);
+    }
+}
+
+void
+klog_append(const char* data, size_t len)
+{
+    if (len > KLOG_SIZE) {
+        data += len - KLOG_SIZE;
+        len = KLOG_SIZE;
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    size_t off = klog_head & KLOG_MASK;
+    size_t cplen_tail = MIN(KLOG_SIZE - off, len);
+    memcpy(&klog_buf[off], data, cplen_tail);
+    memcpy(klog_buf, data + cplen_tail, len - cplen_tail);
+    klog_head += len;
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    __klog_notify();
+}
+
+int
+klog_begin(struct kfmt_out* out, size_t max_len)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // 屏蔽中断期间没有输出端读取环，被覆盖的最旧内容于提交后计入其丢失的部分
+    *out = (struct kfmt_out){ .buf = klog_buf,
+                              .mask = KLOG_MASK,
+                              .pos = klog_head,
+                              .end = klog_head + MIN(max_len, KLOG_SIZE) };
+    return intr;
+}
+
+void
+klog_commit(struct kfmt_out* out, int intr)
+{
+    klog_head = out->pos;
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    __klog_notify();
+}
+
+void
+klog_add_sink(struct klog_sink* sink)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    sink->pos = __klog_tail();
+    sink->lost = 0;
+    llist_append(&klog_sinks, &sink->sinks);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    if (klog_async) {
+        work_submit(&klog_work);
+    } else {
+        __klog_drain(0);
+    }
+}
+
+void
+klog_start_async()
+{
+    work_init(&klog_work, __klog_drain_work, NULL);
+    klog_async = 1;
+    work_submit(&klog_work);
+}
+
+void
+klog_flush()
+{
+    __klog_drain(1);
+}
+
+static int
+__klog_read(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    // 偏移量相对于环中最旧的内容
+    size_t start = __klog_tail() + offset;
+    if (start >= klog_head) {
+        len = 0;
+    } else {
+        len = MIN(len, klog_head - start);
+        __klog_copyout(buf, start, len);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    return len;
+}
+
+static int
+__klog_read_pg(struct device* dev, void* buf, foff_t offset)
+{
+    return __klog_read(dev, buf, offset, PG_SIZE);
+}
+
+void
+klog_init_dev()
+{
+    struct device* dev = device_addseq(NULL, NULL, "klog");
+    dev->read = __klog_read;
+    dev->read_page = __klog_read_pg;
+}
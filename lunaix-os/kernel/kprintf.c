@@ -1,12 +1,22 @@
 #include <klibc/stdio.h>
-#include <lunaix/lxconsole.h>
+#include <klibc/string.h>
+#include <lunaix/klog.h>
 #include <lunaix/spike.h>
 #include <lunaix/syscall.h>
 #include <lunaix/syslog.h>
 #include <lunaix/tty/tty.h>
 
 #define MAX_KPRINTF_BUF_SIZE 512
-#define MAX_XFMT_SIZE 512
+
+static const char* const level_prefix[] = { "- ",
+                                            "\033[6;0mW ",
+                                            "\033[12;0mE ",
+                                            "\033[9;0mD " };
+
+static const u8_t level_prefix_len[] = { 2, 8, 9, 8 };
+
+#define LEVEL_SUFFIX "\033[39;49m"
+#define LEVEL_SUFFIX_LEN (sizeof(LEVEL_SUFFIX) - 1)
 
 void
 __kprintf_internal(const char* component,
@@ -14,41 +24,26 @@ __kprintf_internal(const char* component,
                    const char* fmt,
                    va_list args)
 {
-    char buf[MAX_KPRINTF_BUF_SIZE];
-    char expanded_fmt[MAX_XFMT_SIZE];
-
-    switch (log_level) {
-        case 1:
-            // tty_set_theme(VGA_COLOR_BROWN, current_theme >> 12);
-            ksnprintf(expanded_fmt,
-                      MAX_XFMT_SIZE,
-                      "\033[6;0mW %s: %s\033[39;49m",
-                      component,
-                      fmt);
-            break;
-        case 2:
-            // tty_set_theme(VGA_COLOR_LIGHT_RED, current_theme >> 12);
-            ksnprintf(expanded_fmt,
-                      MAX_XFMT_SIZE,
-                      "\033[12;0mE %s: %s\033[39;49m",
-                      component,
-                      fmt);
-            break;
-        case 3:
-            // tty_set_theme(VGA_COLOR_LIGHT_BLUE, current_theme >> 12);
-            ksnprintf(expanded_fmt,
-                      MAX_XFMT_SIZE,
-                      "\033[9;0mD %s: %s\033[39;49m",
-                      component,
-                      fmt);
-            break;
-        default:
-            ksnprintf(expanded_fmt, MAX_XFMT_SIZE, "- %s: %s", component, fmt);
-            break;
+    struct kfmt_out out;
+
+    if (log_level < 0 || log_level > 3) {
+        log_level = 0;
+    }
+
+    // 前缀、消息与后缀一遍写入日志环，无需经由栈上的缓冲
+    int intr = klog_begin(&out, MAX_KPRINTF_BUF_SIZE - LEVEL_SUFFIX_LEN);
+
+    kfmt_write(&out, level_prefix[log_level], level_prefix_len[log_level]);
+    kfmt_write(&out, component, strlen(component));
+    kfmt_write(&out, ": ", 2);
+    kfmt_vformat(&out, fmt, args);
+
+    if (log_level) {
+        out.end = out.pos + LEVEL_SUFFIX_LEN;
+        kfmt_write(&out, LEVEL_SUFFIX, LEVEL_SUFFIX_LEN);
     }
 
-    __ksprintf_internal(buf, expanded_fmt, MAX_KPRINTF_BUF_SIZE, args);
-    console_write_str(buf);
+    klog_commit(&out, intr);
 }
 
 void
@@ -112,17 +107,14 @@ kprint_hex(const void* buffer, unsigned int size)
     ch_cache[0] = '|';
     ch_cache[1] = ' ';
     while (size) {
-        ksnprintf(buf, 64, " %.4p: ", ptr);
-        console_write_str(buf);
+        klog_append(buf, ksnprintf(buf, 16, " %.4p: ", ptr) - 1);
         for (i = 0; i < 8 && size; i++, size--, ptr++) {
             unsigned char c = *(data + ptr) & 0xff;
             ch_cache[2 + i] = (32 <= c && c < 127) ? c : '.';
-            ksnprintf(buf, 64, "%.2x  ", c);
-            console_write_str(buf);
+            klog_append(buf, ksnprintf(buf, 16, "%.2x  ", c) - 1);
         }
-        ch_cache[2 + i] = '\0';
-        console_write_str(ch_cache);
-        console_write_char('\n');
+        ch_cache[2 + i] = '\n';
+        klog_append(ch_cache, 3 + i);
     }
 }
 
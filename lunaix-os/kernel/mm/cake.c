@@ -16,29 +16,65 @@
 #include <lunaix/mm/vmm.h>
 #include <lunaix/spike.h>
 #include <lunaix/syslog.h>
+#include <lunaix/trace.h>
 
 LOG_MODULE("CAKE")
 
-#define CACHE_LINE_SIZE 128
+// DMA缓冲区所需的对齐
+#define DMA_ALIGN_SIZE 128
+
+#define CACHE_LINE_SIZE 64
 
 struct cake_pile master_pile;
 
+static struct cake_pile* mag_pile;
+
 struct llist_header piles = { .next = &piles, .prev = &piles };
 
 void*
-__alloc_cake(unsigned int cake_pg)
+__alloc_cake(struct cake_pile* pile)
 {
-    uintptr_t pa = pmm_alloc_cpage(KERNEL_PID, cake_pg, 0);
+    unsigned int cake_pg = pile->pg_per_cake;
+    pp_attr_t attr = (pile->options & PILE_DMA) ? PP_GFP_DMA : 0;
+    uintptr_t pa = pmm_alloc_cpage(KERNEL_PID, cake_pg, attr);
     if (!pa) {
         return NULL;
     }
-    return vmm_vmap(pa, cake_pg * PG_SIZE, PG_PREM_RW);
+
+    void* cake = vmm_vmap(pa, cake_pg * PG_SIZE, PG_PREM_RW);
+
+    // 此后这些页的引用由内核映射持有，解除映射即可归还
+    for (size_t i = 0; i < cake_pg; i++) {
+        pmm_free_page(KERNEL_PID, pa + i * PG_SIZE);
+    }
+
+    return cake;
+}
+
+static void
+__free_cake(struct cake_pile* pile, struct cake_s* cake)
+{
+    if (pile->dtor) {
+        for (size_t i = 0; i < pile->pieces_per_cake; i++) {
+            pile->dtor(pile, cake->first_piece + i * pile->piece_size);
+        }
+    }
+
+    for (size_t i = 0; i < pile->pg_per_cake; i++) {
+        uintptr_t pa = (uintptr_t)vmm_v2p((void*)cake + i * PG_SIZE);
+        pmm_query((void*)pa)->cake_pg = 0;
+    }
+
+    llist_delete(&cake->cakes);
+    pile->cakes_count--;
+
+    vmm_vunmap((uintptr_t)cake, pile->pg_per_cake * PG_SIZE);
 }
 
 struct cake_s*
 __new_cake(struct cake_pile* pile)
 {
-    struct cake_s* cake = __alloc_cake(pile->pg_per_cake);
+    struct cake_s* cake = __alloc_cake(pile);
 
     if (!cake) {
         return NULL;
@@ -46,7 +82,19 @@ __new_cake(struct cake_pile* pile)
 
     int max_piece = pile->pieces_per_cake;
 
-    cake->first_piece = (void*)((uintptr_t)cake + pile->offset);
+    // 在物理页上留下记号，这样归还时便可直接找到所属的蛋糕
+    for (size_t i = 0; i < pile->pg_per_cake; i++) {
+        uintptr_t pa = (uintptr_t)vmm_v2p((void*)cake + i * PG_SIZE);
+        pmm_query((void*)pa)->cake_pg = i + 1;
+    }
+
+    // 着色：将各蛋糕的首个切块儿错开不同的缓存行，以免不同蛋糕中
+    //  同一位置的对象总是映射至相同的缓存组
+    unsigned int color = pile->next_color * pile->color_step;
+    pile->next_color = (pile->next_color + 1) % pile->nr_colors;
+
+    cake->owner = pile;
+    cake->first_piece = (void*)((uintptr_t)cake + pile->offset + color);
     cake->next_free = 0;
     pile->cakes_count++;
 
@@ -56,6 +104,13 @@ __new_cake(struct cake_pile* pile)
     }
     free_list[max_piece - 1] = EO_FREE_PIECE;
 
+    // 对象缓存：每块儿仅于此构造一次，此后在拿取与归还间保持已构造的状态
+    if (pile->ctor) {
+        for (size_t i = 0; i < max_piece; i++) {
+            pile->ctor(pile, cake->first_piece + i * pile->piece_size);
+        }
+    }
+
     llist_append(&pile->free, &cake->cakes);
 
     return cake;
@@ -76,35 +131,58 @@ __init_pile(struct cake_pile* pile,
 
     // 默认每块儿蛋糕对齐到地址总线宽度
     if ((options & PILE_CACHELINE)) {
-        // 对齐到128字节缓存行大小，主要用于DMA
+        // 对齐到128字节，主要用于DMA
+        offset = DMA_ALIGN_SIZE;
+    } else if ((options & PILE_HWALIGN)) {
         offset = CACHE_LINE_SIZE;
     }
 
     piece_size = ROUNDUP(piece_size, offset);
     *pile = (struct cake_pile){ .piece_size = piece_size,
-                                .cakes_count = 1,
                                 .pieces_per_cake =
                                   (pg_per_cake * PG_SIZE) /
                                   (piece_size + sizeof(piece_index_t)),
-                                .pg_per_cake = pg_per_cake };
+                                .pg_per_cake = pg_per_cake,
+                                .options = options };
 
     unsigned int free_list_size = pile->pieces_per_cake * sizeof(piece_index_t);
 
     pile->offset = ROUNDUP(sizeof(struct cake_s) + free_list_size, offset);
     pile->pieces_per_cake -= ICEIL((pile->offset - free_list_size), piece_size);
 
+    // 切分后剩余的尾部空间用于着色，步长不小于一个缓存行，且保持切块儿的对齐
+    unsigned int leftover = pg_per_cake * PG_SIZE - pile->offset -
+                            pile->pieces_per_cake * piece_size;
+    pile->color_step = MAX(offset, CACHE_LINE_SIZE);
+    pile->nr_colors = leftover / pile->color_step + 1;
+
     strncpy(pile->pile_name, name, PILE_NAME_MAXLEN);
 
     llist_init_head(&pile->free);
     llist_init_head(&pile->full);
     llist_init_head(&pile->partial);
+    llist_init_head(&pile->depot.full);
+    llist_init_head(&pile->depot.empty);
     llist_append(&piles, &pile->piles);
 }
 
+static void
+__mag_ctor(struct cake_pile* pile, void* piece)
+{
+    // 弹匣总是清空后才归还，故空载即为其已构造的状态
+    struct cake_magazine* mag = (struct cake_magazine*)piece;
+    llist_init_head(&mag->mags);
+    mag->rounds = 0;
+}
+
 void
 cake_init()
 {
-    __init_pile(&master_pile, "pinkamina", sizeof(master_pile), 1, 0);
+    __init_pile(&master_pile, "pinkamina", sizeof(master_pile), 1, PILE_NOMAG);
+
+    mag_pile = cake_new_pile(
+      "cake_mag", sizeof(struct cake_magazine), 1, PILE_NOMAG);
+    cake_set_constructor(mag_pile, __mag_ctor);
 }
 
 struct cake_pile*
@@ -126,8 +204,14 @@ cake_set_constructor(struct cake_pile* pile, pile_cb ctor)
     pile->ctor = ctor;
 }
 
-void*
-cake_grab(struct cake_pile* pile)
+void
+cake_set_destructor(struct cake_pile* pile, pile_cb dtor)
+{
+    pile->dtor = dtor;
+}
+
+static void*
+__cake_grab_piece(struct cake_pile* pile)
 {
     struct cake_s *pos, *n;
     if (!llist_empty(&pile->partial)) {
@@ -153,40 +237,52 @@ cake_grab(struct cake_pile* pile)
         llist_append(&pile->partial, &pos->cakes);
     }
 
-    void* ptr =
-      (void*)((uintptr_t)pos->first_piece + found_index * pile->piece_size);
+    return (void*)((uintptr_t)pos->first_piece +
+                   found_index * pile->piece_size);
+}
 
-    if (pile->ctor) {
-        pile->ctor(pile, ptr);
+static struct cake_s*
+__cake_of(void* area)
+{
+    uintptr_t pa = (uintptr_t)vmm_v2p(area);
+    if (!pa) {
+        return NULL;
     }
 
-    return ptr;
+    struct pp_struct* pp = pmm_query((void*)pa);
+    if (!pp || !pp->cake_pg) {
+        return NULL;
+    }
+
+    // 蛋糕的头部总是位于其首页的起始处
+    return (struct cake_s*)(PG_ALIGN(area) - (pp->cake_pg - 1) * PG_SIZE);
 }
 
-int
-cake_release(struct cake_pile* pile, void* area)
+struct cake_pile*
+cake_query_pile(void* area)
 {
-    piece_index_t piece_index;
-    struct cake_s *pos, *n;
-    struct llist_header* hdrs[2] = { &pile->full, &pile->partial };
-
-    for (size_t i = 0; i < 2; i++) {
-        llist_for_each(pos, n, hdrs[i], cakes)
-        {
-            if (pos->first_piece > area) {
-                continue;
-            }
-            piece_index =
-              (uintptr_t)(area - pos->first_piece) / pile->piece_size;
-            if (piece_index < pile->pieces_per_cake) {
-                goto found;
-            }
-        }
+    struct cake_s* cake = __cake_of(area);
+    return cake ? cake->owner : NULL;
+}
+
+static int
+__cake_valid_piece(struct cake_pile* pile, struct cake_s* pos, void* area)
+{
+    if (!pos || pos->owner != pile || pos->first_piece > area) {
+        return 0;
     }
 
-    return 0;
+    piece_index_t piece_index =
+      (uintptr_t)(area - pos->first_piece) / pile->piece_size;
+    return piece_index < pile->pieces_per_cake;
+}
+
+static void
+__cake_release_piece(struct cake_pile* pile, struct cake_s* pos, void* area)
+{
+    piece_index_t piece_index =
+      (uintptr_t)(area - pos->first_piece) / pile->piece_size;
 
-found:
     pos->free_list[piece_index] = pos->next_free;
     pos->next_free = piece_index;
     pos->used_pieces--;
@@ -198,10 +294,265 @@ found:
     } else {
         llist_append(&pile->partial, &pos->cakes);
     }
+}
+
+/* ------ 弹匣层 ------ */
+
+static inline int
+__mag_empty(struct cake_magazine* mag)
+{
+    return !mag || !mag->rounds;
+}
+
+static inline int
+__mag_full(struct cake_magazine* mag)
+{
+    return !mag || mag->rounds == CAKE_MAG_ROUNDS;
+}
+
+static struct cake_magazine*
+__depot_take_full(struct cake_depot* depot)
+{
+    if (llist_empty(&depot->full)) {
+        return NULL;
+    }
+
+    struct cake_magazine* mag =
+      list_entry(depot->full.next, struct cake_magazine, mags);
+    llist_delete(&mag->mags);
+    depot->full_count--;
+
+    return mag;
+}
+
+static struct cake_magazine*
+__depot_take_empty(struct cake_depot* depot)
+{
+    struct cake_magazine* mag;
+    if (llist_empty(&depot->empty)) {
+        return (struct cake_magazine*)__cake_grab_piece(mag_pile);
+    }
+
+    mag = list_entry(depot->empty.next, struct cake_magazine, mags);
+    llist_delete(&mag->mags);
+    depot->empty_count--;
+
+    return mag;
+}
+
+static void
+__depot_put(struct cake_depot* depot, struct cake_magazine* mag)
+{
+    if (!mag) {
+        return;
+    }
+
+    if (mag->rounds) {
+        llist_append(&depot->full, &mag->mags);
+        depot->full_count++;
+    } else {
+        llist_append(&depot->empty, &mag->mags);
+        depot->empty_count++;
+    }
+}
+
+static void*
+__mag_grab(struct cake_pile* pile)
+{
+    struct cake_mag_cache* cc = &pile->mag_cache;
+    struct cake_magazine* mag;
+
+    if (__mag_empty(cc->loaded)) {
+        if (!__mag_empty(cc->previous)) {
+            mag = cc->loaded;
+            cc->loaded = cc->previous;
+            cc->previous = mag;
+        } else if ((mag = __depot_take_full(&pile->depot))) {
+            __depot_put(&pile->depot, cc->previous);
+            cc->previous = cc->loaded;
+            cc->loaded = mag;
+        } else {
+            return NULL;
+        }
+    }
 
+    pile->cached_pieces--;
+    mag = cc->loaded;
+    return mag->objs[--mag->rounds];
+}
+
+static int
+__mag_release(struct cake_pile* pile, void* area)
+{
+    struct cake_mag_cache* cc = &pile->mag_cache;
+    struct cake_magazine* mag;
+
+    if (__mag_full(cc->loaded)) {
+        if (cc->previous && !cc->previous->rounds) {
+            mag = cc->loaded;
+            cc->loaded = cc->previous;
+            cc->previous = mag;
+        } else if ((mag = __depot_take_empty(&pile->depot))) {
+            __depot_put(&pile->depot, cc->previous);
+            cc->previous = cc->loaded;
+            cc->loaded = mag;
+        } else {
+            return 0;
+        }
+    }
+
+    pile->cached_pieces++;
+    mag = cc->loaded;
+    mag->objs[mag->rounds++] = area;
     return 1;
 }
 
+static void
+__mag_flush(struct cake_pile* pile, struct cake_magazine* mag)
+{
+    if (!mag) {
+        return;
+    }
+
+    while (mag->rounds) {
+        void* area = mag->objs[--mag->rounds];
+        __cake_release_piece(pile, __cake_of(area), area);
+        pile->cached_pieces--;
+    }
+
+    __cake_release_piece(mag_pile, __cake_of(mag), mag);
+}
+
+void
+cake_drain(struct cake_pile* pile)
+{
+    struct cake_magazine *pos, *n;
+
+    struct cake_mag_cache* cc = &pile->mag_cache;
+    __mag_flush(pile, cc->loaded);
+    __mag_flush(pile, cc->previous);
+    cc->loaded = cc->previous = NULL;
+
+    llist_for_each(pos, n, &pile->depot.full, mags)
+    {
+        llist_delete(&pos->mags);
+        __mag_flush(pile, pos);
+    }
+
+    llist_for_each(pos, n, &pile->depot.empty, mags)
+    {
+        llist_delete(&pos->mags);
+        __mag_flush(pile, pos);
+    }
+
+    pile->depot.full_count = 0;
+    pile->depot.empty_count = 0;
+}
+
+void
+cake_drain_all()
+{
+    struct cake_pile *pos, *n;
+    llist_for_each(pos, n, &piles, piles)
+    {
+        if (!(pos->options & PILE_NOMAG)) {
+            cake_drain(pos);
+        }
+    }
+}
+
+unsigned int
+cake_shrink(struct cake_pile* pile)
+{
+    unsigned int nr_free = 0, released = 0;
+    struct cake_s *pos, *n;
+
+    llist_for_each(pos, n, &pile->free, cakes)
+    {
+        if (++nr_free <= CAKE_FREE_RESERVE) {
+            continue;
+        }
+        __free_cake(pile, pos);
+        released += pile->pg_per_cake;
+    }
+
+    return released;
+}
+
+unsigned int
+cake_shrink_all(int drain)
+{
+    unsigned int released = 0;
+    struct cake_pile *pos, *n;
+
+    if (drain) {
+        cake_drain_all();
+    }
+
+    llist_for_each(pos, n, &piles, piles)
+    {
+        released += cake_shrink(pos);
+    }
+
+    return released;
+}
+
+void*
+cake_grab(struct cake_pile* pile)
+{
+    void* ptr = NULL;
+
+    if (!(pile->options & PILE_NOMAG)) {
+        ptr = __mag_grab(pile);
+    }
+
+    if (!ptr && !(ptr = __cake_grab_piece(pile))) {
+        return NULL;
+    }
+
+    unsigned int in_use = pile->alloced_pieces - pile->cached_pieces;
+    pile->peak_pieces = MAX(pile->peak_pieces, in_use);
+
+    tracepoint(TP_CAKE_GRAB, pile, ptr, 0);
+    return ptr;
+}
+
+int
+cake_release(struct cake_pile* pile, void* area)
+{
+    struct cake_s* pos = __cake_of(area);
+
+    if (!__cake_valid_piece(pile, pos, area)) {
+        return 0;
+    }
+
+    tracepoint(TP_CAKE_RELEASE, pile, area, 0);
+
+    if (!(pile->options & PILE_NOMAG) && __mag_release(pile, area)) {
+        return 1;
+    }
+
+    __cake_release_piece(pile, pos, area);
+    return 1;
+}
+
+void
+cake_usage(struct cake_pile* pile, struct cake_usage* usage)
+{
+    unsigned int piece_size = pile->piece_size;
+    unsigned int total = pile->cakes_count * pile->pieces_per_cake;
+    unsigned int in_use = pile->alloced_pieces - pile->cached_pieces;
+    unsigned int cake_size = pile->pg_per_cake * PG_SIZE;
+
+    *usage = (struct cake_usage){
+        .alloced = in_use * piece_size,
+        .free = (total - in_use) * piece_size,
+        .wasted = pile->cakes_count *
+                  (cake_size - pile->pieces_per_cake * piece_size),
+        .peak = pile->peak_pieces * piece_size
+    };
+}
+
 void
 cake_ctor_zeroing(struct cake_pile* pile, void* piece)
 {
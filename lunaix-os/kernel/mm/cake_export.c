@@ -24,13 +24,20 @@ void
 __cake_rd_stat(struct twimap* map)
 {
     struct cake_pile* pos = twimap_index(map, struct cake_pile*);
+    struct cake_usage usage;
+    cake_usage(pos, &usage);
+
     twimap_printf(map,
-                  "%s %d %d %d %d\n",
+                  "%s %d %d %d %d %u %u %u %u\n",
                   pos->pile_name,
                   pos->cakes_count,
                   pos->pg_per_cake,
                   pos->pieces_per_cake,
-                  pos->alloced_pieces);
+                  pos->alloced_pieces,
+                  usage.alloced,
+                  usage.free,
+                  usage.wasted,
+                  usage.peak);
 }
 
 void
@@ -54,6 +61,13 @@ __cake_rd_alloced(struct twimap* map)
     twimap_printf(map, "%u", pile->alloced_pieces);
 }
 
+void
+__cake_rd_cached(struct twimap* map)
+{
+    struct cake_pile* pile = twimap_data(map, struct cake_pile*);
+    twimap_printf(map, "%u", pile->cached_pieces);
+}
+
 void
 __cake_rd_ppc(struct twimap* map)
 {
@@ -68,6 +82,22 @@ __cake_rd_ppg(struct twimap* map)
     twimap_printf(map, "%u", pile->pg_per_cake);
 }
 
+void
+__cake_rd_usage(struct twimap* map)
+{
+    struct cake_pile* pile = twimap_data(map, struct cake_pile*);
+    struct cake_usage usage;
+    cake_usage(pile, &usage);
+
+    // 单位为字节：在用 空闲 浪费 峰值
+    twimap_printf(map,
+                  "%u %u %u %u",
+                  usage.alloced,
+                  usage.free,
+                  usage.wasted,
+                  usage.peak);
+}
+
 void
 cake_export_pile(struct twifs_node* root, struct cake_pile* pile)
 {
@@ -82,11 +112,17 @@ cake_export_pile(struct twifs_node* root, struct cake_pile* pile)
     map = twifs_mapping(pile_rt, pile, "grabbed");
     map->read = __cake_rd_alloced;
 
+    map = twifs_mapping(pile_rt, pile, "cached");
+    map->read = __cake_rd_cached;
+
     map = twifs_mapping(pile_rt, pile, "pieces_per_cake");
     map->read = __cake_rd_ppc;
 
     map = twifs_mapping(pile_rt, pile, "page_per_cake");
     map->read = __cake_rd_ppg;
+
+    map = twifs_mapping(pile_rt, pile, "usage");
+    map->read = __cake_rd_usage;
 }
 
 void
@@ -1,21 +1,74 @@
+#include <hal/cpu.h>
+#include <lunaix/common.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/swap.h>
 #include <lunaix/mm/vmm.h>
 
 void*
 vmm_dup_page(pid_t pid, void* pa)
 {
     void* new_ppg = pmm_alloc_page(pid, 0);
-    vmm_set_mapping(PD_REFERENCED, PG_MOUNT_3, new_ppg, PG_PREM_RW, VMAP_NULL);
-    vmm_set_mapping(PD_REFERENCED, PG_MOUNT_4, pa, PG_PREM_RW, VMAP_NULL);
+    if (!new_ppg) {
+        return NULL;
+    }
 
-    asm volatile("movl %1, %%edi\n"
-                 "movl %2, %%esi\n"
-                 "rep movsl\n" ::"c"(1024),
-                 "r"(PG_MOUNT_3),
-                 "r"(PG_MOUNT_4)
-                 : "memory", "%edi", "%esi");
+    void* dst = vmm_kmap_atomic((uintptr_t)new_ppg);
+    void* src = vmm_kmap_atomic((uintptr_t)pa);
 
-    vmm_del_mapping(PD_REFERENCED, PG_MOUNT_3);
-    vmm_del_mapping(PD_REFERENCED, PG_MOUNT_4);
+    vmm_copy_page(dst, src);
+
+    vmm_kunmap_atomic(src);
+    vmm_kunmap_atomic(dst);
 
     return new_ppg;
-}
\ No newline at end of file
+}
+
+int
+vmm_unshare_pt(uintptr_t mnt, u32_t l1_inx)
+{
+    x86_page_table* l1pt = (x86_page_table*)(mnt | (1023 << 12));
+    x86_page_table* l2pt = (x86_page_table*)(mnt | (l1_inx << 12));
+    x86_pte_t pde = l1pt->entry[l1_inx];
+
+    if (l1_inx >= L1_INDEX(KERNEL_MM_BASE) || !(pde & PG_PRESENT) ||
+        (pde & (PG_WRITE | PG_PDE_4MB))) {
+        return 0;
+    }
+
+    void* pt_pa = PG_ENTRY_ADDR(pde);
+    struct pp_struct* pp = pmm_query(pt_pa);
+
+    // 另一方已经拥有了自己的副本（或已退出），直接收回即可
+    if (!pp || pp->ref_counts <= 1) {
+        l1pt->entry[l1_inx] = pde | PG_WRITE;
+        goto done;
+    }
+
+    void* new_pt = pmm_alloc_page(KERNEL_PID, PP_FGPERSIST);
+    if (!new_pt) {
+        return 0;
+    }
+
+    x86_page_table* pt = vmm_kmap_atomic((uintptr_t)new_pt);
+    for (size_t i = 0; i < PG_MAX_ENTRIES; i++) {
+        x86_pte_t pte = l2pt->entry[i];
+        if ((pte & PG_PRESENT)) {
+            pmm_ref_page(KERNEL_PID, PG_ENTRY_ADDR(pte));
+        } else {
+            swap_entry_dup(pte);
+        }
+        pt->entry[i] = pte;
+    }
+    vmm_kunmap_atomic(pt);
+
+    l1pt->entry[l1_inx] = (uintptr_t)new_pt | PG_ENTRY_FLAGS(pde) | PG_WRITE;
+    pmm_free_page(KERNEL_PID, pt_pa);
+
+done:
+    cpu_invplg(l2pt);
+    if (mnt == PD_REFERENCED) {
+        // 整张页表已被替换，该4MiB区间内的TLB项都需作废
+        cpu_invtlb();
+    }
+    return 1;
+}
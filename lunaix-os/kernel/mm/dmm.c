@@ -18,13 +18,14 @@
 
 #include <lunaix/mm/dmm.h>
 #include <lunaix/mm/page.h>
+#include <lunaix/mm/pmm.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/status.h>
 
 #include <lunaix/spike.h>
 #include <lunaix/syscall.h>
 
-__DEFINE_LXSYSCALL1(int, sbrk, size_t, size)
+__DEFINE_LXSYSCALL1(void*, sbrk, size_t, size)
 {
     heap_context_t* uheap = &__current->mm.u_heap;
     mutex_lock(&uheap->lock);
@@ -33,7 +34,7 @@ __DEFINE_LXSYSCALL1(int, sbrk, size_t, size)
     return r;
 }
 
-__DEFINE_LXSYSCALL1(void*, brk, void*, addr)
+__DEFINE_LXSYSCALL1(int, brk, void*, addr)
 {
     heap_context_t* uheap = &__current->mm.u_heap;
     mutex_lock(&uheap->lock);
@@ -50,50 +51,55 @@ dmm_init(heap_context_t* heap)
     heap->brk = heap->start;
     mutex_init(&heap->lock);
 
-    return vmm_set_mapping(PD_REFERENCED,
-                           heap->brk,
-                           0,
-                           PG_WRITE | PG_ALLOW_USER,
-                           VMAP_NULL) != NULL;
+    return 1;
 }
 
 int
 lxbrk(heap_context_t* heap, void* addr, int user)
 {
-    return -(lxsbrk(heap, addr - heap->brk, user) == (void*)-1);
+    if (addr < heap->start || addr >= heap->max_addr) {
+        __current->k_status = LXINVLDPTR;
+        return -1;
+    }
+
+    // brk 所在的页总是已预留（堆为空时即首页），这里只处理其后的页
+    uintptr_t cur = PG_ALIGN(heap->brk) + PG_SIZE;
+    uintptr_t next = PG_ALIGN(addr) + PG_SIZE;
+
+    // 扩展时仅预留页表项，具体的页框由Page Fault Handler按需分配
+    for (uintptr_t va = cur; va < next; va += PG_SIZE) {
+        vmm_set_mapping(PD_REFERENCED, va, 0, PG_WRITE | user, VMAP_NULL);
+    }
+
+    // 收缩时归还多出的页
+    for (uintptr_t va = next; va < cur; va += PG_SIZE) {
+        uintptr_t pa = vmm_del_mapping(PD_REFERENCED, va);
+        if (pa) {
+            pmm_free_page(__current->pid, pa);
+        }
+    }
+
+    heap->brk = addr;
+    return 0;
 }
 
 void*
 lxsbrk(heap_context_t* heap, size_t size, int user)
 {
+    void* current_brk = heap->brk;
+
     if (size == 0) {
-        return heap->brk;
+        return current_brk;
     }
 
-    void* current_brk = heap->brk;
-
-    // The upper bound of our next brk of heap given the size.
-    // This will be used to calculate the page we need to allocate.
-    void* next = current_brk + ROUNDUP(size, BOUNDARY);
+    size = ROUNDUP(size, BOUNDARY);
 
-    // any invalid situations
-    if (next >= heap->max_addr || next < current_brk) {
+    // 避免越过堆的上界时回绕
+    if (size >= (size_t)(heap->max_addr - current_brk) ||
+        lxbrk(heap, current_brk + size, user)) {
         __current->k_status = LXINVLDPTR;
         return (void*)-1;
     }
 
-    uintptr_t diff = PG_ALIGN(next) - PG_ALIGN(current_brk);
-    if (diff) {
-        // if next do require new pages to be mapped
-        for (size_t i = 0; i < diff; i += PG_SIZE) {
-            vmm_set_mapping(PD_REFERENCED,
-                            PG_ALIGN(current_brk) + PG_SIZE + i,
-                            0,
-                            PG_WRITE | user,
-                            VMAP_NULL);
-        }
-    }
-
-    heap->brk += size;
     return current_brk;
-}
\ No newline at end of file
+}
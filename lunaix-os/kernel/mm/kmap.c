@@ -0,0 +1,106 @@
+#include <arch/x86/fpu.h>
+#include <hal/cpu.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+
+// 单处理器，目前仅有一组槽位
+#define KMAP_NR_CPU 1
+
+struct kmap_cpu
+{
+    u32_t top;
+};
+
+static struct kmap_cpu kmap_cpus[KMAP_NR_CPU];
+
+static inline struct kmap_cpu*
+__kmap_this_cpu()
+{
+    return &kmap_cpus[0];
+}
+
+void
+vmm_kmap_init()
+{
+    // 确保槽位所在的页表存在，此后映射只需直接写入页表项
+    vmm_set_mapping(PD_REFERENCED, KMAP_BASE, 0, PG_PREM_RW, VMAP_NOMAP);
+}
+
+void*
+vmm_kmap_atomic(uintptr_t pa)
+{
+    struct kmap_cpu* kc = __kmap_this_cpu();
+    assert_msg(kc->top < KMAP_SLOTS, "kmap: out of slots");
+
+    // 槽位按栈的方式使用，持有期间不得被抢占
+    preempt_disable();
+
+    uintptr_t va = KMAP_BASE + kc->top++ * PG_SIZE;
+    PTE_MOUNTED(PD_REFERENCED, va >> 12) = NEW_L2_ENTRY(PG_PREM_RW, pa);
+    cpu_invplg(va);
+
+    return (void*)va;
+}
+
+void
+vmm_kunmap_atomic(void* va)
+{
+    struct kmap_cpu* kc = __kmap_this_cpu();
+    assert_msg(kc->top && (uintptr_t)va == KMAP_BASE + (kc->top - 1) * PG_SIZE,
+               "kmap: unbalanced unmap");
+
+    // 槽位在下次映射时才会刷新TLB，这里仅清除页表项
+    PTE_MOUNTED(PD_REFERENCED, (uintptr_t)va >> 12) = PTE_NULL;
+    kc->top--;
+
+    preempt_enable();
+}
+
+// 内核以无SSE的方式编译，编译器不会使用xmm寄存器，因而无需声明破坏
+static inline void
+__copy_page_sse(void* dst, void* src)
+{
+    u32_t n = PG_SIZE / 0x80;
+    asm volatile("1:\n"
+                 "movaps 0x00(%1), %%xmm0\n"
+                 "movaps 0x10(%1), %%xmm1\n"
+                 "movaps 0x20(%1), %%xmm2\n"
+                 "movaps 0x30(%1), %%xmm3\n"
+                 "movaps 0x40(%1), %%xmm4\n"
+                 "movaps 0x50(%1), %%xmm5\n"
+                 "movaps 0x60(%1), %%xmm6\n"
+                 "movaps 0x70(%1), %%xmm7\n"
+                 "movntps %%xmm0, 0x00(%0)\n"
+                 "movntps %%xmm1, 0x10(%0)\n"
+                 "movntps %%xmm2, 0x20(%0)\n"
+                 "movntps %%xmm3, 0x30(%0)\n"
+                 "movntps %%xmm4, 0x40(%0)\n"
+                 "movntps %%xmm5, 0x50(%0)\n"
+                 "movntps %%xmm6, 0x60(%0)\n"
+                 "movntps %%xmm7, 0x70(%0)\n"
+                 "addl $0x80, %1\n"
+                 "addl $0x80, %0\n"
+                 "decl %2\n"
+                 "jnz 1b\n"
+                 "sfence\n"
+                 : "+r"(dst), "+r"(src), "+r"(n)
+                 :
+                 : "memory");
+}
+
+void
+vmm_copy_page(void* dst, void* src)
+{
+    // FPU寄存器中可能仍是某一进程的状态，由 fpu_kernel_try_begin 先行保存
+    if (fpu_kernel_try_begin()) {
+        __copy_page_sse(dst, src);
+        fpu_kernel_end();
+        return;
+    }
+
+    u32_t n = PG_SIZE / 4;
+    asm volatile("rep movsl\n" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
@@ -0,0 +1,84 @@
+/**
+ * @file mempool.c
+ * @brief 带预留的内存池，见 lunaix/mm/mempool.h
+ *
+ */
+#include <lunaix/mm/mempool.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+
+#include <hal/cpu.h>
+
+struct mempool*
+mempool_create(struct cake_pile* pile, unsigned int min_nr)
+{
+    struct mempool* pool =
+      vzalloc(sizeof(struct mempool) + min_nr * sizeof(void*));
+    assert(pool);
+
+    pool->pile = pile;
+    pool->min_nr = min_nr;
+    waitq_init(&pool->wait);
+
+    for (; pool->curr_nr < min_nr; pool->curr_nr++) {
+        void* obj = cake_grab(pile);
+        assert_msg(obj, "mempool: fail to fill the reserve");
+        pool->reserve[pool->curr_nr] = obj;
+    }
+
+    return pool;
+}
+
+void*
+mempool_alloc(struct mempool* pool, int flags)
+{
+    void* obj;
+    int intr = cpu_reflags() & 0x0200;
+
+    while (!(obj = cake_grab(pool->pile))) {
+        // 归还可能发生于中断上下文，关中断以免检查预留后错过唤醒
+        cpu_disable_interrupt();
+
+        if (pool->curr_nr) {
+            obj = pool->reserve[--pool->curr_nr];
+            break;
+        }
+
+        if ((flags & MEMPOOL_NOWAIT)) {
+            break;
+        }
+
+        pwait(&pool->wait);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    } else {
+        cpu_disable_interrupt();
+    }
+
+    return obj;
+}
+
+void
+mempool_free(struct mempool* pool, void* obj)
+{
+    if (!obj) {
+        return;
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    if (pool->curr_nr < pool->min_nr) {
+        pool->reserve[pool->curr_nr++] = obj;
+    } else {
+        cake_release(pool->pile, obj);
+    }
+
+    pwake_all(&pool->wait);
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
@@ -0,0 +1,216 @@
+#include <lunaix/common.h>
+#include <lunaix/fs.h>
+#include <lunaix/mm/mmap.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/region.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/mman.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+#define UMMAP_END USTACK_END
+
+extern struct lru_zone* inode_lru;
+
+uintptr_t
+mmap_find_free(struct mm_regions* regions, size_t size)
+{
+    uintptr_t cur = UMMAP_AREA;
+
+    struct mm_region *pos, *n;
+    llist_for_each(pos, n, &regions->head, head)
+    {
+        if (pos->end <= cur) {
+            continue;
+        }
+        if (pos->start >= cur && pos->start - cur >= size) {
+            break;
+        }
+        cur = ROUNDUP(pos->end, PG_SIZE);
+    }
+
+    // 以减法比较，cur + size 可能越过4GiB而回绕
+    if (cur > UMMAP_END || size > UMMAP_END - cur) {
+        return 0;
+    }
+
+    return cur;
+}
+
+static int
+__mmap_overlaps(struct mm_regions* regions, uintptr_t start, uintptr_t end)
+{
+    struct mm_region *pos, *n;
+    llist_for_each(pos, n, &regions->head, head)
+    {
+        if (pos->start < end && start < pos->end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+__mmap_attr(int prot, int flags)
+{
+    int attr = (flags & MAP_SHARED) ? REGION_WSHARED : REGION_RSHARED;
+
+    if ((prot & PROT_READ)) {
+        attr |= REGION_READ;
+    }
+    if ((prot & PROT_WRITE)) {
+        attr |= REGION_WRITE;
+    }
+    if ((prot & PROT_EXEC)) {
+        attr |= REGION_EXEC;
+    }
+
+    return attr;
+}
+
+int
+mmap_fault(struct mm_region* region, uintptr_t va, volatile x86_pte_t* pte)
+{
+    struct v_inode* inode = region->mfile->inode;
+    foff_t fpos = region->offset + (PG_ALIGN(va) - region->start);
+    struct pcache_pg* pg;
+
+    lock_inode(inode);
+    int errno = pcache_get_filled(inode, fpos, &pg);
+    unlock_inode(inode);
+
+    if (errno < 0) {
+        return 0;
+    }
+
+    uintptr_t pa = (uintptr_t)vmm_v2p(pg->pg);
+    pmm_ref_page(__current->pid, pa);
+
+    x86_pte_t attr = PG_ENTRY_FLAGS(*pte);
+    if ((region->attr & REGION_MODE_MASK) == REGION_WSHARED &&
+        (region->attr & REGION_WRITE)) {
+        // 共享的可写映射直接写入缓存页，回写由页缓存负责
+        pcache_set_dirty(inode->pg_cache, pg);
+    } else {
+        // 私有映射先以只读方式共享缓存页，写入时再应用COW
+        attr &= ~PG_WRITE;
+    }
+
+    *pte = NEW_L2_ENTRY(attr | PG_PRESENT, pa);
+    return 1;
+}
+
+__DEFINE_LXSYSCALL3(void*, mmap, void*, addr, size_t, length, va_list, lst)
+{
+    int prot = va_arg(lst, int);
+    int flags = va_arg(lst, int);
+    int fd = va_arg(lst, int);
+    size_t offset = va_arg(lst, size_t);
+
+    int errno = 0;
+    struct v_file* file = NULL;
+    struct mm_regions* regions = &__current->mm.regions;
+    uintptr_t start = (uintptr_t)addr;
+
+    // 先于取整检查长度：接近4GiB的长度取整后回绕为零
+    if (!length || length > UMMAP_END - UMMAP_AREA ||
+        (offset & (PG_SIZE - 1)) || !(flags & (MAP_SHARED | MAP_PRIVATE))) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    if (!(flags & MAP_ANON)) {
+        struct v_fd* fd_s;
+        if ((errno = vfs_getfd(fd, &fd_s))) {
+            goto done;
+        }
+
+        file = fd_s->file;
+        if (!(file->inode->itype & VFS_IFFILE) || !file->inode->pg_cache) {
+            errno = ENODEV;
+            goto done;
+        }
+    }
+
+    length = ROUNDUP(length, PG_SIZE);
+
+    if ((flags & MAP_FIXED)) {
+        if ((start & (PG_SIZE - 1)) || start < UMMAP_AREA ||
+            start > UMMAP_END - length ||
+            __mmap_overlaps(regions, start, start + length)) {
+            errno = EINVAL;
+            goto done;
+        }
+    } else if (!(start = mmap_find_free(regions, length))) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    struct mm_region* region =
+      region_add(regions, start, start + length, __mmap_attr(prot, flags));
+
+    if (file) {
+        atomic_fetch_add(&file->ref_count, 1);
+        region->mfile = file;
+        region->offset = offset;
+    }
+
+    // 预留地址空间，具体的页框将由Page Fault Handler按需映射。
+    pt_attr pattr = PG_ALLOW_USER | ((prot & PROT_WRITE) ? PG_WRITE : 0);
+    for (size_t i = 0; i < length; i += PG_SIZE) {
+        vmm_set_mapping(PD_REFERENCED, start + i, 0, pattr, VMAP_NULL);
+    }
+
+    return (void*)start;
+
+done:
+    return (void*)DO_STATUS(errno);
+}
+
+__DEFINE_LXSYSCALL2(int, munmap, void*, addr, size_t, length)
+{
+    int errno = 0;
+    uintptr_t start = (uintptr_t)addr;
+    struct mm_regions* regions = &__current->mm.regions;
+
+    if ((start & (PG_SIZE - 1)) || start < UMMAP_AREA ||
+        length > UMMAP_END - UMMAP_AREA ||
+        start > UMMAP_END - ROUNDUP(length, PG_SIZE)) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    uintptr_t end = start + ROUNDUP(length, PG_SIZE);
+
+    // 暂不支持拆分区域：只可解除完全落在范围内的映射
+    struct mm_region *pos, *n;
+    llist_for_each(pos, n, &regions->head, head)
+    {
+        if (pos->start < end && start < pos->end &&
+            (pos->start < start || pos->end > end)) {
+            errno = EINVAL;
+            goto done;
+        }
+    }
+
+    llist_for_each(pos, n, &regions->head, head)
+    {
+        if (pos->start < start || pos->end > end) {
+            continue;
+        }
+
+        for (uintptr_t va = pos->start; va < pos->end; va += PG_SIZE) {
+            uintptr_t pa = vmm_del_mapping(PD_REFERENCED, va);
+            if (pa) {
+                pmm_free_page(__current->pid, pa);
+            }
+        }
+
+        region_remove(regions, pos);
+    }
+
+done:
+    return DO_STATUS(errno);
+}
@@ -1,3 +1,4 @@
+#include <hal/cpu.h>
 #include <lunaix/mm/mmio.h>
 #include <lunaix/mm/pmm.h>
 #include <lunaix/mm/vmm.h>
@@ -6,7 +7,17 @@
 void*
 ioremap(uintptr_t paddr, u32_t size)
 {
-    void* ptr = vmm_vmap(paddr, size, PG_PREM_RW | PG_DISABLE_CACHE);
+    return ioremap_cached(paddr, size, PG_CACHE_UC);
+}
+
+void*
+ioremap_cached(uintptr_t paddr, u32_t size, pt_attr cache)
+{
+    if ((cache & PG_PAT) && !cpu_has_pat()) {
+        cache = PG_CACHE_UC;
+    }
+
+    void* ptr = vmm_vmap(paddr, size, PG_PREM_RW | (cache & PG_CACHE_MASK));
     if (ptr) {
         pmm_mark_chunk_occupied(KERNEL_PID,
                                 paddr >> PG_SIZE_BITS,
@@ -19,8 +30,5 @@ ioremap(uintptr_t paddr, u32_t size)
 void*
 iounmap(uintptr_t vaddr, u32_t size)
 {
-    for (size_t i = 0; i < size; i += PG_SIZE) {
-        uintptr_t paddr = vmm_del_mapping(PD_REFERENCED, vaddr + i);
-        pmm_free_page(KERNEL_PID, paddr);
-    }
+    vmm_vunmap(vaddr, size);
 }
\ No newline at end of file
@@ -1,31 +1,314 @@
 #include <lunaix/mm/page.h>
 #include <lunaix/mm/pmm.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/spike.h>
 #include <lunaix/status.h>
 
-// This is a very large array...
-static struct pp_struct pm_table[PM_BMP_MAX_SIZE];
+extern uint8_t __kernel_end[]; /* link/linker.ld */
+
+// 紧随内核之后，大小取决于实际内存大小
+static struct pp_struct* pm_table;
 
 static uintptr_t max_pg;
 
+#define BUDDY_NIL 0xfffffU
+
+// 非块首的空闲页
+#define BUDDY_TAIL 0xffU
+
+static struct pm_zone zones[PM_NR_ZONES] = {
+    [PM_ZONE_DMA] = { .name = "dma", .start_pg = 0 },
+    [PM_ZONE_NORMAL] = { .name = "normal", .start_pg = PM_ZONE_NORMAL_START },
+    [PM_ZONE_HIGHMEM] = { .name = "highmem",
+                          .start_pg = PM_ZONE_HIGHMEM_START },
+};
+
+// 不同类型的分配请求所依次尝试的区域
+static const int zone_fallbacks[][PM_NR_ZONES + 1] = {
+    // 内核
+    { PM_ZONE_NORMAL, PM_ZONE_HIGHMEM, PM_ZONE_DMA, -1 },
+    // DMA
+    { PM_ZONE_DMA, -1 },
+    // 用户
+    { PM_ZONE_HIGHMEM, PM_ZONE_NORMAL, PM_ZONE_DMA, -1 },
+};
+
+// 我们跳过位于0x0的页。我们不希望空指针是指向一个有效的内存空间。
+#define LOOKUP_START 1
+
+static inline struct pm_zone*
+__zone_of(u32_t ppn)
+{
+    if (ppn >= PM_ZONE_HIGHMEM_START) {
+        return &zones[PM_ZONE_HIGHMEM];
+    }
+    if (ppn >= PM_ZONE_NORMAL_START) {
+        return &zones[PM_ZONE_NORMAL];
+    }
+    return &zones[PM_ZONE_DMA];
+}
+
+static inline int
+__is_block_head(u32_t ppn, u32_t order)
+{
+    struct pp_struct* pp = &pm_table[ppn];
+    return !pp->ref_counts && pp->buddy.order == order;
+}
+
+static void
+__buddy_insert(u32_t ppn, u32_t order)
+{
+    struct pm_zone* zone = __zone_of(ppn);
+    struct free_area* area = &zone->free_areas[order];
+    struct pp_struct* pp = &pm_table[ppn];
+
+    pp->buddy.order = order;
+    pp->buddy.prev = BUDDY_NIL;
+    pp->buddy.next = area->head;
+    if (area->head != BUDDY_NIL) {
+        pm_table[area->head].buddy.prev = ppn;
+    }
+
+    area->head = ppn;
+    area->nr_free++;
+    zone->free_pages += 1 << order;
+}
+
+static void
+__buddy_remove(u32_t ppn, u32_t order)
+{
+    struct pm_zone* zone = __zone_of(ppn);
+    struct free_area* area = &zone->free_areas[order];
+    struct pp_struct* pp = &pm_table[ppn];
+
+    if (pp->buddy.prev != BUDDY_NIL) {
+        pm_table[pp->buddy.prev].buddy.next = pp->buddy.next;
+    } else {
+        area->head = pp->buddy.next;
+    }
+
+    if (pp->buddy.next != BUDDY_NIL) {
+        pm_table[pp->buddy.next].buddy.prev = pp->buddy.prev;
+    }
+
+    pp->buddy.order = BUDDY_TAIL;
+    area->nr_free--;
+    zone->free_pages -= 1 << order;
+}
+
+/**
+ * @brief 将一个空闲块儿归还至伙伴系统，并尽可能与其伙伴合并
+ *
+ */
+static void
+__buddy_free(u32_t ppn, u32_t order)
+{
+    pm_table[ppn].ref_counts = 0;
+    pm_table[ppn].buddy.order = BUDDY_TAIL;
+
+    while (order < PM_MAX_ORDER) {
+        u32_t buddy = ppn ^ (1 << order);
+        if (buddy < LOOKUP_START || buddy + (1 << order) > max_pg ||
+            !__is_block_head(buddy, order)) {
+            break;
+        }
+
+        __buddy_remove(buddy, order);
+        ppn = MIN(ppn, buddy);
+        order++;
+    }
+
+    __buddy_insert(ppn, order);
+}
+
+static inline int
+__chunk_occupied(u32_t ppn, u32_t count)
+{
+    for (u32_t i = 0; i < count; i++) {
+        if (!pm_table[ppn + i].ref_counts) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 将 [start, end) 中被占用的页归还至伙伴系统。对齐且整块儿被占用的
+ * 部分直接作为一个块儿归还，免去逐页地与伙伴合并
+ *
+ */
+static void
+__buddy_free_range(u32_t start, u32_t end)
+{
+    start = MAX(start, LOOKUP_START);
+    end = MIN(end, max_pg);
+
+    while (start < end) {
+        if (!pm_table[start].ref_counts) {
+            start++;
+            continue;
+        }
+
+        // 以 start 为首，落在范围之内且整块儿被占用的最大的块儿
+        u32_t order = 0, len = 1;
+        while (order < PM_MAX_ORDER && !(start & ((len << 1) - 1)) &&
+               start + (len << 1) <= end &&
+               __chunk_occupied(start + len, len)) {
+            order++;
+            len <<= 1;
+        }
+
+        for (u32_t i = 1; i < len; i++) {
+            pm_table[start + i].ref_counts = 0;
+            pm_table[start + i].buddy.order = BUDDY_TAIL;
+        }
+
+        __buddy_free(start, order);
+        start += len;
+    }
+}
+
+/**
+ * @brief 从区域中取出一个 2^order 页大小的块儿，必要时拆分更大的块儿
+ *
+ */
+static u32_t
+__buddy_alloc(struct pm_zone* zone, u32_t order)
+{
+    u32_t k = order;
+    while (k <= PM_MAX_ORDER && zone->free_areas[k].head == BUDDY_NIL) {
+        k++;
+    }
+
+    if (k > PM_MAX_ORDER) {
+        return BUDDY_NIL;
+    }
+
+    u32_t ppn = zone->free_areas[k].head;
+    __buddy_remove(ppn, k);
+
+    while (k > order) {
+        k--;
+        __buddy_insert(ppn + (1 << k), k);
+    }
+
+    return ppn;
+}
+
+/**
+ * @brief 将某个特定的空闲页从其所属的块儿中剥离出来
+ *
+ */
+static void
+__buddy_take(u32_t ppn)
+{
+    u32_t head, k = 0;
+    for (; k <= PM_MAX_ORDER; k++) {
+        head = ppn & ~((1 << k) - 1);
+        if (__is_block_head(head, k)) {
+            break;
+        }
+    }
+
+    if (k > PM_MAX_ORDER) {
+        return;
+    }
+
+    __buddy_remove(head, k);
+
+    while (k) {
+        k--;
+        u32_t half = head + (1 << k);
+        if (ppn < half) {
+            __buddy_insert(half, k);
+        } else {
+            __buddy_insert(head, k);
+            head = half;
+        }
+    }
+}
+
+/**
+ * @brief 按照分配请求的类型，依次尝试各个区域。除首选区域外，
+ * 其余区域仅在余量高于水位线时才允许被借用。用户页则总要为内核留有余量。
+ *
+ */
+static u32_t
+__zone_alloc(pp_attr_t attr, u32_t order)
+{
+    const int* fallbacks = zone_fallbacks[0];
+    if ((attr & PP_GFP_DMA)) {
+        fallbacks = zone_fallbacks[1];
+    } else if ((attr & PP_GFP_USER)) {
+        fallbacks = zone_fallbacks[2];
+    }
+
+    size_t npages = 1 << order;
+    for (int i = 0; fallbacks[i] != -1; i++) {
+        struct pm_zone* zone = &zones[fallbacks[i]];
+        int reserved = i || (fallbacks[i] != PM_ZONE_HIGHMEM &&
+                             (attr & PP_GFP_USER));
+
+        if (zone->free_pages < npages ||
+            (reserved && zone->free_pages - npages < zone->wmark_low)) {
+            continue;
+        }
+
+        u32_t ppn = __buddy_alloc(zone, order);
+        if (ppn != BUDDY_NIL) {
+            // 余量跌破高水位线，提前唤醒回收线程，而非等到分配失败才被动驱逐
+            if (zone->free_pages < zone->wmark_high) {
+                pmm_reclaim_wakeup();
+            }
+            return ppn;
+        }
+    }
+
+    pmm_reclaim_wakeup();
+    return BUDDY_NIL;
+}
+
+static inline void
+__mark_occupied(pid_t owner, uintptr_t ppn, pp_attr_t attr)
+{
+    pm_table[ppn] = (struct pp_struct){ .owner = owner,
+                                        .ref_counts = 1,
+                                        .attr = attr & ~PP_GFP_MASK };
+}
+
 void
 pmm_mark_page_free(uintptr_t ppn)
 {
-    pm_table[ppn].ref_counts = 0;
+    if (ppn < LOOKUP_START || ppn >= max_pg || !pm_table[ppn].ref_counts) {
+        return;
+    }
+
+    __buddy_free(ppn, 0);
 }
 
 void
 pmm_mark_page_occupied(pid_t owner, uintptr_t ppn, pp_attr_t attr)
 {
-    pm_table[ppn] =
-      (struct pp_struct){ .owner = owner, .ref_counts = 1, .attr = attr };
+    // 超出物理内存范围的页（如MMIO）无需记录
+    if (ppn >= max_pg) {
+        return;
+    }
+
+    if (!pm_table[ppn].ref_counts) {
+        __buddy_take(ppn);
+    }
+
+    __mark_occupied(owner, ppn, attr);
 }
 
 void
 pmm_mark_chunk_free(uintptr_t start_ppn, size_t page_count)
 {
-    for (size_t i = start_ppn; i < start_ppn + page_count && i < max_pg; i++) {
-        pm_table[i].ref_counts = 0;
+    if (start_ppn >= max_pg) {
+        return;
     }
+
+    __buddy_free_range(start_ppn, MIN(start_ppn + page_count, max_pg));
 }
 
 void
@@ -35,95 +318,163 @@ pmm_mark_chunk_occupied(pid_t owner,
                         pp_attr_t attr)
 {
     for (size_t i = start_ppn; i < start_ppn + page_count && i < max_pg; i++) {
-        pm_table[i] =
-          (struct pp_struct){ .owner = owner, .ref_counts = 1, .attr = attr };
+        pmm_mark_page_occupied(owner, i, attr);
     }
 }
 
-// 我们跳过位于0x0的页。我们不希望空指针是指向一个有效的内存空间。
-#define LOOKUP_START 1
+// 区域内首个完整的页，整数向上取整除法
+static inline u64_t
+__mmap_start_pg(multiboot_memory_map_t* entry)
+{
+    u64_t base = ((u64_t)entry->addr_high << 32) | entry->addr_low;
+    return (base + PG_SIZE - 1) >> PG_SIZE_BITS;
+}
 
-volatile size_t pg_lookup_ptr;
+static inline u64_t
+__mmap_end_pg(multiboot_memory_map_t* entry)
+{
+    u64_t base = ((u64_t)entry->addr_high << 32) | entry->addr_low;
+    u64_t len = ((u64_t)entry->len_high << 32) | entry->len_low;
+    return (base + len) >> PG_SIZE_BITS;
+}
 
 void
-pmm_init(uintptr_t mem_upper_lim)
+pmm_init(multiboot_memory_map_t* map, size_t map_size)
 {
-    max_pg = (PG_ALIGN(mem_upper_lim) >> 12);
+    max_pg = 0;
+    for (unsigned int i = 0; i < map_size; i++) {
+        if (map[i].type != MULTIBOOT_MEMORY_AVAILABLE) {
+            continue;
+        }
 
-    pg_lookup_ptr = LOOKUP_START;
+        u64_t start = __mmap_start_pg(&map[i]);
+        u64_t end = __mmap_end_pg(&map[i]);
+
+        // 32位分页只能寻址4GiB，其上的内存不予管理
+        if (start < PM_BMP_MAX_SIZE) {
+            max_pg = MAX(max_pg, (uintptr_t)MIN(end, PM_BMP_MAX_SIZE - 1));
+        }
+    }
+
+    // 将描述符表映射至内核末尾。由于此时尚无可用的物理页来分配页表，
+    //  映射必须落在由hhk预先建立的内核页表之内。
+    uintptr_t table_va = (uintptr_t)__kernel_end;
+    size_t table_sz = ROUNDUP(max_pg * sizeof(struct pp_struct), PG_SIZE);
+    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
+
+    assert_msg(table_va + table_sz <= PD_MOUNT_1,
+               "pmm: pm_table collides with mount points");
+
+    for (size_t i = 0; i < table_sz; i += PG_SIZE) {
+        assert_msg(l1pt->entry[L1_INDEX(table_va + i)],
+                   "pmm: page table for pm_table is absent");
+        vmm_set_mapping(
+          PD_REFERENCED, table_va + i, V2P(table_va + i), PG_PREM_RW, 0);
+    }
+
+    pm_table = (struct pp_struct*)table_va;
+
+    for (size_t i = 0; i < PM_NR_ZONES; i++) {
+        struct pm_zone* zone = &zones[i];
+        for (size_t j = 0; j <= PM_MAX_ORDER; j++) {
+            zone->free_areas[j] =
+              (struct free_area){ .head = BUDDY_NIL, .nr_free = 0 };
+        }
+    }
+
+    // 内核占据的页，包括前1MB，hhk_init以及描述符表
+    size_t pg_count = V2P(table_va + table_sz) >> PG_SIZE_BITS;
 
     // mark all as occupied
-    for (size_t i = 0; i < PM_BMP_MAX_SIZE; i++) {
+    for (size_t i = 0; i < max_pg; i++) {
         pm_table[i] =
           (struct pp_struct){ .owner = 0, .attr = 0, .ref_counts = 1 };
     }
+
+    for (size_t i = 0; i < MIN(pg_count, max_pg); i++) {
+        __mark_occupied(KERNEL_PID, i, PP_FGLOCKED);
+    }
+
+    // 空闲区域按块儿整体归还，并避开内核，免得释放后又逐页地将其拆出
+    for (unsigned int i = 0; i < map_size; i++) {
+        if (map[i].type == MULTIBOOT_MEMORY_AVAILABLE) {
+            // 按64位计算，以免4GiB以上的区域被截断后落入低端的保留区域
+            u64_t start = MAX(__mmap_start_pg(&map[i]), pg_count);
+            u64_t end = MIN(__mmap_end_pg(&map[i]), max_pg);
+
+            if (start < end) {
+                pmm_mark_chunk_free(start, end - start);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < PM_NR_ZONES; i++) {
+        struct pm_zone* zone = &zones[i];
+        zone->managed = zone->free_pages;
+        zone->wmark_low = MAX(zone->managed / PM_WMARK_RATIO, PM_WMARK_MIN);
+        zone->wmark_low = MIN(zone->wmark_low, zone->managed);
+        zone->wmark_high = MIN(zone->wmark_low * 2, zone->managed);
+    }
 }
 
 void*
 pmm_alloc_cpage(pid_t owner, size_t num_pages, pp_attr_t attr)
 {
-    size_t p1 = 0;
-    size_t p2 = 0;
+    if (!num_pages) {
+        return NULL;
+    }
+
+    u32_t order = ILOG2(num_pages);
+    order += (num_pages - (1 << order) != 0);
 
-    while (p2 < max_pg && p2 - p1 < num_pages) {
-        (!(&pm_table[p2])->ref_counts) ? (p2++) : (p1 = ++p2);
+    if (order > PM_MAX_ORDER) {
+        return NULL;
     }
 
-    if (p2 == max_pg && p2 - p1 < num_pages) {
+    u32_t p1 = __zone_alloc(attr, order);
+    if (p1 == BUDDY_NIL) {
+        __current->k_status = LXOUTOFMEM;
         return NULL;
     }
 
-    pmm_mark_chunk_occupied(owner, p1, num_pages, attr);
+    for (size_t i = 0; i < num_pages; i++) {
+        __mark_occupied(owner, p1 + i, attr);
+    }
 
-    return p1 << 12;
+    // 归还多余的尾部
+    for (size_t i = num_pages; i < (1U << order); i++) {
+        __buddy_free(p1 + i, 0);
+    }
+
+    return (void*)(p1 << 12);
 }
 
 void*
 pmm_alloc_page(pid_t owner, pp_attr_t attr)
 {
-    // Next fit approach. Maximize the throughput!
-    uintptr_t good_page_found = (uintptr_t)NULL;
-    size_t old_pg_ptr = pg_lookup_ptr;
-    size_t upper_lim = max_pg;
-    struct pp_struct* pm;
-    while (!good_page_found && pg_lookup_ptr < upper_lim) {
-        pm = &pm_table[pg_lookup_ptr];
-
-        if (!pm->ref_counts) {
-            *pm = (struct pp_struct){ .attr = attr,
-                                      .owner = owner,
-                                      .ref_counts = 1 };
-            good_page_found = pg_lookup_ptr << 12;
-            break;
-        } else {
-            pg_lookup_ptr++;
-
-            // We've searched the interval [old_pg_ptr, max_pg) but failed
-            //   may be chances in [1, old_pg_ptr) ?
-            // Let's find out!
-            if (pg_lookup_ptr >= upper_lim && old_pg_ptr != LOOKUP_START) {
-                upper_lim = old_pg_ptr;
-                pg_lookup_ptr = LOOKUP_START;
-                old_pg_ptr = LOOKUP_START;
-            }
-        }
-    }
-    if (!good_page_found) {
+    u32_t ppn = __zone_alloc(attr, 0);
+
+    if (ppn == BUDDY_NIL) {
         __current->k_status = LXOUTOFMEM;
+        return NULL;
     }
-    return (void*)good_page_found;
+
+    __mark_occupied(owner, ppn, attr);
+    return (void*)(ppn << 12);
 }
 
 int
 pmm_free_page(pid_t owner, void* page)
 {
-    struct pp_struct* pm = &pm_table[(intptr_t)page >> 12];
+    u32_t ppn = (intptr_t)page >> 12;
 
     // Is this a MMIO mapping or double free?
-    if (((intptr_t)page >> 12) >= max_pg || !(pm->ref_counts)) {
+    if (ppn >= max_pg || !(pm_table[ppn].ref_counts)) {
         return 0;
     }
 
+    struct pp_struct* pm = &pm_table[ppn];
+
     // 如果是锁定页，则不作处理
     if ((pm->attr & PP_FGLOCKED)) {
         return 0;
@@ -131,7 +482,9 @@ pmm_free_page(pid_t owner, void* page)
 
     // TODO: 检查权限，保证：1) 只有正在使用该页（包括被分享者）的进程可以释放；
     // 2) 内核可释放所有页。
-    pm->ref_counts--;
+    if (!--pm->ref_counts && ppn >= LOOKUP_START) {
+        __buddy_free(ppn, 0);
+    }
     return 1;
 }
 
@@ -142,15 +495,20 @@ pmm_ref_page(pid_t owner, void* page)
 
     u32_t ppn = (uintptr_t)page >> 12;
 
-    if (ppn >= PM_BMP_MAX_SIZE) {
+    if (ppn >= max_pg) {
         return 0;
     }
 
     struct pp_struct* pm = &pm_table[ppn];
-    if (ppn >= max_pg || !pm->ref_counts) {
+    if (!pm->ref_counts) {
         return 0;
     }
 
+    // 与释放对称：锁定页（如零页）不计引用，以免被大量共享时计数溢出
+    if ((pm->attr & PP_FGLOCKED)) {
+        return 1;
+    }
+
     pm->ref_counts++;
     return 1;
 }
@@ -160,9 +518,34 @@ pmm_query(void* pa)
 {
     u32_t ppn = (uintptr_t)pa >> 12;
 
-    if (ppn >= PM_BMP_MAX_SIZE) {
+    if (ppn >= max_pg) {
         return NULL;
     }
 
     return &pm_table[ppn];
-}
\ No newline at end of file
+}
+
+size_t
+pmm_free_blocks(int order)
+{
+    if (order < 0 || order > PM_MAX_ORDER) {
+        return 0;
+    }
+
+    size_t nr_free = 0;
+    for (size_t i = 0; i < PM_NR_ZONES; i++) {
+        nr_free += zones[i].free_areas[order].nr_free;
+    }
+
+    return nr_free;
+}
+
+struct pm_zone*
+pmm_zone(int zone)
+{
+    if (zone < 0 || zone >= PM_NR_ZONES) {
+        return NULL;
+    }
+
+    return &zones[zone];
+}
@@ -0,0 +1,85 @@
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+
+extern struct scheduler sched_ctx; /* kernel/sched.c */
+
+void
+__pmm_rd_buddyinfo(struct twimap* map)
+{
+    size_t free_pages = 0;
+    for (int i = 0; i <= PM_MAX_ORDER; i++) {
+        size_t nr_free = pmm_free_blocks(i);
+        free_pages += nr_free << i;
+        twimap_printf(map, "%u ", nr_free);
+    }
+    twimap_printf(map, "\n%u\n", free_pages);
+}
+
+void
+__pmm_rd_zoneinfo(struct twimap* map)
+{
+    for (int i = 0; i < PM_NR_ZONES; i++) {
+        struct pm_zone* zone = pmm_zone(i);
+        twimap_printf(map,
+                      "%s %u %u %u\n",
+                      zone->name,
+                      zone->managed,
+                      zone->free_pages,
+                      zone->wmark_low);
+    }
+}
+
+/**
+ * @brief 按所有者统计在用的物理页（常驻页）。共享页仅计入其分配者。
+ *
+ */
+void
+__pmm_rd_resident(struct twimap* map)
+{
+    u32_t kernel = 0;
+    pid_t nr_pids = (pid_t)sched_ctx.ptable_len;
+    u32_t* counts = vzalloc(nr_pids * sizeof(u32_t));
+    if (!counts) {
+        return;
+    }
+
+    struct pp_struct* pp;
+    for (u32_t ppn = 0; (pp = pmm_query((void*)(ppn << 12))); ppn++) {
+        if (!pp->ref_counts) {
+            continue;
+        }
+        if (pp->owner == (u16_t)KERNEL_PID) {
+            kernel++;
+        } else if (pp->owner < nr_pids) {
+            counts[pp->owner]++;
+        }
+    }
+
+    twimap_printf(map, "%d %u\n", KERNEL_PID, kernel);
+    struct proc_info* proc;
+    for (pid_t i = 0; (proc = get_next_process(i)); i = proc->pid + 1) {
+        if (proc->pid < nr_pids && counts[proc->pid]) {
+            twimap_printf(map, "%d %u\n", proc->pid, counts[proc->pid]);
+        }
+    }
+
+    vfree(counts);
+}
+
+void
+pmm_export()
+{
+    struct twifs_node* pmm_root = twifs_dir_node(NULL, "pmm");
+
+    struct twimap* map = twifs_mapping(pmm_root, NULL, "buddyinfo");
+    map->read = __pmm_rd_buddyinfo;
+
+    map = twifs_mapping(pmm_root, NULL, "zoneinfo");
+    map->read = __pmm_rd_zoneinfo;
+
+    map = twifs_mapping(pmm_root, NULL, "resident");
+    map->read = __pmm_rd_resident;
+}
@@ -0,0 +1,151 @@
+#include <hal/cpu.h>
+#include <lunaix/clock.h>
+#include <lunaix/ds/lru.h>
+#include <lunaix/ds/waitq.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/cake.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/swap.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+
+// 每轮至多回收的对象数，回收一轮后让出处理器，以免长时间独占
+#define RECLAIM_BATCH 32
+
+// 一轮回收毫无进展时（对象均被钉住），在此期间（毫秒）内忽略唤醒
+#define RECLAIM_BACKOFF 100
+
+LOG_MODULE("RECLAIM")
+
+static waitq_t reclaim_wq;
+static struct proc_info* kreclaimd;
+static time_t backoff_until;
+
+static struct
+{
+    u32_t wakeups;
+    u32_t rounds;
+    u32_t reclaimed;
+    u32_t stalls;
+    u32_t cake_pages;
+    u32_t swapped;
+} reclaim_stat;
+
+/**
+ * @brief 计算各区域距高水位线的总缺额（页）
+ *
+ */
+static size_t
+__reclaim_deficit()
+{
+    size_t deficit = 0;
+    for (int i = 0; i < PM_NR_ZONES; i++) {
+        struct pm_zone* zone = pmm_zone(i);
+        if (zone->free_pages < zone->wmark_high) {
+            deficit += zone->wmark_high - zone->free_pages;
+        }
+    }
+    return deficit;
+}
+
+static void
+__kreclaimd(void* arg)
+{
+    while (1) {
+        // LRU链表同样为系统调用所操作，回收期间须屏蔽中断
+        cpu_disable_interrupt();
+
+        size_t deficit = __reclaim_deficit();
+        if (!deficit) {
+            pwait(&reclaim_wq);
+            continue;
+        }
+
+        u32_t n = lru_reclaim(MIN(deficit, RECLAIM_BATCH));
+
+        // 被驱逐的对象多半只是使蛋糕变空，需收缩蛋糕堆才能真正归还页框。
+        //  弹匣仅在别无他法时才清空，以免损及分配的快速路径
+        u32_t pages = cake_shrink_all(0);
+
+        // 缓存中已无可回收者，换出冷的匿名页。期间可能因I/O而让出处理器
+        u32_t swapped = 0;
+        if (!n && !pages) {
+            swapped = swap_out(MIN(deficit, RECLAIM_BATCH));
+            cpu_disable_interrupt();
+        }
+
+        if (!n && !pages && !swapped) {
+            pages = cake_shrink_all(1);
+        }
+
+        reclaim_stat.rounds++;
+        reclaim_stat.reclaimed += n;
+        reclaim_stat.cake_pages += pages;
+        reclaim_stat.swapped += swapped;
+
+        if (!n && !pages && !swapped) {
+            // 已无可驱逐的对象，暂停回收，直至退避期满后的下一次唤醒
+            reclaim_stat.stalls++;
+            backoff_until = clock_systime() + RECLAIM_BACKOFF;
+            pwait(&reclaim_wq);
+            continue;
+        }
+
+        sched_yieldk();
+    }
+}
+
+void
+pmm_reclaim_wakeup()
+{
+    if (!kreclaimd || waitq_empty(&reclaim_wq)) {
+        return;
+    }
+
+    if (clock_systime() < backoff_until) {
+        return;
+    }
+
+    // 空闲进程会在开中断的情况下分配页框
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    if (!waitq_empty(&reclaim_wq)) {
+        reclaim_stat.wakeups++;
+        pwake_one(&reclaim_wq);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+static void
+__reclaim_rd_stat(struct twimap* map)
+{
+    twimap_printf(map,
+                  "%u %u %u %u %u %u\n",
+                  reclaim_stat.wakeups,
+                  reclaim_stat.rounds,
+                  reclaim_stat.reclaimed,
+                  reclaim_stat.stalls,
+                  reclaim_stat.cake_pages,
+                  reclaim_stat.swapped);
+}
+
+void
+pmm_reclaim_init()
+{
+    waitq_init(&reclaim_wq);
+
+    kreclaimd = spawn_kthread(__kreclaimd, NULL);
+    if (!kreclaimd) {
+        kprintf(KWARN "fail to start reclaim thread\n");
+        return;
+    }
+
+    struct twimap* map = twifs_mapping(NULL, NULL, "reclaim");
+    map->read = __reclaim_rd_stat;
+}
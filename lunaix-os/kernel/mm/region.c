@@ -1,59 +1,201 @@
+#include <klibc/string.h>
+#include <lunaix/fs.h>
 #include <lunaix/mm/region.h>
+#include <lunaix/mm/shm.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/spike.h>
+
+// 索引数组大小受限于最大的 valloc 块
+#define REGION_INDEX_MAX (8192 / sizeof(struct mm_region*))
 
 void
-region_add(struct mm_region* regions,
+region_init(struct mm_regions* regions)
+{
+    llist_init_head(&regions->head);
+    regions->index = NULL;
+    regions->nr = 0;
+    regions->capacity = 0;
+    regions->last_hit = NULL;
+}
+
+static int
+__index_reserve(struct mm_regions* regions, unsigned int nr)
+{
+    if (nr <= regions->capacity) {
+        return 1;
+    }
+
+    unsigned int cap = regions->capacity ? regions->capacity : 8;
+    while (cap < nr) {
+        cap <<= 1;
+    }
+
+    if (cap > REGION_INDEX_MAX) {
+        return 0;
+    }
+
+    struct mm_region** index = valloc(cap * sizeof(struct mm_region*));
+    if (!index) {
+        return 0;
+    }
+
+    if (regions->index) {
+        memcpy(index, regions->index, regions->nr * sizeof(struct mm_region*));
+        vfree(regions->index);
+    }
+
+    regions->index = index;
+    regions->capacity = cap;
+    return 1;
+}
+
+/**
+ * @brief 返回第一个起始地址大于 vaddr 的区域在索引中的位置
+ *
+ */
+static unsigned int
+__index_upper(struct mm_regions* regions, unsigned long vaddr)
+{
+    unsigned int lo = 0, hi = regions->nr;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (regions->index[mid]->start <= vaddr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+struct mm_region*
+region_add(struct mm_regions* regions,
            unsigned long start,
            unsigned long end,
            unsigned int attr)
 {
+    assert_msg(__index_reserve(regions, regions->nr + 1), "region: too many");
+
     struct mm_region* region = valloc(sizeof(struct mm_region));
 
     *region = (struct mm_region){ .attr = attr, .end = end, .start = start };
 
-    llist_append(&regions->head, &region->head);
+    unsigned int pos = __index_upper(regions, start);
+
+    // 保持链表有序：插入至后继之前
+    if (pos < regions->nr) {
+        llist_append(&regions->index[pos]->head, &region->head);
+    } else {
+        llist_append(&regions->head, &region->head);
+    }
+
+    memmove(&regions->index[pos + 1],
+            &regions->index[pos],
+            (regions->nr - pos) * sizeof(struct mm_region*));
+    regions->index[pos] = region;
+    regions->nr++;
+
+    return region;
+}
+
+static void
+__region_free(struct mm_region* region)
+{
+    if (region->mfile) {
+        vfs_close(region->mfile);
+    }
+    if (region->shm) {
+        shm_put(region->shm);
+    }
+    vfree(region);
 }
 
 void
-region_release_all(struct mm_region* regions)
+region_remove(struct mm_regions* regions, struct mm_region* region)
+{
+    unsigned int pos = __index_upper(regions, region->start);
+    assert(pos && regions->index[pos - 1] == region);
+    pos--;
+
+    memmove(&regions->index[pos],
+            &regions->index[pos + 1],
+            (regions->nr - pos - 1) * sizeof(struct mm_region*));
+    regions->nr--;
+
+    if (regions->last_hit == region) {
+        regions->last_hit = NULL;
+    }
+
+    llist_delete(&region->head);
+    __region_free(region);
+}
+
+void
+region_release_all(struct mm_regions* regions)
 {
     struct mm_region *pos, *n;
 
     llist_for_each(pos, n, &regions->head, head)
     {
-        vfree(pos);
+        __region_free(pos);
     }
+
+    if (regions->index) {
+        vfree(regions->index);
+    }
+
+    region_init(regions);
 }
 
 void
-region_copy(struct mm_region* src, struct mm_region* dest)
+region_copy(struct mm_regions* src, struct mm_regions* dest)
 {
     if (!src) {
         return;
     }
 
+    __index_reserve(dest, dest->nr + src->nr);
+
     struct mm_region *pos, *n;
 
     llist_for_each(pos, n, &src->head, head)
     {
-        region_add(dest, pos->start, pos->end, pos->attr);
+        struct mm_region* copied =
+          region_add(dest, pos->start, pos->end, pos->attr);
+
+        if ((copied->mfile = pos->mfile)) {
+            atomic_fetch_add(&copied->mfile->ref_count, 1);
+        }
+        copied->offset = pos->offset;
+
+        if ((copied->shm = pos->shm)) {
+            shm_get(copied->shm);
+        }
     }
 }
 
 struct mm_region*
-region_get(struct mm_region* regions, unsigned long vaddr)
+region_get(struct mm_regions* regions, unsigned long vaddr)
 {
     if (!regions) {
         return NULL;
     }
 
-    struct mm_region *pos, *n;
+    struct mm_region* hit = regions->last_hit;
+    if (hit && hit->start <= vaddr && vaddr < hit->end) {
+        return hit;
+    }
 
-    llist_for_each(pos, n, &regions->head, head)
-    {
-        if (pos->start <= vaddr && vaddr < pos->end) {
-            return pos;
-        }
+    unsigned int pos = __index_upper(regions, vaddr);
+    if (!pos) {
+        return NULL;
     }
+
+    hit = regions->index[pos - 1];
+    if (vaddr < hit->end) {
+        regions->last_hit = hit;
+        return hit;
+    }
+
     return NULL;
 }
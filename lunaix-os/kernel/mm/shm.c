@@ -0,0 +1,207 @@
+/**
+ * @file shm.c
+ * @brief 共享内存段，见 lunaix/mm/shm.h
+ *
+ */
+#include <lunaix/mm/mmap.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/region.h>
+#include <lunaix/mm/shm.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+struct shm_seg
+{
+    int key;
+    u32_t nr_pages;
+    u32_t nattach; // 映射该段的区域数
+    uintptr_t frames[0];
+};
+
+static struct shm_seg* shm_segs[SHM_MAX_SEGS];
+
+static void
+__shm_free(struct shm_seg* seg)
+{
+    for (u32_t i = 0; i < seg->nr_pages; i++) {
+        if (seg->frames[i]) {
+            pmm_free_page(KERNEL_PID, seg->frames[i]);
+        }
+    }
+    vfree(seg);
+}
+
+static int
+__shm_find(int key)
+{
+    for (int i = 0; i < SHM_MAX_SEGS; i++) {
+        if (shm_segs[i] && shm_segs[i]->key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static struct shm_seg*
+__shm_alloc(int key, u32_t nr_pages)
+{
+    struct shm_seg* seg =
+      vzalloc(sizeof(struct shm_seg) + nr_pages * sizeof(uintptr_t));
+    if (!seg) {
+        return NULL;
+    }
+
+    seg->key = key;
+    seg->nr_pages = nr_pages;
+
+    for (u32_t i = 0; i < nr_pages; i++) {
+        if (!(seg->frames[i] = pmm_alloc_zeroed(KERNEL_PID))) {
+            __shm_free(seg);
+            return NULL;
+        }
+    }
+
+    return seg;
+}
+
+void
+shm_get(struct shm_seg* seg)
+{
+    seg->nattach++;
+}
+
+void
+shm_put(struct shm_seg* seg)
+{
+    assert(seg->nattach);
+    if (--seg->nattach) {
+        return;
+    }
+
+    for (int i = 0; i < SHM_MAX_SEGS; i++) {
+        if (shm_segs[i] == seg) {
+            shm_segs[i] = NULL;
+            break;
+        }
+    }
+
+    __shm_free(seg);
+}
+
+/**
+ * @brief 以键查找共享内存段，不存在则创建之
+ *
+ * @return int 段号
+ */
+__DEFINE_LXSYSCALL3(int, shm_create, int, key, size_t, size, int, flags)
+{
+    int errno = 0, id = -1;
+
+    if (key != SHM_PRIVATE && (id = __shm_find(key)) >= 0) {
+        if ((flags & SHM_EXCL)) {
+            errno = EEXIST;
+        } else if (size > shm_segs[id]->nr_pages * PG_SIZE) {
+            errno = EINVAL;
+        }
+        goto done;
+    }
+
+    // 先于取整检查大小：接近4GiB的大小取整后回绕为零
+    if (!size || size > SHM_MAX_PAGES * PG_SIZE) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    u32_t nr_pages = ROUNDUP(size, PG_SIZE) >> 12;
+
+    for (id = 0; id < SHM_MAX_SEGS && shm_segs[id]; id++)
+        ;
+
+    if (id == SHM_MAX_SEGS) {
+        errno = ENOSPC;
+        goto done;
+    }
+
+    if (!(shm_segs[id] = __shm_alloc(key, nr_pages))) {
+        errno = ENOMEM;
+    }
+
+done:
+    return errno ? DO_STATUS(errno) : id;
+}
+
+/**
+ * @brief 将共享内存段映射至当前进程的 mmap 区间
+ *
+ * @return void* 映射的起始地址
+ */
+__DEFINE_LXSYSCALL2(void*, shm_attach, int, id, int, flags)
+{
+    int errno = 0;
+    struct shm_seg* seg;
+    struct mm_regions* regions = &__current->mm.regions;
+
+    if (id < 0 || id >= SHM_MAX_SEGS || !(seg = shm_segs[id])) {
+        errno = EINVAL;
+        goto done;
+    }
+
+    size_t length = seg->nr_pages * PG_SIZE;
+    uintptr_t start = mmap_find_free(regions, length);
+    if (!start) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    int attr = REGION_WSHARED | REGION_READ;
+    pt_attr pattr = PG_PRESENT | PG_ALLOW_USER;
+    if (!(flags & SHM_RDONLY)) {
+        attr |= REGION_WRITE;
+        pattr |= PG_WRITE;
+    }
+
+    struct mm_region* region = region_add(regions, start, start + length, attr);
+    region->shm = seg;
+    shm_get(seg);
+
+    // 页框已存在，直接映射，无需经由缺页
+    for (u32_t i = 0; i < seg->nr_pages; i++) {
+        pmm_ref_page(__current->pid, seg->frames[i]);
+        vmm_set_mapping(
+          PD_REFERENCED, start + i * PG_SIZE, seg->frames[i], pattr, VMAP_NULL);
+    }
+
+    return (void*)start;
+
+done:
+    return (void*)DO_STATUS(errno);
+}
+
+/**
+ * @brief 解除由 shm_attach 建立的映射
+ *
+ */
+__DEFINE_LXSYSCALL1(int, shm_detach, void*, addr)
+{
+    struct mm_regions* regions = &__current->mm.regions;
+    struct mm_region* region = region_get(regions, (uintptr_t)addr);
+
+    if (!region || !region->shm || region->start != (uintptr_t)addr) {
+        return DO_STATUS(EINVAL);
+    }
+
+    for (uintptr_t va = region->start; va < region->end; va += PG_SIZE) {
+        uintptr_t pa = vmm_del_mapping(PD_REFERENCED, va);
+        if (pa) {
+            pmm_free_page(__current->pid, pa);
+        }
+    }
+
+    region_remove(regions, region);
+
+    return 0;
+}
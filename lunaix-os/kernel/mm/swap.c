@@ -0,0 +1,516 @@
+/**
+ * @file swap.c
+ * @brief 匿名页的换出与换入，见 lunaix/mm/swap.h
+ *
+ *  目前仅BSP参与调度，被扫描的进程不在运行，其TLB项已在切换地址空间时作废，
+ *  故修改其页表项（清除访问位、脏位，或换出）时无需刷新TLB。
+ *
+ */
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/ds/mutex.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/swap.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+
+// 每次换出至多检查的页表项数，检查期间屏蔽中断
+#define SWAP_SCAN_MAX 4096
+
+// 换入时，在缺页地址前后各这么多页的范围内寻找可预读的页表项
+#define SWAP_AROUND (SWAP_CLUSTER * 2)
+
+#define SWAP_PT(mnt, va) ((x86_page_table*)((mnt) | (L1_INDEX(va) << 12)))
+#define SWAP_PD(mnt) ((x86_page_table*)((mnt) | (1023 << 12)))
+
+LOG_MODULE("SWAP")
+
+// Linux swap 分区的类型 GUID：0657FD6D-A4AB-43C4-84E5-0933C84B4F4F
+static u8_t SWAP_GUID[16] = { 0x6d, 0xfd, 0x57, 0x06, 0xab, 0xa4, 0xc4, 0x43,
+                              0x84, 0xe5, 0x09, 0x33, 0xc8, 0x4b, 0x4f, 0x4f };
+
+static struct
+{
+    struct device* dev;
+    u16_t* refs;
+    u32_t nr_slots;
+    u32_t used;
+    u32_t hint; // 下一次分配从该簇开始查找
+    void* buf;  // 一簇大小的I/O缓冲区
+    mutex_t lock;
+} swap_area;
+
+static struct
+{
+    u32_t out;
+    u32_t in;
+    u32_t readahead;
+} swap_stat;
+
+// 时钟指针：下一次换出从该进程的该地址处继续扫描
+static pid_t hand_pid;
+static uintptr_t hand_va;
+
+struct swap_victim
+{
+    uintptr_t va;
+    uintptr_t pa;
+    x86_pte_t pte;
+};
+
+int
+swap_probe(struct block_dev* bdev, u8_t* type)
+{
+    if (memcmp(type, SWAP_GUID, 16)) {
+        return 0;
+    }
+
+    if (swap_area.dev) {
+        kprintf(KWARN "%s: only one swap area is supported\n", bdev->bdev_id);
+        return 0;
+    }
+
+    u64_t size = (bdev->end_lba - bdev->start_lba + 1) * bdev->blk_size;
+    u32_t nr = (u32_t)MIN(size >> PG_SIZE_BITS, (u64_t)SWAP_MAX_SLOTS);
+
+    // 不足一簇的尾部不予使用，换入时总可整簇读取
+    nr &= ~(SWAP_CLUSTER - 1);
+    if (nr <= SWAP_CLUSTER) {
+        kprintf(KWARN "%s: swap area too small\n", bdev->bdev_id);
+        return 0;
+    }
+
+    u16_t* refs = vzalloc(nr * sizeof(u16_t));
+    void* buf = valloc(SWAP_CLUSTER * PG_SIZE);
+    if (!refs || !buf) {
+        vfree(refs);
+        vfree(buf);
+        return 0;
+    }
+
+    // 槽位0为首部，永不分配
+    refs[0] = 1;
+
+    mutex_init(&swap_area.lock);
+    swap_area.refs = refs;
+    swap_area.buf = buf;
+    swap_area.nr_slots = nr;
+    swap_area.dev = bdev->dev;
+
+    kprintf("%s: %u KiB swap\n", bdev->bdev_id, (nr - 1) * (PG_SIZE / 1024));
+    return 1;
+}
+
+static inline void
+__swap_get(u32_t slot)
+{
+    __atomic_add_fetch(&swap_area.refs[slot], 1, __ATOMIC_RELAXED);
+}
+
+static void
+__swap_put(u32_t slot)
+{
+    if (!__atomic_sub_fetch(&swap_area.refs[slot], 1, __ATOMIC_RELAXED)) {
+        __atomic_sub_fetch(&swap_area.used, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void
+swap_entry_dup(x86_pte_t pte)
+{
+    if (PG_IS_SWAPPED(pte)) {
+        __swap_get(PG_SWAP_SLOT(pte));
+    }
+}
+
+void
+swap_entry_free(x86_pte_t pte)
+{
+    if (PG_IS_SWAPPED(pte)) {
+        __swap_put(PG_SWAP_SLOT(pte));
+    }
+}
+
+/**
+ * @brief 在同一簇内分配 n 个连续的槽位
+ *
+ * @return u32_t 首个槽位，无足够空间时为0
+ */
+static u32_t
+__swap_alloc(u32_t n)
+{
+    u32_t nr_clusters = swap_area.nr_slots / SWAP_CLUSTER;
+
+    for (u32_t i = 0; i < nr_clusters; i++) {
+        u32_t c = (swap_area.hint + i) % nr_clusters;
+        u16_t* refs = &swap_area.refs[c * SWAP_CLUSTER];
+        u32_t run = 0;
+
+        for (u32_t j = 0; j < SWAP_CLUSTER; j++) {
+            run = refs[j] ? 0 : run + 1;
+            if (run < n) {
+                continue;
+            }
+
+            for (u32_t k = j + 1 - n; k <= j; k++) {
+                refs[k] = 1;
+            }
+
+            swap_area.hint = c;
+            __atomic_add_fetch(&swap_area.used, n, __ATOMIC_RELAXED);
+            return c * SWAP_CLUSTER + j + 1 - n;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 页目录项所指的L2页表是否为该进程独有。
+ * 共享的页表（fork后未写入，或vfork）中的页表项不可改动
+ *
+ */
+static int
+__swap_pt_exclusive(x86_pte_t pde)
+{
+    if (!(pde & PG_PRESENT) || (pde & PG_PDE_4MB) || !(pde & PG_WRITE)) {
+        return 0;
+    }
+
+    struct pp_struct* pp = pmm_query((void*)PG_ENTRY_ADDR(pde));
+    return pp && pp->ref_counts == 1;
+}
+
+/**
+ * @brief 自时钟指针处扫描 proc 的匿名区域，收集至多 max 个冷页，并持有其引用。
+ * 近期被访问过的页只清除其访问位，留待下一轮（第二次机会）。
+ * proc 的页目录须已挂载于 PD_MOUNT_1
+ *
+ */
+static u32_t
+__swap_scan(struct proc_info* proc,
+            struct swap_victim* victims,
+            u32_t max,
+            u32_t* budget)
+{
+    u32_t n = 0;
+    struct mm_region *pos, *r;
+
+    cpu_invplg(SWAP_PD(PD_MOUNT_1));
+
+    llist_for_each(pos, r, &proc->mm.regions.head, head)
+    {
+        if (pos->end <= hand_va || pos->mfile ||
+            (pos->attr & REGION_MODE_MASK) == REGION_WSHARED) {
+            continue;
+        }
+
+        uintptr_t va = MAX(pos->start, hand_va);
+        u32_t l1_inx = -1;
+
+        for (; va < pos->end; va += PG_SIZE) {
+            if (n == max || !*budget) {
+                hand_va = va;
+                return n;
+            }
+            (*budget)--;
+
+            if (KSTACK_START <= va && va <= KSTACK_TOP) {
+                continue;
+            }
+
+            if (L1_INDEX(va) != l1_inx) {
+                l1_inx = L1_INDEX(va);
+                if (!__swap_pt_exclusive(SWAP_PD(PD_MOUNT_1)->entry[l1_inx])) {
+                    // 跳过该页表所覆盖的余下部分
+                    va = ((l1_inx + 1) << 22) - PG_SIZE;
+                    continue;
+                }
+                cpu_invplg(SWAP_PT(PD_MOUNT_1, va));
+            }
+
+            x86_pte_t* pte = &PTE_MOUNTED(PD_MOUNT_1, va >> 12);
+            x86_pte_t e = *pte;
+            if (!(e & PG_PRESENT)) {
+                continue;
+            }
+
+            if ((e & PG_ACCESSED_BIT)) {
+                *pte = e & ~PG_ACCESSED_BIT;
+                continue;
+            }
+
+            uintptr_t pa = PG_ENTRY_ADDR(e);
+            struct pp_struct* pp = pmm_query((void*)pa);
+            if (!pp || pp->ref_counts != 1 ||
+                (pp->attr & (PP_FGPERSIST | PP_FGLOCKED))) {
+                continue;
+            }
+
+            // 清除脏位，换出期间的写入可借此察觉
+            e &= ~PG_DIRTY_BIT;
+            *pte = e;
+
+            pmm_ref_page(KERNEL_PID, (void*)pa);
+            victims[n++] = (struct swap_victim){ .va = va, .pa = pa, .pte = e };
+        }
+    }
+
+    hand_va = KERNEL_MM_BASE;
+    return n;
+}
+
+/**
+ * @brief 将已写出的页替换为换出的页表项。传输期间被访问、写入，
+ * 或因 fork 、解除映射而改变了的页，则保留之
+ *
+ */
+static int
+__swap_commit(pid_t pid, struct swap_victim* v, u32_t slot)
+{
+    x86_pte_t pde = SWAP_PD(PD_MOUNT_1)->entry[L1_INDEX(v->va)];
+    if (!__swap_pt_exclusive(pde)) {
+        return 0;
+    }
+
+    cpu_invplg(SWAP_PT(PD_MOUNT_1, v->va));
+
+    x86_pte_t* pte = &PTE_MOUNTED(PD_MOUNT_1, v->va >> 12);
+    if (*pte != v->pte || pmm_query((void*)v->pa)->ref_counts != 2) {
+        return 0;
+    }
+
+    *pte = NEW_SWAP_ENTRY(v->pte, slot);
+    pmm_free_page(pid, (void*)v->pa);
+    return 1;
+}
+
+/**
+ * @brief 按时钟指针挑选下一批换出的页，均来自同一进程
+ *
+ */
+static struct proc_info*
+__swap_pick(struct swap_victim* victims, u32_t max, u32_t* n)
+{
+    u32_t budget = SWAP_SCAN_MAX;
+    int wrapped = 0;
+
+    while (budget) {
+        struct proc_info* proc = get_next_process(hand_pid);
+        if (!proc) {
+            if (wrapped++) {
+                break;
+            }
+            hand_pid = 0;
+            hand_va = 0;
+            continue;
+        }
+
+        if (proc->pid != hand_pid) {
+            hand_pid = proc->pid;
+            hand_va = 0;
+        }
+
+        if (proc != __current && !PROC_TERMINATED(proc->state)) {
+            vmm_mount_pd(PD_MOUNT_1, proc->page_table);
+            *n = __swap_scan(proc, victims, max, &budget);
+            vmm_unmount_pd(PD_MOUNT_1);
+        } else {
+            hand_va = KERNEL_MM_BASE;
+        }
+
+        if (hand_va >= KERNEL_MM_BASE) {
+            hand_pid = proc->pid + 1;
+            hand_va = 0;
+        }
+
+        if (*n) {
+            return proc;
+        }
+    }
+
+    return NULL;
+}
+
+u32_t
+swap_out(u32_t nr)
+{
+    struct swap_victim victims[SWAP_CLUSTER];
+    u32_t n = 0, k, slot = 0, freed = 0;
+
+    if (!swap_area.dev || !nr) {
+        return 0;
+    }
+
+    mutex_lock(&swap_area.lock);
+    cpu_disable_interrupt();
+
+    struct proc_info* proc = __swap_pick(victims, MIN(nr, SWAP_CLUSTER), &n);
+    if (!proc) {
+        goto done;
+    }
+
+    pid_t pid = proc->pid;
+    void* pd = proc->page_table;
+
+    // 交换区碎片化时，逐次减半，直至找到足够的连续槽位
+    for (k = n; k && !(slot = __swap_alloc(k)); k >>= 1)
+        ;
+
+    for (u32_t i = 0; i < k; i++) {
+        void* src = vmm_kmap_atomic(victims[i].pa);
+        memcpy(swap_area.buf + i * PG_SIZE, src, PG_SIZE);
+        vmm_kunmap_atomic(src);
+    }
+
+    int errno = 0;
+    if (k) {
+        errno = swap_area.dev->write(swap_area.dev,
+                                     swap_area.buf,
+                                     (foff_t)slot << PG_SIZE_BITS,
+                                     k * PG_SIZE);
+        cpu_disable_interrupt();
+    }
+
+    // 传输期间进程可能已退出
+    int alive = errno == (int)(k * PG_SIZE) && get_process(pid) == proc &&
+                !PROC_TERMINATED(proc->state) && proc->page_table == pd;
+
+    if (k && alive) {
+        vmm_mount_pd(PD_MOUNT_1, pd);
+        cpu_invplg(SWAP_PD(PD_MOUNT_1));
+    }
+
+    for (u32_t i = 0; i < n; i++) {
+        if (i < k) {
+            if (alive && __swap_commit(pid, &victims[i], slot + i)) {
+                freed++;
+            } else {
+                __swap_put(slot + i);
+            }
+        }
+        pmm_free_page(KERNEL_PID, (void*)victims[i].pa);
+    }
+
+    if (k && alive) {
+        vmm_unmount_pd(PD_MOUNT_1);
+    }
+
+    swap_stat.out += freed;
+
+done:
+    mutex_unlock(&swap_area.lock);
+    return freed;
+}
+
+/**
+ * @brief 以已读入缓冲区的簇（首个槽位为 base）换入 pte 所指的页
+ *
+ */
+static int
+__swap_install(volatile x86_pte_t* pte, u32_t base)
+{
+    x86_pte_t ent = *pte;
+    u32_t slot = PG_SWAP_SLOT(ent);
+
+    void* pa = pmm_alloc_page(__current->pid, 0);
+    if (!pa) {
+        return 0;
+    }
+
+    void* dst = vmm_kmap_atomic((uintptr_t)pa);
+    memcpy(dst, swap_area.buf + (slot - base) * PG_SIZE, PG_SIZE);
+    vmm_kunmap_atomic(dst);
+
+    *pte = NEW_L2_ENTRY((ent & ~PG_SWAPPED) | PG_PRESENT, pa);
+    __swap_put(slot);
+
+    swap_stat.in++;
+    return 1;
+}
+
+/**
+ * @brief 换入缺页地址附近（同一L2页表内）、槽位同属一簇的页。换出时相邻的页
+ * 被分配到相邻的槽位，故它们多半会被一同用到。预读的页未被访问，
+ * 若始终不用，将在下一轮扫描中再次被换出
+ *
+ */
+static void
+__swap_readahead(struct mm_region* region, uintptr_t va, u32_t base)
+{
+    for (int i = -SWAP_AROUND; i <= SWAP_AROUND; i++) {
+        uintptr_t next = va + i * PG_SIZE;
+        if (!i || next < region->start || next >= region->end ||
+            L1_INDEX(next) != L1_INDEX(va)) {
+            continue;
+        }
+
+        // 未present的页表项不会被TLB缓存，无需刷新
+        volatile x86_pte_t* pte = &PTE_MOUNTED(PD_REFERENCED, next >> 12);
+        if (!PG_IS_SWAPPED(*pte) ||
+            PG_SWAP_SLOT(*pte) - base >= SWAP_CLUSTER) {
+            continue;
+        }
+
+        if (!__swap_install(pte, base)) {
+            break;
+        }
+        swap_stat.readahead++;
+    }
+}
+
+int
+swap_fault(struct mm_region* region, uintptr_t va, volatile x86_pte_t* pte)
+{
+    x86_pte_t ent = *pte;
+    u32_t slot = PG_SWAP_SLOT(ent);
+
+    if (!swap_area.dev || slot >= swap_area.nr_slots) {
+        return 0;
+    }
+
+    mutex_lock(&swap_area.lock);
+
+    // 等待期间，该页可能已随另一次缺页被预读
+    if (*pte != ent) {
+        mutex_unlock(&swap_area.lock);
+        return 1;
+    }
+
+    u32_t base = slot & ~(SWAP_CLUSTER - 1);
+    int errno = swap_area.dev->read(swap_area.dev,
+                                    swap_area.buf,
+                                    (foff_t)base << PG_SIZE_BITS,
+                                    SWAP_CLUSTER * PG_SIZE);
+
+    int ok = 0;
+    if (errno == SWAP_CLUSTER * PG_SIZE && (ok = __swap_install(pte, base))) {
+        __swap_readahead(region, PG_ALIGN(va), base);
+    }
+
+    mutex_unlock(&swap_area.lock);
+    return ok;
+}
+
+static void
+__swap_rd_stat(struct twimap* map)
+{
+    twimap_printf(map,
+                  "%u %u %u %u %u\n",
+                  swap_area.nr_slots ? swap_area.nr_slots - 1 : 0,
+                  swap_area.used,
+                  swap_stat.out,
+                  swap_stat.in,
+                  swap_stat.readahead);
+}
+
+void
+swap_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "swap");
+    map->read = __swap_rd_stat;
+}
@@ -1,6 +1,9 @@
 #include <klibc/string.h>
+#include <lunaix/ds/btrie.h>
 #include <lunaix/mm/cake.h>
+#include <lunaix/mm/pmm.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
 #include <lunaix/spike.h>
 
 #define CLASS_LEN(class) (sizeof(class) / sizeof(class[0]))
@@ -19,6 +22,14 @@ static char piles_names_dma[][PILE_NAME_MAXLEN] = {
 static struct cake_pile* piles[CLASS_LEN(piles_names)];
 static struct cake_pile* piles_dma[CLASS_LEN(piles_names_dma)];
 
+/*
+    超出最大分级的请求直接向页分配器索取物理连续的页，并映射至内核空间。
+    这类大对象以其虚拟地址为键记录于此，值为 (页数 << 1) | 是否为DMA内存。
+*/
+static struct btrie large_objs;
+
+#define LARGE_DMA 0x1
+
 void
 valloc_init()
 {
@@ -31,8 +42,56 @@ valloc_init()
     for (size_t i = 0; i < CLASS_LEN(piles_names_dma); i++) {
         int size = 1 << (i + 7);
         piles_dma[i] = cake_new_pile(
-          piles_names_dma[i], size, size > 1024 ? 4 : 1, PILE_CACHELINE);
+          piles_names_dma[i],
+          size,
+          size > 1024 ? 4 : 1,
+          PILE_CACHELINE | PILE_DMA);
     }
+
+    btrie_init(&large_objs, PG_SIZE_BITS);
+}
+
+static void*
+__valloc_large(unsigned int size, int dma)
+{
+    size_t nr_pages = CEIL(size, PG_SIZE_BITS);
+    uintptr_t pa =
+      pmm_alloc_cpage(KERNEL_PID, nr_pages, dma ? PP_GFP_DMA : 0);
+    if (!pa) {
+        return NULL;
+    }
+
+    void* ptr = vmm_vmap(pa, nr_pages * PG_SIZE, PG_PREM_RW);
+
+    // 此后这些页的引用由内核映射持有
+    for (size_t i = 0; i < nr_pages; i++) {
+        pmm_free_page(KERNEL_PID, pa + i * PG_SIZE);
+    }
+
+    if (!ptr) {
+        return NULL;
+    }
+
+    btrie_set(&large_objs,
+              (uintptr_t)ptr,
+              (void*)((nr_pages << 1) | (dma ? LARGE_DMA : 0)));
+    return ptr;
+}
+
+static void
+__vfree_large(void* ptr, int dma)
+{
+    if (((uintptr_t)ptr & (PG_SIZE - 1))) {
+        return;
+    }
+
+    uintptr_t tag = (uintptr_t)btrie_get(&large_objs, (uintptr_t)ptr);
+    if (!tag || !(tag & LARGE_DMA) != !dma) {
+        return;
+    }
+
+    btrie_remove(&large_objs, (uintptr_t)ptr);
+    vmm_vunmap((uintptr_t)ptr, (tag >> 1) * PG_SIZE);
 }
 
 void*
@@ -41,12 +100,18 @@ __valloc(unsigned int size,
          size_t len,
          size_t boffset)
 {
+    if (!size) {
+        return NULL;
+    }
+
     size_t i = ILOG2(size);
     i += (size - (1 << i) != 0);
-    i -= boffset;
+
+    // 小于最小分级的请求按最小分级分配
+    i = i > boffset ? i - boffset : 0;
 
     if (i >= len)
-        return NULL;
+        return __valloc_large(size, segregate_list == piles_dma);
 
     return cake_grab(segregate_list[i]);
 }
@@ -54,9 +119,16 @@ __valloc(unsigned int size,
 void
 __vfree(void* ptr, struct cake_pile** segregate_list, size_t len)
 {
-    size_t i = 0;
-    for (; i < len; i++) {
-        if (cake_release(segregate_list[i], ptr)) {
+    struct cake_pile* pile = cake_query_pile(ptr);
+    if (!pile) {
+        __vfree_large(ptr, segregate_list == piles_dma);
+        return;
+    }
+
+    // 确保该蛋糕确实来自于这组分离链表，防止误将普通内存当作DMA内存释放
+    for (size_t i = 0; i < len; i++) {
+        if (segregate_list[i] == pile) {
+            cake_release(pile, ptr);
             return;
         }
     }
@@ -72,7 +144,9 @@ void*
 vzalloc(unsigned int size)
 {
     void* ptr = __valloc(size, piles, CLASS_LEN(piles_names), 3);
-    memset(ptr, 0, size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
     return ptr;
 }
 
@@ -85,7 +159,9 @@ vcalloc(unsigned int size, unsigned int count)
     }
 
     void* ptr = __valloc(alloc_size, piles, CLASS_LEN(piles_names), 3);
-    memset(ptr, 0, alloc_size);
+    if (ptr) {
+        memset(ptr, 0, alloc_size);
+    }
     return ptr;
 }
 
@@ -105,7 +181,9 @@ void*
 vzalloc_dma(unsigned int size)
 {
     void* ptr = __valloc(size, piles_dma, CLASS_LEN(piles_names_dma), 7);
-    memset(ptr, 0, size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
     return ptr;
 }
 
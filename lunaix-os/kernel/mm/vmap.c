@@ -1,66 +1,369 @@
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/ds/llist.h>
+#include <lunaix/ds/rbtree.h>
 #include <lunaix/mm/pmm.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/spike.h>
+#include <lunaix/syslog.h>
 
 #define VMAP_START PG_MOUNT_BASE + MEM_4MB
 #define VMAP_END PD_REFERENCED
 
-static uintptr_t start = VMAP_START;
+// 空闲区间描述符的数量上限。由于vmap本身为蛋糕分配器所依赖，
+//  这些描述符只能静态分配。
+#define VMAP_MAX_EXTENTS 512
 
-void*
-vmm_vmap(uintptr_t paddr, size_t size, pt_attr attr)
+LOG_MODULE("VMAP")
+
+struct vmap_extent
 {
-    // next fit
-    assert_msg((paddr & 0xfff) == 0, "vmap: bad alignment");
-    size = ROUNDUP(size, PG_SIZE);
+    struct llist_header spares;
+    struct rb_node node;
+    uintptr_t start;
+    size_t size;
+    // 子树中最大的区间大小，分配时借此跳过容纳不下的子树
+    size_t max_size;
+};
+
+#define __ext(rbnode) rb_entry(rbnode, struct vmap_extent, node)
+
+#define VMAP_L1_BEGIN L1_INDEX(VMAP_START)
+#define VMAP_NR_L1 (L1_INDEX(VMAP_END) - VMAP_L1_BEGIN)
+
+static struct vmap_extent extent_pool[VMAP_MAX_EXTENTS];
+
+// 按起始地址排序的空闲区间，以子树中最大的区间大小增强
+static struct rb_root free_extents;
+static DEFINE_LLIST(spare_extents);
+
+// 被大页取代的、setup_memory 预留的页目录项，解除大页时原样恢复
+static x86_pte_t large_saved[VMAP_NR_L1];
+
+// 第一次fork后，内核页目录项已被复制至其他地址空间，不可再建立或拆除大页
+static int large_sealed;
+
+static void
+__extent_update(struct rb_node* node)
+{
+    struct vmap_extent* ext = __ext(node);
+    size_t max = ext->size;
+
+    if (node->left) {
+        max = MAX(max, __ext(node->left)->max_size);
+    }
+    if (node->right) {
+        max = MAX(max, __ext(node->right)->max_size);
+    }
+
+    ext->max_size = max;
+}
+
+static struct vmap_extent*
+__extent_new(uintptr_t start, size_t size)
+{
+    if (llist_empty(&spare_extents)) {
+        return NULL;
+    }
+
+    struct vmap_extent* ext =
+      list_entry(spare_extents.next, struct vmap_extent, spares);
+    llist_delete(&ext->spares);
+
+    ext->start = start;
+    ext->size = size;
+    ext->max_size = size;
+    return ext;
+}
+
+static void
+__extent_insert(struct vmap_extent* ext)
+{
+    struct rb_node **link = &free_extents.node, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link = ext->start < __ext(parent)->start ? &parent->left
+                                                 : &parent->right;
+    }
+
+    rb_link(&ext->node, parent, link);
+    rb_insert(&free_extents, &ext->node);
+}
 
-    uintptr_t current_addr = start;
-    size_t examed_size = 0, wrapped = 0;
-    x86_page_table* pd = (x86_page_table*)L1_BASE_VADDR;
+static void
+__extent_put(struct vmap_extent* ext)
+{
+    rb_erase(&free_extents, &ext->node);
+    llist_append(&spare_extents, &ext->spares);
+}
+
+/**
+ * @brief 区间的起始或大小改变后（不越过相邻的区间）更新聚合值
+ *
+ */
+static inline void
+__extent_changed(struct vmap_extent* ext)
+{
+    rb_propagate(&free_extents, &ext->node);
+}
+
+void
+vmm_vmap_init()
+{
+    for (size_t i = 0; i < VMAP_MAX_EXTENTS; i++) {
+        llist_append(&spare_extents, &extent_pool[i].spares);
+    }
+
+    free_extents = RB_ROOT(__extent_update);
 
-    while (!wrapped || current_addr >= start) {
-        size_t l1inx = L1_INDEX(current_addr);
-        if (!(pd->entry[l1inx])) {
-            // empty 4mb region
-            examed_size += MEM_4MB;
-            current_addr = (current_addr & 0xffc00000) + MEM_4MB;
+    struct vmap_extent* ext = __extent_new(VMAP_START, VMAP_END - VMAP_START);
+    __extent_insert(ext);
+}
+
+/**
+ * @brief 归还一段虚拟地址区间，并与相邻的空闲区间合并
+ *
+ */
+static void
+__vmap_release(uintptr_t start, size_t size)
+{
+    struct rb_node* node = free_extents.node;
+    struct vmap_extent *prev = NULL, *next = NULL;
+
+    // 找出起始地址不大于 start 的最后一个区间，以及其后的一个
+    while (node) {
+        struct vmap_extent* ext = __ext(node);
+        if (ext->start > start) {
+            next = ext;
+            node = node->left;
         } else {
-            x86_page_table* ptd = (x86_page_table*)(L2_VADDR(l1inx));
-            size_t i = L2_INDEX(current_addr), j = 0;
-            for (; i < PG_MAX_ENTRIES && examed_size < size; i++, j++) {
-                if (!ptd->entry[i]) {
-                    examed_size += PG_SIZE;
-                } else if (examed_size) {
-                    // found a discontinuity, start from beginning
-                    examed_size = 0;
-                    j++;
-                    break;
-                }
-            }
-            current_addr += j << 12;
+            prev = ext;
+            node = node->right;
+        }
+    }
+
+    if (prev && prev->start + prev->size == start) {
+        prev->size += size;
+        if (next && start + size == next->start) {
+            prev->size += next->size;
+            __extent_put(next);
         }
+        __extent_changed(prev);
+        return;
+    }
+
+    if (next && start + size == next->start) {
+        next->start = start;
+        next->size += size;
+        __extent_changed(next);
+        return;
+    }
+
+    struct vmap_extent* ext = __extent_new(start, size);
+    if (!ext) {
+        kprintf(KWARN "out of extents, leaking %p (%u bytes)\n", start, size);
+        return;
+    }
+
+    __extent_insert(ext);
+}
+
+static inline int
+__extent_fits(struct vmap_extent* ext, size_t size, size_t align)
+{
+    size_t gap = ROUNDUP(ext->start, align) - ext->start;
+    return ext->size >= gap + size;
+}
+
+/**
+ * @brief 按地址顺序找出第一个能容纳对齐后的 size 的区间。
+ *  子树中最大的区间仍小于 size 时，整棵子树都可跳过
+ *
+ */
+static struct vmap_extent*
+__extent_first_fit(struct rb_node* node, size_t size, size_t align)
+{
+    struct vmap_extent* ext;
+
+    if (!node || __ext(node)->max_size < size) {
+        return NULL;
+    }
+
+    if ((ext = __extent_first_fit(node->left, size, align))) {
+        return ext;
+    }
+
+    ext = __ext(node);
+    if (__extent_fits(ext, size, align)) {
+        return ext;
+    }
+
+    return __extent_first_fit(node->right, size, align);
+}
+
+/**
+ * @brief 分配一段按 align 对齐的虚拟地址区间
+ *
+ */
+static uintptr_t
+__vmap_alloc(size_t size, size_t align)
+{
+    struct vmap_extent *pos, *tail = NULL;
+
+    if (!(pos = __extent_first_fit(free_extents.node, size, align))) {
+        return 0;
+    }
+
+    uintptr_t aligned = ROUNDUP(pos->start, align);
+    size_t gap = aligned - pos->start;
 
-        if (examed_size >= size) {
-            goto done;
+    if (!gap) {
+        pos->start += size;
+        pos->size -= size;
+        if (!pos->size) {
+            __extent_put(pos);
+        } else {
+            __extent_changed(pos);
         }
+        return aligned;
+    }
+
+    // 前部留有空隙，需要将区间一分为二
+    size_t rest = pos->size - gap - size;
+    if (rest && !(tail = __extent_new(aligned + size, rest))) {
+        return 0;
+    }
+
+    pos->size = gap;
+    __extent_changed(pos);
+    if (tail) {
+        __extent_insert(tail);
+    }
+
+    return aligned;
+}
+
+/**
+ * @brief 以4MiB大页建立映射。
+ *
+ * 注意：内核空间的页目录项在fork时被按值复制至每个进程，而此处只修改当前的
+ * 页目录。因此大页只在第一次fork前（平台初始化期间）建立，之后的映射一律
+ * 使用4K页。预留的页表不释放，仍为其他页目录可能的引用保持有效。
+ */
+static void
+__vmap_set_large(uintptr_t va, uintptr_t pa, pt_attr attr)
+{
+    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
+    u32_t l1inx = L1_INDEX(va);
+
+    large_saved[l1inx - VMAP_L1_BEGIN] = l1pt->entry[l1inx];
+
+    // 大页目录项的第7位为PS，PAT位另在第12位
+    x86_pte_t large = NEW_L1_LARGE_ENTRY(attr & ~PG_PAT, pa);
+    if ((attr & PG_PAT)) {
+        large |= PG_PDE_PAT;
+    }
+
+    l1pt->entry[l1inx] = large;
+    cpu_invplg(L2_VADDR(l1inx));
+    cpu_invplg(va);
+
+    for (size_t i = 0; i < MEM_4MB; i += PG_SIZE) {
+        pmm_ref_page(KERNEL_PID, pa + i);
+    }
+}
+
+/**
+ * @brief 解除大页映射。fork之后大页已存在于每个地址空间中，仅改动当前
+ * 页目录会使其他进程仍能访问已归还的页帧，故此时映射保留，不予回收。
+ *
+ * @return 是否已解除
+ */
+static int
+__vmap_clear_large(uintptr_t va)
+{
+    if (large_sealed) {
+        return 0;
+    }
 
-        if (current_addr >= VMAP_END) {
-            wrapped = 1;
-            examed_size = 0;
-            current_addr = VMAP_START;
+    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
+    u32_t l1inx = L1_INDEX(va);
+    uintptr_t pa = PG_LARGE_ADDR(l1pt->entry[l1inx]);
+
+    // 恢复原先预留的页表，以便之后的4K映射
+    l1pt->entry[l1inx] = large_saved[l1inx - VMAP_L1_BEGIN];
+    cpu_invplg(va);
+    cpu_invplg(L2_VADDR(l1inx));
+
+    for (size_t i = 0; i < MEM_4MB; i += PG_SIZE) {
+        pmm_free_page(KERNEL_PID, pa + i);
+    }
+
+    return 1;
+}
+
+void
+vmm_vmap_seal()
+{
+    large_sealed = 1;
+}
+
+void*
+vmm_vmap(uintptr_t paddr, size_t size, pt_attr attr)
+{
+    assert_msg((paddr & 0xfff) == 0, "vmap: bad alignment");
+    size = ROUNDUP(size, PG_SIZE);
+
+    uintptr_t alloc_begin;
+
+    // 足够大且对齐的物理区间（通常为大型MMIO BAR）使用大页映射
+    if (!large_sealed && size >= MEM_4MB && !(paddr & (MEM_4MB - 1))) {
+        size_t lsize = ROUNDUP(size, MEM_4MB);
+        if ((alloc_begin = __vmap_alloc(lsize, MEM_4MB))) {
+            for (size_t i = 0; i < lsize; i += MEM_4MB) {
+                __vmap_set_large(alloc_begin + i, paddr + i, attr);
+            }
+            return (void*)alloc_begin;
         }
     }
 
-    return NULL;
+    if (!(alloc_begin = __vmap_alloc(size, PG_SIZE))) {
+        return NULL;
+    }
 
-done:
-    uintptr_t alloc_begin = current_addr - examed_size;
     for (size_t i = 0; i < size; i += PG_SIZE) {
-        vmm_set_mapping(
-          PD_REFERENCED, alloc_begin + i, paddr + i, PG_PREM_RW, 0);
+        vmm_set_mapping(PD_REFERENCED, alloc_begin + i, paddr + i, attr, 0);
         pmm_ref_page(KERNEL_PID, paddr + i);
     }
-    start = alloc_begin + size;
 
     return (void*)alloc_begin;
-}
\ No newline at end of file
+}
+
+void
+vmm_vunmap(uintptr_t vaddr, size_t size)
+{
+    assert_msg((vaddr & 0xfff) == 0, "vunmap: bad alignment");
+    size = ROUNDUP(size, PG_SIZE);
+
+    if (vaddr < VMAP_START || vaddr + size > VMAP_END) {
+        return;
+    }
+
+    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
+    if ((l1pt->entry[L1_INDEX(vaddr)] & PG_PDE_4MB)) {
+        size = ROUNDUP(size, MEM_4MB);
+        for (size_t i = 0; i < size; i += MEM_4MB) {
+            if (!__vmap_clear_large(vaddr + i)) {
+                return;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < size; i += PG_SIZE) {
+            uintptr_t paddr = vmm_del_mapping(PD_REFERENCED, vaddr + i);
+            pmm_free_page(KERNEL_PID, paddr);
+        }
+    }
+
+    __vmap_release(vaddr, size);
+}
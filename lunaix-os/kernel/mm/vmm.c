@@ -1,6 +1,7 @@
 #include <hal/cpu.h>
 #include <klibc/string.h>
 #include <lunaix/mm/pmm.h>
+#include <lunaix/mm/swap.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/spike.h>
 #include <lunaix/syslog.h>
@@ -10,7 +11,9 @@ LOG_MODULE("VMM")
 void
 vmm_init()
 {
-    // XXX: something here?
+    vmm_vmap_init();
+    vmm_kmap_init();
+    pmm_zero_init();
 }
 
 x86_page_table*
@@ -43,7 +46,14 @@ vmm_set_mapping(uintptr_t mnt,
     x86_page_table* l2pt = (x86_page_table*)(mnt | (l1_inx << 12));
 
     // See if attr make sense
-    assert(attr <= 128);
+    assert(attr <= 0xff);
+
+    int global = PG_GLOBAL_RANGE(va);
+
+    // fork后仍共享的页表需先行复制，以免修改波及其他进程
+    if (!(l1pt->entry[l1_inx] & PG_WRITE)) {
+        vmm_unshare_pt(mnt, l1_inx);
+    }
 
     if (!l1pt->entry[l1_inx]) {
         x86_page_table* new_l1pt_pa = pmm_alloc_page(KERNEL_PID, PP_FGPERSIST);
@@ -53,14 +63,17 @@ vmm_set_mapping(uintptr_t mnt,
             return 0;
         }
 
-        // This must be writable
+        // This must be writable. 目录项中的第7位为PS，而非PAT
         l1pt->entry[l1_inx] =
-          NEW_L1_ENTRY(attr | PG_WRITE | PG_PRESENT, new_l1pt_pa);
+          NEW_L1_ENTRY((attr & ~PG_PAT) | PG_WRITE | PG_PRESENT, new_l1pt_pa);
 
         // make sure our new l2 table is visible to CPU
         cpu_invplg(l2pt);
 
         memset((void*)l2pt, 0, PG_SIZE);
+    } else if ((l1pt->entry[l1_inx] & PG_PDE_4MB)) {
+        // 已由大页映射，无法在其中建立4K映射
+        return !!(options & (VMAP_IGNORE | VMAP_NOMAP));
     } else {
         x86_pte_t pte = l2pt->entry[l2_inx];
         if (pte && (options & VMAP_IGNORE)) {
@@ -68,7 +81,9 @@ vmm_set_mapping(uintptr_t mnt,
         }
     }
 
-    if (mnt == PD_REFERENCED) {
+    // 内核页表为共享的，经由挂载点的修改同样作用于当前地址空间；而全局页
+    //  不会随CR3的切换而失效，故亦须逐出
+    if (mnt == PD_REFERENCED || global) {
         cpu_invplg(va);
     }
 
@@ -76,7 +91,7 @@ vmm_set_mapping(uintptr_t mnt,
         return 1;
     }
 
-    l2pt->entry[l2_inx] = NEW_L2_ENTRY(attr, pa);
+    l2pt->entry[l2_inx] = NEW_L2_ENTRY(attr | (global ? PG_GLOBAL : 0), pa);
     return 1;
 }
 
@@ -97,13 +112,23 @@ vmm_del_mapping(uintptr_t mnt, uintptr_t va)
 
     x86_pte_t l1pte = l1pt->entry[l1_index];
 
-    if (l1pte) {
+    if (!(l1pte & PG_WRITE) && vmm_unshare_pt(mnt, l1_index)) {
+        l1pte = l1pt->entry[l1_index];
+    }
+
+    if (l1pte && !(l1pte & PG_PDE_4MB)) {
         x86_page_table* l2pt = (x86_page_table*)(mnt | (l1_index << 12));
         x86_pte_t l2pte = l2pt->entry[l2_index];
 
         cpu_invplg(va);
         l2pt->entry[l2_index] = PTE_NULL;
 
+        // 换出的页表项中的地址为槽位号，归还槽位即可
+        if (PG_IS_SWAPPED(l2pte)) {
+            swap_entry_free(l2pte);
+            return 0;
+        }
+
         return PG_ENTRY_ADDR(l2pte);
     }
 
@@ -119,6 +144,15 @@ vmm_lookup(uintptr_t va, v_mapping* mapping)
     x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
     x86_pte_t l1pte = l1pt->entry[l1_index];
 
+    if ((l1pte & PG_PDE_4MB)) {
+        mapping->flags = PG_ENTRY_FLAGS(l1pte);
+        mapping->pa = PG_LARGE_ADDR(l1pte) | (va & (MEM_4MB - 1) & ~0xfff);
+        mapping->pn = mapping->pa >> PG_SIZE_BITS;
+        mapping->pte = &l1pt->entry[l1_index];
+        mapping->va = va;
+        return 1;
+    }
+
     if (l1pte) {
         x86_pte_t* l2pte =
           &((x86_page_table*)L2_VADDR(l1_index))->entry[l2_index];
@@ -134,6 +168,32 @@ vmm_lookup(uintptr_t va, v_mapping* mapping)
     return 0;
 }
 
+int
+vmm_writable(uintptr_t va, size_t len)
+{
+    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
+    uintptr_t end = va + len;
+
+    for (va = PG_ALIGN(va); va < end; va += PG_SIZE) {
+        u32_t l1_index = L1_INDEX(va);
+        x86_pte_t l1pte = l1pt->entry[l1_index];
+
+        // 共享的L2页表以只读的页目录项标记，写入同样会引发缺页
+        if ((l1pte & (PG_PRESENT | PG_WRITE)) != (PG_PRESENT | PG_WRITE) ||
+            (l1pte & PG_PDE_4MB)) {
+            return 0;
+        }
+
+        x86_pte_t l2pte =
+          ((x86_page_table*)L2_VADDR(l1_index))->entry[L2_INDEX(va)];
+        if ((l2pte & (PG_PRESENT | PG_WRITE)) != (PG_PRESENT | PG_WRITE)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 void*
 vmm_v2p(void* va)
 {
@@ -143,6 +203,10 @@ vmm_v2p(void* va)
     x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
     x86_pte_t l1pte = l1pt->entry[l1_index];
 
+    if ((l1pte & PG_PDE_4MB)) {
+        return PG_LARGE_ADDR(l1pte) | ((uintptr_t)va & (MEM_4MB - 1));
+    }
+
     if (l1pte) {
         x86_pte_t* l2pte =
           &((x86_page_table*)L2_VADDR(l1_index))->entry[l2_index];
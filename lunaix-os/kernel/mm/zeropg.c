@@ -0,0 +1,85 @@
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+
+// 预先清零的页框池的容量
+#define ZERO_POOL_SIZE 32
+
+static uintptr_t zero_page;
+
+// 专供空闲进程清零页框所用的窗口，避免与其他挂载点冲突
+static void* zero_window;
+
+static uintptr_t zeroed_pool[ZERO_POOL_SIZE];
+static volatile u32_t zeroed_nr;
+
+void
+pmm_zero_init()
+{
+    zero_page = (uintptr_t)pmm_alloc_page(KERNEL_PID, PP_FGLOCKED);
+    assert_msg(zero_page, "zeropg: no memory");
+
+    // 窗口最初映射的即是零页本身，借此将其清零
+    zero_window = vmm_vmap(zero_page, PG_SIZE, PG_PREM_RW);
+    assert_msg(zero_window, "zeropg: no vmap space");
+
+    memset(zero_window, 0, PG_SIZE);
+}
+
+uintptr_t
+pmm_zero_page()
+{
+    return zero_page;
+}
+
+uintptr_t
+pmm_alloc_zeroed(pid_t owner)
+{
+    uintptr_t pa = 0;
+
+    // 仅在缺页处理中调用，此时中断已被屏蔽
+    if (zeroed_nr) {
+        pa = zeroed_pool[--zeroed_nr];
+        pmm_query((void*)pa)->owner = owner;
+        return pa;
+    }
+
+    if (!(pa = (uintptr_t)pmm_alloc_page(owner, PP_GFP_USER))) {
+        return 0;
+    }
+
+    void* va = vmm_kmap_atomic(pa);
+    memset(va, 0, PG_SIZE);
+    vmm_kunmap_atomic(va);
+
+    return pa;
+}
+
+void
+pmm_zero_refill()
+{
+    while (zeroed_nr < ZERO_POOL_SIZE) {
+        // 空闲进程在开中断的情况下运行，可被抢占：分配器与窗口的映射均不容
+        //  在中途被打断，故每次填充一页都禁止抢占，页与页之间方可让出
+        preempt_disable();
+
+        uintptr_t pa = (uintptr_t)pmm_alloc_page(KERNEL_PID, PP_GFP_USER);
+        if (!pa) {
+            preempt_enable();
+            return;
+        }
+
+        vmm_set_mapping(
+          PD_REFERENCED, (uintptr_t)zero_window, pa, PG_PREM_RW, VMAP_NULL);
+        memset(zero_window, 0, PG_SIZE);
+
+        cpu_disable_interrupt();
+        zeroed_pool[zeroed_nr++] = pa;
+        cpu_enable_interrupt();
+
+        preempt_enable();
+    }
+}
@@ -2,11 +2,13 @@
 #include <hal/ioapic.h>
 #include <lunaix/clock.h>
 #include <lunaix/common.h>
+#include <lunaix/ds/fifo.h>
 #include <lunaix/input.h>
 #include <lunaix/isrm.h>
 #include <lunaix/peripheral/ps2kbd.h>
 #include <lunaix/syslog.h>
 #include <lunaix/timer.h>
+#include <lunaix/workqueue.h>
 
 #include <arch/x86/interrupts.h>
 #include <hal/cpu.h>
@@ -72,6 +74,13 @@ static kbd_keycode_t scancode_set2_shift[] = {
 
 static struct input_device* kbd_idev;
 
+// 原始扫描码由中断处理程序放入，再由工作队列解码，须为 2 的幂
+#define KBD_SCANBUF_SIZE 64
+
+static uint8_t scanbuf_data[KBD_SCANBUF_SIZE];
+static struct fifo_buf scanbuf;
+static struct lx_work kbd_work;
+
 #define KBD_STATE_KWAIT 0x00
 #define KBD_STATE_KSPECIAL 0x01
 #define KBD_STATE_KRELEASED 0x02
@@ -86,6 +95,9 @@ static struct input_device* kbd_idev;
 void
 intr_ps2_kbd_handler(const isr_param* param);
 
+static void
+ps2_kbd_process(void* arg);
+
 static uint8_t
 ps2_issue_cmd_wretry(char cmd, uint16_t arg);
 
@@ -121,6 +133,9 @@ ps2_kbd_init()
     kbd_state.translation_table = scancode_set2;
     kbd_state.state = KBD_STATE_KWAIT;
 
+    fifo_init(&scanbuf, scanbuf_data, KBD_SCANBUF_SIZE, FIFO_SPSC);
+    work_init(&kbd_work, ps2_kbd_process, NULL);
+
     kbd_idev = input_add_device("i8042-kbd");
 
     acpi_context* acpi_ctx = acpi_get_context();
@@ -307,7 +322,6 @@ intr_ps2_kbd_handler(const isr_param* param)
     // it at your own risk This is to ensure we've cleared the output buffer
     // everytime, so it won't pile up across irqs.
     uint8_t scancode = io_inb(PS2_PORT_ENC_DATA);
-    kbd_keycode_t key;
 
     /*
      *    判断键盘是否处在指令发送状态，防止误触发。（伪输入中断）
@@ -351,6 +365,22 @@ intr_ps2_kbd_handler(const isr_param* param)
     kprintf(KDEBUG "%x\n", scancode & 0xff);
 #endif
 
+    /*
+     *  中断处理程序只负责取走扫描码。解码、更新按键状态以及通知输入监听者（如控制台，
+     *  其可能发送信号或是重绘屏幕）均推迟至工作队列中进行，
+     *  以免延长其他设备（AHCI、计时器）的中断响应时间。
+     *  缓冲满时（工作队列迟迟未被调度）丢弃新的扫描码。
+     */
+    if (fifo_putone(&scanbuf, scancode)) {
+        work_submit(&kbd_work);
+    }
+}
+
+static void
+ps2_kbd_decode(uint8_t scancode)
+{
+    kbd_keycode_t key;
+
     switch (kbd_state.state) {
         case KBD_STATE_KWAIT:
             if (scancode == 0xf0) { // release code
@@ -403,6 +433,15 @@ intr_ps2_kbd_handler(const isr_param* param)
     }
 }
 
+static void
+ps2_kbd_process(void* arg)
+{
+    uint8_t scancode;
+    while (fifo_readone_async(&scanbuf, &scancode)) {
+        ps2_kbd_decode(scancode);
+    }
+}
+
 static uint8_t
 ps2_issue_cmd(char cmd, uint16_t arg)
 {
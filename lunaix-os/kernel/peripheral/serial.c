@@ -1,23 +1,51 @@
 #include <hal/cpu.h>
 #include <hal/io.h>
+#include <lunaix/device.h>
+#include <lunaix/ioctl.h>
+#include <lunaix/isrm.h>
+#include <lunaix/klog.h>
+#include <lunaix/mm/valloc.h>
 #include <lunaix/peripheral/serial.h>
+#include <lunaix/poll.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
 #include <lunaix/syslog.h>
 
 LOG_MODULE("UART")
 
+// COM1 is left to sdbg, which polls it and owns its irq
+static struct serial_port* com2 = NULL;
+
+static struct klog_sink uart_sink;
+
+int
+serial_set_baud(uintptr_t port, u32_t baud)
+{
+    if (!baud || baud > SERIAL_BAUD_MAX || SERIAL_BAUD_MAX % baud) {
+        return EINVAL;
+    }
+
+    u32_t divisor = SERIAL_BAUD_MAX / baud;
+    u8_t lcr = io_inb(COM_RCLINE(port));
+
+    // divisor latch is accessible when DLAB = 1
+    io_outb(COM_RCLINE(port), lcr | 0x80);
+    io_outb(COM_RRXTX(port), divisor & 0xff);
+    io_outb(COM_RIE(port), (divisor >> 8) & 0xff);
+    io_outb(COM_RCLINE(port), lcr & ~0x80);
+
+    return 0;
+}
+
 void
 serial_init_port(uintptr_t port)
 {
     // disable interrupt, use irq instead
     io_outb(COM_RIE(port), 0);
 
-    // baud rate config (DLAB = 1)
-    io_outb(COM_RCLINE(port), 0x80);
-    io_outb(COM_RRXTX(port), BAUD_9600);
-    io_outb(COM_RIE(port), 0);
-
-    // transmission size = 7bits, no parity, 1 stop bits
-    io_outb(COM_RCLINE(port), 0x2);
+    // transmission size = 8bits, no parity, 1 stop bits
+    io_outb(COM_RCLINE(port), 0x3);
+    serial_set_baud(port, SERIAL_BAUD_DEFAULT);
 
     // rx trigger level = 14, clear rx/tx buffer, enable buffer
     io_outb(COM_RCFIFO(port), 0xcf);
@@ -72,10 +100,20 @@ serial_tx_byte(uintptr_t port, char data)
 }
 
 void
-serial_tx_buffer(uintptr_t port, char* data, size_t len)
+serial_tx_buffer(uintptr_t port, const char* data, size_t len)
 {
-    for (size_t i = 0; i < len; i++) {
-        serial_tx_byte(port, data[i]);
+    while (len) {
+        while (!(io_inb(COM_RSLINE(port)) & UART_LSR_THRE))
+            ;
+
+        // THRE is set only when the whole tx FIFO is empty, fill it up
+        size_t n = MIN(len, SERIAL_TX_FIFO_DEPTH);
+        for (size_t i = 0; i < n; i++) {
+            io_outb(COM_RRXTX(port), data[i]);
+        }
+
+        data += n;
+        len -= n;
     }
 }
 
@@ -99,4 +137,221 @@ void
 serial_enable_irq(uintptr_t port)
 {
     io_outb(COM_RIE(port), 0x1);
-}
\ No newline at end of file
+}
+
+static void
+__serial_tx_fill(struct serial_port* sport)
+{
+    u8_t chr;
+    for (int i = 0; i < SERIAL_TX_FIFO_DEPTH; i++) {
+        if (!fifo_readone_async(&sport->txbuf, &chr)) {
+            // nothing left, stop asking for THRE
+            io_outb(COM_RIE(sport->base), UART_IER_RDA | UART_IER_RLS);
+            sport->tx_active = 0;
+            return;
+        }
+        io_outb(COM_RRXTX(sport->base), chr);
+    }
+}
+
+static void
+__serial_rx_drain(struct serial_port* sport)
+{
+    int received = 0;
+    while ((io_inb(COM_RSLINE(sport->base)) & UART_LSR_DR)) {
+        u8_t chr = io_inb(COM_RRXTX(sport->base));
+        if (!fifo_putone(&sport->rxbuf, chr)) {
+            sport->rx_dropped++;
+        }
+        received = 1;
+    }
+
+    if (received) {
+        pwake_all(&sport->rx_wait);
+    }
+}
+
+static void
+__serial_irq_handler(const isr_param* param)
+{
+    struct serial_port* sport = (struct serial_port*)isrm_get_payload(param);
+    u8_t iir;
+
+    if (!sport) {
+        return;
+    }
+
+    while (!((iir = io_inb(COM_RIIR(sport->base))) & UART_IIR_NOPEND)) {
+        switch (UART_IIR_ID(iir)) {
+            case UART_IIR_RDA:
+            case UART_IIR_TIMEOUT:
+                __serial_rx_drain(sport);
+                break;
+            case UART_IIR_THRE:
+                __serial_tx_fill(sport);
+                break;
+            case UART_IIR_RLS:
+                io_inb(COM_RSLINE(sport->base));
+                break;
+            default:
+                io_inb(COM_RSMODEM(sport->base));
+                break;
+        }
+    }
+}
+
+size_t
+serial_write_async(struct serial_port* sport, const void* data, size_t len)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    size_t queued = fifo_write(&sport->txbuf, (void*)data, len);
+
+    if (queued && !sport->tx_active) {
+        // prime the tx FIFO, the irq handler takes over from the next THRE
+        sport->tx_active = 1;
+        io_outb(COM_RIE(sport->base),
+                UART_IER_RDA | UART_IER_RLS | UART_IER_THRE);
+        if ((io_inb(COM_RSLINE(sport->base)) & UART_LSR_THRE)) {
+            __serial_tx_fill(sport);
+        }
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    return queued;
+}
+
+struct serial_port*
+serial_get_port(uintptr_t port)
+{
+    if (com2 && com2->base == port) {
+        return com2;
+    }
+    return NULL;
+}
+
+static int
+__serial_read(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    struct serial_port* sport = (struct serial_port*)dev->underlay;
+    size_t count;
+
+    while (1) {
+        // close the window between an empty check and going to sleep
+        cpu_disable_interrupt();
+        if ((count = fifo_read(&sport->rxbuf, buf, len))) {
+            break;
+        }
+        pwait(&sport->rx_wait);
+    }
+    cpu_enable_interrupt();
+
+    return count;
+}
+
+static int
+__serial_read_pg(struct device* dev, void* buf, foff_t offset)
+{
+    return __serial_read(dev, buf, offset, PG_SIZE);
+}
+
+static int
+__serial_write(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    struct serial_port* sport = (struct serial_port*)dev->underlay;
+    return serial_write_async(sport, buf, len);
+}
+
+static int
+__serial_write_pg(struct device* dev, void* buf, foff_t offset)
+{
+    return __serial_write(dev, buf, offset, PG_SIZE);
+}
+
+static int
+__serial_poll(struct device* dev, struct poll_table* pt)
+{
+    struct serial_port* sport = (struct serial_port*)dev->underlay;
+
+    poll_wait(pt, &sport->rx_wait);
+
+    int mask = 0;
+    if (fifo_len(&sport->rxbuf)) {
+        mask |= POLLIN;
+    }
+    if (fifo_len(&sport->txbuf) < sport->txbuf.size) {
+        mask |= POLLOUT;
+    }
+
+    return mask;
+}
+
+static int
+__serial_exec_cmd(struct device* dev, u32_t req, va_list args)
+{
+    struct serial_port* sport = (struct serial_port*)dev->underlay;
+    u32_t baud;
+    int errno;
+
+    switch (req) {
+        case SERIOSBAUD:
+            baud = va_arg(args, u32_t);
+            cpu_disable_interrupt();
+            errno = serial_set_baud(sport->base, baud);
+            cpu_enable_interrupt();
+            if (!errno) {
+                sport->baud = baud;
+            }
+            return errno;
+        case SERIOGBAUD:
+            return sport->baud;
+        default:
+            return EINVAL;
+    }
+}
+
+static void
+__serial_sink_write(struct klog_sink* sink, const char* data, size_t len)
+{
+    serial_write_async((struct serial_port*)sink->data, data, len);
+}
+
+void
+serial_init_async()
+{
+    struct serial_port* sport = vzalloc(sizeof(*sport));
+
+    sport->base = SERIAL_COM2;
+    sport->irq = COM2_IRQ;
+    sport->baud = SERIAL_BAUD_DEFAULT;
+    fifo_init(
+      &sport->rxbuf, valloc(SERIAL_RXBUF_SIZE), SERIAL_RXBUF_SIZE, FIFO_SPSC);
+    fifo_init(
+      &sport->txbuf, valloc(SERIAL_TXBUF_SIZE), SERIAL_TXBUF_SIZE, FIFO_SPSC);
+    waitq_init(&sport->rx_wait);
+
+    struct device* dev = device_addseq(NULL, sport, "ttyS1");
+    dev->read = __serial_read;
+    dev->read_page = __serial_read_pg;
+    dev->write = __serial_write;
+    dev->write_page = __serial_write_pg;
+    dev->poll = __serial_poll;
+    dev->exec_cmd = __serial_exec_cmd;
+    sport->dev = dev;
+
+    cpu_disable_interrupt();
+    com2 = sport;
+    int iv = isrm_bindirq(sport->irq, __serial_irq_handler);
+    isrm_set_payload(iv, (ptr_t)sport);
+    io_outb(COM_RIE(sport->base), UART_IER_RDA | UART_IER_RLS);
+    cpu_enable_interrupt();
+
+    // mirror the kernel log, for headless runs
+    uart_sink.write = __serial_sink_write;
+    uart_sink.data = sport;
+    klog_add_sink(&uart_sink);
+}
@@ -1,22 +1,36 @@
 #include <lunaix/block.h>
+#include <lunaix/boottime.h>
 #include <lunaix/common.h>
+#include <lunaix/ds/hmap.h>
+#include <lunaix/ds/mutex.h>
+#include <lunaix/ds/spinlock.h>
+#include <lunaix/ds/waitq.h>
 #include <lunaix/fctrl.h>
 #include <lunaix/foptions.h>
 #include <lunaix/fs.h>
 #include <lunaix/fs/twifs.h>
+#include <lunaix/kbench.h>
+#include <lunaix/isrm.h>
+#include <lunaix/klog.h>
 #include <lunaix/lunaix.h>
 #include <lunaix/lunistd.h>
 #include <lunaix/lxconsole.h>
 #include <lunaix/mm/cake.h>
 #include <lunaix/mm/pmm.h>
+#include <lunaix/mm/swap.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/peripheral/ps2kbd.h>
 #include <lunaix/peripheral/serial.h>
+#include <lunaix/profiler.h>
+#include <lunaix/scstat.h>
 #include <lunaix/spike.h>
 #include <lunaix/syscall.h>
+#include <lunaix/sysstat.h>
 #include <lunaix/syslog.h>
+#include <lunaix/trace.h>
 #include <lunaix/types.h>
+#include <lunaix/workqueue.h>
 
 #include <sdbg/protocol.h>
 
@@ -24,14 +38,21 @@
 #include <hal/ahci/ahci.h>
 #include <hal/apic.h>
 #include <hal/ioapic.h>
+#include <hal/nvme/nvme.h>
 #include <hal/pci.h>
+#include <hal/pmc.h>
 #include <hal/rtc.h>
+#include <hal/smp.h>
+#include <hal/virtio/virtio_blk.h>
+#include <hal/virtio/virtio_net.h>
 
 #include <arch/x86/boot/multiboot.h>
+#include <arch/x86/interrupts.h>
 
 #include <klibc/string.h>
 
 #include <ulibc/stdio.h>
+#include <ulibc/stdlib.h>
 
 LOG_MODULE("PROC0")
 
@@ -54,6 +75,7 @@ __do_reserved_memory(int unlock);
 // #define DEMO_SIGNAL
 // #define DEMO_READDIR
 // #define DEMO_IOTEST
+// #define DEMO_IOBENCH
 // #define DEMO_INPUT_TEST
 #define DEMO_SIMPLE_SH
 
@@ -72,6 +94,9 @@ _readdir_main();
 extern void
 _iotest_main();
 
+extern void
+_iobench_main();
+
 extern void
 input_test();
 
@@ -112,6 +137,8 @@ __proc0_usr()
         _readdir_main();
 #elif defined DEMO_IOTEST
         _iotest_main();
+#elif defined DEMO_IOBENCH
+        _iobench_main();
 #elif defined DEMO_INPUT_TEST
         input_test();
 #elif defined DEMO_SIMPLE_SH
@@ -120,7 +147,7 @@ __proc0_usr()
         _lxinit_main();
 #endif
         printf("==== test end ====\n");
-        _exit(0);
+        exit(0);
     }
 
     waitpid(p, 0, 0);
@@ -167,6 +194,38 @@ extern uint8_t __kernel_end;              /* link/linker.ld */
 extern uint8_t __init_hhk_end;            /* link/linker.ld */
 extern multiboot_info_t* _k_init_mb_info; /* k_init.c */
 
+static struct lx_work deferred_init;
+
+/**
+ * @brief 用户空间用不到的初始化。由工作队列于 init 开始运行后完成，
+ * 不再推迟用户空间的启动。不可用到内核命令行，它此时已被回收
+ *
+ */
+static void
+__init_deferred(void* arg)
+{
+    // buffered uart, for ports not held by the debugger
+    serial_init_async();
+
+    // expose cake allocator states to vfs
+    cake_export();
+    pmm_export();
+    fork_export();
+    pfault_export();
+    swap_export();
+    mutex_export();
+    spinlock_export();
+    waitq_export();
+    sysstat_export();
+    isrm_export();
+    scstat_export();
+    trace_init();
+    pmc_export();
+    boot_phase_export();
+
+    boot_phase("deferred");
+}
+
 void
 init_platform()
 {
@@ -176,36 +235,69 @@ init_platform()
 
     // 锁定所有系统预留页（内存映射IO，ACPI之类的），并且进行1:1映射
     lock_reserved_memory();
+    boot_phase("reserved_mem");
 
     // firmware
     acpi_init(_k_init_mb_info);
+    boot_phase("acpi");
 
     // die
     apic_init();
     ioapic_init();
+    boot_phase("apic");
 
     // debugger
     serial_init();
     sdbg_init();
+    boot_phase("debugger");
 
     // timers & clock
     rtc_init();
     timer_init(SYS_TIMER_FREQUENCY_HZ);
     clock_init();
+    boot_phase("timer");
+
+    // multiprocessor
+    smp_init();
+    boot_phase("smp");
+
+    // deferred works
+    workqueue_init();
+
+    // kernel log sinks drain from the workqueue from now on
+    klog_start_async();
 
     // peripherals & chipset features
     ps2_kbd_init();
+    boot_phase("ps2kbd");
     block_init();
     ahci_init();
+    boot_phase("ahci");
+    virtio_blk_init();
+    boot_phase("virtio_blk");
+    virtio_net_init();
+    boot_phase("virtio_net");
+    nvme_init();
+    boot_phase("nvme");
 
     pci_init();
+    boot_phase("pci");
 
     // console
     console_start_flushing();
     console_flush();
 
-    // expose cake allocator states to vfs
-    cake_export();
+    // profiler 与 kbench 读取内核命令行，须于其被回收前完成
+    profiler_init();
+    hmap_bench();
+    kbench_run();
+    boot_phase("bench");
+
+    // 启动内存回收线程
+    pmm_reclaim_init();
+
+    // 启动页缓存回写线程
+    pcache_writeback_init();
 
     unlock_reserved_memory();
 
@@ -214,6 +306,10 @@ init_platform()
         vmm_del_mapping(PD_REFERENCED, (void*)i);
         pmm_free_page(KERNEL_PID, (void*)i);
     }
+    boot_phase("cleanup");
+
+    work_init(&deferred_init, __init_deferred, NULL);
+    work_submit(&deferred_init);
 }
 
 void
@@ -242,6 +338,10 @@ __do_reserved_memory(int unlock)
             // Don't fuck up our kernel code or any free area!
             continue;
         }
+        if (mmap.addr_high) {
+            // 4GiB以上的区域无法映射，截断后则会误伤低端的内存
+            continue;
+        }
         size_t pg_num = CEIL(mmap.len_low, PG_SIZE_BITS);
         size_t j = 0;
         if (!unlock) {
@@ -1,7 +1,24 @@
+#include <hal/cpu.h>
+#include <lunaix/idle.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/sched.h>
+#include <lunaix/timer.h>
+
 void
 my_dummy()
 {
+    idle_init();
+
     while (1) {
-        asm("hlt");
+        pmm_zero_refill();
+
+        // 停机期间推迟时钟中断，直至下一个定时器到期
+        cpu_disable_interrupt();
+        idle_enter(timer_idle_enter());
+
+        // 被其他中断唤醒时，补上跳过的时钟周期，并让被唤醒的进程尽快运行
+        cpu_disable_interrupt();
+        timer_idle_exit();
+        sched_yieldk();
     }
 }
@@ -0,0 +1,103 @@
+/**
+ * @file event.c
+ * @brief 事件与完成通告，见 lunaix/event.h
+ *
+ */
+#include <hal/cpu.h>
+#include <lunaix/event.h>
+
+static void
+__event_deferred(void* arg)
+{
+    struct event_listener* listener = (struct event_listener*)arg;
+    listener->func(listener->evt, listener->arg);
+}
+
+void
+event_listen(struct lx_event* evt,
+             struct event_listener* listener,
+             event_fn func,
+             void* arg,
+             struct workqueue* wq)
+{
+    listener->evt = evt;
+    listener->func = func;
+    listener->arg = arg;
+    listener->wq = wq;
+    work_init(&listener->work, __event_deferred, listener);
+
+    // 通告可能来自中断上下文
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+    llist_append(&evt->listeners, &listener->listeners);
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+void
+event_unlisten(struct event_listener* listener)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+    llist_delete(&listener->listeners);
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+static void
+__event_notify(struct lx_event* evt, int nr_exclusive)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    evt->count++;
+
+    struct event_listener *pos, *n;
+    llist_for_each(pos, n, &evt->listeners, listeners)
+    {
+        if (pos->wq) {
+            workqueue_submit(pos->wq, &pos->work);
+        } else {
+            pos->func(evt, pos->arg);
+        }
+    }
+
+    // 被唤醒者可能随即释放事件，此后不再访问 evt
+    if (nr_exclusive < 0) {
+        pwake_all(&evt->waiters);
+    } else {
+        pwake_nr(&evt->waiters, nr_exclusive, 0);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+}
+
+void
+event_signal(struct lx_event* evt)
+{
+    __event_notify(evt, -1);
+}
+
+void
+event_signal_one(struct lx_event* evt)
+{
+    __event_notify(evt, 1);
+}
+
+void
+event_wait(struct lx_event* evt)
+{
+    // 先屏蔽中断再检查，以免错过两者之间的通告
+    cpu_disable_interrupt();
+    while (!evt->count) {
+        pwait(&evt->waiters);
+        cpu_disable_interrupt();
+    }
+
+    evt->count--;
+    cpu_enable_interrupt();
+}
@@ -0,0 +1,499 @@
+/**
+ * @file exec.c
+ * @brief 载入 ELF32 可执行文件，以之替换当前进程的用户地址空间。
+ *
+ *  仅支持静态链接的 ET_EXEC（不支持解释器，即动态链接器）。各 PT_LOAD 段
+ *  注册为文件映射的区域，其页在首次访问时才由缺页处理从页缓存中取得（见
+ *  mmap_fault）：只读的代码段直接映射缓存页，为所有运行该程序的进程所共享；
+ *  可写的数据段则先共享，写入时再经由COW复制。故启动程序时，只有实际执行到的
+ *  部分才会从磁盘读入。
+ *
+ */
+#include <arch/x86/fpu.h>
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/common.h>
+#include <lunaix/elf.h>
+#include <lunaix/fs.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/mm/region.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/signal.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+
+// argv 与 envp 中字符串的总长上限（含结尾的'\0'）
+#define EXEC_ARGS_MAX (32 * 1024)
+
+// 程序头表至多占一页
+#define EXEC_PHNUM_MAX (PG_SIZE / sizeof(struct elf32_phdr))
+
+// 初始用户栈上的辅助向量：AT_PAGESZ、AT_ENTRY、AT_NULL
+#define EXEC_NR_AUXV 3
+
+extern struct lru_zone* inode_lru;
+
+void
+__del_pagetable(pid_t pid, uintptr_t mount_point); /* process.c */
+
+struct exec_args
+{
+    char* strs; // argv 与 envp 的字符串，依次紧密存放
+    u32_t len;
+    u32_t argc;
+    u32_t envc;
+};
+
+/**
+ * @brief 从用户空间复制一个字符串。逐页进行，不会越过字符串所在的最后一页
+ *
+ * @return int 复制的字节数（含'\0'），或错误码
+ */
+static int
+__exec_copy_str(char* dst, const char* src, u32_t max)
+{
+    u32_t len = 0;
+
+    while (len < max) {
+        u32_t n = MIN(max - len, PG_SIZE - PG_OFFSET(src + len));
+        if (copy_from_user(dst + len, src + len, n)) {
+            return EFAULT;
+        }
+
+        u32_t slen = strnlen(dst + len, n);
+        if (slen < n) {
+            return len + slen + 1;
+        }
+
+        len += n;
+    }
+
+    return E2BIG;
+}
+
+static int
+__exec_copy_strv(struct exec_args* args, char* const* vec, u32_t* count)
+{
+    if (!vec) {
+        return 0;
+    }
+
+    for (;; vec++) {
+        const char* str;
+        if (copy_from_user(&str, vec, sizeof(str))) {
+            return EFAULT;
+        }
+        if (!str) {
+            return 0;
+        }
+
+        int len = __exec_copy_str(
+          &args->strs[args->len], str, EXEC_ARGS_MAX - args->len);
+        if (len < 0) {
+            return len;
+        }
+
+        args->len += len;
+        (*count)++;
+    }
+}
+
+static int
+__exec_read(struct v_file* file, void* buf, u32_t len, u32_t fpos)
+{
+    struct v_inode* inode = file->inode;
+
+    if ((u64_t)fpos + len > inode->fsize) {
+        return ENOEXEC;
+    }
+
+    lock_inode(inode);
+    int errno = pcache_read(inode, buf, len, fpos, NULL);
+    unlock_inode(inode);
+
+    if (errno < 0) {
+        return errno;
+    }
+
+    return (u32_t)errno == len ? 0 : EIO;
+}
+
+static int
+__exec_check_ehdr(struct elf32_ehdr* ehdr)
+{
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+        ehdr->e_ident[EI_CLASS] != ELFCLASS32 ||
+        ehdr->e_ident[EI_DATA] != ELFDATA2LSB || ehdr->e_type != ET_EXEC ||
+        ehdr->e_machine != EM_386) {
+        return ENOEXEC;
+    }
+
+    if (ehdr->e_phentsize != sizeof(struct elf32_phdr) || !ehdr->e_phnum ||
+        ehdr->e_phnum > EXEC_PHNUM_MAX) {
+        return ENOEXEC;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 检查各程序头。载入的段须按地址升序排列，所占的页互不重叠，
+ * 且位于 [USER_START, UHEAP_START) 之内，以免与堆、mmap 及栈的区域相冲突
+ *
+ */
+static int
+__exec_check_phdrs(struct v_file* file, struct elf32_phdr* phdrs, u32_t phnum)
+{
+    uintptr_t prev_end = USER_START;
+
+    for (u32_t i = 0; i < phnum; i++) {
+        struct elf32_phdr* ph = &phdrs[i];
+
+        if (ph->p_type == PT_INTERP || ph->p_type == PT_DYNAMIC) {
+            return ENOEXEC;
+        }
+        if (ph->p_type != PT_LOAD || !ph->p_memsz) {
+            continue;
+        }
+
+        if (PG_OFFSET(ph->p_vaddr) != PG_OFFSET(ph->p_offset) ||
+            ph->p_filesz > ph->p_memsz ||
+            (u64_t)ph->p_offset + ph->p_filesz > file->inode->fsize) {
+            return ENOEXEC;
+        }
+
+        uintptr_t start = PG_ALIGN(ph->p_vaddr);
+        u64_t end = ROUNDUP((u64_t)ph->p_vaddr + ph->p_memsz, PG_SIZE);
+
+        if (start < prev_end || end > UHEAP_START) {
+            return ENOEXEC;
+        }
+
+        prev_end = end;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 为当前进程换上一个新的页目录，仅含内核空间与内核栈，并释放旧的用户空间。
+ *
+ * 内核栈所在的页表与旧页目录共享，随后旧页目录的释放仅归还其引用。由 vfork 借来的，
+ * 或 fork 后仍与其他进程共享的页表也仅归还引用，故二者无需另作处理。
+ *
+ */
+static void
+__exec_new_vmspace()
+{
+    pid_t pid = __current->pid;
+
+    // 异步I/O的完成记录与环均指向旧的用户空间，须先于其释放而撤销
+    proc_release_aio((struct proc_info*)__current);
+    proc_release_ioring((struct proc_info*)__current);
+
+    void* ptd_pp = pmm_alloc_page(pid, PP_FGPERSIST);
+    x86_page_table* ptd = vmm_kmap_atomic((uintptr_t)ptd_pp);
+    x86_page_table* pptd = (x86_page_table*)L1_BASE_VADDR;
+
+    size_t kstack_l1inx = L1_INDEX(KSTACK_START);
+    size_t kspace_l1inx = L1_INDEX(KERNEL_MM_BASE);
+
+    for (size_t i = 0; i < PG_MAX_ENTRIES - 1; i++) {
+        x86_pte_t ptde = pptd->entry[i];
+        if (i == kstack_l1inx) {
+            pmm_ref_page(pid, PG_ENTRY_ADDR(ptde));
+        } else if (i < kspace_l1inx) {
+            ptde = 0;
+        }
+        ptd->entry[i] = ptde;
+    }
+
+    ptd->entry[PG_MAX_ENTRIES - 1] = NEW_L1_ENTRY(T_SELF_REF_PERM, ptd_pp);
+    vmm_kunmap_atomic(ptd);
+
+    void* old_pd = __current->page_table;
+    __current->page_table = ptd_pp;
+    cpu_lcr3((reg32)ptd_pp);
+
+    region_release_all(&__current->mm.regions);
+    __current->mm.last_fault = 0;
+
+    vmm_mount_pd(PD_MOUNT_1, old_pd);
+    __del_pagetable(pid, PD_MOUNT_1);
+    vmm_unmount_pd(PD_MOUNT_1);
+}
+
+static void
+__exec_reserve(uintptr_t start, uintptr_t end, pt_attr attr)
+{
+    for (uintptr_t va = start; va < end; va += PG_SIZE) {
+        vmm_set_mapping(PD_REFERENCED, va, 0, attr, VMAP_NULL);
+    }
+}
+
+/**
+ * @brief 为一个 PT_LOAD 段注册区域。文件中的部分映射至文件，其后的部分（.bss）
+ * 为匿名区域。二者共用的那一页中，文件以外的部分须清零
+ *
+ */
+static int
+__exec_map_segment(struct v_file* file, struct elf32_phdr* ph)
+{
+    struct mm_regions* regions = &__current->mm.regions;
+    int attr = REGION_RSHARED;
+
+    if ((ph->p_flags & PF_R)) {
+        attr |= REGION_READ;
+    }
+    if ((ph->p_flags & PF_W)) {
+        attr |= REGION_WRITE;
+    }
+    if ((ph->p_flags & PF_X)) {
+        attr |= REGION_EXEC;
+    }
+
+    pt_attr pattr = PG_ALLOW_USER | ((ph->p_flags & PF_W) ? PG_WRITE : 0);
+    uintptr_t start = PG_ALIGN(ph->p_vaddr);
+    uintptr_t fend = ph->p_vaddr + ph->p_filesz;
+    uintptr_t mend = ROUNDUP(ph->p_vaddr + ph->p_memsz, PG_SIZE);
+    uintptr_t fend_pg = ROUNDUP(fend, PG_SIZE);
+
+    if (ph->p_filesz) {
+        struct mm_region* region = region_add(regions, start, fend_pg, attr);
+        atomic_fetch_add(&file->ref_count, 1);
+        region->mfile = file;
+        region->offset = PG_ALIGN(ph->p_offset);
+        __exec_reserve(start, fend_pg, pattr);
+        start = fend_pg;
+    }
+
+    if (start < mend) {
+        region_add(regions, start, mend, attr);
+        __exec_reserve(start, mend, pattr);
+    }
+
+    // 页缓存中，文件末尾之后的内容未必为零。只读的段不会将其当作 .bss 使用
+    if (ph->p_memsz == ph->p_filesz || !PG_OFFSET(fend) ||
+        !(attr & REGION_WRITE)) {
+        return 0;
+    }
+
+    u32_t len = MIN(fend_pg, ph->p_vaddr + ph->p_memsz) - fend;
+    void* zeros = vzalloc(len);
+    if (!zeros) {
+        return ENOMEM;
+    }
+
+    size_t failed = copy_to_user((void*)fend, zeros, len);
+    vfree(zeros);
+
+    return failed ? ENOMEM : 0;
+}
+
+/**
+ * @brief 按照 i386 System V ABI 在用户栈顶布置 argc、argv、envp 与辅助向量，
+ * 字符串本身位于其上方
+ *
+ * @return uintptr_t 程序入口处的栈指针，0表示失败
+ */
+static uintptr_t
+__exec_setup_stack(struct exec_args* args, uintptr_t entry)
+{
+    u32_t nr_words =
+      1 + (args->argc + 1) + (args->envc + 1) + 2 * EXEC_NR_AUXV;
+
+    uintptr_t top = USTACK_TOP & ~0xf;
+    uintptr_t strs = (top - args->len) & ~0x3;
+    uintptr_t sp = (strs - nr_words * sizeof(u32_t)) & ~0xf;
+    u32_t size = top - sp;
+
+    u32_t* image = valloc(size);
+    if (!image) {
+        return 0;
+    }
+
+    u32_t* word = image;
+    char* str = args->strs;
+
+    *word++ = args->argc;
+    for (u32_t i = 0; i < args->argc; i++) {
+        *word++ = strs + (str - args->strs);
+        str += strlen(str) + 1;
+    }
+    *word++ = 0;
+
+    for (u32_t i = 0; i < args->envc; i++) {
+        *word++ = strs + (str - args->strs);
+        str += strlen(str) + 1;
+    }
+    *word++ = 0;
+
+    *word++ = AT_PAGESZ;
+    *word++ = PG_SIZE;
+    *word++ = AT_ENTRY;
+    *word++ = entry;
+    *word++ = AT_NULL;
+    *word++ = 0;
+
+    memcpy((u8_t*)image + (strs - sp), args->strs, args->len);
+
+    size_t failed = copy_to_user((void*)sp, image, size);
+    vfree(image);
+
+    return failed ? 0 : sp;
+}
+
+/**
+ * @brief 经由调度器进入新程序。借用信号返回时的路径：soft_iret 按照 intr_ctx
+ * 恢复寄存器，并以 registers.esp 处的中断帧执行 iret
+ *
+ */
+static void
+__exec_enter_user(uintptr_t entry, uintptr_t sp)
+{
+    cpu_disable_interrupt();
+
+    // 内核栈上原有的内容不再需要，帧置于栈顶。布局同 isr_param 的 vector 往后部分
+    u32_t* frame = (u32_t*)(KSTACK_TOP & ~0xf) - 7;
+    frame[0] = 0;          // vector
+    frame[1] = 0;          // err_code
+    frame[2] = entry;      // eip
+    frame[3] = UCODE_SEG;  // cs
+    frame[4] = 0x202;      // eflags，开中断
+    frame[5] = sp;         // esp
+    frame[6] = UDATA_SEG;  // ss
+
+    isr_param* ctx = &__current->intr_ctx;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->registers.ds = UDATA_SEG;
+    ctx->registers.es = UDATA_SEG;
+    ctx->registers.fs = UDATA_SEG;
+    ctx->registers.gs = UDATA_SEG;
+    ctx->registers.esp = (reg32)frame;
+    ctx->eip = entry;
+    ctx->cs = UCODE_SEG;
+    ctx->eflags = 0x202;
+    ctx->esp = sp;
+    ctx->ss = UDATA_SEG;
+
+    __current->ustack_top = sp;
+
+    schedule();
+}
+
+__DEFINE_LXSYSCALL3(int,
+                    execve,
+                    const char*,
+                    path,
+                    char* const*,
+                    argv,
+                    char* const*,
+                    envp)
+{
+    int errno = 0;
+    struct v_dnode* dnode;
+    struct v_file* file = NULL;
+    struct elf32_ehdr ehdr;
+    struct elf32_phdr* phdrs = NULL;
+    struct exec_args args = { .strs = valloc(EXEC_ARGS_MAX) };
+
+    if (!args.strs) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    // 参数位于即将被释放的用户空间中，须先行复制
+    if ((errno = __exec_copy_strv(&args, argv, &args.argc)) ||
+        (errno = __exec_copy_strv(&args, envp, &args.envc))) {
+        goto done;
+    }
+
+    if ((errno = vfs_walk_proc(path, &dnode, NULL, 0))) {
+        goto done;
+    }
+
+    if (!dnode->inode || !(dnode->inode->itype & VFS_IFFILE)) {
+        errno = ENOEXEC;
+        goto done;
+    }
+
+    if ((errno = vfs_open(dnode, &file))) {
+        file = NULL;
+        goto done;
+    }
+
+    if ((errno = __exec_read(file, &ehdr, sizeof(ehdr), 0)) ||
+        (errno = __exec_check_ehdr(&ehdr))) {
+        goto done;
+    }
+
+    u32_t phsize = ehdr.e_phnum * sizeof(struct elf32_phdr);
+    if (!(phdrs = valloc(phsize))) {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    if ((errno = __exec_read(file, phdrs, phsize, ehdr.e_phoff)) ||
+        (errno = __exec_check_phdrs(file, phdrs, ehdr.e_phnum))) {
+        goto done;
+    }
+
+    // 此后旧的地址空间已不复存在，任何错误都只能终止进程
+
+    __exec_new_vmspace();
+
+    for (u32_t i = 0; i < ehdr.e_phnum; i++) {
+        if (phdrs[i].p_type != PT_LOAD || !phdrs[i].p_memsz) {
+            continue;
+        }
+        if ((errno = __exec_map_segment(file, &phdrs[i]))) {
+            goto fatal;
+        }
+    }
+
+    init_proc_user_space(__current);
+
+    uintptr_t sp = __exec_setup_stack(&args, ehdr.e_entry);
+    if (!sp) {
+        goto fatal;
+    }
+
+    vfree(phdrs);
+    vfree(args.strs);
+    vfs_close(file);
+
+    memset(__current->sig_handler, 0, sizeof(__current->sig_handler));
+    fpu_reset(__current);
+
+    // 借用父进程地址空间的 vfork 子进程至此已有自己的地址空间
+    if ((__current->flags & PROC_FVFORK)) {
+        __current->flags &= ~PROC_FVFORK;
+        pwake_all(&__current->vfork_wait);
+    }
+
+    __exec_enter_user(ehdr.e_entry, sp);
+
+fatal:
+    vfree(phdrs);
+    vfree(args.strs);
+    vfs_close(file);
+    terminate_proc(_SIGKILL);
+    schedule();
+
+done:
+    if (phdrs) {
+        vfree(phdrs);
+    }
+    if (args.strs) {
+        vfree(args.strs);
+    }
+    if (file) {
+        vfs_close(file);
+    }
+    return DO_STATUS(errno);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file idle.c
+ * @brief 空闲处理器的等待方式
+ *
+ *  支持 MONITOR/MWAIT 时，空闲处理器监视其就绪队列的计数并以 MWAIT 等待：
+ *  除中断外，其他处理器向该队列加入进程时的写入即可将其唤醒，无须IPI。
+ *  同时，MWAIT 可进入比 HLT（C1）更深的C-state。
+ *
+ *  各C-state的目标驻留时间本应取自ACPI的 _CST，但内核尚无AML解释器，
+ *  故仅依 CPUID 5号叶列举的C-state，配以保守的经验值。
+ *  预计的空闲时长不足其目标驻留时间的C-state不会被选用，以免唤醒延迟
+ *  与进出的开销得不偿失。
+ */
+#include <hal/cpu.h>
+#include <lunaix/idle.h>
+#include <lunaix/sched.h>
+#include <lunaix/syslog.h>
+
+LOG_MODULE("IDLE")
+
+// MWAIT 的 C1 至 C7
+#define IDLE_NR_CSTATES 7
+
+// 各C-state的目标驻留时间（微秒）
+static const u32_t idle_residency_us[IDLE_NR_CSTATES] = {
+    2, 20, 300, 800, 1200, 2000, 3000
+};
+
+// 可用的C-state（位图，第 n 位对应 C(n+1)）
+static u32_t idle_cstates;
+
+// 是否使用 MWAIT
+static int idle_mwait;
+
+extern struct scheduler sched_ctx;
+
+void
+idle_init()
+{
+    if (!cpu_has_mwait()) {
+        kprintf(KINFO "hlt\n");
+        return;
+    }
+
+    u32_t substates = cpu_mwait_substates();
+
+    // 未列举时，只可假定 C1 可用
+    idle_cstates = 1;
+    for (int n = 1; n < IDLE_NR_CSTATES; n++) {
+        if (((substates >> ((n + 1) * 4)) & 0xf)) {
+            idle_cstates |= 1 << n;
+        }
+    }
+
+    idle_mwait = 1;
+    kprintf(KINFO "mwait, c-states: 0x%x\n", idle_cstates);
+}
+
+static u32_t
+__idle_select(ticks_t ticks)
+{
+    // 时长未知（如时钟中断已在等待处理）时，只进入最浅的C-state
+    if (!ticks) {
+        return 0;
+    }
+
+    u64_t us = timer_ticks_to_ns(ticks) / 1000;
+    int n = IDLE_NR_CSTATES - 1;
+
+    for (; n > 0; n--) {
+        if ((idle_cstates & (1 << n)) && idle_residency_us[n] <= us) {
+            break;
+        }
+    }
+
+    // 提示的 7:4 位为目标C-state减一，3:0 位为子状态
+    return n << 4;
+}
+
+void
+idle_enter(ticks_t ticks)
+{
+    if (!idle_mwait) {
+        asm volatile("sti\n"
+                     "hlt");
+        return;
+    }
+
+    volatile u32_t* nr_ready = &sched_ctx.nr_ready;
+
+    // 先设置监视，再检查，以免错过两者之间的写入
+    cpu_monitor(nr_ready);
+    if (*nr_ready) {
+        cpu_enable_interrupt();
+        return;
+    }
+
+    cpu_sti_mwait(__idle_select(ticks));
+}
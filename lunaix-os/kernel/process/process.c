@@ -1,8 +1,13 @@
+#include <arch/x86/fpu.h>
+#include <hal/cpu.h>
 #include <klibc/string.h>
 #include <lunaix/clock.h>
 #include <lunaix/common.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/dmm.h>
 #include <lunaix/mm/pmm.h>
 #include <lunaix/mm/region.h>
+#include <lunaix/mm/swap.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/process.h>
@@ -13,13 +18,110 @@
 
 LOG_MODULE("PROC")
 
+extern struct scheduler sched_ctx; /* kernel/sched.c */
+
+// fork耗时统计（以TSC周期计）
+static struct
+{
+    u32_t count;
+    u32_t last;
+    u32_t max;
+    u32_t total_k; // 以1024周期为单位，避免64位除法
+} fork_stat;
+
+/**
+ * @brief 判断一个页目录项所覆盖的区间能否在fork后共享其L2页表
+ *
+ * 内核栈每个进程各有一份，私有区域需在子进程中移除，二者都需要立即复制页表。
+ *
+ */
+static int
+__pt_shareable(struct mm_regions* regions, size_t l1inx)
+{
+    uintptr_t start = l1inx << 22, end = start + MEM_4MB - 1;
+
+    if (start <= KSTACK_TOP && KSTACK_START <= end) {
+        return 0;
+    }
+
+    struct mm_region *pos, *n;
+    llist_for_each(pos, n, &regions->head, head)
+    {
+        if ((pos->attr & REGION_MODE_MASK) != REGION_PRIVATE) {
+            continue;
+        }
+        if (pos->start <= end && start < pos->end) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+#define DUP_VFORK 0x1
+
+/**
+ * @brief 依照所属区域的共享模式，为一张L2页表的表项施加写保护
+ *
+ * @param ppt 父进程的L2页表
+ * @param pt 子进程的L2页表（共享时与 ppt 相同）
+ */
+static void
+__protect_pt(pid_t pid,
+             struct mm_regions* regions,
+             x86_page_table* ppt,
+             x86_page_table* pt,
+             uintptr_t base)
+{
+    struct mm_region* region = NULL;
+
+    for (size_t j = 0; j < PG_MAX_ENTRIES; j++) {
+        x86_pte_t pte = ppt->entry[j];
+        if (!pte) {
+            continue;
+        }
+
+        if (!(region = region_get(regions, base + (j << 12)))) {
+            continue;
+        }
+
+        int mode = region->attr & REGION_MODE_MASK;
+        if (mode == REGION_RSHARED) {
+            // 如果读共享，则将两者的都标注为只读，那么任何写入都将会应用COW策略。
+            if ((pte & PG_PRESENT)) {
+                ppt->entry[j] = pte & ~PG_WRITE;
+                pt->entry[j] = pte & ~PG_WRITE;
+            }
+        } else if (mode == REGION_PRIVATE) {
+            // 如果是私有页，则将该页从新进程中移除。
+            if ((pte & PG_PRESENT)) {
+                pmm_free_page(pid, PG_ENTRY_ADDR(pte));
+            } else {
+                swap_entry_free(pte);
+            }
+            pt->entry[j] = 0;
+        }
+    }
+}
+
+/**
+ * @brief 复制用户地址空间的页表
+ *
+ * 若给出了 regions ，则同时依照各区域的共享模式配置父子进程的页表项。
+ * 该过程中不作逐页的TLB刷新，而是在结束时统一刷新一次。
+ *
+ * 若指定了 DUP_VFORK ，则除内核栈所在的页表外，所有用户页表均由双方直接共享（可写），
+ * 即父子进程共用同一个用户地址空间。
+ *
+ */
 void*
-__dup_pagetable(pid_t pid, uintptr_t mount_point)
+__dup_pagetable(pid_t pid,
+                uintptr_t mount_point,
+                struct mm_regions* regions,
+                int options)
 {
     void* ptd_pp = pmm_alloc_page(pid, PP_FGPERSIST);
-    vmm_set_mapping(PD_REFERENCED, PG_MOUNT_1, ptd_pp, PG_PREM_RW, VMAP_NULL);
-
-    x86_page_table* ptd = PG_MOUNT_1;
+    x86_page_table* ptd = vmm_kmap_atomic((uintptr_t)ptd_pp);
     x86_page_table* pptd = (x86_page_table*)(mount_point | (0x3FF << 12));
 
     size_t kspace_l1inx = L1_INDEX(KERNEL_MM_BASE);
@@ -34,24 +136,59 @@ __dup_pagetable(pid_t pid, uintptr_t mount_point)
             continue;
         }
 
+        x86_page_table* ppt = (x86_page_table*)(mount_point | (i << 12));
+
+        if ((options & DUP_VFORK) && i != L1_INDEX(KSTACK_START)) {
+            ptd->entry[i] = ptde;
+            pmm_ref_page(pid, PG_ENTRY_ADDR(ptde));
+            continue;
+        }
+
+        // 在任意一方写入前，L2页表由双方共享，并通过只读的页目录项来感知首次写入。
+        if (regions && !(options & DUP_VFORK) && __pt_shareable(regions, i)) {
+            ptde &= ~PG_WRITE;
+            pptd->entry[i] = ptde;
+            ptd->entry[i] = ptde;
+            pmm_ref_page(pid, PG_ENTRY_ADDR(ptde));
+            __protect_pt(pid, regions, ppt, ppt, i << 22);
+            continue;
+        }
+
         // 复制L2页表
         void* pt_pp = pmm_alloc_page(pid, PP_FGPERSIST);
-        vmm_set_mapping(
-          PD_REFERENCED, PG_MOUNT_2, pt_pp, PG_PREM_RW, VMAP_NULL);
-
-        x86_page_table* ppt = (x86_page_table*)(mount_point | (i << 12));
-        x86_page_table* pt = PG_MOUNT_2;
+        x86_page_table* pt = vmm_kmap_atomic((uintptr_t)pt_pp);
 
         for (size_t j = 0; j < PG_MAX_ENTRIES; j++) {
             x86_pte_t pte = ppt->entry[j];
-            pmm_ref_page(pid, PG_ENTRY_ADDR(pte));
+            if ((pte & PG_PRESENT)) {
+                pmm_ref_page(pid, PG_ENTRY_ADDR(pte));
+            } else {
+                swap_entry_dup(pte);
+            }
             pt->entry[j] = pte;
         }
 
-        ptd->entry[i] = (uintptr_t)pt_pp | PG_ENTRY_FLAGS(ptde);
+        if (regions && !(options & DUP_VFORK)) {
+            __protect_pt(pid, regions, ppt, pt, i << 22);
+        }
+
+        vmm_kunmap_atomic(pt);
+
+        ptd->entry[i] = (uintptr_t)pt_pp | PG_ENTRY_FLAGS(ptde) | PG_WRITE;
+
+        // 每复制一张L2页表便检查一次抢占。持有页目录的映射时抢占是被禁止的，
+        //  须先行解除，否则 preempt_needed 总为假
+        vmm_kunmap_atomic(ptd);
+        preempt_point();
+        ptd = vmm_kmap_atomic((uintptr_t)ptd_pp);
     }
 
     ptd->entry[PG_MAX_ENTRIES - 1] = NEW_L1_ENTRY(T_SELF_REF_PERM, ptd_pp);
+    vmm_kunmap_atomic(ptd);
+
+    if (mount_point == PD_REFERENCED) {
+        cpu_invtlb();
+    }
 
     return ptd_pp;
 }
@@ -70,11 +207,19 @@ __del_pagetable(pid_t pid, uintptr_t mount_point)
 
         x86_page_table* ppt = (x86_page_table*)(mount_point | (i << 12));
 
+        // 页表仍被其他进程共享（fork后未写入，或vfork），数据页的引用由页表整体持有
+        if (pmm_query(PG_ENTRY_ADDR(ptde))->ref_counts > 1) {
+            pmm_free_page(pid, PG_ENTRY_ADDR(ptde));
+            continue;
+        }
+
         for (size_t j = 0; j < PG_MAX_ENTRIES; j++) {
             x86_pte_t pte = ppt->entry[j];
             // free the 4KB data page
             if ((pte & PG_PRESENT)) {
                 pmm_free_page(pid, PG_ENTRY_ADDR(pte));
+            } else {
+                swap_entry_free(pte);
             }
         }
         // free the L2 page table
@@ -87,7 +232,7 @@ __del_pagetable(pid_t pid, uintptr_t mount_point)
 void*
 vmm_dup_vmspace(pid_t pid)
 {
-    return __dup_pagetable(pid, PD_REFERENCED);
+    return __dup_pagetable(pid, PD_REFERENCED, NULL, 0);
 }
 
 __DEFINE_LXSYSCALL(pid_t, fork)
@@ -95,6 +240,11 @@ __DEFINE_LXSYSCALL(pid_t, fork)
     return dup_proc();
 }
 
+__DEFINE_LXSYSCALL(pid_t, vfork)
+{
+    return vfork_proc();
+}
+
 __DEFINE_LXSYSCALL(pid_t, getpid)
 {
     return __current->pid;
@@ -151,52 +301,49 @@ init_proc_user_space(struct proc_info* pcb)
         vmm_set_mapping(PD_MOUNT_1, i, 0, PG_ALLOW_USER | PG_WRITE, VMAP_NULL);
     }
 
-    // TODO other uspace initialization stuff
+    /*---  用户堆  ---*/
 
-    vmm_unmount_pd(PD_MOUNT_1);
-}
+    // 堆区域一次注册至上界，页表项由 brk 随堆的扩展而预留。首页总是预留，
+    //  用户态的分配器可无需系统调用便访问位于此处的状态
+    region_add(
+      &pcb->mm.regions, UHEAP_START, UHEAP_END, REGION_RW | REGION_RSHARED);
+    vmm_set_mapping(
+      PD_MOUNT_1, UHEAP_START, 0, PG_ALLOW_USER | PG_WRITE, VMAP_NULL);
 
-void
-__mark_region(uintptr_t start_vpn, uintptr_t end_vpn, int attr)
-{
-    for (size_t i = start_vpn; i <= end_vpn; i++) {
-        x86_pte_t* curproc = &PTE_MOUNTED(PD_REFERENCED, i);
-        x86_pte_t* newproc = &PTE_MOUNTED(PD_MOUNT_1, i);
-        cpu_invplg(newproc);
+    pcb->mm.u_heap.start = (void*)UHEAP_START;
+    pcb->mm.u_heap.max_addr = (void*)UHEAP_END;
+    dmm_init(&pcb->mm.u_heap);
 
-        if ((attr & REGION_MODE_MASK) == REGION_RSHARED) {
-            // 如果读共享，则将两者的都标注为只读，那么任何写入都将会应用COW策略。
-            cpu_invplg(curproc);
-            cpu_invplg(i << 12);
-            *curproc = *curproc & ~PG_WRITE;
-            *newproc = *newproc & ~PG_WRITE;
-        } else {
-            // 如果是私有页，则将该页从新进程中移除。
-            *newproc = 0;
-        }
-    }
+    // TODO other uspace initialization stuff
+
+    vmm_unmount_pd(PD_MOUNT_1);
 }
 
 void
 __copy_fdtable(struct proc_info* pcb)
 {
-    for (size_t i = 0; i < VFS_MAX_FD; i++) {
-        struct v_fd* fd = __current->fdtable->fds[i];
-        if (!fd)
-            continue;
-        vfs_dup_fd(fd, &pcb->fdtable->fds[i]);
-    }
+    vfs_fdtable_copy(pcb->fdtable, __current->fdtable);
 }
 
-pid_t
-dup_proc()
+static int
+__setup_proc_mem(struct proc_info* proc, uintptr_t usedMnt, int options);
+
+static struct proc_info*
+__dup_proc(int options)
 {
+    u64_t t0 = cpu_rdtsc();
+
+    // 内核页目录项即将被复制，此后的 vmap 不再使用大页
+    vmm_vmap_seal();
+
     struct proc_info* pcb = alloc_process();
     pcb->mm.u_heap = __current->mm.u_heap;
     pcb->intr_ctx = __current->intr_ctx;
     pcb->parent = __current;
+    pcb->nice = __current->nice;
 
-    memcpy(pcb->fxstate, __current->fxstate, 512);
+    fpu_save(__current);
+    memcpy(pcb->fxstate, __current->fxstate, fpu_state_size);
 
     if (__current->cwd) {
         pcb->cwd = __current->cwd;
@@ -206,45 +353,201 @@ dup_proc()
     __copy_fdtable(pcb);
     region_copy(&__current->mm.regions, &pcb->mm.regions);
 
-    setup_proc_mem(pcb, PD_REFERENCED);
+    // 页表将依照 mm_region 一并配置
+    int errno = __setup_proc_mem(pcb, PD_REFERENCED, options);
 
-    // 根据 mm_region 进一步配置页表
-
-    struct mm_region *pos, *n;
-    llist_for_each(pos, n, &pcb->mm.regions.head, head)
-    {
-        // 如果写共享，则不作处理。
-        if ((pos->attr & REGION_WSHARED)) {
-            continue;
-        }
+    vmm_unmount_pd(PD_MOUNT_1);
 
-        uintptr_t start_vpn = pos->start >> 12;
-        uintptr_t end_vpn = pos->end >> 12;
-        __mark_region(start_vpn, end_vpn, pos->attr);
+    if (errno) {
+        // 尚未提交，撤销即可归还已复制的页表、内核栈与文件描述符
+        destroy_process(pcb->pid);
+        __current->k_status = errno;
+        return NULL;
     }
 
-    vmm_unmount_pd(PD_MOUNT_1);
-
     // 正如同fork，返回两次。
     pcb->intr_ctx.registers.eax = 0;
 
+    u32_t elapsed = (u32_t)(cpu_rdtsc() - t0);
+    fork_stat.count++;
+    fork_stat.last = elapsed;
+    fork_stat.max = MAX(fork_stat.max, elapsed);
+    fork_stat.total_k += elapsed >> 10;
+
+    return pcb;
+}
+
+pid_t
+dup_proc()
+{
+    struct proc_info* pcb = __dup_proc(0);
+    if (!pcb) {
+        return -1;
+    }
+
     commit_process(pcb);
 
     return pcb->pid;
 }
 
-extern void __kernel_end;
+pid_t
+vfork_proc()
+{
+    struct proc_info* pcb = __dup_proc(DUP_VFORK);
+    if (!pcb) {
+        return -1;
+    }
+
+    pcb->flags |= PROC_FVFORK;
+
+    // 关中断，以免子进程在我们进入等待前便已退出
+    cpu_disable_interrupt();
+
+    commit_process(pcb);
+
+    // 子进程借用了我们的地址空间，在其退出前父进程须保持挂起
+    while ((pcb->flags & PROC_FVFORK)) {
+        pwait(&pcb->vfork_wait);
+        cpu_disable_interrupt();
+    }
+
+    cpu_enable_interrupt();
+
+    return pcb->pid;
+}
+
+#define KTHREAD_STACK_SIZE 4096
+
+/**
+ * @brief 创建一个仅含内核地址空间的页目录
+ *
+ */
+static void*
+__kthread_pagetable()
+{
+    void* ptd_pp = pmm_alloc_page(KERNEL_PID, PP_FGPERSIST);
+    if (!ptd_pp) {
+        return NULL;
+    }
+
+    x86_page_table* ptd = vmm_kmap_atomic((uintptr_t)ptd_pp);
+    x86_page_table* pptd = (x86_page_table*)L1_BASE_VADDR;
+
+    size_t kspace_l1inx = L1_INDEX(KERNEL_MM_BASE);
+
+    for (size_t i = 0; i < PG_MAX_ENTRIES - 1; i++) {
+        ptd->entry[i] = i < kspace_l1inx ? PTE_NULL : pptd->entry[i];
+    }
+
+    ptd->entry[PG_MAX_ENTRIES - 1] = NEW_L1_ENTRY(T_SELF_REF_PERM, ptd_pp);
+    vmm_kunmap_atomic(ptd);
+
+    return ptd_pp;
+}
+
+struct proc_info*
+spawn_kthread(void (*entry)(void*), void* arg)
+{
+    // 栈取自内核堆，因而在任何地址空间中均有效
+    u32_t* stack = vzalloc(KTHREAD_STACK_SIZE);
+    if (!stack) {
+        return NULL;
+    }
+
+    // 不借用当前进程的页表，以免其退出或执行exec后波及内核线程
+    void* ptd = __kthread_pagetable();
+    if (!ptd) {
+        vfree(stack);
+        return NULL;
+    }
+
+    u32_t* stack_top = stack + KTHREAD_STACK_SIZE / sizeof(u32_t);
+
+    struct proc_info* pcb = alloc_process();
+    pcb->intr_ctx = (isr_param){
+        .registers = { .ds = KDATA_SEG,
+                       .es = KDATA_SEG,
+                       .fs = KDATA_SEG,
+                       .gs = KDATA_SEG,
+                       .esp = (void*)(stack_top - 7) },
+        .cs = KCODE_SEG,
+        .eip = (void*)entry,
+        .ss = KDATA_SEG,
+        .eflags = cpu_reflags() | 0x0200
+    };
+
+    // 与空闲进程一样，手工构造 soft_iret 所需的返回帧。
+    //  返回后栈顶即为入口函数的调用帧：返回地址（入口函数从不返回）与参数
+    stack_top[-1] = (u32_t)arg;
+    stack_top[-2] = 0;
+    stack_top[-3] = pcb->intr_ctx.eflags;
+    stack_top[-4] = KCODE_SEG;
+    stack_top[-5] = (u32_t)entry;
+
+    // 内核线程从不进入用户态，也就无需保存x87状态
+    vfree_dma(pcb->fxstate);
+    pcb->fxstate = NULL;
+
+    pcb->page_table = ptd;
+    pcb->parent = get_process(0);
+    pcb->flags |= PROC_FKTHREAD;
+
+    commit_process(pcb);
+
+    return pcb;
+}
+
+void
+__fork_rd_stat(struct twimap* map)
+{
+    twimap_printf(map,
+                  "%u %u %u %u\n",
+                  fork_stat.count,
+                  fork_stat.last,
+                  fork_stat.max,
+                  fork_stat.count ? (fork_stat.total_k / fork_stat.count) : 0);
+}
 
 void
+fork_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "forkstat");
+    map->read = __fork_rd_stat;
+}
+
+extern void __kernel_end;
+
+int
 setup_proc_mem(struct proc_info* proc, uintptr_t usedMnt)
+{
+    return __setup_proc_mem(proc, usedMnt, 0);
+}
+
+static int
+__setup_proc_mem(struct proc_info* proc, uintptr_t usedMnt, int options)
 {
     // copy the entire kernel page table
     pid_t pid = proc->pid;
-    void* pt_copy = __dup_pagetable(pid, usedMnt);
+    void* pt_copy =
+      __dup_pagetable(pid, usedMnt, &proc->mm.regions, options);
 
     vmm_mount_pd(PD_MOUNT_1, pt_copy); // 将新进程的页表挂载到挂载点#2
+    proc->page_table = pt_copy;
 
     // copy the kernel stack
+    //  只有当前栈指针所在的页往上仍在使用，仅复制这部分。内核栈上的缺页无法
+    //  按需处理（异常帧本身就要压入缺失的那一页），故其下映射至
+    //  KSTACK_MAPPED_START 为止，余下的不予映射
+    uintptr_t esp;
+    asm("movl %%esp, %0" : "=r"(esp));
+
+    size_t live = KSTACK_START >> 12;
+    if (KSTACK_START <= esp && esp <= KSTACK_TOP) {
+        live = esp >> 12;
+    }
+
+    size_t first = MIN(live, KSTACK_MAPPED_START >> 12);
+
     for (size_t i = KSTACK_START >> 12; i <= KSTACK_TOP >> 12; i++) {
         volatile x86_pte_t* ppte = &PTE_MOUNTED(PD_MOUNT_1, i);
 
@@ -259,8 +562,27 @@ setup_proc_mem(struct proc_info* proc, uintptr_t usedMnt)
         cpu_invplg(ppte);
 
         x86_pte_t p = *ppte;
-        void* ppa = vmm_dup_page(pid, PG_ENTRY_ADDR(p));
+        if (!(p & PG_PRESENT)) {
+            // 父进程本身也是fork而来，这部分从未映射
+            continue;
+        }
+
+        // 页表复制时已为子进程增加了引用，替换或移除前须先归还
         pmm_free_page(pid, PG_ENTRY_ADDR(p));
+
+        if (i < first) {
+            *ppte = 0;
+            continue;
+        }
+
+        void* ppa = i >= live ? vmm_dup_page(pid, PG_ENTRY_ADDR(p))
+                              : pmm_alloc_page(pid, 0);
+        if (!ppa) {
+            // 其余各页仍共享父进程的页并持有引用，连同已复制的页，
+            //  由撤销进程时的 __del_pagetable 一并归还
+            *ppte = 0;
+            return ENOMEM;
+        }
         *ppte = (p & 0xfff) | (uintptr_t)ppa;
     }
 
@@ -268,5 +590,5 @@ setup_proc_mem(struct proc_info* proc, uintptr_t usedMnt)
     // 都会导致eip落在区域外面，从而segmentation fault.
 
     // 至于其他的区域我们暂时没有办法知道，因为那需要知道用户程序的信息。我们留到之后在处理。
-    proc->page_table = pt_copy;
+    return 0;
 }
\ No newline at end of file
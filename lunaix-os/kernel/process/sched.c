@@ -1,22 +1,30 @@
+#include <arch/x86/fpu.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/tss.h>
 
 #include <hal/apic.h>
 #include <hal/cpu.h>
 
+#include <klibc/string.h>
+
 #include <lunaix/fs/taskfs.h>
 #include <lunaix/mm/cake.h>
 #include <lunaix/mm/kalloc.h>
 #include <lunaix/mm/pmm.h>
+#include <lunaix/mm/region.h>
+#include <lunaix/mm/uaccess.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
 #include <lunaix/process.h>
 #include <lunaix/sched.h>
+#include <lunaix/scstat.h>
 #include <lunaix/signal.h>
 #include <lunaix/spike.h>
 #include <lunaix/status.h>
 #include <lunaix/syscall.h>
 #include <lunaix/syslog.h>
+#include <lunaix/time.h>
+#include <lunaix/trace.h>
 
 volatile struct proc_info* __current;
 
@@ -36,12 +44,15 @@ sched_init_dummy();
 void
 sched_init()
 {
-    proc_pile = cake_new_pile("proc", sizeof(struct proc_info), 1, 0);
-    cake_set_constructor(proc_pile, cake_ctor_zeroing);
+    proc_pile =
+      cake_new_pile("proc", sizeof(struct proc_info), 1, PILE_HWALIGN);
+
+    sched_ctx = (struct scheduler){ .ptable_len = 0, .next_pid = 0 };
+    radix_init(&sched_ctx.procs, 0);
 
-    sched_ctx = (struct scheduler){ ._procs = vzalloc(PROC_TABLE_SIZE),
-                                    .ptable_len = 0,
-                                    .procs_index = 0 };
+    for (int i = 0; i < SCHED_NR_PRIO; i++) {
+        llist_init_head(&sched_ctx.runq[i]);
+    }
 
     // TODO initialize dummy_proc
     sched_init_dummy();
@@ -80,6 +91,7 @@ sched_init_dummy()
     dummy_proc.state = PS_READY;
     dummy_proc.parent = &dummy_proc;
     dummy_proc.pid = KERNEL_PID;
+    llist_init_head(&dummy_proc.sched_node);
 
     __current = &dummy_proc;
 }
@@ -89,6 +101,11 @@ run(struct proc_info* proc)
 {
     proc->state = PS_RUNNING;
 
+    if (proc->stat.ready_since) {
+        proc->stat.wait_ns += clock_systime_ns() - proc->stat.ready_since;
+        proc->stat.ready_since = 0;
+    }
+
     /*
         将tss.esp0设置为上次调度前的esp值。
         当处理信号时，上下文信息是不会恢复的，而是保存在用户栈中，然后直接跳转进位于用户空间的sig_wrapper进行
@@ -99,6 +116,11 @@ run(struct proc_info* proc)
     */
     tss_update_esp(proc->intr_ctx.registers.esp);
 
+    // 此时 __current 仍是被换下的进程，自其换上以来的计数归于它
+    pmc_accumulate(((struct proc_info*)__current)->stat.pmc);
+
+    fpu_switch(proc);
+
     apic_done_servicing();
 
     asm volatile("pushl %0\n"
@@ -119,81 +141,155 @@ can_schedule(struct proc_info* proc)
     return 1;
 }
 
+// 以下两者均为一次性定时器的回调，于时钟中断中执行。定时器在回调返回后即被释放
+
+static void
+__sleep_expired(void* payload)
+{
+    struct proc_info* proc = (struct proc_info*)payload;
+
+    proc->sleep.wakeup_timer = NULL;
+    proc->sleep.wakeup_time = 0;
+
+    if (proc->state == PS_BLOCKED) {
+        sched_enqueue(proc);
+    }
+}
+
+static void
+__alarm_expired(void* payload)
+{
+    struct proc_info* proc = (struct proc_info*)payload;
+
+    proc->sleep.alarm_timer = NULL;
+    proc->sleep.alarm_time = 0;
+
+    __SIGSET(proc->sig_pending, _SIGALRM);
+}
+
+static void
+__cancel_sleep_timers(struct proc_info* proc)
+{
+    if (proc->sleep.wakeup_timer) {
+        timer_cancel(proc->sleep.wakeup_timer);
+        proc->sleep.wakeup_timer = NULL;
+    }
+
+    if (proc->sleep.alarm_timer) {
+        timer_cancel(proc->sleep.alarm_timer);
+        proc->sleep.alarm_timer = NULL;
+    }
+
+    proc_release_timers(proc);
+}
+
 void
-check_sleepers()
+sched_enqueue(struct proc_info* proc)
 {
-    struct proc_info* leader = sched_ctx._procs[0];
-    struct proc_info *pos, *n;
-    time_t now = clock_systime();
-    llist_for_each(pos, n, &leader->sleep.sleepers, sleep.sleepers)
-    {
-        if (PROC_TERMINATED(pos->state)) {
-            goto del;
-        }
+    proc->state = PS_READY;
 
-        time_t wtime = pos->sleep.wakeup_time;
-        time_t atime = pos->sleep.alarm_time;
+    if (proc == &dummy_proc || !llist_empty(&proc->sched_node)) {
+        return;
+    }
 
-        if (wtime && now >= wtime) {
-            pos->sleep.wakeup_time = 0;
-            pos->state = PS_READY;
-        }
+    int prio = SCHED_PRIO(proc->nice);
+    llist_append(&sched_ctx.runq[prio], &proc->sched_node);
+    sched_ctx.prio_map[prio / 32] |= 1U << (prio % 32);
+    sched_ctx.nr_ready++;
 
-        if (atime && now >= atime) {
-            pos->sleep.alarm_time = 0;
-            __SIGSET(pos->sig_pending, _SIGALRM);
-        }
+    proc->stat.ready_since = clock_systime_ns();
 
-        if (!wtime && !atime) {
-        del:
-            llist_delete(&pos->sleep.sleepers);
-        }
+    if (proc != __current &&
+        (__current == &dummy_proc || prio < SCHED_PRIO(__current->nice))) {
+        sched_ctx.need_resched = 1;
     }
 }
 
 void
-schedule()
+sched_dequeue(struct proc_info* proc)
 {
-    if (!sched_ctx.ptable_len) {
+    if (llist_empty(&proc->sched_node)) {
         return;
     }
 
-    // 上下文切换相当的敏感！我们不希望任何的中断打乱栈的顺序……
-    cpu_disable_interrupt();
-    struct proc_info* next;
-    int prev_ptr = sched_ctx.procs_index;
-    int ptr = prev_ptr;
+    int prio = SCHED_PRIO(proc->nice);
+    llist_delete(&proc->sched_node);
+    sched_ctx.nr_ready--;
+    if (llist_empty(&sched_ctx.runq[prio])) {
+        sched_ctx.prio_map[prio / 32] &= ~(1U << (prio % 32));
+    }
+}
 
-    if (!(__current->state & ~PS_RUNNING)) {
-        __current->state = PS_READY;
+static struct proc_info*
+__sched_pick()
+{
+    struct proc_info *pos, *n;
+
+    for (int i = 0; i < SCHED_PRIO_WORDS; i++) {
+        u32_t map = sched_ctx.prio_map[i];
+        while (map) {
+            int prio = i * 32 + __builtin_ctz(map);
+            map &= map - 1;
+
+            llist_for_each(pos, n, &sched_ctx.runq[prio], sched_node)
+            {
+                // 进程在入队后可能已经阻塞或终止，在此一并清除
+                if (pos->state != PS_READY) {
+                    sched_dequeue(pos);
+                    continue;
+                }
+
+                // 如果该进程不给予调度，则留在队列中，尝试下一个
+                if (!can_schedule(pos)) {
+                    continue;
+                }
+
+                sched_dequeue(pos);
+                return pos;
+            }
+        }
     }
 
-    check_sleepers();
+    // schedule the dummy process if we're out of choice
+    return &dummy_proc;
+}
+
+static void
+__schedule(int preempted)
+{
+    if (!sched_ctx.ptable_len) {
+        return;
+    }
 
-    // round-robin scheduler
-redo:
-    do {
-        ptr = (ptr + 1) % sched_ctx.ptable_len;
-        next = sched_ctx._procs[ptr];
-    } while (!next || (next->state != PS_READY && ptr != prev_ptr));
+    // 上下文切换相当的敏感！我们不希望任何的中断打乱栈的顺序……
+    cpu_disable_interrupt();
 
-    sched_ctx.procs_index = ptr;
+    sched_ctx.need_resched = 0;
 
-    if (next->state != PS_READY) {
-        // schedule the dummy process if we're out of choice
-        next = &dummy_proc;
-        goto done;
+    struct proc_info* prev = __current;
+    if (!(prev->state & ~PS_RUNNING)) {
+        sched_enqueue(prev);
     }
 
-    if (!can_schedule(next)) {
-        // 如果该进程不给予调度，则尝试重新选择
-        goto redo;
+    struct proc_info* next = __sched_pick();
+    if (next != prev) {
+        if (preempted) {
+            prev->stat.nivcsw++;
+        } else {
+            prev->stat.nvcsw++;
+        }
+        tracepoint(TP_SCHED_SWITCH, prev->pid, next->pid, prev->state);
     }
 
-done:
     run(next);
 }
 
+void
+schedule()
+{
+    __schedule(0);
+}
+
 void
 sched_yieldk()
 {
@@ -201,6 +297,60 @@ sched_yieldk()
     cpu_int(LUNAIX_SCHED);
 }
 
+void
+sched_preempt()
+{
+    if (sched_ctx.need_resched && !__current->preempt_count) {
+        __schedule(1);
+    }
+}
+
+void
+sched_account_ticks(int user, u32_t ticks)
+{
+    if (user) {
+        __current->stat.utime += ticks;
+    } else {
+        __current->stat.stime += ticks;
+    }
+}
+
+void
+preempt_disable()
+{
+    __current->preempt_count++;
+}
+
+void
+preempt_enable()
+{
+    assert(__current->preempt_count > 0);
+    __current->preempt_count--;
+}
+
+int
+preempt_needed()
+{
+    return sched_ctx.need_resched && !__current->preempt_count;
+}
+
+void
+preempt_point()
+{
+    if (!preempt_needed()) {
+        return;
+    }
+
+    // 系统调用通常在屏蔽中断的情况下执行，让出后须恢复原先的状态
+    int intr = cpu_reflags() & 0x0200;
+
+    sched_yieldk();
+
+    if (!intr) {
+        cpu_disable_interrupt();
+    }
+}
+
 __DEFINE_LXSYSCALL1(unsigned int, sleep, unsigned int, seconds)
 {
     if (!seconds) {
@@ -211,9 +361,15 @@ __DEFINE_LXSYSCALL1(unsigned int, sleep, unsigned int, seconds)
         return (__current->sleep.wakeup_time - clock_systime()) / 1000U;
     }
 
-    struct proc_info* root_proc = sched_ctx._procs[0];
+    struct lx_timer* timer =
+      timer_run_second(seconds, __sleep_expired, __current, 0);
+    if (!timer) {
+        __current->k_status = ENOMEM;
+        return seconds;
+    }
+
+    __current->sleep.wakeup_timer = timer;
     __current->sleep.wakeup_time = clock_systime() + seconds * 1000;
-    llist_append(&root_proc->sleep.sleepers, &__current->sleep.sleepers);
 
     __current->intr_ctx.registers.eax = seconds;
 
@@ -221,16 +377,65 @@ __DEFINE_LXSYSCALL1(unsigned int, sleep, unsigned int, seconds)
     schedule();
 }
 
+__DEFINE_LXSYSCALL2(int,
+                    nanosleep,
+                    const struct timespec*,
+                    req,
+                    struct timespec*,
+                    rem)
+{
+    struct timespec ts;
+    if (copy_from_user(&ts, req, sizeof(ts))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
+    if (ts.tv_nsec < 0 || ts.tv_nsec >= NSEC_PER_SEC) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    u64_t ns = (u64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+    if (!ns) {
+        return 0;
+    }
+
+    struct lx_timer* timer =
+      timer_run(timer_ns_to_ticks(ns), __sleep_expired, __current, 0);
+    if (!timer) {
+        __current->k_status = ENOMEM;
+        return -1;
+    }
+
+    __current->sleep.wakeup_timer = timer;
+    __current->sleep.wakeup_time = clock_systime() + (time_t)(ns / 1000000);
+
+    // 与sleep不同，这里经由sched_yieldk让出，被唤醒后仍回到此处。
+    // 阻塞中的进程不会被信号唤醒，因此rem总是无需填写
+    block_current();
+    sched_yieldk();
+    cpu_disable_interrupt();
+
+    return 0;
+}
+
 __DEFINE_LXSYSCALL1(unsigned int, alarm, unsigned int, seconds)
 {
     time_t prev_ddl = __current->sleep.alarm_time;
     time_t now = clock_systime();
 
-    __current->sleep.alarm_time = seconds ? now + seconds * 1000 : 0;
+    if (__current->sleep.alarm_timer) {
+        timer_cancel(__current->sleep.alarm_timer);
+        __current->sleep.alarm_timer = NULL;
+    }
 
-    struct proc_info* root_proc = sched_ctx._procs[0];
-    if (llist_empty(&__current->sleep.sleepers)) {
-        llist_append(&root_proc->sleep.sleepers, &__current->sleep.sleepers);
+    __current->sleep.alarm_time = 0;
+    if (seconds) {
+        __current->sleep.alarm_timer =
+          timer_run_second(seconds, __alarm_expired, __current, 0);
+        if (__current->sleep.alarm_timer) {
+            __current->sleep.alarm_time = now + seconds * 1000;
+        }
     }
 
     return prev_ddl ? (prev_ddl - now) / 1000 : 0;
@@ -260,6 +465,55 @@ __DEFINE_LXSYSCALL3(pid_t, waitpid, pid_t, pid, int*, status, int, options)
     return _wait(pid, status, options);
 }
 
+static void
+__sched_renice(struct proc_info* proc, int nice)
+{
+    nice = MIN(MAX(nice, SCHED_NICE_MIN), SCHED_NICE_MAX);
+
+    // 就绪队列按优先级划分，须先出队再更改
+    int queued = !llist_empty(&proc->sched_node);
+    sched_dequeue(proc);
+
+    proc->nice = nice;
+
+    if (queued && proc->state == PS_READY) {
+        sched_enqueue(proc);
+    }
+}
+
+__DEFINE_LXSYSCALL1(int, nice, int, inc)
+{
+    __sched_renice(__current, __current->nice + inc);
+
+    return __current->nice;
+}
+
+__DEFINE_LXSYSCALL1(int, getpriority, pid_t, pid)
+{
+    struct proc_info* proc = pid ? get_process(pid) : __current;
+
+    if (!proc || PROC_TERMINATED(proc->state)) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    return proc->nice;
+}
+
+__DEFINE_LXSYSCALL2(int, setpriority, pid_t, pid, int, nice)
+{
+    struct proc_info* proc = pid ? get_process(pid) : __current;
+
+    if (!proc || PROC_TERMINATED(proc->state)) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    __sched_renice(proc, nice);
+
+    return 0;
+}
+
 __DEFINE_LXSYSCALL(int, geterrno)
 {
     return __current->k_status;
@@ -300,44 +554,100 @@ repeat:
 done:
     status_flags |= PEXITSIG * (proc->sig_inprogress != 0);
     if (status) {
-        *status = proc->exit_code | status_flags;
+        int code = proc->exit_code | status_flags;
+        if (copy_to_user(status, &code, sizeof(int))) {
+            __current->k_status = EFAULT;
+            return -1;
+        }
     }
     return destroy_process(proc->pid);
 }
 
+/**
+ * @brief 自上次分配的位置往后找一个空闲的 PID，至上限后回绕。
+ * 刚退出的进程的 PID 因此不会被立即重用，进程不多时一两次查找即可找到
+ *
+ */
+static pid_t
+__alloc_pid()
+{
+    for (u32_t n = 0; n < MAX_PROCESS; n++) {
+        pid_t pid = sched_ctx.next_pid;
+        sched_ctx.next_pid = (pid + 1) % MAX_PROCESS;
+
+        if (!radix_get(&sched_ctx.procs, pid)) {
+            return pid;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief 修改进程表。基数树的修改并非一步完成，须避免中断中途查找
+ *
+ */
+static int
+__ptable_set(pid_t pid, struct proc_info* proc)
+{
+    int errno = 0;
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    if (proc) {
+        errno = radix_set(&sched_ctx.procs, pid, proc);
+    } else {
+        radix_remove(&sched_ctx.procs, pid);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+    return errno;
+}
+
 struct proc_info*
 alloc_process()
 {
-    pid_t i = 0;
-    for (; i < sched_ctx.ptable_len && sched_ctx._procs[i]; i++)
-        ;
+    pid_t i = __alloc_pid();
+    struct proc_info* proc = cake_grab(proc_pile);
 
-    if (i == MAX_PROCESS) {
+    if (i < 0 || !proc || __ptable_set(i, proc)) {
         panick("Panic in Ponyville shimmer!");
     }
 
-    if (i == sched_ctx.ptable_len) {
-        sched_ctx.ptable_len++;
-    }
+    // 撤销后的进程控制块并未恢复至初始状态（如子进程链表、等待项），
+    //  无法借助蛋糕堆的构造函数，须于此整体清零
+    memset(proc, 0, sizeof(*proc));
 
-    struct proc_info* proc = cake_grab(proc_pile);
+    if ((unsigned int)i >= sched_ctx.ptable_len) {
+        sched_ctx.ptable_len = i + 1;
+    }
 
     proc->state = PS_CREATED;
     proc->pid = i;
     proc->created = clock_systime();
     proc->pgid = proc->pid;
-    proc->fdtable = vzalloc(sizeof(struct v_fdtable));
-    proc->fxstate =
-      vzalloc_dma(512); // FXSAVE需要十六位对齐地址，使用DMA块（128位对齐）
+    proc->nice = 0;
+    proc->preempt_count = 0;
+    proc->stat = (struct proc_stat){ 0 };
+    proc->scstat = NULL;
+    for (int j = 0; j < PROC_AIO_MAX; j++) {
+        proc->aio[j] = NULL;
+    }
+    proc->ioring = NULL;
+    proc->fdtable = vfs_fdtable_new();
+    // XSAVE需要64字节对齐的地址，使用DMA块（128字节对齐）
+    proc->fxstate = vzalloc_dma(fpu_state_size);
 
-    llist_init_head(&proc->mm.regions.head);
+    region_init(&proc->mm.regions);
     llist_init_head(&proc->tasks);
+    llist_init_head(&proc->sched_node);
     llist_init_head(&proc->children);
+    llist_init_head(&proc->siblings);
     llist_init_head(&proc->grp_member);
-    llist_init_head(&proc->sleep.sleepers);
     waitq_init(&proc->waitqueue);
-
-    sched_ctx._procs[i] = proc;
+    waitq_init(&proc->vfork_wait);
 
     return proc;
 }
@@ -345,7 +655,7 @@ alloc_process()
 void
 commit_process(struct proc_info* process)
 {
-    assert(process == sched_ctx._procs[process->pid]);
+    assert(process == get_process(process->pid));
 
     if (process->state != PS_CREATED) {
         __current->k_status = EINVAL;
@@ -354,13 +664,13 @@ commit_process(struct proc_info* process)
 
     // every process is the child of first process (pid=1)
     if (!process->parent) {
-        process->parent = sched_ctx._procs[1];
+        process->parent = get_process(1);
     }
 
     llist_append(&process->parent->children, &process->siblings);
-    llist_append(&sched_ctx._procs[0]->tasks, &process->tasks);
+    llist_append(&get_process(0)->tasks, &process->tasks);
 
-    process->state = PS_READY;
+    sched_enqueue(process);
 }
 
 // from <kernel/process.c>
@@ -371,17 +681,21 @@ pid_t
 destroy_process(pid_t pid)
 {
     int index = pid;
-    if (index <= 0 || index > sched_ctx.ptable_len) {
+    struct proc_info* proc;
+    if (index <= 0 || !(proc = get_process(index))) {
         __current->k_status = EINVAL;
         return;
     }
-    struct proc_info* proc = sched_ctx._procs[index];
-    sched_ctx._procs[index] = 0;
+    __ptable_set(index, NULL);
 
     llist_delete(&proc->siblings);
     llist_delete(&proc->grp_member);
     llist_delete(&proc->tasks);
-    llist_delete(&proc->sleep.sleepers);
+    __cancel_sleep_timers(proc);
+    proc_release_aio(proc);
+    proc_release_ioring(proc);
+    scstat_release(proc);
+    sched_dequeue(proc);
 
     taskfs_invalidate(pid);
 
@@ -389,22 +703,19 @@ destroy_process(pid_t pid)
         vfs_unref_dnode(proc->cwd);
     }
 
-    for (size_t i = 0; i < VFS_MAX_FD; i++) {
+    vfs_fdtable_foreach(proc->fdtable, i)
+    {
         struct v_fd* fd = proc->fdtable->fds[i];
-        if (fd) {
-            vfs_pclose(fd->file, pid);
-            vfs_free_fd(fd);
-        }
+        vfs_pclose(fd->file, pid);
+        vfs_free_fd(fd);
     }
 
-    vfree(proc->fdtable);
+    vfs_fdtable_free(proc->fdtable);
+
+    fpu_discard(proc);
     vfree_dma(proc->fxstate);
 
-    struct mm_region *pos, *n;
-    llist_for_each(pos, n, &proc->mm.regions.head, head)
-    {
-        vfree(pos);
-    }
+    region_release_all(&proc->mm.regions);
 
     vmm_mount_pd(PD_MOUNT_1, proc->page_table);
 
@@ -423,17 +734,32 @@ terminate_proc(int exit_code)
     __current->state = PS_TERMNAT;
     __current->exit_code = exit_code;
 
+    if ((__current->flags & PROC_FVFORK)) {
+        __current->flags &= ~PROC_FVFORK;
+        pwake_all(&__current->vfork_wait);
+    }
+
     __SIGSET(__current->parent->sig_pending, _SIGCHLD);
 }
 
 struct proc_info*
 get_process(pid_t pid)
 {
-    int index = pid;
-    if (index < 0 || index > sched_ctx.ptable_len) {
+    if (pid < 0 || pid >= MAX_PROCESS) {
         return NULL;
     }
-    return sched_ctx._procs[index];
+    return radix_get(&sched_ctx.procs, pid);
+}
+
+struct proc_info*
+get_next_process(pid_t pid)
+{
+    struct proc_info* proc;
+    if (pid < 0 ||
+        !radix_gang_lookup(&sched_ctx.procs, (void**)&proc, pid, 1, -1)) {
+        return NULL;
+    }
+    return proc;
 }
 
 int
@@ -441,9 +767,9 @@ orphaned_proc(pid_t pid)
 {
     if (!pid)
         return 0;
-    if (pid >= sched_ctx.ptable_len)
+    struct proc_info* proc = get_process(pid);
+    if (!proc)
         return 0;
-    struct proc_info* proc = sched_ctx._procs[pid];
     struct proc_info* parent = proc->parent;
 
     // 如果其父进程的状态是terminated 或 destroy中的一种
@@ -1,6 +1,9 @@
+#include <arch/x86/fpu.h>
 #include <klibc/string.h>
 #include <lunaix/lunistd.h>
 #include <lunaix/lxsignal.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/mm/vmm.h>
 #include <lunaix/process.h>
 #include <lunaix/sched.h>
 #include <lunaix/signal.h>
@@ -23,13 +26,14 @@ void* default_handlers[_SIG_NUM] = {
     [_SIGINT] = default_sighandler_term,
 };
 
-volatile struct proc_sigstate __temp_save;
+// 见 signal_dispatch 中的说明
+volatile isr_param __temp_save;
 // Referenced in kernel/asm/x86/interrupt.S
 void*
 signal_dispatch()
 {
-    if (!__current->sig_pending) {
-        // 没有待处理信号
+    if (!__current->sig_pending || (__current->flags & PROC_FKTHREAD)) {
+        // 没有待处理信号，或为不接收信号的内核线程
         return 0;
     }
 
@@ -52,13 +56,16 @@ signal_dispatch()
 
     uintptr_t ustack = __current->ustack_top & ~0xf;
 
-    if ((int)(ustack - USTACK_END) < (int)sizeof(struct proc_sig)) {
+    // 从未使用过FPU的进程，其FPU状态即是初始状态，无需随信号帧保存
+    int save_fpu = (__current->flags & PROC_FFPU);
+    size_t frame_size = SIGFRAME_LIGHT_SIZE + (save_fpu ? fpu_state_size : 0);
+
+    if ((int)(ustack - USTACK_END) < (int)frame_size) {
         // 用户栈没有空间存放信号上下文
         return 0;
     }
 
-    struct proc_sig* sig_ctx =
-      (struct proc_sig*)(ustack - sizeof(struct proc_sig));
+    struct proc_sig* sig_ctx = (struct proc_sig*)(ustack - frame_size);
 
     /*
         这是一个相当恶心的坑。
@@ -79,11 +86,24 @@ signal_dispatch()
         触发#GP。
 
         解决办法就是先吧intr_ctx拷贝到一个静态分配的区域里，然后再注入到用户栈。
+        若信号帧所在的页均已就绪且可写，则不会缺页，可直接写入。
+        fxstate 不会被中断改写，始终直接拷贝。
     */
-    __temp_save.proc_regs = __current->intr_ctx;
-    memcpy(__temp_save.fxstate, __current->fxstate, 512);
+    if (vmm_writable((uintptr_t)sig_ctx, frame_size)) {
+        sig_ctx->prev_context.proc_regs = __current->intr_ctx;
+    } else {
+        __temp_save = __current->intr_ctx;
+        sig_ctx->prev_context.proc_regs = __temp_save;
+    }
 
-    sig_ctx->prev_context = __temp_save;
+    if (save_fpu) {
+        fpu_save(__current);
+        memcpy(
+          sig_ctx->prev_context.fxstate, __current->fxstate, fpu_state_size);
+        sig_ctx->sig_flags = 0;
+    } else {
+        sig_ctx->sig_flags = SIGFRAME_NOFPU;
+    }
 
     sig_ctx->sig_num = sig_selected;
     sig_ctx->signal_handler = __current->sig_handler[sig_selected];
@@ -141,7 +161,16 @@ send_single:
 
 __DEFINE_LXSYSCALL1(int, sigreturn, struct proc_sig, *sig_ctx)
 {
-    memcpy(__current->fxstate, sig_ctx->prev_context.fxstate, 512);
+    if (!(sig_ctx->sig_flags & SIGFRAME_NOFPU)) {
+        memcpy(
+          __current->fxstate, sig_ctx->prev_context.fxstate, fpu_state_size);
+        fpu_sanitize(__current->fxstate);
+        fpu_discard(__current);
+    } else if ((__current->flags & PROC_FFPU)) {
+        // 处理函数动用了FPU，而被中断者此前从未使用过，还原为初始状态即可
+        fpu_reset(__current);
+    }
+
     __current->intr_ctx = sig_ctx->prev_context.proc_regs;
     __current->flags &= ~PROC_FINPAUSE;
     __SIGCLEAR(__current->sig_inprogress, sig_ctx->sig_num);
@@ -157,13 +186,29 @@ __DEFINE_LXSYSCALL3(int,
                     sigset_t,
                     *oldset)
 {
-    *oldset = __current->sig_mask;
+    sigset_t mask;
+    // oldset为NULL时不报告原有的掩码，set为NULL时不作改动
+    if (oldset &&
+        copy_to_user(oldset, &__current->sig_mask, sizeof(sigset_t))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
+    if (!set) {
+        return 1;
+    }
+
+    if (copy_from_user(&mask, set, sizeof(sigset_t))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
     if (how == _SIG_BLOCK) {
-        __current->sig_mask |= *set;
+        __current->sig_mask |= mask;
     } else if (how == _SIG_UNBLOCK) {
-        __current->sig_mask &= ~(*set);
+        __current->sig_mask &= ~mask;
     } else if (how == _SIG_SETMASK) {
-        __current->sig_mask = *set;
+        __current->sig_mask = mask;
     } else {
         return 0;
     }
@@ -71,6 +71,59 @@ __reset_children(struct twimap* map)
     map->index = proc->children.next;
 }
 
+void
+__read_sched_stat(struct twimap* map)
+{
+    struct proc_info* proc = twimap_data(map, struct proc_info*);
+    struct proc_stat* stat = &proc->stat;
+    twimap_printf(map,
+                  "%u %u %u %u %u\n",
+                  stat->utime,
+                  stat->stime,
+                  stat->nvcsw,
+                  stat->nivcsw,
+                  (u32_t)(stat->wait_ns / 1000000));
+}
+
+#ifdef LUNAIX_PMC
+static char*
+__u64_to_str(u64_t v, char* buf_end)
+{
+    *--buf_end = '\0';
+    do {
+        *--buf_end = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    return buf_end;
+}
+
+void
+__read_pmc(struct twimap* map)
+{
+    struct proc_info* proc = twimap_data(map, struct proc_info*);
+    char buf[24];
+
+    // 进程读取自己的计数时，计入自上次切换以来的部分
+    if (proc == __current) {
+        int intr = cpu_reflags() & 0x0200;
+        cpu_disable_interrupt();
+        pmc_accumulate(proc->stat.pmc);
+        if (intr) {
+            cpu_enable_interrupt();
+        }
+    }
+
+    for (u32_t i = 0; i < PMC_NR; i++) {
+        if ((pmc_available() & (1 << i))) {
+            twimap_printf(map,
+                          "%s %s\n",
+                          pmc_name(i),
+                          __u64_to_str(proc->stat.pmc[i], buf + sizeof(buf)));
+        }
+    }
+}
+#endif
+
 void
 export_task_attr()
 {
@@ -100,4 +153,16 @@ export_task_attr()
     map->go_next = __next_children;
     map->reset = __reset_children;
     taskfs_export_attr("children", map);
+
+    // utime stime（时钟周期） 主动切换 被抢占 就绪等待（毫秒）
+    map = twimap_create(NULL);
+    map->read = __read_sched_stat;
+    taskfs_export_attr("sched_stat", map);
+
+#ifdef LUNAIX_PMC
+    // 每行一个可用的事件：名称 计数
+    map = twimap_create(NULL);
+    map->read = __read_pmc;
+    taskfs_export_attr("pmc", map);
+#endif
 }
\ No newline at end of file
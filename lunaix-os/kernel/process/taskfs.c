@@ -46,43 +46,78 @@ taskfs_mknod(struct v_dnode* dnode, pid_t pid, int sub_counter, int itype)
     return 0;
 }
 
+/**
+ * @brief 获取第 index 个（已提交的）进程。进程以 pid 递增的顺序列出，
+ *  游标记住下一个待查看的 pid，使顺序的 readdir 无需每次都从头数起。
+ *  进程表按 pid 索引，进程退出不会使游标失效
+ *
+ */
+static struct proc_info*
+__taskfs_task_at(struct v_file* file, int index)
+{
+    struct dir_cursor* cur = &file->dcur;
+    pid_t pid = 1;
+    int i = 0;
+
+    if (cur->seq && cur->index <= index) {
+        pid = cur->seq;
+        i = cur->index;
+    }
+
+    struct proc_info* proc;
+    while ((proc = get_next_process(pid))) {
+        pid = proc->pid + 1;
+
+        // 尚未提交的进程不在任务列表之中
+        if (llist_empty(&proc->tasks)) {
+            continue;
+        }
+
+        if (i++ == index) {
+            cur->index = index + 1;
+            cur->seq = pid;
+            return proc;
+        }
+    }
+
+    cur->seq = 0;
+    return NULL;
+}
+
 int
 taskfs_readdir(struct v_file* file, struct dir_context* dctx)
 {
     struct v_inode* inode = file->inode;
     pid_t pid = inode->id >> 16;
-    int counter = 0;
 
     if ((inode->id & COUNTER_MASK)) {
         return ENOTDIR;
     }
 
     if (pid) {
-        struct task_attribute *pos, *n;
-        llist_for_each(pos, n, &attributes, siblings)
-        {
-            if (counter == dctx->index) {
-                dctx->read_complete_callback(
-                  dctx, pos->key_val, VFS_NAME_MAXLEN, DT_FILE);
-                return 1;
-            }
-            counter++;
+        // 属性只会被追加，游标总是有效的
+        struct llist_header* it =
+          vfs_dir_seek(file, &attributes, dctx->index, 0);
+        if (!it) {
+            return 0;
         }
+
+        struct task_attribute* tattr =
+          container_of(it, struct task_attribute, siblings);
+        dctx->read_complete_callback(
+          dctx, tattr->key_val, strlen(tattr->key_val), DT_FILE);
+        return 1;
+    }
+
+    struct proc_info* proc = __taskfs_task_at(file, dctx->index);
+    if (!proc) {
         return 0;
     }
 
     char name[VFS_NAME_MAXLEN];
-    struct proc_info *root = get_process(pid), *pos, *n;
-    llist_for_each(pos, n, &root->tasks, tasks)
-    {
-        if (counter == dctx->index) {
-            ksnprintf(name, VFS_NAME_MAXLEN, "%d", pos->pid);
-            dctx->read_complete_callback(dctx, name, VFS_NAME_MAXLEN, DT_DIR);
-            return 1;
-        }
-        counter++;
-    }
-    return 0;
+    size_t len = ksnprintf(name, VFS_NAME_MAXLEN, "%d", proc->pid);
+    dctx->read_complete_callback(dctx, name, len - 1, DT_DIR);
+    return 1;
 }
 
 // ascii to pid
@@ -218,6 +253,7 @@ void
 taskfs_init()
 {
     struct filesystem* taskfs = fsm_new_fs("taskfs", 5);
+    taskfs->types |= FSTYPE_PSEUDO;
     taskfs->mount = taskfs_mount;
 
     fsm_register(taskfs);
@@ -0,0 +1,96 @@
+#include <hal/cpu.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/sched.h>
+#include <lunaix/spike.h>
+#include <lunaix/syslog.h>
+#include <lunaix/workqueue.h>
+
+LOG_MODULE("WORKQ")
+
+static struct workqueue* sys_wq;
+
+static void
+__worker(void* arg)
+{
+    struct workqueue* wq = (struct workqueue*)arg;
+
+    while (1) {
+        // 工作项与系统调用一样，在屏蔽中断的情况下执行
+        cpu_disable_interrupt();
+
+        if (llist_empty(&wq->works)) {
+            pwait(&wq->worker_wait);
+            continue;
+        }
+
+        struct lx_work* work =
+          list_entry(wq->works.next, struct lx_work, works);
+        llist_delete(&work->works);
+
+        // 先行清除标记，使工作项在执行期间可被再次提交
+        work->flags &= ~WORK_PENDING;
+        work->func(work->arg);
+
+        preempt_point();
+    }
+}
+
+struct workqueue*
+workqueue_create()
+{
+    struct workqueue* wq = valloc(sizeof(struct workqueue));
+    if (!wq) {
+        return NULL;
+    }
+
+    llist_init_head(&wq->works);
+    waitq_init(&wq->worker_wait);
+
+    if (!(wq->worker = spawn_kthread(__worker, wq))) {
+        vfree(wq);
+        return NULL;
+    }
+
+    return wq;
+}
+
+void
+workqueue_init()
+{
+    if (!(sys_wq = workqueue_create())) {
+        panick("fail to start system workqueue");
+    }
+}
+
+int
+workqueue_submit(struct workqueue* wq, struct lx_work* work)
+{
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    int submitted = !(work->flags & WORK_PENDING);
+    if (submitted) {
+        work->flags |= WORK_PENDING;
+        llist_append(&wq->works, &work->works);
+        pwake_one(&wq->worker_wait);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    return submitted;
+}
+
+struct workqueue*
+workqueue_system()
+{
+    return sys_wq;
+}
+
+int
+work_submit(struct lx_work* work)
+{
+    return workqueue_submit(sys_wq, work);
+}
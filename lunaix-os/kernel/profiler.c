@@ -0,0 +1,227 @@
+/**
+ * @file profiler.c
+ * @brief 定时器驱动的采样分析器，见 lunaix/profiler.h
+ *
+ */
+#include <klibc/stdio.h>
+#include <klibc/string.h>
+#include <lunaix/common.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/kcmdline.h>
+#include <lunaix/mm/page.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/mm/vmm.h>
+#include <lunaix/percpu.h>
+#include <lunaix/process.h>
+#include <lunaix/profiler.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syslog.h>
+
+#ifdef LUNAIX_PROFILER
+
+LOG_MODULE("PROF")
+
+extern u8_t __kernel_start; /* link/linker.ld */
+extern u8_t __kernel_end;
+
+static DEFINE_PERCPU(struct prof_ring*, prof_ring);
+static volatile int prof_enabled;
+
+// 各处理器本次开启时的 head，读取时不早于此
+static u32_t prof_start[SMP_MAX_CPU];
+
+static inline int
+__prof_ktext(ptr_t addr)
+{
+    return (ptr_t)&__kernel_start <= addr && addr < (ptr_t)&__kernel_end;
+}
+
+/**
+ * @brief 沿帧指针回溯。fp 可能并非帧指针（如省略了帧指针的函数），
+ *  因此每一帧都须落在已映射的页中，且严格地向栈底（高地址）前进
+ *
+ */
+static u32_t
+__prof_backtrace(ptr_t fp, u32_t* frames)
+{
+    v_mapping mapping;
+    u32_t depth = 0;
+
+    while (depth < PROF_DEPTH) {
+        if ((fp & 3) || PG_OFFSET(fp) > PG_SIZE - 2 * sizeof(ptr_t)) {
+            break;
+        }
+        if (fp < KERNEL_MM_BASE && (fp < KSTACK_START || fp >= KSTACK_TOP)) {
+            break;
+        }
+        if (!vmm_lookup(fp, &mapping) || !(mapping.flags & PG_PRESENT)) {
+            break;
+        }
+
+        ptr_t* frame = (ptr_t*)fp;
+        if (!__prof_ktext(frame[1])) {
+            break;
+        }
+
+        frames[depth++] = frame[1];
+
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+
+    return depth;
+}
+
+void
+profiler_sample(const isr_param* param)
+{
+    if (!prof_enabled) {
+        return;
+    }
+
+    struct prof_ring* ring = this_cpu_read(prof_ring);
+    if (!ring) {
+        return;
+    }
+
+    // 环只由本处理器在中断中写入，head 无需原子的增加
+    u32_t seq = ring->head++;
+    struct prof_sample* s = &ring->samples[seq & (PROF_NR_SAMPLES - 1)];
+
+    // 先使其失效，与之竞争的读者便会发现不一致
+    __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    s->pid = __current->pid;
+    s->eip = param->eip;
+    s->user = (param->cs & 0x3) != 0;
+    s->depth = s->user ? 0 : __prof_backtrace(param->registers.ebp, s->frames);
+
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static int
+__prof_enable(int enable)
+{
+    if (!enable) {
+        prof_enabled = 0;
+        return 0;
+    }
+
+    for (u32_t cpu = 0; cpu < percpu_nr_areas; cpu++) {
+        struct prof_ring** ring = per_cpu_ptr(prof_ring, cpu);
+        if (!*ring && !(*ring = vzalloc(sizeof(struct prof_ring)))) {
+            return ENOMEM;
+        }
+        prof_start[cpu] = (*ring)->head;
+    }
+
+    prof_enabled = 1;
+    return 0;
+}
+
+static int
+__prof_rd_enable(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (fpos) {
+        return 0;
+    }
+    return ksnprintf(buffer, len, "%u\n", prof_enabled);
+}
+
+static int
+__prof_wr_enable(struct v_inode* inode, void* buffer, size_t len, foff_t fpos)
+{
+    if (!len) {
+        return EINVAL;
+    }
+
+    int errno = __prof_enable(*(char*)buffer != '0');
+    return errno ? errno : (int)len;
+}
+
+static void
+__prof_reset(struct twimap* map)
+{
+    u32_t cpu = twimap_data(map, u32_t);
+    struct prof_ring* ring = *per_cpu_ptr(prof_ring, cpu);
+
+    // 从环中最早的、且属于本次开启的样本开始
+    u32_t head = ring ? ring->head : 0;
+    u32_t seq = head > PROF_NR_SAMPLES ? head - PROF_NR_SAMPLES : 0;
+    map->index = (void*)MAX(seq, prof_start[cpu]);
+}
+
+static int
+__prof_next(struct twimap* map)
+{
+    u32_t cpu = twimap_data(map, u32_t);
+    struct prof_ring* ring = *per_cpu_ptr(prof_ring, cpu);
+    u32_t seq = twimap_index(map, u32_t) + 1;
+
+    if (!ring || seq >= ring->head) {
+        return 0;
+    }
+
+    map->index = (void*)seq;
+    return 1;
+}
+
+static void
+__prof_read(struct twimap* map)
+{
+    u32_t cpu = twimap_data(map, u32_t);
+    struct prof_ring* ring = *per_cpu_ptr(prof_ring, cpu);
+    u32_t seq = twimap_index(map, u32_t);
+    struct prof_sample s;
+
+    if (!ring || seq >= ring->head) {
+        return;
+    }
+
+    struct prof_sample* src = &ring->samples[seq & (PROF_NR_SAMPLES - 1)];
+    if (__atomic_load_n(&src->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+        return;
+    }
+
+    s = *src;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    // 读取期间被新样本覆盖则略去
+    if (__atomic_load_n(&src->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+        return;
+    }
+
+    twimap_printf(map, "%u %c %x", s.pid, s.user ? 'u' : 'k', s.eip);
+    for (u32_t i = 0; i < s.depth && i < PROF_DEPTH; i++) {
+        twimap_printf(map, " %x", s.frames[i]);
+    }
+    twimap_printf(map, "\n");
+}
+
+void
+profiler_init()
+{
+    struct twifs_node* dir = twifs_dir_node(NULL, "profile");
+
+    struct twifs_node* node = twifs_file_node(dir, "enable");
+    node->ops.read = __prof_rd_enable;
+    node->ops.write = __prof_wr_enable;
+
+    // smp_init 之后调用，此时已知处理器的数目
+    for (u32_t cpu = 0; cpu < percpu_nr_areas; cpu++) {
+        struct twimap* map = twifs_mapping(dir, (void*)cpu, "cpu%u", cpu);
+        map->reset = __prof_reset;
+        map->go_next = __prof_next;
+        map->read = __prof_read;
+    }
+
+    if (kcmdline_get("prof") && __prof_enable(1)) {
+        kprintf(KWARN "fail to enable profiler\n");
+    }
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include <hal/cpu.h>
+#include <hal/rnd.h>
+#include <hal/rtc.h>
+#include <lunaix/rand.h>
+#include <lunaix/spike.h>
+
+#include <klibc/string.h>
+
+#define CHACHA_BLOCK 64
+#define CHACHA_ROUNDS 20
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d)                                               \
+    a += b;                                                                    \
+    d = ROTL(d ^ a, 16);                                                       \
+    c += d;                                                                    \
+    b = ROTL(b ^ c, 12);                                                       \
+    a += b;                                                                    \
+    d = ROTL(d ^ a, 8);                                                        \
+    c += d;                                                                    \
+    b = ROTL(b ^ c, 7);
+
+#define POOL_WORDS 16
+
+static struct
+{
+    u32_t key[8];
+    // 每次取用使用一个新的 nonce，块计数器于其内递增
+    u64_t nonce;
+} rng;
+
+static struct
+{
+    u32_t words[POOL_WORDS];
+    u32_t pos;
+    volatile u32_t samples;
+} pool;
+
+// "expand 32-byte k"
+static const u32_t chacha_const[4] = {
+    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574
+};
+
+static void
+chacha20_block(u32_t* out, const u32_t* key, u64_t nonce, u32_t counter)
+{
+    u32_t in[16], x[16];
+
+    memcpy(in, chacha_const, sizeof(chacha_const));
+    memcpy(&in[4], key, 32);
+    in[12] = counter;
+    in[13] = 0;
+    in[14] = (u32_t)nonce;
+    in[15] = (u32_t)(nonce >> 32);
+
+    memcpy(x, in, sizeof(in));
+    for (int i = 0; i < CHACHA_ROUNDS; i += 2) {
+        QUARTERROUND(x[0], x[4], x[8], x[12])
+        QUARTERROUND(x[1], x[5], x[9], x[13])
+        QUARTERROUND(x[2], x[6], x[10], x[14])
+        QUARTERROUND(x[3], x[7], x[11], x[15])
+        QUARTERROUND(x[0], x[5], x[10], x[15])
+        QUARTERROUND(x[1], x[6], x[11], x[12])
+        QUARTERROUND(x[2], x[7], x[8], x[13])
+        QUARTERROUND(x[3], x[4], x[9], x[14])
+    }
+
+    for (int i = 0; i < 16; i++) {
+        out[i] = x[i] + in[i];
+    }
+}
+
+void
+rand_add_entropy(u32_t sample)
+{
+    // 仅作搅拌，熵的提取交由注入密钥时的 ChaCha20 完成
+    u32_t i = pool.pos++ & (POOL_WORDS - 1);
+    u32_t j = (i + 5) & (POOL_WORDS - 1);
+    pool.words[i] = ROTL(pool.words[i], 7) ^ pool.words[j] ^ sample;
+    pool.samples++;
+}
+
+static void
+__rand_reseed()
+{
+    u32_t block[16];
+
+    for (int i = 0; i < 8; i++) {
+        rng.key[i] ^= pool.words[i] ^ pool.words[i + 8];
+    }
+    pool.samples = 0;
+
+    chacha20_block(block, rng.key, ~rng.nonce, 0);
+    memcpy(rng.key, block, sizeof(rng.key));
+    memset(block, 0, sizeof(block));
+}
+
+static void
+__rand_collect_hw()
+{
+    u32_t v;
+
+    if (rnd_seed_is_supported()) {
+        for (int i = 0; i < 8; i++) {
+            if (rnd_rdseed32(&v)) {
+                rand_add_entropy(v);
+            }
+        }
+    }
+
+    if (rnd_is_supported()) {
+        for (int i = 0; i < 8; i++) {
+            if (rnd_rdrand32(&v)) {
+                rand_add_entropy(v);
+            }
+        }
+    }
+
+    u64_t tsc = cpu_rdtsc();
+    rand_add_entropy((u32_t)tsc);
+    rand_add_entropy((u32_t)(tsc >> 32));
+}
+
+void
+rand_init()
+{
+    memset(&rng, 0, sizeof(rng));
+
+    __rand_collect_hw();
+
+    // 无硬件随机数时，开机的时刻与 TSC 是仅有的初始熵，其余来自中断
+    rand_add_entropy(rtc_read_reg(RTC_REG_YRS) << 24 |
+                     rtc_read_reg(RTC_REG_DAY) << 16 |
+                     rtc_read_reg(RTC_REG_MIN) << 8 |
+                     rtc_read_reg(RTC_REG_SEC));
+
+    __rand_reseed();
+}
+
+void
+rand_bytes(void* buf, size_t len)
+{
+    u32_t block[16], key[8];
+    u64_t nonce;
+
+    // 取出当前密钥并立即换新，其后的生成无须屏蔽中断
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    if (pool.samples >= RAND_RESEED_SAMPLES) {
+        if (rnd_is_supported()) {
+            __rand_collect_hw();
+        }
+        __rand_reseed();
+    }
+
+    memcpy(key, rng.key, sizeof(key));
+    nonce = rng.nonce++;
+
+    chacha20_block(block, key, nonce, 0);
+    memcpy(rng.key, block, sizeof(rng.key));
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    u8_t* out = (u8_t*)buf;
+    u32_t counter = 1;
+    while (len) {
+        chacha20_block(block, key, nonce, counter++);
+        size_t n = MIN(len, CHACHA_BLOCK);
+        memcpy(out, block, n);
+        out += n;
+        len -= n;
+    }
+
+    memset(block, 0, sizeof(block));
+    memset(key, 0, sizeof(key));
+}
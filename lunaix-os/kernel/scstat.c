@@ -0,0 +1,157 @@
+#include <hal/cpu.h>
+#include <lunaix/fs/taskfs.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/process.h>
+#include <lunaix/scstat.h>
+
+#ifdef LUNAIX_SYSCALL_STAT
+
+typedef int (*scstat_fn)(u32_t, u32_t, u32_t, u32_t, u32_t, u32_t);
+
+// 系统调用表中实际登记的项数（kernel/asm/x86/syscall.S）
+extern const u32_t syscall_nr;
+
+static struct scstat* sys_stats;
+
+static void
+__scstat_account(struct scstat* stat, u32_t cycles)
+{
+    int bucket = 0;
+    if (cycles >> SCSTAT_BUCKET_BASE) {
+        bucket = (31 - __builtin_clz(cycles) - SCSTAT_BUCKET_BASE) / 2;
+    }
+
+    stat->count++;
+    stat->cycles += cycles;
+    stat->hist[bucket]++;
+    if (cycles > stat->max_cycles) {
+        stat->max_cycles = cycles;
+    }
+}
+
+/**
+ * @brief 经由 syscall_hndlr 分派的系统调用。调用号与处理函数之后即为其六个参数，
+ *  与直接调用处理函数时的栈布局一致
+ *
+ */
+int
+scstat_call(u32_t code,
+            scstat_fn fn,
+            u32_t a1,
+            u32_t a2,
+            u32_t a3,
+            u32_t a4,
+            u32_t a5,
+            u32_t a6)
+{
+    u64_t t0 = cpu_rdtsc();
+    int retval = fn(a1, a2, a3, a4, a5, a6);
+    u32_t cycles = (u32_t)(cpu_rdtsc() - t0);
+
+    // 每个进程都有各自的内核栈，返回至此时 __current 仍是发起调用的进程
+    struct proc_info* proc = (struct proc_info*)__current;
+    if (!proc->scstat) {
+        proc->scstat = vzalloc(syscall_nr * sizeof(struct scstat));
+    }
+
+    int intr = cpu_reflags() & 0x0200;
+    cpu_disable_interrupt();
+
+    if (sys_stats) {
+        __scstat_account(&sys_stats[code], cycles);
+    }
+    if (proc->scstat) {
+        __scstat_account(&proc->scstat[code], cycles);
+    }
+
+    if (intr) {
+        cpu_enable_interrupt();
+    }
+
+    return retval;
+}
+
+void
+scstat_release(struct proc_info* proc)
+{
+    if (proc->scstat) {
+        vfree(proc->scstat);
+        proc->scstat = NULL;
+    }
+}
+
+static void
+__scstat_print(struct twimap* map, struct scstat* table)
+{
+    u32_t nr = twimap_index(map, u32_t);
+
+    if (!nr) {
+        twimap_printf(map,
+                      " NR     COUNT    AVG_CYC    MAX_CYC  HISTOGRAM\n");
+    }
+    if (!table || !table[nr].count) {
+        return;
+    }
+
+    struct scstat* stat = &table[nr];
+    twimap_printf(map,
+                  "%3u %9u %10u %10u ",
+                  nr,
+                  stat->count,
+                  (u32_t)(stat->cycles / stat->count),
+                  stat->max_cycles);
+    for (int i = 0; i < SCSTAT_BUCKETS; i++) {
+        twimap_printf(map, " %u", stat->hist[i]);
+    }
+    twimap_printf(map, "\n");
+}
+
+static void
+__scstat_sys_read(struct twimap* map)
+{
+    __scstat_print(map, sys_stats);
+}
+
+static void
+__scstat_proc_read(struct twimap* map)
+{
+    struct proc_info* proc = twimap_data(map, struct proc_info*);
+    __scstat_print(map, proc->scstat);
+}
+
+static int
+__scstat_next(struct twimap* map)
+{
+    u32_t nr = twimap_index(map, u32_t);
+    if (nr + 1 >= syscall_nr) {
+        return 0;
+    }
+    map->index = (void*)(nr + 1);
+    return 1;
+}
+
+static void
+__scstat_reset(struct twimap* map)
+{
+    map->index = (void*)0;
+}
+
+void
+scstat_export()
+{
+    sys_stats = vzalloc(syscall_nr * sizeof(struct scstat));
+
+    struct twimap* map = twifs_mapping(NULL, NULL, "syscalls");
+    map->read = __scstat_sys_read;
+    map->go_next = __scstat_next;
+    map->reset = __scstat_reset;
+
+    map = twimap_create(NULL);
+    map->read = __scstat_proc_read;
+    map->go_next = __scstat_next;
+    map->reset = __scstat_reset;
+    taskfs_export_attr("syscalls", map);
+}
+
+#endif
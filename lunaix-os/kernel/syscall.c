@@ -1,7 +1,10 @@
 #include <arch/x86/interrupts.h>
+#include <hal/cpu.h>
+#include <lunaix/common.h>
 #include <lunaix/isrm.h>
 #include <lunaix/process.h>
 #include <lunaix/sched.h>
+#include <lunaix/spike.h>
 #include <lunaix/syscall.h>
 #include <lunaix/syslog.h>
 
@@ -10,8 +13,22 @@ LOG_MODULE("SYSCALL")
 extern void
 syscall_hndlr(const isr_param* param);
 
+extern u8_t sysenter_stack[];
+
+extern void
+sysenter_entry();
+
 void
 syscall_install()
 {
     isrm_bindiv(LUNAIX_SYS_CALL, syscall_hndlr);
+
+    // 用户态的系统调用均经由SYSENTER发起。Lunaix本就依赖SSE，而支持SSE的
+    //  处理器总是支持SYSENTER的，因此这里不提供回退
+    if (!cpu_has_sysenter()) {
+        panick("sysenter not supported");
+    }
+
+    // SYSEXIT要求用户段紧随内核段之后（CS+16, CS+24），现有的GDT布局恰好满足
+    cpu_setup_sysenter(KCODE_SEG, sysenter_stack, sysenter_entry);
 }
\ No newline at end of file
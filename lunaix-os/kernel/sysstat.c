@@ -0,0 +1,100 @@
+#include <lunaix/block.h>
+#include <lunaix/clock.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/pmm.h>
+#include <lunaix/spike.h>
+#include <lunaix/sysstat.h>
+
+#include <klibc/string.h>
+
+static int
+__sysstat_nr_blk()
+{
+    int n = 0;
+    while (block_dev_at(n)) {
+        n++;
+    }
+    return n;
+}
+
+static void
+__sysstat_rd_header(struct twimap* map)
+{
+    struct sysstat st = { .magic = SYSSTAT_MAGIC,
+                          .version = SYSSTAT_VERSION,
+                          .hdr_size = sizeof(struct sysstat),
+                          .blk_size = sizeof(struct sysstat_blk),
+                          .nr_blk = __sysstat_nr_blk(),
+                          .systime = clock_systime(),
+                          .unixtime = clock_unixtime() };
+
+    for (int i = 0; i < PM_NR_ZONES; i++) {
+        struct pm_zone* zone = pmm_zone(i);
+        st.pm_managed += zone->managed;
+        st.pm_free += zone->free_pages;
+    }
+
+    u32_t pages, max, dirty;
+    pcache_get_stat(&pages, &max, &dirty);
+    st.pc_pages = pages;
+    st.pc_max = max;
+    st.pc_dirty = dirty;
+
+    twimap_memappend(map, &st, sizeof(st));
+}
+
+static void
+__sysstat_rd_blk(struct twimap* map, struct block_dev* bdev)
+{
+    // 分区另有一份统计，设备本身的统计由其blkio上下文负责
+    struct blkio_stats* stats =
+      bdev->stats ? bdev->stats : &bdev->blkio->stats;
+    struct sysstat_blk blk = { .rd_ios = stats->rd_ios,
+                               .wr_ios = stats->wr_ios,
+                               .rd_blocks = stats->rd_blocks,
+                               .wr_blocks = stats->wr_blocks,
+                               .errors = stats->errors,
+                               .merges = stats->merges,
+                               .flushes = stats->flushes,
+                               .discards = stats->discards,
+                               .in_flight = bdev->blkio->busy,
+                               .queued = bdev->blkio->queued };
+
+    strncpy(blk.id, bdev->bdev_id, SYSSTAT_BLKID_LEN - 1);
+
+    twimap_memappend(map, &blk, sizeof(blk));
+}
+
+static void
+__sysstat_read(struct twimap* map)
+{
+    // 第 0 条为头部，其后每条对应一个块设备
+    int index = twimap_index(map, int);
+    struct block_dev* bdev;
+
+    if (!index) {
+        __sysstat_rd_header(map);
+    } else if ((bdev = block_dev_at(index - 1))) {
+        __sysstat_rd_blk(map, bdev);
+    }
+}
+
+static int
+__sysstat_next(struct twimap* map)
+{
+    int index = twimap_index(map, int);
+    if (!block_dev_at(index)) {
+        return 0;
+    }
+    map->index = (void*)(index + 1);
+    return 1;
+}
+
+void
+sysstat_export()
+{
+    struct twimap* map = twifs_mapping(NULL, NULL, "sysstat");
+    map->read = __sysstat_read;
+    map->go_next = __sysstat_next;
+}
@@ -1,19 +1,14 @@
+#include <hal/cpu.h>
 #include <hal/rtc.h>
 #include <lunaix/clock.h>
 #include <lunaix/fs/twifs.h>
 #include <lunaix/spike.h>
 #include <lunaix/timer.h>
 
-static volatile time_t sys_time;
-
-void
-clock_systime_counter(void* arg);
-
 void
 __clock_read_systime(struct twimap* map)
 {
-    time_t save = sys_time;
-    twimap_printf(map, "%u", save);
+    twimap_printf(map, "%u", clock_systime());
 }
 
 void
@@ -62,18 +57,9 @@ clock_init()
         panick("Systimer not initialized");
     }
 
-    // 系统计时器每毫秒累加。
-    timer_run_ms(1, clock_systime_counter, NULL, TIMER_MODE_PERIODIC);
-
     clock_build_mapping();
 }
 
-void
-clock_systime_counter(void* arg)
-{
-    sys_time++;
-}
-
 int
 clock_datatime_eq(datetime_t* a, datetime_t* b)
 {
@@ -129,8 +115,32 @@ clock_unixtime()
     return clock_tounixtime(&dt);
 }
 
+#define NS_PER_SEC 1000000000ULL
+
+u64_t
+clock_systime_ns()
+{
+    struct lx_timer_context* ctx = timer_context();
+
+    if (!ctx || !ctx->running_frequency) {
+        return 0;
+    }
+
+    // 系统时间由时钟源折算，而无需每毫秒一次的定时器。
+    //  后者会使空闲时的时钟中断无法被推迟
+    if (ctx->tsc_frequency) {
+        u64_t freq = ctx->tsc_frequency;
+        u64_t elapsed = cpu_rdtsc() - ctx->tsc_base;
+
+        // 分开计算秒与余数，以免乘法溢出
+        return elapsed / freq * NS_PER_SEC + elapsed % freq * NS_PER_SEC / freq;
+    }
+
+    return (u64_t)ctx->ticks * NS_PER_SEC / ctx->running_frequency;
+}
+
 time_t
 clock_systime()
 {
-    return sys_time;
+    return (time_t)(clock_systime_ns() / 1000000);
 }
\ No newline at end of file
@@ -0,0 +1,270 @@
+/**
+ * @file itimer.c
+ * @brief POSIX风格的时钟读取与进程间隔定时器，构建于系统定时器（lx_timer）之上
+ *
+ * 定时器以时钟周期为精度（SYS_TIMER_FREQUENCY_HZ），到期时间总是向上取整，
+ * 以保证不会提前到期。
+ *
+ */
+#include <lunaix/clock.h>
+#include <lunaix/mm/uaccess.h>
+#include <lunaix/process.h>
+#include <lunaix/signal.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/syscall.h>
+#include <lunaix/time.h>
+#include <lunaix/timer.h>
+
+static inline int
+__timespec_valid(const struct timespec* ts)
+{
+    return ts->tv_nsec >= 0 && ts->tv_nsec < NSEC_PER_SEC;
+}
+
+static inline u64_t
+__timespec_ns(const struct timespec* ts)
+{
+    return (u64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static inline void
+__ns_timespec(u64_t ns, struct timespec* ts)
+{
+    ts->tv_sec = (time_t)(ns / NSEC_PER_SEC);
+    ts->tv_nsec = (long)(ns % NSEC_PER_SEC);
+}
+
+static u64_t
+__clock_now_ns(clockid_t clockid)
+{
+    if (clockid == CLOCK_REALTIME) {
+        return (u64_t)clock_unixtime() * NSEC_PER_SEC;
+    }
+    return clock_systime_ns();
+}
+
+static struct proc_timer*
+__get_timer(timer_t timerid)
+{
+    if (timerid < 0 || timerid >= PROC_TIMER_MAX) {
+        return NULL;
+    }
+
+    struct proc_timer* t = &__current->timers[timerid];
+    return t->signum ? t : NULL;
+}
+
+static void
+__disarm(struct proc_timer* t)
+{
+    if (t->timer) {
+        timer_cancel(t->timer);
+        t->timer = NULL;
+    }
+}
+
+// 于时钟中断中执行
+static void
+__timer_expired(void* payload)
+{
+    struct proc_timer* t = (struct proc_timer*)payload;
+
+    __SIGSET(t->owner->sig_pending, t->signum);
+
+    if (t->interval) {
+        // 首次到期后，改以间隔重新装填（见 __timer_tick）
+        t->timer->deadline = t->interval;
+    } else {
+        // 一次性定时器在回调返回后即被释放
+        t->timer = NULL;
+    }
+}
+
+static void
+__timer_current(struct proc_timer* t, struct itimerspec* spec)
+{
+    ticks_t left = 0;
+    if (t->timer) {
+        left = t->timer->expires - timer_context()->ticks;
+    }
+
+    __ns_timespec(timer_ticks_to_ns(left), &spec->it_value);
+    __ns_timespec(timer_ticks_to_ns(t->interval), &spec->it_interval);
+}
+
+void
+proc_release_timers(struct proc_info* proc)
+{
+    for (int i = 0; i < PROC_TIMER_MAX; i++) {
+        struct proc_timer* t = &proc->timers[i];
+        __disarm(t);
+        t->signum = 0;
+    }
+}
+
+__DEFINE_LXSYSCALL2(int,
+                    clock_gettime,
+                    clockid_t,
+                    clockid,
+                    struct timespec*,
+                    tp)
+{
+    if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    struct timespec ts;
+    __ns_timespec(__clock_now_ns(clockid), &ts);
+
+    if (copy_to_user(tp, &ts, sizeof(ts))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
+    return 0;
+}
+
+__DEFINE_LXSYSCALL3(int,
+                    timer_create,
+                    clockid_t,
+                    clockid,
+                    int,
+                    signum,
+                    timer_t*,
+                    timerid)
+{
+    if ((clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC) ||
+        signum <= 0 || signum >= _SIG_NUM) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    timer_t id = 0;
+    for (; id < PROC_TIMER_MAX && __current->timers[id].signum; id++)
+        ;
+
+    if (id == PROC_TIMER_MAX) {
+        __current->k_status = EAGAIN;
+        return -1;
+    }
+
+    if (copy_to_user(timerid, &id, sizeof(timer_t))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
+    __current->timers[id] = (struct proc_timer){
+        .owner = (struct proc_info*)__current,
+        .signum = signum,
+        .clockid = clockid,
+    };
+
+    return 0;
+}
+
+__DEFINE_LXSYSCALL4(int,
+                    timer_settime,
+                    timer_t,
+                    timerid,
+                    int,
+                    flags,
+                    const struct itimerspec*,
+                    value,
+                    struct itimerspec*,
+                    ovalue)
+{
+    struct proc_timer* t = __get_timer(timerid);
+    if (!t) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    struct itimerspec spec;
+    if (copy_from_user(&spec, value, sizeof(spec))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
+    if (!__timespec_valid(&spec.it_value) ||
+        !__timespec_valid(&spec.it_interval)) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    if (ovalue) {
+        struct itimerspec old;
+        __timer_current(t, &old);
+        if (copy_to_user(ovalue, &old, sizeof(old))) {
+            __current->k_status = EFAULT;
+            return -1;
+        }
+    }
+
+    __disarm(t);
+    t->interval = 0;
+
+    u64_t delay = __timespec_ns(&spec.it_value);
+    if (!delay) {
+        return 0;
+    }
+
+    if ((flags & TIMER_ABSTIME)) {
+        // 已过期的绝对时刻于下一个时钟周期到期
+        u64_t now = __clock_now_ns(t->clockid);
+        delay = delay > now ? delay - now : 0;
+    }
+
+    t->interval = timer_ns_to_ticks(__timespec_ns(&spec.it_interval));
+    t->timer = timer_run(timer_ns_to_ticks(delay),
+                         __timer_expired,
+                         t,
+                         t->interval ? TIMER_MODE_PERIODIC : 0);
+
+    if (!t->timer) {
+        t->interval = 0;
+        __current->k_status = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+__DEFINE_LXSYSCALL2(int,
+                    timer_gettime,
+                    timer_t,
+                    timerid,
+                    struct itimerspec*,
+                    value)
+{
+    struct proc_timer* t = __get_timer(timerid);
+    if (!t) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    struct itimerspec spec;
+    __timer_current(t, &spec);
+
+    if (copy_to_user(value, &spec, sizeof(spec))) {
+        __current->k_status = EFAULT;
+        return -1;
+    }
+
+    return 0;
+}
+
+__DEFINE_LXSYSCALL1(int, timer_delete, timer_t, timerid)
+{
+    struct proc_timer* t = __get_timer(timerid);
+    if (!t) {
+        __current->k_status = EINVAL;
+        return -1;
+    }
+
+    __disarm(t);
+    t->signum = 0;
+
+    return 0;
+}
@@ -10,12 +10,18 @@
  *
  */
 #include <arch/x86/interrupts.h>
+#include <cpuid.h>
 #include <hal/apic.h>
+#include <hal/cpu.h>
+#include <hal/io.h>
+#include <hal/pit.h>
 #include <hal/rtc.h>
 
+#include <lunaix/event.h>
 #include <lunaix/isrm.h>
 #include <lunaix/mm/cake.h>
 #include <lunaix/mm/valloc.h>
+#include <lunaix/profiler.h>
 #include <lunaix/sched.h>
 #include <lunaix/spike.h>
 #include <lunaix/syslog.h>
@@ -23,6 +29,8 @@
 
 #include <hal/acpi/acpi.h>
 
+#include <klibc/string.h>
+
 #define LVT_ENTRY_TIMER(vector, mode) (LVT_DELIVERY_FIXED | mode | vector)
 
 LOG_MODULE("TIMER");
@@ -36,6 +44,9 @@ temp_intr_routine_apic_timer(const isr_param* param);
 static void
 timer_update(const isr_param* param);
 
+static void
+__timer_tsc_arm(u64_t deadline);
+
 static volatile struct lx_timer_context* timer_ctx = NULL;
 
 // Don't optimize them! Took me an half hour to figure that out...
@@ -48,8 +59,31 @@ static volatile u32_t sched_ticks_counter = 0;
 
 static struct cake_pile* timer_pile;
 
+extern struct scheduler sched_ctx;
+
+static u32_t timer_iv;
+
+// Ticks the armed one-shot stands for, zero while running periodically
+static volatile ticks_t oneshot_ticks = 0;
+static volatile u32_t oneshot_count = 0;
+
+// TSC-deadline mode, where each tick is armed at an absolute TSC value
+static int tsc_deadline = 0;
+static u64_t tsc_per_tick;
+static u64_t next_tick_tsc;
+
+static volatile u64_t tsc_calibration;
+
 #define APIC_CALIBRATION_CONST 0x100000
 
+// Length of the PIT gated calibration window
+#define PIT_CALIBRATION_MS 10
+// Give up on a PIT whose output never rises, each poll is an I/O port read
+#define PIT_CALIBRATION_SPINS (1 << 22)
+
+// The APIC timer counts the bus clock divided by this
+#define APIC_TIMER_DIVIDER 64
+
 void
 timer_init_context()
 {
@@ -59,19 +93,198 @@ timer_init_context()
 
     assert_msg(timer_ctx, "Fail to initialize timer contex");
 
-    timer_ctx->active_timers = (struct lx_timer*)cake_grab(timer_pile);
-    llist_init_head(&timer_ctx->active_timers->link);
+    timer_ctx->ticks = 0;
+
+    for (int i = 0; i < TIMER_WHEEL0_SIZE; i++) {
+        llist_init_head(&timer_ctx->wheel0[i]);
+    }
+
+    for (int l = 0; l < TIMER_WHEEL_LEVELS - 1; l++) {
+        for (int i = 0; i < TIMER_WHEELN_SIZE; i++) {
+            llist_init_head(&timer_ctx->wheels[l][i]);
+        }
+    }
 }
 
-void
-timer_init(u32_t frequency)
+#define WHEEL_SHIFT(level) (TIMER_WHEEL0_BITS + (level)*TIMER_WHEELN_BITS)
+#define WHEEL_INDEX(t, level)                                                  \
+    (((t) >> WHEEL_SHIFT(level)) & (TIMER_WHEELN_SIZE - 1))
+
+static void
+__timer_enqueue(struct lx_timer* timer)
 {
-    timer_init_context();
+    ticks_t expires = timer->expires;
+    int delta = (int)(expires - timer_ctx->ticks);
+    struct llist_header* bucket;
+
+    if (delta < 0) {
+        // overdue, fire it on the next tick
+        ticks_t next = timer_ctx->ticks + 1;
+        bucket = &timer_ctx->wheel0[next & (TIMER_WHEEL0_SIZE - 1)];
+    } else if (delta < TIMER_WHEEL0_SIZE) {
+        bucket = &timer_ctx->wheel0[expires & (TIMER_WHEEL0_SIZE - 1)];
+    } else {
+        if ((u32_t)delta >= TIMER_WHEEL_SPAN) {
+            // too far ahead, park it at the outmost edge and let cascading
+            //  bring it back in when the wheel gets closer
+            expires = timer_ctx->ticks + TIMER_WHEEL_SPAN - 1;
+            delta = TIMER_WHEEL_SPAN - 1;
+        }
 
-    cpu_disable_interrupt();
+        int level = 0;
+        while ((u32_t)delta >= (1U << WHEEL_SHIFT(level + 1))) {
+            level++;
+        }
+
+        bucket = &timer_ctx->wheels[level][WHEEL_INDEX(expires, level)];
+    }
+
+    llist_append(bucket, &timer->link);
+}
+
+/**
+ * @brief Redistribute a bucket of an upper level into lower levels
+ *
+ * @return int the index of the bucket, zero means the next level is due too
+ */
+static int
+__timer_cascade(int level)
+{
+    int index = WHEEL_INDEX(timer_ctx->ticks, level);
+    struct llist_header* bucket = &timer_ctx->wheels[level][index];
+    struct lx_timer *pos, *n;
+
+    llist_for_each(pos, n, bucket, link)
+    {
+        llist_delete(&pos->link);
+        __timer_enqueue(pos);
+    }
+
+    return index;
+}
+
+/**
+ * @brief Take the frequencies from CPUID, when enumerated by the hypervisor
+ * (leaf 0x40000010) or by an Intel CPU on bare metal (leaf 0x15/0x16).
+ *
+ * @return int 1 if the APIC timer frequency was found
+ */
+static int
+__timer_calibrate_cpuid(u64_t* tsc_freq)
+{
+    reg32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    char vendor[13];
+
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    if ((ecx & (1 << 31))) {
+        // Hypervisor timing leaf (VMware; KVM with vmware-cpuid-freq):
+        //  EAX = TSC frequency, EBX = APIC bus frequency, both in kHz
+        __cpuid(0x40000000, eax, ebx, ecx, edx);
+        if (eax < 0x40000010) {
+            return 0;
+        }
+
+        __cpuid(0x40000010, eax, ebx, ecx, edx);
+        if (!ebx) {
+            return 0;
+        }
+
+        *tsc_freq = (u64_t)eax * 1000;
+        timer_ctx->base_frequency =
+          (u64_t)ebx * 1000 / APIC_TIMER_DIVIDER;
+        return 1;
+    }
+
+    // Leaf 0x15 of a VM may well be the host's, while its APIC timer runs
+    //  at whatever the hypervisor emulates, so only trust it on bare metal.
+    cpu_get_model(vendor);
+    if (memcmp(vendor, "GenuineIntel", 12) || __get_cpuid_max(0, 0) < 0x15) {
+        return 0;
+    }
+
+    // reference: Intel manual, section 19.7.3
+    __cpuid(0x15, eax, ebx, ecx, edx);
+    if (!eax || !ebx) {
+        return 0;
+    }
+
+    u32_t denominator = eax, numerator = ebx;
+    u64_t crystal = ecx;
+
+    if (!crystal) {
+        // Crystal not enumerated, derive it from the base frequency (MHz)
+        if (__get_cpuid_max(0, 0) < 0x16) {
+            return 0;
+        }
+
+        __cpuid(0x16, eax, ebx, ecx, edx);
+        crystal = (u64_t)(eax & 0xffff) * 1000000 * denominator / numerator;
+        if (!crystal) {
+            return 0;
+        }
+    }
 
-    // Setup APIC timer
+    // The local APIC timer is clocked by the core crystal on these parts
+    *tsc_freq = crystal * numerator / denominator;
+    timer_ctx->base_frequency = crystal / APIC_TIMER_DIVIDER;
+    return 1;
+}
+
+/**
+ * @brief Count the APIC timer and the TSC over a PIT_CALIBRATION_MS window
+ * timed by PIT channel 2, polled with interrupts disabled.
+ *
+ * @return int 1 if the PIT responded
+ */
+static int
+__timer_calibrate_pit(u64_t* tsc_freq)
+{
+    u32_t latch = PIT_FREQUENCY / 1000 * PIT_CALIBRATION_MS;
+    u32_t spins = 0;
+
+    // gate channel 2 on, keep the speaker off
+    u8_t port_b = io_inb(PIT_PORT_B) & ~PIT_PORT_B_SPEAKER;
+    io_outb(PIT_PORT_B, port_b | PIT_PORT_B_GATE2);
+
+    // in mode 0 the output drops once programmed and rises at terminal count
+    io_outb(PIT_CMD, PIT_CMD_CH2_ONESHOT);
+    io_outb(PIT_CH2, latch & 0xff);
+    io_outb(PIT_CH2, (latch >> 8) & 0xff);
+
+    if ((io_inb(PIT_PORT_B) & PIT_PORT_B_OUT2)) {
+        // no PIT behind the port, the bus floats high
+        return 0;
+    }
+
+    apic_write_reg(APIC_TIMER_ICR, (u32_t)-1);
+    u64_t tsc = cpu_rdtsc();
+
+    while (!(io_inb(PIT_PORT_B) & PIT_PORT_B_OUT2)) {
+        if (++spins >= PIT_CALIBRATION_SPINS) {
+            apic_write_reg(APIC_TIMER_ICR, 0);
+            return 0;
+        }
+    }
+
+    u32_t apic_elapsed = (u32_t)-1 - apic_read_reg(APIC_TIMER_CCR);
+    tsc = cpu_rdtsc() - tsc;
 
+    apic_write_reg(APIC_TIMER_ICR, 0);
+
+    *tsc_freq = tsc * PIT_FREQUENCY / latch;
+    timer_ctx->base_frequency = (u64_t)apic_elapsed * PIT_FREQUENCY / latch;
+
+    return !!timer_ctx->base_frequency;
+}
+
+/**
+ * @brief Last resort, time a long APIC one-shot against the RTC
+ *
+ */
+static void
+__timer_calibrate_rtc(u64_t* tsc_freq)
+{
     // Remap the IRQ 8 (rtc timer's vector) to RTC_TIMER_IV in ioapic
     //       (Remarks IRQ 8 is pin INTIN8)
     //       See IBM PC/AT Technical Reference 1-10 for old RTC IRQ
@@ -87,9 +300,6 @@ timer_init(u32_t frequency)
     apic_write_reg(APIC_TIMER_LVT,
                    LVT_ENTRY_TIMER(iv_timer, LVT_TIMER_ONESHOT));
 
-    // Set divider to 64
-    apic_write_reg(APIC_TIMER_DCR, APIC_TIMER_DIV64);
-
     /*
         Timer calibration process - measure the APIC timer base frequency
 
@@ -113,41 +323,99 @@ timer_init(u32_t frequency)
 
     */
 
-#ifdef __LUNAIXOS_DEBUG__
-    if (frequency < 1000) {
-        kprintf(KWARN "Frequency too low. Millisecond timer might be dodgy.");
-    }
-#endif
-
-    timer_ctx->base_frequency = 0;
     rtc_counter = 0;
     apic_timer_done = 0;
 
     rtc_enable_timer();                                     // start RTC timer
     apic_write_reg(APIC_TIMER_ICR, APIC_CALIBRATION_CONST); // start APIC timer
+    tsc_calibration = cpu_rdtsc();
 
     // enable interrupt, just for our RTC start ticking!
     cpu_enable_interrupt();
 
     wait_until(apic_timer_done);
 
+    // The TSC elapsed over the same k RTC ticks, so F_tsc = d / k * 1024
+    *tsc_freq = tsc_calibration * RTC_TIMER_BASE_FREQUENCY / rtc_counter;
+
+    // cleanup
+    isrm_ivfree(iv_timer);
+    isrm_ivfree(iv_rtc);
+}
+
+void
+timer_init(u32_t frequency)
+{
+    const char* source;
+    u64_t tsc_freq = 0;
+
+    timer_init_context();
+
+    cpu_disable_interrupt();
+
+#ifdef __LUNAIXOS_DEBUG__
+    if (frequency < 1000) {
+        kprintf(KWARN "Frequency too low. Millisecond timer might be dodgy.");
+    }
+#endif
+
+    // Measure the APIC timer base frequency, cheapest source first. The
+    //  one-shot stays masked unless the RTC method needs its interrupt.
+    apic_write_reg(APIC_TIMER_LVT, LVT_MASKED | LVT_TIMER_ONESHOT);
+
+    // Set divider to 64
+    apic_write_reg(APIC_TIMER_DCR, APIC_TIMER_DIV64);
+
+    timer_ctx->base_frequency = 0;
+
+    if (__timer_calibrate_cpuid(&tsc_freq)) {
+        source = "cpuid";
+    } else if (__timer_calibrate_pit(&tsc_freq)) {
+        source = "pit";
+    } else {
+        __timer_calibrate_rtc(&tsc_freq);
+        source = "rtc";
+    }
+
+    // interrupts stay on from here, as the RTC method leaves them
+    cpu_enable_interrupt();
+
     assert_msg(timer_ctx->base_frequency, "Fail to initialize timer (NOFREQ)");
 
-    kprintf(
-      KINFO "hw: %u Hz; os: %u Hz\n", timer_ctx->base_frequency, frequency);
+    kprintf(KINFO "hw: %u Hz; os: %u Hz (%s)\n",
+            timer_ctx->base_frequency,
+            frequency,
+            source);
 
     timer_ctx->running_frequency = frequency;
     timer_ctx->tphz = timer_ctx->base_frequency / frequency;
 
-    // cleanup
-    isrm_ivfree(iv_timer);
-    isrm_ivfree(iv_rtc);
+    timer_ctx->tsc_frequency = 0;
+    if (tsc_freq && cpu_has_invariant_tsc()) {
+        timer_ctx->tsc_frequency = tsc_freq;
+        kprintf(KINFO "tsc: %u kHz\n",
+                (u32_t)(timer_ctx->tsc_frequency / 1000));
+    }
 
-    apic_write_reg(
-      APIC_TIMER_LVT,
-      LVT_ENTRY_TIMER(isrm_ivexalloc(timer_update), LVT_TIMER_PERIODIC));
+    timer_iv = isrm_ivexalloc(timer_update);
 
-    apic_write_reg(APIC_TIMER_ICR, timer_ctx->tphz);
+    tsc_per_tick = timer_ctx->tsc_frequency / frequency;
+    tsc_deadline = tsc_per_tick && cpu_has_tsc_deadline();
+
+    if (tsc_deadline) {
+        apic_write_reg(APIC_TIMER_LVT,
+                       LVT_ENTRY_TIMER(timer_iv, LVT_TIMER_TSC_DEADLINE));
+
+        timer_ctx->tsc_base = cpu_rdtsc();
+        next_tick_tsc = timer_ctx->tsc_base + tsc_per_tick;
+        __timer_tsc_arm(next_tick_tsc);
+    } else {
+        apic_write_reg(APIC_TIMER_LVT,
+                       LVT_ENTRY_TIMER(timer_iv, LVT_TIMER_PERIODIC));
+
+        apic_write_reg(APIC_TIMER_ICR, timer_ctx->tphz);
+        timer_ctx->tsc_base = cpu_rdtsc();
+    }
 
     sched_ticks = timer_ctx->running_frequency / 1000 * SCHED_TIME_SLICE;
     sched_ticks_counter = 0;
@@ -175,6 +443,39 @@ timer_run_ms(u32_t millisecond,
                      flags);
 }
 
+static void
+__timer_signal(void* payload)
+{
+    event_signal((struct lx_event*)payload);
+}
+
+struct lx_timer*
+timer_signal_ms(u32_t millisecond, struct lx_event* evt, uint8_t flags)
+{
+    return timer_run_ms(millisecond, __timer_signal, evt, flags);
+}
+
+#define NS_PER_SEC 1000000000ULL
+
+ticks_t
+timer_ns_to_ticks(u64_t ns)
+{
+    u64_t freq = timer_ctx->running_frequency;
+
+    // Round up, a timer must never fire early. Seconds and the remainder are
+    //  scaled apart to keep the product from overflowing
+    u64_t ticks = ns / NS_PER_SEC * freq +
+                  (ns % NS_PER_SEC * freq + NS_PER_SEC - 1) / NS_PER_SEC;
+
+    return (ticks_t)MIN(ticks, (u64_t)TIMER_TICKS_MAX);
+}
+
+u64_t
+timer_ticks_to_ns(ticks_t ticks)
+{
+    return (u64_t)ticks * NS_PER_SEC / timer_ctx->running_frequency;
+}
+
 struct lx_timer*
 timer_run(ticks_t ticks, void (*callback)(void*), void* payload, uint8_t flags)
 {
@@ -183,45 +484,240 @@ timer_run(ticks_t ticks, void (*callback)(void*), void* payload, uint8_t flags)
     if (!timer)
         return NULL;
 
+    ticks = MAX(ticks, 1);
+
     timer->callback = callback;
-    timer->counter = ticks;
     timer->deadline = ticks;
+    timer->expires = timer_ctx->ticks + ticks;
     timer->payload = payload;
     timer->flags = flags;
 
-    llist_append(&timer_ctx->active_timers->link, &timer->link);
+    __timer_enqueue(timer);
 
     return timer;
 }
 
+void
+timer_cancel(struct lx_timer* timer)
+{
+    llist_delete(&timer->link);
+    cake_release(timer_pile, timer);
+}
+
 static void
-timer_update(const isr_param* param)
+__timer_tick()
 {
-    struct lx_timer *pos, *n;
-    struct lx_timer* timer_list_head = timer_ctx->active_timers;
+    ticks_t now = ++timer_ctx->ticks;
+    int index = now & (TIMER_WHEEL0_SIZE - 1);
 
-    llist_for_each(pos, n, &timer_list_head->link, link)
-    {
-        if (--(pos->counter)) {
-            continue;
-        }
+    if (!index) {
+        for (int l = 0; l < TIMER_WHEEL_LEVELS - 1 && !__timer_cascade(l); l++)
+            ;
+    }
+
+    // Detach the due bucket first, so callbacks are free to arm new timers
+    //  or cancel others without disturbing the walk
+    struct llist_header due;
+    struct llist_header* bucket = &timer_ctx->wheel0[index];
+
+    llist_init_head(&due);
+    if (!llist_empty(bucket)) {
+        due.next = bucket->next;
+        due.prev = bucket->prev;
+        due.next->prev = &due;
+        due.prev->next = &due;
+        llist_init_head(bucket);
+    }
+
+    while (!llist_empty(&due)) {
+        struct lx_timer* pos = list_entry(due.next, struct lx_timer, link);
+        llist_delete(&pos->link);
 
         pos->callback ? pos->callback(pos->payload) : 1;
 
         if ((pos->flags & TIMER_MODE_PERIODIC)) {
-            pos->counter = pos->deadline;
+            pos->expires += pos->deadline;
+            __timer_enqueue(pos);
         } else {
-            llist_delete(&pos->link);
             cake_release(timer_pile, pos);
         }
     }
+}
+
+/**
+ * @brief Ticks until the next bucket that needs serving, either a non-empty
+ * one or the wrap of the first level, where upper levels cascade.
+ *
+ */
+static ticks_t
+__timer_next_event()
+{
+    ticks_t now = timer_ctx->ticks;
+    ticks_t d = 1;
+
+    for (; d < TIMER_WHEEL0_SIZE; d++) {
+        int index = (now + d) & (TIMER_WHEEL0_SIZE - 1);
+        if (!index || !llist_empty(&timer_ctx->wheel0[index])) {
+            break;
+        }
+    }
+
+    return d;
+}
+
+static void
+__timer_oneshot(u32_t count, ticks_t ticks)
+{
+    oneshot_ticks = ticks;
+    oneshot_count = count;
+
+    apic_write_reg(APIC_TIMER_LVT,
+                   LVT_ENTRY_TIMER(timer_iv, LVT_TIMER_ONESHOT));
+    apic_write_reg(APIC_TIMER_ICR, count);
+}
+
+static void
+__timer_periodic()
+{
+    oneshot_ticks = 0;
+
+    apic_write_reg(APIC_TIMER_LVT,
+                   LVT_ENTRY_TIMER(timer_iv, LVT_TIMER_PERIODIC));
+    apic_write_reg(APIC_TIMER_ICR, timer_ctx->tphz);
+}
+
+static void
+__timer_tsc_arm(u64_t deadline)
+{
+    cpu_wrmsr(IA32_MSR_TSC_DEADLINE, (u32_t)(deadline >> 32), (u32_t)deadline);
+}
+
+/**
+ * @brief Run every tick whose boundary the TSC has passed
+ *
+ * @return ticks_t number of ticks run
+ */
+static ticks_t
+__timer_tsc_catchup()
+{
+    u64_t now = cpu_rdtsc();
+    ticks_t ticks = 0;
+
+    while (next_tick_tsc <= now) {
+        __timer_tick();
+        next_tick_tsc += tsc_per_tick;
+        ticks++;
+    }
+
+    return ticks;
+}
+
+ticks_t
+timer_idle_enter()
+{
+    if (!timer_ctx || !timer_ctx->tphz) {
+        return 0;
+    }
+
+    ticks_t ticks = __timer_next_event();
+
+    if (oneshot_ticks) {
+        return ticks;
+    }
+
+    if (tsc_deadline) {
+        if (ticks > 1) {
+            oneshot_ticks = ticks;
+            __timer_tsc_arm(next_tick_tsc + (ticks - 1) * tsc_per_tick);
+        }
+        return ticks;
+    }
+    u32_t remain = apic_read_reg(APIC_TIMER_CCR);
+
+    // nothing to skip, or the tick is already pending
+    if (ticks <= 1 || !remain) {
+        return remain ? 1 : 0;
+    }
+
+    // The current period is carried over, so the tick boundaries stay put
+    __timer_oneshot(remain + (ticks - 1) * timer_ctx->tphz, ticks);
+    return ticks;
+}
+
+void
+timer_idle_exit()
+{
+    if (!oneshot_ticks) {
+        return;
+    }
+
+    if (tsc_deadline) {
+        oneshot_ticks = 0;
+        __timer_tsc_catchup();
+        __timer_tsc_arm(next_tick_tsc);
+        return;
+    }
+
+    u32_t remain = apic_read_reg(APIC_TIMER_CCR);
+
+    // already expired, let the pending interrupt do the bookkeeping
+    if (!remain) {
+        return;
+    }
+
+    u32_t tphz = timer_ctx->tphz;
+    u32_t elapsed = oneshot_count - remain;
+    u32_t first = oneshot_count - (oneshot_ticks - 1) * tphz;
+
+    ticks_t passed = 0;
+    u32_t next = first - elapsed;
+
+    if (elapsed >= first) {
+        passed = 1 + (elapsed - first) / tphz;
+        next = tphz - (elapsed - first) % tphz;
+    }
+
+    // Run up to the last boundary passed, and one-shot to the next one, from
+    //  where the periodic tick takes over
+    __timer_oneshot(next, 1);
+
+    while (passed--) {
+        __timer_tick();
+    }
+}
+
+static void
+timer_update(const isr_param* param)
+{
+    ticks_t ticks = 1;
+
+    profiler_sample(param);
+
+    if (tsc_deadline) {
+        oneshot_ticks = 0;
+        ticks = __timer_tsc_catchup();
+        __timer_tsc_arm(next_tick_tsc);
+    } else {
+        if (oneshot_ticks) {
+            ticks = oneshot_ticks;
+            __timer_periodic();
+        }
+
+        for (ticks_t i = 0; i < ticks; i++) {
+            __timer_tick();
+        }
+    }
+
+    sched_account_ticks(param->cs & 0x3, ticks);
 
-    sched_ticks_counter++;
+    sched_ticks_counter += ticks;
 
     if (sched_ticks_counter >= sched_ticks) {
         sched_ticks_counter = 0;
-        schedule();
+        sched_ctx.need_resched = 1;
     }
+
+    sched_preempt();
 }
 
 static void
@@ -237,6 +733,7 @@ temp_intr_routine_rtc_tick(const isr_param* param)
 static void
 temp_intr_routine_apic_timer(const isr_param* param)
 {
+    tsc_calibration = cpu_rdtsc() - tsc_calibration;
     timer_ctx->base_frequency =
       APIC_CALIBRATION_CONST / rtc_counter * RTC_TIMER_BASE_FREQUENCY;
     apic_timer_done = 1;
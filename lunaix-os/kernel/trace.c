@@ -0,0 +1,221 @@
+/**
+ * @file trace.c
+ * @brief 静态跟踪点的事件记录与读取，见 lunaix/trace.h
+ *
+ */
+#include <hal/cpu.h>
+#include <klibc/string.h>
+#include <lunaix/device.h>
+#include <lunaix/fs.h>
+#include <lunaix/fs/twifs.h>
+#include <lunaix/mm/valloc.h>
+#include <lunaix/percpu.h>
+#include <lunaix/process.h>
+#include <lunaix/spike.h>
+#include <lunaix/status.h>
+#include <lunaix/trace.h>
+
+#ifdef LUNAIX_TRACEPOINTS
+
+struct trace_ring
+{
+    u32_t head;
+    struct trace_event events[TRACE_NR_EVENTS];
+};
+
+// 每次打开各自的读取位置
+struct trace_cursor
+{
+    u32_t next[SMP_MAX_CPU];
+};
+
+static const char* tp_names[TP_NR] = {
+    [TP_SCHED_SWITCH] = "sched_switch",
+    [TP_PAGE_FAULT] = "page_fault",
+    [TP_CAKE_GRAB] = "cake_grab",
+    [TP_CAKE_RELEASE] = "cake_release",
+    [TP_BLKIO_COMMIT] = "blkio_commit",
+    [TP_BLKIO_COMPLETE] = "blkio_complete",
+    [TP_PCACHE_HIT] = "pcache_hit",
+    [TP_PCACHE_MISS] = "pcache_miss",
+    [TP_SYSCALL_ENTER] = "syscall_enter",
+    [TP_SYSCALL_EXIT] = "syscall_exit",
+};
+
+volatile u32_t trace_mask;
+
+static DEFINE_PERCPU(struct trace_ring*, trace_ring);
+
+void
+__tracepoint_record(u32_t id, u32_t a0, u32_t a1, u32_t a2)
+{
+    struct trace_ring* ring = this_cpu_read(trace_ring);
+    if (!ring) {
+        return;
+    }
+
+    // 记录可能被本处理器上的中断打断，而中断中亦可能有跟踪点
+    u32_t seq = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct trace_event* ev = &ring->events[seq & (TRACE_NR_EVENTS - 1)];
+
+    // 先使其失效，与之竞争的读者便会发现不一致
+    __atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    ev->id = id;
+    ev->cpu = smp_cpu_id();
+    ev->pid = __current ? __current->pid : 0;
+    ev->args[0] = a0;
+    ev->args[1] = a1;
+    ev->args[2] = a2;
+    ev->tsc = cpu_rdtsc();
+
+    __atomic_store_n(&ev->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 由 syscall_hndlr 于有系统调用的跟踪点开启时调用，代替直接调用 fn
+ *
+ */
+int
+trace_syscall(u32_t code,
+              int (*fn)(u32_t, u32_t, u32_t, u32_t, u32_t, u32_t),
+              u32_t a1,
+              u32_t a2,
+              u32_t a3,
+              u32_t a4,
+              u32_t a5,
+              u32_t a6)
+{
+    tracepoint(TP_SYSCALL_ENTER, code, a1, 0);
+
+    int retval = fn(a1, a2, a3, a4, a5, a6);
+
+    tracepoint(TP_SYSCALL_EXIT, code, retval, 0);
+
+    return retval;
+}
+
+static inline u32_t
+__trace_oldest(struct trace_ring* ring)
+{
+    u32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return head > TRACE_NR_EVENTS ? head - TRACE_NR_EVENTS : 0;
+}
+
+static int
+__trace_open(struct device* dev, struct v_file* file)
+{
+    struct trace_cursor* cur = vzalloc(sizeof(*cur));
+    if (!cur) {
+        return ENOMEM;
+    }
+
+    for (u32_t cpu = 0; cpu < percpu_nr_areas; cpu++) {
+        struct trace_ring* ring = *per_cpu_ptr(trace_ring, cpu);
+        cur->next[cpu] = ring ? __trace_oldest(ring) : 0;
+    }
+
+    file->data = cur;
+    return 0;
+}
+
+static void
+__trace_release(struct device* dev, struct v_file* file)
+{
+    vfree(file->data);
+}
+
+static int
+__trace_read(struct device* dev, struct v_file* file, void* buf, size_t len)
+{
+    struct trace_cursor* cur = file->data;
+    struct trace_event* out = (struct trace_event*)buf;
+    size_t nr = len / sizeof(struct trace_event);
+    size_t i = 0;
+
+    if (!nr) {
+        return ERANGE;
+    }
+
+    for (u32_t cpu = 0; cpu < percpu_nr_areas && i < nr; cpu++) {
+        struct trace_ring* ring = *per_cpu_ptr(trace_ring, cpu);
+        if (!ring) {
+            continue;
+        }
+
+        // 落后了整个环的事件已被覆盖，跳过
+        u32_t seq = MAX(cur->next[cpu], __trace_oldest(ring));
+        u32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        for (; seq != head && i < nr; seq++) {
+            struct trace_event* ev =
+              &ring->events[seq & (TRACE_NR_EVENTS - 1)];
+
+            if (__atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+                // 尚未写完，留待下一次读取
+                break;
+            }
+
+            out[i] = *ev;
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+            // 读取期间被覆盖则丢弃
+            if (__atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE) == seq + 1) {
+                i++;
+            }
+        }
+
+        cur->next[cpu] = seq;
+    }
+
+    return i * sizeof(struct trace_event);
+}
+
+static int
+__trace_write(struct device* dev, void* buf, foff_t offset, size_t len)
+{
+    if (len < sizeof(u32_t)) {
+        return EINVAL;
+    }
+
+    u32_t mask = *(u32_t*)buf & (TP_MASK(TP_NR) - 1);
+
+    // 环一经分配便不再释放，关闭后已记录的事件仍可读取
+    for (u32_t cpu = 0; mask && cpu < percpu_nr_areas; cpu++) {
+        struct trace_ring** ring = per_cpu_ptr(trace_ring, cpu);
+        if (!*ring && !(*ring = vzalloc(sizeof(struct trace_ring)))) {
+            return ENOMEM;
+        }
+    }
+
+    trace_mask = mask;
+    return len;
+}
+
+static void
+__trace_rd_points(struct twimap* map)
+{
+    for (u32_t i = 0; i < TP_NR; i++) {
+        twimap_printf(map,
+                      "%u %s %u\n",
+                      i,
+                      tp_names[i],
+                      !!(trace_mask & TP_MASK(i)));
+    }
+}
+
+void
+trace_init()
+{
+    struct device* dev = device_addseq(NULL, NULL, "trace");
+    dev->open = __trace_open;
+    dev->release = __trace_release;
+    dev->read_file = __trace_read;
+    dev->write = __trace_write;
+
+    struct twimap* map = twifs_mapping(NULL, NULL, "tracepoints");
+    map->read = __trace_rd_points;
+}
+
+#endif
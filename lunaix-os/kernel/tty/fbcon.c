@@ -0,0 +1,185 @@
+#include <klibc/string.h>
+#include <lunaix/mm/mmio.h>
+#include <lunaix/spike.h>
+#include <lunaix/tty/fbcon.h>
+
+extern const u8_t fbcon_font8x8[95][8];
+
+#define FBCON_ROW_PX (FBCON_GLYPH_W * FBCON_MAX_SCALE)
+
+/**
+ * @brief 某一配色下，字形每一行（8个像素，即一字节）所有可能图案对应的像素。
+ *  绘制时每行只需一次拷贝，而无须逐位判断
+ *
+ */
+struct fbcon_gcache
+{
+    u32_t color; // 字符单元的高字节（背景色 << 4 | 前景色）
+    int valid;
+    u32_t rows[256][FBCON_ROW_PX];
+};
+
+static struct
+{
+    u8_t* base;
+    u32_t pitch;
+    u32_t width;
+    u32_t height;
+    u32_t scale;
+    u32_t cell_w; // 像素
+    u32_t cell_h;
+    u32_t palette[16];
+} fb;
+
+static struct fbcon_gcache gcache[FBCON_GCACHE_NR];
+static int gcache_next = 0;
+
+// VGA 文本模式的 16 色，0xRRGGBB
+static const u32_t vga_rgb[16] = { 0x000000, 0x0000aa, 0x00aa00, 0x00aaaa,
+                                   0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+                                   0x555555, 0x5555ff, 0x55ff55, 0x55ffff,
+                                   0xff5555, 0xff55ff, 0xffff55, 0xffffff };
+
+static u32_t
+__fbcon_pack(multiboot_info_t* mb, u32_t rgb)
+{
+    u32_t r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+
+    return ((r >> (8 - mb->framebuffer_red_mask_size))
+            << mb->framebuffer_red_field_position) |
+           ((g >> (8 - mb->framebuffer_green_mask_size))
+            << mb->framebuffer_green_field_position) |
+           ((b >> (8 - mb->framebuffer_blue_mask_size))
+            << mb->framebuffer_blue_field_position);
+}
+
+static struct fbcon_gcache*
+__fbcon_gcache_get(u32_t color)
+{
+    for (int i = 0; i < FBCON_GCACHE_NR; i++) {
+        if (gcache[i].valid && gcache[i].color == color) {
+            return &gcache[i];
+        }
+    }
+
+    struct fbcon_gcache* gc = &gcache[gcache_next];
+    gcache_next = (gcache_next + 1) % FBCON_GCACHE_NR;
+
+    u32_t fg = fb.palette[color & 0xf], bg = fb.palette[(color >> 4) & 0xf];
+    for (int pat = 0; pat < 256; pat++) {
+        for (u32_t px = 0; px < fb.cell_w; px++) {
+            gc->rows[pat][px] = (pat >> (px / fb.scale)) & 1 ? fg : bg;
+        }
+    }
+
+    gc->color = color;
+    gc->valid = 1;
+
+    return gc;
+}
+
+static inline u8_t*
+__fbcon_cell_addr(int x, int y)
+{
+    return fb.base + y * fb.cell_h * fb.pitch + x * fb.cell_w * sizeof(u32_t);
+}
+
+static inline const u8_t*
+__fbcon_glyph(vga_attribute cell)
+{
+    u8_t chr = cell & 0xff;
+    if (chr < 0x20 || chr > 0x7e) {
+        chr = chr ? '?' : ' ';
+    }
+    return fbcon_font8x8[chr - 0x20];
+}
+
+static void
+__fbcon_draw_cell(int x, int y, vga_attribute cell, int cursor)
+{
+    struct fbcon_gcache* gc = __fbcon_gcache_get(cell >> 8);
+    const u8_t* glyph = __fbcon_glyph(cell);
+    u8_t* dst = __fbcon_cell_addr(x, y);
+    u32_t vrep = fb.cell_h / 8;
+    size_t row_sz = fb.cell_w * sizeof(u32_t);
+
+    for (int r = 0; r < 8; r++) {
+        // 光标为字符底部的一行下划线
+        u8_t pat = (cursor && r == 7) ? 0xff : glyph[r];
+        for (u32_t k = 0; k < vrep; k++) {
+            memcpy(dst, gc->rows[pat], row_sz);
+            dst += fb.pitch;
+        }
+    }
+}
+
+void
+fbcon_draw_cell(int x, int y, vga_attribute cell)
+{
+    __fbcon_draw_cell(x, y, cell, 0);
+}
+
+void
+fbcon_draw_cursor(int x, int y, vga_attribute cell)
+{
+    __fbcon_draw_cell(x, y, cell, 1);
+}
+
+void
+fbcon_draw_line(int y, vga_attribute* cells)
+{
+    for (int x = 0; x < TTY_WIDTH; x++) {
+        __fbcon_draw_cell(x, y, cells[x], 0);
+    }
+}
+
+void
+fbcon_scroll(int lines)
+{
+    size_t line_sz = fb.cell_h * fb.pitch;
+    memmove(fb.base, fb.base + lines * line_sz, (TTY_HEIGHT - lines) * line_sz);
+}
+
+int
+fbcon_init(multiboot_info_t* mb_info)
+{
+    if (!present(mb_info->flags, MULTIBOOT_INFO_FRAMEBUFFER_INFO) ||
+        mb_info->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB ||
+        mb_info->framebuffer_bpp != 32 ||
+        (mb_info->framebuffer_addr >> 32)) {
+        return 0;
+    }
+
+    u32_t width = mb_info->framebuffer_width;
+    u32_t height = mb_info->framebuffer_height;
+    u32_t scale = MIN(width / (TTY_WIDTH * FBCON_GLYPH_W),
+                      height / (TTY_HEIGHT * FBCON_GLYPH_H));
+
+    if (!scale) {
+        return 0;
+    }
+
+    u32_t size = mb_info->framebuffer_pitch * height;
+    // 写合并：逐行的像素写入被合并为整条总线事务
+    u8_t* base = ioremap_cached(
+      (uintptr_t)mb_info->framebuffer_addr, size, PG_CACHE_WC);
+    if (!base) {
+        return 0;
+    }
+
+    fb.base = base;
+    fb.pitch = mb_info->framebuffer_pitch;
+    fb.width = width;
+    fb.height = height;
+    fb.scale = MIN(scale, FBCON_MAX_SCALE);
+    fb.cell_w = FBCON_GLYPH_W * fb.scale;
+    fb.cell_h = FBCON_GLYPH_H * fb.scale;
+
+    for (int i = 0; i < 16; i++) {
+        fb.palette[i] = __fbcon_pack(mb_info, vga_rgb[i]);
+    }
+
+    memset(base, 0, size);
+
+    return 1;
+}
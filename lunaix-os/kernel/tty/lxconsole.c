@@ -3,52 +3,88 @@
 #include <lunaix/input.h>
 #include <lunaix/ioctl.h>
 #include <lunaix/keyboard.h>
+#include <lunaix/klog.h>
 #include <lunaix/lxconsole.h>
 #include <lunaix/mm/pmm.h>
 #include <lunaix/mm/valloc.h>
 #include <lunaix/mm/vmm.h>
+#include <lunaix/poll.h>
 #include <lunaix/sched.h>
 #include <lunaix/tty/console.h>
 #include <lunaix/tty/tty.h>
 
 #include <lunaix/lxsignal.h>
 
-static struct console lx_console;
+static struct console lx_consoles[CONSOLE_NR];
+// 当前可见的控制台，只有它会被渲染
+static struct console* lx_console = &lx_consoles[0];
+
+static struct lx_timer* flush_timer;
+static volatile int flush_deferred;
+
+// 由刷新定时器通告，刷新于系统工作队列中进行，而非定时器的中断上下文
+static struct lx_event flush_evt;
+static struct event_listener flush_listener;
 
 int
-__tty_write(struct device* dev, void* buf, size_t offset, size_t len);
+__tty_write(struct device* dev, void* buf, foff_t offset, size_t len);
 
 int
-__tty_read(struct device* dev, void* buf, size_t offset, size_t len);
+__tty_read(struct device* dev, void* buf, foff_t offset, size_t len);
 
 void
 console_flush();
 
-static waitq_t lx_reader;
-static volatile char ttychr;
+void
+console_write(struct console* console, const char* data, size_t size);
 
-static volatile pid_t fg_pgid = 0;
+static struct klog_sink console_sink;
 
 static inline void
-print_control_code(const char cntrl)
+print_control_code(struct console* console, const char cntrl)
 {
-    console_write_char('^');
-    console_write_char(cntrl + 64);
+    char code[2] = { '^', cntrl + 64 };
+    console_write(console, code, 2);
+}
+
+static void
+console_switch(int num)
+{
+    struct console* console = &lx_consoles[num];
+    if (console == lx_console) {
+        return;
+    }
+
+    mutex_lock(&console->output.lock);
+    lx_console = console;
+    console->output.flags |= FIFO_DIRTY;
+    mutex_unlock(&console->output.lock);
+
+    // 屏幕上是另一个控制台的内容，须整屏重绘
+    tty_invalidate();
+    console_flush();
 }
 
 int
 __lxconsole_listener(struct input_device* dev)
 {
+    struct console* console = lx_console;
     u32_t key = dev->current_pkt.sys_code;
     u32_t type = dev->current_pkt.pkt_type;
     kbd_kstate_t state = key >> 16;
-    ttychr = key & 0xff;
+    char ttychr = key & 0xff;
     key = key & 0xffff;
 
     if (type == PKT_RELEASE) {
         goto done;
     }
 
+    if ((state & (KBD_KEY_FLALT_HELD | KBD_KEY_FRALT_HELD)) &&
+        key >= KEY_F1 && key < KEY_F1 + CONSOLE_NR) {
+        console_switch(key - KEY_F1);
+        goto done;
+    }
+
     if ((state & KBD_KEY_FLCTRL_HELD)) {
         char cntrl = (char)(ttychr | 0x20);
         if ('a' > cntrl || cntrl > 'z') {
@@ -57,12 +93,12 @@ __lxconsole_listener(struct input_device* dev)
         ttychr = cntrl - 'a' + 1;
         switch (ttychr) {
             case TCINTR:
-                signal_send(-fg_pgid, _SIGINT);
-                print_control_code(ttychr);
+                signal_send(-console->fg_pgid, _SIGINT);
+                print_control_code(console, ttychr);
                 break;
             case TCSTOP:
-                signal_send(-fg_pgid, _SIGSTOP);
-                print_control_code(ttychr);
+                signal_send(-console->fg_pgid, _SIGSTOP);
+                print_control_code(console, ttychr);
                 break;
             default:
                 break;
@@ -79,7 +115,10 @@ __lxconsole_listener(struct input_device* dev)
         goto done;
     }
 
-    pwake_all(&lx_reader);
+    // 键入只送达可见的控制台，且每个字符只应交由一个读者处理
+    console->ttychr = ttychr;
+    console->ttychr_pending = 1;
+    event_signal_one(&console->typed);
 
 done:
     return INPUT_EVT_NEXT;
@@ -88,21 +127,26 @@ done:
 int
 __tty_exec_cmd(struct device* dev, u32_t req, va_list args)
 {
+    struct console* console = (struct console*)dev->underlay;
+
     switch (req) {
         case TIOCGPGRP:
-            return fg_pgid;
+            return console->fg_pgid;
         case TIOCSPGRP:
-            fg_pgid = va_arg(args, pid_t);
+            console->fg_pgid = va_arg(args, pid_t);
             break;
         case TIOCCLSBUF:
-            fifo_clear(&lx_console.output);
-            fifo_clear(&lx_console.input);
-            lx_console.wnd_start = 0;
-            lx_console.lines = 0;
-            lx_console.output.flags |= FIFO_DIRTY;
+            fifo_clear(&console->output);
+            fifo_clear(&console->input);
+            console->wnd_start = 0;
+            console->lines = 0;
+            console->output.flags |= FIFO_DIRTY;
+            if (console == lx_console) {
+                tty_invalidate();
+            }
             break;
         case TIOCFLUSH:
-            lx_console.output.flags |= FIFO_DIRTY;
+            console->output.flags |= FIFO_DIRTY;
             console_flush();
             break;
         default:
@@ -111,51 +155,93 @@ __tty_exec_cmd(struct device* dev, u32_t req, va_list args)
     return 0;
 }
 
+static void
+__console_sink_write(struct klog_sink* sink, const char* data, size_t len)
+{
+    console_write(&lx_consoles[0], data, len);
+}
+
 void
 lxconsole_init()
 {
-    memset(&lx_console, 0, sizeof(lx_console));
-    fifo_init(&lx_console.output, valloc(8192), 8192, 0);
-    fifo_init(&lx_console.input, valloc(4096), 4096, 0);
+    memset(lx_consoles, 0, sizeof(lx_consoles));
+    for (int i = 0; i < CONSOLE_NR; i++) {
+        struct console* console = &lx_consoles[i];
+        fifo_init(&console->output, valloc(8192), 8192, 0);
+        fifo_init(&console->input, valloc(4096), 4096, 0);
+        event_init(&console->typed);
+    }
 
-    lx_console.flush_timer = NULL;
+    flush_timer = NULL;
+    flush_deferred = 0;
+    event_init(&flush_evt);
+
+    // 内核日志经由此输出端呈现于控制台
+    console_sink.write = __console_sink_write;
+    klog_add_sink(&console_sink);
 }
 
 int
-__tty_write_pg(struct device* dev, void* buf, size_t offset)
+__tty_write_pg(struct device* dev, void* buf, foff_t offset)
 {
     return __tty_write(dev, buf, offset, PG_SIZE);
 }
 
 int
-__tty_read_pg(struct device* dev, void* buf, size_t offset)
+__tty_read_pg(struct device* dev, void* buf, foff_t offset)
 {
     return __tty_read(dev, buf, offset, PG_SIZE);
 }
 
-void
-lxconsole_spawn_ttydev()
+int
+__tty_poll(struct device* dev, struct poll_table* pt)
+{
+    struct console* console = (struct console*)dev->underlay;
+
+    poll_wait(pt, &console->typed.waiters);
+
+    // 输入缓冲中剩余的行，或是一个新近键入的字符
+    int mask = POLLOUT;
+    if (console->input.free_len < console->input.size ||
+        console->ttychr_pending) {
+        mask |= POLLIN;
+    }
+
+    return mask;
+}
+
+static void
+__tty_setup_dev(struct device* tty_dev)
 {
-    struct device* tty_dev = device_addseq(NULL, &lx_console, "tty");
     tty_dev->write = __tty_write;
     tty_dev->write_page = __tty_write_pg;
     tty_dev->read = __tty_read;
     tty_dev->read_page = __tty_read_pg;
     tty_dev->exec_cmd = __tty_exec_cmd;
+    tty_dev->poll = __tty_poll;
+}
+
+void
+lxconsole_spawn_ttydev()
+{
+    // tty 即是 tty0，即内核日志所在的控制台
+    __tty_setup_dev(device_addseq(NULL, &lx_consoles[0], "tty"));
+    for (int i = 0; i < CONSOLE_NR; i++) {
+        __tty_setup_dev(device_addseq(NULL, &lx_consoles[i], "tty%d", i));
+    }
 
-    waitq_init(&lx_reader);
     input_add_listener(__lxconsole_listener);
 }
 
 int
-__tty_write(struct device* dev, void* buf, size_t offset, size_t len)
+__tty_write(struct device* dev, void* buf, foff_t offset, size_t len)
 {
     struct console* console = (struct console*)dev->underlay;
     console_write(console, buf, len);
 }
 
 int
-__tty_read(struct device* dev, void* buf, size_t offset, size_t len)
+__tty_read(struct device* dev, void* buf, foff_t offset, size_t len)
 {
     struct console* console = (struct console*)dev->underlay;
 
@@ -165,7 +251,11 @@ __tty_read(struct device* dev, void* buf, size_t offset, size_t len)
     }
 
     while (count < len) {
-        pwait(&lx_reader);
+        if (!console->ttychr_pending) {
+            event_sleep_exclusive(&console->typed);
+        }
+        console->ttychr_pending = 0;
+        char ttychr = console->ttychr;
 
         if (ttychr < 0x1B) {
             // ASCII control codes
@@ -175,7 +265,7 @@ __tty_read(struct device* dev, void* buf, size_t offset, size_t len)
                     return 0;
                 case TCBS:
                     if (fifo_backone(&console->input)) {
-                        console_write_char(ttychr);
+                        console_write(console, &ttychr, 1);
                     }
                     continue;
                 case TCLF:
@@ -184,12 +274,12 @@ __tty_read(struct device* dev, void* buf, size_t offset, size_t len)
                 default:
                     break;
             }
-            print_control_code(ttychr);
+            print_control_code(console, ttychr);
             continue;
         }
 
     proceed:
-        console_write_char(ttychr);
+        console_write(console, &ttychr, 1);
         if (!fifo_putone(&console->input, ttychr) || ttychr == '\n') {
             break;
         }
@@ -197,17 +287,39 @@ __tty_read(struct device* dev, void* buf, size_t offset, size_t len)
     return count + fifo_read(&console->input, buf + count, len - count);
 }
 
+static void
+__console_deferred_flush(struct lx_event* evt, void* arg)
+{
+    // 定时器已释放自身，清除标记后的写入将重新安排刷新
+    flush_timer = NULL;
+    console_flush();
+}
+
 void
 console_schedule_flush()
 {
-    // TODO make the flush on-demand rather than periodic
+    if (!flush_deferred) {
+        console_flush();
+        return;
+    }
+
+    // 已有待执行的刷新，本次写入将一并呈现
+    if (flush_timer) {
+        return;
+    }
+
+    flush_timer = timer_signal_ms(CONSOLE_FLUSH_DELAY_MS, &flush_evt, 0);
+
+    if (!flush_timer) {
+        console_flush();
+    }
 }
 
 size_t
-__find_next_line(size_t start)
+__find_next_line(struct console* console, size_t start)
 {
     size_t p = start - 1;
-    struct fifo_buf* buffer = &lx_console.output;
+    struct fifo_buf* buffer = &console->output;
     do {
         p = (p + 1) % buffer->size;
     } while (p != buffer->wr_pos && ((char*)buffer->data)[p] != '\n');
@@ -215,16 +327,16 @@ __find_next_line(size_t start)
 }
 
 size_t
-__find_prev_line(size_t start)
+__find_prev_line(struct console* console, size_t start)
 {
     size_t p = start - 1;
-    struct fifo_buf* buffer = &lx_console.output;
+    struct fifo_buf* buffer = &console->output;
     do {
         p--;
-    } while (p < lx_console.wnd_start && p != buffer->wr_pos &&
+    } while (p < console->wnd_start && p != buffer->wr_pos &&
              ((char*)buffer->data)[p] != '\n');
 
-    if (p > lx_console.wnd_start) {
+    if (p > console->wnd_start) {
         return 0;
     }
     return p + 1;
@@ -233,9 +345,10 @@ __find_prev_line(size_t start)
 void
 console_view_up()
 {
-    struct fifo_buf* buffer = &lx_console.output;
+    struct console* console = lx_console;
+    struct fifo_buf* buffer = &console->output;
     mutex_lock(&buffer->lock);
-    fifo_set_rdptr(buffer, __find_prev_line(buffer->rd_pos));
+    fifo_set_rdptr(buffer, __find_prev_line(console, buffer->rd_pos));
     buffer->flags |= FIFO_DIRTY;
     mutex_unlock(&buffer->lock);
 
@@ -245,11 +358,12 @@ console_view_up()
 void
 console_view_down()
 {
-    struct fifo_buf* buffer = &lx_console.output;
+    struct console* console = lx_console;
+    struct fifo_buf* buffer = &console->output;
     mutex_lock(&buffer->lock);
 
-    size_t wnd = lx_console.wnd_start;
-    size_t p = __find_next_line(buffer->rd_pos);
+    size_t wnd = console->wnd_start;
+    size_t p = __find_next_line(console, buffer->rd_pos);
     fifo_set_rdptr(buffer, p > wnd ? wnd : p);
     buffer->flags |= FIFO_DIRTY;
     mutex_unlock(&buffer->lock);
@@ -260,22 +374,24 @@ console_view_down()
 void
 console_flush()
 {
-    if (mutex_on_hold(&lx_console.output.lock)) {
+    struct console* console = lx_console;
+
+    if (mutex_on_hold(&console->output.lock)) {
         return;
     }
-    if (!(lx_console.output.flags & FIFO_DIRTY)) {
+    if (!(console->output.flags & FIFO_DIRTY)) {
         return;
     }
 
-    size_t rdpos_save = lx_console.output.rd_pos;
-    tty_flush_buffer(&lx_console.output);
-    fifo_set_rdptr(&lx_console.output, rdpos_save);
+    size_t rdpos_save = console->output.rd_pos;
+    tty_flush_buffer(&console->output);
+    fifo_set_rdptr(&console->output, rdpos_save);
 
-    lx_console.output.flags &= ~FIFO_DIRTY;
+    console->output.flags &= ~FIFO_DIRTY;
 }
 
 void
-console_write(struct console* console, uint8_t* data, size_t size)
+console_write(struct console* console, const char* data, size_t size)
 {
     struct fifo_buf* fbuf = &console->output;
     mutex_lock(&console->output.lock);
@@ -295,6 +411,10 @@ console_write(struct console* console, uint8_t* data, size_t size)
             console->lines++;
         } else if (c == '\x08') {
             ptr = ptr ? ptr - 1 : fbuf->size - 1;
+            // 已显示的字符被撤回，不再只是追加
+            if (console == lx_console) {
+                tty_invalidate();
+            }
             continue;
         }
         buffer[ptr] = c;
@@ -304,36 +424,41 @@ console_write(struct console* console, uint8_t* data, size_t size)
     fifo_set_wrptr(fbuf, ptr);
 
     while (console->lines >= TTY_HEIGHT) {
-        rd_ptr = __find_next_line(rd_ptr);
+        rd_ptr = __find_next_line(console, rd_ptr);
         console->lines--;
     }
 
-    fifo_set_rdptr(&lx_console.output, rd_ptr);
+    fifo_set_rdptr(fbuf, rd_ptr);
     console->wnd_start = rd_ptr;
     fbuf->flags |= FIFO_DIRTY;
     mutex_unlock(&fbuf->lock);
 
-    if (!lx_console.flush_timer) {
-        console_flush();
+    // 后台的控制台只更新缓冲，切换至前台时才绘制
+    if (console == lx_console) {
+        console_schedule_flush();
     }
 }
 
 void
 console_write_str(char* str)
 {
-    console_write(&lx_console, str, strlen(str));
+    console_write(lx_console, str, strlen(str));
 }
 
 void
 console_write_char(char str)
 {
-    console_write(&lx_console, &str, 1);
+    console_write(lx_console, &str, 1);
 }
 
 void
 console_start_flushing()
 {
-    struct lx_timer* timer =
-      timer_run_ms(20, console_flush, NULL, TIMER_MODE_PERIODIC);
-    lx_console.flush_timer = timer;
+    event_listen(&flush_evt,
+                 &flush_listener,
+                 __console_deferred_flush,
+                 NULL,
+                 workqueue_system());
+    flush_deferred = 1;
+    console_schedule_flush();
 }
\ No newline at end of file
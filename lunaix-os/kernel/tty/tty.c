@@ -3,6 +3,7 @@
 #include <lunaix/common.h>
 #include <lunaix/spike.h>
 #include <lunaix/tty/console.h>
+#include <lunaix/tty/fbcon.h>
 #include <lunaix/tty/tty.h>
 #include <stdint.h>
 
@@ -10,13 +11,60 @@ vga_attribute* tty_vga_buffer;
 
 vga_attribute tty_theme_color = VGA_COLOR_BLACK;
 
-inline void
+#define TTY_LINE_SIZE (TTY_WIDTH * sizeof(vga_attribute))
+
+/**
+ * @brief 上一次渲染的进度。输出缓冲仅是追加时，可由此继续解析，
+ *  而无须清屏后从窗口的起点重新来过
+ *
+ */
+struct tty_render
+{
+    size_t start; // 渲染时窗口的起点
+    size_t end;   // 已解析至缓冲的何处
+    int x, y;
+    int state;
+    int g[2];
+    vga_attribute theme;
+    u32_t dirty; // 每行一位，自上次提交后有改动的行
+    int full;    // 窗口已满，其余内容不可见
+    int valid;
+};
+
+static struct tty_render tty_render;
+
+// tty_back 为渲染的目标，tty_front 为显存中现有内容的副本，
+// 提交时只将二者有差异的行写入显存
+static vga_attribute tty_back[TTY_HEIGHT * TTY_WIDTH];
+static vga_attribute tty_front[TTY_HEIGHT * TTY_WIDTH];
+
+static u8_t tty_cursor_x, tty_cursor_y;
+
+// 经由帧缓冲控制台（而非 VGA 文本模式的显存）输出
+static int tty_fb = 0;
+
+static void
+__tty_output_line(int y)
+{
+    size_t off = y * TTY_WIDTH;
+    if (tty_fb) {
+        fbcon_draw_line(y, &tty_front[off]);
+    } else {
+        memcpy(tty_vga_buffer + off, &tty_front[off], TTY_LINE_SIZE);
+    }
+}
+
+static inline void
 tty_clear()
 {
-    asm volatile("rep stosw" ::"D"(tty_vga_buffer),
+    asm volatile("rep stosw" ::"D"(tty_front),
                  "c"(TTY_HEIGHT * TTY_WIDTH),
                  "a"(tty_theme_color)
                  : "memory");
+    for (int y = 0; y < TTY_HEIGHT; y++) {
+        __tty_output_line(y);
+    }
+    tty_render.valid = 0;
 }
 
 void
@@ -33,78 +81,190 @@ tty_init(void* vga_buf)
     io_outb(0x3D5, (io_inb(0x3D5) & 0xE0) | 15);
 }
 
+void
+tty_enable_fbcon()
+{
+    tty_fb = 1;
+    tty_clear();
+    tty_set_cursor(tty_cursor_x, tty_cursor_y);
+}
+
 void
 tty_set_theme(vga_attribute fg, vga_attribute bg)
 {
     tty_theme_color = (bg << 4 | fg) << 8;
 }
 
-void
-tty_flush_buffer(struct fifo_buf* buf)
+static void
+__tty_reset_render(struct fifo_buf* buf)
 {
-    int x = 0, y = 0;
+    for (int i = 0; i < TTY_HEIGHT * TTY_WIDTH; i++) {
+        tty_back[i] = tty_theme_color;
+    }
 
-    // Clear screen
-    tty_clear();
+    tty_render = (struct tty_render){ .start = buf->rd_pos,
+                                      .end = buf->rd_pos,
+                                      .theme = tty_theme_color,
+                                      .dirty = (1U << TTY_HEIGHT) - 1,
+                                      .valid = 1 };
+}
+
+static int
+__tty_can_append(struct fifo_buf* buf)
+{
+    if (!tty_render.valid || tty_render.start != buf->rd_pos) {
+        return 0;
+    }
+
+    // 上次的终点须仍落在 [rd_pos, wr_pos] 之内，否则内容已被覆写
+    size_t used = buf->size - buf->free_len;
+    size_t rendered = (tty_render.end + buf->size - buf->rd_pos) % buf->size;
+
+    return rendered <= used;
+}
 
+static void
+__tty_render(struct fifo_buf* buf)
+{
+    struct tty_render* r = &tty_render;
     char chr;
-    int state = 0;
-    int g[2] = { 0, 0 };
-    vga_attribute current_theme = tty_theme_color;
-    while (fifo_readone_async(buf, &chr)) {
-        if (state == 0 && chr == '\033') {
-            state = 1;
-        } else if (state == 1 && chr == '[') {
-            state = 2;
-        } else if (state > 1) {
+
+    while (!r->full && fifo_readone_async(buf, &chr)) {
+        if (r->state == 0 && chr == '\033') {
+            r->state = 1;
+        } else if (r->state == 1 && chr == '[') {
+            r->state = 2;
+        } else if (r->state > 1) {
             if ('0' <= chr && chr <= '9') {
-                g[state - 2] = (chr - '0') + g[state - 2] * 10;
-            } else if (chr == ';' && state == 2) {
-                state = 3;
+                r->g[r->state - 2] = (chr - '0') + r->g[r->state - 2] * 10;
+            } else if (chr == ';' && r->state == 2) {
+                r->state = 3;
             } else {
-                if (g[0] == 39 && g[1] == 49) {
-                    current_theme = tty_theme_color;
+                if (r->g[0] == 39 && r->g[1] == 49) {
+                    r->theme = tty_theme_color;
                 } else {
-                    current_theme = (g[1] << 4 | g[0]) << 8;
+                    r->theme = (r->g[1] << 4 | r->g[0]) << 8;
                 }
-                g[0] = 0;
-                g[1] = 0;
-                state = 0;
+                r->g[0] = 0;
+                r->g[1] = 0;
+                r->state = 0;
             }
         } else {
-            state = 0;
+            r->state = 0;
             switch (chr) {
                 case '\t':
-                    x += 4;
+                    r->x += 4;
                     break;
                 case '\n':
-                    y++;
+                    r->y++;
                     // fall through
                 case '\r':
-                    x = 0;
+                    r->x = 0;
                     break;
-                // case '\x08':
-                //     *(tty_vga_buffer + x + y * TTY_WIDTH) =
-                //       (current_theme | 0x20);
-                //     break;
                 default:
-                    *(tty_vga_buffer + x + y * TTY_WIDTH) =
-                      (current_theme | chr);
-                    (x)++;
+                    tty_back[r->x + r->y * TTY_WIDTH] = (r->theme | chr);
+                    r->dirty |= 1U << r->y;
+                    r->x++;
                     break;
             }
 
-            if (x >= TTY_WIDTH) {
-                x = 0;
-                y++;
+            if (r->x >= TTY_WIDTH) {
+                r->x = 0;
+                r->y++;
             }
-            if (y >= TTY_HEIGHT) {
-                y--;
-                break;
+            if (r->y >= TTY_HEIGHT) {
+                r->y--;
+                r->full = 1;
             }
         }
     }
-    tty_set_cursor(x, y);
+
+    r->end = buf->rd_pos;
+}
+
+/**
+ * @brief 整屏重绘时，新内容若只是现有内容上移了若干行（如输出满屏后的滚动），
+ *  返回移动的行数
+ *
+ */
+static int
+__tty_find_scroll()
+{
+    for (int k = 1; k < TTY_HEIGHT; k++) {
+        if (!memcmp(tty_back,
+                    &tty_front[k * TTY_WIDTH],
+                    (TTY_HEIGHT - k) * TTY_LINE_SIZE)) {
+            return k;
+        }
+    }
+    return 0;
+}
+
+static void
+__tty_scroll(int k)
+{
+    size_t moved = (TTY_HEIGHT - k) * TTY_LINE_SIZE;
+
+    memmove(tty_front, &tty_front[k * TTY_WIDTH], moved);
+    if (tty_fb) {
+        fbcon_scroll(k);
+    } else {
+        memmove(tty_vga_buffer, tty_vga_buffer + k * TTY_WIDTH, moved);
+    }
+}
+
+static void
+__tty_commit()
+{
+    u32_t dirty = tty_render.dirty;
+
+    // 先整体移动，其后只有新露出的行有差异
+    int k;
+    if (dirty == (1U << TTY_HEIGHT) - 1 && (k = __tty_find_scroll())) {
+        __tty_scroll(k);
+    }
+
+    for (int y = 0; dirty; y++, dirty >>= 1) {
+        if (!(dirty & 1)) {
+            continue;
+        }
+
+        size_t off = y * TTY_WIDTH;
+        if (!memcmp(&tty_front[off], &tty_back[off], TTY_LINE_SIZE)) {
+            continue;
+        }
+
+        memcpy(&tty_front[off], &tty_back[off], TTY_LINE_SIZE);
+        __tty_output_line(y);
+    }
+
+    tty_render.dirty = 0;
+}
+
+void
+tty_invalidate()
+{
+    tty_render.valid = 0;
+}
+
+void
+tty_flush_buffer(struct fifo_buf* buf)
+{
+    // 仅是追加时，从上次的终点（及其解析状态）继续，只改动新增的字符
+    if (__tty_can_append(buf)) {
+        fifo_set_rdptr(buf, tty_render.end);
+    } else {
+        __tty_reset_render(buf);
+    }
+
+    __tty_render(buf);
+    __tty_commit();
+
+    // 帧缓冲上的光标是画上去的，所在的行重绘后须补画
+    if (tty_fb || tty_render.x != tty_cursor_x ||
+        tty_render.y != tty_cursor_y) {
+        tty_set_cursor(tty_render.x, tty_render.y);
+    }
 }
 
 void
@@ -113,6 +273,19 @@ tty_set_cursor(uint8_t x, uint8_t y)
     if (x >= TTY_WIDTH || y >= TTY_HEIGHT) {
         x = y = 0;
     }
+
+    if (tty_fb) {
+        u32_t old = tty_cursor_x + tty_cursor_y * TTY_WIDTH;
+        fbcon_draw_cell(tty_cursor_x, tty_cursor_y, tty_front[old]);
+        fbcon_draw_cursor(x, y, tty_front[x + y * TTY_WIDTH]);
+        tty_cursor_x = x;
+        tty_cursor_y = y;
+        return;
+    }
+
+    tty_cursor_x = x;
+    tty_cursor_y = y;
+
     u32_t pos = y * TTY_WIDTH + x;
     io_outb(0x3D4, 14);
     io_outb(0x3D5, pos / 256);
@@ -123,10 +296,11 @@ tty_set_cursor(uint8_t x, uint8_t y)
 void
 tty_clear_line(int line_num)
 {
-    asm volatile("rep stosw" ::"D"(tty_vga_buffer + line_num * TTY_WIDTH),
+    asm volatile("rep stosw" ::"D"(tty_front + line_num * TTY_WIDTH),
                  "c"(TTY_WIDTH),
                  "a"(tty_theme_color)
                  : "memory");
+    __tty_output_line(line_num);
 }
 
 void
@@ -134,7 +308,13 @@ tty_put_str_at(char* str, int x, int y)
 {
     char c;
     while ((c = (*str)) && y < TTY_HEIGHT) {
-        *(tty_vga_buffer + x + y * TTY_WIDTH) = c | tty_theme_color;
+        vga_attribute cell = c | tty_theme_color;
+        tty_front[x + y * TTY_WIDTH] = cell;
+        if (tty_fb) {
+            fbcon_draw_cell(x, y, cell);
+        } else {
+            *(tty_vga_buffer + x + y * TTY_WIDTH) = cell;
+        }
         x++;
         if (x >= TTY_WIDTH) {
             y++;
@@ -1,4 +1,7 @@
+#include <arch/x86/fpu.h>
+#include <hal/alternative.h>
 #include <lib/crc.h>
+#include <lunaix/types.h>
 
 // crc32 lookup table. (https://web.mit.edu/freebsd/head/sys/libkern/crc32.c)
 const unsigned int crc32_tab[] = {
@@ -47,6 +50,200 @@ const unsigned int crc32_tab[] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+// CRC32C (Castagnoli) 的多项式，按位反转
+#define CRC32C_POLY 0x82f63b78U
+
+// 达到此长度时以PCLMULQDQ折叠，更短的不值得为之保存寄存器中进程的FPU状态
+#define CRC_PCLMUL_MIN 256
+
+/*
+    slice-by-8 查找表：tab[k][b] 为字节 b 之后再经过 k 个零字节的余数，
+    每次可由八张表并行查得8个字节的贡献。tab[0] 即经典的逐字节查找表。
+*/
+static u32_t crc32_slice[8][256];
+static u32_t crc32c_slice[8][256];
+
+static int crc_ready;
+
+/*
+    以PCLMULQDQ折叠CRC32的常数（x^n mod P，按位反转）。
+    ref: Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+    Instruction"; Linux, arch/x86/crypto/crc32-pclmul_asm.S
+*/
+static const u64_t crc32_fold_k[] __attribute__((aligned(16))) = {
+    0x154442bd4ULL, 0x1c6e41596ULL, // R1, R2：跨64字节折叠
+    0x1751997d0ULL, 0x0ccaa009eULL, // R3, R4：跨16字节折叠
+    0x163cd6124ULL, 0,              // R5：96位至64位
+    0xffffffffULL,  0,              // 低32位的掩码
+    0x1db710641ULL, 0x1f7011641ULL, // P'与μ：Barrett约减
+};
+
+static void
+__crc_slice_init(u32_t tab[8][256], u32_t poly)
+{
+    for (u32_t i = 0; i < 256; i++) {
+        u32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (poly & -(crc & 1));
+        }
+        tab[0][i] = crc;
+    }
+
+    for (u32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            u32_t prev = tab[k - 1][i];
+            tab[k][i] = (prev >> 8) ^ tab[0][prev & 0xff];
+        }
+    }
+}
+
+void
+crc_select_impl()
+{
+    // 改写前后使用的实现不同，两张表都须建立
+    __crc_slice_init(crc32_slice, 0xedb88320U);
+    __crc_slice_init(crc32c_slice, CRC32C_POLY);
+
+    crc_ready = 1;
+}
+
+static u32_t
+__crc_slice8(u32_t tab[8][256], u32_t crc, const u8_t* data, u32_t size)
+{
+    while (size && ((ptr_t)data & 3)) {
+        crc = (crc >> 8) ^ tab[0][(crc ^ *data++) & 0xff];
+        size--;
+    }
+
+    for (; size >= 8; size -= 8, data += 8) {
+        u32_t lo = *(const u32_t*)data ^ crc;
+        u32_t hi = *(const u32_t*)(data + 4);
+        crc = tab[7][lo & 0xff] ^ tab[6][(lo >> 8) & 0xff] ^
+              tab[5][(lo >> 16) & 0xff] ^ tab[4][lo >> 24] ^
+              tab[3][hi & 0xff] ^ tab[2][(hi >> 8) & 0xff] ^
+              tab[1][(hi >> 16) & 0xff] ^ tab[0][hi >> 24];
+    }
+
+    while (size--) {
+        crc = (crc >> 8) ^ tab[0][(crc ^ *data++) & 0xff];
+    }
+
+    return crc;
+}
+
+/**
+ * @brief 以PCLMULQDQ将数据每64字节折叠为一个128位的余数，最后以Barrett约减得出CRC。
+ *  size 须为16的倍数，且不小于64
+ *
+ */
+static u32_t
+__crc32_pclmul(u32_t crc, const u8_t* data, u32_t size)
+{
+    asm volatile("movdqu (%1), %%xmm1\n"
+                 "movdqu 0x10(%1), %%xmm2\n"
+                 "movdqu 0x20(%1), %%xmm3\n"
+                 "movdqu 0x30(%1), %%xmm4\n"
+                 "movd %0, %%xmm0\n"
+                 "pxor %%xmm0, %%xmm1\n"
+                 "addl $0x40, %1\n"
+                 "subl $0x40, %2\n"
+                 "cmpl $0x40, %2\n"
+                 "jb 2f\n"
+
+                 // 四路并行，每路越过64字节折叠至下一块
+                 "movdqa (%3), %%xmm0\n"
+                 "1:\n"
+                 "movdqa %%xmm1, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "movdqu (%1), %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "movdqa %%xmm2, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm2\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm2\n"
+                 "movdqu 0x10(%1), %%xmm5\n"
+                 "pxor %%xmm5, %%xmm2\n"
+                 "movdqa %%xmm3, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm3\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm3\n"
+                 "movdqu 0x20(%1), %%xmm5\n"
+                 "pxor %%xmm5, %%xmm3\n"
+                 "movdqa %%xmm4, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm4\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm4\n"
+                 "movdqu 0x30(%1), %%xmm5\n"
+                 "pxor %%xmm5, %%xmm4\n"
+                 "addl $0x40, %1\n"
+                 "subl $0x40, %2\n"
+                 "cmpl $0x40, %2\n"
+                 "jae 1b\n"
+
+                 // 将四路合而为一，再逐16字节折叠余下的数据
+                 "2:\n"
+                 "movdqa 0x10(%3), %%xmm0\n"
+                 "movdqa %%xmm1, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "pxor %%xmm2, %%xmm1\n"
+                 "movdqa %%xmm1, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "pxor %%xmm3, %%xmm1\n"
+                 "movdqa %%xmm1, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "pxor %%xmm4, %%xmm1\n"
+                 "cmpl $0x10, %2\n"
+                 "jb 4f\n"
+                 "3:\n"
+                 "movdqa %%xmm1, %%xmm5\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pclmulqdq $0x11, %%xmm0, %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "movdqu (%1), %%xmm5\n"
+                 "pxor %%xmm5, %%xmm1\n"
+                 "addl $0x10, %1\n"
+                 "subl $0x10, %2\n"
+                 "cmpl $0x10, %2\n"
+                 "jae 3b\n"
+
+                 // 128位折叠至64位（同时补上32个零位），再至32位
+                 "4:\n"
+                 "pclmulqdq $0x01, %%xmm1, %%xmm0\n"
+                 "psrldq $0x08, %%xmm1\n"
+                 "pxor %%xmm0, %%xmm1\n"
+                 "movdqa %%xmm1, %%xmm2\n"
+                 "movdqa 0x20(%3), %%xmm0\n"
+                 "movdqa 0x30(%3), %%xmm3\n"
+                 "psrldq $0x04, %%xmm2\n"
+                 "pand %%xmm3, %%xmm1\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pxor %%xmm2, %%xmm1\n"
+
+                 // Barrett约减
+                 "movdqa 0x40(%3), %%xmm0\n"
+                 "movdqa %%xmm1, %%xmm2\n"
+                 "pand %%xmm3, %%xmm1\n"
+                 "pclmulqdq $0x10, %%xmm0, %%xmm1\n"
+                 "pand %%xmm3, %%xmm1\n"
+                 "pclmulqdq $0x00, %%xmm0, %%xmm1\n"
+                 "pxor %%xmm2, %%xmm1\n"
+                 "psrldq $0x04, %%xmm1\n"
+                 "movd %%xmm1, %0\n"
+                 : "+r"(crc), "+r"(data), "+r"(size)
+                 : "r"(crc32_fold_k)
+                 : "memory");
+
+    return crc;
+}
+
 /**
  * @brief CRC32 checksum
  *  ref: https://en.wikipedia.org/wiki/Cyclic_redundancy_check#CRC-32_algorithm
@@ -57,12 +254,69 @@ const unsigned int crc32_tab[] = {
 unsigned int
 crc32b(unsigned char* data, unsigned int size)
 {
-    unsigned int crc = (unsigned int)-1, i = 0;
+    u32_t crc = (u32_t)-1;
+
+    if (!crc_ready) {
+        for (u32_t i = 0; i < size; i++) {
+            crc = (crc >> 8) ^ crc32_tab[(crc ^ data[i]) & 0xff];
+        }
+        return ~crc;
+    }
+
+    if (size >= CRC_PCLMUL_MIN && alt_has(ALT_FEATURE_PCLMUL) &&
+        fpu_kernel_try_begin()) {
+        u32_t folded = size & ~15;
+        crc = __crc32_pclmul(crc, data, folded);
+        fpu_kernel_end();
+
+        data += folded;
+        size -= folded;
+    }
+
+    return ~__crc_slice8(crc32_slice, crc, data, size);
+}
+
+/**
+ * @brief CRC32C checksum, with the SSE4.2 crc32 instruction when available
+ *
+ * @param data
+ * @param size
+ * @return unsigned int
+ */
+unsigned int
+crc32c(unsigned char* data, unsigned int size)
+{
+    u32_t crc = (u32_t)-1;
+
+    if (!crc_ready) {
+        // 查找表尚未建立，逐位计算
+        while (size--) {
+            crc ^= *data++;
+            for (int j = 0; j < 8; j++) {
+                crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+            }
+        }
+        return ~crc;
+    }
+
+    if (!alt_has(ALT_FEATURE_SSE42)) {
+        return ~__crc_slice8(crc32c_slice, crc, data, size);
+    }
+
+    while (size && ((ptr_t)data & 3)) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*data));
+        data++;
+        size--;
+    }
+
+    for (; size >= 4; size -= 4, data += 4) {
+        asm("crc32l %1, %0" : "+r"(crc) : "rm"(*(const u32_t*)data));
+    }
 
-    while (i < size) {
-        crc = (crc >> 8) ^ crc32_tab[(crc ^ data[i]) & 0xff];
-        i = i + 1;
+    while (size--) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*data));
+        data++;
     }
 
     return ~crc;
-}
\ No newline at end of file
+}
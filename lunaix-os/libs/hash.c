@@ -1,9 +1,14 @@
 #include <lib/hash.h>
 
 /**
- * @brief Simple string hash function
+ * @brief String hash function (FNV-1a, with a final avalanche)
  *
- * ref: https://stackoverflow.com/a/7666577
+ * ref: http://www.isthe.com/chongo/tech/comp/fnv/
+ *
+ * djb2 leaves the low bits poorly mixed for short names that differ only in
+ * their last character, which is the common case for directory entries. The
+ * finalizer spreads every input bit over the whole word, so any truncation
+ * (or masking) of the result is equally good.
  *
  * @param str
  * @return unsigned int
@@ -11,14 +16,54 @@
 u32_t
 strhash_32(const char* str, u32_t truncate_to)
 {
+    u32_t len;
+    return strhash_32_len(str, truncate_to, &len);
+}
+
+/**
+ * @brief strhash_32, also yielding the length of str from the same pass
+ *
+ * @param str
+ * @param len out, strlen(str)
+ * @return u32_t
+ */
+u32_t
+strhash_32_len(const char* str, u32_t truncate_to, u32_t* len)
+{
+    *len = 0;
     if (!str)
         return 0;
 
-    u32_t hash = 5381;
-    int c;
+    const char* s = str;
+    u32_t hash = 2166136261u;
+    u8_t c;
+
+    while ((c = *s++)) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+
+    *len = s - str - 1;
+    return hash_fmix32(hash) >> (HASH_SIZE_BITS - truncate_to);
+}
+
+/**
+ * @brief strhash_32 over exactly len bytes of str, which need not be
+ * NUL-terminated. Agrees with strhash_32 when str has no NUL in it.
+ *
+ * @param str
+ * @param len
+ * @return u32_t
+ */
+u32_t
+strhash_32_n(const char* str, u32_t len, u32_t truncate_to)
+{
+    u32_t hash = 2166136261u;
 
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    for (u32_t i = 0; i < len; i++) {
+        hash ^= (u8_t)str[i];
+        hash *= 16777619u;
+    }
 
-    return hash >> (HASH_SIZE_BITS - truncate_to);
-}
\ No newline at end of file
+    return hash_fmix32(hash) >> (HASH_SIZE_BITS - truncate_to);
+}
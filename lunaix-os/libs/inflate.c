@@ -0,0 +1,418 @@
+/**
+ * @file inflate.c
+ * @brief A small, table-free deflate decoder
+ *
+ * Huffman codes are decoded bit by bit from their canonical form instead of
+ * through lookup tables, keeping the decoder tiny and free of allocations at
+ * the cost of some speed. The whole output has to fit into the destination
+ * buffer, which also serves as the sliding window.
+ *
+ * ref: https://github.com/madler/zlib/blob/develop/contrib/puff/puff.c
+ *
+ */
+#include <klibc/string.h>
+#include <lib/inflate.h>
+
+#define MAXBITS 15
+#define MAXLCODES 286
+#define MAXDCODES 30
+#define MAXCODES (MAXLCODES + MAXDCODES)
+#define FIXLCODES 288
+
+struct inflate_state
+{
+    const u8_t* in;
+    u32_t inlen;
+    u32_t incnt;
+    u32_t bitbuf;
+    u32_t bitcnt;
+
+    u8_t* out;
+    u32_t outlen;
+    u32_t outcnt;
+
+    int err;
+};
+
+struct huffman
+{
+    short* count;  // number of codes of each length
+    short* symbol; // symbols ordered by their canonical code
+};
+
+static const short lbase[29] = { 3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                 15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short lext[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short dbase[30] = { 1,     2,     3,    4,    5,    7,
+                                 9,     13,    17,   25,   33,   49,
+                                 65,    97,    129,  193,  257,  385,
+                                 513,   769,   1025, 1537, 2049, 3073,
+                                 4097,  6145,  8193, 12289, 16385, 24577 };
+static const short dext[30] = { 0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static u32_t
+__bits(struct inflate_state* s, u32_t need)
+{
+    u32_t val = s->bitbuf;
+
+    while (s->bitcnt < need) {
+        if (s->incnt == s->inlen) {
+            s->err = 1;
+            return 0;
+        }
+        val |= (u32_t)s->in[s->incnt++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+
+    return val & ((1U << need) - 1);
+}
+
+static int
+__stored(struct inflate_state* s)
+{
+    // stored blocks start at a byte boundary
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+
+    if (s->incnt + 4 > s->inlen) {
+        return -1;
+    }
+
+    u32_t len = s->in[s->incnt] | (s->in[s->incnt + 1] << 8);
+    u32_t nlen = s->in[s->incnt + 2] | (s->in[s->incnt + 3] << 8);
+    s->incnt += 4;
+
+    if (len != (~nlen & 0xffff) || s->incnt + len > s->inlen ||
+        s->outcnt + len > s->outlen) {
+        return -1;
+    }
+
+    memcpy(s->out + s->outcnt, s->in + s->incnt, len);
+    s->incnt += len;
+    s->outcnt += len;
+
+    return 0;
+}
+
+static int
+__decode(struct inflate_state* s, struct huffman* h)
+{
+    int code = 0, first = 0, index = 0;
+
+    for (int len = 1; len <= MAXBITS; len++) {
+        code |= __bits(s, 1);
+        if (s->err) {
+            return -1;
+        }
+
+        int count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Build the canonical code from the code lengths
+ *
+ * @return int 0 for a complete code, a positive number for an incomplete one,
+ * negative if it is over-subscribed
+ */
+static int
+__construct(struct huffman* h, const short* length, int n)
+{
+    short offs[MAXBITS + 1];
+    int left = 1;
+
+    for (int len = 0; len <= MAXBITS; len++) {
+        h->count[len] = 0;
+    }
+
+    for (int sym = 0; sym < n; sym++) {
+        h->count[length[sym]]++;
+    }
+
+    if (h->count[0] == n) {
+        return 0;
+    }
+
+    for (int len = 1; len <= MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) {
+            return left;
+        }
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < MAXBITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+
+    for (int sym = 0; sym < n; sym++) {
+        if (length[sym]) {
+            h->symbol[offs[length[sym]]++] = sym;
+        }
+    }
+
+    return left;
+}
+
+static int
+__codes(struct inflate_state* s,
+        struct huffman* lencode,
+        struct huffman* distcode)
+{
+    int symbol;
+
+    do {
+        symbol = __decode(s, lencode);
+        if (symbol < 0) {
+            return -1;
+        }
+
+        if (symbol < 256) {
+            if (s->outcnt == s->outlen) {
+                return -1;
+            }
+            s->out[s->outcnt++] = symbol;
+            continue;
+        }
+
+        if (symbol == 256) {
+            break;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            return -1;
+        }
+        u32_t len = lbase[symbol] + __bits(s, lext[symbol]);
+
+        symbol = __decode(s, distcode);
+        if (symbol < 0 || symbol >= 30) {
+            return -1;
+        }
+        u32_t dist = dbase[symbol] + __bits(s, dext[symbol]);
+
+        if (s->err || dist > s->outcnt || s->outcnt + len > s->outlen) {
+            return -1;
+        }
+
+        // may overlap, copy byte by byte
+        u8_t* from = s->out + s->outcnt - dist;
+        while (len--) {
+            s->out[s->outcnt++] = *from++;
+        }
+    } while (1);
+
+    return 0;
+}
+
+static int
+__fixed(struct inflate_state* s)
+{
+    static int built = 0;
+    static short lencnt[MAXBITS + 1], lensym[FIXLCODES];
+    static short distcnt[MAXBITS + 1], distsym[MAXDCODES];
+    static struct huffman lencode = { lencnt, lensym };
+    static struct huffman distcode = { distcnt, distsym };
+
+    if (!built) {
+        short lengths[FIXLCODES];
+        int sym = 0;
+
+        for (; sym < 144; sym++)
+            lengths[sym] = 8;
+        for (; sym < 256; sym++)
+            lengths[sym] = 9;
+        for (; sym < 280; sym++)
+            lengths[sym] = 7;
+        for (; sym < FIXLCODES; sym++)
+            lengths[sym] = 8;
+        __construct(&lencode, lengths, FIXLCODES);
+
+        for (sym = 0; sym < MAXDCODES; sym++)
+            lengths[sym] = 5;
+        __construct(&distcode, lengths, MAXDCODES);
+
+        built = 1;
+    }
+
+    return __codes(s, &lencode, &distcode);
+}
+
+static int
+__dynamic(struct inflate_state* s)
+{
+    static const short order[19] = { 16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                      11, 4,  12, 3, 13, 2, 14, 1, 15 };
+    short lengths[MAXCODES];
+    short lencnt[MAXBITS + 1], lensym[MAXLCODES];
+    short distcnt[MAXBITS + 1], distsym[MAXDCODES];
+    struct huffman lencode = { lencnt, lensym };
+    struct huffman distcode = { distcnt, distsym };
+    int index, err;
+
+    int nlen = __bits(s, 5) + 257;
+    int ndist = __bits(s, 5) + 1;
+    int ncode = __bits(s, 4) + 4;
+    if (s->err || nlen > MAXLCODES || ndist > MAXDCODES) {
+        return -1;
+    }
+
+    for (index = 0; index < ncode; index++) {
+        lengths[order[index]] = __bits(s, 3);
+    }
+    for (; index < 19; index++) {
+        lengths[order[index]] = 0;
+    }
+
+    // the code length code must be complete
+    if (s->err || __construct(&lencode, lengths, 19)) {
+        return -1;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol = __decode(s, &lencode);
+        if (symbol < 0) {
+            return -1;
+        }
+
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+
+        int len = 0;
+        if (symbol == 16) {
+            if (!index) {
+                return -1;
+            }
+            len = lengths[index - 1];
+            symbol = 3 + __bits(s, 2);
+        } else if (symbol == 17) {
+            symbol = 3 + __bits(s, 3);
+        } else {
+            symbol = 11 + __bits(s, 7);
+        }
+
+        if (s->err || index + symbol > nlen + ndist) {
+            return -1;
+        }
+
+        while (symbol--) {
+            lengths[index++] = len;
+        }
+    }
+
+    // without an end-of-block code, the block could never end
+    if (!lengths[256]) {
+        return -1;
+    }
+
+    // an incomplete code is only allowed for a single length
+    err = __construct(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) {
+        return -1;
+    }
+
+    err = __construct(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) {
+        return -1;
+    }
+
+    return __codes(s, &lencode, &distcode);
+}
+
+static u32_t
+__adler32(const u8_t* data, u32_t len)
+{
+    u32_t a = 1, b = 0;
+
+    while (len) {
+        // largest n that keeps b from overflowing before the reduction
+        u32_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+int
+inflate_zlib(void* dst, u32_t dst_len, const void* src, u32_t src_len)
+{
+    struct inflate_state s = {
+        .in = src, .inlen = src_len, .out = dst, .outlen = dst_len
+    };
+    const u8_t* in = src;
+
+    if (src_len < 6) {
+        return -1;
+    }
+
+    // CM = 8 (deflate), window no more than 32K, FCHECK and no FDICT
+    u32_t cmf = in[0], flg = in[1];
+    if ((cmf & 0xf) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 ||
+        (flg & 0x20)) {
+        return -1;
+    }
+    s.incnt = 2;
+
+    int last, err;
+    do {
+        last = __bits(&s, 1);
+        switch (__bits(&s, 2)) {
+            case 0:
+                err = __stored(&s);
+                break;
+            case 1:
+                err = __fixed(&s);
+                break;
+            case 2:
+                err = __dynamic(&s);
+                break;
+            default:
+                err = -1;
+                break;
+        }
+
+        if (err || s.err) {
+            return -1;
+        }
+    } while (!last);
+
+    // the adler32 trailer follows on the next byte boundary
+    if (s.incnt + 4 > s.inlen) {
+        return -1;
+    }
+
+    in += s.incnt;
+    u32_t adler = (in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+    if (adler != __adler32(s.out, s.outcnt)) {
+        return -1;
+    }
+
+    return s.outcnt;
+}
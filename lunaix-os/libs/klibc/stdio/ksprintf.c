@@ -2,9 +2,11 @@
 #include <klibc/stdio.h>
 #include <klibc/stdlib.h>
 #include <klibc/string.h>
+#include <lunaix/spike.h>
 #include <lunaix/types.h>
 
-#define NUMBUFSIZ 24
+// 足以容纳以二进制表示的32位整数
+#define NUMBUFSIZ 36
 
 static const char flag_chars[] = "#0- +";
 
@@ -19,21 +21,103 @@ static const char flag_chars[] = "#0- +";
 #define FLAG_ALT2 (1 << 8)
 #define FLAG_CAPS (1 << 9)
 
+static const char digits_lower[] = "0123456789abcdef";
+static const char digits_upper[] = "0123456789ABCDEF";
+
+// 两位十进制数 00..99 的字符，每次除以100即可得到两位
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static inline void
+__kfmt_putc(struct kfmt_out* out, char c)
+{
+    if (out->pos < out->end) {
+        out->buf[out->pos++ & out->mask] = c;
+    }
+}
+
+static inline void
+__kfmt_fill(struct kfmt_out* out, char c, int n)
+{
+    for (; n > 0 && out->pos < out->end; n--) {
+        out->buf[out->pos++ & out->mask] = c;
+    }
+}
+
+void
+kfmt_write(struct kfmt_out* out, const char* str, size_t len)
+{
+    len = MIN(len, out->end - out->pos);
+    for (size_t i = 0; i < len; i++) {
+        out->buf[out->pos++ & out->mask] = str[i];
+    }
+}
+
+/**
+ * @brief 自 end 起向前写入 num 的各位数字，返回首位数字的位置。
+ *  十进制每次取两位查表，二进制与十六进制以移位代替除法
+ *
+ */
+static char*
+__kfmt_utoa(char* end, unsigned long num, int base, int caps)
+{
+    char* p = end;
+
+    if (base == 10) {
+        while (num >= 100) {
+            unsigned long q = num / 100;
+            const char* pair = &digit_pairs[(num - q * 100) * 2];
+            *--p = pair[1];
+            *--p = pair[0];
+            num = q;
+        }
+        if (num >= 10) {
+            *--p = digit_pairs[num * 2 + 1];
+            *--p = digit_pairs[num * 2];
+        } else {
+            *--p = '0' + num;
+        }
+        return p;
+    }
+
+    const char* digits = caps ? digits_upper : digits_lower;
+    int shift = base == 16 ? 4 : 1;
+    do {
+        *--p = digits[num & (base - 1)];
+        num >>= shift;
+    } while (num);
+
+    return p;
+}
+
 size_t
-__ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs)
+kfmt_vformat(struct kfmt_out* out, const char* fmt, va_list vargs)
 {
     // This sprintf just a random implementation I found it on Internet . lol.
     //      Of course, with some modifications for porting to LunaixOS :)
 
     char numbuf[NUMBUFSIZ];
-    u32_t ptr = 0;
+    size_t start = out->pos;
     for (; *fmt; ++fmt) {
-        if (max_len && ptr >= max_len - 1) {
+        if (out->pos >= out->end) {
             break;
         }
 
         if (*fmt != '%') {
-            buffer[ptr++] = *fmt;
+            // 连续的普通字符一并写入
+            const char* lit = fmt;
+            while (fmt[1] && fmt[1] != '%') {
+                fmt++;
+            }
+            kfmt_write(out, lit, fmt - lit + 1);
             continue;
         }
 
@@ -80,7 +164,8 @@ __ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs)
         int base = 10;
         unsigned long num = 0;
         int length = 0;
-        char* data = "";
+        const char* data = "";
+        int len = -1;
     again:
         switch (*fmt) {
             case 'l':
@@ -92,7 +177,7 @@ __ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs)
             case 'i': {
                 long x = length ? va_arg(vargs, long) : va_arg(vargs, int);
                 int negative = x < 0 ? FLAG_NEGATIVE : 0;
-                num = negative ? -x : x;
+                num = negative ? -(unsigned long)x : (unsigned long)x;
                 flags |= FLAG_NUMERIC | FLAG_SIGNED | negative;
                 break;
             }
@@ -136,16 +221,13 @@ __ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs)
         }
 
         if (flags & FLAG_NUMERIC) {
-            data = itoa(num, numbuf, base);
-            int i = 0;
-            char c;
-            while ((flags & FLAG_CAPS) && (c = data[i])) {
-                data[i] = c & ~((c & 0x40) >> 1);
-                i++;
-            }
+            char* end = &numbuf[NUMBUFSIZ];
+            data = __kfmt_utoa(end, num, base, flags & FLAG_CAPS);
+            len = end - data;
         }
 
         const char* prefix = "";
+        int prefix_len = 0;
         if ((flags & FLAG_NUMERIC) && (flags & FLAG_SIGNED)) {
             if (flags & FLAG_NEGATIVE) {
                 prefix = "-";
@@ -154,48 +236,57 @@ __ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs)
             } else if (flags & FLAG_SPACEPOSITIVE) {
                 prefix = " ";
             }
+            prefix_len = *prefix ? 1 : 0;
         } else if ((flags & FLAG_NUMERIC) && (flags & FLAG_ALT) &&
-                   (base == 16 || base == -16) &&
-                   (num || (flags & FLAG_ALT2))) {
+                   base == 16 && (num || (flags & FLAG_ALT2))) {
             prefix = "0x";
+            prefix_len = 2;
         }
 
-        int len;
-        if (precision >= 0 && !(flags & FLAG_NUMERIC)) {
-            len = strnlen(data, precision);
-        } else {
-            len = strlen(data);
+        if (len < 0) {
+            if (precision >= 0) {
+                len = strnlen(data, precision);
+            } else {
+                len = strlen(data);
+            }
         }
         int zeros;
         if ((flags & FLAG_NUMERIC) && precision >= 0) {
             zeros = precision > len ? precision - len : 0;
         } else if ((flags & FLAG_NUMERIC) && (flags & FLAG_ZERO) &&
-                   !(flags & FLAG_LEFTJUSTIFY) &&
-                   len + (int)strlen(prefix) < width) {
-            zeros = width - len - strlen(prefix);
+                   !(flags & FLAG_LEFTJUSTIFY) && len + prefix_len < width) {
+            zeros = width - len - prefix_len;
         } else {
             zeros = 0;
         }
-        width -= len + zeros + strlen(prefix);
-        for (; !(flags & FLAG_LEFTJUSTIFY) && width > 0; --width) {
-            buffer[ptr++] = ' ';
+        width -= len + zeros + prefix_len;
+        if (!(flags & FLAG_LEFTJUSTIFY)) {
+            __kfmt_fill(out, ' ', width);
         }
-        for (; *prefix; ++prefix) {
-            buffer[ptr++] = *prefix;
-        }
-        for (; zeros > 0; --zeros) {
-            buffer[ptr++] = '0';
-        }
-        for (; len > 0; ++data, --len) {
-            buffer[ptr++] = *data;
-        }
-        for (; width > 0; --width) {
-            buffer[ptr++] = ' ';
+        kfmt_write(out, prefix, prefix_len);
+        __kfmt_fill(out, '0', zeros);
+        kfmt_write(out, data, len);
+        if (flags & FLAG_LEFTJUSTIFY) {
+            __kfmt_fill(out, ' ', width);
         }
     }
-    buffer[ptr++] = '\0';
 
-    return ptr;
+    return out->pos - start;
+}
+
+size_t
+__ksprintf_internal(char* buffer, char* fmt, size_t max_len, va_list vargs)
+{
+    // 为结尾的 '\0' 预留一个字节
+    struct kfmt_out out = { .buf = buffer,
+                            .mask = (size_t)-1,
+                            .pos = 0,
+                            .end = max_len ? max_len - 1 : (size_t)-1 };
+
+    kfmt_vformat(&out, fmt, vargs);
+    buffer[out.pos++] = '\0';
+
+    return out.pos;
 }
 
 size_t
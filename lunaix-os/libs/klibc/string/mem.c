@@ -1,57 +1,197 @@
+#include <arch/x86/fpu.h>
+#include <hal/alternative.h>
 #include <klibc/string.h>
 #include <stdint.h>
 
+// 不足此长度时逐字节进行，免去对齐与分派的开销
+#define MEM_SMALL 16
+// 达到此长度时使用SSE2。更短的不值得为之保存寄存器中进程的FPU状态
+#define MEM_SSE_MIN 1024
+
+typedef uint32_t __attribute__((may_alias)) mem_word_t;
+
+// 对特性的判断于启动时改写为定向的跳转，见 hal/alternative.h
+static inline int
+__mem_sse_begin(size_t num)
+{
+    return num >= MEM_SSE_MIN && alt_has(ALT_FEATURE_SSE2) &&
+           fpu_kernel_try_begin();
+}
+
+/**
+ * @brief 按双字拷贝，先以字节对齐目标地址。返回后剩余不足4字节
+ *
+ */
+static inline void
+__mem_copy_dword(uint8_t** dest, const uint8_t** src, size_t* num)
+{
+    size_t head = -(uintptr_t)*dest & 3;
+    size_t words = (*num - head) / 4;
+
+    *num -= head + words * 4;
+    asm volatile("rep movsb\n"
+                 "movl %3, %%ecx\n"
+                 "rep movsl\n"
+                 : "+D"(*dest), "+S"(*src), "+c"(head)
+                 : "r"(words)
+                 : "memory");
+}
+
+/**
+ * @brief 以SSE2每次拷贝64字节，目标对齐至16字节，源可以不对齐。返回后剩余不足64字节
+ *
+ */
+static inline void
+__mem_copy_sse(uint8_t** dest, const uint8_t** src, size_t* num)
+{
+    size_t head = -(uintptr_t)*dest & 15;
+    size_t blocks = (*num - head) / 64;
+
+    *num -= head + blocks * 64;
+    asm volatile("rep movsb\n"
+                 : "+D"(*dest), "+S"(*src), "+c"(head)
+                 :
+                 : "memory");
+    asm volatile("1:\n"
+                 "movdqu (%1), %%xmm0\n"
+                 "movdqu 0x10(%1), %%xmm1\n"
+                 "movdqu 0x20(%1), %%xmm2\n"
+                 "movdqu 0x30(%1), %%xmm3\n"
+                 "movdqa %%xmm0, (%0)\n"
+                 "movdqa %%xmm1, 0x10(%0)\n"
+                 "movdqa %%xmm2, 0x20(%0)\n"
+                 "movdqa %%xmm3, 0x30(%0)\n"
+                 "addl $0x40, %1\n"
+                 "addl $0x40, %0\n"
+                 "decl %2\n"
+                 "jnz 1b\n"
+                 : "+r"(*dest), "+r"(*src), "+r"(blocks)
+                 :
+                 : "memory");
+}
+
 void*
 memcpy(void* dest, const void* src, size_t num)
 {
-    if (!num)
-        return dest;
-    asm volatile("movl %1, %%edi\n"
-                 "rep movsb\n" ::"S"(src),
-                 "r"(dest),
-                 "c"(num)
-                 : "edi", "memory");
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    if (num >= MEM_SMALL) {
+        if (__mem_sse_begin(num)) {
+            __mem_copy_sse(&d, &s, &num);
+            fpu_kernel_end();
+        } else if (!alt_has(ALT_FEATURE_ERMSB)) {
+            __mem_copy_dword(&d, &s, &num);
+        }
+    }
+
+    asm volatile("rep movsb\n" : "+D"(d), "+S"(s), "+c"(num) : : "memory");
     return dest;
 }
 
 void*
 memmove(void* dest, const void* src, size_t num)
 {
-    uint8_t* dest_ptr = (uint8_t*)dest;
-    const uint8_t* src_ptr = (const uint8_t*)src;
-    if (dest_ptr < src_ptr) {
-        for (size_t i = 0; i < num; i++) {
-            *(dest_ptr + i) = *(src_ptr + i);
-        }
-    } else {
-        for (size_t i = num; i != 0; i--) {
-            *(dest_ptr + i - 1) = *(src_ptr + i - 1);
-        }
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // 前向拷贝时，每一块总是先读后写，目标位于源之前时即便重叠亦无妨
+    if (d <= s || d >= s + num) {
+        return memcpy(dest, src, num);
     }
+
+    // 目标与源的尾部重叠，自后向前拷贝
+    d += num;
+    s += num;
+
+    while (num && ((uintptr_t)d & 3)) {
+        *--d = *--s;
+        num--;
+    }
+
+    size_t words = num / 4;
+    if (words) {
+        mem_word_t* dw = (mem_word_t*)d - 1;
+        const mem_word_t* sw = (const mem_word_t*)s - 1;
+        asm volatile("std\n"
+                     "rep movsl\n"
+                     "cld\n"
+                     : "+D"(dw), "+S"(sw), "+c"(words)
+                     :
+                     : "memory");
+        d -= num & ~3;
+        s -= num & ~3;
+        num &= 3;
+    }
+
+    while (num--) {
+        *--d = *--s;
+    }
+
     return dest;
 }
 
 void*
 memset(void* ptr, int value, size_t num)
 {
-    asm volatile("movl %1, %%edi\n"
-                 "rep stosb\n" ::"c"(num),
-                 "r"(ptr),
-                 "a"(value)
-                 : "edi", "memory");
+    uint8_t* d = (uint8_t*)ptr;
+    uint32_t v = (uint8_t)value * 0x01010101U;
+
+    if (num >= MEM_SMALL && __mem_sse_begin(num)) {
+        size_t head = -(uintptr_t)d & 15;
+        size_t blocks = (num - head) / 64;
+
+        num -= head + blocks * 64;
+        asm volatile("rep stosb\n" : "+D"(d), "+c"(head) : "a"(v) : "memory");
+        asm volatile("movd %2, %%xmm0\n"
+                     "pshufd $0, %%xmm0, %%xmm0\n"
+                     "1:\n"
+                     "movdqa %%xmm0, (%0)\n"
+                     "movdqa %%xmm0, 0x10(%0)\n"
+                     "movdqa %%xmm0, 0x20(%0)\n"
+                     "movdqa %%xmm0, 0x30(%0)\n"
+                     "addl $0x40, %0\n"
+                     "decl %1\n"
+                     "jnz 1b\n"
+                     : "+r"(d), "+r"(blocks)
+                     : "r"(v)
+                     : "memory");
+        fpu_kernel_end();
+    } else if (num >= MEM_SMALL && !alt_has(ALT_FEATURE_ERMSB)) {
+        size_t head = -(uintptr_t)d & 3;
+        size_t words = (num - head) / 4;
+
+        num -= head + words * 4;
+        asm volatile("rep stosb\n"
+                     "movl %2, %%ecx\n"
+                     "rep stosl\n"
+                     : "+D"(d), "+c"(head)
+                     : "r"(words), "a"(v)
+                     : "memory");
+    }
+
+    asm volatile("rep stosb\n" : "+D"(d), "+c"(num) : "a"(v) : "memory");
     return ptr;
 }
 
 int
 memcmp(const void* ptr1, const void* ptr2, size_t num)
 {
-    uint8_t* p1 = (uint8_t*)ptr1;
-    uint8_t* p2 = (uint8_t*)ptr2;
+    const uint8_t* p1 = (const uint8_t*)ptr1;
+    const uint8_t* p2 = (const uint8_t*)ptr2;
+
+    // 逐个双字比较，直至找到有差异的双字，再于其中逐字节定位
+    while (num >= 4 && *(const mem_word_t*)p1 == *(const mem_word_t*)p2) {
+        p1 += 4;
+        p2 += 4;
+        num -= 4;
+    }
+
     for (size_t i = 0; i < num; i++) {
-        int diff = *(p1 + i) - *(p2 + i);
+        int diff = p1[i] - p2[i];
         if (diff != 0) {
             return diff;
         }
     }
     return 0;
-}
\ No newline at end of file
+}
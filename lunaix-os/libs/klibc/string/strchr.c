@@ -1,9 +1,30 @@
 #include <klibc/string.h>
 
+#include "word.h"
+
 const char*
 strchr(const char* str, int character)
 {
     char c = (char)character;
+
+    while (!STR_WORD_ALIGNED(str)) {
+        if (*str == c) {
+            return str;
+        }
+        if (!*str) {
+            return NULL;
+        }
+        str++;
+    }
+
+    // 跳过既不含结尾、也不含目标字符的双字
+    const str_word_t* w = (const str_word_t*)str;
+    str_word_t mask = STR_REPEAT(c);
+    while (!STR_HAS_ZERO(*w) && !STR_HAS_ZERO(*w ^ mask)) {
+        w++;
+    }
+
+    str = (const char*)w;
     while ((*str)) {
         if (*str == c) {
             return str;
@@ -11,4 +32,4 @@ strchr(const char* str, int character)
         str++;
     }
     return c == '\0' ? str : NULL;
-}
\ No newline at end of file
+}
@@ -1,8 +1,34 @@
 #include <klibc/string.h>
 
+#include "word.h"
+
 int
 streq(const char* a, const char* b)
 {
+    // 两者对齐的余量相同时，才能同时按双字对齐地读取
+    if (((uintptr_t)a & 3) == ((uintptr_t)b & 3)) {
+        while (!STR_WORD_ALIGNED(a)) {
+            if (*a != *b) {
+                return 0;
+            }
+            if (!*a) {
+                return 1;
+            }
+            a++;
+            b++;
+        }
+
+        const str_word_t* wa = (const str_word_t*)a;
+        const str_word_t* wb = (const str_word_t*)b;
+        while (*wa == *wb && !STR_HAS_ZERO(*wa)) {
+            wa++;
+            wb++;
+        }
+
+        a = (const char*)wa;
+        b = (const char*)wb;
+    }
+
     while (*a == *b) {
         if (!(*a)) {
             return 1;
@@ -11,4 +37,4 @@ streq(const char* a, const char* b)
         b++;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,12 +1,30 @@
 #include <klibc/string.h>
 
+#include "word.h"
+
 size_t
 strlen(const char* str)
 {
-    size_t len = 0;
-    while (str[len])
-        len++;
-    return len;
+    const char* s = str;
+
+    while (!STR_WORD_ALIGNED(s)) {
+        if (!*s) {
+            return s - str;
+        }
+        s++;
+    }
+
+    const str_word_t* w = (const str_word_t*)s;
+    while (!STR_HAS_ZERO(*w)) {
+        w++;
+    }
+
+    s = (const char*)w;
+    while (*s) {
+        s++;
+    }
+
+    return s - str;
 }
 
 size_t
@@ -15,4 +33,4 @@ strnlen(const char* str, size_t max_len) {
     while (str[len] && len <= max_len)
         len++;
     return len;
-}
\ No newline at end of file
+}
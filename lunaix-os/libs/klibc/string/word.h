@@ -0,0 +1,24 @@
+#ifndef __KLIBC_STRING_WORD_H
+#define __KLIBC_STRING_WORD_H
+
+#include <stdint.h>
+
+/*
+    逐个双字扫描字符串。双字按其自身的大小对齐读取，因而不会跨越页边界，
+    即便越过了字符串的结尾，读到的也总是字符串所在的页。
+*/
+
+typedef uint32_t __attribute__((may_alias)) str_word_t;
+
+#define STR_WORD_ALIGNED(p) (!((uintptr_t)(p)&3))
+
+#define STR_ONES 0x01010101U
+#define STR_HIGHS 0x80808080U
+
+// 某个字节为零时非零（仅最低的零字节处必定准确，足以判断存在与否）
+#define STR_HAS_ZERO(w) (((w)-STR_ONES) & ~(w)&STR_HIGHS)
+
+// 将一个字节复制到双字的每个字节
+#define STR_REPEAT(c) ((uint8_t)(c)*STR_ONES)
+
+#endif /* __KLIBC_STRING_WORD_H */
@@ -0,0 +1,205 @@
+#include <lunaix/lunistd.h>
+#include <lunaix/mman.h>
+#include <lunaix/spike.h>
+#include <ulibc/stdlib.h>
+
+#include "ulibc.h"
+
+// A size-class allocator for the user programs linked into the kernel.
+//
+// Its state is part of the per-process ulibc data (see ulibc.h), and the
+// chunks are carved right after it. It assumes to be the only user of
+// sbrk/brk in the process.
+//
+// Small requests are rounded up to a power of two and served from one free
+// list per class. A freed chunk goes back to its list and is reused without
+// entering the kernel; the lists are per process, and thus per thread, as
+// processes here are single threaded. New chunks are carved from a window
+// that grows by at least UMALLOC_GROW bytes per sbrk. Requests above
+// UMALLOC_SMALL_MAX get an anonymous mapping of their own, which is unmapped
+// on free.
+
+#define UMALLOC_MIN_SHIFT 4
+#define UMALLOC_SMALL_MAX (1U << (UMALLOC_MIN_SHIFT + UMALLOC_NR_CLASSES - 1))
+#define UMALLOC_GROW (64 * 1024)
+
+// marks a chunk that has its own mapping
+#define UMALLOC_MAPPED 0xffffffffU
+
+// 8 bytes, to keep the payload 8-byte aligned
+struct uchunk
+{
+    u32_t class;
+    u32_t size; // length of the mapping, mapped chunks only
+};
+
+#define UMALLOC_STATE (&ULIBC_DATA->malloc)
+#define CHUNK_OF(ptr) ((struct uchunk*)(ptr)-1)
+
+static void __USER__
+__umalloc_fill(void* dst, int c, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        ((char*)dst)[i] = c;
+    }
+}
+
+static void __USER__
+__umalloc_copy(void* dst, const void* src, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        ((char*)dst)[i] = ((const char*)src)[i];
+    }
+}
+
+static struct umalloc_state* __USER__
+__umalloc_state()
+{
+    struct umalloc_state* st = UMALLOC_STATE;
+
+    if (st->end) {
+        return st;
+    }
+
+    // first call, the heap is still empty and its first page is all zero
+    if (sbrk(UMALLOC_GROW) == (void*)-1) {
+        return NULL;
+    }
+
+    st->top = (char*)ROUNDUP(UHEAP_START + sizeof(struct ulibc_data), 16);
+    st->end = (char*)(UHEAP_START + UMALLOC_GROW);
+    return st;
+}
+
+static void* __USER__
+__umalloc_carve(struct umalloc_state* st, size_t size)
+{
+    if ((size_t)(st->end - st->top) < size) {
+        size_t grow = ROUNDUP(size, UMALLOC_GROW);
+        if (sbrk(grow) == (void*)-1) {
+            return NULL;
+        }
+        st->end += grow;
+    }
+
+    void* chunk = st->top;
+    st->top += size;
+    return chunk;
+}
+
+static void* __USER__
+__umalloc_mapped(size_t size)
+{
+    size_t len = ROUNDUP(size + sizeof(struct uchunk), PG_SIZE);
+    struct uchunk* chunk = mmap(
+      NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+    if (chunk == MAP_FAILED) {
+        return NULL;
+    }
+
+    chunk->class = UMALLOC_MAPPED;
+    chunk->size = len;
+    return chunk + 1;
+}
+
+static size_t __USER__
+__umalloc_usable(struct uchunk* chunk)
+{
+    if (chunk->class == UMALLOC_MAPPED) {
+        return chunk->size - sizeof(struct uchunk);
+    }
+    return (1U << (chunk->class + UMALLOC_MIN_SHIFT)) - sizeof(struct uchunk);
+}
+
+void* __USER__
+malloc(size_t size)
+{
+    size_t need = size + sizeof(struct uchunk);
+
+    if (need < size) {
+        return NULL;
+    }
+
+    if (need > UMALLOC_SMALL_MAX) {
+        return __umalloc_mapped(size);
+    }
+
+    struct umalloc_state* st = __umalloc_state();
+    if (!st) {
+        return NULL;
+    }
+
+    u32_t class = 0;
+    while ((1U << (class + UMALLOC_MIN_SHIFT)) < need) {
+        class++;
+    }
+
+    struct uchunk* chunk = st->free[class];
+    if (chunk) {
+        st->free[class] = *(void**)(chunk + 1);
+    } else {
+        chunk = __umalloc_carve(st, 1U << (class + UMALLOC_MIN_SHIFT));
+        if (!chunk) {
+            return NULL;
+        }
+    }
+
+    chunk->class = class;
+    return chunk + 1;
+}
+
+void __USER__
+free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    struct uchunk* chunk = CHUNK_OF(ptr);
+
+    if (chunk->class == UMALLOC_MAPPED) {
+        munmap(chunk, chunk->size);
+        return;
+    }
+
+    struct umalloc_state* st = UMALLOC_STATE;
+    *(void**)ptr = st->free[chunk->class];
+    st->free[chunk->class] = chunk;
+}
+
+void* __USER__
+calloc(size_t nmemb, size_t size)
+{
+    size_t total = nmemb * size;
+    if (size && total / size != nmemb) {
+        return NULL;
+    }
+
+    void* ptr = malloc(total);
+    if (ptr) {
+        // fresh heap and mapped pages are already zero, recycled ones are not
+        __umalloc_fill(ptr, 0, total);
+    }
+    return ptr;
+}
+
+void* __USER__
+realloc(void* ptr, size_t size)
+{
+    if (!ptr) {
+        return malloc(size);
+    }
+
+    size_t usable = __umalloc_usable(CHUNK_OF(ptr));
+    if (size <= usable) {
+        return ptr;
+    }
+
+    void* new_ptr = malloc(size);
+    if (new_ptr) {
+        __umalloc_copy(new_ptr, ptr, usable);
+        free(ptr);
+    }
+    return new_ptr;
+}
@@ -8,16 +8,41 @@
 // program.
 // FIXME Eliminate this when we're able to load program.
 
+#define UFMT_MAX 512
+
+static int __USER__
+__uvfprintf(FILE* stream, const char* fmt, va_list args)
+{
+    char buf[UFMT_MAX];
+    size_t sz = __ksprintf_internal(buf, fmt, UFMT_MAX, args);
+
+    if (!stream) {
+        // no stream could be set up, write it out as is
+        return write(stdout, buf, sz);
+    }
+
+    return fwrite(buf, 1, sz, stream) ? (int)sz : EOF;
+}
+
+int __USER__
+fprintf(FILE* stream, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    int ret = __uvfprintf(stream, fmt, args);
+
+    va_end(args);
+    return ret;
+}
+
 void __USER__
 printf(const char* fmt, ...)
 {
-    const char buf[512];
     va_list args;
     va_start(args, fmt);
 
-    size_t sz = __ksprintf_internal(buf, fmt, 512, args);
-
-    write(stdout, buf, sz);
+    __uvfprintf(ustdout, fmt, args);
 
     va_end(args);
-}
\ No newline at end of file
+}
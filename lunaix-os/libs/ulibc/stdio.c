@@ -0,0 +1,223 @@
+#include <lunaix/lunistd.h>
+#include <lunaix/spike.h>
+#include <ulibc/stdio.h>
+#include <ulibc/stdlib.h>
+
+#include "ulibc.h"
+
+// Buffered output streams.
+//
+// Data is collected in the stream's buffer and handed to write(2) in one go
+// once the buffer is full, or, for line buffered streams, once a newline has
+// been written. Writes at least as large as the buffer skip it. Streams are
+// write only; the mode string of fdopen is accepted but not interpreted.
+//
+// Output that does not end in a newline (e.g. a prompt) stays in the buffer
+// until the next flush, so it has to be flushed explicitly.
+
+static int __USER__
+__ufile_write(FILE* stream, const char* data, size_t len)
+{
+    while (len) {
+        int n = write(stream->fd, (void*)data, len);
+        if (n <= 0) {
+            stream->error = 1;
+            return EOF;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int __USER__
+__ufile_drain(FILE* stream)
+{
+    u32_t len = stream->len;
+    stream->len = 0;
+    return __ufile_write(stream, stream->buf, len);
+}
+
+static int __USER__
+__ufile_register(FILE* stream)
+{
+    struct ulibc_data* ud = ULIBC_DATA;
+    for (int i = 0; i < UFILE_MAX; i++) {
+        if (!ud->files[i]) {
+            ud->files[i] = stream;
+            return 0;
+        }
+    }
+    return EOF;
+}
+
+static void __USER__
+__ufile_unregister(FILE* stream)
+{
+    struct ulibc_data* ud = ULIBC_DATA;
+    for (int i = 0; i < UFILE_MAX; i++) {
+        if (ud->files[i] == stream) {
+            ud->files[i] = NULL;
+        }
+    }
+    if (ud->out == stream) {
+        ud->out = NULL;
+    }
+}
+
+FILE* __USER__
+fdopen(int fd, const char* mode)
+{
+    FILE* stream = calloc(1, sizeof(FILE));
+    char* buf = malloc(BUFSIZ);
+
+    if (!stream || !buf || __ufile_register(stream)) {
+        free(stream);
+        free(buf);
+        return NULL;
+    }
+
+    stream->fd = fd;
+    stream->buf = buf;
+    stream->size = BUFSIZ;
+    stream->own_buf = 1;
+    stream->mode = isatty(fd) > 0 ? _IOLBF : _IOFBF;
+    return stream;
+}
+
+FILE* __USER__
+__ustdout()
+{
+    struct ulibc_data* ud = ULIBC_DATA;
+    if (!ud->out) {
+        ud->out = fdopen(stdout, "w");
+    }
+    return ud->out;
+}
+
+int __USER__
+fflush(FILE* stream)
+{
+    if (stream) {
+        return stream->len ? __ufile_drain(stream) : 0;
+    }
+
+    int ret = 0;
+    struct ulibc_data* ud = ULIBC_DATA;
+    for (int i = 0; i < UFILE_MAX; i++) {
+        if (ud->files[i] && fflush(ud->files[i])) {
+            ret = EOF;
+        }
+    }
+    return ret;
+}
+
+int __USER__
+fclose(FILE* stream)
+{
+    int ret = fflush(stream);
+
+    __ufile_unregister(stream);
+    if (close(stream->fd)) {
+        ret = EOF;
+    }
+    if (stream->own_buf) {
+        free(stream->buf);
+    }
+    free(stream);
+
+    return ret;
+}
+
+int __USER__
+setvbuf(FILE* stream, char* buf, int mode, size_t size)
+{
+    if (stream->len || mode < _IOFBF || mode > _IONBF) {
+        return EOF;
+    }
+
+    if (mode == _IONBF) {
+        buf = NULL;
+        size = 0;
+    } else if (!size) {
+        return EOF;
+    }
+
+    int own_buf = 0;
+    if (mode != _IONBF && !buf) {
+        if (!(buf = malloc(size))) {
+            return EOF;
+        }
+        own_buf = 1;
+    }
+
+    if (stream->own_buf) {
+        free(stream->buf);
+    }
+
+    stream->buf = buf;
+    stream->size = size;
+    stream->own_buf = own_buf;
+    stream->mode = mode;
+    return 0;
+}
+
+size_t __USER__
+fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream)
+{
+    const char* data = (const char*)ptr;
+    size_t len = size * nmemb;
+
+    if (!len) {
+        return 0;
+    }
+
+    if (len >= stream->size) {
+        if (fflush(stream) || __ufile_write(stream, data, len)) {
+            return 0;
+        }
+        return nmemb;
+    }
+
+    if (stream->size - stream->len < len && __ufile_drain(stream)) {
+        return 0;
+    }
+
+    int newline = 0;
+    char* dst = stream->buf + stream->len;
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = data[i];
+        newline |= data[i] == '\n';
+    }
+    stream->len += len;
+
+    if (newline && stream->mode == _IOLBF && __ufile_drain(stream)) {
+        return 0;
+    }
+
+    return nmemb;
+}
+
+int __USER__
+fputc(int c, FILE* stream)
+{
+    unsigned char ch = (unsigned char)c;
+    return fwrite(&ch, 1, 1, stream) ? ch : EOF;
+}
+
+int __USER__
+fputs(const char* s, FILE* stream)
+{
+    size_t len = 0;
+    while (s[len]) {
+        len++;
+    }
+    return fwrite(s, 1, len, stream) == len ? 0 : EOF;
+}
+
+void __USER__
+exit(int status)
+{
+    fflush(NULL);
+    _exit(status);
+}
@@ -0,0 +1,45 @@
+#ifndef __LUNAIX_ULIBC_H
+#define __LUNAIX_ULIBC_H
+
+#include <lunaix/common.h>
+#include <lunaix/types.h>
+
+// Per-process state of ulibc.
+//
+// The user programs linked into the kernel cannot keep state in the kernel's
+// data sections, so it lives at the bottom of the process's own heap
+// (UHEAP_START), whose first page the kernel always keeps mapped. It starts
+// out zeroed and is inherited by fork like any other heap memory.
+
+#define UMALLOC_NR_CLASSES 12
+
+#define UFILE_MAX 16
+
+struct umalloc_state
+{
+    void* free[UMALLOC_NR_CLASSES];
+    char* top;
+    char* end;
+};
+
+struct ufile
+{
+    int fd;
+    int mode;
+    int error;
+    char* buf;
+    u32_t size;
+    u32_t len;
+    int own_buf;
+};
+
+struct ulibc_data
+{
+    struct umalloc_state malloc;
+    struct ufile* files[UFILE_MAX]; // open streams, flushed on exit
+    struct ufile* out;              // stream on the stdout descriptor
+};
+
+#define ULIBC_DATA ((struct ulibc_data*)UHEAP_START)
+
+#endif /* __LUNAIX_ULIBC_H */
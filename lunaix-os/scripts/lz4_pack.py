@@ -0,0 +1,103 @@
+"""
+Compress a raw kernel image into an LZ4 legacy frame (the format of
+"lz4 -l"), which is decoded by the higher half kernel loader before
+paging is enabled (see arch/x86/unlz4.c).
+
+    usage: lz4_pack.py INPUT OUTPUT
+
+A greedy, single-probe hash match finder is used. It compresses a bit
+worse than the reference lz4 but needs nothing beyond the python
+standard library, and the decoder does not care how the matches were
+chosen.
+"""
+
+import struct
+import sys
+
+LEGACY_MAGIC = 0x184C2102
+BLOCK_SIZE = 8 << 20
+
+MIN_MATCH = 4
+MAX_OFFSET = 0xFFFF
+
+# reference: lz4_Block_format.md, "End of block conditions"
+LAST_LITERALS = 5
+MF_LIMIT = 12
+
+
+def put_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def put_sequence(out, literals, offset, match):
+    lit = len(literals)
+    token = min(lit, 15) << 4
+    if match:
+        token |= min(match - MIN_MATCH, 15)
+    out.append(token)
+
+    if lit >= 15:
+        put_length(out, lit - 15)
+    out += literals
+
+    if not match:
+        return
+
+    out += struct.pack("<H", offset)
+    if match - MIN_MATCH >= 15:
+        put_length(out, match - MIN_MATCH - 15)
+
+
+def compress_block(src):
+    out = bytearray()
+    table = {}
+    end = len(src)
+    match_limit = end - MF_LIMIT
+    match_end = end - LAST_LITERALS
+
+    anchor = 0
+    i = 0
+    while i < match_limit:
+        key = src[i:i + MIN_MATCH]
+        ref = table.get(key)
+        table[key] = i
+
+        if ref is None or i - ref > MAX_OFFSET:
+            i += 1
+            continue
+
+        n = MIN_MATCH
+        while i + n < match_end and src[ref + n] == src[i + n]:
+            n += 1
+
+        put_sequence(out, src[anchor:i], i - ref, n)
+
+        i += n
+        anchor = i
+
+    put_sequence(out, src[anchor:], 0, 0)
+    return out
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip(), file=sys.stderr)
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    out = bytearray(struct.pack("<I", LEGACY_MAGIC))
+    for off in range(0, len(data), BLOCK_SIZE):
+        block = compress_block(data[off:off + BLOCK_SIZE])
+        out += struct.pack("<I", len(block)) + block
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(out)
+
+
+if __name__ == "__main__":
+    main()
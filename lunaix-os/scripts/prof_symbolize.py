@@ -0,0 +1,103 @@
+"""
+Symbolize samples of the kernel sampling profiler (LUNAIX_PROFILER).
+
+Each line of /profile/cpu<N> is
+
+    <pid> <k|u> <eip> [<return address> ...]
+
+with addresses in hex. Samples are resolved against the symbol table of
+the kernel ELF (build/bin/lunaix.bin) and reported either as a flat
+profile or, with --folded, as folded stacks understood by flamegraph.pl.
+
+    usage: prof_symbolize.py [--nm NM] [--folded] [--by-pid]
+                             KERNEL_ELF SAMPLE_FILE...
+
+Use "-" as SAMPLE_FILE to read from stdin.
+"""
+
+import argparse
+import bisect
+import subprocess
+import sys
+from collections import Counter
+
+
+def load_symbols(nm, elf):
+    out = subprocess.run([nm, "-n", "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+
+    addrs, names = [], []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) != 3 or parts[1] not in "tTwW":
+            continue
+        addrs.append(int(parts[0], 16))
+        names.append(parts[2])
+
+    return addrs, names
+
+
+def symbolize(symtab, addr):
+    addrs, names = symtab
+    i = bisect.bisect_right(addrs, addr) - 1
+    if i < 0:
+        return "0x%x" % addr
+    return names[i]
+
+
+def read_samples(files):
+    for path in files:
+        f = sys.stdin if path == "-" else open(path)
+        for line in f:
+            parts = line.split()
+            if len(parts) < 3:
+                continue
+            yield int(parts[0]), parts[1] == "u", \
+                [int(x, 16) for x in parts[2:]]
+        if f is not sys.stdin:
+            f.close()
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--nm", default="i686-elf-nm")
+    parser.add_argument("--folded", action="store_true",
+                        help="emit folded stacks for flamegraph.pl")
+    parser.add_argument("--by-pid", action="store_true",
+                        help="prefix every stack with its pid")
+    parser.add_argument("elf")
+    parser.add_argument("samples", nargs="+")
+    args = parser.parse_args()
+
+    symtab = load_symbols(args.nm, args.elf)
+
+    flat = Counter()
+    stacks = Counter()
+    total = 0
+
+    for pid, user, addrs in read_samples(args.samples):
+        total += 1
+        if user:
+            frames = ["[user]"]
+        else:
+            frames = [symbolize(symtab, a) for a in addrs]
+
+        if args.by_pid:
+            frames.append("pid %d" % pid)
+
+        flat[frames[0]] += 1
+        # folded stacks go from the outermost caller to the leaf
+        stacks[";".join(reversed(frames))] += 1
+
+    if args.folded:
+        for stack, n in stacks.most_common():
+            print("%s %d" % (stack, n))
+        return
+
+    print("%d samples" % total)
+    for name, n in flat.most_common():
+        print("%6.2f%% %8d  %s" % (100.0 * n / total, n, name))
+
+
+if __name__ == "__main__":
+    main()